@@ -0,0 +1,400 @@
+/** 
+ * @file avatar_bake_bench.cpp
+ * @brief Measures how long an appearance edit takes to reach the avatar bake.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+// Builds a layer set shaped like an upper body bake (a skin base, then
+// clothing layers that show through alpha params), and applies the same
+// series of appearance edits to it twice with LLBakeCompositor: once
+// recompositing the whole bake for every edit, as the viewer did, and
+// once recompositing only from the changed layer, over the changed
+// region.  Edits are:
+//  - slider: an alpha param's weight, e.g. sleeve length
+//  - color: a clothing layer's color
+//  - skin: the skin color, which is under everything
+// Reported, per kind of edit, is the time from the edit until the bake is
+// up to date (mean and max), and how many layer pixels were redrawn.  The
+// GL compositor does the same amount of layer work; its timings depend on
+// the card, so this measures it on the CPU.
+
+#include "linden_common.h"
+
+#include <iostream>
+#include <vector>
+
+#include "apr_getopt.h"
+#include "apr_pools.h"
+
+#include "llapr.h"
+#include "llbakecompositor.h"
+#include "llerrorcontrol.h"
+#include "llimage.h"
+#include "llmath.h"
+#include "llrand.h"
+#include "lltimer.h"
+
+enum EEditType
+{
+	EDIT_SLIDER,
+	EDIT_COLOR,
+	EDIT_SKIN,
+	EDIT_COUNT
+};
+
+static const char* EDIT_NAMES[EDIT_COUNT] = { "slider", "color", "skin" };
+
+// An alpha param as LLTexLayerParamAlpha has it: a ramp that its weight
+// thresholds, with a domain of softness.
+struct LLBenchParam
+{
+	S32 mLayer;
+	S32 mMask;
+	LLPointer<LLImageRaw> mRamp;
+	LLRectf mRegion;
+	F32 mDomain;
+};
+
+struct LLBenchEdit
+{
+	EEditType mType;
+	S32 mParam;
+	S32 mChannel;
+	F32 mValue;
+};
+
+struct LLBenchStats
+{
+	LLBenchStats() : mEdits(0), mTime(0.0), mMaxTime(0.0), mPixels(0.0) {}
+
+	S32 mEdits;
+	F64 mTime;
+	F64 mMaxTime;
+	F64 mPixels;
+};
+
+// As LLImageTGA::decodeAndProcess()
+static void process_ramp(const LLImageRaw* ramp, F32 domain, F32 weight, LLImageRaw* mask)
+{
+	U8 lut[256];
+	F32 scale = 1.f / domain;
+	F32 offset = (1.f - domain) * llclampf(1.f - weight);
+	F32 bias = -(scale * offset);
+	for (S32 i = 0; i < 256; i++)
+	{
+		lut[i] = (U8)llclampb(255.f * (i / 255.f * scale + bias));
+	}
+
+	const U8* src = ramp->getData();
+	U8* dst = mask->getData();
+	for (S32 i = 0; i < ramp->getDataSize(); i++)
+	{
+		dst[i] = lut[src[i]];
+	}
+}
+
+// Zero outside the rect, rising from 1 to 255 towards its top inside it
+static LLPointer<LLImageRaw> make_ramp(S32 size, const LLRect& rect)
+{
+	LLPointer<LLImageRaw> ramp = new LLImageRaw(size, size, 1);
+	memset(ramp->getData(), 0, ramp->getDataSize());
+	for (S32 y = rect.mBottom; y < rect.mTop; y++)
+	{
+		U8 value = (U8)(1 + 254 * (y - rect.mBottom) / llmax(1, rect.getHeight() - 1));
+		memset(ramp->getData() + y * size + rect.mLeft, value, rect.getWidth());
+	}
+	return ramp;
+}
+
+static LLPointer<LLImageRaw> make_image(S32 size, S32 components)
+{
+	LLPointer<LLImageRaw> image = new LLImageRaw(size, size, components);
+	U8* data = image->getData();
+	for (S32 i = 0; i < image->getDataSize(); i++)
+	{
+		data[i] = (U8)ll_rand(256);
+	}
+	return image;
+}
+
+static LLColor4U random_color()
+{
+	return LLColor4U(ll_rand(256), ll_rand(256), ll_rand(256), 255);
+}
+
+static void build_layers(S32 size, LLBakeCompositor::layer_list_t& layers, std::vector<LLBenchParam>& params)
+{
+	// skin
+	LLBakeCompositor::Layer skin;
+	skin.mImage = make_image(size, 3);
+	skin.mColor = LLColor4U(230, 190, 170, 255);
+	skin.mWriteAllChannels = TRUE;
+	layers.push_back(skin);
+
+	// tattoo, over everything
+	LLBakeCompositor::Layer tattoo;
+	tattoo.mImage = make_image(size, 4);
+	layers.push_back(tattoo);
+
+	// clothing: undershirt, shirt, gloves and jacket, each in two parts
+	// with a sleeve or length slider
+	const S32 PIECES = 8;
+	for (S32 i = 0; i < PIECES; i++)
+	{
+		LLBakeCompositor::Layer layer;
+		layer.mImage = make_image(size, (i % 3) ? 3 : 4);
+		layer.mColor = random_color();
+		layer.mColorSpecified = TRUE;
+
+		S32 width = size / 8 + ll_rand(size / 3);
+		S32 height = size / 8 + ll_rand(size / 3);
+		S32 left = ll_rand(size - width);
+		S32 bottom = ll_rand(size - height);
+		LLBenchParam param;
+		param.mLayer = i + 2;
+		param.mMask = 0;
+		param.mRamp = make_ramp(size, LLRect(left, bottom + height, left + width, bottom));
+		param.mRegion = LLBakeDirtyTracker::calcMaskRegion(param.mRamp);
+		param.mDomain = .05f + ll_frand(.2f);
+
+		LLBakeCompositor::Mask mask;
+		mask.mImage = new LLImageRaw(size, size, 1);
+		process_ramp(param.mRamp, param.mDomain, .5f, mask.mImage);
+		layer.mMasks.push_back(mask);
+
+		layers.push_back(layer);
+		params.push_back(param);
+	}
+}
+
+static void make_edits(S32 count, S32 param_count, std::vector<LLBenchEdit>& edits)
+{
+	for (S32 i = 0; i < count; i++)
+	{
+		LLBenchEdit edit;
+		edit.mType = (EEditType)(i % EDIT_COUNT);
+		if (edit.mType == EDIT_SKIN && (i / EDIT_COUNT) % 4)
+		{
+			// skin edits are rarer
+			edit.mType = EDIT_SLIDER;
+		}
+		edit.mParam = ll_rand(param_count);
+		edit.mChannel = ll_rand(3);
+		edit.mValue = ll_frand();
+		edits.push_back(edit);
+	}
+}
+
+static void run_edits(LLBakeCompositor& compositor, const std::vector<LLBenchParam>& params,
+					  const std::vector<LLBenchEdit>& edits, LLBenchStats* stats)
+{
+	LLTimer timer;
+
+	// the first bake isn't an edit
+	compositor.update();
+
+	for (std::vector<LLBenchEdit>::const_iterator iter = edits.begin(); iter != edits.end(); ++iter)
+	{
+		const LLBenchEdit& edit = *iter;
+		const LLBenchParam& param = params[edit.mParam];
+
+		timer.reset();
+		if (edit.mType == EDIT_SLIDER)
+		{
+			LLBakeCompositor::Layer layer = compositor.getLayer(param.mLayer);
+			LLPointer<LLImageRaw> mask = new LLImageRaw(compositor.getWidth(), compositor.getHeight(), 1);
+			process_ramp(param.mRamp, param.mDomain, edit.mValue, mask);
+			layer.mMasks[param.mMask].mImage = mask;
+			compositor.setLayer(param.mLayer, layer, param.mRegion);
+		}
+		else if (edit.mType == EDIT_COLOR)
+		{
+			LLBakeCompositor::Layer layer = compositor.getLayer(param.mLayer);
+			layer.mColor.mV[edit.mChannel] = (U8)(edit.mValue * 255.f);
+			compositor.setLayer(param.mLayer, layer, LLBakeCompositor::calcLayerRegion(layer));
+		}
+		else
+		{
+			LLBakeCompositor::Layer layer = compositor.getLayer(0);
+			layer.mColor.mV[VX] = (U8)(200.f + edit.mValue * 55.f);
+			compositor.setLayer(0, layer);
+		}
+		compositor.update();
+		F64 elapsed = timer.getElapsedTimeF64();
+
+		LLBenchStats& stat = stats[edit.mType];
+		stat.mEdits++;
+		stat.mTime += elapsed;
+		stat.mMaxTime = llmax(stat.mMaxTime, elapsed);
+		stat.mPixels += compositor.getLastPixelCount();
+	}
+}
+
+static void report(std::ostream& s, const char* name, const LLBenchStats* stats, S32 size)
+{
+	for (S32 i = 0; i < EDIT_COUNT; i++)
+	{
+		const LLBenchStats& stat = stats[i];
+		if (!stat.mEdits)
+		{
+			continue;
+		}
+		s << llformat("%8s%8s%8d%12.2f%12.2f%14.2f",
+					  name, EDIT_NAMES[i], stat.mEdits,
+					  stat.mTime * 1000.0 / stat.mEdits, stat.mMaxTime * 1000.0,
+					  stat.mPixels / stat.mEdits / (size * size))
+		  << std::endl;
+	}
+}
+
+static const apr_getopt_option_t BENCH_CL_OPTIONS[] =
+{
+	{"help", 'h', 0, "Print the help message."},
+	{"size", 's', 1, "Width and height of the bake (default: 512)."},
+	{"edits", 'e', 1, "Number of edits (default: 300)."},
+	{0, 0, 0, 0}
+};
+
+void stream_usage(std::ostream& s, const char* app)
+{
+	s << "Usage: " << app << " [OPTIONS]" << std::endl
+	  << std::endl;
+
+	s << "Applies a series of appearance edits to an upper body bake, once" << std::endl
+	  << "recompositing the whole bake for each and once recompositing only" << std::endl
+	  << "what changed, and reports how long each edit took to reach the bake." << std::endl << std::endl;
+
+	s << "Options: " << std::endl;
+	const apr_getopt_option_t* option = &BENCH_CL_OPTIONS[0];
+	while(option->name)
+	{
+		s << "  ";
+		s << "  -" << (char)option->optch << ", --" << option->name
+		  << std::endl;
+		s << "\t" << option->description << std::endl << std::endl;
+		++option;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	LLError::initForApplication(".");
+	LLError::setDefaultLevel(LLError::LEVEL_WARN);
+
+	ll_init_apr();
+
+	apr_pool_t* pool = NULL;
+	if(APR_SUCCESS != apr_pool_create(&pool, NULL))
+	{
+		std::cerr << "Unable to initialize pool" << std::endl;
+		return 1;
+	}
+	apr_getopt_t* os = NULL;
+	if(APR_SUCCESS != apr_getopt_init(&os, pool, argc, argv))
+	{
+		std::cerr << "Unable to parse options" << std::endl;
+		return 1;
+	}
+
+	S32 size = 512;
+	S32 edit_count = 300;
+
+	apr_status_t apr_err;
+	const char* opt_arg = NULL;
+	int opt_id = 0;
+	while(true)
+	{
+		apr_err = apr_getopt_long(os, BENCH_CL_OPTIONS, &opt_id, &opt_arg);
+		if(APR_STATUS_IS_EOF(apr_err)) break;
+		if(apr_err)
+		{
+			char buf[255];		/* Flawfinder: ignore */
+			std::cerr << "Error parsing options: "
+					  << apr_strerror(apr_err, buf, 255) << std::endl;
+			return 1;
+		}
+		switch (opt_id)
+		{
+		case 'h':
+			stream_usage(std::cout, argv[0]);
+			return 0;
+		case 's':
+			size = llclamp(atoi(opt_arg), 16, 2048);
+			break;
+		case 'e':
+			edit_count = llmax(1, atoi(opt_arg));
+			break;
+		default:
+			stream_usage(std::cerr, argv[0]);
+			return 1;
+		}
+	}
+
+	// the same layers and edits for both runs
+	LLBakeCompositor::layer_list_t layers;
+	std::vector<LLBenchParam> params;
+	build_layers(size, layers, params);
+	std::vector<LLBenchEdit> edits;
+	make_edits(edit_count, (S32)params.size(), edits);
+
+	LLBakeCompositor full(size, size);
+	LLBakeCompositor incremental(size, size);
+	for (LLBakeCompositor::layer_list_t::iterator iter = layers.begin(); iter != layers.end(); ++iter)
+	{
+		full.addLayer(*iter);
+		incremental.addLayer(*iter);
+	}
+	full.setClearAlpha(TRUE);
+	incremental.setClearAlpha(TRUE);
+	incremental.setCaching(TRUE);
+
+	std::cout << full.getLayerCount() << " layers at " << size << "x" << size
+			  << ", " << edit_count << " edits" << std::endl << std::endl;
+	std::cout << llformat("%8s%8s%8s%12s%12s%14s",
+						  "Bake", "Edit", "Count", "Mean ms", "Max ms", "Layer images") << std::endl;
+
+	LLBenchStats full_stats[EDIT_COUNT];
+	run_edits(full, params, edits, full_stats);
+	report(std::cout, "full", full_stats, size);
+
+	LLBenchStats incremental_stats[EDIT_COUNT];
+	run_edits(incremental, params, edits, incremental_stats);
+	report(std::cout, "dirty", incremental_stats, size);
+
+	LLPointer<LLImageRaw> reference = new LLImageRaw;
+	incremental.compositeAll(reference);
+	if (memcmp(reference->getData(), incremental.getComposite()->getData(), reference->getDataSize()))
+	{
+		std::cerr << "Incremental bake differs from a full composite" << std::endl;
+		return 1;
+	}
+
+	ll_cleanup_apr();
+	return 0;
+}
@@ -0,0 +1,311 @@
+/** 
+ * @file image_decode_bench.cpp
+ * @brief Decodes a corpus of JPEG2000 textures on the image worker pool and reports throughput.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+// Loads a set of .j2c files and decodes them the way the viewer does,
+// through LLImageWorker requests on an ImageDecode LLWorkerThread, first
+// with one thread and then with a pool.  Each run first asks for every
+// texture at a coarse discard level, as the viewer does for a newly seen
+// texture, and then for every texture at full resolution.  Reported:
+//  - time from request until the coarse level is usable (mean and max)
+//  - full resolution images/sec and megapixels/sec
+
+#include "linden_common.h"
+
+#include <iostream>
+#include <vector>
+
+#include "apr_getopt.h"
+#include "apr_pools.h"
+
+#include "llapr.h"
+#include "llerrorcontrol.h"
+#include "llimage.h"
+#include "llimagej2c.h"
+#include "llimageworker.h"
+#include "llsys.h"
+#include "lltimer.h"
+#include "llworkerthread.h"
+
+struct LLDecodeRunStats
+{
+	LLDecodeRunStats()
+	:	mFirstMean(0.0),
+		mFirstMax(0.0),
+		mFullTime(0.0),
+		mFullPixels(0),
+		mFailed(0)
+	{
+	}
+
+	F64 mFirstMean;
+	F64 mFirstMax;
+	F64 mFullTime;
+	U64 mFullPixels;
+	S32 mFailed;
+};
+
+static void wait_for_batch(LLWorkerThread& thread, LLImageDecodeBatch& batch)
+{
+	while (batch.update() > 0)
+	{
+		thread.update(0);
+		ms_sleep(1);
+	}
+}
+
+static void run_batch(LLWorkerThread& thread, std::vector<LLPointer<LLImageJ2C> >& images,
+					  S32 first_discard, LLDecodeRunStats& stats)
+{
+	LLImageDecodeBatch batch;
+
+	// Coarse level of everything, as textures first come into view
+	for (std::vector<LLPointer<LLImageJ2C> >::iterator iter = images.begin(); iter != images.end(); ++iter)
+	{
+		LLImageJ2C* image = *iter;
+		batch.addImage(image, llmax(first_discard, (S32)image->getDiscardLevel()));
+	}
+	wait_for_batch(thread, batch);
+
+	F64 total = 0.0;
+	for (S32 i = 0; i < batch.getCount(); ++i)
+	{
+		F64 decode_time = batch.getDecodeTime(i);
+		total += decode_time;
+		stats.mFirstMax = llmax(stats.mFirstMax, decode_time);
+	}
+	stats.mFirstMean = total / (F64)batch.getCount();
+	batch.clear();
+
+	// Then everything at full resolution
+	LLTimer timer;
+	for (std::vector<LLPointer<LLImageJ2C> >::iterator iter = images.begin(); iter != images.end(); ++iter)
+	{
+		batch.addImage(*iter);
+	}
+	wait_for_batch(thread, batch);
+	stats.mFullTime = timer.getElapsedTimeF64();
+
+	for (S32 i = 0; i < batch.getCount(); ++i)
+	{
+		LLImageRaw* raw = batch.getDecodedImage(i);
+		if (raw)
+		{
+			stats.mFullPixels += (U64)raw->getWidth() * raw->getHeight();
+		}
+		else
+		{
+			stats.mFailed++;
+		}
+	}
+	batch.clear();
+
+	// let the thread delete the finished workers
+	while (thread.getNumDeletes())
+	{
+		thread.update(0);
+	}
+}
+
+static void report(std::ostream& s, S32 threads, S32 count, const LLDecodeRunStats& stats, F64 base_time)
+{
+	s << llformat("%7d%12.2f%12.2f%12.1f%12.2f%10.2f",
+				  threads,
+				  stats.mFirstMean * 1000.0,
+				  stats.mFirstMax * 1000.0,
+				  stats.mFullTime > 0.0 ? count / stats.mFullTime : 0.0,
+				  stats.mFullTime > 0.0 ? stats.mFullPixels / stats.mFullTime / 1000000.0 : 0.0,
+				  stats.mFullTime > 0.0 ? base_time / stats.mFullTime : 0.0);
+	if (stats.mFailed)
+	{
+		s << "  (" << stats.mFailed << " failed)";
+	}
+	s << std::endl;
+}
+
+static const apr_getopt_option_t BENCH_CL_OPTIONS[] =
+{
+	{"help", 'h', 0, "Print the help message."},
+	{"threads", 't', 1, "Decode threads for the pooled run (default: number of cores)."},
+	{"first-discard", 'f', 1, "Discard level of the first, coarse request (default: 3)."},
+	{"loops", 'l', 1, "Decode the corpus this many times per run (default: 1)."},
+	{"debug", 'd', 0, "Emit full debug logs."},
+	{0, 0, 0, 0}
+};
+
+void stream_usage(std::ostream& s, const char* app)
+{
+	s << "Usage: " << app << " [OPTIONS] <file.j2c> [<file.j2c> ...]" << std::endl
+	  << std::endl;
+
+	s << "Decodes the given JPEG2000 textures through the image worker" << std::endl
+	  << "thread on one thread and on a pool, and reports decode throughput" << std::endl
+	  << "and the time until a coarse discard level is usable." << std::endl << std::endl;
+
+	s << "Options: " << std::endl;
+	const apr_getopt_option_t* option = &BENCH_CL_OPTIONS[0];
+	while(option->name)
+	{
+		s << "  ";
+		s << "  -" << (char)option->optch << ", --" << option->name
+		  << std::endl;
+		s << "\t" << option->description << std::endl << std::endl;
+		++option;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	LLError::initForApplication(".");
+	LLError::setDefaultLevel(LLError::LEVEL_WARN);
+
+	ll_init_apr();
+
+	apr_pool_t* pool = NULL;
+	if(APR_SUCCESS != apr_pool_create(&pool, NULL))
+	{
+		std::cerr << "Unable to initialize pool" << std::endl;
+		return 1;
+	}
+	apr_getopt_t* os = NULL;
+	if(APR_SUCCESS != apr_getopt_init(&os, pool, argc, argv))
+	{
+		std::cerr << "Unable to parse options" << std::endl;
+		return 1;
+	}
+
+	S32 threads = gSysCPU.getNumCores();
+	S32 first_discard = 3;
+	S32 loops = 1;
+
+	apr_status_t apr_err;
+	const char* opt_arg = NULL;
+	int opt_id = 0;
+	while(true)
+	{
+		apr_err = apr_getopt_long(os, BENCH_CL_OPTIONS, &opt_id, &opt_arg);
+		if(APR_STATUS_IS_EOF(apr_err)) break;
+		if(apr_err)
+		{
+			char buf[255];		/* Flawfinder: ignore */
+			std::cerr << "Error parsing options: "
+					  << apr_strerror(apr_err, buf, 255) << std::endl;
+			return 1;
+		}
+		switch (opt_id)
+		{
+		case 'h':
+			stream_usage(std::cout, argv[0]);
+			return 0;
+		case 't':
+			threads = llmax(1, atoi(opt_arg));
+			break;
+		case 'f':
+			first_discard = llclamp(atoi(opt_arg), 0, MAX_DISCARD_LEVEL);
+			break;
+		case 'l':
+			loops = llmax(1, atoi(opt_arg));
+			break;
+		case 'd':
+			LLError::setDefaultLevel(LLError::LEVEL_DEBUG);
+			break;
+		default:
+			stream_usage(std::cerr, argv[0]);
+			return 1;
+		}
+	}
+
+	if (os->ind >= argc)
+	{
+		stream_usage(std::cerr, argv[0]);
+		return 1;
+	}
+
+	LLImage::initClass(NULL);
+
+	std::vector<LLPointer<LLImageJ2C> > images;
+	for (S32 i = os->ind; i < argc; ++i)
+	{
+		LLPointer<LLImageJ2C> image = new LLImageJ2C;
+		if (image->loadAndValidate(argv[i]))
+		{
+			images.push_back(image);
+		}
+		else
+		{
+			std::cerr << "Skipping " << argv[i] << ": " << LLImage::getLastError() << std::endl;
+		}
+	}
+	if (images.empty())
+	{
+		std::cerr << "No images to decode" << std::endl;
+		return 1;
+	}
+	std::vector<LLPointer<LLImageJ2C> > corpus;
+	for (S32 loop = 0; loop < loops; ++loop)
+	{
+		corpus.insert(corpus.end(), images.begin(), images.end());
+	}
+
+	std::cout << images.size() << " images x " << loops << " loops, "
+			  << gSysCPU.getNumCores() << " cores, "
+			  << LLImageJ2C::getEngineInfo() << std::endl << std::endl;
+	std::cout << llformat("%7s%12s%12s%12s%12s%10s",
+						  "Threads", "First ms", "First max", "Images/s", "MPix/s", "Speedup") << std::endl;
+
+	F64 base_time = 0.0;
+	for (S32 run_threads = 1; ; run_threads = threads)
+	{
+		LLDecodeRunStats stats;
+		{
+			LLWorkerThread thread("ImageDecode", true, run_threads);
+			LLImageWorker::initImageWorker(&thread);
+			run_batch(thread, corpus, first_discard, stats);
+			LLImageWorker::initImageWorker(NULL);
+		}
+		if (run_threads == 1)
+		{
+			base_time = stats.mFullTime;
+		}
+		report(std::cout, run_threads, (S32)corpus.size(), stats, base_time);
+
+		if (run_threads == threads)
+		{
+			break;
+		}
+	}
+
+	corpus.clear();
+	images.clear();
+	LLImage::cleanupClass();
+	ll_cleanup_apr();
+	return 0;
+}
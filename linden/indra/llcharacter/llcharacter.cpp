@@ -37,6 +37,8 @@
 #include "linden_common.h"
 
 #include "llcharacter.h"
+#include "llcriticaldamp.h"
+#include "lljobpool.h"
 #include "llstring.h"
 
 #define SKEL_HEADER "Linden Skeleton 1.0"
@@ -55,7 +57,8 @@ LLCharacter::LLCharacter()
 	mPreferredPelvisHeight( 0.f ),
 	mSex( SEX_FEMALE ),
 	mAppearanceSerialNum( 0 ),
-	mSkeletonSerialNum( 0 )
+	mSkeletonSerialNum( 0 ),
+	mDeferredUpdateType( NORMAL_UPDATE )
 {
 	mMotionController.setCharacter( this );
 	sInstances.push_back(this);
@@ -199,6 +202,74 @@ void LLCharacter::updateMotions(e_update_t update_type)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// beginDeferredUpdate()
+//-----------------------------------------------------------------------------
+void LLCharacter::beginDeferredUpdate(e_update_t update_type)
+{
+	mDeferredUpdateType = update_type;
+	if (update_type != HIDDEN_UPDATE)
+	{
+		// unpause if the number of outstanding pause requests has dropped to the initial one
+		if (mMotionController.isPaused() && mPauseRequest->getNumRefs() == 1)
+		{
+			mMotionController.unpauseAllMotions();
+		}
+	}
+	mMotionController.beginDeferredUpdate();
+}
+
+//-----------------------------------------------------------------------------
+// updateDeferred()
+//-----------------------------------------------------------------------------
+void LLCharacter::updateDeferred()
+{
+	if (mDeferredUpdateType == HIDDEN_UPDATE)
+	{
+		mMotionController.updateMotionsMinimal();
+	}
+	else
+	{
+		mMotionController.updateMotions(mDeferredUpdateType == FORCE_UPDATE);
+		getRootJoint()->updateWorldMatrixChildren();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// endDeferredUpdate()
+//-----------------------------------------------------------------------------
+void LLCharacter::endDeferredUpdate()
+{
+	mMotionController.endDeferredUpdate();
+}
+
+static void update_deferred_character(S32 index, void* userdata)
+{
+	std::vector<LLCharacter*>* characters = (std::vector<LLCharacter*>*)userdata;
+	(*characters)[index]->updateDeferred();
+}
+
+//-----------------------------------------------------------------------------
+// runDeferredUpdates()
+//-----------------------------------------------------------------------------
+// static
+void LLCharacter::runDeferredUpdates(const std::vector<LLCharacter*>& characters, LLJobPool* pool)
+{
+	LLFastTimer t(LLFastTimer::FTM_UPDATE_ANIMATION);
+
+	// motions look up shared damping constants; keep the cache from
+	// growing under them
+	LLCriticalDamp::setCacheReadOnly(TRUE);
+	pool->run((S32)characters.size(), update_deferred_character, (void*)&characters);
+	LLCriticalDamp::setCacheReadOnly(FALSE);
+
+	for (std::vector<LLCharacter*>::const_iterator iter = characters.begin();
+		 iter != characters.end(); ++iter)
+	{
+		(*iter)->endDeferredUpdate();
+	}
+}
+
 
 //-----------------------------------------------------------------------------
 // deactivateAllMotions()
@@ -46,6 +46,7 @@
 #include "llthread.h"
 
 class LLPolyMesh;
+class LLJobPool;
 
 class LLPauseRequestHandle : public LLThreadSafeRefCount
 {
@@ -130,6 +131,10 @@ public:
 	// updates all visual parameters for this character
 	virtual void updateVisualParams();
 
+	// motions call this rather than updateVisualParams(), which may
+	// only run on the main thread
+	void requestVisualParamUpdate() { mMotionController.requestVisualParamUpdate(); }
+
 	virtual void addDebugText( const std::string& text ) = 0;
 
 	virtual const LLUUID&	getID() = 0;
@@ -168,6 +173,18 @@ public:
 	enum e_update_t { NORMAL_UPDATE, HIDDEN_UPDATE, FORCE_UPDATE };
 	void updateMotions(e_update_t update_type);
 
+	// parallel alternative to updateMotions()
+	// Call beginDeferredUpdate() on the main thread, then updateDeferred()
+	// from any thread, then endDeferredUpdate() on the main thread.
+	// updateDeferred() also updates the skeleton's world matrices.
+	void beginDeferredUpdate(e_update_t update_type);
+	void updateDeferred();
+	void endDeferredUpdate();
+
+	// runs updateDeferred() for each character on the job pool's threads,
+	// then endDeferredUpdate() on this one
+	static void runDeferredUpdates(const std::vector<LLCharacter*>& characters, LLJobPool* pool);
+
 	LLAnimPauseRequest requestPause();
 	BOOL areAnimationsPaused() { return mMotionController.isPaused(); }
 	void setAnimTimeFactor(F32 factor) { mMotionController.setTimeFactor(factor); }
@@ -272,6 +289,7 @@ protected:
 	U32					mAppearanceSerialNum;
 	U32					mSkeletonSerialNum;
 	LLAnimPauseRequest	mPauseRequest;
+	e_update_t			mDeferredUpdateType;
 
 
 private:
@@ -38,6 +38,7 @@
 #include "lljoint.h"
 
 #include "llmath.h"
+#include "llskeleton.h"
 
 S32 LLJoint::sNumUpdates = 0;
 S32 LLJoint::sNumTouches = 0;
@@ -50,6 +51,8 @@ LLJoint::LLJoint()
 {
 	mName = "unnamed";
 	mParent = NULL;
+	mSkeleton = NULL;
+	mSkeletonIndex = -1;
 	mXform.setScaleChildOffset(TRUE);
 	mXform.setScale(LLVector3(1.0f, 1.0f, 1.0f));
 	mDirtyFlags = MATRIX_DIRTY | ROTATION_DIRTY | POSITION_DIRTY;
@@ -67,9 +70,12 @@ LLJoint::LLJoint(const std::string &name, LLJoint *parent)
 {
 	mName = "unnamed";
 	mParent = NULL;
+	mSkeleton = NULL;
+	mSkeletonIndex = -1;
 	mXform.setScaleChildOffset(TRUE);
 	mXform.setScale(LLVector3(1.0f, 1.0f, 1.0f));
 	mDirtyFlags = MATRIX_DIRTY | ROTATION_DIRTY | POSITION_DIRTY;
+	mUpdateXform = TRUE;
 	mJointNum = 0;
 
 	setName(name);
@@ -91,6 +97,10 @@ LLJoint::~LLJoint()
 		mParent->removeChild( this );
 	}
 	removeAllChildren();
+	if (mSkeleton)
+	{
+		mSkeleton->removeJoint(this);
+	}
 }
 
 
@@ -179,6 +189,10 @@ void LLJoint::addChild(LLJoint* joint)
 	joint->mXform.setParent(&mXform);
 	joint->mParent = this;	
 	joint->touch();
+	if (mSkeleton)
+	{
+		mSkeleton->invalidate();
+	}
 }
 
 
@@ -195,6 +209,10 @@ void LLJoint::removeChild(LLJoint* joint)
 		joint->mXform.setParent(NULL);
 		joint->mParent = NULL;
 		joint->touch();
+		if (mSkeleton)
+		{
+			mSkeleton->invalidate();
+		}
 	}
 }
 
@@ -214,6 +232,10 @@ void LLJoint::removeAllChildren()
 		joint->mParent = NULL;
 		joint->touch();
 	}
+	if (mSkeleton)
+	{
+		mSkeleton->invalidate();
+	}
 }
 
 
@@ -446,6 +468,13 @@ void LLJoint::updateWorldPRSParent()
 //-----------------------------------------------------------------------------
 void LLJoint::updateWorldMatrixChildren()
 {	
+	if (mSkeleton && mSkeleton->getRootJoint() == this)
+	{
+		// same walk, without the recursion
+		mSkeleton->updateWorldMatrices();
+		return;
+	}
+
 	if (!this->mUpdateXform) return;
 
 	if (mDirtyFlags & MATRIX_DIRTY)
@@ -468,7 +497,14 @@ void LLJoint::updateWorldMatrix()
 	if (mDirtyFlags & MATRIX_DIRTY)
 	{
 		sNumUpdates++;
-		mXform.updateMatrix(FALSE);
+		if (mSkeleton)
+		{
+			mSkeleton->updateJoint(mSkeletonIndex);
+		}
+		else
+		{
+			mXform.updateMatrix(FALSE);
+		}
 		mDirtyFlags = 0x0;
 	}
 }
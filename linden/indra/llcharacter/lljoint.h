@@ -46,6 +46,8 @@
 #include "xform.h"
 #include "lldarray.h"
 
+class LLSkeleton;
+
 const S32 LL_CHARACTER_MAX_JOINTS_PER_MESH = 15;
 const U32 LL_CHARACTER_MAX_JOINTS = 32; // must be divisible by 4!
 const U32 LL_HAND_JOINT_NUM = 31;
@@ -58,6 +60,8 @@ const F32 LL_MAX_PELVIS_OFFSET = 5.f;
 //-----------------------------------------------------------------------------
 class LLJoint
 {
+	friend class LLSkeleton;
+
 public:
 	// priority levels, from highest to lowest
 	enum JointPriority
@@ -87,6 +91,10 @@ protected:
 	// explicit transformation members
 	LLXformMatrix		mXform;
 
+	// flattened hierarchy this joint belongs to, if any
+	LLSkeleton*			mSkeleton;
+	S32					mSkeletonIndex;
+
 public:
 	U32				mDirtyFlags;
 	BOOL			mUpdateXform;
@@ -176,6 +184,8 @@ public:
 
 	virtual BOOL isAnimatable() { return TRUE; }
 
+	LLSkeleton* getSkeleton() const { return mSkeleton; }
+
 	S32 getJointNum() const { return mJointNum; }
 	void setJointNum(S32 joint_num) { mJointNum = joint_num; }
 };
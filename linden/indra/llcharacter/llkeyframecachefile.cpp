@@ -0,0 +1,452 @@
+/** 
+ * @file llkeyframecachefile.cpp
+ * @brief A mapped file of decoded keyframe animations.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llkeyframecachefile.h"
+
+#include <algorithm>
+
+#include "llbvhconsts.h"
+#include "llhandmotion.h"
+
+static const U32 KEYFRAME_CACHE_MAGIC = 0x4c4c4b43; // "LLKC"
+
+//-----------------------------------------------------------------------------
+// RecordReader
+// Hands out the parts of a record in place, padded as append() wrote them.
+// Once a part would run past the end of the record every read fails.
+//-----------------------------------------------------------------------------
+class RecordReader
+{
+public:
+	RecordReader(const U8* data, U32 size) : mPos(data), mEnd(data + size), mFailed(false) {}
+
+	template <class T>
+	const T* read(U32 count)
+	{
+		U64 size = (U64)count * sizeof(T);
+		if (mFailed || size > (U64)(mEnd - mPos))
+		{
+			mFailed = true;
+			return NULL;
+		}
+		const T* data = (const T*)mPos;
+		mPos += llmin((U64)(mEnd - mPos), (size + 3) & ~(U64)3);
+		return data;
+	}
+
+	bool failed() const { return mFailed; }
+
+private:
+	const U8* mPos;
+	const U8* mEnd;
+	bool mFailed;
+};
+
+LLKeyframeCacheFile::LLKeyframeCacheFile()
+	: mCount(0),
+	  mIndex(NULL),
+	  mFileOut(NULL),
+	  mFileOutSize(0)
+{
+}
+
+LLKeyframeCacheFile::~LLKeyframeCacheFile()
+{
+	close();
+	if (mFileOut)
+	{
+		fclose(mFileOut);
+		LLFile::remove(mFilename + ".tmp");
+	}
+}
+
+bool LLKeyframeCacheFile::open(const std::string& filename)
+{
+	close();
+	mFilename = filename;
+	if (!mFile.open(filename, 0, LLMappedFile::READ_ONLY))
+	{
+		// might not have a file, which is normal
+		return false;
+	}
+
+	const U64 size = mFile.getSize();
+	const Header* header = (const Header*)mFile.getData();
+	if (size < sizeof(Header)
+		|| header->mMagic != KEYFRAME_CACHE_MAGIC
+		|| header->mVersion != VERSION)
+	{
+		llinfos << "Keyframe cache version changed, discarding " << filename << llendl;
+		mFile.close();
+		return false;
+	}
+	if (header->mIndexOffset < sizeof(Header)
+		|| (header->mIndexOffset & 3)
+		|| header->mIndexOffset + (U64)header->mCount * sizeof(IndexEntry) > size)
+	{
+		llwarns << "Keyframe cache " << filename << " is damaged, discarding" << llendl;
+		mFile.close();
+		return false;
+	}
+
+	mCount = (S32)header->mCount;
+	mIndex = (const IndexEntry*)(mFile.getData() + header->mIndexOffset);
+	return true;
+}
+
+void LLKeyframeCacheFile::close()
+{
+	mFile.close();
+	mCount = 0;
+	mIndex = NULL;
+}
+
+LLKeyframeMotion::JointMotionList* LLKeyframeCacheFile::load(const LLUUID& id) const
+{
+	if (!mIndex)
+	{
+		return NULL;
+	}
+	IndexEntry key;
+	key.mID = id;
+	const IndexEntry* end = mIndex + mCount;
+	const IndexEntry* found = std::lower_bound(mIndex, end, key);
+	if (found == end || found->mID != id)
+	{
+		return NULL;
+	}
+	if (found->mOffset < sizeof(Header)
+		|| (found->mOffset & 3)
+		|| (U64)found->mOffset + found->mSize > mFile.getSize())
+	{
+		llwarns << "Keyframe cache entry for " << id << " is damaged" << llendl;
+		return NULL;
+	}
+
+	RecordReader reader(mFile.getData() + found->mOffset, found->mSize);
+	const ListRecord* record = reader.read<ListRecord>(1);
+	if (!record
+		|| record->mNumJoints > LL_CHARACTER_MAX_JOINTS
+		|| record->mHandPose > LLHandMotion::NUM_HAND_POSES)
+	{
+		llwarns << "Keyframe cache entry for " << id << " is damaged" << llendl;
+		return NULL;
+	}
+	const char* emote_name = reader.read<char>(record->mEmoteNameLength);
+
+	LLKeyframeMotion::JointMotionList* list = new LLKeyframeMotion::JointMotionList;
+	list->mDuration = record->mDuration;
+	list->mLoop = record->mLoop;
+	list->mLoopInPoint = record->mLoopInPoint;
+	list->mLoopOutPoint = record->mLoopOutPoint;
+	list->mEaseInDuration = record->mEaseInDuration;
+	list->mEaseOutDuration = record->mEaseOutDuration;
+	list->mBasePriority = (LLJoint::JointPriority)record->mBasePriority;
+	list->mMaxPriority = (LLJoint::JointPriority)record->mMaxPriority;
+	list->mHandPose = (LLHandMotion::eHandPose)record->mHandPose;
+	list->mPelvisBBox = LLBBoxLocal(record->mPelvisMin, record->mPelvisMax);
+	if (emote_name)
+	{
+		list->mEmoteName.assign(emote_name, record->mEmoteNameLength);
+	}
+
+	list->mJointMotionArray.reserve(record->mNumJoints);
+	for (U32 i = 0; i < record->mNumJoints && !reader.failed(); ++i)
+	{
+		const JointRecord* joint_record = reader.read<JointRecord>(1);
+		if (!joint_record)
+		{
+			break;
+		}
+		const char* name = reader.read<char>(joint_record->mNameLength);
+		const F32* scale_times = reader.read<F32>(joint_record->mNumKeys[0]);
+		const LLVector3* scales = reader.read<LLVector3>(joint_record->mNumKeys[0]);
+		const F32* rotation_times = reader.read<F32>(joint_record->mNumKeys[1]);
+		const LLQuaternion* rotations = reader.read<LLQuaternion>(joint_record->mNumKeys[1]);
+		const F32* position_times = reader.read<F32>(joint_record->mNumKeys[2]);
+		const LLVector3* positions = reader.read<LLVector3>(joint_record->mNumKeys[2]);
+		if (reader.failed()
+			|| joint_record->mNumKeys[0] < 0
+			|| joint_record->mNumKeys[1] < 0
+			|| joint_record->mNumKeys[2] < 0)
+		{
+			break;
+		}
+
+		LLKeyframeMotion::JointMotion* joint_motion = new LLKeyframeMotion::JointMotion;
+		list->mJointMotionArray.push_back(joint_motion);
+		joint_motion->mJointName.assign(name, joint_record->mNameLength);
+		joint_motion->mUsage = joint_record->mUsage;
+		joint_motion->mPriority = (LLJoint::JointPriority)joint_record->mPriority;
+		joint_motion->mScaleCurve.mInterpolationType = (LLKeyframeMotion::InterpolationType)joint_record->mInterpolation[0];
+		joint_motion->mScaleCurve.setKeys(scale_times, scales, joint_record->mNumKeys[0]);
+		joint_motion->mRotationCurve.mInterpolationType = (LLKeyframeMotion::InterpolationType)joint_record->mInterpolation[1];
+		joint_motion->mRotationCurve.setKeys(rotation_times, rotations, joint_record->mNumKeys[1]);
+		joint_motion->mPositionCurve.mInterpolationType = (LLKeyframeMotion::InterpolationType)joint_record->mInterpolation[2];
+		joint_motion->mPositionCurve.setKeys(position_times, positions, joint_record->mNumKeys[2]);
+	}
+
+	bool damaged = reader.failed() || list->getNumJointMotions() != record->mNumJoints;
+	for (U32 i = 0; i < record->mNumConstraints && !damaged; ++i)
+	{
+		const ConstraintRecord* constraint_record = reader.read<ConstraintRecord>(1);
+		if (!constraint_record
+			|| constraint_record->mChainLength < 0
+			|| (U32)constraint_record->mChainLength > record->mNumJoints)
+		{
+			damaged = true;
+			break;
+		}
+		const S32* indices = reader.read<S32>(constraint_record->mChainLength + 1);
+		if (!indices)
+		{
+			damaged = true;
+			break;
+		}
+
+		LLKeyframeMotion::JointConstraintSharedData* constraint = new LLKeyframeMotion::JointConstraintSharedData;
+		list->mConstraints.push_back(constraint);
+		constraint->mSourceConstraintVolume = constraint_record->mSourceVolume;
+		constraint->mSourceConstraintOffset = constraint_record->mSourceOffset;
+		constraint->mTargetConstraintVolume = constraint_record->mTargetVolume;
+		constraint->mTargetConstraintOffset = constraint_record->mTargetOffset;
+		constraint->mTargetConstraintDir = constraint_record->mTargetDir;
+		constraint->mChainLength = constraint_record->mChainLength;
+		constraint->mEaseInStartTime = constraint_record->mEaseInStartTime;
+		constraint->mEaseInStopTime = constraint_record->mEaseInStopTime;
+		constraint->mEaseOutStartTime = constraint_record->mEaseOutStartTime;
+		constraint->mEaseOutStopTime = constraint_record->mEaseOutStopTime;
+		constraint->mUseTargetOffset = constraint_record->mUseTargetOffset;
+		constraint->mConstraintType = (EConstraintType)constraint_record->mType;
+		constraint->mConstraintTargetType = (EConstraintTargetType)constraint_record->mTargetType;
+		constraint->mJointStateIndices = new S32[constraint->mChainLength + 1];
+		for (S32 j = 0; j < constraint->mChainLength + 1; ++j)
+		{
+			if (indices[j] < 0 || (U32)indices[j] >= record->mNumJoints)
+			{
+				damaged = true;
+			}
+			constraint->mJointStateIndices[j] = indices[j];
+		}
+	}
+
+	if (damaged)
+	{
+		llwarns << "Keyframe cache entry for " << id << " is damaged" << llendl;
+		delete list;
+		return NULL;
+	}
+	return list;
+}
+
+bool LLKeyframeCacheFile::startFile(const std::string& filename)
+{
+	llassert(!mFileOut);
+	mFilename = filename;
+	mFileOut = LLFile::fopen(mFilename + ".tmp", "wb");		/* Flawfinder: ignore */
+	if (!mFileOut)
+	{
+		llwarns << "Unable to write keyframe cache " << mFilename << llendl;
+		return false;
+	}
+	// Header goes in last, once the index is written
+	Header header;
+	memset(&header, 0, sizeof(header));
+	if (fwrite(&header, sizeof(header), 1, mFileOut) != 1)
+	{
+		llwarns << "Short write" << llendl;
+	}
+	mFileOutSize = sizeof(header);
+	mFileOutIndex.clear();
+	return true;
+}
+
+// static
+void LLKeyframeCacheFile::append(std::vector<U8>& buffer, const void* data, size_t size)
+{
+	// Keep every part 4 byte aligned so it can be used in place
+	size_t start = buffer.size();
+	buffer.resize(start + ((size + 3) & ~(size_t)3), 0);
+	if (size)
+	{
+		memcpy(&buffer[start], data, size);		/* Flawfinder: ignore */
+	}
+}
+
+void LLKeyframeCacheFile::addToFile(const LLUUID& id, const LLKeyframeMotion::JointMotionList* list)
+{
+	if (!mFileOut)
+	{
+		return;
+	}
+	LLKeyframeMotion::JointMotionList::constraint_list_t::const_iterator iter;
+	for (iter = list->mConstraints.begin(); iter != list->mConstraints.end(); ++iter)
+	{
+		if (!(*iter)->mJointStateIndices)
+		{
+			// never finished loading
+			return;
+		}
+	}
+
+	std::vector<U8> buffer;
+	ListRecord record;
+	record.mDuration = list->mDuration;
+	record.mLoop = list->mLoop;
+	record.mLoopInPoint = list->mLoopInPoint;
+	record.mLoopOutPoint = list->mLoopOutPoint;
+	record.mEaseInDuration = list->mEaseInDuration;
+	record.mEaseOutDuration = list->mEaseOutDuration;
+	record.mBasePriority = list->mBasePriority;
+	record.mMaxPriority = list->mMaxPriority;
+	record.mHandPose = list->mHandPose;
+	record.mPelvisMin = list->mPelvisBBox.getMin();
+	record.mPelvisMax = list->mPelvisBBox.getMax();
+	record.mNumJoints = list->getNumJointMotions();
+	record.mNumConstraints = (U32)list->mConstraints.size();
+	record.mEmoteNameLength = (U32)list->mEmoteName.size();
+	append(buffer, &record, sizeof(record));
+	append(buffer, list->mEmoteName.data(), list->mEmoteName.size());
+
+	for (U32 i = 0; i < list->getNumJointMotions(); ++i)
+	{
+		const LLKeyframeMotion::JointMotion* joint_motion = list->getJointMotion(i);
+		const LLKeyframeMotion::ScaleCurve& scale_curve = joint_motion->mScaleCurve;
+		const LLKeyframeMotion::RotationCurve& rotation_curve = joint_motion->mRotationCurve;
+		const LLKeyframeMotion::PositionCurve& position_curve = joint_motion->mPositionCurve;
+
+		JointRecord joint_record;
+		memset(&joint_record, 0, sizeof(joint_record));
+		joint_record.mNameLength = (U32)joint_motion->mJointName.size();
+		joint_record.mUsage = joint_motion->mUsage;
+		joint_record.mPriority = joint_motion->mPriority;
+		joint_record.mInterpolation[0] = scale_curve.mInterpolationType;
+		joint_record.mNumKeys[0] = scale_curve.mKeyTimes ? scale_curve.mNumKeys : 0;
+		joint_record.mInterpolation[1] = rotation_curve.mInterpolationType;
+		joint_record.mNumKeys[1] = rotation_curve.mKeyTimes ? rotation_curve.mNumKeys : 0;
+		joint_record.mInterpolation[2] = position_curve.mInterpolationType;
+		joint_record.mNumKeys[2] = position_curve.mKeyTimes ? position_curve.mNumKeys : 0;
+		append(buffer, &joint_record, sizeof(joint_record));
+		append(buffer, joint_motion->mJointName.data(), joint_motion->mJointName.size());
+		append(buffer, scale_curve.mKeyTimes, joint_record.mNumKeys[0] * sizeof(F32));
+		append(buffer, scale_curve.mKeyScales, joint_record.mNumKeys[0] * sizeof(LLVector3));
+		append(buffer, rotation_curve.mKeyTimes, joint_record.mNumKeys[1] * sizeof(F32));
+		append(buffer, rotation_curve.mKeyRotations, joint_record.mNumKeys[1] * sizeof(LLQuaternion));
+		append(buffer, position_curve.mKeyTimes, joint_record.mNumKeys[2] * sizeof(F32));
+		append(buffer, position_curve.mKeyPositions, joint_record.mNumKeys[2] * sizeof(LLVector3));
+	}
+
+	for (iter = list->mConstraints.begin(); iter != list->mConstraints.end(); ++iter)
+	{
+		const LLKeyframeMotion::JointConstraintSharedData* constraint = *iter;
+		ConstraintRecord constraint_record;
+		constraint_record.mSourceVolume = constraint->mSourceConstraintVolume;
+		constraint_record.mSourceOffset = constraint->mSourceConstraintOffset;
+		constraint_record.mTargetVolume = constraint->mTargetConstraintVolume;
+		constraint_record.mTargetOffset = constraint->mTargetConstraintOffset;
+		constraint_record.mTargetDir = constraint->mTargetConstraintDir;
+		constraint_record.mChainLength = constraint->mChainLength;
+		constraint_record.mEaseInStartTime = constraint->mEaseInStartTime;
+		constraint_record.mEaseInStopTime = constraint->mEaseInStopTime;
+		constraint_record.mEaseOutStartTime = constraint->mEaseOutStartTime;
+		constraint_record.mEaseOutStopTime = constraint->mEaseOutStopTime;
+		constraint_record.mUseTargetOffset = constraint->mUseTargetOffset;
+		constraint_record.mType = constraint->mConstraintType;
+		constraint_record.mTargetType = constraint->mConstraintTargetType;
+		append(buffer, &constraint_record, sizeof(constraint_record));
+		append(buffer, constraint->mJointStateIndices, (constraint->mChainLength + 1) * sizeof(S32));
+	}
+
+	if (fwrite(&buffer[0], 1, buffer.size(), mFileOut) != buffer.size())
+	{
+		llwarns << "Short write" << llendl;
+	}
+	IndexEntry entry;
+	entry.mID = id;
+	entry.mOffset = mFileOutSize;
+	entry.mSize = (U32)buffer.size();
+	mFileOutIndex.push_back(entry);
+	mFileOutSize += entry.mSize;
+}
+
+bool LLKeyframeCacheFile::finishFile()
+{
+	if (!mFileOut)
+	{
+		return false;
+	}
+
+	std::sort(mFileOutIndex.begin(), mFileOutIndex.end());
+	Header header;
+	header.mMagic = KEYFRAME_CACHE_MAGIC;
+	header.mVersion = VERSION;
+	header.mCount = (U32)mFileOutIndex.size();
+	header.mIndexOffset = mFileOutSize;
+
+	bool success = true;
+	if (header.mCount
+		&& fwrite(&mFileOutIndex[0], sizeof(IndexEntry), header.mCount, mFileOut) != header.mCount)
+	{
+		success = false;
+	}
+	if (fseek(mFileOut, 0, SEEK_SET) != 0
+		|| fwrite(&header, sizeof(header), 1, mFileOut) != 1)
+	{
+		success = false;
+	}
+	if (fclose(mFileOut) != 0)
+	{
+		success = false;
+	}
+	mFileOut = NULL;
+	mFileOutIndex.clear();
+
+	// Lists written may have pointed into the old file; let it go only now
+	close();
+	std::string temp_filename = mFilename + ".tmp";
+	if (!success)
+	{
+		llwarns << "Short write, discarding new keyframe cache " << mFilename << llendl;
+		LLFile::remove(temp_filename);
+		return false;
+	}
+	LLFile::remove(mFilename);
+	if (LLFile::rename(temp_filename, mFilename) != 0)
+	{
+		llwarns << "Unable to replace keyframe cache " << mFilename << llendl;
+		LLFile::remove(temp_filename);
+		return false;
+	}
+	return true;
+}
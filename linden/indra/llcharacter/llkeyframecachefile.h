@@ -0,0 +1,160 @@
+/** 
+ * @file llkeyframecachefile.h
+ * @brief A mapped file of decoded keyframe animations.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLKEYFRAMECACHEFILE_H
+#define LL_LLKEYFRAMECACHEFILE_H
+
+#include <vector>
+
+#include "llfile.h"
+#include "llkeyframemotion.h"
+#include "llmappedfile.h"
+#include "lluuid.h"
+
+// Keyframe animations as LLKeyframeMotion::deserialize() leaves them,
+// keyed by asset id, so later sessions can skip fetching and decoding.
+//
+// The file is mapped read only and load() points each curve at key times
+// and values in the mapping, so loading an animation allocates its joints
+// and constraints but no keys.  Nothing is read from disk until an
+// animation is loaded.  The file is native endian and tied to one
+// VERSION; bump it when the decoded data or this layout changes.
+class LLKeyframeCacheFile
+{
+public:
+	enum { VERSION = 1 };
+
+	LLKeyframeCacheFile();
+	~LLKeyframeCacheFile();
+
+	// Returns false if there is no usable file, which is normal on the
+	// first run.
+	bool open(const std::string& filename);
+	// Lists loaded from the file must be deleted first.
+	void close();
+
+	const std::string& getFilename() const	{ return mFilename; }
+	bool isOpen() const				{ return mFile.isOpen(); }
+	S32 getCount() const			{ return mCount; }
+	size_t getSize() const			{ return mFile.getSize(); }
+
+	// Returns a new list whose keys live in the mapping, or NULL if id
+	// isn't in the file or its record is damaged.
+	LLKeyframeMotion::JointMotionList* load(const LLUUID& id) const;
+
+	// Writes a new file, usually over the one open() was given.  Lists
+	// added may have been loaded from the current file; delete them before
+	// finishFile(), which closes this file and replaces it.
+	bool startFile(const std::string& filename);
+	void addToFile(const LLUUID& id, const LLKeyframeMotion::JointMotionList* list);
+	bool finishFile();
+
+private:
+	// No copy constructor or copy assignment
+	LLKeyframeCacheFile(const LLKeyframeCacheFile&);
+	LLKeyframeCacheFile& operator=(const LLKeyframeCacheFile&);
+
+	struct Header
+	{
+		U32 mMagic;
+		U32 mVersion;
+		U32 mCount;
+		U32 mIndexOffset;	// IndexEntry table, sorted by id
+	};
+	struct IndexEntry
+	{
+		LLUUID mID;
+		U32 mOffset;
+		U32 mSize;
+
+		bool operator<(const IndexEntry& rhs) const	{ return mID < rhs.mID; }
+	};
+
+	// Records are 4 byte aligned and each part is padded to 4 bytes.
+	struct ListRecord
+	{
+		F32 mDuration;
+		S32 mLoop;
+		F32 mLoopInPoint;
+		F32 mLoopOutPoint;
+		F32 mEaseInDuration;
+		F32 mEaseOutDuration;
+		S32 mBasePriority;
+		S32 mMaxPriority;
+		U32 mHandPose;
+		LLVector3 mPelvisMin;
+		LLVector3 mPelvisMax;
+		U32 mNumJoints;
+		U32 mNumConstraints;
+		U32 mEmoteNameLength;
+		// followed by the emote name, the joints and the constraints
+	};
+	struct JointRecord
+	{
+		U32 mNameLength;
+		U32 mUsage;
+		S32 mPriority;
+		S32 mInterpolation[3];	// scale, rotation, position
+		S32 mNumKeys[3];
+		// followed by the name, then the times and values of each curve
+	};
+	struct ConstraintRecord
+	{
+		S32 mSourceVolume;
+		LLVector3 mSourceOffset;
+		S32 mTargetVolume;
+		LLVector3 mTargetOffset;
+		LLVector3 mTargetDir;
+		S32 mChainLength;
+		F32 mEaseInStartTime;
+		F32 mEaseInStopTime;
+		F32 mEaseOutStartTime;
+		F32 mEaseOutStopTime;
+		S32 mUseTargetOffset;
+		S32 mType;
+		S32 mTargetType;
+		// followed by mChainLength + 1 joint state indices
+	};
+
+	static void append(std::vector<U8>& buffer, const void* data, size_t size);
+
+	std::string mFilename;
+	LLMappedFile mFile;
+	S32 mCount;
+	const IndexEntry* mIndex;
+
+	LLFILE* mFileOut;
+	U32 mFileOutSize;
+	std::vector<IndexEntry> mFileOutIndex;
+};
+
+#endif // LL_LLKEYFRAMECACHEFILE_H
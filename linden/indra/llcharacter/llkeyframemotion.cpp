@@ -43,6 +43,7 @@
 #include "llcriticaldamp.h"
 #include "lldir.h"
 #include "llendianswizzle.h"
+#include "llkeyframecachefile.h"
 #include "llkeyframemotion.h"
 #include "llquantize.h"
 #include "llvfile.h"
@@ -54,6 +55,7 @@
 //-----------------------------------------------------------------------------
 LLVFS*				LLKeyframeMotion::sVFS = NULL;
 LLKeyframeDataCache::keyframe_data_map_t	LLKeyframeDataCache::sKeyframeDataMap;
+LLKeyframeCacheFile*	LLKeyframeDataCache::sCompiledCache = NULL;
 
 //-----------------------------------------------------------------------------
 // Globals
@@ -126,6 +128,15 @@ U32 LLKeyframeMotion::JointMotionList::dumpDiagInfo()
 	return total_size;
 }
 
+void LLKeyframeMotion::JointMotionList::update(F32 time, LLPointer<LLJointState>* joint_states, JointCursor* cursors) const
+{
+	S32 num_joints = (S32)mJointMotionArray.size();
+	for (S32 i = 0; i < num_joints; i++)
+	{
+		mJointMotionArray[i]->update(joint_states[i], time, mDuration, cursors[i]);
+	}
+}
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 // ****Curve classes
@@ -133,6 +144,81 @@ U32 LLKeyframeMotion::JointMotionList::dumpDiagInfo()
 //-----------------------------------------------------------------------------
 
 
+//-----------------------------------------------------------------------------
+// find_key()
+// Returns the index of the first key at or after time, like lower_bound().
+// cursor holds the previous answer; during forward playback the answer is
+// the same key or one a step or two later, so most calls don't search.
+//-----------------------------------------------------------------------------
+static S32 find_key(const F32* times, S32 num_keys, F32 time, S32& cursor)
+{
+	const S32 MAX_CURSOR_STEPS = 4;
+	S32 index = llclamp(cursor, 0, num_keys);
+	if (index == 0 || times[index - 1] < time)
+	{
+		for (S32 step = 0; step < MAX_CURSOR_STEPS; ++step, ++index)
+		{
+			if (index == num_keys || times[index] >= time)
+			{
+				cursor = index;
+				return index;
+			}
+		}
+	}
+
+	// Jumped, probably looped back to the start
+	index = (S32)(std::lower_bound(times, times + num_keys, time) - times);
+	cursor = index;
+	return index;
+}
+
+//-----------------------------------------------------------------------------
+// sort_keys()
+// Sorts parallel time and value arrays by time.  Where keys share a time
+// the one added last wins, as it did when keys were kept in a map.
+//-----------------------------------------------------------------------------
+template <class VALUE>
+static void sort_keys(std::vector<F32>& times, std::vector<VALUE>& values)
+{
+	S32 num_keys = (S32)times.size();
+	S32 i;
+	for (i = 1; i < num_keys; ++i)
+	{
+		if (times[i] <= times[i - 1])
+		{
+			break;
+		}
+	}
+	if (i == num_keys)
+	{
+		// Animations are saved in order, so this is the usual case
+		return;
+	}
+
+	std::multimap<F32, S32> order;
+	for (i = 0; i < num_keys; ++i)
+	{
+		order.insert(std::make_pair(times[i], i));
+	}
+	std::vector<F32> sorted_times;
+	std::vector<VALUE> sorted_values;
+	sorted_times.reserve(num_keys);
+	sorted_values.reserve(num_keys);
+	for (std::multimap<F32, S32>::iterator iter = order.begin(); iter != order.end(); ++iter)
+	{
+		// equal times keep insertion order, so overwrite with the later key
+		if (!sorted_times.empty() && sorted_times.back() == iter->first)
+		{
+			sorted_values.back() = values[iter->second];
+			continue;
+		}
+		sorted_times.push_back(iter->first);
+		sorted_values.push_back(values[iter->second]);
+	}
+	times.swap(sorted_times);
+	values.swap(sorted_values);
+}
+
 //-----------------------------------------------------------------------------
 // ScaleCurve::ScaleCurve()
 //-----------------------------------------------------------------------------
@@ -140,6 +226,8 @@ LLKeyframeMotion::ScaleCurve::ScaleCurve()
 {
 	mInterpolationType = LLKeyframeMotion::IT_LINEAR;
 	mNumKeys = 0;
+	mKeyTimes = NULL;
+	mKeyScales = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -147,51 +235,83 @@ LLKeyframeMotion::ScaleCurve::ScaleCurve()
 //-----------------------------------------------------------------------------
 LLKeyframeMotion::ScaleCurve::~ScaleCurve() 
 {
-	mKeys.clear();
 	mNumKeys = 0;
 }
 
+//-----------------------------------------------------------------------------
+// ScaleCurve::addKey()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::ScaleCurve::addKey(const ScaleKey& key)
+{
+	mKeyTimeData.push_back(key.mTime);
+	mKeyScalesData.push_back(key.mScale);
+}
+
+//-----------------------------------------------------------------------------
+// ScaleCurve::sortKeys()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::ScaleCurve::sortKeys()
+{
+	sort_keys(mKeyTimeData, mKeyScalesData);
+	if (mKeyTimeData.empty())
+	{
+		setKeys(NULL, NULL, 0);
+	}
+	else
+	{
+		setKeys(&mKeyTimeData[0], &mKeyScalesData[0], (S32)mKeyTimeData.size());
+	}
+}
+
+//-----------------------------------------------------------------------------
+// ScaleCurve::setKeys()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::ScaleCurve::setKeys(const F32* times, const LLVector3* scales, S32 num_keys)
+{
+	mNumKeys = num_keys;
+	mKeyTimes = num_keys ? times : NULL;
+	mKeyScales = num_keys ? scales : NULL;
+}
+
 //-----------------------------------------------------------------------------
 // getValue()
 //-----------------------------------------------------------------------------
 LLVector3 LLKeyframeMotion::ScaleCurve::getValue(F32 time, F32 duration)
+{
+	S32 cursor = 0;
+	return getValue(time, duration, cursor);
+}
+
+LLVector3 LLKeyframeMotion::ScaleCurve::getValue(F32 time, F32 duration, S32& cursor)
 {
 	LLVector3 value;
 
-	if (mKeys.empty())
+	if (!mKeyTimes)
 	{
 		value.clearVec();
 		return value;
 	}
 	
-	key_map_t::iterator right = mKeys.lower_bound(time);
-	if (right == mKeys.end())
+	S32 right = find_key(mKeyTimes, mNumKeys, time, cursor);
+	if (right == mNumKeys)
 	{
 		// Past last key
-		--right;
-		value = right->second.mScale;
+		value = mKeyScales[right - 1];
 	}
-	else if (right == mKeys.begin() || right->first == time)
+	else if (right == 0 || mKeyTimes[right] == time)
 	{
 		// Before first key or exactly on a key
-		value = right->second.mScale;
+		value = mKeyScales[right];
 	}
 	else
 	{
 		// Between two keys
-		key_map_t::iterator left = right; --left;
-		F32 index_before = left->first;
-		F32 index_after = right->first;
-		ScaleKey& scale_before = left->second;
-		ScaleKey& scale_after = right->second;
-		if (right == mKeys.end())
-		{
-			scale_after = mLoopInKey;
-			index_after = duration;
-		}
+		S32 left = right - 1;
+		F32 index_before = mKeyTimes[left];
+		F32 index_after = mKeyTimes[right];
 
 		F32 u = (time - index_before) / (index_after - index_before);
-		value = interp(u, scale_before, scale_after);
+		value = interp(u, mKeyScales[left], mKeyScales[right]);
 	}
 	return value;
 }
@@ -199,17 +319,17 @@ LLVector3 LLKeyframeMotion::ScaleCurve::getValue(F32 time, F32 duration)
 //-----------------------------------------------------------------------------
 // interp()
 //-----------------------------------------------------------------------------
-LLVector3 LLKeyframeMotion::ScaleCurve::interp(F32 u, ScaleKey& before, ScaleKey& after)
+LLVector3 LLKeyframeMotion::ScaleCurve::interp(F32 u, const LLVector3& before, const LLVector3& after)
 {
 	switch (mInterpolationType)
 	{
 	case IT_STEP:
-		return before.mScale;
+		return before;
 
 	default:
 	case IT_LINEAR:
 	case IT_SPLINE:
-		return lerp(before.mScale, after.mScale, u);
+		return lerp(before, after, u);
 	}
 }
 
@@ -220,6 +340,8 @@ LLKeyframeMotion::RotationCurve::RotationCurve()
 {
 	mInterpolationType = LLKeyframeMotion::IT_LINEAR;
 	mNumKeys = 0;
+	mKeyTimes = NULL;
+	mKeyRotations = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -227,51 +349,83 @@ LLKeyframeMotion::RotationCurve::RotationCurve()
 //-----------------------------------------------------------------------------
 LLKeyframeMotion::RotationCurve::~RotationCurve()
 {
-	mKeys.clear();
 	mNumKeys = 0;
 }
 
+//-----------------------------------------------------------------------------
+// RotationCurve::addKey()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::RotationCurve::addKey(const RotationKey& key)
+{
+	mKeyTimeData.push_back(key.mTime);
+	mKeyRotationsData.push_back(key.mRotation);
+}
+
+//-----------------------------------------------------------------------------
+// RotationCurve::sortKeys()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::RotationCurve::sortKeys()
+{
+	sort_keys(mKeyTimeData, mKeyRotationsData);
+	if (mKeyTimeData.empty())
+	{
+		setKeys(NULL, NULL, 0);
+	}
+	else
+	{
+		setKeys(&mKeyTimeData[0], &mKeyRotationsData[0], (S32)mKeyTimeData.size());
+	}
+}
+
+//-----------------------------------------------------------------------------
+// RotationCurve::setKeys()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::RotationCurve::setKeys(const F32* times, const LLQuaternion* rotations, S32 num_keys)
+{
+	mNumKeys = num_keys;
+	mKeyTimes = num_keys ? times : NULL;
+	mKeyRotations = num_keys ? rotations : NULL;
+}
+
 //-----------------------------------------------------------------------------
 // RotationCurve::getValue()
 //-----------------------------------------------------------------------------
 LLQuaternion LLKeyframeMotion::RotationCurve::getValue(F32 time, F32 duration)
+{
+	S32 cursor = 0;
+	return getValue(time, duration, cursor);
+}
+
+LLQuaternion LLKeyframeMotion::RotationCurve::getValue(F32 time, F32 duration, S32& cursor)
 {
 	LLQuaternion value;
 
-	if (mKeys.empty())
+	if (!mKeyTimes)
 	{
 		value = LLQuaternion::DEFAULT;
 		return value;
 	}
 	
-	key_map_t::iterator right = mKeys.lower_bound(time);
-	if (right == mKeys.end())
+	S32 right = find_key(mKeyTimes, mNumKeys, time, cursor);
+	if (right == mNumKeys)
 	{
 		// Past last key
-		--right;
-		value = right->second.mRotation;
+		value = mKeyRotations[right - 1];
 	}
-	else if (right == mKeys.begin() || right->first == time)
+	else if (right == 0 || mKeyTimes[right] == time)
 	{
 		// Before first key or exactly on a key
-		value = right->second.mRotation;
+		value = mKeyRotations[right];
 	}
 	else
 	{
 		// Between two keys
-		key_map_t::iterator left = right; --left;
-		F32 index_before = left->first;
-		F32 index_after = right->first;
-		RotationKey& rot_before = left->second;
-		RotationKey& rot_after = right->second;
-		if (right == mKeys.end())
-		{
-			rot_after = mLoopInKey;
-			index_after = duration;
-		}
+		S32 left = right - 1;
+		F32 index_before = mKeyTimes[left];
+		F32 index_after = mKeyTimes[right];
 
 		F32 u = (time - index_before) / (index_after - index_before);
-		value = interp(u, rot_before, rot_after);
+		value = interp(u, mKeyRotations[left], mKeyRotations[right]);
 	}
 	return value;
 }
@@ -279,17 +433,17 @@ LLQuaternion LLKeyframeMotion::RotationCurve::getValue(F32 time, F32 duration)
 //-----------------------------------------------------------------------------
 // interp()
 //-----------------------------------------------------------------------------
-LLQuaternion LLKeyframeMotion::RotationCurve::interp(F32 u, RotationKey& before, RotationKey& after)
+LLQuaternion LLKeyframeMotion::RotationCurve::interp(F32 u, const LLQuaternion& before, const LLQuaternion& after)
 {
 	switch (mInterpolationType)
 	{
 	case IT_STEP:
-		return before.mRotation;
+		return before;
 
 	default:
 	case IT_LINEAR:
 	case IT_SPLINE:
-		return nlerp(u, before.mRotation, after.mRotation);
+		return nlerp(u, before, after);
 	}
 }
 
@@ -301,6 +455,8 @@ LLKeyframeMotion::PositionCurve::PositionCurve()
 {
 	mInterpolationType = LLKeyframeMotion::IT_LINEAR;
 	mNumKeys = 0;
+	mKeyTimes = NULL;
+	mKeyPositions = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -308,51 +464,83 @@ LLKeyframeMotion::PositionCurve::PositionCurve()
 //-----------------------------------------------------------------------------
 LLKeyframeMotion::PositionCurve::~PositionCurve()
 {
-	mKeys.clear();
 	mNumKeys = 0;
 }
 
+//-----------------------------------------------------------------------------
+// PositionCurve::addKey()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::PositionCurve::addKey(const PositionKey& key)
+{
+	mKeyTimeData.push_back(key.mTime);
+	mKeyPositionsData.push_back(key.mPosition);
+}
+
+//-----------------------------------------------------------------------------
+// PositionCurve::sortKeys()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::PositionCurve::sortKeys()
+{
+	sort_keys(mKeyTimeData, mKeyPositionsData);
+	if (mKeyTimeData.empty())
+	{
+		setKeys(NULL, NULL, 0);
+	}
+	else
+	{
+		setKeys(&mKeyTimeData[0], &mKeyPositionsData[0], (S32)mKeyTimeData.size());
+	}
+}
+
+//-----------------------------------------------------------------------------
+// PositionCurve::setKeys()
+//-----------------------------------------------------------------------------
+void LLKeyframeMotion::PositionCurve::setKeys(const F32* times, const LLVector3* positions, S32 num_keys)
+{
+	mNumKeys = num_keys;
+	mKeyTimes = num_keys ? times : NULL;
+	mKeyPositions = num_keys ? positions : NULL;
+}
+
 //-----------------------------------------------------------------------------
 // PositionCurve::getValue()
 //-----------------------------------------------------------------------------
 LLVector3 LLKeyframeMotion::PositionCurve::getValue(F32 time, F32 duration)
+{
+	S32 cursor = 0;
+	return getValue(time, duration, cursor);
+}
+
+LLVector3 LLKeyframeMotion::PositionCurve::getValue(F32 time, F32 duration, S32& cursor)
 {
 	LLVector3 value;
 
-	if (mKeys.empty())
+	if (!mKeyTimes)
 	{
 		value.clearVec();
 		return value;
 	}
 	
-	key_map_t::iterator right = mKeys.lower_bound(time);
-	if (right == mKeys.end())
+	S32 right = find_key(mKeyTimes, mNumKeys, time, cursor);
+	if (right == mNumKeys)
 	{
 		// Past last key
-		--right;
-		value = right->second.mPosition;
+		value = mKeyPositions[right - 1];
 	}
-	else if (right == mKeys.begin() || right->first == time)
+	else if (right == 0 || mKeyTimes[right] == time)
 	{
 		// Before first key or exactly on a key
-		value = right->second.mPosition;
+		value = mKeyPositions[right];
 	}
 	else
 	{
 		// Between two keys
-		key_map_t::iterator left = right; --left;
-		F32 index_before = left->first;
-		F32 index_after = right->first;
-		PositionKey& pos_before = left->second;
-		PositionKey& pos_after = right->second;
-		if (right == mKeys.end())
-		{
-			pos_after = mLoopInKey;
-			index_after = duration;
-		}
+		S32 left = right - 1;
+		F32 index_before = mKeyTimes[left];
+		F32 index_after = mKeyTimes[right];
 
 		F32 u = (time - index_before) / (index_after - index_before);
-		value = interp(u, pos_before, pos_after);
+		value = interp(u, mKeyPositions[left], mKeyPositions[right]);
 	}
 
 	llassert(value.isFinite());
@@ -363,16 +551,16 @@ LLVector3 LLKeyframeMotion::PositionCurve::getValue(F32 time, F32 duration)
 //-----------------------------------------------------------------------------
 // interp()
 //-----------------------------------------------------------------------------
-LLVector3 LLKeyframeMotion::PositionCurve::interp(F32 u, PositionKey& before, PositionKey& after)
+LLVector3 LLKeyframeMotion::PositionCurve::interp(F32 u, const LLVector3& before, const LLVector3& after)
 {
 	switch (mInterpolationType)
 	{
 	case IT_STEP:
-		return before.mPosition;
+		return before;
 	default:
 	case IT_LINEAR:
 	case IT_SPLINE:
-		return lerp(before.mPosition, after.mPosition, u);
+		return lerp(before, after, u);
 	}
 }
 
@@ -386,7 +574,7 @@ LLVector3 LLKeyframeMotion::PositionCurve::interp(F32 u, PositionKey& before, Po
 //-----------------------------------------------------------------------------
 // JointMotion::update()
 //-----------------------------------------------------------------------------
-void LLKeyframeMotion::JointMotion::update(LLJointState* joint_state, F32 time, F32 duration)
+void LLKeyframeMotion::JointMotion::update(LLJointState* joint_state, F32 time, F32 duration, JointCursor& cursor)
 {
 	// this value being 0 is the cause of https://jira.lindenlab.com/browse/SL-22678 but I haven't 
 	// managed to get a stack to see how it got here. Testing for 0 here will stop the crash.
@@ -402,7 +590,7 @@ void LLKeyframeMotion::JointMotion::update(LLJointState* joint_state, F32 time,
 	//-------------------------------------------------------------------------
 	if ((usage & LLJointState::SCALE) && mScaleCurve.mNumKeys)
 	{
-		joint_state->setScale( mScaleCurve.getValue( time, duration ) );
+		joint_state->setScale( mScaleCurve.getValue( time, duration, cursor.mScale ) );
 	}
 
 	//-------------------------------------------------------------------------
@@ -410,7 +598,7 @@ void LLKeyframeMotion::JointMotion::update(LLJointState* joint_state, F32 time,
 	//-------------------------------------------------------------------------
 	if ((usage & LLJointState::ROT) && mRotationCurve.mNumKeys)
 	{
-		joint_state->setRotation( mRotationCurve.getValue( time, duration ) );
+		joint_state->setRotation( mRotationCurve.getValue( time, duration, cursor.mRotation ) );
 	}
 
 	//-------------------------------------------------------------------------
@@ -418,7 +606,7 @@ void LLKeyframeMotion::JointMotion::update(LLJointState* joint_state, F32 time,
 	//-------------------------------------------------------------------------
 	if ((usage & LLJointState::POS) && mPositionCurve.mNumKeys)
 	{
-		joint_state->setPosition( mPositionCurve.getValue( time, duration ) );
+		joint_state->setPosition( mPositionCurve.getValue( time, duration, cursor.mPosition ) );
 	}
 }
 
@@ -722,11 +910,13 @@ BOOL LLKeyframeMotion::onUpdate(F32 time, U8* joint_mask)
 void LLKeyframeMotion::applyKeyframes(F32 time)
 {
 	llassert_always (mJointMotionList->getNumJointMotions() <= mJointStates.size());
-	for (U32 i=0; i<mJointMotionList->getNumJointMotions(); i++)
+	if (mJointCursors.size() != mJointStates.size())
+	{
+		mJointCursors.resize(mJointStates.size());
+	}
+	if (!mJointStates.empty())
 	{
-		mJointMotionList->getJointMotion(i)->update(mJointStates[i],
-													  time, 
-													  mJointMotionList->mDuration );
+		mJointMotionList->update(time, &mJointStates[0], &mJointCursors[0]);
 	}
 
 	LLJoint::JointPriority* pose_priority = (LLJoint::JointPriority* )mCharacter->getAnimationData("Hand Pose Priority");
@@ -1475,8 +1665,9 @@ BOOL LLKeyframeMotion::deserialize(LLDataPacker& dp)
 				return FALSE;
 			}
 
-			rCurve->mKeys[time] = rot_key;
+			rCurve->addKey(rot_key);
 		}
+		rCurve->sortKeys();
 
 		//---------------------------------------------------------------------
 		// scan position curve header
@@ -1553,13 +1744,14 @@ BOOL LLKeyframeMotion::deserialize(LLDataPacker& dp)
 				return FALSE;
 			}
 			
-			pCurve->mKeys[pos_key.mTime] = pos_key;
+			pCurve->addKey(pos_key);
 
 			if (is_pelvis)
 			{
 				mJointMotionList->mPelvisBBox.addPoint(pos_key.mPosition);
 			}
 		}
+		pCurve->sortKeys();
 
 		joint_motion->mUsage = joint_state->getUsage();
 	}
@@ -1804,14 +1996,13 @@ BOOL LLKeyframeMotion::serialize(LLDataPacker& dp) const
 		success &= dp.packS32(joint_motionp->mPriority, "joint_priority");
 		success &= dp.packS32(joint_motionp->mRotationCurve.mNumKeys, "num_rot_keys");
 
-		for (RotationCurve::key_map_t::iterator iter = joint_motionp->mRotationCurve.mKeys.begin();
-			 iter != joint_motionp->mRotationCurve.mKeys.end(); ++iter)
+		RotationCurve* rot_curve = &joint_motionp->mRotationCurve;
+		for (S32 k = 0; k < rot_curve->mNumKeys; k++)
 		{
-			RotationKey& rot_key = iter->second;
-			U16 time_short = F32_to_U16(rot_key.mTime, 0.f, mJointMotionList->mDuration);
+			U16 time_short = F32_to_U16(rot_curve->mKeyTimes[k], 0.f, mJointMotionList->mDuration);
 			success &= dp.packU16(time_short, "time");
 
-			LLVector3 rot_angles = rot_key.mRotation.packToVector3();
+			LLVector3 rot_angles = rot_curve->mKeyRotations[k].packToVector3();
 			
 			U16 x, y, z;
 			rot_angles.quantize16(-1.f, 1.f, -1.f, 1.f);
@@ -1824,18 +2015,18 @@ BOOL LLKeyframeMotion::serialize(LLDataPacker& dp) const
 		}
 
 		success &= dp.packS32(joint_motionp->mPositionCurve.mNumKeys, "num_pos_keys");
-		for (PositionCurve::key_map_t::iterator iter = joint_motionp->mPositionCurve.mKeys.begin();
-			 iter != joint_motionp->mPositionCurve.mKeys.end(); ++iter)
+		PositionCurve* pos_curve = &joint_motionp->mPositionCurve;
+		for (S32 k = 0; k < pos_curve->mNumKeys; k++)
 		{
-			PositionKey& pos_key = iter->second;
-			U16 time_short = F32_to_U16(pos_key.mTime, 0.f, mJointMotionList->mDuration);
+			U16 time_short = F32_to_U16(pos_curve->mKeyTimes[k], 0.f, mJointMotionList->mDuration);
 			success &= dp.packU16(time_short, "time");
 
 			U16 x, y, z;
-			pos_key.mPosition.quantize16(-LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET, -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
-			x = F32_to_U16(pos_key.mPosition.mV[VX], -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
-			y = F32_to_U16(pos_key.mPosition.mV[VY], -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
-			z = F32_to_U16(pos_key.mPosition.mV[VZ], -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
+			LLVector3 position = pos_curve->mKeyPositions[k];
+			position.quantize16(-LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET, -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
+			x = F32_to_U16(position.mV[VX], -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
+			y = F32_to_U16(position.mV[VY], -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
+			z = F32_to_U16(position.mV[VZ], -LL_MAX_PELVIS_OFFSET, LL_MAX_PELVIS_OFFSET);
 			success &= dp.packU16(x, "pos_x");
 			success &= dp.packU16(y, "pos_y");
 			success &= dp.packU16(z, "pos_z");
@@ -2172,11 +2363,66 @@ void LLKeyframeDataCache::removeKeyframeData(const LLUUID& id)
 LLKeyframeMotion::JointMotionList* LLKeyframeDataCache::getKeyframeData(const LLUUID& id)
 {
 	keyframe_data_map_t::iterator found_data = sKeyframeDataMap.find(id);
-	if (found_data == sKeyframeDataMap.end())
+	if (found_data != sKeyframeDataMap.end())
+	{
+		return found_data->second;
+	}
+	if (sCompiledCache)
+	{
+		LLKeyframeMotion::JointMotionList* joint_motion_listp = sCompiledCache->load(id);
+		if (joint_motion_listp)
+		{
+			sKeyframeDataMap[id] = joint_motion_listp;
+			return joint_motion_listp;
+		}
+	}
+	return NULL;
+}
+
+//--------------------------------------------------------------------
+// LLKeyframeDataCache::openCompiledCache()
+//--------------------------------------------------------------------
+// static
+bool LLKeyframeDataCache::openCompiledCache(const std::string& filename)
+{
+	if (sCompiledCache)
+	{
+		closeCompiledCache(false);
+	}
+	sCompiledCache = new LLKeyframeCacheFile;
+	if (!sCompiledCache->open(filename))
+	{
+		// keep the filename to save to
+		return false;
+	}
+	llinfos << "Mapped " << sCompiledCache->getCount() << " decoded animations ("
+			<< sCompiledCache->getSize() / 1024 << " KB) from " << filename << llendl;
+	return true;
+}
+
+//--------------------------------------------------------------------
+// LLKeyframeDataCache::closeCompiledCache()
+//--------------------------------------------------------------------
+// static
+void LLKeyframeDataCache::closeCompiledCache(bool save)
+{
+	bool saving = save && sCompiledCache && sCompiledCache->startFile(sCompiledCache->getFilename());
+	if (saving)
+	{
+		for (keyframe_data_map_t::iterator iter = sKeyframeDataMap.begin();
+			 iter != sKeyframeDataMap.end(); ++iter)
+		{
+			sCompiledCache->addToFile(iter->first, iter->second);
+		}
+	}
+	// lists may point into the old file
+	clear();
+	if (saving)
 	{
-		return NULL;
+		sCompiledCache->finishFile();
 	}
-	return found_data->second;
+	delete sCompiledCache;
+	sCompiledCache = NULL;
 }
 
 //--------------------------------------------------------------------
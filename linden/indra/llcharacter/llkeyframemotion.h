@@ -50,6 +50,7 @@
 #include "llapr.h"
 #include "llbvhconsts.h"
 
+class LLKeyframeCacheFile;
 class LLKeyframeDataCache;
 class LLVFS;
 class LLDataPacker;
@@ -67,6 +68,7 @@ class LLKeyframeMotion :
 	public LLMotion
 {
 	friend class LLKeyframeDataCache;
+	friend class LLKeyframeCacheFile;
 public:
 	// Constructor
 	LLKeyframeMotion(const LLUUID &id);
@@ -327,14 +329,26 @@ public:
 		ScaleCurve();
 		~ScaleCurve();
 		LLVector3 getValue(F32 time, F32 duration);
-		LLVector3 interp(F32 u, ScaleKey& before, ScaleKey& after);
+		// cursor is the caller's playhead for this curve; playing forward
+		// finds the next key from it without a search.
+		LLVector3 getValue(F32 time, F32 duration, S32& cursor);
+		LLVector3 interp(F32 u, const LLVector3& before, const LLVector3& after);
+		// Keys may be added in any order; call sortKeys() when done.
+		void addKey(const ScaleKey& key);
+		void sortKeys();
+		// Uses num_keys keys, sorted by time, that outlive the curve
+		void setKeys(const F32* times, const LLVector3* scales, S32 num_keys);
 
 		InterpolationType	mInterpolationType;
 		S32					mNumKeys;
-		typedef std::map<F32, ScaleKey> key_map_t;
-		key_map_t 			mKeys;
-		ScaleKey			mLoopInKey;
-		ScaleKey			mLoopOutKey;
+		// Sorted by time, one entry per key.  These point into the arrays
+		// below, or into a mapped LLKeyframeCacheFile.
+		const F32*			mKeyTimes;
+		const LLVector3*	mKeyScales;
+		std::vector<F32>	mKeyTimeData;
+		std::vector<LLVector3>	mKeyScalesData;
+		ScaleKey		mLoopInKey;
+		ScaleKey		mLoopOutKey;
 	};
 
 	//-------------------------------------------------------------------------
@@ -346,14 +360,26 @@ public:
 		RotationCurve();
 		~RotationCurve();
 		LLQuaternion getValue(F32 time, F32 duration);
-		LLQuaternion interp(F32 u, RotationKey& before, RotationKey& after);
+		// cursor is the caller's playhead for this curve; playing forward
+		// finds the next key from it without a search.
+		LLQuaternion getValue(F32 time, F32 duration, S32& cursor);
+		LLQuaternion interp(F32 u, const LLQuaternion& before, const LLQuaternion& after);
+		// Keys may be added in any order; call sortKeys() when done.
+		void addKey(const RotationKey& key);
+		void sortKeys();
+		// Uses num_keys keys, sorted by time, that outlive the curve
+		void setKeys(const F32* times, const LLQuaternion* rotations, S32 num_keys);
 
 		InterpolationType	mInterpolationType;
 		S32					mNumKeys;
-		typedef std::map<F32, RotationKey> key_map_t;
-		key_map_t		mKeys;
-		RotationKey		mLoopInKey;
-		RotationKey		mLoopOutKey;
+		// Sorted by time, one entry per key.  These point into the arrays
+		// below, or into a mapped LLKeyframeCacheFile.
+		const F32*			mKeyTimes;
+		const LLQuaternion*	mKeyRotations;
+		std::vector<F32>	mKeyTimeData;
+		std::vector<LLQuaternion>	mKeyRotationsData;
+		RotationKey	mLoopInKey;
+		RotationKey	mLoopOutKey;
 	};
 
 	//-------------------------------------------------------------------------
@@ -365,16 +391,43 @@ public:
 		PositionCurve();
 		~PositionCurve();
 		LLVector3 getValue(F32 time, F32 duration);
-		LLVector3 interp(F32 u, PositionKey& before, PositionKey& after);
+		// cursor is the caller's playhead for this curve; playing forward
+		// finds the next key from it without a search.
+		LLVector3 getValue(F32 time, F32 duration, S32& cursor);
+		LLVector3 interp(F32 u, const LLVector3& before, const LLVector3& after);
+		// Keys may be added in any order; call sortKeys() when done.
+		void addKey(const PositionKey& key);
+		void sortKeys();
+		// Uses num_keys keys, sorted by time, that outlive the curve
+		void setKeys(const F32* times, const LLVector3* positions, S32 num_keys);
 
 		InterpolationType	mInterpolationType;
 		S32					mNumKeys;
-		typedef std::map<F32, PositionKey> key_map_t;
-		key_map_t		mKeys;
+		// Sorted by time, one entry per key.  These point into the arrays
+		// below, or into a mapped LLKeyframeCacheFile.
+		const F32*			mKeyTimes;
+		const LLVector3*	mKeyPositions;
+		std::vector<F32>	mKeyTimeData;
+		std::vector<LLVector3>	mKeyPositionsData;
 		PositionKey		mLoopInKey;
 		PositionKey		mLoopOutKey;
 	};
 
+	//-------------------------------------------------------------------------
+	// JointCursor
+	// Where one motion instance last sampled each of a joint's curves.  The
+	// curves are shared by every instance playing the same animation.
+	//-------------------------------------------------------------------------
+	class JointCursor
+	{
+	public:
+		JointCursor() : mPosition(0), mRotation(0), mScale(0) {}
+
+		S32 mPosition;
+		S32 mRotation;
+		S32 mScale;
+	};
+
 	//-------------------------------------------------------------------------
 	// JointMotion
 	//-------------------------------------------------------------------------
@@ -388,7 +441,7 @@ public:
 		U32				mUsage;
 		LLJoint::JointPriority	mPriority;
 
-		void update(LLJointState* joint_state, F32 time, F32 duration);
+		void update(LLJointState* joint_state, F32 time, F32 duration, JointCursor& cursor);
 	};
 	
 	//-------------------------------------------------------------------------
@@ -420,6 +473,9 @@ public:
 		U32 dumpDiagInfo();
 		JointMotion* getJointMotion(U32 index) const { llassert(index < mJointMotionArray.size()); return mJointMotionArray[index]; }
 		U32 getNumJointMotions() const { return mJointMotionArray.size(); }
+		// Samples every joint at time.  joint_states and cursors are indexed
+		// like mJointMotionArray and belong to the calling motion instance.
+		void update(F32 time, LLPointer<LLJointState>* joint_states, JointCursor* cursors) const;
 	};
 
 
@@ -431,6 +487,7 @@ protected:
 	//-------------------------------------------------------------------------
 	JointMotionList*				mJointMotionList;
 	std::vector<LLPointer<LLJointState> > mJointStates;
+	std::vector<JointCursor>		mJointCursors;
 	LLJoint*						mPelvisp;
 	LLCharacter*					mCharacter;
 	typedef std::list<JointConstraint*>	constraint_list_t;
@@ -456,9 +513,20 @@ public:
 
 	static void removeKeyframeData(const LLUUID& id);
 
+	// Maps a file of animations decoded in earlier sessions.  Animations
+	// missing from the map are loaded from it before falling back to the
+	// VFS and the asset system.  Opening another file clears the cache.
+	static bool openCompiledCache(const std::string& filename);
+	// Clears the cache and closes the file, first replacing it with every
+	// animation cached now if save is set.
+	static void closeCompiledCache(bool save);
+
 	//print out diagnostic info
 	static void dumpDiagInfo();
 	static void clear();
+
+private:
+	static LLKeyframeCacheFile* sCompiledCache;
 };
 
 #endif // LL_LLKEYFRAMEMOTION_H
@@ -0,0 +1,439 @@
+/** 
+ * @file llmorphdeltas.cpp
+ * @brief Implementation of LLMorphDeltas and LLMorphAccumulator
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+//-----------------------------------------------------------------------------
+// Header Files
+//-----------------------------------------------------------------------------
+#include "linden_common.h"
+
+#include "llmorphdeltas.h"
+
+#include "v2math.h"
+#include "v3math.h"
+#include "v4math.h"
+
+//-----------------------------------------------------------------------------
+// LLMorphDeltas()
+//-----------------------------------------------------------------------------
+LLMorphDeltas::LLMorphDeltas() :
+	mNumVertices(0),
+	mNumGroups(0),
+	mBuffer(NULL),
+	mGroups(NULL)
+{
+}
+
+//-----------------------------------------------------------------------------
+// ~LLMorphDeltas()
+//-----------------------------------------------------------------------------
+LLMorphDeltas::~LLMorphDeltas()
+{
+	delete[] mBuffer;
+}
+
+//-----------------------------------------------------------------------------
+// set()
+//-----------------------------------------------------------------------------
+void LLMorphDeltas::set(U32 num_vertices, const U32* vertex_indices,
+						const LLVector3* coords, const LLVector3* normals,
+						const LLVector3* binormals, const LLVector2* tex_coords)
+{
+	delete[] mBuffer;
+	mBuffer = NULL;
+	mGroups = NULL;
+
+	mNumVertices = num_vertices;
+	mNumGroups = (num_vertices + 3) / 4;
+	mIndices.assign(vertex_indices, vertex_indices + num_vertices);
+	if (!mNumGroups)
+	{
+		return;
+	}
+
+	U32 num_floats = mNumGroups * NUM_COMPONENTS * 4;
+	mBuffer = new U8[num_floats * sizeof(F32) + 15];
+	mGroups = (F32*)(((size_t)mBuffer + 15) & ~(size_t)15);
+	memset(mGroups, 0, num_floats * sizeof(F32));
+
+	for (U32 v = 0; v < num_vertices; ++v)
+	{
+		F32* group = mGroups + (v / 4) * NUM_COMPONENTS * 4;
+		U32 lane = v % 4;
+		for (U32 i = 0; i < 3; ++i)
+		{
+			group[(COORD_X + i) * 4 + lane] = coords[v].mV[i];
+			group[(NORMAL_X + i) * 4 + lane] = normals[v].mV[i];
+			group[(BINORMAL_X + i) * 4 + lane] = binormals[v].mV[i];
+		}
+		group[TEX_U * 4 + lane] = tex_coords[v].mV[VX];
+		group[TEX_V * 4 + lane] = tex_coords[v].mV[VY];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// LLMorphAccumulator
+//-----------------------------------------------------------------------------
+BOOL LLMorphAccumulator::sVectorize = LL_VECTORIZE;
+
+LLMorphAccumulator::LLMorphAccumulator() :
+	mNumVertices(0),
+	mCoords(NULL),
+	mNormals(NULL),
+	mScaledNormals(NULL),
+	mBinormals(NULL),
+	mScaledBinormals(NULL),
+	mTexCoords(NULL),
+	mClothingWeights(NULL)
+{
+}
+
+// static
+void LLMorphAccumulator::setVectorize(BOOL vectorize)
+{
+	sVectorize = vectorize && LL_VECTORIZE;
+}
+
+//-----------------------------------------------------------------------------
+// begin()
+//-----------------------------------------------------------------------------
+void LLMorphAccumulator::begin(U32 num_vertices, LLVector3* coords,
+							   LLVector3* normals, LLVector3* scaled_normals,
+							   LLVector3* binormals, LLVector3* scaled_binormals,
+							   LLVector2* tex_coords, LLVector4* clothing_weights)
+{
+	mNumVertices = num_vertices;
+	mCoords = coords;
+	mNormals = normals;
+	mScaledNormals = scaled_normals;
+	mBinormals = binormals;
+	mScaledBinormals = scaled_binormals;
+	mTexCoords = tex_coords;
+	mClothingWeights = clothing_weights;
+
+	// mTouched is all zeroes between finish() and begin()
+	if (mTouched.size() < num_vertices)
+	{
+		mTouched.resize(num_vertices, 0);
+	}
+	mTouchedVertices.clear();
+}
+
+//-----------------------------------------------------------------------------
+// add()
+//-----------------------------------------------------------------------------
+void LLMorphAccumulator::add(const LLMorphDeltas& deltas, F32 weight, const F32* mask_weights,
+							 F32 normal_scale, BOOL clothing)
+{
+	if (!mClothingWeights)
+	{
+		clothing = FALSE;
+	}
+#if LL_VECTORIZE
+	if (sVectorize)
+	{
+		addVectorized(deltas, weight, mask_weights, normal_scale, clothing);
+		return;
+	}
+#endif
+	addScalar(deltas, weight, mask_weights, normal_scale, clothing);
+}
+
+//-----------------------------------------------------------------------------
+// finish()
+//-----------------------------------------------------------------------------
+void LLMorphAccumulator::finish()
+{
+#if LL_VECTORIZE
+	if (sVectorize)
+	{
+		finishVectorized();
+	}
+	else
+#endif
+	{
+		finishScalar();
+	}
+
+	for (std::vector<U32>::iterator iter = mTouchedVertices.begin();
+		 iter != mTouchedVertices.end(); ++iter)
+	{
+		mTouched[*iter] = 0;
+	}
+	mTouchedVertices.clear();
+}
+
+//-----------------------------------------------------------------------------
+// addScalar()
+//-----------------------------------------------------------------------------
+void LLMorphAccumulator::addScalar(const LLMorphDeltas& deltas, F32 weight, const F32* mask_weights,
+								   F32 normal_scale, BOOL clothing)
+{
+	for (U32 v = 0; v < deltas.mNumVertices; ++v)
+	{
+		const F32* group = deltas.getGroup(v / 4);
+		U32 lane = v % 4;
+		U32 index = deltas.mIndices[v];
+		llassert(index < mNumVertices);
+
+		F32 mask_weight = mask_weights ? mask_weights[v] : 1.f;
+
+		LLVector3 coord(group[LLMorphDeltas::COORD_X * 4 + lane],
+						group[LLMorphDeltas::COORD_Y * 4 + lane],
+						group[LLMorphDeltas::COORD_Z * 4 + lane]);
+		LLVector3 coord_offset = coord * weight * mask_weight;
+		mCoords[index] += coord_offset;
+		if (clothing)
+		{
+			LLVector4* clothing_weight = &mClothingWeights[index];
+			clothing_weight->mV[VX] += coord_offset.mV[VX];
+			clothing_weight->mV[VY] += coord_offset.mV[VY];
+			clothing_weight->mV[VZ] += coord_offset.mV[VZ];
+			clothing_weight->mV[VW] = mask_weight;
+		}
+
+		LLVector3 normal(group[LLMorphDeltas::NORMAL_X * 4 + lane],
+						 group[LLMorphDeltas::NORMAL_Y * 4 + lane],
+						 group[LLMorphDeltas::NORMAL_Z * 4 + lane]);
+		mScaledNormals[index] += normal * weight * mask_weight * normal_scale;
+
+		LLVector3 binormal(group[LLMorphDeltas::BINORMAL_X * 4 + lane],
+						   group[LLMorphDeltas::BINORMAL_Y * 4 + lane],
+						   group[LLMorphDeltas::BINORMAL_Z * 4 + lane]);
+		mScaledBinormals[index] += binormal * weight * mask_weight * normal_scale;
+
+		LLVector2 tex_coord(group[LLMorphDeltas::TEX_U * 4 + lane],
+							group[LLMorphDeltas::TEX_V * 4 + lane]);
+		mTexCoords[index] += tex_coord * weight * mask_weight;
+
+		if (!mTouched[index])
+		{
+			mTouched[index] = 1;
+			mTouchedVertices.push_back(index);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// finishScalar()
+//-----------------------------------------------------------------------------
+void LLMorphAccumulator::finishScalar()
+{
+	for (std::vector<U32>::iterator iter = mTouchedVertices.begin();
+		 iter != mTouchedVertices.end(); ++iter)
+	{
+		U32 index = *iter;
+
+		// calculate new normals based on half angles
+		LLVector3 normalized_normal = mScaledNormals[index];
+		normalized_normal.normVec();
+		mNormals[index] = normalized_normal;
+
+		// calculate new binormals
+		LLVector3 tangent = mScaledBinormals[index] % normalized_normal;
+		LLVector3 normalized_binormal = normalized_normal % tangent;
+		normalized_binormal.normVec();
+		mBinormals[index] = normalized_binormal;
+	}
+}
+
+#if LL_VECTORIZE
+
+// Normalizes four vectors in place the way LLVector3::normVec() does,
+// zeroing the ones too short to normalize.
+inline void morph_normalize(V4F32& x, V4F32& y, V4F32& z)
+{
+	V4F32 mag = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+	V4F32 valid = _mm_cmpgt_ps(mag, _mm_set1_ps(FP_MAG_THRESHOLD));
+	V4F32 oomag = _mm_div_ps(_mm_set1_ps(1.f), mag);
+	x = _mm_and_ps(_mm_mul_ps(x, oomag), valid);
+	y = _mm_and_ps(_mm_mul_ps(y, oomag), valid);
+	z = _mm_and_ps(_mm_mul_ps(z, oomag), valid);
+}
+
+// (rx, ry, rz) = a % b, as LLVector3's operator% computes it
+inline void morph_cross(V4F32 ax, V4F32 ay, V4F32 az, V4F32 bx, V4F32 by, V4F32 bz,
+						V4F32& rx, V4F32& ry, V4F32& rz)
+{
+	rx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(by, az));
+	ry = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(bz, ax));
+	rz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(bx, ay));
+}
+
+//-----------------------------------------------------------------------------
+// addVectorized()
+//-----------------------------------------------------------------------------
+void LLMorphAccumulator::addVectorized(const LLMorphDeltas& deltas, F32 weight, const F32* mask_weights,
+									   F32 normal_scale, BOOL clothing)
+{
+	LL_LLV4MATH_ALIGN_PREFIX F32 offsets[LLMorphDeltas::NUM_COMPONENTS][4] LL_LLV4MATH_ALIGN_POSTFIX;
+	LL_LLV4MATH_ALIGN_PREFIX F32 masks[4] LL_LLV4MATH_ALIGN_POSTFIX;
+
+	const V4F32 weights = _mm_set1_ps(weight);
+	const V4F32 normal_scales = _mm_set1_ps(normal_scale);
+
+	for (U32 g = 0; g < deltas.mNumGroups; ++g)
+	{
+		const F32* group = deltas.getGroup(g);
+		U32 first = g * 4;
+		U32 count = llmin(deltas.mNumVertices - first, (U32)4);
+
+		V4F32 mask;
+		if (!mask_weights)
+		{
+			mask = _mm_set1_ps(1.f);
+		}
+		else if (count == 4)
+		{
+			mask = _mm_loadu_ps(mask_weights + first);
+		}
+		else
+		{
+			for (U32 lane = 0; lane < 4; ++lane)
+			{
+				masks[lane] = lane < count ? mask_weights[first + lane] : 0.f;
+			}
+			mask = _mm_load_ps(masks);
+		}
+
+		for (U32 c = 0; c < LLMorphDeltas::NUM_COMPONENTS; ++c)
+		{
+			V4F32 offset = _mm_mul_ps(_mm_mul_ps(_mm_load_ps(group + c * 4), weights), mask);
+			if (c >= LLMorphDeltas::NORMAL_X && c <= LLMorphDeltas::BINORMAL_Z)
+			{
+				offset = _mm_mul_ps(offset, normal_scales);
+			}
+			_mm_store_ps(offsets[c], offset);
+		}
+		if (clothing)
+		{
+			_mm_store_ps(masks, mask);
+		}
+
+		for (U32 lane = 0; lane < count; ++lane)
+		{
+			U32 index = deltas.mIndices[first + lane];
+			llassert(index < mNumVertices);
+
+			F32* coord = mCoords[index].mV;
+			coord[VX] += offsets[LLMorphDeltas::COORD_X][lane];
+			coord[VY] += offsets[LLMorphDeltas::COORD_Y][lane];
+			coord[VZ] += offsets[LLMorphDeltas::COORD_Z][lane];
+			if (clothing)
+			{
+				F32* clothing_weight = mClothingWeights[index].mV;
+				clothing_weight[VX] += offsets[LLMorphDeltas::COORD_X][lane];
+				clothing_weight[VY] += offsets[LLMorphDeltas::COORD_Y][lane];
+				clothing_weight[VZ] += offsets[LLMorphDeltas::COORD_Z][lane];
+				clothing_weight[VW] = masks[lane];
+			}
+
+			F32* normal = mScaledNormals[index].mV;
+			normal[VX] += offsets[LLMorphDeltas::NORMAL_X][lane];
+			normal[VY] += offsets[LLMorphDeltas::NORMAL_Y][lane];
+			normal[VZ] += offsets[LLMorphDeltas::NORMAL_Z][lane];
+
+			F32* binormal = mScaledBinormals[index].mV;
+			binormal[VX] += offsets[LLMorphDeltas::BINORMAL_X][lane];
+			binormal[VY] += offsets[LLMorphDeltas::BINORMAL_Y][lane];
+			binormal[VZ] += offsets[LLMorphDeltas::BINORMAL_Z][lane];
+
+			F32* tex_coord = mTexCoords[index].mV;
+			tex_coord[VX] += offsets[LLMorphDeltas::TEX_U][lane];
+			tex_coord[VY] += offsets[LLMorphDeltas::TEX_V][lane];
+
+			if (!mTouched[index])
+			{
+				mTouched[index] = 1;
+				mTouchedVertices.push_back(index);
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// finishVectorized()
+//-----------------------------------------------------------------------------
+void LLMorphAccumulator::finishVectorized()
+{
+	LL_LLV4MATH_ALIGN_PREFIX F32 results[6][4] LL_LLV4MATH_ALIGN_POSTFIX;
+
+	U32 num_touched = mTouchedVertices.size();
+	for (U32 first = 0; first < num_touched; first += 4)
+	{
+		U32 count = llmin(num_touched - first, (U32)4);
+
+		// short groups repeat their first vertex
+		U32 indices[4];
+		for (U32 lane = 0; lane < 4; ++lane)
+		{
+			indices[lane] = mTouchedVertices[first + (lane < count ? lane : 0)];
+		}
+
+		const F32* sn0 = mScaledNormals[indices[0]].mV;
+		const F32* sn1 = mScaledNormals[indices[1]].mV;
+		const F32* sn2 = mScaledNormals[indices[2]].mV;
+		const F32* sn3 = mScaledNormals[indices[3]].mV;
+		V4F32 nx = _mm_set_ps(sn3[VX], sn2[VX], sn1[VX], sn0[VX]);
+		V4F32 ny = _mm_set_ps(sn3[VY], sn2[VY], sn1[VY], sn0[VY]);
+		V4F32 nz = _mm_set_ps(sn3[VZ], sn2[VZ], sn1[VZ], sn0[VZ]);
+		morph_normalize(nx, ny, nz);
+
+		const F32* sb0 = mScaledBinormals[indices[0]].mV;
+		const F32* sb1 = mScaledBinormals[indices[1]].mV;
+		const F32* sb2 = mScaledBinormals[indices[2]].mV;
+		const F32* sb3 = mScaledBinormals[indices[3]].mV;
+		V4F32 sbx = _mm_set_ps(sb3[VX], sb2[VX], sb1[VX], sb0[VX]);
+		V4F32 sby = _mm_set_ps(sb3[VY], sb2[VY], sb1[VY], sb0[VY]);
+		V4F32 sbz = _mm_set_ps(sb3[VZ], sb2[VZ], sb1[VZ], sb0[VZ]);
+
+		V4F32 tx, ty, tz;
+		morph_cross(sbx, sby, sbz, nx, ny, nz, tx, ty, tz);
+		V4F32 bx, by, bz;
+		morph_cross(nx, ny, nz, tx, ty, tz, bx, by, bz);
+		morph_normalize(bx, by, bz);
+
+		_mm_store_ps(results[0], nx);
+		_mm_store_ps(results[1], ny);
+		_mm_store_ps(results[2], nz);
+		_mm_store_ps(results[3], bx);
+		_mm_store_ps(results[4], by);
+		_mm_store_ps(results[5], bz);
+
+		for (U32 lane = 0; lane < count; ++lane)
+		{
+			mNormals[indices[lane]].setVec(results[0][lane], results[1][lane], results[2][lane]);
+			mBinormals[indices[lane]].setVec(results[3][lane], results[4][lane], results[5][lane]);
+		}
+	}
+}
+
+#endif // LL_VECTORIZE
@@ -0,0 +1,146 @@
+/** 
+ * @file llmorphdeltas.h
+ * @brief Morph target deltas packed for batched, vectorized application
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLMORPHDELTAS_H
+#define LL_LLMORPHDELTAS_H
+
+#include <vector>
+
+#include "llv4math.h"
+
+class LLVector2;
+class LLVector3;
+class LLVector4;
+
+//-----------------------------------------------------------------------------
+// class LLMorphDeltas
+// The per-vertex offsets of one morph target, stored as groups of four
+// vertices with each component in its own four-wide column (x x x x,
+// y y y y, ...), so a group can be scaled with a handful of vector
+// multiplies.  The last group is padded with zero deltas.
+//-----------------------------------------------------------------------------
+class LLMorphDeltas
+{
+public:
+	LLMorphDeltas();
+	~LLMorphDeltas();
+
+	// Copies num_vertices deltas for the mesh vertices in vertex_indices
+	void set(U32 num_vertices, const U32* vertex_indices,
+			 const LLVector3* coords, const LLVector3* normals,
+			 const LLVector3* binormals, const LLVector2* tex_coords);
+
+	U32 getNumVertices() const { return mNumVertices; }
+
+private:
+	friend class LLMorphAccumulator;
+
+	// disallowed
+	LLMorphDeltas(const LLMorphDeltas&);
+	LLMorphDeltas& operator=(const LLMorphDeltas&);
+
+	enum
+	{
+		COORD_X, COORD_Y, COORD_Z,
+		NORMAL_X, NORMAL_Y, NORMAL_Z,
+		BINORMAL_X, BINORMAL_Y, BINORMAL_Z,
+		TEX_U, TEX_V,
+		NUM_COMPONENTS
+	};
+
+	const F32* getGroup(U32 group) const { return mGroups + group * NUM_COMPONENTS * 4; }
+
+	U32 mNumVertices;
+	U32 mNumGroups;
+	std::vector<U32> mIndices;
+	U8* mBuffer;
+	F32* mGroups;	// mBuffer, aligned for LLV4 math
+};
+
+//-----------------------------------------------------------------------------
+// class LLMorphAccumulator
+// Adds any number of weighted morph targets to one mesh's vertex arrays,
+// then recomputes the normal and binormal of every vertex they touched
+// once at the end, instead of once per morph.  Each delta is scaled the
+// same way, in the same order, as the per-morph loop it replaces, so the
+// results are the same as applying the morphs one at a time.
+//-----------------------------------------------------------------------------
+class LLMorphAccumulator
+{
+public:
+	LLMorphAccumulator();
+
+	void begin(U32 num_vertices, LLVector3* coords,
+			   LLVector3* normals, LLVector3* scaled_normals,
+			   LLVector3* binormals, LLVector3* scaled_binormals,
+			   LLVector2* tex_coords, LLVector4* clothing_weights);
+
+	// Adds deltas * weight * mask_weights[i] to the mesh, with normal and
+	// binormal deltas further scaled by normal_scale.  mask_weights may be
+	// NULL.  Clothing morphs also offset the clothing weights and store the
+	// mask weight in their w component.
+	void add(const LLMorphDeltas& deltas, F32 weight, const F32* mask_weights,
+			 F32 normal_scale, BOOL clothing);
+
+	// Renormalizes the touched normals and binormals
+	void finish();
+
+	// Uses the scalar loops even where vectorization is available
+	static void setVectorize(BOOL vectorize);
+	static BOOL getVectorize() { return sVectorize; }
+
+private:
+	void addScalar(const LLMorphDeltas& deltas, F32 weight, const F32* mask_weights,
+				   F32 normal_scale, BOOL clothing);
+	void finishScalar();
+#if LL_VECTORIZE
+	void addVectorized(const LLMorphDeltas& deltas, F32 weight, const F32* mask_weights,
+					   F32 normal_scale, BOOL clothing);
+	void finishVectorized();
+#endif
+
+	U32 mNumVertices;
+	LLVector3* mCoords;
+	LLVector3* mNormals;
+	LLVector3* mScaledNormals;
+	LLVector3* mBinormals;
+	LLVector3* mScaledBinormals;
+	LLVector2* mTexCoords;
+	LLVector4* mClothingWeights;
+
+	std::vector<U8> mTouched;			// per mesh vertex
+	std::vector<U32> mTouchedVertices;	// in the order first touched
+
+	static BOOL sVectorize;
+};
+
+#endif // LL_LLMORPHDELTAS_H
@@ -143,7 +143,9 @@ LLMotionController::LLMotionController()
 	  mPauseTime(0.f),
 	  mTimeStep(0.f),
 	  mTimeStepCount(0),
-	  mLastInterp(0.f)
+	  mLastInterp(0.f),
+	  mDeferMainThreadCalls(FALSE),
+	  mDeferredVisualParamUpdate(FALSE)
 {
 }
 
@@ -515,7 +517,7 @@ void LLMotionController::updateIdleMotion(LLMotion* motionp)
 		// this will only be called when an animation stops itself (runs out of time)
 		if (mLastTime <= motionp->mSendStopTimestamp)
 		{
-			mCharacter->requestStopMotion( motionp );
+			requestStopMotion( motionp );
 			stopMotionInstance(motionp, FALSE);
 		}
 	}
@@ -616,7 +618,7 @@ void LLMotionController::updateMotionsByType(LLMotion::LLMotionBlendType anim_ty
 				// this will only be called when an animation stops itself (runs out of time)
 				if (mLastTime <= motionp->mSendStopTimestamp)
 				{
-					mCharacter->requestStopMotion( motionp );
+					requestStopMotion( motionp );
 					stopMotionInstance(motionp, FALSE);
 				}
 			}
@@ -697,7 +699,7 @@ void LLMotionController::updateMotionsByType(LLMotion::LLMotionBlendType anim_ty
 				// this will only be called when an animation stops itself (runs out of time)
 				if (mLastTime <= motionp->mSendStopTimestamp)
 				{
-					mCharacter->requestStopMotion( motionp );
+					requestStopMotion( motionp );
 					stopMotionInstance(motionp, FALSE);
 				}
 			}
@@ -741,7 +743,7 @@ void LLMotionController::updateMotionsByType(LLMotion::LLMotionBlendType anim_ty
 				// animation has stopped itself due to internal logic
 				// propagate this to the network
 				// as not all viewers are guaranteed to have access to the same logic
-				mCharacter->requestStopMotion( motionp );
+				requestStopMotion( motionp );
 				stopMotionInstance(motionp, FALSE);
 			}
 
@@ -813,7 +815,10 @@ void LLMotionController::updateMotions(bool force_update)
 	mLastTime = mAnimTime;
 
 	// Always cap the number of loaded motions
-	purgeExcessMotions();
+	if (!mDeferMainThreadCalls)
+	{
+		purgeExcessMotions();
+	}
 	
 	// Update timing info for this time step.
 	if (!mPaused)
@@ -835,7 +840,10 @@ void LLMotionController::updateMotions(bool force_update)
 					mLastInterp = interp;
 				}
 
-				updateLoadingMotions();
+				if (!mDeferMainThreadCalls)
+				{
+					updateLoadingMotions();
+				}
 				return;
 			}
 			
@@ -853,7 +861,10 @@ void LLMotionController::updateMotions(bool force_update)
 		}
 	}
 
-	updateLoadingMotions();
+	if (!mDeferMainThreadCalls)
+	{
+		updateLoadingMotions();
+	}
 
 	resetJointSignatures();
 
@@ -893,8 +904,11 @@ void LLMotionController::updateMotionsMinimal()
 	// Always update mPrevTimerElapsed
 	mPrevTimerElapsed = mTimer.getElapsedTimeF32();
 
-	purgeExcessMotions();
-	updateLoadingMotions();
+	if (!mDeferMainThreadCalls)
+	{
+		purgeExcessMotions();
+		updateLoadingMotions();
+	}
 	resetJointSignatures();
 
 	deactivateStoppedMotions();
@@ -902,6 +916,74 @@ void LLMotionController::updateMotionsMinimal()
 	mHasRunOnce = TRUE;
 }
 
+//-----------------------------------------------------------------------------
+// beginDeferredUpdate()
+//-----------------------------------------------------------------------------
+void LLMotionController::beginDeferredUpdate()
+{
+	// Newly loaded motions are activated at the previous update's time here
+	// rather than this one's, which is one frame earlier than usual.
+	purgeExcessMotions();
+	updateLoadingMotions();
+
+	mDeferMainThreadCalls = TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// endDeferredUpdate()
+//-----------------------------------------------------------------------------
+void LLMotionController::endDeferredUpdate()
+{
+	mDeferMainThreadCalls = FALSE;
+
+	for (std::vector<LLMotion*>::iterator iter = mDeferredStopRequests.begin();
+		 iter != mDeferredStopRequests.end(); ++iter)
+	{
+		mCharacter->requestStopMotion(*iter);
+	}
+	mDeferredStopRequests.clear();
+
+	if (mDeferredVisualParamUpdate)
+	{
+		mDeferredVisualParamUpdate = FALSE;
+		mCharacter->updateVisualParams();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// requestVisualParamUpdate()
+//-----------------------------------------------------------------------------
+void LLMotionController::requestVisualParamUpdate()
+{
+	if (mDeferMainThreadCalls)
+	{
+		// applying params deforms meshes through state shared by all
+		// avatars, so it waits for the main thread
+		mDeferredVisualParamUpdate = TRUE;
+	}
+	else
+	{
+		mCharacter->updateVisualParams();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// requestStopMotion()
+// tells the character that a motion stopped itself
+//-----------------------------------------------------------------------------
+void LLMotionController::requestStopMotion(LLMotion* motion)
+{
+	if (mDeferMainThreadCalls)
+	{
+		// the viewer sends this to the simulator, so it waits for the main thread
+		mDeferredStopRequests.push_back(motion);
+	}
+	else
+	{
+		mCharacter->requestStopMotion(motion);
+	}
+}
+
 //-----------------------------------------------------------------------------
 // activateMotionInstance()
 //-----------------------------------------------------------------------------
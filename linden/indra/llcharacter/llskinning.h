@@ -0,0 +1,103 @@
+/** 
+ * @file llskinning.h
+ * @brief CPU skinning kernels for two-joint blended meshes
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLSKINNING_H
+#define LL_LLSKINNING_H
+
+class LLCPUInfo;
+class LLMatrix4;
+class LLVector3;
+
+//-----------------------------------------------------------------------------
+// class LLSkinning
+// CPU skinning for avatar meshes, used when the video card can't run the
+// avatar vertex program.  Every vertex blends between two neighbouring
+// joints: the integer part of its weight picks joint_mats[i], and the
+// fraction blends toward joint_mats[i + 1].
+//
+// The kernels only touch the arrays they are given, so several meshes can
+// be skinned at once on different threads.  The SIMD versions are in their
+// own files because each needs its own compiler options.
+//-----------------------------------------------------------------------------
+class LLSkinning
+{
+public:
+	enum EKernel
+	{
+		KERNEL_ORIGINAL,	// plain C++
+		KERNEL_VECTORIZED,	// LLV4 math with the compiler's defaults, works well for Altivec
+		KERNEL_SSE,
+		KERNEL_SSE2,
+		KERNEL_AVX2,		// two vertices at a time, with FMA
+		KERNEL_COUNT
+	};
+
+	// Writes num_vertices skinned positions and normals, out_stride bytes
+	// apart, so the output can go straight into an interleaved vertex buffer.
+	typedef void (*skin_func_t)(const LLMatrix4* joint_mats, const F32* weights,
+								const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+								LLVector3* out_coords, LLVector3* out_normals, U32 out_stride);
+
+	static skin_func_t getKernel(EKernel kernel);
+	static const char* getKernelName(EKernel kernel);
+
+	// The fastest kernel the processor supports, if this build has it
+	static EKernel getBestKernel(const LLCPUInfo& cpu);
+
+	// A joint's skinning matrix: its world matrix, with the joint's skin
+	// offset rotated into world space and added to the translation
+	static void makeJointMatrix(const LLMatrix4& world, const LLVector3& skin_offset, LLMatrix4& joint_mat);
+
+	static void skinOriginal(const LLMatrix4* joint_mats, const F32* weights,
+							 const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+							 LLVector3* out_coords, LLVector3* out_normals, U32 out_stride);
+	static void skinVectorized(const LLMatrix4* joint_mats, const F32* weights,
+							   const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+							   LLVector3* out_coords, LLVector3* out_normals, U32 out_stride);
+	static void skinSSE(const LLMatrix4* joint_mats, const F32* weights,
+						const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+						LLVector3* out_coords, LLVector3* out_normals, U32 out_stride);
+	static void skinSSE2(const LLMatrix4* joint_mats, const F32* weights,
+						 const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+						 LLVector3* out_coords, LLVector3* out_normals, U32 out_stride);
+	static void skinAVX2(const LLMatrix4* joint_mats, const F32* weights,
+						 const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+						 LLVector3* out_coords, LLVector3* out_normals, U32 out_stride);
+};
+
+// the next vertex of a strided output array
+inline LLVector3* skin_next(LLVector3* out, U32 stride)
+{
+	return (LLVector3*)((U8*)out + stride);
+}
+
+#endif // LL_LLSKINNING_H
@@ -0,0 +1,144 @@
+/** 
+ * @file llskinning_avx2.cpp
+ * @brief AVX2 skinning kernel
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+// Visual Studio required settings for this file:
+// Precompiled Headers OFF
+// Enhanced Instruction Set: AVX2
+
+//-----------------------------------------------------------------------------
+// Header Files
+//-----------------------------------------------------------------------------
+#include "linden_common.h"
+
+#include "llskinning.h"
+
+#include "llv4math.h"		// for LL_VECTORIZE
+#include "m4math.h"
+#include "v3math.h"
+
+
+#if LL_VECTORIZE && defined(__AVX2__) && (defined(__FMA__) || LL_MSVC)
+
+#include <immintrin.h>
+
+// row of joint_mats[lo] in the low half, and of joint_mats[hi] in the high half
+static inline __m256 load_rows(const LLMatrix4* joint_mats, S32 lo, S32 hi, S32 row)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(joint_mats[lo].mMatrix[row])),
+								_mm_loadu_ps(joint_mats[hi].mMatrix[row]), 1);
+}
+
+// a in the low half, b in the high half
+static inline __m256 splat_pair(F32 a, F32 b)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a)), _mm_set1_ps(b), 1);
+}
+
+static inline void store_vec3(const __m128& v, LLVector3* out)
+{
+	_mm_storel_pi((__m64*)out->mV, v);
+	_mm_store_ss(out->mV + VZ, _mm_movehl_ps(v, v));
+}
+
+// Skins two vertices per pass, one in each 128-bit half.  Each pair's two
+// blended matrices are kept while the next pair has the same weights,
+// which is most of the time since vertices are sorted by joint.
+// static
+void LLSkinning::skinAVX2(const LLMatrix4* joint_mats, const F32* weights,
+						  const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+						  LLVector3* out_coords, LLVector3* out_normals, U32 out_stride)
+{
+	F32 last_weight0 = F32_MAX;
+	F32 last_weight1 = F32_MAX;
+	__m256 blend[4];
+
+	U32 index = 0;
+	for ( ; index + 1 < num_vertices; index += 2)
+	{
+		F32 weight0 = weights[index];
+		F32 weight1 = weights[index + 1];
+		if (weight0 != last_weight0 || weight1 != last_weight1)
+		{
+			last_weight0 = weight0;
+			last_weight1 = weight1;
+			S32 joint0 = llfloor(weight0);
+			S32 joint1 = llfloor(weight1);
+			__m256 w = splat_pair(weight0 - joint0, weight1 - joint1);
+			for (S32 row = 0; row < 4; ++row)
+			{
+				__m256 a = load_rows(joint_mats, joint0, joint1, row);
+				__m256 b = load_rows(joint_mats, joint0 + 1, joint1 + 1, row);
+				blend[row] = _mm256_fmadd_ps(_mm256_sub_ps(b, a), w, a);
+			}
+		}
+
+		const LLVector3& c0 = coords[index];
+		const LLVector3& c1 = coords[index + 1];
+		__m256 v = _mm256_fmadd_ps(splat_pair(c0.mV[VZ], c1.mV[VZ]), blend[VZ], blend[VW]);
+		v = _mm256_fmadd_ps(splat_pair(c0.mV[VY], c1.mV[VY]), blend[VY], v);
+		v = _mm256_fmadd_ps(splat_pair(c0.mV[VX], c1.mV[VX]), blend[VX], v);
+
+		const LLVector3& n0 = normals[index];
+		const LLVector3& n1 = normals[index + 1];
+		__m256 n = _mm256_mul_ps(splat_pair(n0.mV[VZ], n1.mV[VZ]), blend[VZ]);
+		n = _mm256_fmadd_ps(splat_pair(n0.mV[VY], n1.mV[VY]), blend[VY], n);
+		n = _mm256_fmadd_ps(splat_pair(n0.mV[VX], n1.mV[VX]), blend[VX], n);
+
+		store_vec3(_mm256_castps256_ps128(v), out_coords);
+		store_vec3(_mm256_castps256_ps128(n), out_normals);
+		out_coords = skin_next(out_coords, out_stride);
+		out_normals = skin_next(out_normals, out_stride);
+		store_vec3(_mm256_extractf128_ps(v, 1), out_coords);
+		store_vec3(_mm256_extractf128_ps(n, 1), out_normals);
+		out_coords = skin_next(out_coords, out_stride);
+		out_normals = skin_next(out_normals, out_stride);
+	}
+
+	if (index < num_vertices)
+	{
+		// odd one out
+		skinSSE2(joint_mats, weights + index, coords + index, normals + index, 1,
+				 out_coords, out_normals, out_stride);
+	}
+}
+
+#else
+
+// static
+void LLSkinning::skinAVX2(const LLMatrix4* joint_mats, const F32* weights,
+						  const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+						  LLVector3* out_coords, LLVector3* out_normals, U32 out_stride)
+{
+	skinSSE2(joint_mats, weights, coords, normals, num_vertices, out_coords, out_normals, out_stride);
+}
+
+#endif
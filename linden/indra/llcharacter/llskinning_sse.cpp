@@ -0,0 +1,99 @@
+/** 
+ * @file llskinning_sse.cpp
+ * @brief SSE vectorized joint skinning code, only used when video card does
+ * not support avatar vertex programs.
+ *
+ * *NOTE: Disabled on Windows builds. See llv4math.h for details.
+ *
+ * $LicenseInfo:firstyear=2007&license=viewergpl$
+ * 
+ * Copyright (c) 2007-2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+//-----------------------------------------------------------------------------
+// Header Files
+//-----------------------------------------------------------------------------
+#include "linden_common.h"
+
+#include "llskinning.h"
+
+#include "m3math.h"
+#include "m4math.h"
+#include "v3math.h"
+#include "v4math.h"
+
+#include "llv4math.h"		// for LL_VECTORIZE
+#include "llv4matrix3.h"
+#include "llv4matrix4.h"
+
+
+#if LL_VECTORIZE
+
+static inline void matrix_load(LLV4Matrix4& m, const LLMatrix4& w)
+{
+	m.mV[VX] = _mm_loadu_ps(w.mMatrix[VX]);
+	m.mV[VY] = _mm_loadu_ps(w.mMatrix[VY]);
+	m.mV[VZ] = _mm_loadu_ps(w.mMatrix[VZ]);
+	m.mV[VW] = _mm_loadu_ps(w.mMatrix[VW]);
+}
+
+// static
+void LLSkinning::skinSSE(const LLMatrix4* joint_mats, const F32* weights,
+						 const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+						 LLVector3* out_coords, LLVector3* out_normals, U32 out_stride)
+{
+	F32					weight		= F32_MAX;
+	LLV4Matrix4			blend_mat;
+	LLV4Matrix4			mat0;
+	LLV4Matrix4			mat1;
+
+	for (U32 index = 0; index < num_vertices; ++index)
+	{
+		if( weight != weights[index])
+		{
+			S32 joint = llfloor(weight = weights[index]);
+			matrix_load(mat0, joint_mats[joint]);
+			matrix_load(mat1, joint_mats[joint+1]);
+			blend_mat.lerp(mat0, mat1, weight - joint);
+		}
+		blend_mat.multiply(coords[index], *out_coords);
+		((LLV4Matrix3)blend_mat).multiply(normals[index], *out_normals);
+		out_coords = skin_next(out_coords, out_stride);
+		out_normals = skin_next(out_normals, out_stride);
+	}
+}
+
+#else
+
+// static
+void LLSkinning::skinSSE(const LLMatrix4* joint_mats, const F32* weights,
+						 const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+						 LLVector3* out_coords, LLVector3* out_normals, U32 out_stride)
+{
+	skinVectorized(joint_mats, weights, coords, normals, num_vertices, out_coords, out_normals, out_stride);
+}
+
+#endif
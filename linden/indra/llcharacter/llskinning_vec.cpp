@@ -1,5 +1,5 @@
 /** 
- * @file llviewerjointmesh_vec.cpp
+ * @file llskinning_vec.cpp
  * @brief Compiler-generated vectorized joint skinning code, works well on
  * Altivec processors (PowerPC Mac)
  *
@@ -36,12 +36,15 @@
 //-----------------------------------------------------------------------------
 // Header Files
 //-----------------------------------------------------------------------------
-#include "llviewerprecompiledheaders.h"
+#include "linden_common.h"
 
-#include "llviewerjointmesh.h"
+#include "llskinning.h"
+
+#include "m3math.h"
+#include "m4math.h"
+#include "v3math.h"
+#include "v4math.h"
 
-#include "llface.h"
-#include "llpolymesh.h"
 #include "llv4math.h"
 #include "llv4matrix3.h"
 #include "llv4matrix4.h"
@@ -50,52 +53,27 @@
 // on PowerPC.
 
 // static
-void LLViewerJointMesh::updateGeometryVectorized(LLFace *face, LLPolyMesh *mesh)
+void LLSkinning::skinVectorized(const LLMatrix4* joint_mats, const F32* weights,
+								const LLVector3* coords, const LLVector3* normals, U32 num_vertices,
+								LLVector3* out_coords, LLVector3* out_normals, U32 out_stride)
 {
-	static LLV4Matrix4	sJointMat[32];
-	LLDynamicArray<LLJointRenderData*>& joint_data = mesh->getReferenceMesh()->mJointRenderData;
-	S32 j, joint_num, joint_end = joint_data.count();
-	LLV4Vector3 pivot;
-
-	//upload joint pivots/matrices
-	for(j = joint_num = 0; joint_num < joint_end ; ++joint_num )
-	{
-		LLSkinJoint *sj;
-		const LLMatrix4 *	wm = joint_data[joint_num]->mWorldMatrix;
-		if (NULL == (sj = joint_data[joint_num]->mSkinJoint))
-		{
-				sj = joint_data[++joint_num]->mSkinJoint;
-				((LLV4Matrix3)(sJointMat[j] = *wm)).multiply(sj->mRootToParentJointSkinOffset, pivot);
-				sJointMat[j++].translate(pivot);
-				wm = joint_data[joint_num]->mWorldMatrix;
-		}
-		((LLV4Matrix3)(sJointMat[j] = *wm)).multiply(sj->mRootToJointSkinOffset, pivot);
-		sJointMat[j++].translate(pivot);
-	}
-
 	F32					weight		= F32_MAX;
 	LLV4Matrix4			blend_mat;
+	LLV4Matrix4			mat0;
+	LLV4Matrix4			mat1;
 
-	LLStrider<LLVector3> o_vertices;
-	LLStrider<LLVector3> o_normals;
-
-	LLVertexBuffer *buffer = face->mVertexBuffer;
-	buffer->getVertexStrider(o_vertices,  mesh->mFaceVertexOffset);
-	buffer->getNormalStrider(o_normals,   mesh->mFaceVertexOffset);
-
-	const F32*			weights			= mesh->getWeights();
-	const LLVector3*	coords			= mesh->getCoords();
-	const LLVector3*	normals			= mesh->getNormals();
-	for (U32 index = 0, index_end = mesh->getNumVertices(); index < index_end; ++index)
+	for (U32 index = 0; index < num_vertices; ++index)
 	{
 		if( weight != weights[index])
 		{
 			S32 joint = llfloor(weight = weights[index]);
-			blend_mat.lerp(sJointMat[joint], sJointMat[joint+1], weight - joint);
+			mat0 = joint_mats[joint];
+			mat1 = joint_mats[joint+1];
+			blend_mat.lerp(mat0, mat1, weight - joint);
 		}
-		blend_mat.multiply(coords[index], o_vertices[index]);
-		((LLV4Matrix3)blend_mat).multiply(normals[index], o_normals[index]);
+		blend_mat.multiply(coords[index], *out_coords);
+		((LLV4Matrix3)blend_mat).multiply(normals[index], *out_normals);
+		out_coords = skin_next(out_coords, out_stride);
+		out_normals = skin_next(out_normals, out_stride);
 	}
-
-	buffer->setBuffer(0);
 }
@@ -49,11 +49,16 @@ public:
 	// ACCESSORS
 	static F32 getInterpolant(const F32 time_constant, BOOL use_cache = TRUE);
 
+	// While set, getInterpolant() only reads the cache, so it may be called
+	// from several threads at once.  Misses are computed but not stored.
+	static void setCacheReadOnly(BOOL read_only) { sCacheReadOnly = read_only; }
+
 protected:	
 	static LLFrameTimer sInternalTimer;	// frame timer for calculating deltas
 
 	static std::map<F32, F32> 	sInterpolants;
 	static F32					sTimeDelta;
+	static BOOL					sCacheReadOnly;
 };
 
 #endif  // LL_LLCRITICALDAMP_H
@@ -0,0 +1,185 @@
+/** 
+ * @file lljobpool.cpp
+ * @brief Runs batches of independent jobs on a pool of threads.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "lljobpool.h"
+
+#include "llformat.h"
+#include "lltimer.h"
+
+//============================================================================
+
+LLJobPool::LLJobPool(const std::string& name, S32 num_threads) :
+	mName(name),
+	mFunc(NULL),
+	mUserData(NULL),
+	mCount(0),
+	mBatch(0),
+	mNextJob(0),
+	mBusyThreads(0)
+{
+	mDoneCondition = new LLCondition(NULL);
+	for (S32 i = 1; i < num_threads; i++)
+	{
+		JobThread* thread = new JobThread(llformat("%s %d", name.c_str(), i), this);
+		mThreads.push_back(thread);
+		thread->start();
+	}
+	llinfos << "Job Pool: " << mName << " running on " << getNumThreads() << " threads" << llendl;
+}
+
+LLJobPool::~LLJobPool()
+{
+	for (std::vector<JobThread*>::iterator iter = mThreads.begin();
+		 iter != mThreads.end(); ++iter)
+	{
+		// ~LLThread() only waits for a thread it has seen running
+		JobThread* thread = *iter;
+		for (S32 timeout = 1000; timeout > 0 && !thread->hasStarted(); --timeout)
+		{
+			ms_sleep(1);
+		}
+		// asks the thread to quit and waits for it
+		delete thread;
+	}
+	mThreads.clear();
+	delete mDoneCondition;
+}
+
+void LLJobPool::run(S32 count, job_func_t func, void* userdata)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	if (mThreads.empty() || count == 1)
+	{
+		for (S32 i = 0; i < count; i++)
+		{
+			func(i, userdata);
+		}
+		return;
+	}
+
+	mFunc = func;
+	mUserData = userdata;
+	mCount = count;
+	mNextJob = 0;
+	mDoneCondition->lock();
+	mBusyThreads = (S32)mThreads.size();
+	mDoneCondition->unlock();
+
+	// Bump the batch last: a thread that is between batches may see it
+	// before wake() takes its lock.
+	mBatch++;
+	for (std::vector<JobThread*>::iterator iter = mThreads.begin();
+		 iter != mThreads.end(); ++iter)
+	{
+		(*iter)->wake();
+	}
+
+	runJobs();
+
+	// Wait for every thread to leave the batch, not just for the jobs to
+	// finish, so that none of them is still taking indices when the next
+	// run() resets the batch.
+	mDoneCondition->lock();
+	while (mBusyThreads > 0)
+	{
+		mDoneCondition->wait();
+	}
+	mDoneCondition->unlock();
+}
+
+void LLJobPool::runJobs()
+{
+	while (1)
+	{
+		S32 index = mNextJob++; // returns the old value
+		if (index >= mCount)
+		{
+			break;
+		}
+		mFunc(index, mUserData);
+	}
+}
+
+void LLJobPool::finishBatch()
+{
+	mDoneCondition->lock();
+	if (--mBusyThreads == 0)
+	{
+		mDoneCondition->signal();
+	}
+	mDoneCondition->unlock();
+}
+
+//============================================================================
+
+LLJobPool::JobThread::JobThread(const std::string& name, LLJobPool* pool) :
+	LLThread(name),
+	mPool(pool),
+	mBatch(0),
+	mStarted(false)
+{
+}
+
+// virtual
+bool LLJobPool::JobThread::runCondition()
+{
+	// mRunCondition must be locked here
+	return mBatch != mPool->mBatch;
+}
+
+// virtual
+void LLJobPool::JobThread::run()
+{
+	mStarted = true;
+	while (1)
+	{
+		checkPause();
+
+		if (isQuitting())
+			break;
+
+		// wake() reads mBatch under the same lock
+		mRunCondition->lock();
+		mBatch = mPool->mBatch;
+		mRunCondition->unlock();
+
+		mPool->runJobs();
+		mPool->finishBatch();
+	}
+
+	llinfos << "JOB POOL THREAD " << mName << " EXITING." << llendl;
+}
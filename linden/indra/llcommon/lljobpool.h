@@ -0,0 +1,102 @@
+/** 
+ * @file lljobpool.h
+ * @brief Runs batches of independent jobs on a pool of threads.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLJOBPOOL_H
+#define LL_LLJOBPOOL_H
+
+#include <string>
+#include <vector>
+
+#include "llthread.h"
+#include "llapr.h"
+
+//============================================================================
+// Fork/join helper for per-frame work: run() hands out a batch of jobs to
+// the pool's threads and the calling thread and returns when all of them
+// are done.  Jobs are handed out one index at a time, so uneven jobs
+// balance themselves.  For long running background work that the caller
+// polls for, use LLWorkerThread instead.
+
+class LLJobPool
+{
+public:
+	typedef void (*job_func_t)(S32 index, void* userdata);
+
+	// num_threads counts the thread that calls run(), so a pool of one
+	// starts no threads and runs every job inline.
+	LLJobPool(const std::string& name, S32 num_threads);
+	~LLJobPool();
+
+	S32 getNumThreads() const { return (S32)mThreads.size() + 1; }
+
+	// Calls func(i, userdata) once for each i in [0, count) and returns
+	// when every call has finished.  The calls may run in any order and
+	// at the same time, so they must not depend on each other.
+	// Call from one thread at a time.
+	void run(S32 count, job_func_t func, void* userdata);
+
+private:
+	class JobThread : public LLThread
+	{
+	public:
+		JobThread(const std::string& name, LLJobPool* pool);
+
+		bool hasStarted() const { return mStarted; }
+
+	protected:
+		/*virtual*/ bool runCondition(void);
+		/*virtual*/ void run(void);
+
+	private:
+		LLJobPool* mPool;
+		U32 mBatch; // last batch this thread has joined
+		volatile bool mStarted;
+	};
+
+	void runJobs();
+	void finishBatch();
+
+	std::string mName;
+	std::vector<JobThread*> mThreads;
+
+	// the current batch; only written by run() while no thread is in it
+	job_func_t mFunc;
+	void* mUserData;
+	S32 mCount;
+	LLAtomicU32 mBatch; // atomic so that a thread seeing a new batch also sees the fields above
+
+	LLAtomicS32 mNextJob;
+	LLCondition* mDoneCondition;
+	S32 mBusyThreads; // threads still in the current batch, protected by mDoneCondition
+};
+
+#endif // LL_LLJOBPOOL_H
@@ -33,6 +33,8 @@
 #include "llqueuedthread.h"
 #include "llstl.h"
 
+#include <algorithm>
+
 //============================================================================
 
 // MAIN THREAD
@@ -40,6 +42,9 @@ LLQueuedThread::LLQueuedThread(const std::string& name, bool threaded) :
 	LLThread(name),
 	mThreaded(threaded),
 	mIdleThread(TRUE),
+	mNextSerial(0),
+	mQueuedCount(0),
+	mInbox(NULL),
 	mNextHandle(0)
 {
 	if (mThreaded)
@@ -82,6 +87,19 @@ void LLQueuedThread::shutdown()
 		mStatus = STOPPED;
 	}
 
+	// Requests are owned by the hash; only priority changes need freeing here.
+	InboxRecord* record = takeInbox();
+	while (record)
+	{
+		InboxRecord* next = record->mNext;
+		if (!record->mRequest)
+		{
+			delete record;
+		}
+		record = next;
+	}
+	mRequestHeap.clear();
+
 	QueuedRequest* req;
 	S32 active_count = 0;
 	while ( (req = (QueuedRequest*)mRequestHash.pop_element()) )
@@ -147,11 +165,7 @@ void LLQueuedThread::incQueue()
 // May be called from any thread
 S32 LLQueuedThread::getPending()
 {
-	S32 res;
-	lockData();
-	res = mRequestQueue.size();
-	unlockData();
-	return res;
+	return mQueuedCount;
 }
 
 // MAIN thread
@@ -177,10 +191,9 @@ void LLQueuedThread::waitOnPending()
 void LLQueuedThread::printQueueStats()
 {
 	lockData();
-	if (!mRequestQueue.empty())
+	if (mQueuedCount > 0)
 	{
-		QueuedRequest *req = *mRequestQueue.begin();
-		llinfos << llformat("Pending Requests:%d Current status:%d", mRequestQueue.size(), req->getStatus()) << llendl;
+		llinfos << llformat("Pending Requests:%d Queue entries:%d", (S32)mQueuedCount, (S32)mRequestHeap.size()) << llendl;
 	}
 	else
 	{
@@ -212,8 +225,9 @@ bool LLQueuedThread::addRequest(QueuedRequest* req)
 	
 	lockData();
 	req->setStatus(STATUS_QUEUED);
-	mRequestQueue.insert(req);
 	mRequestHash.insert(req);
+	mQueuedCount++;
+	pushInbox(&req->mInboxRecord, &req->mInboxRecord);
 #if _DEBUG
 // 	llinfos << llformat("LLQueuedThread::Added req [%08d]",handle) << llendl;
 #endif
@@ -224,6 +238,61 @@ bool LLQueuedThread::addRequest(QueuedRequest* req)
 	return true;
 }
 
+// Any thread
+bool LLQueuedThread::submitBatch(RequestBatch& batch)
+{
+	if (mStatus == QUITTING)
+	{
+		return false;
+	}
+	if (batch.empty())
+	{
+		return true;
+	}
+
+	if (batch.mRequestCount)
+	{
+		lockData();
+		for (InboxRecord* record = batch.mHead; record; record = record->mNext)
+		{
+			QueuedRequest* req = record->mRequest;
+			if (req)
+			{
+				req->setStatus(STATUS_QUEUED);
+				mRequestHash.insert(req);
+			}
+		}
+		mQueuedCount += batch.mRequestCount;
+		pushInbox(batch.mHead, batch.mTail);
+		unlockData();
+
+		incQueue();
+	}
+	else if (pushInbox(batch.mHead, batch.mTail))
+	{
+		// Priority changes only, no lock needed
+		incQueue();
+	}
+
+	// The records now belong to the inbox
+	batch.mHead = batch.mTail = NULL;
+	batch.mRequestCount = 0;
+	return true;
+}
+
+// Any thread
+bool LLQueuedThread::pushInbox(InboxRecord* head, InboxRecord* tail)
+{
+	void* old_head;
+	do
+	{
+		old_head = apr_atomic_casptr(&mInbox, NULL, NULL); // atomic read
+		tail->mNext = (InboxRecord*)old_head;
+	}
+	while (apr_atomic_casptr(&mInbox, head, old_head) != old_head);
+	return old_head == NULL;
+}
+
 // MAIN thread
 bool LLQueuedThread::waitForResult(LLQueuedThread::handle_t handle, bool auto_complete)
 {
@@ -314,26 +383,15 @@ void LLQueuedThread::setFlags(handle_t handle, U32 flags)
 	unlockData();
 }
 
+// Any thread
 void LLQueuedThread::setPriority(handle_t handle, U32 priority)
 {
-	lockData();
-	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
-	if (req)
+	InboxRecord* record = new InboxRecord(NULL, handle, priority);
+	if (pushInbox(record, record))
 	{
-		if(req->getStatus() == STATUS_INPROGRESS)
-		{
-			// not in list
-			req->setPriority(priority);
-		}
-		else if(req->getStatus() == STATUS_QUEUED)
-		{
-			// remove from list then re-insert
-			llverify(mRequestQueue.erase(req) == 1);
-			req->setPriority(priority);
-			mRequestQueue.insert(req);
-		}
+		// An idle thread would otherwise hold the change until the next request
+		incQueue();
 	}
-	unlockData();
 }
 
 bool LLQueuedThread::completeRequest(handle_t handle)
@@ -380,20 +438,171 @@ bool LLQueuedThread::check()
 //============================================================================
 // Runs on its OWN thread
 
+// Any thread
+LLQueuedThread::InboxRecord* LLQueuedThread::takeInbox()
+{
+	void* head;
+	do
+	{
+		head = apr_atomic_casptr(&mInbox, NULL, NULL); // atomic read
+	}
+	while (head && apr_atomic_casptr(&mInbox, NULL, head) != head);
+	return (InboxRecord*)head;
+}
+
+void LLQueuedThread::drainInbox()
+{
+	// Take the whole list, then restore submission order
+	InboxRecord* record = takeInbox();
+	InboxRecord* ordered = NULL;
+	while (record)
+	{
+		InboxRecord* next = record->mNext;
+		record->mNext = ordered;
+		ordered = record;
+		record = next;
+	}
+
+	// Requests are only pushed once all the changes are in, so a request
+	// changed repeatedly gets a single heap entry at its final priority.
+	while (ordered)
+	{
+		InboxRecord* next = ordered->mNext;
+		QueuedRequest* req = ordered->mRequest;
+		if (req)
+		{
+			// Queued requests cannot be completed or deleted, so this is
+			// still valid.
+			if (req->getStatus() == STATUS_QUEUED)
+			{
+				mRequeue.push_back(req);
+			}
+		}
+		else
+		{
+			applyPriority(ordered->mHandle, ordered->mPriority);
+			delete ordered;
+		}
+		ordered = next;
+	}
+
+	if (!mRequeue.empty())
+	{
+		std::sort(mRequeue.begin(), mRequeue.end());
+		std::vector<QueuedRequest*>::iterator end = std::unique(mRequeue.begin(), mRequeue.end());
+		for (std::vector<QueuedRequest*>::iterator iter = mRequeue.begin(); iter != end; ++iter)
+		{
+			pushQueue(*iter);
+		}
+		mRequeue.clear();
+	}
+
+	// Superseded entries are normally dropped as they reach the top; if a
+	// lot of reprioritizing leaves the heap mostly stale, rebuild it.
+	if (mRequestHeap.size() > (size_t)(2 * mQueuedCount + 64))
+	{
+		compactQueue();
+	}
+}
+
+void LLQueuedThread::applyPriority(handle_t handle, U32 priority)
+{
+	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(handle);
+	if (!req || req->getPriority() == priority)
+	{
+		return;
+	}
+	if (req->getStatus() == STATUS_INPROGRESS)
+	{
+		// not in queue, picked up when it is requeued
+		req->setPriority(priority);
+	}
+	else if (req->getStatus() == STATUS_QUEUED)
+	{
+		// requeued by drainInbox()
+		req->setPriority(priority);
+		mRequeue.push_back(req);
+	}
+}
+
+void LLQueuedThread::pushQueue(QueuedRequest* req)
+{
+	QueueEntry entry;
+	entry.mPriority = req->getPriority();
+	entry.mHandle = req->getHashKey();
+	entry.mSerial = ++mNextSerial;
+	entry.mRequest = req;
+	req->mQueueSerial = entry.mSerial;
+	mRequestHeap.push_back(entry);
+	std::push_heap(mRequestHeap.begin(), mRequestHeap.end(), queue_entry_less());
+}
+
+LLQueuedThread::QueuedRequest* LLQueuedThread::popQueue()
+{
+	while (!mRequestHeap.empty())
+	{
+		QueueEntry entry = mRequestHeap.front();
+		std::pop_heap(mRequestHeap.begin(), mRequestHeap.end(), queue_entry_less());
+		mRequestHeap.pop_back();
+
+		if (isLiveEntry(entry))
+		{
+			mQueuedCount--;
+			return entry.mRequest;
+		}
+	}
+	return NULL;
+}
+
+bool LLQueuedThread::isLiveEntry(const QueueEntry& entry)
+{
+	// The entry's request may have been deleted, so validate it
+	// through the hash before touching it.
+	QueuedRequest* req = (QueuedRequest*)mRequestHash.find(entry.mHandle);
+	return req == entry.mRequest
+		&& req->mQueueSerial == entry.mSerial
+		&& req->getStatus() == STATUS_QUEUED;
+}
+
+void LLQueuedThread::getQueuedRequests(std::vector<QueuedRequest*>& requests)
+{
+	for (request_heap_t::iterator iter = mRequestHeap.begin(); iter != mRequestHeap.end(); ++iter)
+	{
+		if (isLiveEntry(*iter))
+		{
+			requests.push_back(iter->mRequest);
+		}
+	}
+}
+
+void LLQueuedThread::compactQueue()
+{
+	request_heap_t live;
+	live.reserve(mQueuedCount + 16);
+	for (request_heap_t::iterator iter = mRequestHeap.begin(); iter != mRequestHeap.end(); ++iter)
+	{
+		if (isLiveEntry(*iter))
+		{
+			live.push_back(*iter);
+		}
+	}
+	std::make_heap(live.begin(), live.end(), queue_entry_less());
+	mRequestHeap.swap(live);
+}
+
 S32 LLQueuedThread::processNextRequest()
 {
 	QueuedRequest *req;
 	// Get next request from pool
 	lockData();
+	drainInbox();
 	while(1)
 	{
-		req = NULL;
-		if (mRequestQueue.empty())
+		req = popQueue();
+		if (!req)
 		{
 			break;
 		}
-		req = *mRequestQueue.begin();
-		mRequestQueue.erase(mRequestQueue.begin());
 		if ((req->getFlags() & FLAG_ABORT) || (mStatus == QUITTING))
 		{
 			req->setStatus(STATUS_ABORTED);
@@ -439,8 +648,11 @@ S32 LLQueuedThread::processNextRequest()
 		else
 		{
 			lockData();
+			// pick up any priority change made while processing
+			drainInbox();
 			req->setStatus(STATUS_QUEUED);
-			mRequestQueue.insert(req);
+			mQueuedCount++;
+			pushQueue(req);
 			U32 priority = req->getPriority();
 			unlockData();
 			if (priority < PRIORITY_NORMAL)
@@ -473,7 +685,7 @@ S32 LLQueuedThread::processNextRequest()
 bool LLQueuedThread::runCondition()
 {
 	// mRunCondition must be locked here
-	if (mRequestQueue.empty() && mIdleThread)
+	if (mQueuedCount == 0 && mIdleThread && mInbox == NULL)
 		return false;
 	else
 		return true;
@@ -489,7 +701,7 @@ void LLQueuedThread::run()
 		if(isQuitting())
 			break;
 
-		//llinfos << "QUEUED THREAD RUNNING, queue size = " << mRequestQueue.size() << llendl;
+		//llinfos << "QUEUED THREAD RUNNING, queued requests = " << (S32)mQueuedCount << llendl;
 
 		mIdleThread = FALSE;
 		
@@ -516,8 +728,11 @@ LLQueuedThread::QueuedRequest::QueuedRequest(LLQueuedThread::handle_t handle, U3
 	LLSimpleHashEntry<LLQueuedThread::handle_t>(handle),
 	mStatus(STATUS_UNKNOWN),
 	mPriority(priority),
-	mFlags(flags)
+	mFlags(flags),
+	mQueueSerial(0),
+	mInboxRecord(NULL, handle, priority)
 {
+	mInboxRecord.mRequest = this;
 }
 
 LLQueuedThread::QueuedRequest::~QueuedRequest()
@@ -537,3 +752,42 @@ void LLQueuedThread::QueuedRequest::deleteRequest()
 	setStatus(STATUS_DELETE);
 	delete this;
 }
+
+//============================================================================
+
+void LLQueuedThread::RequestBatch::addRequest(QueuedRequest* req)
+{
+	append(&req->mInboxRecord);
+	mRequestCount++;
+}
+
+void LLQueuedThread::RequestBatch::setPriority(handle_t handle, U32 priority)
+{
+	append(new InboxRecord(NULL, handle, priority));
+}
+
+void LLQueuedThread::RequestBatch::clear()
+{
+	while (mHead)
+	{
+		InboxRecord* next = mHead->mNext;
+		if (!mHead->mRequest)
+		{
+			delete mHead;
+		}
+		mHead = next;
+	}
+	mTail = NULL;
+	mRequestCount = 0;
+}
+
+void LLQueuedThread::RequestBatch::append(InboxRecord* record)
+{
+	// Kept newest first so the whole batch can be pushed at once
+	record->mNext = mHead;
+	mHead = record;
+	if (!mTail)
+	{
+		mTail = record;
+	}
+}
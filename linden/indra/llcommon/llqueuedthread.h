@@ -35,8 +35,8 @@
 
 #include <queue>
 #include <string>
-#include <map>
 #include <set>
+#include <vector>
 
 #include "llapr.h"
 
@@ -80,9 +80,31 @@ public:
 	//------------------------------------------------------------------------
 public:
 
+	class QueuedRequest;
+	class RequestBatch;
+
+	// Entries in the lock-free inbox, applied in the order they were pushed.
+	// A new request is pushed through its own record; a priority change
+	// allocates one, freed once it has been applied.
+	class InboxRecord
+	{
+		friend class LLQueuedThread;
+		friend class RequestBatch;
+	public:
+		InboxRecord(QueuedRequest* req = NULL, handle_t handle = 0, U32 priority = 0) :
+			mNext(NULL), mRequest(req), mHandle(handle), mPriority(priority) {}
+
+	private:
+		InboxRecord* mNext;
+		QueuedRequest* mRequest; // NULL for a priority change
+		handle_t mHandle;
+		U32 mPriority;
+	};
+
 	class QueuedRequest : public LLSimpleHashEntry<handle_t>
 	{
 		friend class LLQueuedThread;
+		friend class RequestBatch;
 		
 	protected:
 		virtual ~QueuedRequest(); // use deleteRequest()
@@ -137,14 +159,58 @@ public:
 		LLAtomic32<status_t> mStatus;
 		U32 mPriority;
 		U32 mFlags;
+		U32 mQueueSerial; // matches the request's live entry in mRequestHeap
+		InboxRecord mInboxRecord;
+	};
+
+	//------------------------------------------------------------------------
+	// New requests and priority changes collected without any locking and
+	// handed to the thread in one go by submitBatch().
+	class RequestBatch
+	{
+		friend class LLQueuedThread;
+	public:
+		RequestBatch() : mHead(NULL), mTail(NULL), mRequestCount(0) {}
+		~RequestBatch() { clear(); }
+
+		void addRequest(QueuedRequest* req);
+		void setPriority(handle_t handle, U32 priority);
+		bool empty() const { return mHead == NULL; }
+		// Drops anything not yet submitted; requests still belong to the caller
+		void clear();
+
+	private:
+		// No copy constructor or copy assignment
+		RequestBatch(const RequestBatch&);
+		RequestBatch& operator=(const RequestBatch&);
+
+		void append(InboxRecord* record);
+
+		InboxRecord* mHead; // newest first, as in the inbox
+		InboxRecord* mTail;
+		S32 mRequestCount;
 	};
 
 protected:
-	struct queued_request_less
+	// Entries in the priority heap.  Reprioritizing a queued request pushes
+	// a fresh entry rather than searching for the old one; entries whose
+	// serial no longer matches their request are skipped when popped.
+	struct QueueEntry
 	{
-		bool operator()(const QueuedRequest* lhs, const QueuedRequest* rhs) const
+		U32 mPriority;
+		handle_t mHandle;
+		U32 mSerial;
+		QueuedRequest* mRequest; // compared, never dereferenced, until validated
+	};
+	struct queue_entry_less
+	{
+		bool operator()(const QueueEntry& lhs, const QueueEntry& rhs) const
 		{
-			return lhs->higherPriority(*rhs); // higher priority in front of queue (set)
+			// std heaps pop the largest entry: higher priority, then lower handle
+			if (lhs.mPriority == rhs.mPriority)
+				return lhs.mHandle > rhs.mHandle;
+			else
+				return lhs.mPriority < rhs.mPriority;
 		}
 	};
 
@@ -170,7 +236,21 @@ protected:
 	handle_t generateHandle();
 	bool addRequest(QueuedRequest* req);
 	S32  processNextRequest(void);
-	void incQueue();
+	virtual void incQueue();
+
+	// Lock-free multi-producer inbox, drained by whichever thread
+	// processes requests.  pushInbox() links head..tail in front of the
+	// current entries and returns true if the inbox was empty.
+	bool pushInbox(InboxRecord* head, InboxRecord* tail);
+	InboxRecord* takeInbox();
+	void drainInbox(); // call with data locked
+	void pushQueue(QueuedRequest* req); // call with data locked
+	QueuedRequest* popQueue(); // call with data locked
+	void compactQueue(); // call with data locked
+	bool isLiveEntry(const QueueEntry& entry); // call with data locked
+	void applyPriority(handle_t handle, U32 priority); // call with data locked
+	// Queued requests in no particular order, for debugging
+	void getQueuedRequests(std::vector<QueuedRequest*>& requests); // call with data locked
 
 public:
 	bool waitForResult(handle_t handle, bool auto_complete = true);
@@ -188,7 +268,13 @@ public:
 	status_t getRequestStatus(handle_t handle);
 	void abortRequest(handle_t handle, bool autocomplete);
 	void setFlags(handle_t handle, U32 flags);
+	// Priority changes do not take the data lock; they are applied in order
+	// with new requests the next time the thread looks for work.  A request
+	// changed several times before then is only requeued once.
 	void setPriority(handle_t handle, U32 priority);
+	// Queues every request in the batch and applies its priority changes,
+	// locking once for the lot.  Empties the batch unless quitting.
+	bool submitBatch(RequestBatch& batch);
 	bool completeRequest(handle_t handle);
 	// This is public for support classes like LLWorkerThread,
 	// but generally the methods above should be used.
@@ -201,8 +287,14 @@ protected:
 	BOOL mThreaded;  // if false, run on main thread and do updates during update()
 	LLAtomic32<BOOL> mIdleThread; // request queue is empty (or we are quitting) and the thread is idle
 	
-	typedef std::set<QueuedRequest*, queued_request_less> request_queue_t;
-	request_queue_t mRequestQueue;
+	// Only touched by the thread processing requests (with data locked)
+	typedef std::vector<QueueEntry> request_heap_t;
+	request_heap_t mRequestHeap;
+	U32 mNextSerial;
+	std::vector<QueuedRequest*> mRequeue; // scratch for drainInbox()
+
+	LLAtomic32<S32> mQueuedCount; // requests in STATUS_QUEUED
+	volatile void* mInbox; // InboxRecord*, newest first
 
 	enum { REQUEST_HASH_SIZE = 512 }; // must be power of 2
 	typedef LLSimpleHash<handle_t, REQUEST_HASH_SIZE> request_hash_t;
@@ -33,6 +33,9 @@
 #include "linden_common.h"
 #include "llsd.h"
 
+#include <new>
+
+#include "llapr.h"
 #include "llerror.h"
 #include "../llmath/llmath.h"
 #include "llformat.h"
@@ -66,6 +69,11 @@ class LLSD::Impl
 {
 private:
 	U32 mUseCount;
+	U32 mBlockOffset;
+		///< offset of this object in its LLSDArena block, or 0 if it
+		//   was allocated on its own
+	
+	friend class LLSDArena;
 	
 protected:
 	Impl();
@@ -351,6 +359,7 @@ namespace
 		virtual bool has(const LLSD::String&) const; 
 		virtual LLSD get(const LLSD::String&) const; 
 		        LLSD& insert(const LLSD::String& k, const LLSD& v);
+		        void insertLast(const LLSD::String& k, const LLSD& v);
 		virtual void erase(const LLSD::String&);
 		              LLSD& ref(const LLSD::String&);
 		virtual const LLSD& ref(const LLSD::String&) const;
@@ -399,6 +408,13 @@ namespace
 		#endif
 	}
 	
+	void ImplMap::insertLast(const LLSD::String& k, const LLSD& v)
+	{
+		// Hinting at the end makes this constant time when keys arrive
+		// in sorted order.
+		mData.insert(mData.end(), DataMap::value_type(k, v));
+	}
+	
 	void ImplMap::erase(const LLSD::String& k)
 	{
 		mData.erase(k);
@@ -444,6 +460,7 @@ namespace
 		        void set(LLSD::Integer, const LLSD&);
 		        LLSD& insert(LLSD::Integer, const LLSD&);
 		        void append(const LLSD&);
+		        void reserve(LLSD::Integer n)	{ mData.reserve(n); }
 		virtual void erase(LLSD::Integer);
 		              LLSD& ref(LLSD::Integer);
 		virtual const LLSD& ref(LLSD::Integer) const; 
@@ -558,14 +575,14 @@ namespace
 }
 
 LLSD::Impl::Impl()
-	: mUseCount(0)
+	: mUseCount(0), mBlockOffset(0)
 {
 	++sAllocationCount;
 	++sOutstandingCount;
 }
 
 LLSD::Impl::Impl(StaticAllocationMarker)
-	: mUseCount(0)
+	: mUseCount(0), mBlockOffset(0)
 {
 }
 
@@ -579,7 +596,14 @@ void LLSD::Impl::reset(Impl*& var, Impl* impl)
 	if (impl) ++impl->mUseCount;
 	if (var  &&  --var->mUseCount == 0)
 	{
-		delete var;
+		if (var->mBlockOffset)
+		{
+			LLSDArena::release(var, var->mBlockOffset);
+		}
+		else
+		{
+			delete var;
+		}
 	}
 	var = impl;
 }
@@ -693,6 +717,135 @@ namespace
 }
 
 
+struct LLSDArena::Block
+	///< Header at the start of each arena block.  The bytes after it are
+	//   handed out in order and never reused; the block is freed when the
+	//   last reference to it, the arena's or a value's, is released.
+{
+	enum { SIZE = 16384, HEADER = 16 };
+
+	LLAtomicS32 mRefs;
+	U32 mUsed;
+
+	static Block* create();
+	void release();
+
+	static LLAtomicS32 sCount;
+};
+
+LLAtomicS32 LLSDArena::Block::sCount;
+
+//static
+LLSDArena::Block* LLSDArena::Block::create()
+{
+	Block* block = new (::operator new(SIZE)) Block;
+	block->mRefs = 1;
+	block->mUsed = HEADER;
+	sCount++;
+	return block;
+}
+
+void LLSDArena::Block::release()
+{
+	// apr_atomic_dec32() returns zero once the count reaches zero
+	if (!(mRefs--))
+	{
+		sCount--;
+		this->~Block();
+		::operator delete(this);
+	}
+}
+
+LLSDArena::LLSDArena()
+	: mBlock(NULL)
+{
+}
+
+LLSDArena::~LLSDArena()
+{
+	if (mBlock)
+	{
+		mBlock->release();
+	}
+}
+
+void* LLSDArena::allocate(size_t size)
+{
+	size = (size + 7) & ~7;
+	if (!mBlock || mBlock->mUsed + size > Block::SIZE)
+	{
+		if (mBlock)
+		{
+			mBlock->release();
+		}
+		mBlock = Block::create();
+	}
+	void* mem = (char*)mBlock + mBlock->mUsed;
+	mBlock->mUsed += size;
+	return mem;
+}
+
+void LLSDArena::adopt(LLSD& sd, LLSD::Impl* impl)
+{
+	// The block only gains a reference once the value is constructed, so
+	// a constructor that throws just wastes its space.
+	mBlock->mRefs++;
+	impl->mBlockOffset = (U32)((char*)impl - (char*)mBlock);
+	LLSD::Impl::reset(sd.impl, impl);
+}
+
+//static
+void LLSDArena::release(LLSD::Impl* impl, U32 offset)
+{
+	Block* block = (Block*)((char*)impl - offset);
+	impl->~Impl();
+	block->release();
+}
+
+void LLSDArena::assign(LLSD& sd, LLSD::Boolean v)
+	{ adopt(sd, new (allocate(sizeof(ImplBoolean))) ImplBoolean(v)); }
+void LLSDArena::assign(LLSD& sd, LLSD::Integer v)
+	{ adopt(sd, new (allocate(sizeof(ImplInteger))) ImplInteger(v)); }
+void LLSDArena::assign(LLSD& sd, LLSD::Real v)
+	{ adopt(sd, new (allocate(sizeof(ImplReal))) ImplReal(v)); }
+void LLSDArena::assign(LLSD& sd, const LLSD::String& v)
+	{ adopt(sd, new (allocate(sizeof(ImplString))) ImplString(v)); }
+void LLSDArena::assign(LLSD& sd, const LLSD::UUID& v)
+	{ adopt(sd, new (allocate(sizeof(ImplUUID))) ImplUUID(v)); }
+void LLSDArena::assign(LLSD& sd, const LLSD::Date& v)
+	{ adopt(sd, new (allocate(sizeof(ImplDate))) ImplDate(v)); }
+void LLSDArena::assign(LLSD& sd, const LLSD::URI& v)
+	{ adopt(sd, new (allocate(sizeof(ImplURI))) ImplURI(v)); }
+void LLSDArena::assign(LLSD& sd, const LLSD::Binary& v)
+	{ adopt(sd, new (allocate(sizeof(ImplBinary))) ImplBinary(v)); }
+
+void LLSDArena::emptyMap(LLSD& sd)
+{
+	adopt(sd, new (allocate(sizeof(ImplMap))) ImplMap);
+}
+
+void LLSDArena::emptyArray(LLSD& sd, S32 reserve)
+{
+	ImplArray* array = new (allocate(sizeof(ImplArray))) ImplArray;
+	adopt(sd, array);
+	if (reserve > 0)
+	{
+		array->reserve(reserve);
+	}
+}
+
+void LLSDArena::insert(LLSD& map, const LLSD::String& k, const LLSD& v)
+{
+	makeMap(map.impl).insertLast(k, v);
+}
+
+//static
+S32 LLSDArena::getBlockCount()
+{
+	return Block::sCount;
+}
+
+
 LLSD::LLSD()							: impl(0)	{ }
 LLSD::~LLSD()							{ Impl::reset(impl, 0); }
 
@@ -324,6 +324,7 @@ public:
 		class Impl;
 private:
 		Impl* impl;
+		friend class LLSDArena;
 	//@}
 	
 	/** @name Unit Testing Interface */
@@ -344,6 +345,69 @@ private:
 	//@}
 };
 
+/**
+	LLSDArena builds LLSD values for parsers that produce whole documents at
+	once, such as the binary parser.
+
+	Values assigned through an arena are placed one after another in blocks
+	owned by the arena instead of each getting its own heap allocation.  The
+	results are ordinary LLSD: they are reference counted, copy on write,
+	and may outlive the arena.  A block is freed once the arena has moved
+	past it and every value placed in it is gone, so holding on to one
+	value keeps its whole block alive.
+
+	Only the value nodes themselves move into the arena.  What they hold is
+	allocated as before: a map is still a std::map with a heap node and its
+	own copy of the key string per entry, an array's storage and the bytes
+	of strings and binaries still come from the heap.  Keys are not interned.
+*/
+class LLSDArena
+{
+public:
+	LLSDArena();
+	~LLSDArena();
+
+	/** @name Scalar Assignment */
+	//@{
+		void assign(LLSD& sd, LLSD::Boolean v);
+		void assign(LLSD& sd, LLSD::Integer v);
+		void assign(LLSD& sd, LLSD::Real v);
+		void assign(LLSD& sd, const LLSD::String& v);
+		void assign(LLSD& sd, const LLSD::UUID& v);
+		void assign(LLSD& sd, const LLSD::Date& v);
+		void assign(LLSD& sd, const LLSD::URI& v);
+		void assign(LLSD& sd, const LLSD::Binary& v);
+	//@}
+
+	/** @name Containers */
+	//@{
+		void emptyMap(LLSD& sd);
+		void emptyArray(LLSD& sd, S32 reserve = 0);
+
+		/// Adds k to map unless it is already present, like LLSD::insert().
+		/// Keys that arrive in sorted order, as every LLSD formatter
+		/// writes them, are inserted in constant time.
+		void insert(LLSD& map, const LLSD::String& k, const LLSD& v);
+	//@}
+
+	static S32 getBlockCount();	///< arena blocks still allocated
+
+private:
+	struct Block;
+
+	void* allocate(size_t size);
+	void adopt(LLSD& sd, LLSD::Impl* impl);
+
+	static void release(LLSD::Impl* impl, U32 offset);
+
+	LLSDArena(const LLSDArena&);
+	LLSDArena& operator=(const LLSDArena&);
+
+	Block* mBlock;
+
+	friend class LLSD::Impl;
+};
+
 struct llsd_select_bool : public std::unary_function<LLSD, LLSD::Boolean>
 {
 	LLSD::Boolean operator()(const LLSD& sd) const
@@ -51,6 +51,7 @@
 
 // File constants
 static const int MAX_HDR_LEN = 20;
+static const S32 MAX_ARRAY_RESERVE = 65536;
 static const char LEGACY_NON_HEADER[] = "<llsd>";
 const std::string LLSD_BINARY_HEADER("LLSD/Binary");
 const std::string LLSD_XML_HEADER("LLSD/XML");
@@ -301,6 +302,123 @@ static const char BINARY_TRUE_SERIAL = '1';
 static const char BINARY_FALSE_SERIAL = '0';
 
 
+/**
+ * LLSDReader
+ */
+// virtual
+LLSDReader::~LLSDReader()
+{ }
+
+S32 LLSDReader::replay(const LLSD& data)
+{
+	S32 count = 1;
+	switch(data.type())
+	{
+	case LLSD::TypeMap:
+	{
+		beginMap(data.size());
+		LLSD::map_const_iterator iter = data.beginMap();
+		LLSD::map_const_iterator end = data.endMap();
+		for(; iter != end; ++iter)
+		{
+			key((*iter).first);
+			count += replay((*iter).second);
+		}
+		endMap();
+		break;
+	}
+
+	case LLSD::TypeArray:
+	{
+		beginArray(data.size());
+		LLSD::array_const_iterator iter = data.beginArray();
+		LLSD::array_const_iterator end = data.endArray();
+		for(; iter != end; ++iter)
+		{
+			count += replay(*iter);
+		}
+		endArray();
+		break;
+	}
+
+	default:
+		value(data);
+		break;
+	}
+	return count;
+}
+
+
+/**
+ * LLSDTreeReader
+ */
+LLSDTreeReader::LLSDTreeReader()
+{
+}
+
+void LLSDTreeReader::reset()
+{
+	mResult.clear();
+	mStack.clear();
+	mKey.clear();
+}
+
+LLSD& LLSDTreeReader::place()
+{
+	if(mStack.empty())
+	{
+		return mResult;
+	}
+	LLSD& container = *mStack.back();
+	if(container.isMap())
+	{
+		return container[mKey];
+	}
+	container.append(LLSD());
+	return container[container.size() - 1];
+}
+
+// virtual
+void LLSDTreeReader::beginMap(S32 size)
+{
+	LLSD& map = place();
+	map = LLSD::emptyMap();
+	mStack.push_back(&map);
+}
+
+// virtual
+void LLSDTreeReader::key(const std::string& key)
+{
+	mKey = key;
+}
+
+// virtual
+void LLSDTreeReader::endMap()
+{
+	mStack.pop_back();
+}
+
+// virtual
+void LLSDTreeReader::beginArray(S32 size)
+{
+	LLSD& array = place();
+	array = LLSD::emptyArray();
+	mStack.push_back(&array);
+}
+
+// virtual
+void LLSDTreeReader::endArray()
+{
+	mStack.pop_back();
+}
+
+// virtual
+void LLSDTreeReader::value(const LLSD& value)
+{
+	place() = value;
+}
+
+
 /**
  * LLSDParser
  */
@@ -321,6 +439,25 @@ S32 LLSDParser::parse(std::istream& istr, LLSD& data, S32 max_bytes)
 }
 
 
+S32 LLSDParser::parse(std::istream& istr, LLSDReader& reader, S32 max_bytes)
+{
+	mCheckLimits = (LLSDSerialize::SIZE_UNLIMITED == max_bytes) ? false : true;
+	mMaxBytesLeft = max_bytes;
+	return doRead(istr, reader);
+}
+
+// virtual
+S32 LLSDParser::doRead(std::istream& istr, LLSDReader& reader) const
+{
+	LLSD data;
+	S32 parse_count = doParse(istr, data);
+	if(parse_count > 0)
+	{
+		reader.replay(data);
+	}
+	return parse_count;
+}
+
 // Parse using routine to get() lines, faster than parse()
 S32 LLSDParser::parseLines(std::istream& istr, LLSD& data)
 {
@@ -930,23 +1067,39 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 		break;
 	}
 
+	default:
+		parse_count = parseScalar(c, istr, data);
+		break;
+	}
+	if(PARSE_FAILURE == parse_count)
+	{
+		data.clear();
+	}
+	return parse_count;
+}
+
+S32 LLSDBinaryParser::parseScalar(char c, std::istream& istr, LLSD& data) const
+{
+	S32 parse_count = 1;
+	switch(c)
+	{
 	case '!':
 		data.clear();
 		break;
 
 	case '0':
-		data = false;
+		mArena.assign(data, false);
 		break;
 
 	case '1':
-		data = true;
+		mArena.assign(data, true);
 		break;
 
 	case 'i':
 	{
 		U32 value_nbo = 0;
 		read(istr, (char*)&value_nbo, sizeof(U32));	 /*Flawfinder: ignore*/
-		data = (S32)ntohl(value_nbo);
+		mArena.assign(data, (S32)ntohl(value_nbo));
 		if(istr.fail())
 		{
 			llinfos << "STREAM FAILURE reading binary integer." << llendl;
@@ -958,7 +1111,7 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 	{
 		F64 real_nbo = 0.0;
 		read(istr, (char*)&real_nbo, sizeof(F64));	 /*Flawfinder: ignore*/
-		data = ll_ntohd(real_nbo);
+		mArena.assign(data, ll_ntohd(real_nbo));
 		if(istr.fail())
 		{
 			llinfos << "STREAM FAILURE reading binary real." << llendl;
@@ -970,7 +1123,7 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 	{
 		LLUUID id;
 		read(istr, (char*)(&id.mData), UUID_BYTES);	 /*Flawfinder: ignore*/
-		data = id;
+		mArena.assign(data, id);
 		if(istr.fail())
 		{
 			llinfos << "STREAM FAILURE reading binary uuid." << llendl;
@@ -989,7 +1142,7 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 		}
 		else
 		{
-			data = value;
+			mArena.assign(data, value);
 			account(cnt);
 		}
 		if(istr.fail())
@@ -1006,7 +1159,7 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 		std::string value;
 		if(parseString(istr, value))
 		{
-			data = value;
+			mArena.assign(data, value);
 		}
 		else
 		{
@@ -1025,7 +1178,7 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 		std::string value;
 		if(parseString(istr, value))
 		{
-			data = LLURI(value);
+			mArena.assign(data, LLURI(value));
 		}
 		else
 		{
@@ -1043,7 +1196,7 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 	{
 		F64 real = 0.0;
 		read(istr, (char*)&real, sizeof(F64));	 /*Flawfinder: ignore*/
-		data = LLDate(real);
+		mArena.assign(data, LLDate(real));
 		if(istr.fail())
 		{
 			llinfos << "STREAM FAILURE reading binary date." << llendl;
@@ -1071,7 +1224,7 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 				value.resize(size);
 				account(fullread(istr, (char*)&value[0], size));
 			}
-			data = value;
+			mArena.assign(data, value);
 		}
 		if(istr.fail())
 		{
@@ -1094,9 +1247,53 @@ S32 LLSDBinaryParser::doParse(std::istream& istr, LLSD& data) const
 	return parse_count;
 }
 
+// virtual
+S32 LLSDBinaryParser::doRead(std::istream& istr, LLSDReader& reader) const
+{
+	char c;
+	c = get(istr);
+	if(!istr.good())
+	{
+		return 0;
+	}
+	S32 parse_count = PARSE_FAILURE;
+	switch(c)
+	{
+	case '{':
+		parse_count = readMap(istr, reader);
+		if(istr.fail())
+		{
+			llinfos << "STREAM FAILURE reading binary map." << llendl;
+			parse_count = PARSE_FAILURE;
+		}
+		break;
+
+	case '[':
+		parse_count = readArray(istr, reader);
+		if(istr.fail())
+		{
+			llinfos << "STREAM FAILURE reading binary array." << llendl;
+			parse_count = PARSE_FAILURE;
+		}
+		break;
+
+	default:
+	{
+		LLSD data;
+		parse_count = parseScalar(c, istr, data);
+		if(parse_count > 0)
+		{
+			reader.value(data);
+		}
+		break;
+	}
+	}
+	return parse_count;
+}
+
 S32 LLSDBinaryParser::parseMap(std::istream& istr, LLSD& map) const
 {
-	map = LLSD::emptyMap();
+	mArena.emptyMap(map);
 	U32 value_nbo = 0;
 	read(istr, (char*)&value_nbo, sizeof(U32));		 /*Flawfinder: ignore*/
 	S32 size = (S32)ntohl(value_nbo);
@@ -1106,22 +1303,9 @@ S32 LLSDBinaryParser::parseMap(std::istream& istr, LLSD& map) const
 	while(c != '}' && (count < size) && istr.good())
 	{
 		std::string name;
-		switch(c)
-		{
-		case 'k':
-			if(!parseString(istr, name))
-			{
-				return PARSE_FAILURE;
-			}
-			break;
-		case '\'':
-		case '"':
+		if(!parseKey(c, istr, name))
 		{
-			int cnt = deserialize_string_delim(istr, name, c);
-			if(PARSE_FAILURE == cnt) return PARSE_FAILURE;
-			account(cnt);
-			break;
-		}
+			return PARSE_FAILURE;
 		}
 		LLSD child;
 		S32 child_count = doParse(istr, child);
@@ -1130,7 +1314,7 @@ S32 LLSDBinaryParser::parseMap(std::istream& istr, LLSD& map) const
 			// There must be a value for every key, thus child_count
 			// must be greater than 0.
 			parse_count += child_count;
-			map.insert(name, child);
+			mArena.insert(map, name, child);
 		}
 		else
 		{
@@ -1150,13 +1334,18 @@ S32 LLSDBinaryParser::parseMap(std::istream& istr, LLSD& map) const
 
 S32 LLSDBinaryParser::parseArray(std::istream& istr, LLSD& array) const
 {
-	array = LLSD::emptyArray();
 	U32 value_nbo = 0;
 	read(istr, (char*)&value_nbo, sizeof(U32));		 /*Flawfinder: ignore*/
 	S32 size = (S32)ntohl(value_nbo);
 
-	// *FIX: This would be a good place to reserve some space in the
-	// array...
+	// The size comes off the wire, so only trust it as far as the bytes
+	// left could hold one element each.
+	S32 reserve = llmin(size, MAX_ARRAY_RESERVE);
+	if(mCheckLimits)
+	{
+		reserve = llmin(reserve, mMaxBytesLeft);
+	}
+	mArena.emptyArray(array, reserve);
 
 	S32 parse_count = 0;
 	S32 count = 0;
@@ -1187,21 +1376,113 @@ S32 LLSDBinaryParser::parseArray(std::istream& istr, LLSD& array) const
 	return parse_count;
 }
 
+S32 LLSDBinaryParser::readMap(std::istream& istr, LLSDReader& reader) const
+{
+	U32 value_nbo = 0;
+	read(istr, (char*)&value_nbo, sizeof(U32));		 /*Flawfinder: ignore*/
+	S32 size = (S32)ntohl(value_nbo);
+	if(mCheckLimits && (size > mMaxBytesLeft))
+	{
+		// Every entry takes at least a byte, so this could never
+		// parse. Fail before the reader sees the bogus size.
+		return PARSE_FAILURE;
+	}
+	reader.beginMap(size);
+	S32 parse_count = 1;
+	S32 count = 0;
+	char c = get(istr);
+	while(c != '}' && (count < size) && istr.good())
+	{
+		std::string name;
+		if(!parseKey(c, istr, name))
+		{
+			return PARSE_FAILURE;
+		}
+		reader.key(name);
+		S32 child_count = doRead(istr, reader);
+		if(child_count <= 0)
+		{
+			// There must be a value for every key.
+			return PARSE_FAILURE;
+		}
+		parse_count += child_count;
+		++count;
+		c = get(istr);
+	}
+	if((c != '}') || (count < size))
+	{
+		return PARSE_FAILURE;
+	}
+	reader.endMap();
+	return parse_count;
+}
+
+S32 LLSDBinaryParser::readArray(std::istream& istr, LLSDReader& reader) const
+{
+	U32 value_nbo = 0;
+	read(istr, (char*)&value_nbo, sizeof(U32));		 /*Flawfinder: ignore*/
+	S32 size = (S32)ntohl(value_nbo);
+	if(mCheckLimits && (size > mMaxBytesLeft))
+	{
+		return PARSE_FAILURE;
+	}
+	reader.beginArray(size);
+	S32 parse_count = 1;
+	S32 count = 0;
+	char c = istr.peek();
+	while((c != ']') && (count < size) && istr.good())
+	{
+		S32 child_count = doRead(istr, reader);
+		if(PARSE_FAILURE == child_count)
+		{
+			return PARSE_FAILURE;
+		}
+		parse_count += child_count;
+		++count;
+		c = istr.peek();
+	}
+	c = get(istr);
+	if((c != ']') || (count < size))
+	{
+		return PARSE_FAILURE;
+	}
+	reader.endArray();
+	return parse_count;
+}
+
+bool LLSDBinaryParser::parseKey(
+	char c,
+	std::istream& istr,
+	std::string& key) const
+{
+	switch(c)
+	{
+	case 'k':
+		return parseString(istr, key);
+	case '\'':
+	case '"':
+	{
+		int cnt = deserialize_string_delim(istr, key, c);
+		if(PARSE_FAILURE == cnt) return false;
+		account(cnt);
+		break;
+	}
+	}
+	return true;
+}
+
 bool LLSDBinaryParser::parseString(
 	std::istream& istr,
 	std::string& value) const
 {
-	// *FIX: This is memory inefficient.
 	U32 value_nbo = 0;
 	read(istr, (char*)&value_nbo, sizeof(U32));		 /*Flawfinder: ignore*/
 	S32 size = (S32)ntohl(value_nbo);
 	if(mCheckLimits && (size > mMaxBytesLeft)) return false;
-	std::vector<char> buf;
-	if(size)
+	if(size > 0)
 	{
-		buf.resize(size);
-		account(fullread(istr, &buf[0], size));
-		value.assign(buf.begin(), buf.end());
+		value.resize(size);
+		account(fullread(istr, &value[0], size));
 	}
 	return true;
 }
@@ -39,6 +39,99 @@
 #include "llsd.h"
 #include "llmemory.h"
 
+/** 
+ * @class LLSDReader
+ * @brief Abstract base class for receiving LLSD one event at a time.
+ *
+ * Parsers can drive a reader instead of building a complete LLSD, so
+ * the consumer can handle each item as it arrives without holding the
+ * whole document. Events always nest properly: every value inside a map
+ * is preceded by its key, and every beginMap() or beginArray() is
+ * matched by an endMap() or endArray(). The exception is a parse that
+ * fails part way through, which stops the events where it failed.
+ */
+class LLSDReader
+{
+public:
+	virtual ~LLSDReader();
+
+	/** 
+	 * @brief Called at the start of a map.
+	 *
+	 * @param size The number of entries if the format says, otherwise -1.
+	 */
+	virtual void beginMap(S32 size) = 0;
+
+	/** 
+	 * @brief Called with the key of the next value in the current map.
+	 */
+	virtual void key(const std::string& key) = 0;
+
+	/** 
+	 * @brief Called at the end of a map.
+	 */
+	virtual void endMap() = 0;
+
+	/** 
+	 * @brief Called at the start of an array.
+	 *
+	 * @param size The number of elements if the format says, otherwise -1.
+	 */
+	virtual void beginArray(S32 size) = 0;
+
+	/** 
+	 * @brief Called at the end of an array.
+	 */
+	virtual void endArray() = 0;
+
+	/** 
+	 * @brief Called with every value which is not a map or an array.
+	 */
+	virtual void value(const LLSD& value) = 0;
+
+	/** 
+	 * @brief Sends the events describing an existing LLSD to this reader.
+	 *
+	 * @param data The data to walk.
+	 * @return Returns the number of LLSD objects walked.
+	 */
+	S32 replay(const LLSD& data);
+};
+
+/** 
+ * @class LLSDTreeReader
+ * @brief Reader which assembles the events back into an LLSD.
+ */
+class LLSDTreeReader : public LLSDReader
+{
+public:
+	LLSDTreeReader();
+
+	virtual void beginMap(S32 size);
+	virtual void key(const std::string& key);
+	virtual void endMap();
+	virtual void beginArray(S32 size);
+	virtual void endArray();
+	virtual void value(const LLSD& value);
+
+	/** 
+	 * @brief The last complete top level value read.
+	 */
+	const LLSD& getResult() const { return mResult; }
+
+	/** 
+	 * @brief Discards the result and any partly read value.
+	 */
+	void reset();
+
+private:
+	LLSD& place();
+
+	LLSD mResult;
+	std::vector<LLSD*> mStack;
+	std::string mKey;
+};
+
 /** 
  * @class LLSDParser
  * @brief Abstract base class for LLSD parsers.
@@ -84,6 +177,22 @@ public:
 	 */
 	S32 parse(std::istream& istr, LLSD& data, S32 max_bytes);
 
+	/** 
+	 * @brief Call this method to parse a stream one event at a time.
+	 *
+	 * This method reads one data object like parse(), but passes it
+	 * to reader as it goes instead of building an LLSD. Parsers which
+	 * cannot do this themselves build the object and then replay it.
+	 * @param istr The input stream.
+	 * @param reader The reader which receives the events.
+	 * @param max_bytes The maximum number of bytes that will be in
+	 * the stream. Pass in LLSDSerialize::SIZE_UNLIMITED (-1) to set no
+	 * byte limit.
+	 * @return Returns the number of LLSD objects read. Returns
+	 * PARSE_FAILURE (-1) on parse failure.
+	 */
+	S32 parse(std::istream& istr, LLSDReader& reader, S32 max_bytes);
+
 	/** Like parse(), but uses a different call (istream.getline()) to read by lines
 	 *  This API is better suited for XML, where the parse cannot tell
 	 *  where the document actually ends.
@@ -113,6 +222,17 @@ protected:
 	 */
 	virtual S32 doParse(std::istream& istr, LLSD& data) const = 0;
 
+	/** 
+	 * @brief Virtual default function for parsing into a reader.
+	 *
+	 * The default builds the object with doParse() and replays it.
+	 * @param istr The input stream.
+	 * @param reader The reader which receives the events.
+	 * @return Returns the number of LLSD objects read. Returns
+	 * PARSE_FAILURE (-1) on parse failure.
+	 */
+	virtual S32 doRead(std::istream& istr, LLSDReader& reader) const;
+
 	/** 
 	 * @brief Virtual default function for resetting the parser
 	 */
@@ -324,6 +444,12 @@ protected:
 	 */
 	virtual S32 doParse(std::istream& istr, LLSD& data) const;
 
+	/** 
+	 * @brief Parse the stream, sending each element to reader as
+	 * expat reports it.
+	 */
+	virtual S32 doRead(std::istream& istr, LLSDReader& reader) const;
+
 	/** 
 	 * @brief Virtual default function for resetting the parser
 	 */
@@ -372,7 +498,51 @@ protected:
 	 */
 	virtual S32 doParse(std::istream& istr, LLSD& data) const;
 
+	/** 
+	 * @brief Parse the stream, sending each value to reader as it is
+	 * read.
+	 */
+	virtual S32 doRead(std::istream& istr, LLSDReader& reader) const;
+
 private:
+	/** 
+	 * @brief Parse a value which is not a map or an array.
+	 *
+	 * @param c The type character already read from the stream.
+	 * @param istr The input stream.
+	 * @param data[out] The newly parsed value. Undefined on failure.
+	 * @return Returns 1, or PARSE_FAILURE (-1) on parse failure.
+	 */
+	S32 parseScalar(char c, std::istream& istr, LLSD& data) const;
+
+	/** 
+	 * @brief Read a map from the istream into reader.
+	 *
+	 * @param istr The input stream.
+	 * @param reader The reader which receives the events.
+	 * @return Returns The number of LLSD objects read.
+	 */
+	S32 readMap(std::istream& istr, LLSDReader& reader) const;
+
+	/** 
+	 * @brief Read an array from the istream into reader.
+	 *
+	 * @param istr The input stream.
+	 * @param reader The reader which receives the events.
+	 * @return Returns The number of LLSD objects read.
+	 */
+	S32 readArray(std::istream& istr, LLSDReader& reader) const;
+
+	/** 
+	 * @brief Read a map key from the istream.
+	 *
+	 * @param c The key type character already read from the stream.
+	 * @param istr The input stream.
+	 * @param key[out] The key.
+	 * @return Retuns true if a complete key was read.
+	 */
+	bool parseKey(char c, std::istream& istr, std::string& key) const;
+
 	/** 
 	 * @brief Parse a map from the istream
 	 *
@@ -399,6 +569,9 @@ private:
 	 * @return Retuns true if a complete string was parsed.
 	 */
 	bool parseString(std::istream& istr, std::string& value) const;
+
+	/// Places parsed values for the documents read by this parser.
+	mutable LLSDArena mArena;
 };
 
 
@@ -560,6 +733,54 @@ protected:
 	 * @return Returns The number of LLSD objects fomatted out
 	 */
 	S32 format_impl(const LLSD& data, std::ostream& ostr, U32 options, U32 level) const;
+
+	friend class LLSDXMLWriter;
+};
+
+
+/** 
+ * @class LLSDXMLWriter
+ * @brief Reader which writes the events it receives out as XML.
+ *
+ * This is the streaming counterpart of LLSDXMLFormatter, and produces
+ * the same output for the same data. Feed it from a parser to convert a
+ * document without building it, or call it directly to write a large
+ * response one item at a time. To write into an LLBufferArray, point it
+ * at an LLBufferStream. Each top level value is wrapped in its own
+ * llsd element.
+ */
+class LLSDXMLWriter : public LLSDReader
+{
+public:
+	/** 
+	 * @brief Constructor
+	 *
+	 * @param ostr The destination stream for the data.
+	 * @param options LLSDFormatter options, such as OPTIONS_PRETTY.
+	 */
+	LLSDXMLWriter(std::ostream& ostr, U32 options = LLSDFormatter::OPTIONS_NONE);
+	virtual ~LLSDXMLWriter();
+
+	virtual void beginMap(S32 size);
+	virtual void key(const std::string& key);
+	virtual void endMap();
+	virtual void beginArray(S32 size);
+	virtual void endArray();
+	virtual void value(const LLSD& value);
+
+private:
+	void beginValue();
+	void endValue();
+	void endContainer(const char* tag);
+	void flushOpenTag();
+	void indent(U32 level);
+
+	std::ostream& mOStr;
+	U32 mOptions;
+	LLPointer<LLSDXMLFormatter> mFormatter;
+	U32 mLevel;						// containers currently open
+	const char* mOpenTag;			// container tag not yet written
+	std::streamsize mOldPrecision;
 };
 
 
@@ -763,6 +984,11 @@ public:
 		return fromXMLEmbedded(sd, str);
 //		return fromXMLDocument(sd, str);
 	}
+	static S32 fromXML(LLSDReader& reader, std::istream& str)
+	{
+		LLPointer<LLSDXMLParser> p = new LLSDXMLParser;
+		return p->parse(str, reader, LLSDSerialize::SIZE_UNLIMITED);
+	}
 
 	/*
 	 * Binary Methods
@@ -784,6 +1010,11 @@ public:
 		(void)p->parse(str, sd, max_bytes);
 		return sd;
 	}
+	static S32 fromBinary(LLSDReader& reader, std::istream& str, S32 max_bytes)
+	{
+		LLPointer<LLSDBinaryParser> p = new LLSDBinaryParser;
+		return p->parse(str, reader, max_bytes);
+	}
 };
 
 #endif // LL_LLSDSERIALIZE_H
@@ -34,7 +34,7 @@
 #include "llsdserialize_xml.h"
 
 #include <iostream>
-#include <deque>
+#include <vector>
 
 #include "apr_base64.h"
 
@@ -221,6 +221,132 @@ S32 LLSDXMLFormatter::format_impl(const LLSD& data, std::ostream& ostr, U32 opti
 	return format_count;
 }
 
+/**
+ * LLSDXMLWriter
+ */
+LLSDXMLWriter::LLSDXMLWriter(std::ostream& ostr, U32 options) :
+	mOStr(ostr),
+	mOptions(options),
+	mFormatter(new LLSDXMLFormatter),
+	mLevel(0),
+	mOpenTag(NULL),
+	mOldPrecision(0)
+{
+}
+
+// virtual
+LLSDXMLWriter::~LLSDXMLWriter()
+{
+}
+
+void LLSDXMLWriter::indent(U32 level)
+{
+	if (mOptions & LLSDFormatter::OPTIONS_PRETTY)
+	{
+		for (U32 i = 0; i < level; i++)
+		{
+			mOStr << "    ";
+		}
+	}
+}
+
+void LLSDXMLWriter::flushOpenTag()
+{
+	// Containers are opened lazily so empty ones can be written as
+	// "<map />", the same as LLSDXMLFormatter does.
+	if (mOpenTag)
+	{
+		indent(mLevel);
+		mOStr << "<" << mOpenTag << ">";
+		if (mOptions & LLSDFormatter::OPTIONS_PRETTY) mOStr << "\n";
+		mOpenTag = NULL;
+	}
+}
+
+void LLSDXMLWriter::beginValue()
+{
+	if (0 == mLevel)
+	{
+		mOldPrecision = mOStr.precision(25);
+		mOStr << "<llsd>";
+		if (mOptions & LLSDFormatter::OPTIONS_PRETTY) mOStr << "\n";
+	}
+	flushOpenTag();
+}
+
+void LLSDXMLWriter::endValue()
+{
+	if (0 == mLevel)
+	{
+		mOStr << "</llsd>\n";
+		mOStr.precision(mOldPrecision);
+	}
+}
+
+void LLSDXMLWriter::endContainer(const char* tag)
+{
+	if (mOpenTag)
+	{
+		indent(mLevel);
+		mOStr << "<" << tag << " />";
+		mOpenTag = NULL;
+	}
+	else
+	{
+		indent(mLevel);
+		mOStr << "</" << tag << ">";
+	}
+	if (mOptions & LLSDFormatter::OPTIONS_PRETTY) mOStr << "\n";
+	--mLevel;
+	endValue();
+}
+
+// virtual
+void LLSDXMLWriter::beginMap(S32 size)
+{
+	beginValue();
+	++mLevel;
+	mOpenTag = "map";
+}
+
+// virtual
+void LLSDXMLWriter::key(const std::string& key)
+{
+	flushOpenTag();
+	indent(mLevel);
+	mOStr << "<key>" << LLSDXMLFormatter::escapeString(key) << "</key>";
+	if (mOptions & LLSDFormatter::OPTIONS_PRETTY) mOStr << "\n";
+}
+
+// virtual
+void LLSDXMLWriter::endMap()
+{
+	endContainer("map");
+}
+
+// virtual
+void LLSDXMLWriter::beginArray(S32 size)
+{
+	beginValue();
+	++mLevel;
+	mOpenTag = "array";
+}
+
+// virtual
+void LLSDXMLWriter::endArray()
+{
+	endContainer("array");
+}
+
+// virtual
+void LLSDXMLWriter::value(const LLSD& value)
+{
+	beginValue();
+	mFormatter->format_impl(value, mOStr, mOptions, mLevel + 1);
+	endValue();
+}
+
+
 // static
 std::string LLSDXMLFormatter::escapeString(const std::string& in)
 {
@@ -264,6 +390,7 @@ public:
 	
 	S32 parse(std::istream& input, LLSD& data);
 	S32 parseLines(std::istream& input, LLSD& data);
+	S32 read(std::istream& input, LLSDReader& reader);
 
 	void parsePart(const char *buf, int len);
 	
@@ -306,14 +433,15 @@ private:
 
 	XML_Parser	mParser;
 
-	LLSD mResult;
+	LLSDTreeReader mBuilder;		// assembles the result of parse()
+	LLSDReader* mReader;			// where element events go
 	S32 mParseCount;
 	
 	bool mInLLSDElement;			// true if we're on LLSD
 	bool mGracefullStop;			// true if we found the </llsd
 	
-	typedef std::deque<LLSD*> LLSDRefStack;
-	LLSDRefStack mStack;
+	typedef std::vector<Element> ElementStack;
+	ElementStack mStack;			// value elements currently open
 	
 	int mDepth;
 	bool mSkipping;
@@ -364,9 +492,25 @@ static unsigned get_till_eol(std::istream& input, char *buf, unsigned bufsize)
 }
 
 S32 LLSDXMLParser::Impl::parse(std::istream& input, LLSD& data)
+{
+	S32 parse_count = read(input, mBuilder);
+	if (parse_count == LLSDParser::PARSE_FAILURE)
+	{
+		data = LLSD();
+	}
+	else
+	{
+		data = mBuilder.getResult();
+	}
+	return parse_count;
+}
+
+S32 LLSDXMLParser::Impl::read(std::istream& input, LLSDReader& reader)
 {
 	XML_Status status;
 	
+	mReader = &reader;
+	
 	static const int BUFFER_SIZE = 1024;
 	void* buffer = NULL;	
 	int count = 0;
@@ -409,12 +553,12 @@ S32 LLSDXMLParser::Impl::parse(std::istream& input, LLSD& data)
 			((char*) buffer)[count ? count - 1 : 0] = '\0';
 		}
 		llinfos << "LLSDXMLParser::Impl::parse: XML_STATUS_ERROR parsing:" << (char*) buffer << llendl;
-		data = LLSD();
+		mReader = &mBuilder;
 		return LLSDParser::PARSE_FAILURE;
 	}
 
 	clear_eol(input);
-	data = mResult;
+	mReader = &mBuilder;
 	return mParseCount;
 }
 
@@ -491,14 +635,15 @@ S32 LLSDXMLParser::Impl::parseLines(std::istream& input, LLSD& data)
 	}
 
 	clear_eol(input);
-	data = mResult;
+	data = mBuilder.getResult();
 	return mParseCount;
 }
 
 
 void LLSDXMLParser::Impl::reset()
 {
-	mResult.clear();
+	mBuilder.reset();
+	mReader = &mBuilder;
 	mParseCount = 0;
 
 	mInLLSDElement = false;
@@ -610,7 +755,7 @@ void LLSDXMLParser::Impl::startElementHandler(const XML_Char* name, const XML_Ch
 			return;
 	
 		case ELEMENT_KEY:
-			if (mStack.empty()  ||  !(mStack.back()->isMap()))
+			if (mStack.empty()  ||  mStack.back() != ELEMENT_MAP)
 			{
 				return startSkipping();
 			}
@@ -633,15 +778,13 @@ void LLSDXMLParser::Impl::startElementHandler(const XML_Char* name, const XML_Ch
 	
 	if (mStack.empty())
 	{
-		mStack.push_back(&mResult);
+		// a top level value
 	}
-	else if (mStack.back()->isMap())
+	else if (mStack.back() == ELEMENT_MAP)
 	{
 		if (mCurrentKey.empty()) { return startSkipping(); }
 		
-		LLSD& map = *mStack.back();
-		LLSD& newElement = map[mCurrentKey];
-		mStack.push_back(&newElement);		
+		mReader->key(mCurrentKey);
 
 #if( LL_WINDOWS || __GNUC__ > 2)
 		mCurrentKey.clear();
@@ -649,31 +792,26 @@ void LLSDXMLParser::Impl::startElementHandler(const XML_Char* name, const XML_Ch
 		mCurrentKey = std::string();
 #endif
 	}
-	else if (mStack.back()->isArray())
+	else if (mStack.back() != ELEMENT_ARRAY)
 	{
-		LLSD& array = *mStack.back();
-		array.append(LLSD());
-		LLSD& newElement = array[array.size()-1];
-		mStack.push_back(&newElement);
-	}
-	else {
 		// improperly nested value in a non-structure
 		return startSkipping();
 	}
+	mStack.push_back(element);
 
 	++mParseCount;
 	switch (element)
 	{
 		case ELEMENT_MAP:
-			*mStack.back() = LLSD::emptyMap();
+			mReader->beginMap(-1);
 			break;
 		
 		case ELEMENT_ARRAY:
-			*mStack.back() = LLSD::emptyArray();
+			mReader->beginArray(-1);
 			break;
 			
 		default:
-			// all the other values will be set in the end element handler
+			// all the other values will be sent by the end element handler
 			;
 	}
 }
@@ -718,13 +856,20 @@ void LLSDXMLParser::Impl::endElementHandler(const XML_Char* name)
 	
 	if (!mInLLSDElement) { return; }
 
-	LLSD& value = *mStack.back();
 	mStack.pop_back();
 	
+	LLSD value;
 	switch (element)
 	{
+		case ELEMENT_MAP:
+			mReader->endMap();
+			break;
+		
+		case ELEMENT_ARRAY:
+			mReader->endArray();
+			break;
+		
 		case ELEMENT_UNDEF:
-			value.clear();
 			break;
 		
 		case ELEMENT_BOOL:
@@ -786,14 +931,14 @@ void LLSDXMLParser::Impl::endElementHandler(const XML_Char* name)
 			break;
 		}
 		
-		case ELEMENT_UNKNOWN:
-			value.clear();
-			break;
-			
 		default:
-			// other values, map and array, have already been set
+			// ELEMENT_UNKNOWN is read as undefined
 			break;
 	}
+	if (element != ELEMENT_MAP && element != ELEMENT_ARRAY)
+	{
+		mReader->value(value);
+	}
 
 	mCurrentContent.clear();
 }
@@ -930,6 +1075,12 @@ S32 LLSDXMLParser::doParse(std::istream& input, LLSD& data) const
 	return impl.parse(input, data);
 }
 
+// virtual
+S32 LLSDXMLParser::doRead(std::istream& input, LLSDReader& reader) const
+{
+	return impl.read(input, reader);
+}
+
 //	virtual 
 void LLSDXMLParser::doReset()
 {
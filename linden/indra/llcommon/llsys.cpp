@@ -43,6 +43,12 @@
 
 #include "llprocessor.h"
 
+#if LL_X86 && LL_GNUC
+#	include <cpuid.h>
+#elif LL_X86 && LL_MSVC
+#	include <intrin.h>
+#endif
+
 #if LL_WINDOWS
 #	define WIN32_LEAN_AND_MEAN
 #	include <winsock2.h>
@@ -384,6 +390,59 @@ U32 LLOSInfo::getProcessResidentSizeKB()
 	return resident_size;
 }
 
+// CProcessor predates AVX, so ask the processor directly.  AVX2 code also
+// needs the OS to save the upper halves of the registers on a context
+// switch, which it reports through XCR0.
+static bool check_avx2()
+{
+#if LL_X86 && LL_GNUC
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+	{
+		return false;
+	}
+	const unsigned int FMA = 1 << 12, OSXSAVE = 1 << 27, AVX = 1 << 28;
+	if ((ecx & (FMA | OSXSAVE | AVX)) != (FMA | OSXSAVE | AVX))
+	{
+		return false;
+	}
+	unsigned int xcr0, xcr0_high;
+	__asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0_high) : "c" (0));
+	if ((xcr0 & 6) != 6)
+	{
+		// XMM and YMM state
+		return false;
+	}
+	if (__get_cpuid_max(0, NULL) < 7)
+	{
+		return false;
+	}
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 5)) != 0;
+#elif LL_X86 && LL_MSVC && _MSC_FULL_VER >= 160040219 // VS2010 SP1 for _xgetbv
+	int info[4];
+	__cpuid(info, 1);
+	const int FMA = 1 << 12, OSXSAVE = 1 << 27, AVX = 1 << 28;
+	if ((info[2] & (FMA | OSXSAVE | AVX)) != (FMA | OSXSAVE | AVX))
+	{
+		return false;
+	}
+	if ((_xgetbv(0) & 6) != 6)
+	{
+		return false;
+	}
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
 LLCPUInfo::LLCPUInfo()
 {
 	std::ostringstream out;
@@ -393,10 +452,32 @@ LLCPUInfo::LLCPUInfo()
 	mHasSSE = info->_Ext.SSE_StreamingSIMD_Extensions;
 	mHasSSE2 = info->_Ext.SSE2_StreamingSIMD2_Extensions;
 	mHasAltivec = info->_Ext.Altivec_Extensions;
+	mHasAVX2 = check_avx2();
 	mCPUMhz = (S32)(proc.GetCPUFrequency(50)/1000000.0);
 	mFamily.assign( info->strFamily );
 	mCPUString = "Unknown";
 
+	mNumCores = 1;
+#if LL_WINDOWS
+	SYSTEM_INFO sys_info;
+	GetSystemInfo(&sys_info);
+	mNumCores = (S32)sys_info.dwNumberOfProcessors;
+#elif LL_DARWIN
+	int ncpu = 0;
+	size_t len = sizeof(ncpu);
+	if (sysctlbyname("hw.ncpu", &ncpu, &len, NULL, 0) == 0)
+	{
+		mNumCores = ncpu;
+	}
+#else
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu > 0)
+	{
+		mNumCores = (S32)ncpu;
+	}
+#endif
+	mNumCores = llmax(mNumCores, 1);
+
 #if LL_WINDOWS || LL_DARWIN || LL_SOLARIS
 	out << proc.strCPUName;
 	if (200 < mCPUMhz && mCPUMhz < 10000)           // *NOTE: cpu speed is often way wrong, do a sanity check
@@ -469,11 +550,21 @@ bool LLCPUInfo::hasSSE2() const
 	return mHasSSE2;
 }
 
+bool LLCPUInfo::hasAVX2() const
+{
+	return mHasAVX2;
+}
+
 S32 LLCPUInfo::getMhz() const
 {
 	return mCPUMhz;
 }
 
+S32 LLCPUInfo::getNumCores() const
+{
+	return mNumCores;
+}
+
 std::string LLCPUInfo::getCPUString() const
 {
 	return mCPUString;
@@ -517,7 +608,9 @@ void LLCPUInfo::stream(std::ostream& s) const
 	// CPU's attributes regardless of platform
 	s << "->mHasSSE:     " << (U32)mHasSSE << std::endl;
 	s << "->mHasSSE2:    " << (U32)mHasSSE2 << std::endl;
+	s << "->mHasAVX2:    " << (U32)mHasAVX2 << std::endl;
 	s << "->mHasAltivec: " << (U32)mHasAltivec << std::endl;
+	s << "->mNumCores:   " << mNumCores << std::endl;
 	s << "->mCPUMhz:     " << mCPUMhz << std::endl;
 	s << "->mCPUString:  " << mCPUString << std::endl;
 }
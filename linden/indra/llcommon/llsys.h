@@ -81,7 +81,9 @@ public:
 	bool hasAltivec() const;
 	bool hasSSE() const;
 	bool hasSSE2() const;
+	bool hasAVX2() const; // AVX2 and FMA, with the OS saving the AVX registers
 	S32	 getMhz() const;
+	S32	 getNumCores() const; // logical processors available to the process
 
 	// Family is "AMD Duron" or "Intel Pentium Pro"
 	const std::string& getFamily() const { return mFamily; }
@@ -89,8 +91,10 @@ public:
 private:
 	bool mHasSSE;
 	bool mHasSSE2;
+	bool mHasAVX2;
 	bool mHasAltivec;
 	S32 mCPUMhz;
+	S32 mNumCores;
 	std::string mFamily;
 	std::string mCPUString;
 };
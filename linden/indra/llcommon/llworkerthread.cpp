@@ -40,7 +40,7 @@
 //============================================================================
 // Run on MAIN thread
 
-LLWorkerThread::LLWorkerThread(const std::string& name, bool threaded) :
+LLWorkerThread::LLWorkerThread(const std::string& name, bool threaded, S32 num_threads) :
 	LLQueuedThread(name, threaded)
 {
 	mDeleteMutex = new LLMutex(NULL);
@@ -49,10 +49,25 @@ LLWorkerThread::LLWorkerThread(const std::string& name, bool threaded) :
 	{
 		mLocalAPRFilePoolp = new LLVolatileAPRPool() ;
 	}
+
+	if (mThreaded && num_threads > 1)
+	{
+		for (S32 i = 1; i < num_threads; ++i)
+		{
+			PoolThread* thread = new PoolThread(llformat("%s %d", name.c_str(), i), this);
+			mPoolThreads.push_back(thread);
+			thread->start();
+		}
+		llinfos << "Worker Thread: " << mName << " running on " << num_threads << " threads" << llendl;
+	}
 }
 
 LLWorkerThread::~LLWorkerThread()
 {
+	// ~LLQueuedThread() only runs its own shutdown(), and the pool threads
+	// must be gone before it deletes the remaining requests.
+	stopPoolThreads();
+
 	// Delete any workers in the delete queue (should be safe - had better be!)
 	if (!mDeleteList.empty())
 	{
@@ -65,10 +80,76 @@ LLWorkerThread::~LLWorkerThread()
 	// ~LLQueuedThread() will be called here
 }
 
+// virtual
+void LLWorkerThread::shutdown()
+{
+	stopPoolThreads();
+	LLQueuedThread::shutdown();
+}
+
+void LLWorkerThread::stopPoolThreads()
+{
+	for (pool_thread_list_t::iterator iter = mPoolThreads.begin();
+		 iter != mPoolThreads.end(); ++iter)
+	{
+		// ~LLThread() only waits for a thread it has seen running
+		PoolThread* thread = *iter;
+		for (S32 timeout = 1000; timeout > 0 && !thread->getThreadID(); --timeout)
+		{
+			ms_sleep(1);
+		}
+		// asks the thread to quit and waits for it
+		delete thread;
+	}
+	mPoolThreads.clear();
+}
+
+void LLWorkerThread::wakePoolThreads()
+{
+	for (pool_thread_list_t::iterator iter = mPoolThreads.begin();
+		 iter != mPoolThreads.end(); ++iter)
+	{
+		(*iter)->wake();
+	}
+}
+
+// virtual
+void LLWorkerThread::incQueue()
+{
+	LLQueuedThread::incQueue();
+	if (!isPaused())
+	{
+		wakePoolThreads();
+	}
+}
+
+void LLWorkerThread::checkWorkerPause()
+{
+	if (!mPoolThreads.empty())
+	{
+		U32 id = LLThread::currentID();
+		for (pool_thread_list_t::iterator iter = mPoolThreads.begin();
+			 iter != mPoolThreads.end(); ++iter)
+		{
+			if ((*iter)->getThreadID() == id)
+			{
+				(*iter)->checkPause();
+				return;
+			}
+		}
+	}
+	checkPause();
+}
+
 // virtual
 S32 LLWorkerThread::update(U32 max_time_ms)
 {
 	S32 res = LLQueuedThread::update(max_time_ms);
+	if (res > 0)
+	{
+		// update() unpauses the queue; the pool threads follow it
+		wakePoolThreads();
+	}
 	// Delete scheduled workers
 	std::vector<LLWorkerClass*> delete_list;
 	std::vector<LLWorkerClass*> abort_list;
@@ -145,6 +226,48 @@ void LLWorkerThread::deleteWorker(LLWorkerClass* workerclass)
 //============================================================================
 // Runs on its OWN thread
 
+LLWorkerThread::PoolThread::PoolThread(const std::string& name, LLWorkerThread* owner) :
+	LLThread(name),
+	mOwner(owner),
+	mThreadID(0),
+	mBusy(FALSE)
+{
+}
+
+// virtual
+bool LLWorkerThread::PoolThread::runCondition()
+{
+	// mRunCondition must be locked here
+	if (mBusy)
+	{
+		// yielding from doWork(); sleeping here could stall the request
+		// until something else is queued
+		return true;
+	}
+	return !mOwner->isPaused() && mOwner->getPending() > 0;
+}
+
+// virtual
+void LLWorkerThread::PoolThread::run()
+{
+	mThreadID = LLThread::currentID();
+	while (1)
+	{
+		checkPause();
+
+		if (isQuitting() || mOwner->isQuitting())
+			break;
+
+		mBusy = TRUE;
+		mOwner->processNextRequest();
+		mBusy = FALSE;
+	}
+
+	llinfos << "WORKER POOL THREAD " << mName << " EXITING." << llendl;
+}
+
+//----------------------------------------------------------------------------
+
 LLWorkerThread::WorkRequest::WorkRequest(handle_t handle, U32 priority, LLWorkerClass* workerclass, S32 param) :
 	LLQueuedThread::QueuedRequest(handle, priority),
 	mWorkerClass(workerclass),
@@ -264,7 +387,7 @@ void LLWorkerClass::setWorking(bool working)
 bool LLWorkerClass::yield()
 {
 	LLThread::yield();
-	mWorkerThread->checkPause();
+	mWorkerThread->checkWorkerPause();
 	bool res;
 	mMutex.lock();
 	res = (getFlags() & WCF_ABORT_REQUESTED) ? true : false;
@@ -376,5 +499,16 @@ void LLWorkerClass::setPriority(U32 priority)
 	mMutex.unlock();
 }
 
+void LLWorkerClass::setPriority(U32 priority, LLQueuedThread::RequestBatch& batch)
+{
+	mMutex.lock();
+	if (mRequestHandle != LLWorkerThread::nullHandle())
+	{
+		mRequestPriority = priority;
+		batch.setPriority(mRequestHandle, priority);
+	}
+	mMutex.unlock();
+}
+
 //============================================================================
 
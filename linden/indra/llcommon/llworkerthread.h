@@ -80,20 +80,60 @@ public:
 	};
 
 private:
+	// Additional threads pulling requests from the same queue.  Whichever
+	// thread goes idle first takes the next highest priority request, so
+	// requests are still started in priority order.
+	class PoolThread : public LLThread
+	{
+	public:
+		PoolThread(const std::string& name, LLWorkerThread* owner);
+
+		U32 getThreadID() const { return mThreadID; }
+
+	protected:
+		/*virtual*/ bool runCondition(void);
+		/*virtual*/ void run(void);
+
+	private:
+		LLWorkerThread* mOwner;
+		volatile U32 mThreadID;
+		LLAtomic32<BOOL> mBusy; // holds a request, so must not sleep in checkWorkerPause()
+	};
+
 	typedef std::list<LLWorkerClass*> delete_list_t;
 	delete_list_t mDeleteList;
 	LLMutex* mDeleteMutex;
+
+	typedef std::vector<PoolThread*> pool_thread_list_t;
+	pool_thread_list_t mPoolThreads;
 	
 public:
-	LLWorkerThread(const std::string& name, bool threaded = true);
+	// num_threads > 1 runs requests on that many threads.  Only do this
+	// when doWork() does not use per-thread state such as
+	// getLocalAPRFilePool(); a worker's requests may run on any of them
+	// (never more than one at a time).
+	LLWorkerThread(const std::string& name, bool threaded = true, S32 num_threads = 1);
 	~LLWorkerThread();
 
+	/*virtual*/ void shutdown();
 	/*virtual*/ S32 update(U32 max_time_ms);
 	
 	handle_t addWorkRequest(LLWorkerClass* workerclass, S32 param, U32 priority = PRIORITY_NORMAL);
 	
 	void deleteWorker(LLWorkerClass* workerclass); // schedule for deletion
 	S32 getNumDeletes() { return (S32)mDeleteList.size(); } // debug
+
+	S32 getNumThreads() const { return mThreaded ? (S32)mPoolThreads.size() + 1 : 0; }
+
+	// Called from doWork() (any of the pool's threads)
+	void checkWorkerPause();
+
+protected:
+	/*virtual*/ void incQueue();
+
+private:
+	void stopPoolThreads();
+	void wakePoolThreads();
 };
 
 //============================================================================
@@ -150,6 +190,8 @@ public:
 
 	// setPriority(): changes the priority of a request
 	void setPriority(U32 priority);
+	// Same, but records the change in batch for the caller to submit
+	void setPriority(U32 priority, LLQueuedThread::RequestBatch& batch);
 	U32  getPriority() { return mRequestPriority; }
 		
 	const std::string& getName() const { return mWorkerClassName; }
@@ -160,7 +202,7 @@ protected:
 	
 	// Call from doWork only to avoid eating up cpu time.
 	// Returns true if work has been aborted
-	// yields the current thread and calls mWorkerThread->checkPause()
+	// yields the current thread and calls mWorkerThread->checkWorkerPause()
 	bool yield();
 	
 	void setWorkerThread(LLWorkerThread* workerthread);
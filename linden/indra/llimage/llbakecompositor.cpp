@@ -0,0 +1,536 @@
+/** 
+ * @file llbakecompositor.cpp
+ * @brief Tracks changed regions of avatar bake layers and composites them on the CPU.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llbakecompositor.h"
+
+#include <algorithm>
+
+#include "llmath.h"
+
+// Product of two 0..255 values, as 0..255, rounded.
+inline U8 mul_u8(U32 a, U32 b)
+{
+	U32 t = a * b + 128;
+	return (U8)((t + (t >> 8)) >> 8);
+}
+
+//----------------------------------------------------------------------------
+// LLBakeDirtyTracker
+//----------------------------------------------------------------------------
+
+LLBakeDirtyTracker::LLBakeDirtyTracker()
+:	mWidth(0),
+	mHeight(0),
+	mHasComposite(FALSE)
+{
+}
+
+void LLBakeDirtyTracker::reset(S32 width, S32 height, S32 layer_count)
+{
+	mWidth = width;
+	mHeight = height;
+	mDirtyRects.assign(layer_count, getImageRect());
+	mCached.assign(layer_count, FALSE);
+	mHasComposite = FALSE;
+}
+
+void LLBakeDirtyTracker::invalidateLayer(S32 layer)
+{
+	invalidateLayer(layer, LLRectf(0.f, 1.f, 1.f, 0.f));
+}
+
+void LLBakeDirtyTracker::invalidateLayer(S32 layer, const LLRectf& region)
+{
+	if (layer < 0 || layer >= getLayerCount())
+	{
+		return;
+	}
+	if (region.isNull())
+	{
+		return;
+	}
+
+	LLRect rect(llfloor(region.mLeft * mWidth) - 1,
+				llceil(region.mTop * mHeight) + 1,
+				llceil(region.mRight * mWidth) + 1,
+				llfloor(region.mBottom * mHeight) - 1);
+	rect.intersectWith(getImageRect());
+	if (rect.isNull())
+	{
+		return;
+	}
+
+	LLRect& dirty = mDirtyRects[layer];
+	if (dirty.isNull())
+	{
+		dirty = rect;
+	}
+	else
+	{
+		dirty.unionWith(rect);
+	}
+}
+
+void LLBakeDirtyTracker::invalidateAll()
+{
+	mDirtyRects.assign(mDirtyRects.size(), getImageRect());
+}
+
+void LLBakeDirtyTracker::setCached(S32 layer, BOOL cached)
+{
+	if (layer >= 0 && layer < getLayerCount())
+	{
+		mCached[layer] = cached;
+	}
+}
+
+BOOL LLBakeDirtyTracker::isCached(S32 layer) const
+{
+	return layer >= 0 && layer < getLayerCount() && mCached[layer];
+}
+
+void LLBakeDirtyTracker::clearCached()
+{
+	mCached.assign(mCached.size(), FALSE);
+}
+
+BOOL LLBakeDirtyTracker::isDirty() const
+{
+	if (!mHasComposite)
+	{
+		return TRUE;
+	}
+	for (S32 i = 0; i < getLayerCount(); ++i)
+	{
+		if (mDirtyRects[i].notNull())
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+BOOL LLBakeDirtyTracker::isLayerDirty(S32 layer) const
+{
+	return layer >= 0 && layer < getLayerCount() && mDirtyRects[layer].notNull();
+}
+
+BOOL LLBakeDirtyTracker::getUpdate(S32& first_layer, LLRect& rect) const
+{
+	if (!mHasComposite)
+	{
+		return FALSE;
+	}
+
+	S32 first_dirty = -1;
+	rect = LLRect();
+	for (S32 i = 0; i < getLayerCount(); ++i)
+	{
+		const LLRect& dirty = mDirtyRects[i];
+		if (dirty.isNull())
+		{
+			continue;
+		}
+		if (first_dirty < 0)
+		{
+			first_dirty = i;
+			rect = dirty;
+		}
+		else
+		{
+			rect.unionWith(dirty);
+		}
+	}
+
+	if (first_dirty < 0)
+	{
+		first_layer = getLayerCount();
+		return TRUE;
+	}
+
+	// Start from the nearest copy below the first change.  Layers in
+	// between haven't changed, but have to be redrawn over the region.
+	S32 start = first_dirty - 1;
+	while (start >= 0 && !mCached[start])
+	{
+		--start;
+	}
+	if (start < 0)
+	{
+		return FALSE;
+	}
+	first_layer = start + 1;
+	return TRUE;
+}
+
+void LLBakeDirtyTracker::clearDirty()
+{
+	mDirtyRects.assign(mDirtyRects.size(), LLRect());
+	mHasComposite = TRUE;
+}
+
+//static
+LLRectf LLBakeDirtyTracker::calcMaskRegion(const LLImageRaw* mask)
+{
+	const S32 width = mask->getWidth();
+	const S32 height = mask->getHeight();
+	const S32 components = mask->getComponents();
+	const U8* data = mask->getData();
+	if (!data || width <= 0 || height <= 0)
+	{
+		return LLRectf();
+	}
+
+	S32 left = width;
+	S32 right = -1;
+	S32 bottom = height;
+	S32 top = -1;
+	for (S32 y = 0; y < height; ++y)
+	{
+		const U8* row = data + y * width * components + components - 1;
+		S32 x = 0;
+		while (x < width && !row[x * components])
+		{
+			++x;
+		}
+		if (x == width)
+		{
+			continue;
+		}
+		left = llmin(left, x);
+		bottom = llmin(bottom, y);
+		top = y;
+		x = width - 1;
+		while (!row[x * components])
+		{
+			--x;
+		}
+		right = llmax(right, x);
+	}
+	if (right < 0)
+	{
+		return LLRectf();
+	}
+
+	return LLRectf((F32)left / width, (F32)(top + 1) / height,
+				   (F32)(right + 1) / width, (F32)bottom / height);
+}
+
+//----------------------------------------------------------------------------
+// LLBakeCompositor
+//----------------------------------------------------------------------------
+
+LLBakeCompositor::Mask::Mask()
+:	mValue(0),
+	mMultiply(FALSE)
+{
+}
+
+LLBakeCompositor::Layer::Layer()
+:	mColor(255, 255, 255, 255),
+	mColorSpecified(FALSE),
+	mImageAlphaOnly(FALSE),
+	mWriteAllChannels(FALSE)
+{
+}
+
+LLBakeCompositor::LLBakeCompositor(S32 width, S32 height)
+:	mWidth(width),
+	mHeight(height),
+	mCaching(FALSE),
+	mClearAlpha(FALSE),
+	mLastLayerCount(0),
+	mLastPixelCount(0)
+{
+	mComposite = new LLImageRaw(width, height, 4);
+	mTracker.reset(width, height, 0);
+}
+
+S32 LLBakeCompositor::addLayer(const Layer& layer)
+{
+	mLayers.push_back(layer);
+	mCachedComposites.push_back(NULL);
+	mTracker.reset(mWidth, mHeight, getLayerCount());
+	return getLayerCount() - 1;
+}
+
+void LLBakeCompositor::setLayer(S32 index, const Layer& layer)
+{
+	mLayers[index] = layer;
+	mTracker.invalidateLayer(index);
+}
+
+void LLBakeCompositor::setLayer(S32 index, const Layer& layer, const LLRectf& region)
+{
+	mLayers[index] = layer;
+	mTracker.invalidateLayer(index, region);
+}
+
+void LLBakeCompositor::setCaching(BOOL caching)
+{
+	mCaching = caching;
+	if (!caching)
+	{
+		std::fill(mCachedComposites.begin(), mCachedComposites.end(), LLPointer<LLImageRaw>());
+		mTracker.clearCached();
+	}
+}
+
+const LLImageRaw* LLBakeCompositor::update()
+{
+	mLastLayerCount = 0;
+	mLastPixelCount = 0;
+
+	S32 first_layer = 0;
+	LLRect rect;
+	BOOL incremental = mCaching && mTracker.getUpdate(first_layer, rect);
+	if (!incremental)
+	{
+		first_layer = 0;
+		rect = mTracker.getImageRect();
+		memset(mComposite->getData(), 0, mComposite->getDataSize());
+	}
+	if (rect.isNull())
+	{
+		mTracker.clearDirty();
+		return mComposite;
+	}
+
+	U8* data = mComposite->getData();
+	if (first_layer > 0)
+	{
+		copyRect(mCachedComposites[first_layer - 1]->getData(), data, rect);
+	}
+
+	for (S32 i = first_layer; i < getLayerCount(); ++i)
+	{
+		renderLayer(mLayers[i], data, rect);
+		++mLastLayerCount;
+
+		if (!mCaching)
+		{
+			continue;
+		}
+		if (!incremental)
+		{
+			if (mCachedComposites[i].isNull())
+			{
+				mCachedComposites[i] = new LLImageRaw(mWidth, mHeight, 4);
+			}
+			memcpy(mCachedComposites[i]->getData(), data, mComposite->getDataSize());	/* Flawfinder: ignore */
+			mTracker.setCached(i, TRUE);
+		}
+		else if (mTracker.isCached(i))
+		{
+			copyRect(data, mCachedComposites[i]->getData(), rect);
+		}
+	}
+	mLastPixelCount = mLastLayerCount * rect.getWidth() * rect.getHeight();
+
+	if (mClearAlpha)
+	{
+		clearAlpha(data, rect);
+	}
+
+	mTracker.clearDirty();
+	return mComposite;
+}
+
+void LLBakeCompositor::compositeAll(LLImageRaw* image) const
+{
+	image->resize(mWidth, mHeight, 4);
+	memset(image->getData(), 0, image->getDataSize());
+
+	LLRect rect(0, mHeight, mWidth, 0);
+	for (layer_list_t::const_iterator iter = mLayers.begin(); iter != mLayers.end(); ++iter)
+	{
+		renderLayer(*iter, image->getData(), rect);
+	}
+	if (mClearAlpha)
+	{
+		clearAlpha(image->getData(), rect);
+	}
+}
+
+//static
+LLRectf LLBakeCompositor::calcLayerRegion(const Layer& layer)
+{
+	const LLRectf everywhere(0.f, 1.f, 1.f, 0.f);
+	if (layer.mMasks.empty() || layer.mMasks.front().mMultiply)
+	{
+		return everywhere;
+	}
+
+	LLRectf region;
+	for (std::vector<Mask>::const_iterator iter = layer.mMasks.begin(); iter != layer.mMasks.end(); ++iter)
+	{
+		if (iter->mMultiply)
+		{
+			continue;
+		}
+		if (iter->mImage.isNull())
+		{
+			if (iter->mValue)
+			{
+				return everywhere;
+			}
+			continue;
+		}
+		LLRectf mask_region = LLBakeDirtyTracker::calcMaskRegion(iter->mImage);
+		if (mask_region.isNull())
+		{
+			continue;
+		}
+		if (region.isNull())
+		{
+			region = mask_region;
+		}
+		else
+		{
+			region.unionWith(mask_region);
+		}
+	}
+	return region;
+}
+
+void LLBakeCompositor::renderLayer(const Layer& layer, U8* data, const LLRect& rect) const
+{
+	// If you can't see the layer, don't render it.
+	if (!layer.mColor.mV[VW])
+	{
+		return;
+	}
+
+	const BOOL masked = !layer.mMasks.empty();
+	const U8* image = layer.mImage.notNull() ? layer.mImage->getData() : NULL;
+	const S32 image_components = image ? layer.mImage->getComponents() : 0;
+	const BOOL draw_image = image && !layer.mImageAlphaOnly;
+	const BOOL draw_color = (!image || layer.mImageAlphaOnly) && layer.mColorSpecified;
+	const U8* color = layer.mColor.mV;
+
+	for (S32 y = rect.mBottom; y < rect.mTop; ++y)
+	{
+		for (S32 x = rect.mLeft; x < rect.mRight; ++x)
+		{
+			const S32 offset = y * mWidth + x;
+			U8* dst = data + offset * 4;
+			const U8* texel = image ? image + offset * image_components : NULL;
+
+			if (masked)
+			{
+				// As LLTexLayer::renderAlphaMasks(): accumulate the masks
+				// in the destination alpha...
+				U32 alpha = layer.mMasks.front().mMultiply ? dst[3] : 0;
+				for (std::vector<Mask>::const_iterator iter = layer.mMasks.begin();
+					 iter != layer.mMasks.end(); ++iter)
+				{
+					U32 value = iter->mImage.notNull() ? iter->mImage->getData()[offset] : iter->mValue;
+					alpha = iter->mMultiply ? mul_u8(alpha, value) : llmin(alpha + value, (U32)255);
+				}
+				// ...then multiply by the texture's and the color's alpha
+				if (image_components == 4)
+				{
+					alpha = mul_u8(alpha, texel[3]);
+				}
+				if (color[VW] != 255)
+				{
+					alpha = mul_u8(alpha, color[VW]);
+				}
+				dst[3] = (U8)alpha;
+			}
+
+			if (!draw_image && !draw_color)
+			{
+				continue;
+			}
+
+			U8 src[4];
+			if (draw_image)
+			{
+				// Textures are modulated by the net color
+				src[0] = mul_u8(texel[0], color[VX]);
+				src[1] = mul_u8(texel[1], color[VY]);
+				src[2] = mul_u8(texel[2], color[VZ]);
+				src[3] = mul_u8(image_components == 4 ? texel[3] : 255, color[VW]);
+			}
+			else
+			{
+				src[0] = color[VX];
+				src[1] = color[VY];
+				src[2] = color[VZ];
+				src[3] = color[VW];
+			}
+
+			if (layer.mWriteAllChannels)
+			{
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+				dst[3] = src[3];
+				continue;
+			}
+
+			// Blend by the destination alpha if masked, else by the source's
+			const U32 factor = masked ? dst[3] : src[3];
+			const U32 inverse = 255 - factor;
+			for (S32 c = 0; c < 4; ++c)
+			{
+				dst[c] = (U8)llmin((U32)mul_u8(src[c], factor) + mul_u8(dst[c], inverse), (U32)255);
+			}
+		}
+	}
+}
+
+void LLBakeCompositor::clearAlpha(U8* data, const LLRect& rect) const
+{
+	for (S32 y = rect.mBottom; y < rect.mTop; ++y)
+	{
+		U8* dst = data + (y * mWidth + rect.mLeft) * 4 + 3;
+		for (S32 x = rect.mLeft; x < rect.mRight; ++x, dst += 4)
+		{
+			*dst = 255;
+		}
+	}
+}
+
+void LLBakeCompositor::copyRect(const U8* src, U8* dst, const LLRect& rect) const
+{
+	const S32 offset = rect.mLeft * 4;
+	const S32 length = rect.getWidth() * 4;
+	for (S32 y = rect.mBottom; y < rect.mTop; ++y)
+	{
+		const S32 row = y * mWidth * 4 + offset;
+		memcpy(dst + row, src + row, length);		/* Flawfinder: ignore */
+	}
+}
@@ -0,0 +1,198 @@
+/** 
+ * @file llbakecompositor.h
+ * @brief Tracks changed regions of avatar bake layers and composites them on the CPU.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLBAKECOMPOSITOR_H
+#define LL_LLBAKECOMPOSITOR_H
+
+#include <vector>
+
+#include "llimage.h"
+#include "llrect.h"
+#include "v4coloru.h"
+
+//============================================================================
+// An avatar bake is an ordered stack of layers blended into one image, so
+// the image after layer N depends only on layers 0..N.  When one layer
+// changes, everything below it still holds, and the blend is per pixel, so
+// the change can only show where that layer changed.  Given a copy of the
+// composite as it stood after each layer, a change can be recomposited from
+// the last layer below it, over just the changed region.
+//
+// LLBakeDirtyTracker does the bookkeeping for that: which layers changed
+// and where, which per-layer copies are held, and where the next update
+// has to start.  The viewer's GL compositor (LLTexLayerSet) and the CPU
+// compositor below both use it.
+
+class LLBakeDirtyTracker
+{
+public:
+	LLBakeDirtyTracker();
+
+	// For a composite of the given size.  Everything starts out dirty, with
+	// no composite and no per-layer copies.
+	void reset(S32 width, S32 height, S32 layer_count);
+
+	S32 getWidth() const				{ return mWidth; }
+	S32 getHeight() const				{ return mHeight; }
+	S32 getLayerCount() const			{ return (S32)mDirtyRects.size(); }
+	LLRect getImageRect() const			{ return LLRect(0, mHeight, mWidth, 0); }
+
+	// Marks a layer changed everywhere, or only within a region given in
+	// unit coordinates (0..1 across, 0..1 up).  Regions are rounded out to
+	// whole pixels plus one, for filtering.
+	void invalidateLayer(S32 layer);
+	void invalidateLayer(S32 layer, const LLRectf& region);
+	void invalidateAll();
+
+	// Whether the composite as it stood after this layer is held.
+	void setCached(S32 layer, BOOL cached);
+	BOOL isCached(S32 layer) const;
+	void clearCached();
+
+	BOOL isDirty() const;
+	BOOL isLayerDirty(S32 layer) const;
+
+	// Where the next update starts and what it has to redraw: restore the
+	// copy held for first_layer - 1 within rect, then composite layers from
+	// first_layer on within rect.  rect is empty and first_layer is the
+	// layer count if nothing changed.  Returns FALSE if the whole composite
+	// has to be redone from the first layer.
+	BOOL getUpdate(S32& first_layer, LLRect& rect) const;
+
+	// The composite is up to date.
+	void clearDirty();
+
+	// The region of a one component mask that isn't zero, in unit
+	// coordinates.  Empty if the mask is zero everywhere.
+	static LLRectf calcMaskRegion(const LLImageRaw* mask);
+
+private:
+	S32 mWidth;
+	S32 mHeight;
+	std::vector<LLRect> mDirtyRects;	// empty if clean
+	std::vector<BOOL> mCached;
+	BOOL mHasComposite;
+};
+
+//============================================================================
+// Composites bake layers on the CPU, with the same blending the viewer does
+// in GL (see LLTexLayer::render()), and recomposites only what changed when
+// caching is on.  Used as a reference for headless testing and for
+// measuring how long an edit takes to reach the bake.
+
+class LLBakeCompositor
+{
+public:
+	// An alpha param: a one component image the size of the composite, or
+	// a constant if there is no image.  The first mask clears the layer's
+	// alpha unless it multiplies; after that, masks add or multiply.
+	struct Mask
+	{
+		Mask();
+
+		LLPointer<LLImageRaw> mImage;
+		U8 mValue;
+		BOOL mMultiply;
+	};
+
+	struct Layer
+	{
+		Layer();
+
+		LLColor4U mColor;				// net color
+		BOOL mColorSpecified;			// draw mColor where there is no image
+		LLPointer<LLImageRaw> mImage;	// 3 or 4 components, the size of the composite
+		BOOL mImageAlphaOnly;			// only mask with the image's alpha
+		BOOL mWriteAllChannels;			// replace instead of blending
+		std::vector<Mask> mMasks;
+	};
+	typedef std::vector<Layer> layer_list_t;
+
+	LLBakeCompositor(S32 width, S32 height);
+
+	S32 getWidth() const				{ return mWidth; }
+	S32 getHeight() const				{ return mHeight; }
+
+	S32 addLayer(const Layer& layer);
+	S32 getLayerCount() const			{ return (S32)mLayers.size(); }
+	const Layer& getLayer(S32 index) const	{ return mLayers[index]; }
+
+	// Replaces a layer and marks it changed, everywhere or within a region
+	// in unit coordinates.
+	void setLayer(S32 index, const Layer& layer);
+	void setLayer(S32 index, const Layer& layer, const LLRectf& region);
+
+	// Set alpha to opaque once all layers are down, as LLTexLayerSet does
+	// for layer sets without a static alpha.
+	void setClearAlpha(BOOL clear)		{ mClearAlpha = clear; mTracker.invalidateAll(); }
+
+	// Keep a copy of the composite after each layer, so that updates only
+	// recomposite what changed.
+	void setCaching(BOOL caching);
+	BOOL getCaching() const				{ return mCaching; }
+
+	// Brings the composite up to date and returns it.
+	const LLImageRaw* update();
+	const LLImageRaw* getComposite() const	{ return mComposite; }
+
+	// Composites every layer from scratch, without touching the caches.
+	void compositeAll(LLImageRaw* image) const;
+
+	// Work done by the last update().
+	S32 getLastLayerCount() const		{ return mLastLayerCount; }
+	S32 getLastPixelCount() const		{ return mLastPixelCount; }
+
+	// Where a layer can show at all, in unit coordinates: everywhere,
+	// unless its first mask clears alpha, in which case only where its
+	// added masks aren't zero.  Changing only a layer's color changes the
+	// composite only here.
+	static LLRectf calcLayerRegion(const Layer& layer);
+
+private:
+	void renderLayer(const Layer& layer, U8* data, const LLRect& rect) const;
+	void clearAlpha(U8* data, const LLRect& rect) const;
+	void copyRect(const U8* src, U8* dst, const LLRect& rect) const;
+
+private:
+	S32 mWidth;
+	S32 mHeight;
+	layer_list_t mLayers;
+	std::vector<LLPointer<LLImageRaw> > mCachedComposites;
+	LLPointer<LLImageRaw> mComposite;
+	LLBakeDirtyTracker mTracker;
+	BOOL mCaching;
+	BOOL mClearAlpha;
+	S32 mLastLayerCount;
+	S32 mLastPixelCount;
+};
+
+#endif // LL_LLBAKECOMPOSITOR_H
@@ -34,6 +34,7 @@
 
 #include "llimage.h"
 
+#include "llimagebufferpool.h"
 #include "llmath.h"
 #include "v4coloru.h"
 #include "llmemtype.h"
@@ -58,6 +59,7 @@ LLMutex* LLImage::sMutex = NULL;
 void LLImage::initClass(LLWorkerThread* workerthread)
 {
 	sMutex = new LLMutex(NULL);
+	LLImageBufferPool::initClass();
 	if (workerthread)
 	{
 		LLImageWorker::initImageWorker(workerthread);
@@ -70,6 +72,7 @@ void LLImage::cleanupClass()
 {
 	LLImageJ2C::closeDSO();
 	LLImageWorker::cleanupImageWorker();
+	LLImageBufferPool::cleanupClass();
 	delete sMutex;
 	sMutex = NULL;
 }
@@ -144,7 +147,7 @@ BOOL LLImageBase::sSizeOverride = FALSE;
 // virtual
 void LLImageBase::deleteData()
 {
-	delete[] mData;
+	LLImageBufferPool::free(mData, mDataSize);
 	mData = NULL;
 	mDataSize = 0;
 }
@@ -171,7 +174,7 @@ U8* LLImageBase::allocateData(S32 size)
 	{
 		deleteData(); // virtual
 		mBadBufferAllocation = FALSE ;
-		mData = new U8[size];
+		mData = LLImageBufferPool::allocate(size);
 		if (!mData)
 		{
 			llwarns << "allocate image data: " << size << llendl;
@@ -189,7 +192,7 @@ U8* LLImageBase::allocateData(S32 size)
 U8* LLImageBase::reallocateData(S32 size)
 {
 	LLMemType mt1((LLMemType::EMemType)mMemType);
-	U8 *new_datap = new U8[size];
+	U8 *new_datap = LLImageBufferPool::allocate(size);
 	if (!new_datap)
 	{
 		llwarns << "Out of memory in LLImageBase::reallocateData" << llendl;
@@ -199,7 +202,7 @@ U8* LLImageBase::reallocateData(S32 size)
 	{
 		S32 bytes = llmin(mDataSize, size);
 		memcpy(new_datap, mData, bytes);	/* Flawfinder: ignore */
-		delete[] mData;
+		LLImageBufferPool::free(mData, mDataSize);
 	}
 	mData = new_datap;
 	mDataSize = size;
@@ -278,6 +278,8 @@ public:
 	virtual S32 calcDiscardLevelBytes(S32 bytes);
 	// getRawDiscardLevel()by default returns mDiscardLevel, but may be overridden (LLImageJ2C)
 	virtual S8  getRawDiscardLevel() { return mDiscardLevel; }
+	// getDecodeDataSize() returns how many of the bytes held are read to decode the raw discard level
+	virtual S32 getDecodeDataSize() { return getDataSize(); }
 	
 	BOOL load(const std::string& filename);
 	BOOL save(const std::string& filename);
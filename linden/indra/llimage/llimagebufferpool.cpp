@@ -0,0 +1,345 @@
+/** 
+ * @file llimagebufferpool.cpp
+ * @brief Size-class pool for image pixel buffers.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llimagebufferpool.h"
+
+#include <algorithm>
+
+#include "llthread.h"
+
+LLImageBufferPool* LLImageBufferPool::sInstance = NULL;
+LLMutex* LLImageBufferPool::sInstanceMutex = NULL;
+
+//static
+void LLImageBufferPool::initClass(S32 max_cached_bytes)
+{
+	if (!sInstanceMutex)
+	{
+		sInstanceMutex = new LLMutex(NULL);
+	}
+	if (!sInstance)
+	{
+		sInstance = new LLImageBufferPool(max_cached_bytes);
+	}
+}
+
+//static
+void LLImageBufferPool::cleanupClass()
+{
+	if (!sInstance)
+	{
+		return;
+	}
+	dumpStats();
+
+	// a thread that is just exiting may be flushing its cache
+	sInstanceMutex->lock();
+	delete sInstance;
+	sInstance = NULL;
+	sInstanceMutex->unlock();
+}
+
+//static
+S32 LLImageBufferPool::getSizeClass(S32 size)
+{
+	S32 odd = 0;
+	if (size > 0 && size % 3 == 0)
+	{
+		size /= 3;
+		odd = 1;
+	}
+	if (size < (1 << MIN_POOLED_BITS) || size > (1 << MAX_POOLED_BITS) || (size & (size - 1)))
+	{
+		return -1;
+	}
+	S32 bits = MIN_POOLED_BITS;
+	while ((1 << bits) < size)
+	{
+		++bits;
+	}
+	return (bits - MIN_POOLED_BITS) * 2 + odd;
+}
+
+//static
+U8* LLImageBufferPool::allocate(S32 size)
+{
+	S32 size_class = sInstance ? getSizeClass(size) : -1;
+	if (size_class < 0)
+	{
+		if (sInstance)
+		{
+			sInstance->mUnpooled++;
+		}
+		return new U8[size];
+	}
+	return sInstance->allocateClass(size_class, size);
+}
+
+//static
+void LLImageBufferPool::free(U8* data, S32 size)
+{
+	if (!data)
+	{
+		return;
+	}
+	S32 size_class = sInstance ? getSizeClass(size) : -1;
+	if (size_class < 0)
+	{
+		delete[] data;
+		return;
+	}
+	sInstance->freeClass(data, size_class, size);
+}
+
+//static
+void LLImageBufferPool::getStats(Stats& stats)
+{
+	if (!sInstance)
+	{
+		memset(&stats, 0, sizeof(Stats));
+		return;
+	}
+	stats.mAllocations = sInstance->mAllocations;
+	stats.mReused = sInstance->mReused;
+	stats.mUnpooled = sInstance->mUnpooled;
+	stats.mLiveBytes = llmax((S32)sInstance->mLiveBytes, 0);
+	stats.mCachedBytes = sInstance->mCachedBytes;
+	sInstance->mMutex->lock();
+	stats.mPeakBytes = sInstance->mPeakBytes;
+	sInstance->mMutex->unlock();
+}
+
+//static
+void LLImageBufferPool::dumpStats()
+{
+	Stats stats;
+	getStats(stats);
+	llinfos << "Image buffer pool: " << stats.mAllocations << " allocations, "
+			<< (S32)(stats.getReuseRate() * 100.f) << "% reused, "
+			<< stats.mUnpooled << " unpooled, "
+			<< stats.mLiveBytes / 1024 << "KB live, "
+			<< stats.mCachedBytes / 1024 << "KB cached, "
+			<< stats.mPeakBytes / 1024 << "KB peak" << llendl;
+}
+
+//----------------------------------------------------------------------------
+
+LLImageBufferPool::LLImageBufferPool(S32 max_cached_bytes)
+	: mAPRPoolp(NULL),
+	  mThreadKey(NULL),
+	  mSharedBytes(0),
+	  mMaxCachedBytes(max_cached_bytes),
+	  mAllocations(0),
+	  mReused(0),
+	  mUnpooled(0),
+	  mLiveBytes(0),
+	  mCachedBytes(0),
+	  mPeakBytes(0)
+{
+	mMutex = new LLMutex(NULL);
+	apr_pool_create(&mAPRPoolp, NULL);
+	if (apr_threadkey_private_create(&mThreadKey, threadCacheDestructor, mAPRPoolp) != APR_SUCCESS)
+	{
+		llwarns << "Image buffer pool has no thread caches" << llendl;
+		mThreadKey = NULL;
+	}
+}
+
+LLImageBufferPool::~LLImageBufferPool()
+{
+	// Threads that are still around must not flush into us when they exit
+	if (mThreadKey)
+	{
+		apr_threadkey_private_delete(mThreadKey);
+	}
+	for (std::vector<ThreadCache*>::iterator iter = mThreadCaches.begin();
+		 iter != mThreadCaches.end(); ++iter)
+	{
+		ThreadCache* cache = *iter;
+		for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+		{
+			for (std::vector<U8*>::iterator data = cache->mFree[i].begin(); data != cache->mFree[i].end(); ++data)
+			{
+				delete[] *data;
+			}
+		}
+		delete cache;
+	}
+	for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+	{
+		for (std::vector<U8*>::iterator data = mFree[i].begin(); data != mFree[i].end(); ++data)
+		{
+			delete[] *data;
+		}
+	}
+	apr_pool_destroy(mAPRPoolp);
+	delete mMutex;
+}
+
+U8* LLImageBufferPool::allocateClass(S32 size_class, S32 size)
+{
+	mAllocations++;
+
+	U8* data = NULL;
+	ThreadCache* cache = getThreadCache();
+	if (cache && !cache->mFree[size_class].empty())
+	{
+		data = cache->mFree[size_class].back();
+		cache->mFree[size_class].pop_back();
+		cache->mBytes -= size;
+	}
+	else
+	{
+		mMutex->lock();
+		if (!mFree[size_class].empty())
+		{
+			data = mFree[size_class].back();
+			mFree[size_class].pop_back();
+			mSharedBytes -= size;
+		}
+		else
+		{
+			// new memory, the only way the total grows
+			S32 total = mLiveBytes + mCachedBytes + size;
+			mPeakBytes = llmax(mPeakBytes, total);
+		}
+		mMutex->unlock();
+	}
+
+	mLiveBytes += size;
+	if (data)
+	{
+		mReused++;
+		mCachedBytes -= size;
+		return data;
+	}
+	return new U8[size];
+}
+
+void LLImageBufferPool::freeClass(U8* data, S32 size_class, S32 size)
+{
+	mLiveBytes -= size;
+
+	ThreadCache* cache = getThreadCache();
+	if (cache
+		&& cache->mFree[size_class].size() < THREAD_CACHE_DEPTH
+		&& cache->mBytes + size <= THREAD_CACHE_BYTES)
+	{
+		cache->mFree[size_class].push_back(data);
+		cache->mBytes += size;
+		mCachedBytes += size;
+		return;
+	}
+
+	mMutex->lock();
+	if (mSharedBytes + size <= mMaxCachedBytes)
+	{
+		mFree[size_class].push_back(data);
+		mSharedBytes += size;
+		mCachedBytes += size;
+		data = NULL;
+	}
+	mMutex->unlock();
+
+	delete[] data;
+}
+
+LLImageBufferPool::ThreadCache* LLImageBufferPool::getThreadCache()
+{
+	if (!mThreadKey)
+	{
+		return NULL;
+	}
+
+	void* cache = NULL;
+	apr_threadkey_private_get(&cache, mThreadKey);
+	if (!cache)
+	{
+		cache = new ThreadCache;
+		apr_threadkey_private_set(cache, mThreadKey);
+		mMutex->lock();
+		mThreadCaches.push_back((ThreadCache*)cache);
+		mMutex->unlock();
+	}
+	return (ThreadCache*)cache;
+}
+
+// A thread is exiting: hand its buffers to the shared cache, or back to
+// the heap if that is full.
+void LLImageBufferPool::releaseThreadCache(ThreadCache* cache)
+{
+	std::vector<U8*> excess;
+
+	mMutex->lock();
+	std::vector<ThreadCache*>::iterator found = std::find(mThreadCaches.begin(), mThreadCaches.end(), cache);
+	if (found != mThreadCaches.end())
+	{
+		mThreadCaches.erase(found);
+	}
+	for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+	{
+		S32 size = (1 << (i / 2 + MIN_POOLED_BITS)) * ((i & 1) ? 3 : 1);
+		for (std::vector<U8*>::iterator data = cache->mFree[i].begin(); data != cache->mFree[i].end(); ++data)
+		{
+			if (mSharedBytes + size <= mMaxCachedBytes)
+			{
+				mFree[i].push_back(*data);
+				mSharedBytes += size;
+			}
+			else
+			{
+				excess.push_back(*data);
+				mCachedBytes -= size;
+			}
+		}
+	}
+	mMutex->unlock();
+
+	for (std::vector<U8*>::iterator data = excess.begin(); data != excess.end(); ++data)
+	{
+		delete[] *data;
+	}
+	delete cache;
+}
+
+//static
+void LLImageBufferPool::threadCacheDestructor(void* cache)
+{
+	sInstanceMutex->lock();
+	if (sInstance && cache)
+	{
+		sInstance->releaseThreadCache((ThreadCache*)cache);
+	}
+	sInstanceMutex->unlock();
+}
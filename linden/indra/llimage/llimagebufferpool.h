@@ -0,0 +1,131 @@
+/** 
+ * @file llimagebufferpool.h
+ * @brief Size-class pool for image pixel buffers.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLIMAGEBUFFERPOOL_H
+#define LL_LLIMAGEBUFFERPOOL_H
+
+#include <vector>
+
+#include "llapr.h"
+
+class LLMutex;
+
+//============================================================================
+// Recycles image buffers whose size is a power-of-two image's, that is
+// 2^n or 3 * 2^n bytes, so a texture storm reuses the same few buffers
+// instead of churning the heap.  Each thread keeps a small cache of its
+// own, in front of a shared one, so decode threads rarely take the lock.
+//
+// Buffers are plain new U8[] blocks: anything of a pooled size may be
+// freed here whether or not it came from here, and anything allocated
+// here may be deleted with delete[].  Before initClass() and after
+// cleanupClass() allocate() and free() are just new and delete.
+
+class LLImageBufferPool
+{
+public:
+	struct Stats
+	{
+		U32 mAllocations;		// of pooled sizes
+		U32 mReused;			// of those, served from a cache
+		U32 mUnpooled;			// allocations of other sizes
+		S32 mLiveBytes;			// pooled-size buffers in use, less any that were
+								// allocated elsewhere and adopted by free()
+		S32 mCachedBytes;		// waiting for reuse, all threads
+		S32 mPeakBytes;			// highest live + cached
+
+		F32 getReuseRate() const { return mAllocations ? (F32)mReused / (F32)mAllocations : 0.f; }
+	};
+
+	static void initClass(S32 max_cached_bytes = DEFAULT_MAX_CACHED_BYTES);
+	static void cleanupClass();
+
+	static U8* allocate(S32 size);
+	static void free(U8* data, S32 size);
+
+	static void getStats(Stats& stats);
+	static void dumpStats();
+
+	// -1 if size isn't pooled
+	static S32 getSizeClass(S32 size);
+
+	enum
+	{
+		MIN_POOLED_BITS = 10,		// 1KB, 16x16 RGBA
+		MAX_POOLED_BITS = 24,		// 16MB, 2048x2048 RGBA
+		NUM_SIZE_CLASSES = (MAX_POOLED_BITS - MIN_POOLED_BITS + 1) * 2,
+		DEFAULT_MAX_CACHED_BYTES = 32 * 1024 * 1024,
+		THREAD_CACHE_BYTES = 4 * 1024 * 1024,
+		THREAD_CACHE_DEPTH = 4		// buffers per size class
+	};
+
+private:
+	struct ThreadCache
+	{
+		ThreadCache() : mBytes(0) {}
+
+		std::vector<U8*> mFree[NUM_SIZE_CLASSES];
+		S32 mBytes;
+	};
+
+	LLImageBufferPool(S32 max_cached_bytes);
+	~LLImageBufferPool();
+
+	U8* allocateClass(S32 size_class, S32 size);
+	void freeClass(U8* data, S32 size_class, S32 size);
+
+	ThreadCache* getThreadCache();
+	void releaseThreadCache(ThreadCache* cache);
+	static void threadCacheDestructor(void* cache);
+
+	static LLImageBufferPool* sInstance;
+	static LLMutex* sInstanceMutex; // for exiting threads, lives as long as the process
+
+	LLMutex* mMutex;
+	apr_pool_t* mAPRPoolp;
+	apr_threadkey_t* mThreadKey;
+
+	// shared cache, protected by mMutex
+	std::vector<U8*> mFree[NUM_SIZE_CLASSES];
+	S32 mSharedBytes;
+	S32 mMaxCachedBytes;
+	std::vector<ThreadCache*> mThreadCaches;
+
+	LLAtomicU32 mAllocations;
+	LLAtomicU32 mReused;
+	LLAtomicU32 mUnpooled;
+	LLAtomicS32 mLiveBytes;
+	LLAtomicS32 mCachedBytes;
+	S32 mPeakBytes; // protected by mMutex
+};
+
+#endif // LL_LLIMAGEBUFFERPOOL_H
@@ -239,6 +239,57 @@ S8  LLImageJ2C::getRawDiscardLevel()
 	return mRawDiscardLevel;
 }
 
+// virtual
+S32 LLImageJ2C::getDecodeDataSize()
+{
+	// Only a resolution progressive (RLCP or RPCL) codestream can be cut at
+	// the size a fetch for the discard level would ask for and still hold
+	// every layer of the levels we decode.  Ours are usually LRCP, with the
+	// quality layers first, so those are passed whole; any shortening has
+	// already been done by the fetch.
+	S32 discard = getRawDiscardLevel();
+	if (discard <= 0 || !(getWidth() * getHeight() * getComponents())
+		|| !isResolutionProgressive())
+	{
+		return getDataSize();
+	}
+	return llmin(getDataSize(), calcDataSize(discard));
+}
+
+BOOL LLImageJ2C::isResolutionProgressive()
+{
+	// Walk the main header's marker segments: SOC, then SIZ, COD and the
+	// others, each a 2 byte marker and a 2 byte length, up to the first SOT.
+	const U8* data = getData();
+	S32 size = getDataSize();
+	if (!data || size < 4 || data[0] != 0xff || data[1] != 0x4f)
+	{
+		return FALSE;	// not a raw codestream
+	}
+	S32 pos = 2;
+	while (pos + 4 <= size && data[pos] == 0xff)
+	{
+		U8 marker = data[pos + 1];
+		if (marker == 0x90)
+		{
+			break;		// SOT, the main header is over
+		}
+		S32 length = (data[pos + 2] << 8) | data[pos + 3];
+		if (marker == 0x52)
+		{
+			// COD: Lcod, Scod, then the progression order
+			if (pos + 6 > size)
+			{
+				break;
+			}
+			U8 order = data[pos + 5];
+			return (order == 1 || order == 2);	// RLCP, RPCL
+		}
+		pos += 2 + length;
+	}
+	return FALSE;
+}
+
 BOOL LLImageJ2C::updateData()
 {
 	BOOL res = TRUE;
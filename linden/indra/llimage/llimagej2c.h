@@ -55,6 +55,7 @@ public:
 	/*virtual*/ S32 calcDataSize(S32 discard_level = 0);
 	/*virtual*/ S32 calcDiscardLevelBytes(S32 bytes);
 	/*virtual*/ S8  getRawDiscardLevel();
+	/*virtual*/ S32 getDecodeDataSize();
 	// Override these so that we don't try to set a global variable from a DLL
 	/*virtual*/ void resetLastError();
 	/*virtual*/ void setLastError(const std::string& message, const std::string& filename = std::string());
@@ -85,6 +86,8 @@ protected:
 	friend class LLImageJ2CKDU;
 	void decodeFailed();
 	void updateRawDiscardLevel();
+	// True if the COD marker says the finest resolution levels come last
+	BOOL isResolutionProgressive();
 
 	S32 mMaxBytes; // Maximum number of bytes of data to use...
 	S8  mRawDiscardLevel;
@@ -34,6 +34,8 @@
 
 #include "llimageworker.h"
 #include "llimagedxt.h"
+#include "llstl.h"
+#include "timing.h"
 
 //----------------------------------------------------------------------------
 
@@ -56,11 +58,13 @@ void LLImageWorker::cleanupImageWorker()
 
 LLImageWorker::LLImageWorker(LLImageFormatted* image, U32 priority,
 							 S32 discard,
-							 LLPointer<LLResponder> responder)
+							 LLPointer<LLResponder> responder,
+							 S32 min_discard)
 	: LLWorkerClass(sWorkerThread, "Image"),
 	  mFormattedImage(image),
 	  mDecodedType(-1),
 	  mDiscardLevel(discard),
+	  mMinDiscardLevel(min_discard),
 	  mPriority(priority),
 	  mResponder(responder)
 {
@@ -97,6 +101,19 @@ bool LLImageWorker::doWork(S32 param)
 		{
 			mFormattedImage->setDiscardLevel(mDiscardLevel);
 		}
+		if (mMinDiscardLevel > mFormattedImage->getDiscardLevel())
+		{
+			// Don't spend time on detail nobody asked for.  Stop short of
+			// tiny reductions though; small images may be coded with fewer levels.
+			const S32 MIN_REDUCED_SIZE = 32;
+			S32 size = llmin(mFormattedImage->getWidth(), mFormattedImage->getHeight());
+			S32 discard = llmin(mMinDiscardLevel, (S32)MAX_DISCARD_LEVEL);
+			while (discard > mFormattedImage->getDiscardLevel() && (size >> discard) < MIN_REDUCED_SIZE)
+			{
+				discard--;
+			}
+			mFormattedImage->setDiscardLevel(discard);
+		}
 		if (!(mFormattedImage->getWidth() * mFormattedImage->getHeight() * mFormattedImage->getComponents()))
 		{
 			decoded = true; // failed
@@ -186,3 +203,93 @@ BOOL LLImageWorker::requestDecodedData(LLPointer<LLImageRaw>& raw, S32 discard)
 		return requestDecodedAuxData(raw, 0, discard);
 	}
 }
+
+//----------------------------------------------------------------------------
+
+// Stamps the time the decode finished, from the worker thread.  Shared by
+// the worker and the batch so it outlives whichever lets go first.
+class LLImageDecodeBatch::Responder : public LLResponder
+{
+public:
+	Responder() : mDoneTime(0) {}
+	/*virtual*/ void completed(bool success)
+	{
+		mDoneTime = totalTime();
+	}
+	volatile U64 mDoneTime;
+};
+
+LLImageDecodeBatch::LLImageDecodeBatch()
+	: mPending(0)
+{
+}
+
+LLImageDecodeBatch::~LLImageDecodeBatch()
+{
+	clear();
+}
+
+S32 LLImageDecodeBatch::addImage(LLImageFormatted* image, S32 discard, U32 priority)
+{
+	Entry* entry = new Entry;
+	entry->mImage = image;
+	entry->mResponder = new Responder;
+	entry->mStartTime = totalTime();
+	entry->mWorker = new LLImageWorker(image, priority, discard, entry->mResponder.get());
+	mEntries.push_back(entry);
+	++mPending;
+
+	// the first request starts the work (see LLTextureFetchWorker)
+	LLPointer<LLImageRaw> raw;
+	entry->mWorker->requestDecodedData(raw, -1);
+
+	return (S32)mEntries.size() - 1;
+}
+
+S32 LLImageDecodeBatch::update()
+{
+	for (std::vector<Entry*>::iterator iter = mEntries.begin();
+		 mPending > 0 && iter != mEntries.end(); ++iter)
+	{
+		Entry* entry = *iter;
+		if (entry->mWorker && entry->mWorker->requestDecodedData(entry->mDecoded, -1))
+		{
+			if (entry->mDecoded.notNull() && !entry->mDecoded->getDataSize())
+			{
+				entry->mDecoded = NULL;
+			}
+			entry->mWorker->scheduleDelete();
+			entry->mWorker = NULL;
+			--mPending;
+		}
+	}
+	return mPending;
+}
+
+void LLImageDecodeBatch::clear()
+{
+	for (std::vector<Entry*>::iterator iter = mEntries.begin();
+		 iter != mEntries.end(); ++iter)
+	{
+		Entry* entry = *iter;
+		if (entry->mWorker)
+		{
+			// aborted and deleted by the worker thread's update()
+			entry->mWorker->scheduleDelete();
+		}
+	}
+	for_each(mEntries.begin(), mEntries.end(), DeletePointer());
+	mEntries.clear();
+	mPending = 0;
+}
+
+F64 LLImageDecodeBatch::getDecodeTime(S32 index) const
+{
+	const Entry* entry = mEntries[index];
+	U64 done_time = entry->mResponder->mDoneTime;
+	if (!done_time)
+	{
+		return 0.0;
+	}
+	return (F64)(done_time - entry->mStartTime) * 0.000001;
+}
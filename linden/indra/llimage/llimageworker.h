@@ -47,8 +47,10 @@ public:
 
 	// LLWorkerThread
 public:
+	// discard < 0: decode as far as the data allows.  min_discard >= 0:
+	// never decode finer than that, even if the data allows it.
 	LLImageWorker(LLImageFormatted* image, U32 priority, S32 discard,
-				  LLPointer<LLResponder> responder);
+				  LLPointer<LLResponder> responder, S32 min_discard = -1);
 	~LLImageWorker();
 
 	// called from WORKER THREAD, returns TRUE if done
@@ -69,6 +71,7 @@ protected:
 	LLPointer<LLImageRaw> mDecodedImage;
 	S32 mDecodedType;
 	S32 mDiscardLevel;
+	S32 mMinDiscardLevel;
 
 private:
 	U32 mPriority;
@@ -81,4 +84,46 @@ public:
 	static S32 sCount;
 };
 
+// Decodes a set of images together, one LLImageWorker each, so a pooled
+// decode thread (see LLWorkerThread) works on several at once.  The
+// decode thread still needs its usual update() calls.
+// MAIN THREAD
+class LLImageDecodeBatch
+{
+public:
+	LLImageDecodeBatch();
+	~LLImageDecodeBatch();
+
+	// Starts decoding image at discard (< 0: as far as its data allows).
+	// Returns the image's index in the batch.
+	S32 addImage(LLImageFormatted* image, S32 discard = -1, U32 priority = LLWorkerThread::PRIORITY_NORMAL);
+
+	// Collects finished decodes; returns the number still in progress.
+	S32 update();
+
+	// Abandons any decodes still in progress and empties the batch.
+	void clear();
+
+	S32 getCount() const { return (S32)mEntries.size(); }
+	S32 getPending() const { return mPending; }
+	bool isDone(S32 index) const { return mEntries[index]->mWorker == NULL; }
+	// NULL until done, or if the decode failed
+	LLImageRaw* getDecodedImage(S32 index) const { return mEntries[index]->mDecoded; }
+	// Seconds from addImage() until the worker finished decoding
+	F64 getDecodeTime(S32 index) const;
+
+private:
+	class Responder;
+	struct Entry
+	{
+		LLPointer<LLImageFormatted> mImage;
+		LLPointer<LLImageRaw> mDecoded;
+		LLImageWorker* mWorker;
+		LLPointer<Responder> mResponder;
+		U64 mStartTime;
+	};
+	std::vector<Entry*> mEntries;
+	S32 mPending;
+};
+
 #endif
@@ -0,0 +1,280 @@
+/** 
+ * @file lltexturebudget.cpp
+ * @brief Chooses per-texture discard levels under a texture memory budget.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "lltexturebudget.h"
+
+#include <queue>
+
+#include "llimage.h"
+#include "llmath.h"
+
+// tuning params
+static const F32 DEFAULT_LOOKAHEAD = 1.f;		// seconds
+static const F32 DEFAULT_RECENCY_TIME = 2.f;	// seconds
+static const F32 RECENT_PIXEL_AREA = 32.f * 32.f;	// worth of a texture bound just now
+static const F32 MIN_UTILITY = 1.f;				// a pixel
+static const F32 MIN_PREDICT_DISTANCE = 1.f;	// meters, don't extrapolate past the near plane
+static const F32 DISCARD_BIAS = -.5f;			// as LLViewerImage, round towards the finer level
+static const F32 PREFETCH_WEIGHT = .25f;		// of a level that's needed now
+static const F32 RESIDENT_WEIGHT = 2.f;			// of a level that has to be fetched
+
+//----------------------------------------------------------------------------
+
+LLTextureBudget::Entry::Entry()
+	: mWidth(0),
+	  mHeight(0),
+	  mComponents(4),
+	  mMinDiscard(0),
+	  mMaxDiscard(MAX_DISCARD_LEVEL),
+	  mWantedDiscard(0),
+	  mPixelArea(0.f),
+	  mDistance(0.f),
+	  mApproachSpeed(0.f),
+	  mTimeSinceBound(0.f),
+	  mResidentDiscard(MAX_DISCARD_LEVEL + 1),
+	  mPinned(FALSE),
+	  mUserData(NULL),
+	  mDiscard(MAX_DISCARD_LEVEL + 1),
+	  mUtility(0.f)
+{
+}
+
+//----------------------------------------------------------------------------
+
+LLTextureBudget::LLTextureBudget()
+	: mLookahead(DEFAULT_LOOKAHEAD),
+	  mRecencyTime(DEFAULT_RECENCY_TIME)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+//static
+S64 LLTextureBudget::calcBytes(S32 width, S32 height, S32 components, S32 discard)
+{
+	if (width <= 0 || height <= 0 || discard < 0)
+	{
+		return 0;
+	}
+	S32 w = llmax(width >> discard, 1);
+	S32 h = llmax(height >> discard, 1);
+	// the mip chain below adds a third
+	return ((S64)w * h * components * 4) / 3;
+}
+
+//static
+S32 LLTextureBudget::calcDiscardLevel(F32 texels, F32 pixel_area)
+{
+	static const F64 log_4 = log(4.0);
+
+	if (pixel_area <= 0.f || texels <= pixel_area)
+	{
+		return 0;
+	}
+	// log_4 because both are areas: twice the width and height is 4x the texels
+	F32 discard = (F32)(log(texels / pixel_area) / log_4) + DISCARD_BIAS;
+	return llmax(0, (S32)floorf(discard));
+}
+
+//static
+F32 LLTextureBudget::predictPixelArea(F32 pixel_area, F32 distance, F32 approach_speed, F32 lookahead)
+{
+	if (pixel_area <= 0.f || approach_speed <= 0.f || distance <= MIN_PREDICT_DISTANCE)
+	{
+		return pixel_area;
+	}
+	// area falls off with the square of the distance
+	F32 future_distance = llmax(distance - approach_speed * lookahead, MIN_PREDICT_DISTANCE);
+	F32 scale = distance / future_distance;
+	return pixel_area * llmin(scale * scale, (F32)MAX_AREA_GROWTH);
+}
+
+F32 LLTextureBudget::calcUtility(F32 pixel_area, F32 time_since_bound) const
+{
+	// Proportional to the area, so that under pressure an entry covering
+	// four times the pixels ends up a level finer than one covering less,
+	// i.e. texel density on screen stays even.
+	F32 utility = pixel_area;
+	if (mRecencyTime > 0.f)
+	{
+		// Off screen but bound recently, e.g. just behind the camera: worth
+		// keeping a coarse level of, if nothing on screen needs the room.
+		F32 recent = RECENT_PIXEL_AREA * powf(0.5f, llmax(time_since_bound, 0.f) / mRecencyTime);
+		utility = llmax(utility, recent);
+	}
+	return utility >= MIN_UTILITY ? utility : 0.f;
+}
+
+//----------------------------------------------------------------------------
+
+S64 LLTextureBudget::solve(entry_list_t& entries, S64 budget_bytes)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	mStats.mBudgetBytes = budget_bytes;
+	mStats.mEntries = (U32)entries.size();
+
+	S32 count = (S32)entries.size();
+	std::vector<S32> needed(count);		// for the view as it is
+	std::vector<S32> wanted(count);		// including prefetch
+	std::vector<S32> candidates;
+	candidates.reserve(count);
+	S64 used_bytes = 0;
+
+	for (S32 i = 0; i < count; ++i)
+	{
+		Entry& entry = entries[i];
+		entry.mMinDiscard = llclamp(entry.mMinDiscard, 0, MAX_DISCARD_LEVEL);
+		entry.mMaxDiscard = llclamp(entry.mMaxDiscard, entry.mMinDiscard, MAX_DISCARD_LEVEL);
+
+		needed[i] = llclamp(entry.mWantedDiscard, entry.mMinDiscard, entry.mMaxDiscard);
+		wanted[i] = needed[i];
+		entry.mUtility = calcUtility(entry.mPixelArea, entry.mTimeSinceBound);
+		if (entry.mPinned)
+		{
+			entry.mDiscard = needed[i];
+			used_bytes += calcBytes(entry.mWidth, entry.mHeight, entry.mComponents, needed[i]);
+		}
+		else if (entry.mUtility <= 0.f)
+		{
+			entry.mDiscard = entry.mMaxDiscard + 1;
+			continue;
+		}
+		else
+		{
+			// prefetch what we'll need once the camera gets closer
+			F32 predicted_area = predictPixelArea(entry.mPixelArea, entry.mDistance, entry.mApproachSpeed, mLookahead);
+			if (predicted_area > entry.mPixelArea)
+			{
+				S32 predicted_discard = calcDiscardLevel((F32)entry.mWidth * entry.mHeight, predicted_area);
+				wanted[i] = llclamp(predicted_discard, entry.mMinDiscard, needed[i]);
+			}
+			candidates.push_back(i);
+		}
+		mStats.mWantedBytes += calcBytes(entry.mWidth, entry.mHeight, entry.mComponents, needed[i]);
+	}
+
+	// Each level, the coarsest included, is worth the entry's utility
+	// again, for about four times the bytes of the last, so taking the
+	// best value per byte first spreads the budget over what's on screen
+	// and leaves out what isn't worth even its coarsest level.
+	std::priority_queue<Upgrade> upgrades;
+	for (std::vector<S32>::iterator iter = candidates.begin(); iter != candidates.end(); ++iter)
+	{
+		Entry& entry = entries[*iter];
+		entry.mDiscard = entry.mMaxDiscard + 1;
+		upgrades.push(Upgrade(calcUpgradeValue(entry, needed[*iter]), *iter));
+	}
+	while (!upgrades.empty())
+	{
+		S32 i = upgrades.top().mIndex;
+		upgrades.pop();
+		Entry& entry = entries[i];
+		S64 bytes = calcLevelBytes(entry, entry.mDiscard);
+		S64 finer_bytes = calcLevelBytes(entry, entry.mDiscard - 1);
+		if (used_bytes + finer_bytes - bytes > budget_bytes)
+		{
+			// won't fit, and the next level would cost even more
+			continue;
+		}
+		entry.mDiscard--;
+		used_bytes += finer_bytes - bytes;
+		if (entry.mDiscard > wanted[i])
+		{
+			upgrades.push(Upgrade(calcUpgradeValue(entry, needed[i]), i));
+		}
+	}
+
+	for (S32 i = 0; i < count; ++i)
+	{
+		const Entry& entry = entries[i];
+		if (entry.mDiscard > entry.mMaxDiscard)
+		{
+			if (entry.mUtility > 0.f)
+			{
+				mStats.mDropped++;
+			}
+			else
+			{
+				mStats.mIdle++;
+			}
+		}
+		else if (entry.mDiscard <= needed[i])
+		{
+			mStats.mAtWanted++;
+			if (entry.mDiscard < needed[i])
+			{
+				mStats.mPrefetched++;
+			}
+		}
+		else
+		{
+			mStats.mDegraded++;
+		}
+	}
+	mStats.mUsedBytes = used_bytes;
+	return used_bytes;
+}
+
+// Value per byte of taking entry one level finer.  Levels past what the
+// view needs now are only a guess at what it will need, so they go
+// after the levels that are needed.  Levels we already have cost nothing
+// to keep, so they only give way to something clearly better; otherwise
+// the choice flickers from one solve to the next and every flicker is a
+// refetch.
+//static
+F32 LLTextureBudget::calcUpgradeValue(const Entry& entry, S32 needed_discard)
+{
+	S32 finer = entry.mDiscard - 1;
+	S64 bytes = calcLevelBytes(entry, entry.mDiscard);
+	S64 finer_bytes = calcLevelBytes(entry, finer);
+	F32 value = entry.mUtility;
+	if (finer < needed_discard)
+	{
+		value *= PREFETCH_WEIGHT;
+	}
+	if (finer >= entry.mResidentDiscard)
+	{
+		value *= RESIDENT_WEIGHT;
+	}
+	return value / (F32)llmax(finer_bytes - bytes, (S64)1);
+}
+
+//static
+S64 LLTextureBudget::calcLevelBytes(const Entry& entry, S32 discard)
+{
+	if (discard > entry.mMaxDiscard)
+	{
+		return 0;
+	}
+	return calcBytes(entry.mWidth, entry.mHeight, entry.mComponents, discard);
+}
@@ -0,0 +1,146 @@
+/** 
+ * @file lltexturebudget.h
+ * @brief Chooses per-texture discard levels under a texture memory budget.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLTEXTUREBUDGET_H
+#define LL_LLTEXTUREBUDGET_H
+
+#include <vector>
+
+//============================================================================
+// Decides which discard level each texture should be held at so that the
+// whole set fits in a byte budget.  Every texture has a utility, from how
+// much of the screen it covers or, if none, how recently it was bound.
+// Each level, starting with its coarsest, is worth that utility once and
+// costs the bytes it adds, so a greedy pass over the best value-per-byte
+// upgrades gives the budget to the textures that matter instead of
+// blurring everything.  Levels that an approaching texture will need soon
+// are fetched too, once what's needed now has been paid for, and levels
+// already resident are worth more than ones that would have to be fetched
+// again.
+//
+// Knows nothing about GL: the viewer fills in the entries from its images
+// and applies the levels it gets back.
+
+class LLTextureBudget
+{
+public:
+	struct Entry
+	{
+		Entry();
+
+		// in
+		S32 mWidth;				// full resolution
+		S32 mHeight;
+		S32 mComponents;
+		S32 mMinDiscard;		// finest level allowed
+		S32 mMaxDiscard;		// coarsest level available
+		S32 mWantedDiscard;		// what the view needs, or needed when last drawn
+		F32 mPixelArea;			// on screen this frame, in pixels
+		F32 mDistance;			// from the camera, in meters
+		F32 mApproachSpeed;		// towards the camera, m/s; negative if receding
+		F32 mTimeSinceBound;	// seconds, 0 if drawn this frame
+		S32 mResidentDiscard;	// level held now, mMaxDiscard + 1 if none
+		BOOL mPinned;			// always gets mWantedDiscard, e.g. UI
+		void* mUserData;
+
+		// out
+		S32 mDiscard;			// mMaxDiscard + 1 if it shouldn't be resident
+		F32 mUtility;
+	};
+	typedef std::vector<Entry> entry_list_t;
+
+	struct Stats
+	{
+		S64 mBudgetBytes;
+		S64 mUsedBytes;			// may exceed the budget if pinned entries do
+		S64 mWantedBytes;		// if every entry got what it wanted
+		U32 mEntries;
+		U32 mAtWanted;			// at least as fine as wanted
+		U32 mDegraded;			// resident, but coarser than wanted
+		U32 mDropped;			// not worth even the coarsest level
+		U32 mIdle;				// not visible and not bound recently
+		U32 mPrefetched;		// of those, finer because the camera is approaching
+	};
+
+	LLTextureBudget();
+
+	// Fills in mDiscard and mUtility for every entry and returns the bytes used.
+	// Byte counts are 64 bit: a few large textures add up past 2GB easily.
+	S64 solve(entry_list_t& entries, S64 budget_bytes);
+
+	const Stats& getStats() const { return mStats; }
+
+	// How far ahead, in seconds, to anticipate camera motion.
+	void setLookahead(F32 seconds) { mLookahead = seconds; }
+	F32 getLookahead() const { return mLookahead; }
+
+	// Off screen, an entry recently bound is worth a little, halving every
+	// this many seconds since the bind.
+	void setRecencyTime(F32 seconds) { mRecencyTime = seconds; }
+	F32 getRecencyTime() const { return mRecencyTime; }
+
+	// Bytes for a texture at a discard level, mip chain included.
+	static S64 calcBytes(S32 width, S32 height, S32 components, S32 discard);
+
+	// The discard level that puts about one texel on each pixel, 0 or more.
+	static S32 calcDiscardLevel(F32 texels, F32 pixel_area);
+
+	// Pixel area after lookahead seconds of the camera closing in at
+	// approach_speed, never less than the area now.
+	static F32 predictPixelArea(F32 pixel_area, F32 distance, F32 approach_speed, F32 lookahead);
+
+	F32 calcUtility(F32 pixel_area, F32 time_since_bound) const;
+
+	enum
+	{
+		MAX_AREA_GROWTH = 16	// cap on predictPixelArea(), i.e. 4x closer
+	};
+
+private:
+	static F32 calcUpgradeValue(const Entry& entry, S32 needed_discard);
+	static S64 calcLevelBytes(const Entry& entry, S32 discard);
+
+	struct Upgrade
+	{
+		Upgrade(F32 value, S32 index) : mValue(value), mIndex(index) {}
+		bool operator<(const Upgrade& rhs) const { return mValue < rhs.mValue; }
+
+		F32 mValue;		// utility per byte
+		S32 mIndex;
+	};
+
+	F32 mLookahead;
+	F32 mRecencyTime;
+	Stats mStats;
+};
+
+#endif // LL_LLTEXTUREBUDGET_H
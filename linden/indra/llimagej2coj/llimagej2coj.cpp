@@ -148,8 +148,8 @@ BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decod
 	/* setup the decoder decoding parameters using user parameters */
 	opj_setup_decoder(dinfo, &parameters);
 
-	/* open a byte stream */
-	cio = opj_cio_open((opj_common_ptr)dinfo, base.getData(), base.getDataSize());
+	/* open a byte stream, leaving out anything only finer levels need */
+	cio = opj_cio_open((opj_common_ptr)dinfo, base.getData(), base.getDecodeDataSize());
 
 	/* decode the stream and fill the image structure */
 	image = opj_decode(dinfo, cio);
@@ -218,34 +218,40 @@ BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decod
 	S32 f=image->comps[0].factor;
 	S32 width = ceildivpow2(image->x1 - image->x0, f);
 	S32 height = ceildivpow2(image->y1 - image->y0, f);
+	for (S32 comp = first_channel; comp < first_channel + channels; comp++)
+	{
+		if (!image->comps[comp].data) // Some rare OpenJPEG versions have this bug.
+		{
+			llwarns << "ERROR -> decodeImpl: failed to decode image! (NULL comp data - OpenJPEG bug)" << llendl;
+			opj_image_destroy(image);
+
+			return TRUE; // done
+		}
+	}
+
 	raw_image.resize(width, height, channels);
 	U8 *rawp = raw_image.getData();
 
+	// Interleave a row of every channel at a time, so each raw row is
+	// written once while it is in cache rather than once per channel.
+	// Raw images are stored bottom row first.
 	// first_channel is what channel to start copying from
 	// dest is what channel to copy to.  first_channel comes from the
 	// argument, dest always starts writing at channel zero.
-	for (S32 comp = first_channel, dest=0; comp < first_channel + channels;
-		comp++, dest++)
+	for (S32 y = 0; y < height; y++)
 	{
-		if (image->comps[comp].data)
+		U8* dst_row = rawp + (height - 1 - y) * width * channels;
+		for (S32 comp = first_channel, dest = 0; comp < first_channel + channels;
+			comp++, dest++)
 		{
-			S32 offset = dest;
-			for (S32 y = (height - 1); y >= 0; y--)
+			const int* src = image->comps[comp].data + y * comp_width;
+			U8* dst = dst_row + dest;
+			for (S32 x = 0; x < width; x++)
 			{
-				for (S32 x = 0; x < width; x++)
-				{
-					rawp[offset] = image->comps[comp].data[y*comp_width + x];
-					offset += channels;
-				}
+				*dst = (U8)src[x];
+				dst += channels;
 			}
 		}
-		else // Some rare OpenJPEG versions have this bug.
-		{
-			llwarns << "ERROR -> decodeImpl: failed to decode image! (NULL comp data - OpenJPEG bug)" << llendl;
-			opj_image_destroy(image);
-
-			return TRUE; // done
-		}
 	}
 
 	/* free image data structure */
@@ -40,7 +40,7 @@
 // Our header files include statements like this
 //   const F32 HAVOK_TIMESTEP = 1.f / 45.f;
 // This creates "globals" that are included in each .obj file.  If a single
-// .cpp file has SSE code generation turned on (eg, llviewerjointmesh_sse.cpp)
+// .cpp file has SSE code generation turned on (eg, llskinning_sse.cpp)
 // these globals will be initialized using SSE instructions.  This causes SL
 // to crash before main() on processors without SSE.  Untangling all these 
 // headers/variables is too much work for the small performance gains of 
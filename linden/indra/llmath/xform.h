@@ -150,6 +150,15 @@ public:
 
 	void update();
 	void updateMatrix(BOOL update_bounds = TRUE);
+
+	// For callers that compute world transforms themselves (LLSkeleton);
+	// same as updateMatrix(FALSE) with the given world position and rotation.
+	void setWorldTransform(const LLVector3& pos, const LLQuaternion& rot)
+	{
+		mWorldPosition = pos;
+		mWorldRotation = rot;
+		mWorldMatrix.initAll(mScale, mWorldRotation, mWorldPosition);
+	}
 	void getMinMax(LLVector3& min,LLVector3& max) const;
 
 protected:
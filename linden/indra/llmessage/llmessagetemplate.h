@@ -368,6 +368,11 @@ public:
 		mUserData = user_data;
 	}
 
+	typedef void (*handler_func_t)(LLMessageSystem *msgsystem, void **user_data);
+
+	handler_func_t getHandlerFunc() const		{ return mHandlerFunc; }
+	void **getHandlerUserData() const			{ return mUserData; }
+
 	BOOL callHandlerFunc(LLMessageSystem *msgsystem) const
 	{
 		if (mHandlerFunc)
@@ -0,0 +1,195 @@
+/** 
+ * @file llpacketcapture.cpp
+ * @brief Implementation of LLPacketCapture.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llpacketcapture.h"
+
+#include "net.h"
+#include "timing.h"
+
+static const char CAPTURE_MAGIC[] = "LLPCAP01";
+static const S32 CAPTURE_MAGIC_SIZE = 8;
+static const S32 CAPTURE_RECORD_HEADER_SIZE = 12;
+
+static void put_u32(U8* p, U32 value)
+{
+	p[0] = (U8)(value & 0xFF);
+	p[1] = (U8)((value >> 8) & 0xFF);
+	p[2] = (U8)((value >> 16) & 0xFF);
+	p[3] = (U8)((value >> 24) & 0xFF);
+}
+
+static void put_u16(U8* p, U16 value)
+{
+	p[0] = (U8)(value & 0xFF);
+	p[1] = (U8)((value >> 8) & 0xFF);
+}
+
+static U32 get_u32(const U8* p)
+{
+	return (U32)p[0] | ((U32)p[1] << 8) | ((U32)p[2] << 16) | ((U32)p[3] << 24);
+}
+
+static U16 get_u16(const U8* p)
+{
+	return (U16)(p[0] | (p[1] << 8));
+}
+
+LLPacketCapture::LLPacketCapture()
+:	mFile(NULL),
+	mWriting(FALSE),
+	mStartTime(0),
+	mPacketCount(0)
+{
+}
+
+LLPacketCapture::~LLPacketCapture()
+{
+	close();
+}
+
+BOOL LLPacketCapture::openForWrite(const std::string& filename)
+{
+	close();
+	mFile = LLFile::fopen(filename, "wb");	/* Flawfinder: ignore */
+	if (!mFile)
+	{
+		llwarns << "Unable to open packet capture " << filename << " for writing" << llendl;
+		return FALSE;
+	}
+	if (fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, mFile) != (size_t)CAPTURE_MAGIC_SIZE)
+	{
+		llwarns << "Unable to write packet capture header to " << filename << llendl;
+		close();
+		return FALSE;
+	}
+	mWriting = TRUE;
+	mStartTime = totalTime();
+	return TRUE;
+}
+
+BOOL LLPacketCapture::openForRead(const std::string& filename)
+{
+	close();
+	mFile = LLFile::fopen(filename, "rb");	/* Flawfinder: ignore */
+	if (!mFile)
+	{
+		llwarns << "Unable to open packet capture " << filename << llendl;
+		return FALSE;
+	}
+	char magic[CAPTURE_MAGIC_SIZE];		/* Flawfinder: ignore */
+	if (fread(magic, 1, CAPTURE_MAGIC_SIZE, mFile) != (size_t)CAPTURE_MAGIC_SIZE
+		|| memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE))
+	{
+		llwarns << filename << " is not a packet capture" << llendl;
+		close();
+		return FALSE;
+	}
+	mWriting = FALSE;
+	return TRUE;
+}
+
+void LLPacketCapture::close()
+{
+	if (mFile)
+	{
+		fclose(mFile);
+		mFile = NULL;
+	}
+	mPacketCount = 0;
+}
+
+BOOL LLPacketCapture::writePacket(const LLHost& sender, const char* datap, S32 size)
+{
+	if (!mFile || !mWriting || size <= 0 || size > NET_BUFFER_SIZE)
+	{
+		return FALSE;
+	}
+
+	U8 header[CAPTURE_RECORD_HEADER_SIZE];		/* Flawfinder: ignore */
+	put_u32(header, (U32)(totalTime() - mStartTime));
+	put_u32(header + 4, sender.getAddress());
+	put_u16(header + 8, (U16)sender.getPort());
+	put_u16(header + 10, (U16)size);
+
+	if (fwrite(header, 1, CAPTURE_RECORD_HEADER_SIZE, mFile) != (size_t)CAPTURE_RECORD_HEADER_SIZE
+		|| fwrite(datap, 1, size, mFile) != (size_t)size)
+	{
+		llwarns << "Packet capture write failed, closing capture after "
+			<< mPacketCount << " packets" << llendl;
+		close();
+		return FALSE;
+	}
+	mPacketCount++;
+	return TRUE;
+}
+
+S32 LLPacketCapture::readPacket(LLHost& sender, char* datap, U32* time_usec)
+{
+	if (!mFile || mWriting)
+	{
+		return -1;
+	}
+
+	U8 header[CAPTURE_RECORD_HEADER_SIZE];		/* Flawfinder: ignore */
+	size_t got = fread(header, 1, CAPTURE_RECORD_HEADER_SIZE, mFile);
+	if (got == 0)
+	{
+		return 0;
+	}
+	if (got != (size_t)CAPTURE_RECORD_HEADER_SIZE)
+	{
+		llwarns << "Truncated packet capture record after " << mPacketCount << " packets" << llendl;
+		return -1;
+	}
+
+	S32 size = get_u16(header + 10);
+	if (size <= 0 || size > NET_BUFFER_SIZE)
+	{
+		llwarns << "Bad packet size " << size << " in capture record " << mPacketCount << llendl;
+		return -1;
+	}
+	if (fread(datap, 1, size, mFile) != (size_t)size)
+	{
+		llwarns << "Truncated packet capture record after " << mPacketCount << " packets" << llendl;
+		return -1;
+	}
+
+	if (time_usec)
+	{
+		*time_usec = get_u32(header);
+	}
+	sender.set(get_u32(header + 4), get_u16(header + 8));
+	mPacketCount++;
+	return size;
+}
@@ -0,0 +1,77 @@
+/** 
+ * @file llpacketcapture.h
+ * @brief On-disk recording of received UDP payloads for offline replay.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPACKETCAPTURE_H
+#define LL_LLPACKETCAPTURE_H
+
+#include "llfile.h"
+#include "llhost.h"
+
+// Sequential reader/writer for packet capture files.
+//
+// A capture is an 8 byte magic followed by one record per packet:
+//   U32	microseconds since the capture was started
+//   U32	sender IP, as stored in LLHost
+//   U16	sender port
+//   U16	payload size (at most NET_BUFFER_SIZE)
+//   U8[]	payload, exactly as it came off the socket
+// All integers are little-endian.  Payloads are stored before zero
+// code expansion and ack stripping so that a replay exercises the
+// whole receive path.
+class LLPacketCapture
+{
+public:
+	LLPacketCapture();
+	~LLPacketCapture();
+
+	BOOL openForWrite(const std::string& filename);
+	BOOL openForRead(const std::string& filename);
+	void close();
+
+	BOOL isOpen() const						{ return mFile != NULL; }
+	S32 getPacketCount() const				{ return mPacketCount; }
+
+	BOOL writePacket(const LLHost& sender, const char* datap, S32 size);
+
+	// Reads the next record into datap, which must hold NET_BUFFER_SIZE
+	// bytes.  Returns the payload size, 0 at end of file or -1 if the
+	// record is truncated or malformed.
+	S32 readPacket(LLHost& sender, char* datap, U32* time_usec = NULL);
+
+private:
+	LLFILE*	mFile;
+	BOOL	mWriting;
+	U64		mStartTime;
+	S32		mPacketCount;
+};
+
+#endif // LL_LLPACKETCAPTURE_H
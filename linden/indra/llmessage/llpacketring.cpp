@@ -53,7 +53,8 @@ LLPacketRing::LLPacketRing () :
 	mInBufferLength(0),
 	mOutBufferLength(0),
 	mDropPercentage(0.0f),
-	mPacketsToDrop(0x0)
+	mPacketsToDrop(0x0),
+	mReplayMode(FALSE)
 {
 }
 
@@ -81,6 +82,15 @@ void LLPacketRing::cleanup ()
 		delete packetp;
 		mSendQueue.pop();
 	}
+
+	while (!mReplayQueue.empty())
+	{
+		packetp = mReplayQueue.front();
+		delete packetp;
+		mReplayQueue.pop();
+	}
+
+	mCapture.close();
 }
 
 ///////////////////////////////////////////////////////////
@@ -151,13 +161,70 @@ S32 LLPacketRing::receiveFromRing (S32 socket, char *datap)
 	return packet_size;
 }
 
+///////////////////////////////////////////////////////////
+BOOL LLPacketRing::startCapture(const std::string& filename)
+{
+	if (!mCapture.openForWrite(filename))
+	{
+		return FALSE;
+	}
+	llinfos << "Capturing received packets to " << filename << llendl;
+	return TRUE;
+}
+
+void LLPacketRing::stopCapture()
+{
+	if (mCapture.isOpen())
+	{
+		llinfos << "Packet capture stopped after " << mCapture.getPacketCount() << " packets" << llendl;
+		mCapture.close();
+	}
+}
+
+///////////////////////////////////////////////////////////
+void LLPacketRing::setReplayMode(const BOOL replay)
+{
+	mReplayMode = replay;
+}
+
+void LLPacketRing::injectPacket(const LLHost& sender, const char* datap, S32 size)
+{
+	LLPacketBuffer* packetp = new LLPacketBuffer(sender, datap, size);
+	mReplayQueue.push(packetp);
+}
+
+S32 LLPacketRing::receiveFromReplay(char *datap)
+{
+	if (mReplayQueue.empty())
+	{
+		return 0;
+	}
+
+	LLPacketBuffer* packetp = mReplayQueue.front();
+	mReplayQueue.pop();
+
+	S32 packet_size = packetp->getSize();
+	memcpy(datap, packetp->getData(), packet_size);	/*Flawfinder: ignore*/
+	mLastSender = packetp->getHost();
+	mLastReceivingIF = packetp->getReceivingInterface();
+	delete packetp;
+
+	mActualBitsIn += packet_size * 8;
+	return packet_size;
+}
+
 ///////////////////////////////////////////////////////////
 S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 {
 	S32 packet_size = 0;
 
+	if (mReplayMode)
+	{
+		// The replay queue stands in for the socket.
+		packet_size = receiveFromReplay(datap);
+	}
 	// If using the throttle, simulate a limited size input buffer.
-	if (mUseInThrottle)
+	else if (mUseInThrottle)
 	{
 		BOOL done = FALSE;
 
@@ -241,13 +308,25 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 		}
 	}
 
+	if (packet_size > 0 && mCapture.isOpen())
+	{
+		mCapture.writePacket(mLastSender, datap, packet_size);
+	}
+
 	return packet_size;
 }
 
 BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host)
 {
 	BOOL status = TRUE;
-	if (!mUseOutThrottle)
+	if (mReplayMode)
+	{
+		// Nothing is listening on the other end of a replay, so outgoing
+		// traffic (acks, pings) is only counted.
+		mActualBitsOut += buf_size * 8;
+		return TRUE;
+	}
+	else if (!mUseOutThrottle)
 	{
 		return send_packet(h_socket, send_buffer, buf_size, host.getAddress(), host.getPort() );
 	}
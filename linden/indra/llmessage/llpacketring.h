@@ -37,6 +37,7 @@
 #include <queue>
 
 #include "llpacketbuffer.h"
+#include "llpacketcapture.h"
 #include "llhost.h"
 #include "net.h"
 #include "llthrottle.h"
@@ -61,6 +62,19 @@ public:
 
 	BOOL sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host);
 
+	// Appends every packet returned by receivePacket() to a capture file.
+	BOOL startCapture(const std::string& filename);
+	void stopCapture();
+	BOOL isCapturing() const					{ return mCapture.isOpen(); }
+
+	// In replay mode receivePacket() only returns packets queued with
+	// injectPacket() and sendPacket() discards everything, so recorded
+	// traffic can be pushed through the message system without a network.
+	void setReplayMode(const BOOL replay);
+	BOOL getReplayMode() const					{ return mReplayMode; }
+	void injectPacket(const LLHost& sender, const char* datap, S32 size);
+	S32  getReplayQueueSize() const				{ return (S32)mReplayQueue.size(); }
+
 	inline LLHost getLastSender();
 	inline LLHost getLastReceivingInterface();
 
@@ -88,6 +102,12 @@ protected:
 
 	LLHost mLastSender;
 	LLHost mLastReceivingIF;
+
+	BOOL mReplayMode;
+	std::queue<LLPacketBuffer *> mReplayQueue;
+	LLPacketCapture mCapture;
+
+	S32 receiveFromReplay(char *datap);
 };
 
 
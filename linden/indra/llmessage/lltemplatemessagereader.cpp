@@ -47,16 +47,19 @@ LLTemplateMessageReader::LLTemplateMessageReader(message_template_number_map_t&
 												 number_template_map) :
 	mReceiveSize(0),
 	mCurrentRMessageTemplate(NULL),
-	mCurrentRMessageData(NULL),
+	mCurrentRMessageDecoded(false),
 	mMessageNumbers(number_template_map)
 {
+	// enough for any packet plus a little zero fill, so the tables
+	// rarely have to grow once the reader is running
+	mDecodeBuffer.reserve(MAX_BUFFER_SIZE);
+	mBlkSlots.reserve(16);
+	mVarSlots.reserve(256);
 }
 
 //virtual 
 LLTemplateMessageReader::~LLTemplateMessageReader()
 {
-	delete mCurrentRMessageData;
-	mCurrentRMessageData = NULL;
 }
 
 //virtual
@@ -64,8 +67,44 @@ void LLTemplateMessageReader::clearMessage()
 {
 	mReceiveSize = -1;
 	mCurrentRMessageTemplate = NULL;
-	delete mCurrentRMessageData;
-	mCurrentRMessageData = NULL;
+	mCurrentRMessageDecoded = false;
+}
+
+S32 LLTemplateMessageReader::findVarSlot(const char* blockname, S32 blocknum,
+										 const char* varname,
+										 const LLMessageVariable** varp) const
+{
+	const LLMessageTemplate::message_block_map_t& blocks =
+		mCurrentRMessageTemplate->mMemberBlocks;
+	LLMessageTemplate::message_block_map_t::const_iterator block_iter =
+		blocks.find((char*)blockname);
+	if (block_iter == blocks.end())
+	{
+		return LL_BLOCK_NOT_IN_MESSAGE;
+	}
+
+	const LLMsgBlkSlot& block_slot = mBlkSlots[block_iter - blocks.begin()];
+	if ((blocknum < 0) || (blocknum >= block_slot.mRepeat))
+	{
+		return LL_BLOCK_NOT_IN_MESSAGE;
+	}
+
+	const LLMessageBlock::message_variable_map_t& variables =
+		(*block_iter)->mMemberVariables;
+	LLMessageBlock::message_variable_map_t::const_iterator var_iter =
+		variables.find(varname);
+	if (var_iter == variables.end())
+	{
+		return LL_VARIABLE_NOT_IN_BLOCK;
+	}
+
+	if (varp)
+	{
+		*varp = *var_iter;
+	}
+	return block_slot.mFirstVar
+		+ blocknum * (S32)variables.size()
+		+ (S32)(var_iter - variables.begin());
 }
 
 void LLTemplateMessageReader::getData(const char *blockname, const char *varname, void *datap, S32 size, S32 blocknum, S32 max_size)
@@ -77,77 +116,55 @@ void LLTemplateMessageReader::getData(const char *blockname, const char *varname
 		return;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{
 		llerrs << "Invalid mCurrentMessageData in getData!" << llendl;
 		return;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; // this works because it's just a hash.  The bnamep is never derefference
-	char *vnamep = (char *)varname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
+	const LLMessageVariable* varp = NULL;
+	S32 slot = findVarSlot(blockname, blocknum, varname, &varp);
 
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	if (slot == LL_BLOCK_NOT_IN_MESSAGE)
 	{
 		llerrs << "Block " << blockname << " #" << blocknum
-			<< " not in message " << mCurrentRMessageData->mName << llendl;
+			<< " not in message " << mCurrentRMessageTemplate->mName << llendl;
 		return;
 	}
 
-	LLMsgBlkData *msg_block_data = iter->second;
-	LLMsgVarData& vardata = msg_block_data->mMemberVarData[vnamep];
-
-	if (!vardata.getName())
+	if (slot == LL_VARIABLE_NOT_IN_BLOCK)
 	{
-		llerrs << "Variable "<< vnamep << " not in message "
-			<< mCurrentRMessageData->mName<< " block " << bnamep << llendl;
+		llerrs << "Variable "<< varname << " not in message "
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return;
 	}
 
-	if (size && size != vardata.getSize())
+	const LLMsgVarSlot& vardata = mVarSlots[slot];
+
+	if (size && size != vardata.mSize)
 	{
-		llerrs << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llerrs << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << varname
+			<< " is size " << vardata.mSize
 			<< " but copying into buffer of size " << size
 			<< llendl;
 		return;
 	}
 
-
-	const S32 vardata_size = vardata.getSize();
-	if( max_size >= vardata_size )
+	const U8* src = &mDecodeBuffer[0] + vardata.mOffset;
+	if( max_size >= vardata.mSize )
 	{   
-		switch( vardata_size )
-		{ 
-		case 1:
-			*((U8*)datap) = *((U8*)vardata.getData());
-			break;
-		case 2:
-			*((U16*)datap) = *((U16*)vardata.getData());
-			break;
-		case 4:
-			*((U32*)datap) = *((U32*)vardata.getData());
-			break;
-		case 8:
-			((U32*)datap)[0] = ((U32*)vardata.getData())[0];
-			((U32*)datap)[1] = ((U32*)vardata.getData())[1];
-			break;
-		default:
-			memcpy(datap, vardata.getData(), vardata_size);
-			break;
-		}
+		htonmemcpy(datap, src, varp->getType(), vardata.mSize);
 	}
 	else
 	{
-		llwarns << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llwarns << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << varname
+			<< " is size " << vardata.mSize
 			<< " but truncated to max size of " << max_size
 			<< llendl;
 
-		memcpy(datap, vardata.getData(), max_size);
+		memcpy(datap, src, max_size);
 	}
 }
 
@@ -160,22 +177,23 @@ S32 LLTemplateMessageReader::getNumberOfBlocks(const char *blockname)
 		return -1;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{
 		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
 		return -1;
 	}
 
-	char *bnamep = (char *)blockname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
+	const LLMessageTemplate::message_block_map_t& blocks =
+		mCurrentRMessageTemplate->mMemberBlocks;
+	LLMessageTemplate::message_block_map_t::const_iterator iter =
+		blocks.find((char *)blockname);
 	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	if (iter == blocks.end())
 	{
 		return 0;
 	}
 
-	return (iter->second)->mBlockNumber;
+	return mBlkSlots[iter - blocks.begin()].mRepeat;
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
@@ -187,43 +205,36 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{	// This is a serious error - crash
 		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname; 
+	S32 slot = findVarSlot(blockname, 0, varname);
 
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	if (slot == LL_BLOCK_NOT_IN_MESSAGE)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message "
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " not in message "
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
 
-	char *vnamep = (char *)varname; 
-
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	if (slot == LL_VARIABLE_NOT_IN_BLOCK)
 	{	// don't crash
 		llinfos << "Variable " << varname << " not in message "
-			<< mCurrentRMessageData->mName << " block " << bnamep << llendl;
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	if (mCurrentRMessageTemplate->mMemberBlocks[bnamep]->mType != MBT_SINGLE)
+	if (mCurrentRMessageTemplate->mMemberBlocks[(char *)blockname]->mType != MBT_SINGLE)
 	{	// This is a serious error - crash
-		llerrs << "Block " << bnamep << " isn't type MBT_SINGLE,"
+		llerrs << "Block " << blockname << " isn't type MBT_SINGLE,"
 			" use getSize with blocknum argument!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	return vardata.getSize();
+	return mVarSlots[slot].mSize;
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const char *varname)
@@ -235,35 +246,29 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mCurrentRMessageDecoded)
 	{	// This is a serious error - crash
 		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; 
-	char *vnamep = (char *)varname; 
+	S32 slot = findVarSlot(blockname, blocknum, varname);
 
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	if (slot == LL_BLOCK_NOT_IN_MESSAGE)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message " 
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " not in message " 
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
 
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	if (slot == LL_VARIABLE_NOT_IN_BLOCK)
 	{	// don't crash
-		llinfos << "Variable " << vnamep << " not in message "
-			<<  mCurrentRMessageData->mName << " block " << bnamep << llendl;
+		llinfos << "Variable " << varname << " not in message "
+			<<  mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	return vardata.getSize();
+	return mVarSlots[slot].mSize;
 }
 
 void LLTemplateMessageReader::getBinaryData(const char *blockname, 
@@ -536,18 +541,22 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 {
 	llassert( mReceiveSize >= 0 );
 	llassert( mCurrentRMessageTemplate);
-	llassert( !mCurrentRMessageData );
-	delete mCurrentRMessageData; // just to make sure
+	llassert( !mCurrentRMessageDecoded );
 
 	// The offset tells us how may bytes to skip after the end of the
 	// message name.
 	U8 offset = buffer[PHL_OFFSET];
 	S32 decode_pos = LL_PACKET_ID_SIZE + (S32)(mCurrentRMessageTemplate->mFrequency) + offset;
 
-	// create base working data set
-	mCurrentRMessageData = new LLMsgData(mCurrentRMessageTemplate->mName);
-	
-	// loop through the template building the data structure as we go
+	// Take our own copy of the packet so the message stays readable
+	// after the receive buffer is reused. Variables that run off the
+	// end of the packet get zero filled space appended after it.
+	mDecodeBuffer.assign(buffer, buffer + mReceiveSize);
+	mBlkSlots.resize(0);
+	mVarSlots.resize(0);
+	bool has_blocks = false;
+
+	// loop through the template building the slot tables as we go
 	LLMessageTemplate::message_block_map_t::const_iterator iter;
 	for(iter = mCurrentRMessageTemplate->mMemberBlocks.begin();
 		iter != mCurrentRMessageTemplate->mMemberBlocks.end();
@@ -594,36 +603,22 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 			return FALSE;
 		}
 
-		LLMsgBlkData* cur_data_block = NULL;
+		LLMsgBlkSlot block_slot;
+		block_slot.mRepeat = repeat_number;
+		block_slot.mFirstVar = (S32)mVarSlots.size();
+		mBlkSlots.push_back(block_slot);
+		has_blocks = has_blocks || (repeat_number > 0);
 
 		// now loop through the block
 		for (i = 0; i < repeat_number; i++)
 		{
-			if (i)
-			{
-				// build new name to prevent collisions
-				// TODO: This should really change to a vector
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
-				cur_data_block->mName = mbci->mName + i;
-			}
-			else
-			{
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
-			}
-
-			// add the block to the message
-			mCurrentRMessageData->addBlock(cur_data_block);
-
 			// now read the variables
 			for (LLMessageBlock::message_variable_map_t::const_iterator iter = 
 					 mbci->mMemberVariables.begin();
 				 iter != mbci->mMemberVariables.end(); iter++)
 			{
 				const LLMessageVariable& mvci = **iter;
-
-				// ok, build out the variables
-				// add variable block
-				cur_data_block->addVariable(mvci.getName(), mvci.getType());
+				LLMsgVarSlot var_slot;
 
 				// what type of variable?
 				if (mvci.getType() == MVT_VARIABLE)
@@ -663,44 +658,51 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 					}
 					decode_pos += data_size;
 
-					cur_data_block->addData(mvci.getName(), &buffer[decode_pos], tsize, mvci.getType());
+					var_slot.mOffset = llmin(decode_pos, mReceiveSize);
+					var_slot.mSize = (S32)tsize;
+					if (var_slot.mSize
+						&& ((decode_pos + var_slot.mSize) > mReceiveSize))
+					{
+						logRanOffEndOfPacket(sender, decode_pos, var_slot.mSize);
+
+						// keep whatever part of the field is present
+						var_slot.mSize = llmax(0, mReceiveSize - decode_pos);
+					}
 					decode_pos += tsize;
 				}
 				else
 				{
 					// fixed!
-					// so, copy data pointer and set data size to fixed size
-					if ((decode_pos + mvci.getSize()) > mReceiveSize)
+					// so, point at the data and set data size to fixed size
+					var_slot.mSize = mvci.getSize();
+					if ((decode_pos + var_slot.mSize) > mReceiveSize)
 					{
-						logRanOffEndOfPacket(sender, decode_pos, mvci.getSize());
+						logRanOffEndOfPacket(sender, decode_pos, var_slot.mSize);
 
 						// default to 0s.
-						U32 size = mvci.getSize();
-						std::vector<U8> data(size);
-						memset(&(data[0]), 0, size);
-						cur_data_block->addData(mvci.getName(), &(data[0]), 
-												size, mvci.getType());
+						var_slot.mOffset = (S32)mDecodeBuffer.size();
+						mDecodeBuffer.resize(var_slot.mOffset + var_slot.mSize, 0);
 					}
 					else
 					{
-						cur_data_block->addData(mvci.getName(), 
-												&buffer[decode_pos], 
-												mvci.getSize(), 
-												mvci.getType());
+						var_slot.mOffset = decode_pos;
 					}
-					decode_pos += mvci.getSize();
+					decode_pos += var_slot.mSize;
 				}
+				mVarSlots.push_back(var_slot);
 			}
 		}
 	}
 
-	if (mCurrentRMessageData->mMemberBlocks.empty()
+	if (!has_blocks
 		&& !mCurrentRMessageTemplate->mMemberBlocks.empty())
 	{
 		lldebugs << "Empty message '" << mCurrentRMessageTemplate->mName << "' (no blocks)" << llendl;
 		return FALSE;
 	}
 
+	mCurrentRMessageDecoded = true;
+
 	{
 		static LLTimer decode_timer;
 
@@ -822,12 +824,233 @@ bool LLTemplateMessageReader::isUdpBanned() const
 	return mCurrentRMessageTemplate->isUdpBanned();
 }
 
+bool LLTemplateMessageReader::resolveVariable(const char* blockname,
+											  const char* varname,
+											  LLMsgVariableHandle& handle) const
+{
+	if (!mCurrentRMessageTemplate)
+	{
+		return false;
+	}
+	if (handle.mTemplate == mCurrentRMessageTemplate)
+	{
+		return true;
+	}
+
+	const LLMessageTemplate::message_block_map_t& blocks =
+		mCurrentRMessageTemplate->mMemberBlocks;
+	LLMessageTemplate::message_block_map_t::const_iterator block_iter =
+		blocks.find((char*)blockname);
+	if (block_iter == blocks.end())
+	{
+		return false;
+	}
+
+	const LLMessageBlock::message_variable_map_t& variables =
+		(*block_iter)->mMemberVariables;
+	LLMessageBlock::message_variable_map_t::const_iterator var_iter =
+		variables.find(varname);
+	if (var_iter == variables.end())
+	{
+		return false;
+	}
+
+	handle.mTemplate = mCurrentRMessageTemplate;
+	handle.mBlockIndex = (S32)(block_iter - blocks.begin());
+	handle.mVarIndex = (S32)(var_iter - variables.begin());
+	handle.mNumVars = (S32)variables.size();
+	handle.mSize = (*var_iter)->getSize();
+	handle.mType = (*var_iter)->getType();
+	return true;
+}
+
+const U8* LLTemplateMessageReader::getDataPtr(const LLMsgVariableHandle& handle,
+											  S32 blocknum, S32* size) const
+{
+	if (!mCurrentRMessageDecoded
+		|| (handle.mTemplate != mCurrentRMessageTemplate))
+	{
+		llerrs << "Variable handle not resolved for message "
+			<< getMessageName() << llendl;
+		return NULL;
+	}
+
+	const LLMsgBlkSlot& block_slot = mBlkSlots[handle.mBlockIndex];
+	if ((blocknum < 0) || (blocknum >= block_slot.mRepeat))
+	{
+		return NULL;
+	}
+
+	const LLMsgVarSlot& var_slot = mVarSlots[block_slot.mFirstVar
+											 + blocknum * handle.mNumVars
+											 + handle.mVarIndex];
+	if (size)
+	{
+		*size = var_slot.mSize;
+	}
+	return &mDecodeBuffer[0] + var_slot.mOffset;
+}
+
+S32 LLTemplateMessageReader::getSize(const LLMsgVariableHandle& handle,
+									 S32 blocknum) const
+{
+	S32 size = 0;
+	if (!getDataPtr(handle, blocknum, &size))
+	{
+		return LL_BLOCK_NOT_IN_MESSAGE;
+	}
+	return size;
+}
+
+void LLTemplateMessageReader::getData(const LLMsgVariableHandle& handle,
+									  void* datap, S32 size, 
+									  S32 blocknum) const
+{
+	S32 data_size = 0;
+	const U8* src = getDataPtr(handle, blocknum, &data_size);
+	if (!src)
+	{
+		llerrs << "Block #" << blocknum << " not in message "
+			<< getMessageName() << llendl;
+		return;
+	}
+	if (size != data_size)
+	{
+		llerrs << "Msg " << getMessageName()
+			<< " variable is size " << data_size
+			<< " but copying into buffer of size " << size
+			<< llendl;
+		return;
+	}
+	htonmemcpy(datap, src, handle.mType, size);
+}
+
+void LLTemplateMessageReader::getU8(const LLMsgVariableHandle& handle, 
+									U8& u, S32 blocknum) const
+{
+	getData(handle, &u, sizeof(U8), blocknum);
+}
+
+void LLTemplateMessageReader::getU16(const LLMsgVariableHandle& handle, 
+									 U16& u, S32 blocknum) const
+{
+	getData(handle, &u, sizeof(U16), blocknum);
+}
+
+void LLTemplateMessageReader::getU32(const LLMsgVariableHandle& handle, 
+									 U32& u, S32 blocknum) const
+{
+	getData(handle, &u, sizeof(U32), blocknum);
+}
+
+void LLTemplateMessageReader::getS32(const LLMsgVariableHandle& handle, 
+									 S32& s, S32 blocknum) const
+{
+	getData(handle, &s, sizeof(S32), blocknum);
+}
+
+void LLTemplateMessageReader::getU64(const LLMsgVariableHandle& handle, 
+									 U64& u, S32 blocknum) const
+{
+	getData(handle, &u, sizeof(U64), blocknum);
+}
+
+void LLTemplateMessageReader::getF32(const LLMsgVariableHandle& handle, 
+									 F32& f, S32 blocknum) const
+{
+	getData(handle, &f, sizeof(F32), blocknum);
+
+	if( !llfinite( f ) )
+	{
+		llwarns << "non-finite in getF32 " << getMessageName() << llendl;
+		f = 0;
+	}
+}
+
+void LLTemplateMessageReader::getVector3(const LLMsgVariableHandle& handle, 
+										 LLVector3& v, S32 blocknum) const
+{
+	getData(handle, &v.mV[0], sizeof(v.mV), blocknum);
+
+	if( !v.isFinite() )
+	{
+		llwarns << "non-finite in getVector3 " << getMessageName() << llendl;
+		v.zeroVec();
+	}
+}
+
+void LLTemplateMessageReader::getUUID(const LLMsgVariableHandle& handle, 
+									  LLUUID& uuid, S32 blocknum) const
+{
+	getData(handle, &uuid.mData[0], sizeof(uuid.mData), blocknum);
+}
+
+void LLTemplateMessageReader::getString(const LLMsgVariableHandle& handle, 
+										std::string& outstr, S32 blocknum) const
+{
+	// same limit as the name based getString()
+	S32 size = 0;
+	const char* src = (const char*)getDataPtr(handle, blocknum, &size);
+	if (!src)
+	{
+		outstr.clear();
+		return;
+	}
+	size = llmin(size, MTUBYTES - 1);
+	S32 length = 0;
+	while (length < size && src[length])
+	{
+		++length;
+	}
+	outstr.assign(src, length);
+}
+
+void LLTemplateMessageReader::getBinaryData(const LLMsgVariableHandle& handle, 
+											void* datap, S32 size, S32 blocknum) const
+{
+	getData(handle, datap, size, blocknum);
+}
+
 //virtual 
 void LLTemplateMessageReader::copyToBuilder(LLMessageBuilder& builder) const
 {
-	if(NULL == mCurrentRMessageTemplate)
+	if(NULL == mCurrentRMessageTemplate || !mCurrentRMessageDecoded)
     {
         return;
     }
-	builder.copyFromMessageData(*mCurrentRMessageData);
+
+	// Builders consume an LLMsgData tree, so build one from the slot
+	// tables. Only forwarded or wrapped messages come through here.
+	LLMsgData message_data(mCurrentRMessageTemplate->mName);
+	S32 block_index = 0;
+	LLMessageTemplate::message_block_map_t::const_iterator iter;
+	for(iter = mCurrentRMessageTemplate->mMemberBlocks.begin();
+		iter != mCurrentRMessageTemplate->mMemberBlocks.end();
+		++iter, ++block_index)
+	{
+		const LLMessageBlock* mbci = *iter;
+		const LLMsgBlkSlot& block_slot = mBlkSlots[block_index];
+		S32 slot = block_slot.mFirstVar;
+		for (S32 i = 0; i < block_slot.mRepeat; i++)
+		{
+			// repeats are keyed by offsetting the name pointer, see getData
+			LLMsgBlkData* block_data = new LLMsgBlkData(mbci->mName, block_slot.mRepeat);
+			block_data->mName = mbci->mName + i;
+			message_data.addBlock(block_data);
+
+			for (LLMessageBlock::message_variable_map_t::const_iterator var_iter =
+					 mbci->mMemberVariables.begin();
+				 var_iter != mbci->mMemberVariables.end(); ++var_iter)
+			{
+				const LLMessageVariable& mvci = **var_iter;
+				const LLMsgVarSlot& var_slot = mVarSlots[slot++];
+				block_data->addVariable(mvci.getName(), mvci.getType());
+				block_data->addData(mvci.getName(),
+									&mDecodeBuffer[0] + var_slot.mOffset,
+									var_slot.mSize,
+									mvci.getType());
+			}
+		}
+	}
+	builder.copyFromMessageData(message_data);
 }
@@ -34,11 +34,47 @@
 #define LL_LLTEMPLATEMESSAGEREADER_H
 
 #include "llmessagereader.h"
+#include "llmsgvariabletype.h"
 
 #include <map>
+#include <vector>
 
 class LLMessageTemplate;
-class LLMsgData;
+class LLMessageVariable;
+
+// A (block, variable) pair of one message template, resolved to
+// indices so that reads through it skip the name lookups done by the
+// get* methods. Keep handles around (a static per call site is fine)
+// and resolve them once per message with
+// LLTemplateMessageReader::resolveVariable(), which is a no-op when
+// the handle already matches the current message's template.
+class LLMsgVariableHandle
+{
+public:
+	LLMsgVariableHandle() :
+		mTemplate(NULL),
+		mBlockIndex(-1),
+		mVarIndex(-1),
+		mNumVars(0),
+		mSize(-1),
+		mType(MVT_NULL)
+	{
+	}
+
+	bool isResolved() const { return mTemplate != NULL; }
+	S32 getSize() const { return mSize; }	// template size, see LLMessageVariable
+	EMsgVariableType getType() const { return mType; }
+
+private:
+	friend class LLTemplateMessageReader;
+
+	const LLMessageTemplate* mTemplate;
+	S32 mBlockIndex;
+	S32 mVarIndex;
+	S32 mNumVars;
+	S32 mSize;
+	EMsgVariableType mType;
+};
 
 class LLTemplateMessageReader : public LLMessageReader
 {
@@ -111,9 +147,39 @@ public:
 	bool isTrusted() const;
 	bool isBanned(bool trusted_source) const;
 	bool isUdpBanned() const;
+
+	// Handle based access, see LLMsgVariableHandle. Returns false if
+	// the current message's template has no such block or variable.
+	bool resolveVariable(const char* blockname, const char* varname,
+						 LLMsgVariableHandle& handle) const;
+
+	// Returns a pointer to the decoded data of handle in repeat
+	// blocknum without copying it, or NULL if the message holds fewer
+	// repeats. Data is in network order, and the pointer is valid until
+	// the next message is read.
+	const U8* getDataPtr(const LLMsgVariableHandle& handle, S32 blocknum = 0, 
+						 S32* size = NULL) const;
+	// size in bytes of handle's data in repeat blocknum, or
+	// LL_BLOCK_NOT_IN_MESSAGE
+	S32 getSize(const LLMsgVariableHandle& handle, S32 blocknum = 0) const;
+
+	void getU8(const LLMsgVariableHandle& handle, U8& u, S32 blocknum = 0) const;
+	void getU16(const LLMsgVariableHandle& handle, U16& u, S32 blocknum = 0) const;
+	void getU32(const LLMsgVariableHandle& handle, U32& u, S32 blocknum = 0) const;
+	void getS32(const LLMsgVariableHandle& handle, S32& s, S32 blocknum = 0) const;
+	void getU64(const LLMsgVariableHandle& handle, U64& u, S32 blocknum = 0) const;
+	void getF32(const LLMsgVariableHandle& handle, F32& f, S32 blocknum = 0) const;
+	void getVector3(const LLMsgVariableHandle& handle, LLVector3& v, S32 blocknum = 0) const;
+	void getUUID(const LLMsgVariableHandle& handle, LLUUID& uuid, S32 blocknum = 0) const;
+	void getString(const LLMsgVariableHandle& handle, std::string& outstr, S32 blocknum = 0) const;
+	void getBinaryData(const LLMsgVariableHandle& handle, void* datap, S32 size,
+					   S32 blocknum = 0) const;
 	
 private:
 
+	void getData(const LLMsgVariableHandle& handle, void* datap, S32 size,
+				 S32 blocknum) const;
+
 	void getData(const char *blockname, const char *varname, void *datap, 
 				 S32 size = 0, S32 blocknum = 0, S32 max_size = S32_MAX);
 
@@ -124,9 +190,36 @@ private:
 
 	BOOL decodeData(const U8* buffer, const LLHost& sender );
 
+	// Returns the index of the variable slot for the given block
+	// repeat and variable, or LL_BLOCK_NOT_IN_MESSAGE /
+	// LL_VARIABLE_NOT_IN_BLOCK.
+	S32 findVarSlot(const char* blockname, S32 blocknum, 
+					const char* varname, 
+					const LLMessageVariable** varp = NULL) const;
+
+	// The decoded message is not built as a tree of LLMsgData
+	// objects. Instead the packet is copied once into mDecodeBuffer
+	// and described by flat tables indexed in template order. The
+	// vectors keep their capacity between messages, so steady state
+	// decoding does no heap allocation.
+	struct LLMsgVarSlot
+	{
+		S32 mOffset;	// into mDecodeBuffer
+		S32 mSize;
+	};
+
+	struct LLMsgBlkSlot
+	{
+		S32 mRepeat;	// number of copies of the block in this message
+		S32 mFirstVar;	// index into mVarSlots of repeat 0, variable 0
+	};
+
 	S32	mReceiveSize;
 	LLMessageTemplate* mCurrentRMessageTemplate;
-	LLMsgData* mCurrentRMessageData;
+	bool mCurrentRMessageDecoded;
+	std::vector<U8> mDecodeBuffer;
+	std::vector<LLMsgBlkSlot> mBlkSlots;
+	std::vector<LLMsgVarSlot> mVarSlots;
 	message_template_number_map_t& mMessageNumbers;
 };
 
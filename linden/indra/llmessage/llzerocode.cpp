@@ -0,0 +1,274 @@
+/** 
+ * @file llzerocode.cpp
+ * @brief LLZeroCode class implementation.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llzerocode.h"
+
+#include "llsys.h"
+
+LLZeroCode::find_func_t LLZeroCode::sFindZero = &LLZeroCode::findZero;
+LLZeroCode::find_func_t LLZeroCode::sFindNonZero = &LLZeroCode::findNonZero;
+
+//static
+void LLZeroCode::initClass(const LLCPUInfo& cpu)
+{
+	setUseSSE2(cpu.hasSSE2());
+}
+
+//static
+void LLZeroCode::setUseSSE2(bool use_sse2)
+{
+	sFindZero = use_sse2 ? &findZeroSSE2 : &findZero;
+	sFindNonZero = use_sse2 ? &findNonZeroSSE2 : &findNonZero;
+}
+
+//static
+bool LLZeroCode::getUseSSE2()
+{
+	return sFindZero == &findZeroSSE2;
+}
+
+//static
+S32 LLZeroCode::findZero(const U8* in, S32 pos, S32 end)
+{
+	while ((pos < end) && in[pos])
+	{
+		++pos;
+	}
+	return pos;
+}
+
+//static
+S32 LLZeroCode::findNonZero(const U8* in, S32 pos, S32 end)
+{
+	while ((pos < end) && !in[pos])
+	{
+		++pos;
+	}
+	return pos;
+}
+
+//static
+S32 LLZeroCode::encode(const U8* in, S32 in_size, U8* out)
+{
+	const find_func_t find_zero = sFindZero;
+	const find_func_t find_non_zero = sFindNonZero;
+	S32 pos = 0;
+	S32 out_pos = 0;
+	while (pos < in_size)
+	{
+		S32 zero_pos = find_zero(in, pos, in_size);
+		memcpy(out + out_pos, in + pos, zero_pos - pos);	/* Flawfinder: ignore */
+		out_pos += zero_pos - pos;
+		if (zero_pos == in_size)
+		{
+			break;
+		}
+
+		pos = find_non_zero(in, zero_pos, in_size);
+		S32 run = pos - zero_pos;
+		while (run >= 255)
+		{
+			out[out_pos++] = 0;
+			out[out_pos++] = 255;
+			run -= 255;
+		}
+		if (run)
+		{
+			out[out_pos++] = 0;
+			out[out_pos++] = (U8)run;
+		}
+	}
+	return out_pos;
+}
+
+//static
+S32 LLZeroCode::encodedSize(const U8* in, S32 in_size)
+{
+	const find_func_t find_zero = sFindZero;
+	const find_func_t find_non_zero = sFindNonZero;
+	S32 pos = 0;
+	S32 size = 0;
+	while (pos < in_size)
+	{
+		S32 zero_pos = find_zero(in, pos, in_size);
+		size += zero_pos - pos;
+		if (zero_pos == in_size)
+		{
+			break;
+		}
+
+		pos = find_non_zero(in, zero_pos, in_size);
+		size += 2 * ((pos - zero_pos + 254) / 255);
+	}
+	return size;
+}
+
+//static
+S32 LLZeroCode::encodeScalar(const U8* in, S32 in_size, U8* out)
+{
+	S32 count = in_size;
+	U8 num_zeroes = 0;
+	const U8* inptr = in;
+	U8* outptr = out;
+
+	while (count-- > 0)
+	{
+		if (!(*inptr))   // in a zero count
+		{
+			if (num_zeroes)
+			{
+				if (++num_zeroes > 254)
+				{
+					*outptr++ = num_zeroes;
+					num_zeroes = 0;
+				}
+			}
+			else
+			{
+				*outptr++ = 0;
+				num_zeroes = 1;
+			}
+			inptr++;
+		}
+		else
+		{
+			if (num_zeroes)
+			{
+				*outptr++ = num_zeroes;
+				num_zeroes = 0;
+			}
+			*outptr++ = *inptr++;
+		}
+	}
+
+	if (num_zeroes)
+	{
+		*outptr++ = num_zeroes;
+	}
+	return (S32)(outptr - out);
+}
+
+//static
+S32 LLZeroCode::expand(const U8* in, S32 in_size, U8* out, S32 out_size)
+{
+	const find_func_t find_zero = sFindZero;
+	S32 pos = 0;
+	S32 out_pos = 0;
+	while (pos < in_size)
+	{
+		// copy the literal run along with the zero that ends it
+		S32 zero_pos = find_zero(in, pos, in_size);
+		S32 length = zero_pos - pos + ((zero_pos < in_size) ? 1 : 0);
+		if (out_pos + length > out_size)
+		{
+			return -1;
+		}
+		memcpy(out + out_pos, in + pos, length);	/* Flawfinder: ignore */
+		out_pos += length;
+		pos += length;
+		if (zero_pos == in_size)
+		{
+			break;
+		}
+
+		// 0 0 continues the run with another 256 zeroes
+		while ((pos < in_size) && !in[pos])
+		{
+			if (out_pos + 1 > out_size - 256)
+			{
+				return -1;
+			}
+			memset(out + out_pos, 0, 256);
+			out_pos += 256;
+			pos++;
+		}
+		if (pos == in_size)
+		{
+			break;
+		}
+
+		// the count includes the zero already written
+		S32 count = in[pos++];
+		if (out_pos > out_size - count)
+		{
+			return -1;
+		}
+		memset(out + out_pos, 0, count - 1);
+		out_pos += count - 1;
+	}
+	return out_pos;
+}
+
+//static
+S32 LLZeroCode::expandScalar(const U8* in, S32 in_size, U8* out, S32 out_size)
+{
+	S32 count = in_size;
+	const U8* inptr = in;
+	U8* outptr = out;
+
+	while (count-- > 0)
+	{
+		if (outptr > (&out[out_size-1]))
+		{
+			return -1;
+		}
+		if (!((*outptr++ = *inptr++)))
+		{
+			while (((count--)) && (!(*inptr)))
+			{
+				if (outptr + 1 > (&out[out_size-256]))
+				{
+					return -1;
+				}
+				*outptr++ = *inptr++;
+				memset(outptr,0,255);
+				outptr += 255;
+			}
+
+			if (count < 0)
+			{
+				break;
+			}
+
+			if (outptr > (&out[out_size-(*inptr)]))
+			{
+				return -1;
+			}
+			memset(outptr,0,(*inptr) - 1);
+			outptr += ((*inptr) - 1);
+			inptr++;
+		}
+	}
+	return (S32)(outptr - out);
+}
@@ -0,0 +1,85 @@
+/** 
+ * @file llzerocode.h
+ * @brief Zero coding of message packet bodies.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLZEROCODE_H
+#define LL_LLZEROCODE_H
+
+#include "stdtypes.h"
+
+// Zero coding writes each run of zero bytes as 0 [U8 count]. Runs
+// longer than 255 are split, so 0 255 is followed by another 0 [count].
+//
+// The bulk versions scan for the next zero (or non-zero) byte and copy
+// the literal runs in between with memcpy. initClass() picks scanners
+// that test 16 bytes at a time with SSE2 when the CPU has it; until then
+// they test a byte at a time. The scalar versions are the original byte
+// at a time loops, kept as the reference the bulk versions must match
+// bit for bit.
+class LLCPUInfo;
+
+class LLZeroCode
+{
+public:
+	// Picks the run scanners for cpu.
+	static void initClass(const LLCPUInfo& cpu);
+	// Only pass true on CPUs with SSE2.
+	static void setUseSSE2(bool use_sse2);
+	static bool getUseSSE2();
+
+	// Encodes in_size bytes into out, which must have room for
+	// 2 * in_size bytes. Returns the encoded size.
+	static S32 encode(const U8* in, S32 in_size, U8* out);
+	static S32 encodeScalar(const U8* in, S32 in_size, U8* out);
+
+	// Returns what encode() would return, without writing anything.
+	static S32 encodedSize(const U8* in, S32 in_size);
+
+	// Expands in_size bytes into out. Returns the expanded size, or -1
+	// if the data would not fit in out_size bytes.
+	static S32 expand(const U8* in, S32 in_size, U8* out, S32 out_size);
+	static S32 expandScalar(const U8* in, S32 in_size, U8* out, S32 out_size);
+
+private:
+	// Return the position of the first zero (or non-zero) byte in
+	// [pos, end), or end.
+	typedef S32 (*find_func_t)(const U8* in, S32 pos, S32 end);
+	static S32 findZero(const U8* in, S32 pos, S32 end);
+	static S32 findNonZero(const U8* in, S32 pos, S32 end);
+	// llzerocode_sse2.cpp
+	static S32 findZeroSSE2(const U8* in, S32 pos, S32 end);
+	static S32 findNonZeroSSE2(const U8* in, S32 pos, S32 end);
+
+	static find_func_t sFindZero;
+	static find_func_t sFindNonZero;
+};
+
+#endif // LL_LLZEROCODE_H
@@ -0,0 +1,101 @@
+/** 
+ * @file llzerocode_sse2.cpp
+ * @brief SSE2 run scanners for LLZeroCode
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+// Visual Studio required settings for this file:
+// Precompiled Headers OFF
+// Code Generation: SSE2
+
+#include "linden_common.h"
+
+#include "llzerocode.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define LL_ZEROCODE_SSE2 1
+#include <emmintrin.h>
+#if LL_MSVC
+#include <intrin.h>
+#endif
+#else
+#define LL_ZEROCODE_SSE2 0
+#endif
+
+#if LL_ZEROCODE_SSE2
+// index of the lowest set bit, mask must be non-zero
+inline S32 lowest_bit(U32 mask)
+{
+#if LL_MSVC
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (S32)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+//static
+S32 LLZeroCode::findZeroSSE2(const U8* in, S32 pos, S32 end)
+{
+#if LL_ZEROCODE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	while (pos + 16 <= end)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(in + pos));
+		U32 mask = (U32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+		if (mask)
+		{
+			return pos + lowest_bit(mask);
+		}
+		pos += 16;
+	}
+#endif
+	return findZero(in, pos, end);
+}
+
+//static
+S32 LLZeroCode::findNonZeroSSE2(const U8* in, S32 pos, S32 end)
+{
+#if LL_ZEROCODE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	while (pos + 16 <= end)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(in + pos));
+		U32 mask = (U32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)) ^ 0xFFFF;
+		if (mask)
+		{
+			return pos + lowest_bit(mask);
+		}
+		pos += 16;
+	}
+#endif
+	return findNonZero(in, pos, end);
+}
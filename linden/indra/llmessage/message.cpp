@@ -76,9 +76,11 @@
 #include "llsdmessagereader.h"
 #include "llsdserialize.h"
 #include "llstring.h"
+#include "llsys.h"
 #include "lltransfermanager.h"
 #include "lluuid.h"
 #include "llxfermanager.h"
+#include "llzerocode.h"
 #include "timing.h"
 #include "llquaternion.h"
 #include "u64.h"
@@ -2496,6 +2498,8 @@ bool start_messaging_system(
 	const F32 circuit_heartbeat_interval, 
 	const F32 circuit_timeout)
 {
+	LLZeroCode::initClass(gSysCPU);
+
 	gMessageSystem = new LLMessageSystem(
 		template_name,
 		port, 
@@ -2809,54 +2813,14 @@ S32 LLMessageSystem::zeroCodeAdjustCurrentSendTotal()
 	// TODO: babbage: remove this horror
 	mMessageBuilder->setBuilt(FALSE);
 
-	S32 count = mSendSize;
-	
-	S32 net_gain = 0;
-	U8 num_zeroes = 0;
-	
-	U8 *inptr = (U8 *)mSendBuffer;
-
-// skip the packet id field
-
-	for (U32 ii = 0; ii < LL_PACKET_ID_SIZE; ++ii)
-	{
-		count--;
-		inptr++;
-	}
-
-// don't actually build, just test
-
-// sequential zero bytes are encoded as 0 [U8 count] 
-// with 0 0 [count] representing wrap (>256 zeroes)
-
-	while (count--)
+	// skip the packet id field, and don't actually build, just test
+	S32 body_size = mSendSize - LL_PACKET_ID_SIZE;
+	if (body_size <= 0)
 	{
-		if (!(*inptr))   // in a zero count
-		{
-			if (num_zeroes)
-			{
-				if (++num_zeroes > 254)
-				{
-					num_zeroes = 0;
-				}
-				net_gain--;   // subseqent zeroes save one
-			}
-			else
-			{
-				net_gain++;  // starting a zero count adds one
-				num_zeroes = 1;
-			}
-			inptr++;
-		}
-		else
-		{
-			if (num_zeroes)
-			{
-				num_zeroes = 0;
-			}
-			inptr++;
-		}
+		return 0;
 	}
+	S32 net_gain = LLZeroCode::encodedSize(mSendBuffer + LL_PACKET_ID_SIZE, 
+										   body_size) - body_size;
 	if (net_gain < 0)
 	{
 		return net_gain;
@@ -2891,72 +2855,28 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 	
 	*data[0] &= (~LL_ZERO_CODE_FLAG);
 
-	S32 count = (*data_size);  
-	
-	U8 *inptr = (U8 *)*data;
-	U8 *outptr = (U8 *)mEncodedRecvBuffer;
+	S32 body_size = llmax(0, (*data_size) - (S32)LL_PACKET_ID_SIZE);
 
 // skip the packet id field
 
-	for (U32 ii = 0; ii < LL_PACKET_ID_SIZE; ++ii)
-	{
-		count--;
-		*outptr++ = *inptr++;
-	}
+	memcpy(mEncodedRecvBuffer, *data, LL_PACKET_ID_SIZE);	/* Flawfinder: ignore */
 
-// reconstruct encoded packet, keeping track of net size gain
+// reconstruct encoded packet
 
-// sequential zero bytes are encoded as 0 [U8 count] 
-// with 0 0 [count] representing wrap (>256 zeroes)
-
-	while (count--)
+	S32 expanded_size = LLZeroCode::expand(*data + LL_PACKET_ID_SIZE, body_size,
+										   mEncodedRecvBuffer + LL_PACKET_ID_SIZE,
+										   MAX_BUFFER_SIZE - LL_PACKET_ID_SIZE);
+	if (expanded_size < 0)
 	{
-		if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-1]))
-		{
-			LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 1" << llendl;
-			callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-			outptr = mEncodedRecvBuffer;					
-			break;
-		}
-		if (!((*outptr++ = *inptr++)))
-		{
-			while (((count--)) && (!(*inptr)))
-			{
-				*outptr++ = *inptr++;
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-256]))
-  				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 2" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;
-					count = -1;
-					break;
-  				}
-				memset(outptr,0,255);
-				outptr += 255;
-			}
-			
-			if (count < 0)
-			{
-				break;
-			}
-
-			else
-			{
-  				if (outptr > (&mEncodedRecvBuffer[MAX_BUFFER_SIZE-(*inptr)]))
-				{
-  					LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size 3" << llendl;
-					callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
-					outptr = mEncodedRecvBuffer;					
-				}
-				memset(outptr,0,(*inptr) - 1);
-				outptr += ((*inptr) - 1);
-				inptr++;
-			}
-		}		
+		LL_WARNS("Messaging") << "attempt to write past reasonable encoded buffer size" << llendl;
+		callExceptionFunc(MX_WROTE_PAST_BUFFER_SIZE);
+		*data_size = 0;
+	}
+	else
+	{
+		*data_size = LL_PACKET_ID_SIZE + expanded_size;
 	}
-	
 	*data = mEncodedRecvBuffer;
-	*data_size = (S32)(outptr - mEncodedRecvBuffer);
 	mUncompressedBytesIn += *data_size;
 
 	return(in_size);
@@ -3999,6 +3919,71 @@ S32	LLMessageSystem::getSize(const char *blockname, S32 blocknum,
 					   LLMessageStringTable::getInstance()->getString(varname));
 }
 
+bool LLMessageSystem::resolveVariableFast(const char *blockname, 
+										  const char *varname,
+										  LLMsgVariableHandle& handle) const
+{
+	if (mMessageReader != mTemplateMessageReader)
+	{
+		return false;
+	}
+	return mTemplateMessageReader->resolveVariable(blockname, varname, handle);
+}
+
+const U8* LLMessageSystem::getDataPtrFast(const LLMsgVariableHandle& handle,
+										  S32 blocknum, S32* size) const
+{
+	return mTemplateMessageReader->getDataPtr(handle, blocknum, size);
+}
+
+S32 LLMessageSystem::getSizeFast(const LLMsgVariableHandle& handle,
+								 S32 blocknum) const
+{
+	return mTemplateMessageReader->getSize(handle, blocknum);
+}
+
+void LLMessageSystem::getU8Fast(const LLMsgVariableHandle& handle, U8& data,
+								S32 blocknum) const
+{
+	mTemplateMessageReader->getU8(handle, data, blocknum);
+}
+
+void LLMessageSystem::getU32Fast(const LLMsgVariableHandle& handle, U32& data,
+								 S32 blocknum) const
+{
+	mTemplateMessageReader->getU32(handle, data, blocknum);
+}
+
+void LLMessageSystem::getF32Fast(const LLMsgVariableHandle& handle, F32& data,
+								 S32 blocknum) const
+{
+	mTemplateMessageReader->getF32(handle, data, blocknum);
+}
+
+void LLMessageSystem::getVector3Fast(const LLMsgVariableHandle& handle, LLVector3& vec,
+									 S32 blocknum) const
+{
+	mTemplateMessageReader->getVector3(handle, vec, blocknum);
+}
+
+void LLMessageSystem::getUUIDFast(const LLMsgVariableHandle& handle, LLUUID& uuid,
+								  S32 blocknum) const
+{
+	mTemplateMessageReader->getUUID(handle, uuid, blocknum);
+}
+
+void LLMessageSystem::getStringFast(const LLMsgVariableHandle& handle, std::string& outstr,
+									S32 blocknum) const
+{
+	mTemplateMessageReader->getString(handle, outstr, blocknum);
+}
+
+void LLMessageSystem::getBinaryDataFast(const LLMsgVariableHandle& handle, void* datap,
+										S32 size, S32 blocknum) const
+{
+	mTemplateMessageReader->getBinaryData(handle, datap, size, blocknum);
+}
+
 S32 LLMessageSystem::getReceiveSize() const
 {
 	return mMessageReader->getMessageSize();
@@ -197,6 +197,7 @@ class LLSDMessageBuilder;
 class LLMessageReader;
 class LLTemplateMessageReader;
 class LLSDMessageReader;
+class LLMsgVariableHandle;
 
 
 
@@ -333,6 +334,13 @@ public:
 		return mTimingCallbackData;
 	}
 
+	// All loaded templates, keyed by prehashed name.  Lets profiling
+	// tools enumerate and wrap the registered handlers.
+	const message_template_name_map_t& getMessageTemplates() const
+	{
+		return mMessageTemplates;
+	}
+
 	// This method returns true if the code is in the circuit codes map.
 	BOOL isCircuitCodeKnown(U32 code) const;
 
@@ -646,6 +654,30 @@ public:
 						const char *varname) const; // size in bytes of data
 	S32		getSize(const char *blockname, S32 blocknum, const char *varname) const;
 
+	// Lookup free, zero-copy access to template messages, see
+	// LLMsgVariableHandle. resolveVariableFast() returns false when the
+	// current message did not arrive as a template message, in which
+	// case callers fall back to the name based get*Fast() methods.
+	bool	resolveVariableFast(const char *blockname, const char *varname,
+								LLMsgVariableHandle& handle) const;
+	const U8* getDataPtrFast(const LLMsgVariableHandle& handle, 
+							 S32 blocknum = 0, S32* size = NULL) const;
+	S32		getSizeFast(const LLMsgVariableHandle& handle, S32 blocknum = 0) const;
+	void	getU8Fast(const LLMsgVariableHandle& handle, U8& data, 
+					  S32 blocknum = 0) const;
+	void	getU32Fast(const LLMsgVariableHandle& handle, U32& data, 
+					   S32 blocknum = 0) const;
+	void	getF32Fast(const LLMsgVariableHandle& handle, F32& data, 
+					   S32 blocknum = 0) const;
+	void	getVector3Fast(const LLMsgVariableHandle& handle, LLVector3& vec, 
+						   S32 blocknum = 0) const;
+	void	getUUIDFast(const LLMsgVariableHandle& handle, LLUUID& uuid, 
+						S32 blocknum = 0) const;
+	void	getStringFast(const LLMsgVariableHandle& handle, std::string& outstr, 
+						  S32 blocknum = 0) const;
+	void	getBinaryDataFast(const LLMsgVariableHandle& handle, void* datap, 
+							  S32 size, S32 blocknum = 0) const;
+
 	void	resetReceiveCounts();				// resets receive counts for all message types to 0
 	void	dumpReceiveCounts();				// dumps receive count for each message type to llinfos
 	void	dumpCircuitInfo();					// Circuit information to llinfos
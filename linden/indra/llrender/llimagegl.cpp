@@ -39,6 +39,7 @@
 
 #include "llerror.h"
 #include "llimage.h"
+#include "llimagebufferpool.h"
 
 #include "llmath.h"
 #include "llgl.h"
@@ -608,15 +609,16 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 				S32 height = getHeight(mCurrentDiscardLevel);
 				S32 nummips = mMaxDiscardLevel - mCurrentDiscardLevel + 1;
 				S32 w = width, h = height;
-				const U8* prev_mip_data = 0;
-				const U8* cur_mip_data = 0;
+				// levels after the first are pool allocations
+				U8* prev_mip_data = 0;
+				U8* cur_mip_data = 0;
 				S32 prev_mip_size = 0;
 				S32 cur_mip_size = 0;
 				for (int m=0; m<nummips; m++)
 				{
 					if (m==0)
 					{
-						cur_mip_data = data_in;
+						cur_mip_data = const_cast<U8*>(data_in); // only read, never freed
 						cur_mip_size = width * height * mComponents; 
 					}
 					else
@@ -624,7 +626,7 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 						S32 bytes = w * h * mComponents;
 						llassert(prev_mip_data);
 						llassert(prev_mip_size == bytes*4);
-						U8* new_data = new U8[bytes];
+						U8* new_data = LLImageBufferPool::allocate(bytes);
 						llassert_always(new_data);
 						LLImageBase::generateMip(prev_mip_data, new_data, w, h, mComponents);
 						cur_mip_data = new_data;
@@ -658,7 +660,7 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 					}
 					if (prev_mip_data && prev_mip_data != data_in)
 					{
-						delete[] prev_mip_data;
+						LLImageBufferPool::free(prev_mip_data, prev_mip_size);
 					}
 					prev_mip_data = cur_mip_data;
 					prev_mip_size = cur_mip_size;
@@ -667,7 +669,7 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 				}
 				if (prev_mip_data && prev_mip_data != data_in)
 				{
-					delete[] prev_mip_data;
+					LLImageBufferPool::free(prev_mip_data, prev_mip_size);
 					prev_mip_data = NULL;
 				}
 			}
@@ -1343,6 +1345,11 @@ BOOL LLImageGL::getBoundRecently() const
 	return (BOOL)(sLastFrameTime - mLastBindTime < MIN_TEXTURE_LIFETIME);
 }
 
+F32 LLImageGL::getTimeSinceBound() const
+{
+	return sLastFrameTime - mLastBindTime;
+}
+
 void LLImageGL::setTarget(const LLGLenum target, const LLTexUnit::eTextureType bind_target)
 {
 	mTarget = target;
@@ -127,6 +127,7 @@ public:
 	S32  getBytes(S32 discard_level = -1) const;
 	S32  getMipBytes(S32 discard_level = -1) const;
 	BOOL getBoundRecently() const;
+	F32  getTimeSinceBound() const;
 	LLGLenum getPrimaryFormat() const { return mFormatPrimary; }
 
 	BOOL getHasGLTexture() const { return mTexName != 0; }
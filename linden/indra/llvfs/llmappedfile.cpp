@@ -0,0 +1,243 @@
+/** 
+ * @file llmappedfile.cpp
+ * @brief Files mapped into memory.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llmappedfile.h"
+
+#include "llfile.h"
+#include "llstring.h"
+
+#if !LL_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+LLMappedFile::LLMappedFile()
+	: mData(NULL),
+	  mSize(0),
+	  mFileSize(0),
+	  mMode(READ_WRITE),
+#if LL_WINDOWS
+	  mFile(INVALID_HANDLE_VALUE),
+	  mMapping(NULL)
+#else
+	  mFile(-1)
+#endif
+{
+}
+
+LLMappedFile::~LLMappedFile()
+{
+	close();
+}
+
+bool LLMappedFile::open(const std::string& filename, size_t min_size, EMode mode)
+{
+	close();
+	mMode = mode;
+	if (mode == PRIVATE)
+	{
+		return openPrivate(filename, min_size);
+	}
+
+	bool read_only = (mode == READ_ONLY);
+	if (read_only)
+	{
+		min_size = 0;
+	}
+
+#if LL_WINDOWS
+	llutf16string utf16filename = utf8str_to_utf16str(filename);
+	mFile = CreateFileW((LPCWSTR)utf16filename.c_str(),
+						read_only ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+						FILE_SHARE_READ, NULL, read_only ? OPEN_EXISTING : OPEN_ALWAYS,
+						FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+	{
+		if (read_only && GetLastError() == ERROR_FILE_NOT_FOUND)
+		{
+			return false;
+		}
+		llwarns << "Unable to open " << filename << " for mapping" << llendl;
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(mFile, &file_size))
+	{
+		close();
+		return false;
+	}
+	mFileSize = (size_t)file_size.QuadPart;
+	mSize = llmax(mFileSize, min_size);
+	if (!mSize)
+	{
+		close();
+		return false;
+	}
+	// Mapping more than the file's size extends it with zeros
+	mMapping = CreateFileMapping(mFile, NULL, read_only ? PAGE_READONLY : PAGE_READWRITE,
+								 (DWORD)((U64)mSize >> 32), (DWORD)(mSize & 0xffffffff), NULL);
+	if (mMapping)
+	{
+		mData = (U8*)MapViewOfFile(mMapping, read_only ? FILE_MAP_READ : FILE_MAP_WRITE, 0, 0, mSize);
+	}
+#else
+	mFile = ::open(filename.c_str(), read_only ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+	if (mFile < 0)
+	{
+		if (read_only && errno == ENOENT)
+		{
+			return false;
+		}
+		llwarns << "Unable to open " << filename << " for mapping" << llendl;
+		return false;
+	}
+	struct stat file_stat;
+	if (fstat(mFile, &file_stat) != 0)
+	{
+		close();
+		return false;
+	}
+	mFileSize = (size_t)file_stat.st_size;
+	mSize = llmax(mFileSize, min_size);
+	if (!mSize || (mSize > mFileSize && ftruncate(mFile, (off_t)mSize) != 0))
+	{
+		llwarns << "Unable to size " << filename << " to " << mSize << " bytes" << llendl;
+		close();
+		return false;
+	}
+	void* data = mmap(NULL, mSize, read_only ? PROT_READ : PROT_READ | PROT_WRITE,
+					  MAP_SHARED, mFile, 0);
+	if (data != MAP_FAILED)
+	{
+		mData = (U8*)data;
+	}
+#endif
+
+	if (!mData)
+	{
+		llwarns << "Unable to map " << mSize << " bytes of " << filename << llendl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool LLMappedFile::openPrivate(const std::string& filename, size_t min_size)
+{
+	// Read only caches are small and rare; a heap copy keeps every
+	// platform's semantics the same.
+	LLFILE* fp = LLFile::fopen(filename, "rb");		/* Flawfinder: ignore */
+	if (fp)
+	{
+		fseek(fp, 0, SEEK_END);
+		long file_size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		mFileSize = file_size > 0 ? (size_t)file_size : 0;
+	}
+	mSize = llmax(mFileSize, min_size);
+	if (mSize)
+	{
+		mData = new U8[mSize];
+		memset(mData, 0, mSize);
+		if (fp && mFileSize && fread(mData, 1, mFileSize, fp) != mFileSize)
+		{
+			llwarns << "Unable to read " << filename << llendl;
+			memset(mData, 0, mSize);
+		}
+	}
+	if (fp)
+	{
+		fclose(fp);
+	}
+	return mData != NULL;
+}
+
+void LLMappedFile::close()
+{
+	if (mMode == PRIVATE)
+	{
+		delete[] mData;
+	}
+#if LL_WINDOWS
+	else
+	{
+		if (mData)
+		{
+			UnmapViewOfFile(mData);
+		}
+		if (mMapping)
+		{
+			CloseHandle(mMapping);
+		}
+		if (mFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(mFile);
+		}
+	}
+	mMapping = NULL;
+	mFile = INVALID_HANDLE_VALUE;
+#else
+	else
+	{
+		if (mData)
+		{
+			munmap(mData, mSize);
+		}
+		if (mFile >= 0)
+		{
+			::close(mFile);
+		}
+	}
+	mFile = -1;
+#endif
+	mData = NULL;
+	mSize = 0;
+	mFileSize = 0;
+}
+
+void LLMappedFile::flush()
+{
+	if (!mData || mMode == PRIVATE)
+	{
+		return;
+	}
+#if LL_WINDOWS
+	FlushViewOfFile(mData, 0);
+#else
+	msync(mData, mSize, MS_ASYNC);
+#endif
+}
@@ -0,0 +1,90 @@
+/** 
+ * @file llmappedfile.h
+ * @brief Files mapped into memory.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLMAPPEDFILE_H
+#define LL_LLMAPPEDFILE_H
+
+#if LL_WINDOWS
+#include <windows.h>
+#endif
+
+// A file mapped into memory.  Pages are read in as they are touched, so
+// opening a large file costs nothing until it is used.
+class LLMappedFile
+{
+public:
+	enum EMode
+	{
+		READ_WRITE,		// changes are written back to the file
+		READ_ONLY,		// an existing file, never written to
+		PRIVATE			// a private copy; changes are never written back
+	};
+
+	LLMappedFile();
+	~LLMappedFile();
+
+	// Maps at least min_size bytes of filename, creating the file or
+	// extending it with zeros as needed.  PRIVATE copies never create or
+	// extend the file, they are just zero filled past its end.  READ_ONLY
+	// mappings ignore min_size and fail if the file is missing or empty.
+	bool open(const std::string& filename, size_t min_size, EMode mode);
+	void close();
+
+	// Starts writing dirty pages back to the file.
+	void flush();
+
+	bool isOpen() const			{ return mData != NULL; }
+	U8* getData() const			{ return mData; }
+	size_t getSize() const		{ return mSize; }
+	// Size of the file before open() extended it
+	size_t getFileSize() const	{ return mFileSize; }
+
+private:
+	// No copy constructor or copy assignment
+	LLMappedFile(const LLMappedFile&);
+	LLMappedFile& operator=(const LLMappedFile&);
+
+	bool openPrivate(const std::string& filename, size_t min_size);
+
+	U8* mData;
+	size_t mSize;
+	size_t mFileSize;
+	EMode mMode;
+#if LL_WINDOWS
+	HANDLE mFile;
+	HANDLE mMapping;
+#else
+	int mFile;
+#endif
+};
+
+#endif // LL_LLMAPPEDFILE_H
@@ -0,0 +1,427 @@
+/** 
+ * @file llobjectcachefile.cpp
+ * @brief Memory mapped object cache snapshot with an append log.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llobjectcachefile.h"
+
+#include <algorithm>
+
+static const U32 SNAPSHOT_MAGIC = 0x4c4c4f43; // "LLOC"
+static const U32 LOG_MAGIC = 0x4c4c4f4c; // "LLOL"
+// Compact once the log holds this many records, or a quarter of the
+// snapshot's count if that is more.
+static const S32 MIN_COMPACT_LOG_RECORDS = 256;
+
+LLObjectCacheFile::LLObjectCacheFile()
+	: mVersion(0),
+	  mSerial(0),
+	  mCount(0),
+	  mOffsets(NULL),
+	  mIndex(NULL),
+	  mTableOffset(0),
+	  mLogFile(NULL),
+	  mLogAppending(false),
+	  mLogCount(0),
+	  mLogEnd(0),
+	  mSnapshotOut(NULL),
+	  mSnapshotOutSize(0)
+{
+}
+
+LLObjectCacheFile::~LLObjectCacheFile()
+{
+	close();
+	if (mSnapshotOut)
+	{
+		fclose(mSnapshotOut);
+		LLFile::remove(mFilename + ".tmp");
+	}
+}
+
+bool LLObjectCacheFile::open(const std::string& filename, const std::string& log_filename,
+							 const LLUUID& cache_id, U32 version)
+{
+	close();
+	mFilename = filename;
+	mLogFilename = log_filename;
+	mCacheID = cache_id;
+	mVersion = version;
+
+	bool loaded = mapSnapshot();
+	openLog();
+	return loaded;
+}
+
+bool LLObjectCacheFile::mapSnapshot()
+{
+	if (!mSnapshot.open(mFilename, 0, LLMappedFile::READ_ONLY))
+	{
+		// might not have a file, which is normal
+		return false;
+	}
+
+	const U64 size = mSnapshot.getSize();
+	const Header* header = (const Header*)mSnapshot.getData();
+	if (size < sizeof(Header)
+		|| header->mMagic != SNAPSHOT_MAGIC
+		|| header->mVersion != mVersion)
+	{
+		llinfos << "Object cache version changed, discarding " << mFilename << llendl;
+		mSnapshot.close();
+		return false;
+	}
+	if (header->mCacheID != mCacheID)
+	{
+		llinfos << "Cache ID doesn't match for this region, discarding " << mFilename << llendl;
+		mSnapshot.close();
+		return false;
+	}
+	if (header->mTableOffset < sizeof(Header)
+		|| (header->mTableOffset & 3)
+		|| header->mTableOffset + (U64)header->mCount * (sizeof(U32) + sizeof(IndexEntry)) > size)
+	{
+		llwarns << "Object cache " << mFilename << " is damaged, discarding" << llendl;
+		mSnapshot.close();
+		return false;
+	}
+
+	mSerial = header->mSerial;
+	mCount = (S32)header->mCount;
+	mTableOffset = header->mTableOffset;
+	mOffsets = (const U32*)(mSnapshot.getData() + mTableOffset);
+	mIndex = (const IndexEntry*)(mOffsets + mCount);
+	return true;
+}
+
+void LLObjectCacheFile::close()
+{
+	mSnapshot.close();
+	mSerial = 0;
+	mCount = 0;
+	mOffsets = NULL;
+	mIndex = NULL;
+	mTableOffset = 0;
+
+	if (mLogFile)
+	{
+		fclose(mLogFile);
+		mLogFile = NULL;
+	}
+	mLogAppending = false;
+	mLogCount = 0;
+	mLogEnd = 0;
+}
+
+const LLObjectCacheFile::Record* LLObjectCacheFile::getRecord(S32 position) const
+{
+	if (position < 0 || position >= mCount)
+	{
+		return NULL;
+	}
+	U32 offset = mOffsets[position];
+	if (offset < sizeof(Header)
+		|| (offset & 3)
+		|| (U64)offset + sizeof(Record) > mTableOffset)
+	{
+		return NULL;
+	}
+	const Record* record = (const Record*)(mSnapshot.getData() + offset);
+	if (record->mSize < 1 || (U64)offset + sizeof(Record) + record->mSize > mTableOffset)
+	{
+		return NULL;
+	}
+	return record;
+}
+
+S32 LLObjectCacheFile::find(U32 id) const
+{
+	IndexEntry key;
+	key.mID = id;
+	key.mPosition = 0;
+	const IndexEntry* end = mIndex + mCount;
+	const IndexEntry* iter = std::lower_bound(mIndex, end, key);
+	if (iter == end || iter->mID != id)
+	{
+		return -1;
+	}
+	S32 position = (S32)iter->mPosition;
+	const Record* record = getRecord(position);
+	if (!record || record->mID != id)
+	{
+		return -1;
+	}
+	return position;
+}
+
+//static
+U32 LLObjectCacheFile::getCheck(const LogRecord& record)
+{
+	return (record.mID * 2654435761U) ^ record.mCRC ^ ((U32)record.mSize << 7) ^ LOG_MAGIC;
+}
+
+void LLObjectCacheFile::openLog()
+{
+	mLogFile = LLFile::fopen(mLogFilename, "rb");		/* Flawfinder: ignore */
+	if (!mLogFile)
+	{
+		return;
+	}
+	LogHeader header;
+	if (fread(&header, sizeof(header), 1, mLogFile) != 1
+		|| header.mMagic != LOG_MAGIC
+		|| header.mVersion != mVersion
+		|| header.mSerial != mSerial
+		|| header.mCacheID != mCacheID)
+	{
+		// Belongs to some other snapshot, start over when something changes
+		fclose(mLogFile);
+		mLogFile = NULL;
+		return;
+	}
+	mLogEnd = (long)sizeof(header);
+}
+
+bool LLObjectCacheFile::readLog(U32& id, U32& crc, std::vector<U8>& data)
+{
+	if (!mLogFile || mLogAppending)
+	{
+		return false;
+	}
+	LogRecord record;
+	if (fread(&record, sizeof(record), 1, mLogFile) != 1)
+	{
+		return false;
+	}
+	if (record.mCheck != getCheck(record) || record.mSize < 0)
+	{
+		llwarns << "Object cache log " << mLogFilename << " is damaged after "
+				<< mLogCount << " records" << llendl;
+		return false;
+	}
+	data.resize(record.mSize);
+	if (record.mSize && fread(&data[0], 1, record.mSize, mLogFile) != (size_t)record.mSize)
+	{
+		// torn by a crash; later appends overwrite it
+		return false;
+	}
+	id = record.mID;
+	crc = record.mCRC;
+	mLogEnd += (long)(sizeof(record) + record.mSize);
+	mLogCount++;
+	return true;
+}
+
+void LLObjectCacheFile::startLog()
+{
+	mLogAppending = true;
+	if (mLogFile)
+	{
+		// Append after the last good record, dropping anything torn
+		fclose(mLogFile);
+		mLogFile = LLFile::fopen(mLogFilename, "r+b");		/* Flawfinder: ignore */
+		if (mLogFile && fseek(mLogFile, mLogEnd, SEEK_SET) == 0)
+		{
+			return;
+		}
+		if (mLogFile)
+		{
+			fclose(mLogFile);
+		}
+	}
+
+	mLogCount = 0;
+	mLogFile = LLFile::fopen(mLogFilename, "wb");		/* Flawfinder: ignore */
+	if (!mLogFile)
+	{
+		llwarns << "Unable to write object cache log " << mLogFilename << llendl;
+		return;
+	}
+	LogHeader header;
+	header.mMagic = LOG_MAGIC;
+	header.mVersion = mVersion;
+	header.mSerial = mSerial;
+	header.mCacheID = mCacheID;
+	if (fwrite(&header, sizeof(header), 1, mLogFile) != 1)
+	{
+		llwarns << "Short write" << llendl;
+	}
+	mLogEnd = (long)sizeof(header);
+}
+
+void LLObjectCacheFile::appendLog(U32 id, U32 crc, const U8* data, S32 size)
+{
+	if (!mLogAppending)
+	{
+		startLog();
+	}
+	if (!mLogFile)
+	{
+		return;
+	}
+	LogRecord record;
+	record.mID = id;
+	record.mCRC = crc;
+	record.mSize = size;
+	record.mCheck = getCheck(record);
+	if (fwrite(&record, sizeof(record), 1, mLogFile) != 1
+		|| (size && fwrite(data, 1, size, mLogFile) != (size_t)size))
+	{
+		llwarns << "Short write" << llendl;
+	}
+	mLogEnd += (long)(sizeof(record) + size);
+	mLogCount++;
+}
+
+bool LLObjectCacheFile::needsCompaction() const
+{
+	if (!mLogCount)
+	{
+		return false;
+	}
+	return !mSnapshot.isOpen() || mLogCount >= llmax(MIN_COMPACT_LOG_RECORDS, mCount / 4);
+}
+
+bool LLObjectCacheFile::startSnapshot()
+{
+	llassert(!mSnapshotOut);
+	mSnapshotOut = LLFile::fopen(mFilename + ".tmp", "wb");		/* Flawfinder: ignore */
+	if (!mSnapshotOut)
+	{
+		llwarns << "Unable to write object cache " << mFilename << llendl;
+		return false;
+	}
+	// Header goes in last, once the table is written
+	Header header;
+	header.mMagic = 0;
+	header.mVersion = 0;
+	header.mSerial = 0;
+	header.mCount = 0;
+	header.mTableOffset = 0;
+	header.mCacheID.setNull();
+	if (fwrite(&header, sizeof(header), 1, mSnapshotOut) != 1)
+	{
+		llwarns << "Short write" << llendl;
+	}
+	mSnapshotOutSize = sizeof(header);
+	mSnapshotOffsets.clear();
+	mSnapshotIndex.clear();
+	return true;
+}
+
+void LLObjectCacheFile::addToSnapshot(U32 id, U32 crc, S32 hit_count, S32 dupe_count,
+									  S32 crc_change_count, const U8* data, S32 size)
+{
+	if (!mSnapshotOut || size < 1)
+	{
+		return;
+	}
+	Record record;
+	record.mID = id;
+	record.mCRC = crc;
+	record.mHitCount = hit_count;
+	record.mDupeCount = dupe_count;
+	record.mCRCChangeCount = crc_change_count;
+	record.mSize = size;
+	// Keep records 4 byte aligned so they can be read in place
+	static const U8 pad[3] = { 0, 0, 0 };
+	S32 pad_size = (4 - (size & 3)) & 3;
+	if (fwrite(&record, sizeof(record), 1, mSnapshotOut) != 1
+		|| fwrite(data, 1, size, mSnapshotOut) != (size_t)size
+		|| (pad_size && fwrite(pad, 1, pad_size, mSnapshotOut) != (size_t)pad_size))
+	{
+		llwarns << "Short write" << llendl;
+	}
+
+	IndexEntry entry;
+	entry.mID = id;
+	entry.mPosition = (U32)mSnapshotOffsets.size();
+	mSnapshotIndex.push_back(entry);
+	mSnapshotOffsets.push_back(mSnapshotOutSize);
+	mSnapshotOutSize += sizeof(record) + size + pad_size;
+}
+
+bool LLObjectCacheFile::finishSnapshot()
+{
+	if (!mSnapshotOut)
+	{
+		return false;
+	}
+
+	std::sort(mSnapshotIndex.begin(), mSnapshotIndex.end());
+	Header header;
+	header.mMagic = SNAPSHOT_MAGIC;
+	header.mVersion = mVersion;
+	header.mSerial = (mSerial + 1) ? mSerial + 1 : 1;
+	header.mCount = (U32)mSnapshotOffsets.size();
+	header.mTableOffset = mSnapshotOutSize;
+	header.mCacheID = mCacheID;
+
+	bool success = true;
+	if (header.mCount
+		&& (fwrite(&mSnapshotOffsets[0], sizeof(U32), header.mCount, mSnapshotOut) != header.mCount
+			|| fwrite(&mSnapshotIndex[0], sizeof(IndexEntry), header.mCount, mSnapshotOut) != header.mCount))
+	{
+		success = false;
+	}
+	if (fseek(mSnapshotOut, 0, SEEK_SET) != 0
+		|| fwrite(&header, sizeof(header), 1, mSnapshotOut) != 1)
+	{
+		success = false;
+	}
+	if (fclose(mSnapshotOut) != 0)
+	{
+		success = false;
+	}
+	mSnapshotOut = NULL;
+	mSnapshotOffsets.clear();
+	mSnapshotIndex.clear();
+
+	// Records may have pointed into the old snapshot; let it go only now
+	close();
+	std::string temp_filename = mFilename + ".tmp";
+	if (!success)
+	{
+		llwarns << "Short write, discarding new object cache " << mFilename << llendl;
+		LLFile::remove(temp_filename);
+		return false;
+	}
+	LLFile::remove(mFilename);
+	if (LLFile::rename(temp_filename, mFilename) != 0)
+	{
+		llwarns << "Unable to replace object cache " << mFilename << llendl;
+		LLFile::remove(temp_filename);
+		return false;
+	}
+	LLFile::remove(mLogFilename);
+	return true;
+}
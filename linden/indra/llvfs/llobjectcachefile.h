@@ -0,0 +1,167 @@
+/** 
+ * @file llobjectcachefile.h
+ * @brief Memory mapped object cache snapshot with an append log.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLOBJECTCACHEFILE_H
+#define LL_LLOBJECTCACHEFILE_H
+
+#include <vector>
+
+#include "llfile.h"
+#include "llmappedfile.h"
+#include "lluuid.h"
+
+// The on-disk store behind a region's object cache: records keyed by a
+// U32 id (the object's local id), each holding a CRC, a few counters and
+// an opaque blob of update data.
+//
+// A snapshot file holds the records, oldest first, followed by a table of
+// ids sorted for binary search.  It is mapped read only, so opening even a
+// large cache costs next to nothing and records are read in place as they
+// are looked up.  Changes made after the snapshot was written are appended
+// to a log file beside it.  The owner replays the log after open(), and
+// writes a new snapshot folding the log in once needsCompaction() says the
+// log has grown enough to be worth it.
+class LLObjectCacheFile
+{
+public:
+	struct Record
+	{
+		U32 mID;
+		U32 mCRC;
+		S32 mHitCount;
+		S32 mDupeCount;
+		S32 mCRCChangeCount;
+		S32 mSize;
+		// followed by mSize bytes of data
+
+		const U8* getData() const	{ return (const U8*)(this + 1); }
+	};
+
+	LLObjectCacheFile();
+	~LLObjectCacheFile();
+
+	// Maps filename and opens log_filename.  A snapshot or log written for
+	// another cache_id or version is ignored.  Returns false if there is no
+	// usable snapshot, though the log may still hold records.
+	bool open(const std::string& filename, const std::string& log_filename,
+			  const LLUUID& cache_id, U32 version);
+	void close();
+
+	// Number of records in the snapshot.  Positions run oldest to newest.
+	S32 getCount() const			{ return mCount; }
+	// Returns NULL if the record is damaged
+	const Record* getRecord(S32 position) const;
+	// Returns the position of id's record, or -1 if it has none
+	S32 find(U32 id) const;
+
+	// Reads the next log record in the order they were appended.  Empty
+	// data means id was removed.  Returns false at the end of the log.
+	// Read the whole log before appending to it.
+	bool readLog(U32& id, U32& crc, std::vector<U8>& data);
+	// Records that id now holds crc and data; a size of 0 records its removal.
+	void appendLog(U32 id, U32 crc, const U8* data, S32 size);
+	S32 getLogCount() const			{ return mLogCount; }
+	bool needsCompaction() const;
+
+	// Writes a new snapshot.  Records are added oldest first and their data
+	// may point into the current snapshot.  finishSnapshot() closes this
+	// file, then replaces the snapshot and deletes the log.
+	bool startSnapshot();
+	void addToSnapshot(U32 id, U32 crc, S32 hit_count, S32 dupe_count, S32 crc_change_count,
+					   const U8* data, S32 size);
+	bool finishSnapshot();
+
+private:
+	// No copy constructor or copy assignment
+	LLObjectCacheFile(const LLObjectCacheFile&);
+	LLObjectCacheFile& operator=(const LLObjectCacheFile&);
+
+	struct Header
+	{
+		U32 mMagic;
+		U32 mVersion;
+		U32 mSerial;		// ties a log to the snapshot it follows
+		U32 mCount;
+		U32 mTableOffset;	// U32 record offsets by position, then the IndexEntry table
+		LLUUID mCacheID;
+	};
+	struct IndexEntry
+	{
+		U32 mID;
+		U32 mPosition;
+
+		bool operator<(const IndexEntry& rhs) const	{ return mID < rhs.mID; }
+	};
+	struct LogHeader
+	{
+		U32 mMagic;
+		U32 mVersion;
+		U32 mSerial;
+		LLUUID mCacheID;
+	};
+	struct LogRecord
+	{
+		U32 mID;
+		U32 mCRC;
+		S32 mSize;
+		U32 mCheck;			// catches records torn by a crash
+	};
+
+	bool mapSnapshot();
+	void openLog();
+	void startLog();
+	static U32 getCheck(const LogRecord& record);
+
+	std::string mFilename;
+	std::string mLogFilename;
+	LLUUID mCacheID;
+	U32 mVersion;
+
+	LLMappedFile mSnapshot;
+	U32 mSerial;
+	S32 mCount;
+	const U32* mOffsets;
+	const IndexEntry* mIndex;
+	U32 mTableOffset;
+
+	LLFILE* mLogFile;
+	bool mLogAppending;
+	S32 mLogCount;
+	long mLogEnd;			// end of the last good log record
+
+	LLFILE* mSnapshotOut;
+	U32 mSnapshotOutSize;
+	std::vector<U32> mSnapshotOffsets;
+	std::vector<IndexEntry> mSnapshotIndex;
+};
+
+#endif // LL_LLOBJECTCACHEFILE_H
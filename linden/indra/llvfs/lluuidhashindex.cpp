@@ -0,0 +1,247 @@
+/** 
+ * @file lluuidhashindex.cpp
+ * @brief Sharded, open-addressed LLUUID index kept in a caller supplied memory block.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "lluuidhashindex.h"
+
+static const U32 INDEX_MAGIC = 0x4c4c5549; // "LLUI"
+static const U32 INDEX_VERSION = 1;
+// Shards are kept at most half full so probe runs stay short
+static const U32 MIN_SLOTS_PER_SHARD = 16;
+
+LLUUIDHashIndex::LLUUIDHashIndex()
+	: mHeader(NULL),
+	  mSlots(NULL)
+{
+	for (S32 i = 0; i < NUM_SHARDS; ++i)
+	{
+		mShardMutex[i] = new LLMutex(NULL);
+	}
+}
+
+LLUUIDHashIndex::~LLUUIDHashIndex()
+{
+	for (S32 i = 0; i < NUM_SHARDS; ++i)
+	{
+		delete mShardMutex[i];
+		mShardMutex[i] = NULL;
+	}
+}
+
+//static
+U32 LLUUIDHashIndex::calcSlotsPerShard(U32 capacity)
+{
+	U32 wanted = (U32)(((U64)capacity * 2 + NUM_SHARDS - 1) / NUM_SHARDS);
+	U32 slots = MIN_SLOTS_PER_SHARD;
+	while (slots < wanted)
+	{
+		slots <<= 1;
+	}
+	return slots;
+}
+
+//static
+size_t LLUUIDHashIndex::calcMemorySize(U32 capacity)
+{
+	return sizeof(Header) + (size_t)calcSlotsPerShard(capacity) * NUM_SHARDS * sizeof(Slot);
+}
+
+bool LLUUIDHashIndex::attach(U8* memory, size_t size, U32 capacity)
+{
+	llassert_always(memory && size >= calcMemorySize(capacity));
+	mHeader = (Header*)memory;
+	mSlots = (Slot*)(memory + sizeof(Header));
+
+	U32 slots_per_shard = calcSlotsPerShard(capacity);
+	if (mHeader->mMagic == INDEX_MAGIC
+		&& mHeader->mVersion == INDEX_VERSION
+		&& mHeader->mCapacity == capacity
+		&& mHeader->mSlotsPerShard == slots_per_shard
+		&& mHeader->mClean)
+	{
+		// In use, so not clean until detach()ed
+		mHeader->mClean = 0;
+		return true;
+	}
+
+	mHeader->mMagic = INDEX_MAGIC;
+	mHeader->mVersion = INDEX_VERSION;
+	mHeader->mCapacity = capacity;
+	mHeader->mSlotsPerShard = slots_per_shard;
+	mHeader->mClean = 0;
+	clear();
+	return false;
+}
+
+void LLUUIDHashIndex::detach()
+{
+	if (mHeader)
+	{
+		mHeader->mClean = 1;
+	}
+	mHeader = NULL;
+	mSlots = NULL;
+}
+
+void LLUUIDHashIndex::clear()
+{
+	if (!mHeader)
+	{
+		return;
+	}
+	for (U32 shard = 0; shard < NUM_SHARDS; ++shard)
+	{
+		LLMutexLock lock(mShardMutex[shard]);
+		// The count can't be trusted in a rejected header, so reset every
+		// slot rather than only shards that claim to hold entries
+		Slot* slots = getShardSlots(shard);
+		for (U32 i = 0; i < mHeader->mSlotsPerShard; ++i)
+		{
+			slots[i].mID.setNull();
+			slots[i].mValue = 0;
+		}
+		mHeader->mCount[shard] = 0;
+	}
+}
+
+S32 LLUUIDHashIndex::find(const LLUUID& id) const
+{
+	if (!mHeader)
+	{
+		return -1;
+	}
+	const U32 mask = mHeader->mSlotsPerShard - 1;
+	const Slot* slots = getShardSlots(getShard(id));
+	for (U32 pos = getHome(id, mask); ; pos = (pos + 1) & mask)
+	{
+		const Slot& slot = slots[pos];
+		if (!slot.mValue)
+		{
+			return -1;
+		}
+		if (slot.mID == id)
+		{
+			return slot.mValue - 1;
+		}
+	}
+}
+
+bool LLUUIDHashIndex::insert(const LLUUID& id, S32 value)
+{
+	llassert(value >= 0);
+	if (!mHeader)
+	{
+		return false;
+	}
+	const U32 shard = getShard(id);
+	const U32 mask = mHeader->mSlotsPerShard - 1;
+	Slot* slots = getShardSlots(shard);
+	for (U32 pos = getHome(id, mask); ; pos = (pos + 1) & mask)
+	{
+		Slot& slot = slots[pos];
+		if (!slot.mValue)
+		{
+			// keep at least one empty slot so probes always end
+			if (mHeader->mCount[shard] + 1 >= mHeader->mSlotsPerShard)
+			{
+				return false;
+			}
+			slot.mID = id;
+			slot.mValue = value + 1;
+			mHeader->mCount[shard]++;
+			return true;
+		}
+		if (slot.mID == id)
+		{
+			slot.mValue = value + 1;
+			return true;
+		}
+	}
+}
+
+bool LLUUIDHashIndex::erase(const LLUUID& id)
+{
+	if (!mHeader)
+	{
+		return false;
+	}
+	const U32 shard = getShard(id);
+	const U32 mask = mHeader->mSlotsPerShard - 1;
+	Slot* slots = getShardSlots(shard);
+	U32 pos = getHome(id, mask);
+	while (1)
+	{
+		if (!slots[pos].mValue)
+		{
+			return false;
+		}
+		if (slots[pos].mID == id)
+		{
+			break;
+		}
+		pos = (pos + 1) & mask;
+	}
+
+	// Shift later members of the probe run back over the hole, so the
+	// table never needs tombstones
+	U32 hole = pos;
+	for (U32 next = (hole + 1) & mask; slots[next].mValue; next = (next + 1) & mask)
+	{
+		U32 home = getHome(slots[next].mID, mask);
+		// move it unless its home lies cyclically in (hole, next]
+		bool in_place = (hole <= next) ? (hole < home && home <= next)
+									   : (hole < home || home <= next);
+		if (!in_place)
+		{
+			slots[hole] = slots[next];
+			hole = next;
+		}
+	}
+	slots[hole].mID.setNull();
+	slots[hole].mValue = 0;
+	mHeader->mCount[shard]--;
+	return true;
+}
+
+U32 LLUUIDHashIndex::getCount() const
+{
+	U32 count = 0;
+	if (mHeader)
+	{
+		for (U32 shard = 0; shard < NUM_SHARDS; ++shard)
+		{
+			count += mHeader->mCount[shard];
+		}
+	}
+	return count;
+}
@@ -0,0 +1,131 @@
+/** 
+ * @file lluuidhashindex.h
+ * @brief Sharded, open-addressed LLUUID index kept in a caller supplied memory block.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLUUIDHASHINDEX_H
+#define LL_LLUUIDHASHINDEX_H
+
+#include "llthread.h"
+#include "lluuid.h"
+
+// Maps LLUUIDs to non-negative S32s (typically record numbers in some
+// other file) with a linear probing hash table that lives entirely in a
+// block of memory the caller supplies, normally an LLMappedFile.  A saved
+// index is usable as soon as it is mapped; nothing is read up front.
+//
+// The table is split into NUM_SHARDS shards by the first byte of the
+// UUID, each with its own lock, so lookups from different threads rarely
+// contend.  find(), insert() and erase() must be called with the UUID's
+// shard locked (see ShardLock).
+class LLUUIDHashIndex
+{
+public:
+	enum { NUM_SHARDS = 64 };
+
+	class ShardLock
+	{
+	public:
+		ShardLock(LLUUIDHashIndex& index, const LLUUID& id)
+			: mMutex(index.mShardMutex[getShard(id)])
+		{
+			mMutex->lock();
+		}
+		~ShardLock()
+		{
+			mMutex->unlock();
+		}
+	private:
+		LLMutex* mMutex;
+	};
+
+	LLUUIDHashIndex();
+	~LLUUIDHashIndex();
+
+	// Bytes of memory an index holding up to capacity UUIDs needs
+	static size_t calcMemorySize(U32 capacity);
+
+	// Uses memory for the table.  Returns true if it already holds an index
+	// for capacity that was detach()ed cleanly; otherwise the table is
+	// cleared and false is returned, and the caller should repopulate it.
+	bool attach(U8* memory, size_t size, U32 capacity);
+	// Marks the table as cleanly saved and stops using the memory.
+	void detach();
+	bool isAttached() const { return mHeader != NULL; }
+
+	// Removes every entry.  Locks every shard.
+	void clear();
+
+	// Returns -1 if id is not in the index
+	S32 find(const LLUUID& id) const;
+	// Adds or replaces the value for id.  Returns false if id's shard is full.
+	bool insert(const LLUUID& id, S32 value);
+	bool erase(const LLUUID& id);
+
+	U32 getCount() const; // approximate while other threads are inserting
+
+	static U32 getShard(const LLUUID& id) { return id.mData[0] % NUM_SHARDS; }
+
+private:
+	// No copy constructor or copy assignment
+	LLUUIDHashIndex(const LLUUIDHashIndex&);
+	LLUUIDHashIndex& operator=(const LLUUIDHashIndex&);
+
+	struct Header
+	{
+		U32 mMagic;
+		U32 mVersion;
+		U32 mCapacity;
+		U32 mSlotsPerShard;
+		U32 mClean;
+		U32 mCount[NUM_SHARDS];
+	};
+	struct Slot
+	{
+		LLUUID mID;
+		S32 mValue; // value + 1; 0 marks an empty slot so zeroed memory is an empty table
+	};
+
+	static U32 calcSlotsPerShard(U32 capacity);
+	static U32 getHome(const LLUUID& id, U32 mask)
+	{
+		// byte 0 picks the shard; hash the rest
+		U32 hash;
+		memcpy(&hash, &id.mData[4], sizeof(hash));		/* Flawfinder: ignore */
+		return (hash ^ (hash >> 15)) & mask;
+	}
+	Slot* getShardSlots(U32 shard) const { return mSlots + shard * mHeader->mSlotsPerShard; }
+
+	Header* mHeader;
+	Slot* mSlots;
+	LLMutex* mShardMutex[NUM_SHARDS];
+};
+
+#endif // LL_LLUUIDHASHINDEX_H
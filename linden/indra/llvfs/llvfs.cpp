@@ -33,25 +33,63 @@
 #include "linden_common.h"
 
 #include <sys/stat.h>
+#include <errno.h>
+#include <algorithm>
 #include <set>
 #include <map>
 #if LL_WINDOWS
 #include <share.h>
+#include <io.h>
+#include <windows.h>
 #elif LL_SOLARIS
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
 #else
 #include <sys/file.h>
+#include <unistd.h>
 #endif
     
 #include "llvfs.h"
+#include "llcrc.h"
 #include "llstl.h"
     
 const S32 FILE_BLOCK_MASK = 0x000003FF;	 // 1024-byte blocks
 const S32 VFS_CLEANUP_SIZE = 5242880;  // how much space we free up in a single stroke
 const S32 BLOCK_LENGTH_INVALID = -1;	// mLength for invalid LLVFSFileBlocks
 
+// The index is a snapshot of every file block, sorted by location, plus a
+// journal of the changes made since.  Both are replaced by a new snapshot
+// when the journal gets long, and on shutdown.
+const U32 VFS_INDEX_MAGIC = 0x49534656;		// "VFSI"
+const U32 VFS_INDEX_VERSION = 1;
+const S32 VFS_INDEX_HEADER_SIZE = 16;		// magic, version, generation, count
+const U32 VFS_JOURNAL_MAGIC = 0x4A534656;	// "VFSJ"
+const S32 VFS_JOURNAL_HEADER_SIZE = 8;		// magic, generation
+const S32 VFS_JOURNAL_BATCH = 32;			// entries buffered before a write
+const S32 VFS_JOURNAL_CHECKPOINT_MIN = 4096;	// entries before a new snapshot
+
+// Index headers are little endian, like the file block records
+static void put_u32(U8 *buffer, U32 value)
+{
+	buffer[0] = (U8)value;
+	buffer[1] = (U8)(value >> 8);
+	buffer[2] = (U8)(value >> 16);
+	buffer[3] = (U8)(value >> 24);
+}
+
+static U32 get_u32(const U8 *buffer)
+{
+	return (U32)buffer[0] | ((U32)buffer[1] << 8) | ((U32)buffer[2] << 16) | ((U32)buffer[3] << 24);
+}
+
+static U32 calc_crc(const U8 *buffer, S32 size)
+{
+	LLCRC crc;
+	crc.update(buffer, size);
+	return crc.getCRC();
+}
+
 LLVFS *gVFS = NULL;
 
 // internal class definitions
@@ -127,6 +165,8 @@ public:
 		mSize = 0;
 		mIndexLocation = -1;
 		mAccessTime = (U32)time(NULL);
+		mIOCount = 0;
+		mWriteCount = 0;
 
 		for (S32 i = 0; i < (S32)VFSLOCK_COUNT; i++)
 		{
@@ -216,6 +256,8 @@ public:
 	S32  mIndexLocation; // location of index entry
 	U32  mAccessTime;
 	BOOL mLocks[VFSLOCK_COUNT]; // number of outstanding locks of each type
+	S32  mIOCount;		// reads and writes in flight outside mDataMutex
+	U32  mWriteCount;	// writes started, so a move can tell its copy is stale
     
 	static const S32 SERIAL_SIZE;
 };
@@ -231,12 +273,70 @@ struct LLVFSFileBlock_less
 
 
 const S32 LLVFSFileBlock::SERIAL_SIZE = 34;
+const S32 VFS_JOURNAL_ENTRY_SIZE = LLVFSFileBlock::SERIAL_SIZE + 4;	// record, crc
+
+static BOOL read_index_file(const std::string& filename, std::vector<U8>& buffer)
+{
+	LLFILE *fp = LLFile::fopen(filename, "rb");	/* Flawfinder: ignore */
+	if (!fp)
+	{
+		return FALSE;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	buffer.resize(size > 0 ? size : 0);
+	if (size > 0)
+	{
+		buffer.resize(fread(&buffer[0], 1, size, fp));
+	}
+	fclose(fp);
+	return TRUE;
+}
+
+// TRUE if the buffer holds a whole snapshot with a matching checksum
+static BOOL check_snapshot(const std::vector<U8>& buffer, U32& generation)
+{
+	if (buffer.size() < (size_t)(VFS_INDEX_HEADER_SIZE + 4) ||
+		get_u32(&buffer[0]) != VFS_INDEX_MAGIC ||
+		get_u32(&buffer[4]) != VFS_INDEX_VERSION)
+	{
+		return FALSE;
+	}
+	U32 count = get_u32(&buffer[12]);
+	size_t crc_offset = VFS_INDEX_HEADER_SIZE + (size_t)count * LLVFSFileBlock::SERIAL_SIZE;
+	if (count > (U32)(buffer.size() / LLVFSFileBlock::SERIAL_SIZE) ||
+		buffer.size() != crc_offset + 4 ||
+		get_u32(&buffer[crc_offset]) != calc_crc(&buffer[0], (S32)crc_offset))
+	{
+		return FALSE;
+	}
+	generation = get_u32(&buffer[8]);
+	return TRUE;
+}
      
 
 LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash)
-:	mRemoveAfterCrash(remove_after_crash)
+:	mAllocCount(0),
+	mAllocEvictCount(0),
+	mAllocFailCount(0),
+	mAllocTime(0.0),
+	mAllocMaxTime(0.f),
+	mCompactMoves(0),
+	mCompactBytes(0),
+	mCompactIdle(FALSE),
+	mCompactPassActive(FALSE),
+	mCompactPassMoved(FALSE),
+	mDataFP(NULL),
+	mIndexFP(NULL),
+	mJournalFP(NULL),
+	mJournalEntries(0),
+	mJournalPendingFree(FALSE),
+	mCheckpointPending(FALSE),
+	mIndexGeneration(0),
+	mRemoveAfterCrash(remove_after_crash)
 {
-	mDataMutex = new LLMutex(0);
+	mDataMutex = new LLCondition(0);
 
 	S32 i;
 	for (i = 0; i < VFSLOCK_COUNT; i++)
@@ -264,7 +364,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 		{
 			// Since we're creating this data file, assume any index file is bogus
 			// remove the index, since this vfs is now blank
-			LLFile::remove(mIndexFilename);
+			removeIndexFiles(mIndexFilename);
 		}
 		else
 		{
@@ -287,7 +387,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 				if ((mDataFP = openAndLock(temp_data, "w+b", FALSE)))
 				{
 					// we're creating the datafile, so nuke the indexfile
-					LLFile::remove(temp_index);
+					removeIndexFiles(temp_index);
 					break;
 				}
 			}
@@ -322,7 +422,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			mDataFP = NULL;
 
 			LL_WARNS("VFS") << "VFS: File left open on last run, removing old VFS file " << mDataFilename << LL_ENDL;
-			LLFile::remove(mIndexFilename);
+			removeIndexFiles(mIndexFilename);
 			LLFile::remove(mDataFilename);
 			LLFile::remove(marker);
 
@@ -345,27 +445,45 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	fseek(mDataFP, 0, SEEK_END);
 	U32 data_size = ftell(mDataFP);
 
-	// read the index file
-	// make sure there's at least one file in it too
-	// if not, we'll treat this as a new vfs
-	llstat fbuf;
-	if (! LLFile::stat(mIndexFilename, &fbuf) &&
-		fbuf.st_size >= LLVFSFileBlock::SERIAL_SIZE &&
+	// A new snapshot that was written but not yet renamed into place
+	// when we last quit is newer than the index.
+	if (!mReadOnly)
+	{
+		finishCheckpoint();
+	}
+
+	// read the index file, with the journal replayed over it
+	// if there isn't one, we'll treat this as a new vfs
+	std::vector<LLVFSFileBlock*> index_blocks;
+	S32 journal_entries = 0;
+	EIndexState index_state = readIndex(index_blocks, mIndexGeneration, journal_entries);
+	BOOL needs_checkpoint = (index_state != INDEX_SNAPSHOT || journal_entries > 0);
+	if (index_state == INDEX_CORRUPT)
+	{
+		unlockAndClose( mDataFP );
+		mDataFP = NULL;
+		removeIndexFiles( mIndexFilename );
+		LLFile::remove( mDataFilename );
+
+		LL_WARNS("VFS") << "VFS index failed its checksum, deleted corrupt VFS files " 
+			<< mDataFilename 
+			<< " and "
+			<< mIndexFilename
+			<< LL_ENDL;
+
+		mValid = VFSVALID_BAD_CORRUPT;
+		return;
+	}
+	if (index_state != INDEX_MISSING &&
 		(mIndexFP = openAndLock(mIndexFilename, file_mode, mReadOnly))
 		)
 	{	
-		U8 *buffer = new U8[fbuf.st_size];
-		size_t nread = fread(buffer, 1, fbuf.st_size, mIndexFP);
-    
-		U8 *tmp_ptr = buffer;
-    
 		std::vector<LLVFSFileBlock*> files_by_loc;
 		
-		while (tmp_ptr < buffer + nread)
+		for (std::vector<LLVFSFileBlock*>::iterator iter = index_blocks.begin();
+			 iter != index_blocks.end(); ++iter)
 		{
-			LLVFSFileBlock *block = new LLVFSFileBlock();
-    
-			block->deserialize(tmp_ptr, (S32)(tmp_ptr - buffer));
+			LLVFSFileBlock *block = *iter;
     
 			// Do sanity check on this block.
 			// Note that this skips zero size blocks, which helps VFS
@@ -389,12 +507,11 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 				LL_WARNS("VFS") << "Length: " << block->mLength << "\tLocation: " << block->mLocation << "\tSize: " << block->mSize << LL_ENDL;
 				LL_WARNS("VFS") << "File has bad data - VFS removed" << LL_ENDL;
 
-				delete[] buffer;
-				delete block;
+				for_each(iter, index_blocks.end(), DeletePointer());
 
 				unlockAndClose( mIndexFP );
 				mIndexFP = NULL;
-				LLFile::remove( mIndexFilename );
+				removeIndexFiles( mIndexFilename );
 
 				unlockAndClose( mDataFP );
 				mDataFP = NULL;
@@ -412,15 +529,15 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			else
 			{
 				// this is a null or bad entry, skip it
-				S32 index_loc = (S32)(tmp_ptr - buffer);
-				mIndexHoles.push_back(index_loc);
-    
+				// and leave it out of the next snapshot
+				if (block->mLength)
+				{
+					needs_checkpoint = TRUE;
+				}
 				delete block;
 			}
-    
-			tmp_ptr += LLVFSFileBlock::SERIAL_SIZE;
 		}
-		delete[] buffer;
+		index_blocks.clear();
 
 		std::sort(
 			files_by_loc.begin(),
@@ -442,7 +559,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			if (last_file_block->mLocation > 0)
 			{
 				// If so, create a free block.
-				addFreeBlock(new LLVFSBlock(0, last_file_block->mLocation));
+				addFreeSpace(0, last_file_block->mLocation);
 			}
 
 			// Walk through the 2nd+ block.  If there is a free space
@@ -471,10 +588,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 					if (cur_file_block->mLength > 0)
 					{
 						// convert to hole
-						addFreeBlock(
-							new LLVFSBlock(
-								cur_file_block->mLocation,
-								cur_file_block->mLength));
+						addFreeSpace(cur_file_block->mLocation, cur_file_block->mLength);
 					}
 					lockData();						// needed for sync()
 					sync(cur_file_block, TRUE);		// remove first on disk
@@ -499,7 +613,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 					// Invalid VFS
 					unlockAndClose( mIndexFP );
 					mIndexFP = NULL;
-					LLFile::remove( mIndexFilename );
+					removeIndexFiles( mIndexFilename );
 
 					unlockAndClose( mDataFP );
 					mDataFP = NULL;
@@ -525,7 +639,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 				// we don't want to add empty blocks to the list...
 				if (length > 0)
 				{
-					addFreeBlock(new LLVFSBlock(loc, length));
+					addFreeSpace(loc, length);
 				}
 				last_file_block = cur_file_block;
 				++cur;
@@ -535,12 +649,12 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 			U32 loc = last_file_block->mLocation + last_file_block->mLength;
 			if (loc < data_size)
 			{
-				addFreeBlock(new LLVFSBlock(loc, data_size - loc));
+				addFreeSpace(loc, data_size - loc);
 			}
 		}
 		else // There where no blocks in the file.
 		{
-			addFreeBlock(new LLVFSBlock(0, data_size));
+			addFreeSpace(0, data_size);
 		}
 	}
 	else
@@ -567,8 +681,24 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 		}
 	
 		// no index file, start from scratch w/ 1GB allocation
-		LLVFSBlock *first_block = new LLVFSBlock(0, data_size ? data_size : 0x40000000);
-		addFreeBlock(first_block);
+		addFreeSpace(0, data_size ? data_size : 0x40000000);
+	}
+
+	// Fold the journal (and anything older formats left behind) into a
+	// fresh snapshot, so the next startup only has to read one file.
+	if (!mReadOnly)
+	{
+		if (needs_checkpoint || !mJournalBuffer.empty())
+		{
+			if (!checkpoint())
+			{
+				LL_WARNS("VFS") << "Couldn't write a new VFS index snapshot" << LL_ENDL;
+			}
+		}
+		else
+		{
+			resetJournal();
+		}
 	}
 
 	// Open marker file to look for bad shutdowns
@@ -595,6 +725,17 @@ LLVFS::~LLVFS()
 	{
 		LL_ERRS("VFS") << "LLVFS destroyed with mutex locked" << LL_ENDL;
 	}
+
+	// Leave a snapshot with an empty journal for the next startup
+	if (isValid() && !mReadOnly && !checkpoint())
+	{
+		flushJournal();
+	}
+	if (mJournalFP)
+	{
+		fclose(mJournalFP);
+		mJournalFP = NULL;
+	}
 	
 	unlockAndClose(mIndexFP);
 	mIndexFP = NULL;
@@ -606,9 +747,7 @@ LLVFS::~LLVFS()
 	}
 	mFileBlocks.clear();
 	
-	mFreeBlocksByLength.clear();
-
-	for_each(mFreeBlocksByLocation.begin(), mFreeBlocksByLocation.end(), DeletePairedPointer());
+	mFreeSpace.clear();
     
 	unlockAndClose(mDataFP);
 	mDataFP = NULL;
@@ -632,17 +771,15 @@ void LLVFS::presizeDataFile(const U32 size)
 	}
 
 	// we're creating this file for the first time, size it
-	fseek(mDataFP, size-1, SEEK_SET);
-	S32 tmp = 0;
-	tmp = (S32)fwrite(&tmp, 1, 1, mDataFP);
-	// fflush(mDataFP);
+	U8 tmp = 0;
+	S32 written = writeData(&tmp, size-1, 1);
 
 	// also remove any index, since this vfs is now blank
-	LLFile::remove(mIndexFilename);
+	removeIndexFiles(mIndexFilename);
 
-	if (tmp)
+	if (written == 1)
 	{
-		llinfos << "Pre-sized VFS data file to " << ftell(mDataFP) << " bytes" << llendl;
+		llinfos << "Pre-sized VFS data file to " << size << " bytes" << llendl;
 	}
 	else
 	{
@@ -650,6 +787,104 @@ void LLVFS::presizeDataFile(const U32 size)
 	}
 }
 
+// Reads and writes go straight to the data file at the given offset, with
+// no shared file position, so any number of them can be in flight at once.
+S32 LLVFS::readData(U8 *buffer, U32 location, S32 length)
+{
+	S32 total = 0;
+#if LL_WINDOWS
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(mDataFP));
+	while (total < length)
+	{
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = location + total;
+		DWORD bytes = 0;
+		if (!ReadFile(handle, buffer + total, length - total, &bytes, &overlapped) || !bytes)
+		{
+			break;
+		}
+		total += (S32)bytes;
+	}
+#else
+	int fd = fileno(mDataFP);
+	while (total < length)
+	{
+		ssize_t bytes = pread(fd, buffer + total, length - total, (off_t)location + total);
+		if (bytes < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (bytes <= 0)
+		{
+			break;
+		}
+		total += (S32)bytes;
+	}
+#endif
+	return total;
+}
+
+S32 LLVFS::writeData(const U8 *buffer, U32 location, S32 length)
+{
+	S32 total = 0;
+#if LL_WINDOWS
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(mDataFP));
+	while (total < length)
+	{
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = location + total;
+		DWORD bytes = 0;
+		if (!WriteFile(handle, buffer + total, length - total, &bytes, &overlapped) || !bytes)
+		{
+			break;
+		}
+		total += (S32)bytes;
+	}
+#else
+	int fd = fileno(mDataFP);
+	while (total < length)
+	{
+		ssize_t bytes = pwrite(fd, buffer + total, length - total, (off_t)location + total);
+		if (bytes < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (bytes <= 0)
+		{
+			break;
+		}
+		total += (S32)bytes;
+	}
+#endif
+	return total;
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::waitForIO(const LLVFSFileSpecifier &spec)
+{
+	while (TRUE)
+	{
+		fileblock_map::iterator it = mFileBlocks.find(spec);
+		if (it == mFileBlocks.end() || !it->second->mIOCount)
+		{
+			return;
+		}
+		mDataMutex->wait();
+	}
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::endIO(LLVFSFileBlock *block)
+{
+	llassert(block->mIOCount > 0);
+	if (--block->mIOCount == 0)
+	{
+		mDataMutex->broadcast();
+	}
+}
+
 BOOL LLVFS::getExists(const LLUUID &file_id, const LLAssetType::EType file_type)
 {
 	LLVFSFileBlock *block = NULL;
@@ -733,8 +968,7 @@ BOOL LLVFS::checkAvailable(S32 max_size)
 {
 	lockData();
 	
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(max_size); // first entry >= size
-	const BOOL res(iter == mFreeBlocksByLength.end() ? FALSE : TRUE);
+	const BOOL res(mFreeSpace.getLargestExtent() >= max_size);
 
 	unlockData();
 	
@@ -760,6 +994,8 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 	lockData();
 	
 	LLVFSFileSpecifier spec(file_id, file_type);
+	waitForIO(spec);
+
 	LLVFSFileBlock *block = NULL;
 	fileblock_map::iterator it = mFileBlocks.find(spec);
 	if (it != mFileBlocks.end())
@@ -791,9 +1027,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 		else if (max_size < block->mLength)
 		{
 			// this file is shrinking
-			LLVFSBlock *free_block = new LLVFSBlock(block->mLocation + max_size, block->mLength - max_size);
-
-			addFreeBlock(free_block);
+			addFreeSpace(block->mLocation + max_size, block->mLength - max_size);
     
 			block->mLength = max_size;
     
@@ -805,6 +1039,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			}
     
 			sync(block);
+			mJournalPendingFree = TRUE;
 			//mergeFreeBlocks();
 
 			unlockData();
@@ -816,57 +1051,41 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			// first check for an adjacent free block to grow into
 			S32 size_increase = max_size - block->mLength;
 
-			// Find the first free block with and addres > block->mLocation
-			LLVFSBlock *free_block;
-			blocks_location_map_t::iterator iter = mFreeBlocksByLocation.upper_bound(block->mLocation);
-			if (iter != mFreeBlocksByLocation.end())
+			U32 file_end = block->mLocation + block->mLength;
+			if (mFreeSpace.getFreeAt(file_end) >= size_increase)
 			{
-				free_block = iter->second;
-			
-				if (free_block->mLocation == block->mLocation + block->mLength &&
-					free_block->mLength >= size_increase)
-				{
-					// this free block is at the end of the file and is large enough
+				// the free space right after the file is large enough
 
-					// Must call useFreeSpace before sync(), as sync()
-					// unlocks data structures.
-					useFreeSpace(free_block, size_increase);
-					block->mLength += size_increase;
-					sync(block);
+				// Must call useFreeSpace before sync(), as sync()
+				// unlocks data structures.
+				useFreeSpace(file_end, size_increase);
+				block->mLength += size_increase;
+				sync(block);
 
-					unlockData();
-					return TRUE;
-				}
+				unlockData();
+				return TRUE;
 			}
 			
-			// no adjecent free block, find one in the list
-			free_block = findFreeBlock(max_size, block);
-    
-			if (free_block)
+			// no adjacent free space, find some elsewhere
+			U32 new_data_location = 0;
+			if (findFreeSpace(max_size, new_data_location, block))
 			{
-				// Save location where data is going, useFreeSpace will move free_block->mLocation;
-				U32 new_data_location = free_block->mLocation;
-
-				//mark the free block as used so it does not
-				//interfere with other operations such as addFreeBlock
-				useFreeSpace(free_block, max_size);		// useFreeSpace takes ownership (and may delete) free_block
+				//mark the space as used so it does not
+				//interfere with other operations such as addFreeSpace
+				useFreeSpace(new_data_location, max_size);
 
 				if (block->mLength > 0)
 				{
-					// create a new free block where this file used to be
-					LLVFSBlock *new_free_block = new LLVFSBlock(block->mLocation, block->mLength);
-
-					addFreeBlock(new_free_block);
+					// free the space where this file used to be
+					addFreeSpace(block->mLocation, block->mLength);
 					
 					if (block->mSize > 0)
 					{
 						// move the file into the new block
 						U8 *buffer = new U8[block->mSize];
-						fseek(mDataFP, block->mLocation, SEEK_SET);
-						if (fread(buffer, block->mSize, 1, mDataFP) == 1)
+						if (readData(buffer, block->mLocation, block->mSize) == block->mSize)
 						{
-							fseek(mDataFP, new_data_location, SEEK_SET);
-							if (fwrite(buffer, block->mSize, 1, mDataFP) != 1)
+							if (writeData(buffer, new_data_location, block->mSize) != block->mSize)
 							{
 								llwarns << "Short write" << llendl;
 							}
@@ -884,6 +1103,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 
 
 				sync(block);
+				mJournalPendingFree = TRUE;
 
 				unlockData();
 				return TRUE;
@@ -900,26 +1120,25 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 	}
 	else
 	{
-		// find a free block in the list
-		LLVFSBlock *free_block = findFreeBlock(max_size);
-    
-		if (free_block)
+		// find some free space
+		U32 new_data_location = 0;
+		if (findFreeSpace(max_size, new_data_location))
 		{        
 			if (block)
 			{
-				block->mLocation = free_block->mLocation;
+				block->mLocation = new_data_location;
 				block->mLength = max_size;
 			}
 			else
 			{
 				// this file doesn't exist, create it
-				block = new LLVFSFileBlock(file_id, file_type, free_block->mLocation, max_size);
+				block = new LLVFSFileBlock(file_id, file_type, new_data_location, max_size);
 				mFileBlocks.insert(fileblock_map::value_type(spec, block));
 			}
 
 			// Must call useFreeSpace before sync(), as sync()
 			// unlocks data structures.
-			useFreeSpace(free_block, max_size);
+			useFreeSpace(new_data_location, max_size);
 			block->mAccessTime = (U32)time(NULL);
 
 			sync(block);
@@ -956,6 +1175,8 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 	
 	LLVFSFileSpecifier new_spec(new_id, new_type);
 	LLVFSFileSpecifier old_spec(file_id, file_type);
+	// The target's data is about to be freed
+	waitForIO(new_spec);
 	
 	fileblock_map::iterator it = mFileBlocks.find(old_spec);
 	if (it != mFileBlocks.end())
@@ -990,6 +1211,9 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 			delete dest_block;
 		}
 
+		// the journal is keyed by name, so record the old one going away
+		sync(src_block, TRUE);
+
 		src_block->mFileID = new_id;
 		src_block->mFileType = new_type;
 		src_block->mAccessTime = (U32)time(NULL);
@@ -1015,10 +1239,9 @@ void LLVFS::removeFileBlock(LLVFSFileBlock *fileblock)
 	
 	if (fileblock->mLength > 0)
 	{
-		// turn this file into an empty block
-		LLVFSBlock *free_block = new LLVFSBlock(fileblock->mLocation, fileblock->mLength);
-		
-		addFreeBlock(free_block);
+		// turn this file into free space
+		addFreeSpace(fileblock->mLocation, fileblock->mLength);
+		mJournalPendingFree = TRUE;
 	}
 	
 	fileblock->mLocation = 0;
@@ -1043,6 +1266,8 @@ void LLVFS::removeFile(const LLUUID &file_id, const LLAssetType::EType file_type
     lockData();
 	
 	LLVFSFileSpecifier spec(file_id, file_type);
+	waitForIO(spec);
+
 	fileblock_map::iterator it = mFileBlocks.find(spec);
 	if (it != mFileBlocks.end())
 	{
@@ -1069,7 +1294,7 @@ S32 LLVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8
 	llassert(location >= 0);
 	llassert(length >= 0);
 
-	BOOL do_read = FALSE;
+	LLVFSFileBlock *read_block = NULL;
 	
     lockData();
 	
@@ -1092,17 +1317,25 @@ S32 LLVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8
 				length = block->mSize - location;
 			}
 			location += block->mLocation;
-			do_read = TRUE;
+			if (length > 0)
+			{
+				// Keeps the block where it is until we're done
+				block->mIOCount++;
+				read_block = block;
+			}
 		}
 	}
 
-	if (do_read)
+	unlockData();
+
+	if (read_block)
 	{
-		fseek(mDataFP, location, SEEK_SET);
-		bytesread = (S32)fread(buffer, 1, length, mDataFP);
+		bytesread = readData(buffer, location, length);
+
+		lockData();
+		endIO(read_block);
+		unlockData();
 	}
-	
-	unlockData();
 
 	return bytesread;
 }
@@ -1168,19 +1401,24 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
 			}
 			U32 file_location = location + block->mLocation;
 			
-			fseek(mDataFP, file_location, SEEK_SET);
-			S32 write_len = (S32)fwrite(buffer, 1, length, mDataFP);
+			// Readers don't see the new data until mSize covers it
+			block->mIOCount++;
+			block->mWriteCount++;
+			unlockData();
+
+			S32 write_len = writeData(buffer, file_location, length);
 			if (write_len != length)
 			{
 				llwarns << llformat("VFS Write Error: %d != %d",write_len,length) << llendl;
 			}
-			// fflush(mDataFP);
 			
-			if (location + length > block->mSize)
+			lockData();
+			if (location + write_len > block->mSize)
 			{
 				block->mSize = location + write_len;
 				sync(block);
 			}
+			endIO(block);
 			unlockData();
 			
 			return write_len;
@@ -1232,6 +1470,11 @@ void LLVFS::decLock(const LLUUID &file_id, const LLAssetType::EType file_type, E
 		if (block->mLocks[lock] > 0)
 		{
 			block->mLocks[lock]--;
+			if (!block->mLocks[lock])
+			{
+				// compact() may be able to move it now
+				mCompactIdle = FALSE;
+			}
 		}
 		else
 		{
@@ -1262,190 +1505,259 @@ BOOL LLVFS::isLocked(const LLUUID &file_id, const LLAssetType::EType file_type,
 	return res;
 }
 
-//============================================================================
-// protected
-//============================================================================
+S32 LLVFS::compact(S32 max_bytes, F32 max_time)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+	if (mReadOnly)
+	{
+		return 0;
+	}
 
-void LLVFS::eraseBlockLength(LLVFSBlock *block)
+	lockData();
+
+	// Last files first, each into the first hole before it that fits
+	LLTimer timer;
+	S32 moved = 0;
+	while (moved < max_bytes && !mCompactIdle)
+	{
+		if (max_time > 0.f && moved > 0 && timer.getElapsedTimeF32() > max_time)
+		{
+			break;
+		}
+		if (mCompactQueue.empty())
+		{
+			if (mCompactPassActive)
+			{
+				mCompactPassActive = FALSE;
+				if (!mCompactPassMoved)
+				{
+					// Nothing fitted in the holes before it this pass, so
+					// make a hole bigger for the next one
+					S32 grown = growFreeSpace();
+					moved += grown;
+					if (!grown)
+					{
+						// don't look again until something is freed
+						mCompactIdle = TRUE;
+					}
+					break;
+				}
+			}
+
+			std::vector<LLVFSFileBlock*> files_by_loc;
+			getFilesByLocation(files_by_loc);
+			for (std::vector<LLVFSFileBlock*>::iterator iter = files_by_loc.begin();
+				 iter != files_by_loc.end(); ++iter)
+			{
+				mCompactQueue.push_back(**iter);
+			}
+			if (mCompactQueue.empty())
+			{
+				mCompactIdle = TRUE;
+				break;
+			}
+			mCompactPassActive = TRUE;
+			mCompactPassMoved = FALSE;
+		}
+
+		// Files may have gone or moved since the pass started
+		fileblock_map::iterator it = mFileBlocks.find(mCompactQueue.back());
+		mCompactQueue.pop_back();
+		if (it == mFileBlocks.end() || it->second->mLength <= 0)
+		{
+			continue;
+		}
+		LLVFSFileBlock *block = it->second;
+		S32 size = block->mSize;
+		if (moveFileBlock(block, TRUE))
+		{
+			moved += size;
+			mCompactPassMoved = TRUE;
+		}
+	}
+
+	unlockData();
+
+	return moved;
+}
+
+// mDataMutex must be LOCKED before calling this
+// Moves the file just past the first hole that has one out of the way,
+// so the hole grows big enough for the next pass to fill.  Returns the
+// bytes moved.
+S32 LLVFS::growFreeSpace()
 {
-	// find the corresponding map entry in the length map and erase it
-	S32 length = block->mLength;
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(length);
-	blocks_length_map_t::iterator end = mFreeBlocksByLength.end();
-	bool found_block = false;
-	while(iter != end)
-	{
-		LLVFSBlock *tblock = iter->second;
-		llassert(tblock->mLength == length); // there had -better- be an entry with our length!
-		if (tblock == block)
-		{
-			mFreeBlocksByLength.erase(iter);
-			found_block = true;
+	std::vector<LLVFSFileBlock*> files_by_loc;
+	getFilesByLocation(files_by_loc);
+
+	// moveFileBlock() lets go of the lock while it copies, so pick the
+	// candidates before trying any of them
+	std::vector<LLVFSFileSpecifier> candidates;
+	const LLVFSExtentMap::extent_map_t& extents = mFreeSpace.getExtents();
+	for (LLVFSExtentMap::extent_map_t::const_iterator hole = extents.begin();
+		 hole != extents.end(); ++hole)
+	{
+		const LLVFSBlock hole_end(hole->first + hole->second, 0);
+		std::vector<LLVFSFileBlock*>::iterator next = std::lower_bound(
+			files_by_loc.begin(),
+			files_by_loc.end(),
+			&hole_end,
+			LLVFSFileBlock::locationSortPredicate);
+		if (next == files_by_loc.end())
+		{
+			// the last hole; everything is packed ahead of it
 			break;
 		}
-		++iter;
+		candidates.push_back(**next);
 	}
-	if(!found_block)
+
+	for (std::vector<LLVFSFileSpecifier>::iterator iter = candidates.begin();
+		 iter != candidates.end(); ++iter)
 	{
-		llerrs << "eraseBlock could not find block" << llendl;
+		fileblock_map::iterator it = mFileBlocks.find(*iter);
+		if (it == mFileBlocks.end() || it->second->mLength <= 0)
+		{
+			continue;
+		}
+		S32 size = it->second->mSize;
+		if (moveFileBlock(it->second, FALSE))
+		{
+			return size;
+		}
 	}
+	return 0;
 }
 
+// mDataMutex must be LOCKED before calling this
+void LLVFS::getFilesByLocation(std::vector<LLVFSFileBlock*>& files)
+{
+	files.reserve(mFileBlocks.size());
+	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	{
+		LLVFSFileBlock *block = (*it).second;
+		if (block->mLength > 0)
+		{
+			files.push_back(block);
+		}
+	}
+	std::sort(
+		files.begin(),
+		files.end(),
+		LLVFSFileBlock::locationSortPredicate);
+}
 
-// Remove block from both free lists (by location and by length).
-void LLVFS::eraseBlock(LLVFSBlock *block)
+F32 LLVFS::getFragmentation()
 {
-	eraseBlockLength(block);
-	// find the corresponding map entry in the location map and erase it	
-	U32 location = block->mLocation;
-	llverify(mFreeBlocksByLocation.erase(location) == 1); // we should only have one entry per location.
+	lockData();
+	F32 fragmentation = mFreeSpace.getFragmentation();
+	unlockData();
+	return fragmentation;
 }
 
+//============================================================================
+// protected
+//============================================================================
 
-// Add the region specified by block location and length to the free lists.
-// Also incrementally defragment by merging with previous and next free blocks.
-void LLVFS::addFreeBlock(LLVFSBlock *block)
+// mDataMutex must be LOCKED before calling this
+// Moves a file that isn't open, locked or mid-I/O, either down into the
+// first hole before it that fits or, if not down, into the best fit
+// after it.  Returns FALSE if the file stays put.
+// The data is copied with mDataMutex unlocked.  The block is pinned with
+// mIOCount meanwhile, so it can't be freed, resized or evicted, and the
+// move is dropped if it was written to or is still being read from the
+// old location when the copy is done.
+BOOL LLVFS::moveFileBlock(LLVFSFileBlock *block, BOOL down)
 {
-#if LL_DEBUG
-	size_t dbgcount = mFreeBlocksByLocation.count(block->mLocation);
-	if(dbgcount > 0)
+	if (block->mLocks[VFSLOCK_OPEN] ||
+		block->mLocks[VFSLOCK_READ] ||
+		block->mLocks[VFSLOCK_APPEND] ||
+		block->mIOCount)
 	{
-		llerrs << "addFreeBlock called with block already in list" << llendl;
+		return FALSE;
 	}
-#endif
 
-	// Get a pointer to the next free block (by location).
-	blocks_location_map_t::iterator next_free_it = mFreeBlocksByLocation.lower_bound(block->mLocation);
-
-	// We can merge with previous if it ends at our requested location.
-	LLVFSBlock* prev_block = NULL;
-	bool merge_prev = false;
-	if (next_free_it != mFreeBlocksByLocation.begin())
-	{
-		blocks_location_map_t::iterator prev_free_it = next_free_it;
-		--prev_free_it;
-		prev_block = prev_free_it->second;
-		merge_prev = (prev_block->mLocation + prev_block->mLength == block->mLocation);
-	}
-
-	// We can merge with next if our block ends at the next block's location.
-	LLVFSBlock* next_block = NULL;
-	bool merge_next = false;
-	if (next_free_it != mFreeBlocksByLocation.end())
-	{
-		next_block = next_free_it->second;
-		merge_next = (block->mLocation + block->mLength == next_block->mLocation);
-	}
-
-	if (merge_prev && merge_next)
-	{
-		// llinfos << "VFS merge BOTH" << llendl;
-		// Previous block is changing length (a lot), so only need to update length map.
-		// Next block is going away completely. JC
-		eraseBlockLength(prev_block);
-		eraseBlock(next_block);
-		prev_block->mLength += block->mLength + next_block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block));
-		delete block;
-		block = NULL;
-		delete next_block;
-		next_block = NULL;
-	}
-	else if (merge_prev)
-	{
-		// llinfos << "VFS merge previous" << llendl;
-		// Previous block is maintaining location, only changing length,
-		// therefore only need to update the length map. JC
-		eraseBlockLength(prev_block);
-		prev_block->mLength += block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block)); // multimap insert
-		delete block;
-		block = NULL;
-	}
-	else if (merge_next)
-	{
-		// llinfos << "VFS merge next" << llendl;
-		// Next block is changing both location and length,
-		// so both free lists must update. JC
-		eraseBlock(next_block);
-		next_block->mLocation = block->mLocation;
-		next_block->mLength += block->mLength;
-		// Don't hint here, next_free_it iterator may be invalid.
-		mFreeBlocksByLocation.insert(blocks_location_map_t::value_type(next_block->mLocation, next_block)); // multimap insert
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(next_block->mLength, next_block)); // multimap insert			
-		delete block;
-		block = NULL;
+	U32 new_location = 0;
+	if (down)
+	{
+		if (!mFreeSpace.findFirstFit(block->mLength, block->mLocation, new_location))
+		{
+			return FALSE;
+		}
 	}
-	else
+	else if (!mFreeSpace.findBestFit(block->mLength, new_location) ||
+			 new_location < block->mLocation)
 	{
-		// Can't merge with other free blocks.
-		// Hint that insert should go near next_free_it.
- 		mFreeBlocksByLocation.insert(next_free_it, blocks_location_map_t::value_type(block->mLocation, block)); // multimap insert
- 		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(block->mLength, block)); // multimap insert
+		return FALSE;
+	}
+	// reserved until the move is committed or dropped
+	useFreeSpace(new_location, block->mLength);
+
+	if (block->mSize > 0)
+	{
+		const U32 old_location = block->mLocation;
+		const S32 size = block->mSize;
+		const U32 write_count = block->mWriteCount;
+		block->mIOCount++;
+		unlockData();
+
+		U8 *buffer = new U8[size];
+		BOOL copied = (readData(buffer, old_location, size) == size &&
+					   writeData(buffer, new_location, size) == size);
+		delete[] buffer;
+
+		lockData();
+		endIO(block);
+		if (!copied)
+		{
+			llwarns << "VFS: Couldn't move " << block->mFileID << ":" << block->mFileType << llendl;
+		}
+		if (!copied ||
+			block->mWriteCount != write_count ||
+			block->mIOCount)
+		{
+			addFreeSpace(new_location, block->mLength);
+			return FALSE;
+		}
 	}
+
+	addFreeSpace(block->mLocation, block->mLength);
+	block->mLocation = new_location;
+	sync(block);
+	mJournalPendingFree = TRUE;
+
+	mCompactMoves++;
+	mCompactBytes += block->mSize;
+	return TRUE;
 }
 
-// Superceeded by new addFreeBlock which does incremental free space merging.
-// Incremental is faster overall.
-//void LLVFS::mergeFreeBlocks()
-//{
-// 	if (!isValid())
-// 	{
-// 		llerrs << "Attempting to use invalid VFS!" << llendl;
-// 	}
-// 	// TODO: could we optimize this with hints from the calling code?
-// 	blocks_location_map_t::iterator iter = mFreeBlocksByLocation.begin();	
-// 	blocks_location_map_t::iterator end = mFreeBlocksByLocation.end();	
-// 	LLVFSBlock *first_block = iter->second;
-// 	while(iter != end)
-// 	{
-// 		blocks_location_map_t::iterator first_iter = iter; // save for if we do a merge
-// 		if (++iter == end)
-// 			break;
-// 		LLVFSBlock *second_block = iter->second;
-// 		if (first_block->mLocation + first_block->mLength == second_block->mLocation)
-// 		{
-// 			// remove the first block from the length map
-// 			eraseBlockLength(first_block);
-// 			// merge first_block with second_block, since they're adjacent
-// 			first_block->mLength += second_block->mLength;
-// 			// add the first block to the length map (with the new size)
-// 			mFreeBlocksByLength.insert(blocks_length_map_t::value_type(first_block->mLength, first_block)); // multimap insert
-//
-// 			// erase and delete the second block
-// 			eraseBlock(second_block);
-// 			delete second_block;
-//
-// 			// reset iterator
-// 			iter = first_iter; // haven't changed first_block, so corresponding iterator is still valid
-// 			end = mFreeBlocksByLocation.end();
-// 		}
-// 		first_block = second_block;
-// 	}
-//}
-	
-// length bytes from free_block are going to be used (so they are no longer free)
-void LLVFS::useFreeSpace(LLVFSBlock *free_block, S32 length)
+void LLVFS::addFreeSpace(U32 location, S32 length)
+{
+	mFreeSpace.addFree(location, length);
+	// there may be somewhere new to move files to
+	mCompactIdle = FALSE;
+}
+
+// length bytes at location are going to be used (so they are no longer free)
+void LLVFS::useFreeSpace(U32 location, S32 length)
 {
-	if (free_block->mLength == length)
+	// The index on disk has to stop pointing at freed space before
+	// anything else is written there.
+	if (mJournalPendingFree)
 	{
-		eraseBlock(free_block);
-		delete free_block;
+		flushJournal();
 	}
-	else
-	{
-		eraseBlock(free_block);
-  		
-		free_block->mLocation += length;
-		free_block->mLength -= length;
 
-		addFreeBlock(free_block);
-	}
+	mFreeSpace.useFree(location, length);
 }
 
 // NOTE! mDataMutex must be LOCKED before calling this
-// sync this index entry out to the index file
-// we need to do this constantly to avoid corruption on viewer crash
+// sync this index entry out to the index journal
+// Entries are written in batches, and always before freed space is reused,
+// so a crash can lose recent changes but never leaves the index pointing
+// at another file's data.
 void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 {
 	if (!isValid())
@@ -1467,75 +1779,334 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 		llerrs << "VFS syncing zero-length block" << llendl;
 	}
 
-    BOOL set_index_to_end = FALSE;
-	long seek_pos = block->mIndexLocation;
-		
-	if (-1 == seek_pos)
+	U8 buffer[VFS_JOURNAL_ENTRY_SIZE];
+	if (remove)
+	{
+		// a zero length entry removes the file
+		LLVFSFileBlock removed(block->mFileID, block->mFileType);
+		removed.serialize(buffer);
+	}
+	else
 	{
-		if (!mIndexHoles.empty())
+		block->serialize(buffer);
+	}
+	put_u32(buffer + LLVFSFileBlock::SERIAL_SIZE, calc_crc(buffer, LLVFSFileBlock::SERIAL_SIZE));
+
+	mJournalBuffer.insert(mJournalBuffer.end(), buffer, buffer + VFS_JOURNAL_ENTRY_SIZE);
+	if (mJournalBuffer.size() >= (size_t)(VFS_JOURNAL_BATCH * VFS_JOURNAL_ENTRY_SIZE))
+	{
+		flushJournal();
+	}
+}
+
+// mDataMutex must be LOCKED before calling this
+void LLVFS::flushJournal()
+{
+	if (mJournalBuffer.empty())
+	{
+		return;
+	}
+	if (!mJournalFP)
+	{
+		// nowhere to put it, so write a whole new snapshot instead
+		mCheckpointPending = TRUE;
+		return;
+	}
+
+	if (fwrite(&mJournalBuffer[0], mJournalBuffer.size(), 1, mJournalFP) != 1 ||
+		fflush(mJournalFP))
+	{
+		// a torn entry hides everything after it, so start over
+		llwarns << "Short write to VFS journal" << llendl;
+		mCheckpointPending = TRUE;
+	}
+	mJournalEntries += (S32)(mJournalBuffer.size() / VFS_JOURNAL_ENTRY_SIZE);
+	mJournalBuffer.clear();
+	mJournalPendingFree = FALSE;
+
+	if (mJournalEntries >= llmax(VFS_JOURNAL_CHECKPOINT_MIN, (S32)mFileBlocks.size()))
+	{
+		mCheckpointPending = TRUE;
+	}
+}
+
+// mDataMutex must be LOCKED before calling this
+// Starts an empty journal for the current snapshot
+void LLVFS::resetJournal()
+{
+	if (mJournalFP)
+	{
+		fclose(mJournalFP);
+	}
+
+	std::string journal_filename = mIndexFilename + ".jnl";
+	mJournalFP = LLFile::fopen(journal_filename, "wb");	/* Flawfinder: ignore */
+	if (mJournalFP)
+	{
+		U8 header[VFS_JOURNAL_HEADER_SIZE];
+		put_u32(header, VFS_JOURNAL_MAGIC);
+		put_u32(header + 4, mIndexGeneration);
+		if (fwrite(header, VFS_JOURNAL_HEADER_SIZE, 1, mJournalFP) != 1 ||
+			fflush(mJournalFP))
 		{
-			seek_pos = mIndexHoles.front();
-			mIndexHoles.pop_front();
+			llwarns << "Couldn't write VFS journal " << journal_filename << llendl;
 		}
-		else
+	}
+	else
+	{
+		llwarns << "Couldn't open VFS journal " << journal_filename << llendl;
+	}
+
+	mJournalBuffer.clear();
+	mJournalEntries = 0;
+	mJournalPendingFree = FALSE;
+	mCheckpointPending = FALSE;
+}
+
+// mDataMutex must be LOCKED before calling this
+// Writes every file block to a new snapshot, which replaces the index
+// with a rename so a crash leaves either the old index or the new one.
+BOOL LLVFS::checkpoint()
+{
+	mCheckpointPending = FALSE;
+	if (mReadOnly || !mIndexFP)
+	{
+		return FALSE;
+	}
+
+	std::vector<LLVFSFileBlock*> files_by_loc;
+	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	{
+		LLVFSFileBlock *block = (*it).second;
+		if (block->mLength > 0)
 		{
-			set_index_to_end = TRUE;
+			files_by_loc.push_back(block);
 		}
 	}
+	std::sort(
+		files_by_loc.begin(),
+		files_by_loc.end(),
+		LLVFSFileBlock::locationSortPredicate);
 
-    if (set_index_to_end)
+	U32 generation = mIndexGeneration + 1;
+	S32 count = (S32)files_by_loc.size();
+	S32 crc_offset = VFS_INDEX_HEADER_SIZE + count * LLVFSFileBlock::SERIAL_SIZE;
+	std::vector<U8> buffer(crc_offset + 4);
+	put_u32(&buffer[0], VFS_INDEX_MAGIC);
+	put_u32(&buffer[4], VFS_INDEX_VERSION);
+	put_u32(&buffer[8], generation);
+	put_u32(&buffer[12], (U32)count);
+	for (S32 i = 0; i < count; i++)
 	{
-		// Need fseek/ftell to update the seek_pos and hence data
-		// structures, so can't unlockData() before this.
-		fseek(mIndexFP, 0, SEEK_END);
-		seek_pos = ftell(mIndexFP);
+		files_by_loc[i]->serialize(&buffer[VFS_INDEX_HEADER_SIZE + i * LLVFSFileBlock::SERIAL_SIZE]);
 	}
-	    
-	block->mIndexLocation = seek_pos;
-	if (remove)
+	put_u32(&buffer[crc_offset], calc_crc(&buffer[0], crc_offset));
+
+	std::string temp_filename = mIndexFilename + ".tmp";
+	LLFILE *temp_fp = LLFile::fopen(temp_filename, "wb");	/* Flawfinder: ignore */
+	if (!temp_fp)
 	{
-		mIndexHoles.push_back(seek_pos);
+		llwarns << "Couldn't open " << temp_filename << llendl;
+		return FALSE;
+	}
+	BOOL written = (fwrite(&buffer[0], buffer.size(), 1, temp_fp) == 1);
+	written = (fclose(temp_fp) == 0) && written;
+	if (!written)
+	{
+		llwarns << "Short write to " << temp_filename << llendl;
+		LLFile::remove(temp_filename);
+		return FALSE;
 	}
 
-	U8 buffer[LLVFSFileBlock::SERIAL_SIZE];
-	if (remove)
+	unlockAndClose(mIndexFP);
+	mIndexFP = NULL;
+#if LL_WINDOWS
+	// rename() won't replace an existing file here; finishCheckpoint()
+	// picks up the new snapshot if we die in between.
+	LLFile::remove(mIndexFilename);
+#endif
+	BOOL renamed = (LLFile::rename(temp_filename, mIndexFilename) == 0);
+	if (!renamed)
 	{
-		memset(buffer, 0, LLVFSFileBlock::SERIAL_SIZE);
+		llwarns << "Couldn't rename " << temp_filename << " to " << mIndexFilename << llendl;
+		LLFile::remove(temp_filename);
 	}
-	else
+
+	mIndexFP = openAndLock(mIndexFilename, "r+b", FALSE);
+	if (!mIndexFP)
 	{
-		block->serialize(buffer);
+		llwarns << "Couldn't reopen VFS index " << mIndexFilename << llendl;
+	}
+	if (!renamed)
+	{
+		// the old snapshot and journal are still current
+		return FALSE;
 	}
 
-	// If set_index_to_end, file pointer is already at seek_pos
-	// and we don't need to do anything.  Only seek if not at end.
-	if (!set_index_to_end)
+	mIndexGeneration = generation;
+	resetJournal();
+	return TRUE;
+}
+
+// Adopts a snapshot left behind by a checkpoint that didn't finish, if it
+// is complete and newer than the index, and otherwise throws it away.
+void LLVFS::finishCheckpoint()
+{
+	std::string temp_filename = mIndexFilename + ".tmp";
+	std::vector<U8> temp_buffer;
+	if (!read_index_file(temp_filename, temp_buffer))
 	{
-		fseek(mIndexFP, seek_pos, SEEK_SET);
+		return;
 	}
 
-	if (fwrite(buffer, LLVFSFileBlock::SERIAL_SIZE, 1, mIndexFP) != 1)
+	U32 temp_generation = 0;
+	BOOL adopt = FALSE;
+	if (check_snapshot(temp_buffer, temp_generation))
 	{
-		llwarns << "Short write" << llendl;
+		std::vector<U8> index_buffer;
+		U32 index_generation = 0;
+		adopt = !read_index_file(mIndexFilename, index_buffer) ||
+				!check_snapshot(index_buffer, index_generation) ||
+				temp_generation > index_generation;
 	}
 
-	// *NOTE:  Why was this commented out?
-	// fflush(mIndexFP);
-	
-	return;
+	if (adopt)
+	{
+		LL_INFOS("VFS") << "Finishing interrupted VFS index snapshot " << temp_filename << LL_ENDL;
+#if LL_WINDOWS
+		LLFile::remove(mIndexFilename);
+#endif
+		if (LLFile::rename(temp_filename, mIndexFilename) == 0)
+		{
+			return;
+		}
+	}
+	LLFile::remove(temp_filename);
+}
+
+// Reads the index snapshot and replays the journal over it.  A torn
+// journal entry ends the replay; anything after it was never relied on.
+LLVFS::EIndexState LLVFS::readIndex(std::vector<LLVFSFileBlock*>& blocks, U32& generation, S32& journal_entries) const
+{
+	generation = 0;
+	journal_entries = 0;
+
+	// make sure there's at least one file in an old style index, or
+	// the header of a new one
+	std::vector<U8> buffer;
+	if (!read_index_file(mIndexFilename, buffer) ||
+		buffer.size() < (size_t)VFS_INDEX_HEADER_SIZE)
+	{
+		return INDEX_MISSING;
+	}
+
+	if (get_u32(&buffer[0]) != VFS_INDEX_MAGIC)
+	{
+		// written in place by older viewers, holes and all
+		if (buffer.size() < (size_t)LLVFSFileBlock::SERIAL_SIZE)
+		{
+			return INDEX_MISSING;
+		}
+		S32 index_size = (S32)buffer.size();
+		for (S32 offset = 0; offset + LLVFSFileBlock::SERIAL_SIZE <= index_size; offset += LLVFSFileBlock::SERIAL_SIZE)
+		{
+			LLVFSFileBlock *block = new LLVFSFileBlock();
+			block->deserialize(&buffer[offset], offset);
+			blocks.push_back(block);
+		}
+		return INDEX_LEGACY;
+	}
+
+	if (!check_snapshot(buffer, generation))
+	{
+		return INDEX_CORRUPT;
+	}
+	S32 count = (S32)get_u32(&buffer[12]);
+	for (S32 i = 0; i < count; i++)
+	{
+		S32 offset = VFS_INDEX_HEADER_SIZE + i * LLVFSFileBlock::SERIAL_SIZE;
+		LLVFSFileBlock *block = new LLVFSFileBlock();
+		block->deserialize(&buffer[offset], offset);
+		blocks.push_back(block);
+	}
+
+	std::vector<U8> journal;
+	if (!read_index_file(mIndexFilename + ".jnl", journal) ||
+		journal.size() < (size_t)VFS_JOURNAL_HEADER_SIZE ||
+		get_u32(&journal[0]) != VFS_JOURNAL_MAGIC ||
+		get_u32(&journal[4]) != generation)
+	{
+		// no journal, or one that the snapshot already covers
+		return INDEX_SNAPSHOT;
+	}
+
+	std::map<LLVFSFileSpecifier, S32> block_index;
+	for (S32 i = 0; i < count; i++)
+	{
+		block_index[*blocks[i]] = i;
+	}
+
+	S32 journal_size = (S32)journal.size();
+	for (S32 offset = VFS_JOURNAL_HEADER_SIZE; offset + VFS_JOURNAL_ENTRY_SIZE <= journal_size; offset += VFS_JOURNAL_ENTRY_SIZE)
+	{
+		U8 *entry = &journal[offset];
+		if (get_u32(entry + LLVFSFileBlock::SERIAL_SIZE) != calc_crc(entry, LLVFSFileBlock::SERIAL_SIZE))
+		{
+			break;
+		}
+		journal_entries++;
+
+		LLVFSFileBlock *block = new LLVFSFileBlock();
+		block->deserialize(entry, offset);
+		std::map<LLVFSFileSpecifier, S32>::iterator it = block_index.find(*block);
+		if (it != block_index.end())
+		{
+			delete blocks[it->second];
+			if (block->mLength)
+			{
+				blocks[it->second] = block;
+			}
+			else
+			{
+				blocks[it->second] = NULL;
+				block_index.erase(it);
+				delete block;
+			}
+		}
+		else if (block->mLength)
+		{
+			block_index[*block] = (S32)blocks.size();
+			blocks.push_back(block);
+		}
+		else
+		{
+			delete block;
+		}
+	}
+	blocks.erase(std::remove(blocks.begin(), blocks.end(), (LLVFSFileBlock*)NULL), blocks.end());
+
+	return INDEX_SNAPSHOT;
+}
+
+//static
+void LLVFS::removeIndexFiles(const std::string& index_filename)
+{
+	LLFile::remove(index_filename);
+	LLFile::remove(index_filename + ".jnl");
+	LLFile::remove(index_filename + ".tmp");
 }
 
 // mDataMutex must be LOCKED before calling this
 // Can initiate LRU-based file removal to make space.
 // The immune file block will not be removed.
-LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
+BOOL LLVFS::findFreeSpace(S32 size, U32& location, LLVFSFileBlock *immune)
 {
 	if (!isValid())
 	{
 		llerrs << "Attempting to use invalid VFS!" << llendl;
 	}
 
-	LLVFSBlock *block = NULL;
+	BOOL found = FALSE;
 	BOOL have_lru_list = FALSE;
 	
 	typedef std::set<LLVFSFileBlock*, LLVFSFileBlock_less> lru_set;
@@ -1543,15 +2114,13 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
     
 	LLTimer timer;
 
-	while (! block)
+	while (! found)
 	{
-		// look for a suitable free block
-		blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(size); // first entry >= size
-		if (iter != mFreeBlocksByLength.end())
-			block = iter->second;
+		// look for suitable free space
+		found = mFreeSpace.findBestFit(size, location);
     	
-		// no large enough free blocks, time to clean out some junk
-		if (! block)
+		// no large enough free space, time to clean out some junk
+		if (! found)
 		{
 			// create a list of files sorted by usage time
 			// this is far faster than sorting a linked list
@@ -1565,7 +2134,8 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 						tmp->mLength > 0 &&
 						! tmp->mLocks[VFSLOCK_READ] &&
 						! tmp->mLocks[VFSLOCK_APPEND] &&
-						! tmp->mLocks[VFSLOCK_OPEN])
+						! tmp->mLocks[VFSLOCK_OPEN] &&
+						! tmp->mIOCount)
 					{
 						lru_list.insert(tmp);
 					}
@@ -1625,10 +2195,22 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 	F32 time = timer.getElapsedTimeF32();
 	if (time > 0.5f)
 	{
-		llwarns << "VFS: Spent " << time << " seconds in findFreeBlock!" << llendl;
+		llwarns << "VFS: Spent " << time << " seconds in findFreeSpace!" << llendl;
+	}
+
+	mAllocCount++;
+	mAllocTime += time;
+	mAllocMaxTime = llmax(mAllocMaxTime, time);
+	if (have_lru_list)
+	{
+		mAllocEvictCount++;
+	}
+	if (!found)
+	{
+		mAllocFailCount++;
 	}
 
-	return block;
+	return found;
 }
 
 //============================================================================
@@ -1645,17 +2227,18 @@ void LLVFS::pokeFiles()
 	
 	// only write data if we actually read 4 bytes
 	// otherwise we're writing garbage and screwing up the file
-	fseek(mDataFP, 0, SEEK_SET);
-	if (fread(&word, sizeof(word), 1, mDataFP) == 1)
+	if (readData((U8*)&word, 0, sizeof(word)) == sizeof(word))
 	{
-		fseek(mDataFP, 0, SEEK_SET);
-		if (fwrite(&word, sizeof(word), 1, mDataFP) != 1)
+		if (writeData((U8*)&word, 0, sizeof(word)) != sizeof(word))
 		{
 			llwarns << "Could not write to data file" << llendl;
 		}
-		fflush(mDataFP);
 	}
 
+	if (!mIndexFP)
+	{
+		return;
+	}
 	fseek(mIndexFP, 0, SEEK_SET);
 	if (fread(&word, sizeof(word), 1, mIndexFP) == 1)
 	{
@@ -1679,51 +2262,43 @@ void LLVFS::dumpMap()
 	}
     
 	llinfos << "Free Blocks:" << llendl;
-	for (blocks_location_map_t::iterator iter = mFreeBlocksByLocation.begin(),
-			 end = mFreeBlocksByLocation.end();
-		 iter != end; iter++)
+	const LLVFSExtentMap::extent_map_t& extents = mFreeSpace.getExtents();
+	for (LLVFSExtentMap::extent_map_t::const_iterator iter = extents.begin();
+		 iter != extents.end(); ++iter)
 	{
-		LLVFSBlock *free_block = iter->second;
-		llinfos << "Location: " << free_block->mLocation << "\tLength: " << free_block->mLength << llendl;
+		llinfos << "Location: " << iter->first << "\tLength: " << iter->second << llendl;
 	}
 }
     
 // verify that the index file contents match the in-memory file structure
 // Very slow, do not call routinely. JC
-void LLVFS::audit()
+BOOL LLVFS::audit()
 {
 	// Lock the mutex through this whole function.
 	LLMutexLock lock_data(mDataMutex);
 	
-	fflush(mIndexFP);
+	flushJournal();
 
-	fseek(mIndexFP, 0, SEEK_END);
-	long index_size = ftell(mIndexFP);
-	fseek(mIndexFP, 0, SEEK_SET);
-    
-	BOOL vfs_corrupt = FALSE;
-	
-	U8 *buffer = new U8[index_size];
+	std::vector<LLVFSFileBlock*> audit_blocks;
+	U32 generation = 0;
+	S32 journal_entries = 0;
+	EIndexState index_state = readIndex(audit_blocks, generation, journal_entries);
 
-	if (fread(buffer, 1, index_size, mIndexFP) != index_size)
+	BOOL vfs_corrupt = FALSE;
+	BOOL vfs_mismatch = FALSE;
+	if (index_state == INDEX_CORRUPT || generation != mIndexGeneration)
 	{
-		llwarns << "Index truncated" << llendl;
+		llwarns << "Index unreadable, generation " << generation << " expected " << mIndexGeneration << llendl;
 		vfs_corrupt = TRUE;
 	}
     
-	U8 *tmp_ptr = buffer;
-    
 	std::map<LLVFSFileSpecifier, LLVFSFileBlock*>	found_files;
 	U32 cur_time = (U32)time(NULL);
 
-	std::vector<LLVFSFileBlock*> audit_blocks;
-	while (!vfs_corrupt && tmp_ptr < buffer + index_size)
+	for (std::vector<LLVFSFileBlock*>::iterator iter = audit_blocks.begin();
+		 !vfs_corrupt && iter != audit_blocks.end(); ++iter)
 	{
-		LLVFSFileBlock *block = new LLVFSFileBlock();
-		audit_blocks.push_back(block);
-		
-		block->deserialize(tmp_ptr, (S32)(tmp_ptr - buffer));
-		tmp_ptr += block->SERIAL_SIZE;
+		LLVFSFileBlock *block = *iter;
     
 		// do sanity check on this block
 		if (block->mLength >= 0 &&
@@ -1737,6 +2312,7 @@ void LLVFS::audit()
 			if (mFileBlocks.find(*block) == mFileBlocks.end())
 			{
 				llwarns << "VFile " << block->mFileID << ":" << block->mFileType << " on disk, not in memory, loc " << block->mIndexLocation << llendl;
+				vfs_mismatch = TRUE;
 			}
 			else if (found_files.find(*block) != found_files.end())
 			{
@@ -1762,7 +2338,6 @@ void LLVFS::audit()
 					<< " id " << dupe->mFileID
 					<< " type " << dupe->mFileType
 					<< llendl;
-				llwarns << "VFS: Index size " << index_size << llendl;
 				llwarns << "VFS: INDEX CORRUPT" << llendl;
 				vfs_corrupt = TRUE;
 				break;
@@ -1777,12 +2352,11 @@ void LLVFS::audit()
 			if (block->mLength)
 			{
 				llwarns << "VFile " << block->mFileID << ":" << block->mFileType << " corrupt on disk" << llendl;
+				vfs_mismatch = TRUE;
 			}
 			// else this is just a hole
 		}
 	}
-    
-	delete[] buffer;
 
 	if (!vfs_corrupt)
 	{
@@ -1790,28 +2364,29 @@ void LLVFS::audit()
 		{
 			LLVFSFileBlock* block = (*it).second;
 
-			if (block->mSize > 0)
+			// every block with space allocated has been synced
+			if (block->mLength > 0)
 			{
-				if (! found_files.count(*block))
+				std::map<LLVFSFileSpecifier, LLVFSFileBlock*>::iterator found = found_files.find(*block);
+				if (found == found_files.end())
 				{
-					llwarns << "VFile " << block->mFileID << ":" << block->mFileType << " in memory, not on disk, loc " << block->mIndexLocation<< llendl;
-					fseek(mIndexFP, block->mIndexLocation, SEEK_SET);
-					U8 buf[LLVFSFileBlock::SERIAL_SIZE];
-					if (fread(buf, LLVFSFileBlock::SERIAL_SIZE, 1, mIndexFP) != 1)
-					{
-						llwarns << "VFile " << block->mFileID
-								<< " gave short read" << llendl;
-					}
-    			
-					LLVFSFileBlock disk_block;
-					disk_block.deserialize(buf, block->mIndexLocation);
-				
-					llwarns << "Instead found " << disk_block.mFileID << ":" << block->mFileType << llendl;
+					llwarns << "VFile " << block->mFileID << ":" << block->mFileType << " in memory, not on disk" << llendl;
+					vfs_mismatch = TRUE;
 				}
 				else
 				{
-					block = found_files.find(*block)->second;
-					found_files.erase(*block);
+					LLVFSFileBlock* disk_block = found->second;
+					if (disk_block->mLocation != block->mLocation ||
+						disk_block->mLength != block->mLength ||
+						disk_block->mSize != block->mSize)
+					{
+						llwarns << "VFile " << block->mFileID << ":" << block->mFileType
+							<< " at " << block->mLocation << " length " << block->mLength << " size " << block->mSize
+							<< " in memory, at " << disk_block->mLocation << " length " << disk_block->mLength << " size " << disk_block->mSize
+							<< " on disk" << llendl;
+						vfs_mismatch = TRUE;
+					}
+					found_files.erase(found);
 				}
 			}
 		}
@@ -1821,13 +2396,19 @@ void LLVFS::audit()
 		{
 			LLVFSFileBlock* block = iter->second;
 			llwarns << "VFile " << block->mFileID << ":" << block->mFileType << " szie:" << block->mSize << " leftover" << llendl;
+			vfs_mismatch = TRUE;
 		}
     
-		llinfos << "VFS: audit OK" << llendl;
+		if (!vfs_mismatch)
+		{
+			llinfos << "VFS: audit OK" << llendl;
+		}
 		// mutex released by LLMutexLock() destructor.
 	}
 
 	for_each(audit_blocks.begin(), audit_blocks.end(), DeletePointer());
+
+	return !vfs_corrupt && !vfs_mismatch;
 }
     
     
@@ -1844,15 +2425,6 @@ void LLVFS::checkMem()
 				 block->mFileType < LLAssetType::AT_COUNT &&
 				 block->mFileID != LLUUID::null);
     
-		for (std::deque<S32>::iterator iter = mIndexHoles.begin();
-			 iter != mIndexHoles.end(); ++iter)
-		{
-			S32 index_loc = *iter;
-			if (index_loc == block->mIndexLocation)
-			{
-				llwarns << "VFile block " << block->mFileID << ":" << block->mFileType << " is marked as a hole" << llendl;
-			}
-		}
 	}
     
 	llinfos << "VFS: mem check OK" << llendl;
@@ -1925,30 +2497,31 @@ void LLVFS::dumpStatistics()
 	S32 max_free_size = 0;
 	S32 total_free_size = 0;
 	std::map<S32, S32> free_length_counts;
-	for (blocks_location_map_t::iterator iter = mFreeBlocksByLocation.begin(),
-			 end = mFreeBlocksByLocation.end();
-		 iter != end; iter++)
+	const LLVFSExtentMap::extent_map_t& extents = mFreeSpace.getExtents();
+	for (LLVFSExtentMap::extent_map_t::const_iterator iter = extents.begin();
+		 iter != extents.end(); ++iter)
 	{
-		LLVFSBlock *free_block = iter->second;
-		if (free_block->mLength <= 0)
+		U32 free_location = iter->first;
+		S32 free_length = iter->second;
+		if (free_length <= 0)
 		{
-			llinfos << "Bad free block at: " << free_block->mLocation << "\tLength: " << free_block->mLength << llendl;
+			llinfos << "Bad free block at: " << free_location << "\tLength: " << free_length << llendl;
 		}
 		else
 		{
-			llinfos << "Block: " << free_block->mLocation
-					<< "\tLength: " << free_block->mLength
-					<< "\tEnd: " << free_block->mLocation + free_block->mLength
+			llinfos << "Block: " << free_location
+					<< "\tLength: " << free_length
+					<< "\tEnd: " << free_location + free_length
 					<< llendl;
-			total_free_size += free_block->mLength;
+			total_free_size += free_length;
 		}
 
-		if (free_block->mLength > max_free_size)
+		if (free_length > max_free_size)
 		{
-			max_free_size = free_block->mLength;
+			max_free_size = free_length;
 		}
 
-		free_length_counts[free_block->mLength]++;
+		free_length_counts[free_length]++;
 	}
 
 	// Dump histogram of free block sizes
@@ -1960,17 +2533,12 @@ void LLVFS::dumpStatistics()
 	llinfos << "Invalid blocks: " << invalid_file_count << llendl;
 	llinfos << "File blocks:    " << mFileBlocks.size() << llendl;
 
-	S32 length_list_count = (S32)mFreeBlocksByLength.size();
-	S32 location_list_count = (S32)mFreeBlocksByLocation.size();
-	if (length_list_count == location_list_count)
-	{
-		llinfos << "Free list lengths match, free blocks: " << location_list_count << llendl;
-	}
-	else
+	llinfos << "Free blocks:    " << mFreeSpace.getExtentCount() << llendl;
+	if ((U32)total_free_size != mFreeSpace.getTotalFree())
 	{
-		llwarns << "Free list lengths do not match!" << llendl;
-		llwarns << "By length: " << length_list_count << llendl;
-		llwarns << "By location: " << location_list_count << llendl;
+		llwarns << "Free space total does not match!" << llendl;
+		llwarns << "Counted: " << total_free_size << llendl;
+		llwarns << "Tracked: " << mFreeSpace.getTotalFree() << llendl;
 	}
 	llinfos << "Max file: " << max_file_size/1024 << "K" << llendl;
 	llinfos << "Max free: " << max_free_size/1024 << "K" << llendl;
@@ -1978,6 +2546,17 @@ void LLVFS::dumpStatistics()
 	llinfos << "Total free size: " << total_free_size/1024 << "K" << llendl;
 	llinfos << "Sum: " << (total_file_size + total_free_size) << " bytes" << llendl;
 	llinfos << llformat("%.0f%% full",((F32)(total_file_size)/(F32)(total_file_size+total_free_size))*100.f) << llendl;
+	llinfos << llformat("Fragmentation: %.0f%% of free space outside the largest block",
+						mFreeSpace.getFragmentation() * 100.f) << llendl;
+	llinfos << "Allocations: " << mAllocCount
+			<< " evicting: " << mAllocEvictCount
+			<< " failed: " << mAllocFailCount << llendl;
+	if (mAllocCount)
+	{
+		llinfos << llformat("Allocation time: %.3f ms mean, %.3f ms max",
+							mAllocTime * 1000.0 / mAllocCount, mAllocMaxTime * 1000.f) << llendl;
+	}
+	llinfos << "Compacted: " << mCompactMoves << " files, " << (mCompactBytes >> 10) << "K" << llendl;
 
 	llinfos << " " << llendl;
 	for (std::map<LLAssetType::EType, std::pair<S32,S32> >::iterator iter = filetype_counts.begin();
@@ -1989,20 +2568,17 @@ void LLVFS::dumpStatistics()
 	}
 	
 	// Look for potential merges 
+	if (!extents.empty())
 	{
- 		blocks_location_map_t::iterator iter = mFreeBlocksByLocation.begin();	
- 		blocks_location_map_t::iterator end = mFreeBlocksByLocation.end();	
- 		LLVFSBlock *first_block = iter->second;
- 		while(iter != end)
+ 		LLVFSExtentMap::extent_map_t::const_iterator iter = extents.begin();	
+ 		LLVFSExtentMap::extent_map_t::const_iterator first = iter;	
+ 		while (++iter != extents.end())
  		{
- 			if (++iter == end)
- 				break;
- 			LLVFSBlock *second_block = iter->second;
- 			if (first_block->mLocation + first_block->mLength == second_block->mLocation)
+ 			if (first->first + first->second == iter->first)
  			{
-				llinfos << "Potential merge at " << first_block->mLocation << llendl;
+				llinfos << "Potential merge at " << first->first << llendl;
  			}
- 			first_block = second_block;
+ 			first = iter;
  		}
 	}
 	unlockData();
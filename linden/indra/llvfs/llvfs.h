@@ -34,10 +34,12 @@
 #define LL_LLVFS_H
 
 #include <deque>
+#include <vector>
 #include "lluuid.h"
 #include "linked_lists.h"
 #include "llassettype.h"
 #include "llthread.h"
+#include "llvfsextentmap.h"
 
 enum EVFSValid 
 {
@@ -86,6 +88,8 @@ public:
 	EVFSValid getValidState() const	{ return mValid; }
 
 	// ---------- The following fucntions lock/unlock mDataMutex ----------
+	// getData() and storeData() only hold it to find the file's block; the
+	// disk I/O itself is positional and runs concurrently.
 	BOOL getExists(const LLUUID &file_id, const LLAssetType::EType file_type);
 	S32	 getSize(const LLUUID &file_id, const LLAssetType::EType file_type);
 
@@ -104,6 +108,17 @@ public:
 	void incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
 	void decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
 	BOOL isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
+
+	// Moves files from late in the data file down into free space nearer
+	// the start, so free space gathers into one block at the end.  Files
+	// that are open, locked or being read or written stay put.  Copies at
+	// most max_bytes; returns the bytes copied, 0 once nothing more can
+	// move.  Stops early once max_time seconds have gone by (0 = no limit),
+	// checked between files.  Data is copied without the data lock held.
+	// Meant for idle time; LLVFSThread::compact() runs it on the VFS thread.
+	S32 compact(S32 max_bytes, F32 max_time = 0.f);
+	// Share of the free space that isn't in the largest free block
+	F32 getFragmentation();
 	// ----------------------------------------------------------------
 
 	// Used to trigger evil WinXP behavior of "preloading" entire file into memory.
@@ -111,7 +126,7 @@ public:
 
 	// Verify that the index file contents match the in-memory file structure
 	// Very slow, do not call routinely. JC
-	void audit();
+	BOOL audit();
 	// Check for uninitialized blocks.  Slow, do not call in release. JC
 	void checkMem();
 	// for debugging, prints a map of the vfs
@@ -124,40 +139,90 @@ public:
 protected:
 	void removeFileBlock(LLVFSFileBlock *fileblock);
 	
-	void eraseBlockLength(LLVFSBlock *block);
-	void eraseBlock(LLVFSBlock *block);
-	void addFreeBlock(LLVFSBlock *block);
-	//void mergeFreeBlocks();
-	void useFreeSpace(LLVFSBlock *free_block, S32 length);
+	BOOL moveFileBlock(LLVFSFileBlock *block, BOOL down);
+	S32 growFreeSpace();
+	void getFilesByLocation(std::vector<LLVFSFileBlock*>& files);
+	void addFreeSpace(U32 location, S32 length);
+	void useFreeSpace(U32 location, S32 length);
 	void sync(LLVFSFileBlock *block, BOOL remove = FALSE);
 	void presizeDataFile(const U32 size);
 
+	// The index on disk is a snapshot plus a journal of the changes since.
+	// sync() appends to the journal in batches; flushJournal() writes out
+	// the batch, and must happen before freed space is handed out again.
+	enum EIndexState
+	{
+		INDEX_MISSING,
+		INDEX_LEGACY,		// unversioned array of file blocks
+		INDEX_SNAPSHOT,
+		INDEX_CORRUPT
+	};
+	EIndexState readIndex(std::vector<LLVFSFileBlock*>& blocks, U32& generation, S32& journal_entries) const;
+	void flushJournal();
+	void resetJournal();
+	BOOL checkpoint();
+	void finishCheckpoint();
+	static void removeIndexFiles(const std::string& index_filename);
+
+	// Positional I/O on the data file.  Safe to call without mDataMutex.
+	S32 readData(U8 *buffer, U32 location, S32 length);
+	S32 writeData(const U8 *buffer, U32 location, S32 length);
+
+	// Blocks with I/O in flight can't be moved, freed or evicted.
+	// mDataMutex must be LOCKED; waiting releases it, so callers look the
+	// file up again afterwards.
+	void waitForIO(const LLVFSFileSpecifier &spec);
+	void endIO(LLVFSFileBlock *block);
+
 	static LLFILE *openAndLock(const std::string& filename, const char* mode, BOOL read_lock);
 	static void unlockAndClose(FILE *fp);
 	
 	// Can initiate LRU-based file removal to make space.
 	// The immune file block will not be removed.
-	LLVFSBlock *findFreeBlock(S32 size, LLVFSFileBlock *immune = NULL);
+	BOOL findFreeSpace(S32 size, U32& location, LLVFSFileBlock *immune = NULL);
 
 	// lock/unlock data mutex (mDataMutex)
 	void lockData() { mDataMutex->lock(); }
-	void unlockData() { mDataMutex->unlock(); }	
+	void unlockData()
+	{
+		// Nothing is mid-update here, so it's a safe point for a snapshot
+		if (mCheckpointPending) checkpoint();
+		mDataMutex->unlock();
+	}
 	
 protected:
-	LLMutex* mDataMutex;
+	LLCondition* mDataMutex;	// signalled when a block's I/O count drops to zero
 	
 	typedef std::map<LLVFSFileSpecifier, LLVFSFileBlock*> fileblock_map;
 	fileblock_map mFileBlocks;
 
-	typedef std::multimap<S32, LLVFSBlock*>	blocks_length_map_t;
-	blocks_length_map_t 	mFreeBlocksByLength;
-	typedef std::multimap<U32, LLVFSBlock*>	blocks_location_map_t;
-	blocks_location_map_t 	mFreeBlocksByLocation;
+	LLVFSExtentMap mFreeSpace;
+
+	// allocation and compaction statistics, for dumpStatistics()
+	S32 mAllocCount;
+	S32 mAllocEvictCount;	// needed files evicted to make room
+	S32 mAllocFailCount;
+	F64 mAllocTime;
+	F32 mAllocMaxTime;
+	S32 mCompactMoves;
+	U64 mCompactBytes;
+	BOOL mCompactIdle;		// nothing could move, and nothing has been freed since
+
+	// compact() works through the files from the end of the data file
+	// over as many calls as it takes
+	std::vector<LLVFSFileSpecifier> mCompactQueue;	// files left this pass, last on top
+	BOOL mCompactPassActive;
+	BOOL mCompactPassMoved;	// something moved since the pass started
 
 	LLFILE *mDataFP;
 	LLFILE *mIndexFP;
+	LLFILE *mJournalFP;
 
-	std::deque<S32> mIndexHoles;
+	std::vector<U8> mJournalBuffer;	// entries not yet written to mJournalFP
+	S32 mJournalEntries;			// entries written since the last snapshot
+	BOOL mJournalPendingFree;		// buffered entries free up space
+	BOOL mCheckpointPending;
+	U32 mIndexGeneration;
 
 	std::string mIndexFilename;
 	std::string mDataFilename;
@@ -0,0 +1,180 @@
+/** 
+ * @file llvfsextentmap.cpp
+ * @brief Free space extents for LLVFS
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llvfsextentmap.h"
+
+LLVFSExtentMap::LLVFSExtentMap()
+:	mTotalFree(0)
+{
+}
+
+void LLVFSExtentMap::clear()
+{
+	mByLocation.clear();
+	mByLength.clear();
+	mTotalFree = 0;
+}
+
+void LLVFSExtentMap::insertExtent(U32 location, S32 length)
+{
+	mByLocation[location] = length;
+	mByLength.insert(std::make_pair(length, location));
+	mTotalFree += length;
+}
+
+void LLVFSExtentMap::eraseExtent(extent_map_t::iterator iter)
+{
+	mByLength.erase(std::make_pair(iter->second, iter->first));
+	mTotalFree -= iter->second;
+	mByLocation.erase(iter);
+}
+
+void LLVFSExtentMap::addFree(U32 location, S32 length)
+{
+	if (length <= 0)
+	{
+		return;
+	}
+
+	extent_map_t::iterator next = mByLocation.lower_bound(location);
+	if (next != mByLocation.end() && location + length > next->first)
+	{
+		llerrs << "VFS freeing " << length << " bytes at " << location
+			<< " over free space at " << next->first << llendl;
+	}
+	if (next != mByLocation.begin())
+	{
+		extent_map_t::iterator prev = next;
+		--prev;
+		if (prev->first + prev->second > location)
+		{
+			llerrs << "VFS freeing " << length << " bytes at " << location
+				<< " over free space at " << prev->first << llendl;
+		}
+		if (prev->first + prev->second == location)
+		{
+			// grow the previous extent down over this one
+			location = prev->first;
+			length += prev->second;
+			eraseExtent(prev);
+		}
+	}
+	if (next != mByLocation.end() && location + length == next->first)
+	{
+		length += next->second;
+		eraseExtent(next);
+	}
+
+	insertExtent(location, length);
+}
+
+void LLVFSExtentMap::useFree(U32 location, S32 length)
+{
+	if (length <= 0)
+	{
+		return;
+	}
+
+	extent_map_t::iterator iter = mByLocation.upper_bound(location);
+	if (iter == mByLocation.begin())
+	{
+		llerrs << "VFS using " << length << " bytes at " << location << " that aren't free" << llendl;
+		return;
+	}
+	--iter;
+
+	U32 extent_location = iter->first;
+	S32 extent_length = iter->second;
+	if (location + length > extent_location + extent_length)
+	{
+		llerrs << "VFS using " << length << " bytes at " << location << " that aren't free" << llendl;
+		return;
+	}
+
+	eraseExtent(iter);
+	if (location > extent_location)
+	{
+		insertExtent(extent_location, location - extent_location);
+	}
+	U32 end = location + length;
+	if (end < extent_location + extent_length)
+	{
+		insertExtent(end, extent_location + extent_length - end);
+	}
+}
+
+BOOL LLVFSExtentMap::findBestFit(S32 length, U32& location) const
+{
+	length_set_t::const_iterator iter = mByLength.lower_bound(std::make_pair(length, (U32)0));
+	if (iter == mByLength.end())
+	{
+		return FALSE;
+	}
+	location = iter->second;
+	return TRUE;
+}
+
+BOOL LLVFSExtentMap::findFirstFit(S32 length, U32 limit, U32& location) const
+{
+	if (getLargestExtent() < length)
+	{
+		// nothing anywhere fits, no need to walk the extents
+		return FALSE;
+	}
+	for (extent_map_t::const_iterator iter = mByLocation.begin();
+		 iter != mByLocation.end() && iter->first < limit; ++iter)
+	{
+		if (iter->second >= length)
+		{
+			location = iter->first;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+S32 LLVFSExtentMap::getFreeAt(U32 location) const
+{
+	extent_map_t::const_iterator iter = mByLocation.find(location);
+	return iter == mByLocation.end() ? 0 : iter->second;
+}
+
+F32 LLVFSExtentMap::getFragmentation() const
+{
+	if (!mTotalFree)
+	{
+		return 0.f;
+	}
+	return 1.f - (F32)getLargestExtent() / (F32)mTotalFree;
+}
@@ -0,0 +1,86 @@
+/** 
+ * @file llvfsextentmap.h
+ * @brief Free space extents for LLVFS
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLVFSEXTENTMAP_H
+#define LL_LLVFSEXTENTMAP_H
+
+#include <map>
+#include <set>
+
+// The free space in a VFS data file, as extents indexed both by location
+// and by (length, location).  Adjacent extents are always merged, so each
+// run of free space is exactly one extent.  Allocation is best fit, taking
+// the lowest addressed of equally good extents, which keeps live data
+// packed toward the start of the file.
+class LLVFSExtentMap
+{
+public:
+	typedef std::map<U32, S32> extent_map_t;	// location -> length
+
+	LLVFSExtentMap();
+
+	void clear();
+
+	// Frees [location, location + length), merging with the neighbours.
+	// The range must not overlap free space.
+	void addFree(U32 location, S32 length);
+	// Takes [location, location + length) out of the free extent that
+	// holds it, which may split it in two.
+	void useFree(U32 location, S32 length);
+
+	// The best fit for length bytes.  Returns FALSE if no extent is large enough.
+	BOOL findBestFit(S32 length, U32& location) const;
+	// The lowest addressed extent before limit that holds length bytes.
+	BOOL findFirstFit(S32 length, U32 limit, U32& location) const;
+	// Length of the free extent starting at location, or 0
+	S32 getFreeAt(U32 location) const;
+
+	S32 getExtentCount() const		{ return (S32)mByLocation.size(); }
+	S32 getLargestExtent() const	{ return mByLength.empty() ? 0 : mByLength.rbegin()->first; }
+	U32 getTotalFree() const		{ return mTotalFree; }
+	// 0 when the free space is all in one extent, toward 1 as it splinters
+	F32 getFragmentation() const;
+
+	const extent_map_t& getExtents() const { return mByLocation; }
+
+private:
+	typedef std::set<std::pair<S32, U32> > length_set_t;	// (length, location)
+
+	void insertExtent(U32 location, S32 length);
+	void eraseExtent(extent_map_t::iterator iter);
+
+	extent_map_t mByLocation;
+	length_set_t mByLength;
+	U32 mTotalFree;
+};
+
+#endif // LL_LLVFSEXTENTMAP_H
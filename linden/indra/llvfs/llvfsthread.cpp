@@ -167,6 +167,24 @@ S32 LLVFSThread::writeImmediate(LLVFS* vfs, const LLUUID &file_id, const LLAsset
 	return res;
 }
 
+LLVFSThread::handle_t LLVFSThread::compact(LLVFS* vfs, S32 max_bytes, S32 max_ms, U32 flags)
+{
+	handle_t handle = generateHandle();
+
+	// max_ms is passed as "offset"
+	Request* req = new Request(handle, 0, flags, FILE_COMPACT, vfs, LLUUID::null, LLAssetType::AT_NONE,
+							   NULL, max_ms, max_bytes);
+
+	bool res = addRequest(req);
+	if (!res)
+	{
+		llerrs << "LLVFSThread::compact called after LLVFSThread::cleanupClass()" << llendl;
+		req->deleteRequest();
+		handle = nullHandle();
+	}
+
+	return handle;
+}
 
 // LLVFSThread::handle_t LLVFSThread::rename(LLVFS* vfs, const LLUUID &file_id, const LLAssetType::EType file_type,
 // 										  const LLUUID &new_id, const LLAssetType::EType new_type, U32 flags)
@@ -205,7 +223,7 @@ LLVFSThread::Request::Request(handle_t handle, U32 priority, U32 flags,
 	mBytes(numbytes),
 	mBytesRead(0)
 {
-	llassert(mBuffer);
+	llassert(mBuffer || mOperation == FILE_COMPACT);
 
 	if (numbytes <= 0 && mOperation != FILE_RENAME)
 	{
@@ -227,6 +245,10 @@ LLVFSThread::Request::Request(handle_t handle, U32 priority, U32 flags,
 	{
 		mVFS->incLock(mFileID, mFileType, VFSLOCK_APPEND);
 	}
+	else if (mOperation == FILE_COMPACT)
+	{
+		// compact() leaves locked files where they are
+	}
 	else // if (mOperation == FILE_READ)
 	{
 		mVFS->incLock(mFileID, mFileType, VFSLOCK_READ);
@@ -244,6 +266,10 @@ void LLVFSThread::Request::finishRequest(bool completed)
 	{
 		mVFS->decLock(mFileID, mFileType, VFSLOCK_APPEND);
 	}
+	else if (mOperation == FILE_COMPACT)
+	{
+		// nothing was locked
+	}
 	else // if (mOperation == FILE_READ)
 	{
 		mVFS->decLock(mFileID, mFileType, VFSLOCK_READ);
@@ -296,6 +322,11 @@ bool LLVFSThread::Request::processRequest()
 		complete = true;
 		//llinfos << llformat("LLVFSThread::RENAME '%s': %d bytes arg:%d",getFilename(),mBytesRead) << llendl;
 	}
+	else if (mOperation == FILE_COMPACT)
+	{
+		mBytesRead = mVFS->compact(mBytes, (F32)mOffset * .001f);
+		complete = true;
+	}
 	else
 	{
 		llerrs << llformat("LLVFSThread::unknown operation: %d", mOperation) << llendl;
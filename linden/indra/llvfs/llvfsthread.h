@@ -53,7 +53,8 @@ public:
 	enum operation_t {
 		FILE_READ,
 		FILE_WRITE,
-		FILE_RENAME
+		FILE_RENAME,
+		FILE_COMPACT
 	};
 
 	//------------------------------------------------------------------------
@@ -105,9 +106,9 @@ public:
 		LLAssetType::EType mFileType;
 		
 		U8* mBuffer;	// dest for reads, source for writes, new UUID for rename
-		S32 mOffset;	// offset into file, -1 = append (WRITE only)
-		S32 mBytes;		// bytes to read from file, -1 = all (new mFileType for rename)
-		S32	mBytesRead;	// bytes read from file
+		S32 mOffset;	// offset into file, -1 = append (WRITE only) (time limit in ms for compact)
+		S32 mBytes;		// bytes to read from file, -1 = all (new mFileType for rename, max bytes for compact)
+		S32	mBytesRead;	// bytes read from file (bytes moved for compact)
 	};
 
 	//------------------------------------------------------------------------
@@ -132,6 +133,9 @@ public:
 					  U8* buffer, S32 offset, S32 numbytes);
 	S32 writeImmediate(LLVFS* vfs, const LLUUID &file_id, const LLAssetType::EType file_type,
 					   U8* buffer, S32 offset, S32 numbytes);
+	// Runs LLVFS::compact() on this thread, behind any reads and writes
+	// already queued
+	handle_t compact(LLVFS* vfs, S32 max_bytes, S32 max_ms, U32 flags);
 
 	/*virtual*/ bool processRequest(QueuedRequest* req);
 
@@ -0,0 +1,505 @@
+/** 
+ * @file message_replay.cpp
+ * @brief Replays captured UDP traffic through the message system and reports per-message costs.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+// Feeds a packet capture (see LLPacketCapture and the viewer's
+// MessageCaptureFile setting) through LLPacketRing, LLCircuit and
+// LLTemplateMessageReader exactly as LLMessageSystem::checkMessages()
+// sees live traffic, and reports what each message type costs.
+//
+// Every template's handler is wrapped so the time and allocations spent
+// inside it can be separated from the receive path (zero code expansion,
+// circuit and ack bookkeeping, template decode).  Messages without a
+// registered handler get one that reads every variable of every block,
+// which approximates a handler consuming the whole message.
+
+#include "linden_common.h"
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+#include <set>
+#include <vector>
+
+#include "apr_getopt.h"
+#include "apr_pools.h"
+
+#include "llapr.h"
+#include "llerrorcontrol.h"
+#include "llfasttimer.h"
+#include "llpacketcapture.h"
+#include "llversionviewer.h"
+#include "message.h"
+#include "llmessagetemplate.h"
+#include "net.h"
+
+//
+// Allocation counting.  Only operator new is tracked; the message system
+// does not call malloc directly on its receive path.
+//
+static U64 sAllocCount = 0;
+static U64 sAllocBytes = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+	++sAllocCount;
+	sAllocBytes += size;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+	++sAllocCount;
+	sAllocBytes += size;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+//
+// Per message type statistics.
+//
+struct LLReplayMessageStats
+{
+	LLReplayMessageStats()
+	:	mName(NULL),
+		mTemplate(NULL),
+		mHandlerFunc(NULL),
+		mHandlerUserData(NULL),
+		mCount(0),
+		mBytes(0),
+		mDecodeClocks(0),
+		mHandlerClocks(0),
+		mMaxClocks(0),
+		mDecodeAllocs(0),
+		mHandlerAllocs(0)
+	{
+	}
+
+	U64 getTotalClocks() const				{ return mDecodeClocks + mHandlerClocks; }
+
+	const char*							mName;
+	const LLMessageTemplate*			mTemplate;
+	LLMessageTemplate::handler_func_t	mHandlerFunc;
+	void**								mHandlerUserData;
+	U32									mCount;
+	U64									mBytes;
+	U64									mDecodeClocks;
+	U64									mHandlerClocks;
+	U64									mMaxClocks;
+	U64									mDecodeAllocs;
+	U64									mHandlerAllocs;
+};
+
+struct LLReplayStatsCompare
+{
+	bool operator()(const LLReplayMessageStats* lhs, const LLReplayMessageStats* rhs) const
+	{
+		return lhs->getTotalClocks() > rhs->getTotalClocks();
+	}
+};
+
+// Filled in by replay_handler() for the packet currently being processed.
+static LLReplayMessageStats* sCurrentStats = NULL;
+static U64 sCurrentHandlerClocks = 0;
+static U64 sCurrentHandlerAllocs = 0;
+
+static void drain_message(LLMessageSystem* msg, const LLMessageTemplate* templatep)
+{
+	static U8 scratch[NET_BUFFER_SIZE];		/* Flawfinder: ignore */
+
+	LLMessageTemplate::message_block_map_t::const_iterator block_iter = templatep->mMemberBlocks.begin();
+	LLMessageTemplate::message_block_map_t::const_iterator block_end = templatep->mMemberBlocks.end();
+	for (; block_iter != block_end; ++block_iter)
+	{
+		const LLMessageBlock* blockp = *block_iter;
+		S32 count = msg->getNumberOfBlocksFast(blockp->mName);
+		for (S32 blocknum = 0; blocknum < count; ++blocknum)
+		{
+			LLMessageBlock::message_variable_map_t::const_iterator var_iter = blockp->mMemberVariables.begin();
+			LLMessageBlock::message_variable_map_t::const_iterator var_end = blockp->mMemberVariables.end();
+			for (; var_iter != var_end; ++var_iter)
+			{
+				const char* varname = (*var_iter)->getName();
+				S32 size = msg->getSizeFast(blockp->mName, blocknum, varname);
+				if (size > 0)
+				{
+					msg->getBinaryDataFast(blockp->mName, varname, scratch, size, blocknum, NET_BUFFER_SIZE);
+				}
+			}
+		}
+	}
+}
+
+static void replay_handler(LLMessageSystem* msg, void** user_data)
+{
+	LLReplayMessageStats* stats = (LLReplayMessageStats*)user_data;
+	sCurrentStats = stats;
+
+	U64 allocs = sAllocCount;
+	U64 start = get_cpu_clock_count();
+	if (stats->mHandlerFunc)
+	{
+		stats->mHandlerFunc(msg, stats->mHandlerUserData);
+	}
+	else
+	{
+		drain_message(msg, stats->mTemplate);
+	}
+	sCurrentHandlerClocks = get_cpu_clock_count() - start;
+	sCurrentHandlerAllocs = sAllocCount - allocs;
+}
+
+static void wrap_handlers(std::vector<LLReplayMessageStats*>& all_stats)
+{
+	const LLMessageSystem::message_template_name_map_t& templates = gMessageSystem->getMessageTemplates();
+	LLMessageSystem::message_template_name_map_t::const_iterator iter = templates.begin();
+	for (; iter != templates.end(); ++iter)
+	{
+		LLMessageTemplate* templatep = iter->second;
+
+		LLReplayMessageStats* stats = new LLReplayMessageStats;
+		stats->mName = templatep->mName;
+		stats->mTemplate = templatep;
+		stats->mHandlerFunc = templatep->getHandlerFunc();
+		stats->mHandlerUserData = templatep->getHandlerUserData();
+		all_stats.push_back(stats);
+
+		templatep->setHandlerFunc(replay_handler, (void**)stats);
+	}
+}
+
+struct LLCapturedPacket
+{
+	LLHost				mSender;
+	std::vector<char>	mData;
+};
+
+static bool load_capture(const std::string& filename, std::vector<LLCapturedPacket>& packets)
+{
+	LLPacketCapture capture;
+	if (!capture.openForRead(filename))
+	{
+		return false;
+	}
+
+	char buffer[NET_BUFFER_SIZE];		/* Flawfinder: ignore */
+	LLHost sender;
+	S32 size;
+	while ((size = capture.readPacket(sender, buffer)) > 0)
+	{
+		packets.push_back(LLCapturedPacket());
+		packets.back().mSender = sender;
+		packets.back().mData.assign(buffer, buffer + size);
+	}
+	return size == 0;
+}
+
+static void reset_circuits(const std::set<LLHost>& senders)
+{
+	// Fresh circuits each pass, so packet ids and resend flags from the
+	// previous pass do not turn into duplicates or lost packet reports.
+	std::set<LLHost>::const_iterator iter = senders.begin();
+	for (; iter != senders.end(); ++iter)
+	{
+		if (gMessageSystem->mCircuitInfo.findCircuit(*iter))
+		{
+			gMessageSystem->mCircuitInfo.removeCircuitData(*iter);
+		}
+		gMessageSystem->enableCircuit(*iter, TRUE);
+	}
+}
+
+static void report(std::ostream& s, std::vector<LLReplayMessageStats*> all_stats,
+				   const LLReplayMessageStats& rejected, U64 ack_clocks,
+				   U32 packets, U64 bytes, U64 wall_clocks)
+{
+	const F64 usec_per_clock = 1000000.0 / (F64)LLFastTimer::countsPerSecond();
+	std::sort(all_stats.begin(), all_stats.end(), LLReplayStatsCompare());
+
+	s << llformat("%-35s%9s%10s%11s%11s%10s%10s%10s",
+				  "Message", "Count", "Bytes", "Decode us", "Handler us",
+				  "Max us", "Dec alloc", "Hnd alloc") << std::endl;
+
+	std::vector<LLReplayMessageStats*>::const_iterator iter = all_stats.begin();
+	for (; iter != all_stats.end(); ++iter)
+	{
+		const LLReplayMessageStats* stats = *iter;
+		if (!stats->mCount)
+		{
+			continue;
+		}
+		F64 count = (F64)stats->mCount;
+		s << llformat("%-35s%9u%10llu%11.3f%11.3f%10.1f%10.2f%10.2f",
+					  stats->mName, stats->mCount, stats->mBytes,
+					  stats->mDecodeClocks * usec_per_clock / count,
+					  stats->mHandlerClocks * usec_per_clock / count,
+					  stats->mMaxClocks * usec_per_clock,
+					  stats->mDecodeAllocs / count,
+					  stats->mHandlerAllocs / count) << std::endl;
+	}
+
+	if (rejected.mCount)
+	{
+		s << llformat("%-35s%9u%10llu%11.3f%11s%10.1f%10.2f%10s",
+					  "(rejected)", rejected.mCount, rejected.mBytes,
+					  rejected.mDecodeClocks * usec_per_clock / (F64)rejected.mCount, "-",
+					  rejected.mMaxClocks * usec_per_clock,
+					  rejected.mDecodeAllocs / (F64)rejected.mCount, "-") << std::endl;
+	}
+
+	F64 wall_sec = wall_clocks * usec_per_clock / 1000000.0;
+	s << std::endl;
+	s << "Packets:          " << packets << " (" << bytes << " bytes)" << std::endl;
+	s << "Ack processing:   " << llformat("%.3f", ack_clocks * usec_per_clock / 1000.0) << " ms" << std::endl;
+	s << "Wall time:        " << llformat("%.3f", wall_sec * 1000.0) << " ms" << std::endl;
+	if (wall_sec > 0.0)
+	{
+		s << "Packets/sec:      " << llformat("%.0f", packets / wall_sec) << std::endl;
+	}
+}
+
+static const apr_getopt_option_t REPLAY_CL_OPTIONS[] =
+{
+	{"help", 'h', 0, "Print the help message."},
+	{"template", 't', 1, "Path to message_template.msg (default: ./message_template.msg)."},
+	{"loops", 'l', 1, "Replay the capture this many times (default: 1)."},
+	{"frame", 'f', 1, "Packets per simulated frame between processAcks() calls (default: 64)."},
+	{"debug", 'd', 0, "Emit full debug logs."},
+	{0, 0, 0, 0}
+};
+
+void stream_usage(std::ostream& s, const char* app)
+{
+	s << "Usage: " << app << " [OPTIONS] <capture file>" << std::endl
+	  << std::endl;
+
+	s << "Replays a packet capture through the message system and reports" << std::endl
+	  << "decode time, handler time and allocations per message type." << std::endl
+	  << "Captures are recorded by the viewer when MessageCaptureFile is set." << std::endl << std::endl;
+
+	s << "Options: " << std::endl;
+	const apr_getopt_option_t* option = &REPLAY_CL_OPTIONS[0];
+	while(option->name)
+	{
+		s << "  ";
+		s << "  -" << (char)option->optch << ", --" << option->name
+		  << std::endl;
+		s << "\t" << option->description << std::endl << std::endl;
+		++option;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	LLError::initForApplication(".");
+	LLError::setDefaultLevel(LLError::LEVEL_WARN);
+
+	ll_init_apr();
+
+	apr_pool_t* pool = NULL;
+	if(APR_SUCCESS != apr_pool_create(&pool, NULL))
+	{
+		std::cerr << "Unable to initialize pool" << std::endl;
+		return 1;
+	}
+	apr_getopt_t* os = NULL;
+	if(APR_SUCCESS != apr_getopt_init(&os, pool, argc, argv))
+	{
+		std::cerr << "Unable to parse options" << std::endl;
+		return 1;
+	}
+
+	std::string template_path("message_template.msg");
+	S32 loops = 1;
+	S32 frame_packets = 64;
+
+	apr_status_t apr_err;
+	const char* opt_arg = NULL;
+	int opt_id = 0;
+	while(true)
+	{
+		apr_err = apr_getopt_long(os, REPLAY_CL_OPTIONS, &opt_id, &opt_arg);
+		if(APR_STATUS_IS_EOF(apr_err)) break;
+		if(apr_err)
+		{
+			char buf[255];		/* Flawfinder: ignore */
+			std::cerr << "Error parsing options: "
+					  << apr_strerror(apr_err, buf, 255) << std::endl;
+			return 1;
+		}
+		switch (opt_id)
+		{
+		case 'h':
+			stream_usage(std::cout, argv[0]);
+			return 0;
+		case 't':
+			template_path.assign(opt_arg);
+			break;
+		case 'l':
+			loops = llmax(1, atoi(opt_arg));
+			break;
+		case 'f':
+			frame_packets = llmax(1, atoi(opt_arg));
+			break;
+		case 'd':
+			LLError::setDefaultLevel(LLError::LEVEL_DEBUG);
+			break;
+		default:
+			stream_usage(std::cerr, argv[0]);
+			return 1;
+		}
+	}
+
+	if (os->ind >= argc)
+	{
+		stream_usage(std::cerr, argv[0]);
+		return 1;
+	}
+	std::string capture_path(argv[os->ind]);
+
+	std::vector<LLCapturedPacket> packets;
+	if (!load_capture(capture_path, packets))
+	{
+		std::cerr << "Unable to read capture " << capture_path << std::endl;
+		return 1;
+	}
+	if (packets.empty())
+	{
+		std::cerr << capture_path << " contains no packets" << std::endl;
+		return 1;
+	}
+
+	if (!start_messaging_system(template_path,
+								NET_USE_OS_ASSIGNED_PORT,
+								LL_VERSION_MAJOR,
+								LL_VERSION_MINOR,
+								LL_VERSION_PATCH,
+								FALSE,
+								std::string(),
+								NULL,
+								false,
+								5.f,
+								100.f))
+	{
+		std::cerr << "Unable to start the message system with " << template_path << std::endl;
+		return 1;
+	}
+
+	// The replay queue stands in for the socket; anything the message
+	// system tries to send back (acks, ping replies) is discarded.
+	gMessageSystem->mPacketRing.setReplayMode(TRUE);
+
+	std::vector<LLReplayMessageStats*> all_stats;
+	wrap_handlers(all_stats);
+	LLReplayMessageStats rejected;
+
+	std::set<LLHost> senders;
+	for (std::vector<LLCapturedPacket>::const_iterator iter = packets.begin(); iter != packets.end(); ++iter)
+	{
+		senders.insert(iter->mSender);
+	}
+
+	U32 total_packets = 0;
+	U64 total_bytes = 0;
+	U64 ack_clocks = 0;
+	U64 wall_start = get_cpu_clock_count();
+	for (S32 loop = 0; loop < loops; ++loop)
+	{
+		reset_circuits(senders);
+
+		S32 frame_count = 0;
+		for (std::vector<LLCapturedPacket>::const_iterator iter = packets.begin(); iter != packets.end(); ++iter)
+		{
+			const LLCapturedPacket& packet = *iter;
+			S32 size = (S32)packet.mData.size();
+			gMessageSystem->mPacketRing.injectPacket(packet.mSender, &packet.mData[0], size);
+
+			sCurrentStats = NULL;
+			sCurrentHandlerClocks = 0;
+			sCurrentHandlerAllocs = 0;
+
+			U64 allocs = sAllocCount;
+			U64 start = get_cpu_clock_count();
+			gMessageSystem->checkMessages(frame_count);
+			U64 clocks = get_cpu_clock_count() - start;
+			allocs = sAllocCount - allocs;
+
+			LLReplayMessageStats* stats = sCurrentStats ? sCurrentStats : &rejected;
+			stats->mCount++;
+			stats->mBytes += size;
+			stats->mDecodeClocks += clocks - sCurrentHandlerClocks;
+			stats->mHandlerClocks += sCurrentHandlerClocks;
+			stats->mMaxClocks = llmax(stats->mMaxClocks, clocks);
+			stats->mDecodeAllocs += allocs - sCurrentHandlerAllocs;
+			stats->mHandlerAllocs += sCurrentHandlerAllocs;
+
+			total_packets++;
+			total_bytes += size;
+
+			if (total_packets % frame_packets == 0)
+			{
+				start = get_cpu_clock_count();
+				gMessageSystem->processAcks();
+				ack_clocks += get_cpu_clock_count() - start;
+				frame_count++;
+			}
+		}
+	}
+	U64 wall_clocks = get_cpu_clock_count() - wall_start;
+
+	report(std::cout, all_stats, rejected, ack_clocks, total_packets, total_bytes, wall_clocks);
+
+	for_each(all_stats.begin(), all_stats.end(), DeletePointer());
+	all_stats.clear();
+
+	end_messaging_system();
+	ll_cleanup_apr();
+	return 0;
+}
@@ -88,6 +88,7 @@
 #include "llviewerkeyboard.h"
 #include "lllfsthread.h"
 #include "llworkerthread.h"
+#include "lljobpool.h"
 #include "lltexturecache.h"
 #include "lltexturefetch.h"
 #include "llimageworker.h"
@@ -419,6 +420,12 @@ static void settings_modify()
 		gSavedSettings.setU32("VectorizeProcessor", 0 );
 	}
 	else
+	if (gSysCPU.hasAVX2())
+	{
+		gSavedSettings.setBOOL("VectorizeEnable", TRUE );
+		gSavedSettings.setU32("VectorizeProcessor", 3 );
+	}
+	else
 	if (gSysCPU.hasSSE2())
 	{
 		gSavedSettings.setBOOL("VectorizeEnable", TRUE );
@@ -1019,6 +1026,31 @@ bool LLAppViewer::mainLoop()
 						break;
 					}
 				}
+
+				// Pack the VFS a little at a time, so its free space doesn't
+				// splinter over a long session.  Only when this frame had time
+				// to spare and no file or texture work is waiting; the copying
+				// is done on the VFS thread.
+				static LLFrameTimer vfs_compact_timer;
+				if (vfs_compact_timer.getElapsedTimeF32() > 1.f)
+				{
+					const F32 VFS_COMPACT_FRAGMENTATION = 0.25f;
+					const F64 VFS_COMPACT_MAX_FRAME_TIME = 0.05; // 20 fps
+					const S32 VFS_COMPACT_MAX_MS = 5;
+					S32 compact_bytes = gSavedSettings.getS32("VFSCompactBytes");
+					if (compact_bytes > 0
+						&& frameTimer.getElapsedTimeF64() < VFS_COMPACT_MAX_FRAME_TIME
+						&& LLVFSThread::sLocal->getPending() == 0 // includes the last compact()
+						&& LLLFSThread::sLocal->getPending() == 0
+						&& LLAppViewer::getTextureCache()->getPending() == 0
+						&& LLAppViewer::getTextureFetch()->getPending() == 0
+						&& gVFS->getFragmentation() > VFS_COMPACT_FRAGMENTATION)
+					{
+						LLVFSThread::sLocal->compact(gVFS, compact_bytes, VFS_COMPACT_MAX_MS, LLVFSThread::FLAG_AUTO_COMPLETE);
+					}
+					vfs_compact_timer.reset();
+				}
+
 				if ((LLStartUp::getStartupState() >= STATE_CLEANUP) &&
 					(frameTimer.getElapsedTimeF64() > FRAME_STALL_THRESHOLD))
 				{
@@ -1126,7 +1158,8 @@ bool LLAppViewer::cleanup()
 	LLHUDObject::cleanupHUDObjects();
 	llinfos << "HUD Objects cleaned up" << llendflush;
 
-	LLKeyframeDataCache::clear();
+	// Keep this session's animations decoded for the next one
+	LLKeyframeDataCache::closeCompiledCache(!mSecondInstance);
 	
  	// End TransferManager before deleting systems it depends on (Audio, VFS, AssetStorage)
 #if 0 // this seems to get us stuck in an infinite loop...
@@ -1355,6 +1388,8 @@ bool LLAppViewer::cleanup()
     sTextureFetch = NULL;
 	delete sImageDecodeThread;
     sImageDecodeThread = NULL;
+	delete LLVOAvatar::sAnimationPool;
+	LLVOAvatar::sAnimationPool = NULL;
 
 	//Note:
 	//LLViewerMedia::cleanupClass() has to be put before gImageList.shutdown()
@@ -1453,11 +1488,28 @@ bool LLAppViewer::initThreads()
 	LLLFSThread::initClass(enable_threads && true);
 
 	// Image decoding
-	LLAppViewer::sImageDecodeThread = new LLWorkerThread("ImageDecode", enable_threads && true);
+	S32 decode_threads = gSavedSettings.getS32("ImageDecodeThreads");
+	if (decode_threads <= 0)
+	{
+		// leave a core for the main thread
+		decode_threads = llclamp(gSysCPU.getNumCores() - 1, 1, 4);
+	}
+	LLAppViewer::sImageDecodeThread = new LLWorkerThread("ImageDecode", enable_threads && true, decode_threads);
 	LLAppViewer::sTextureCache = new LLTextureCache(enable_threads && true);
 	LLAppViewer::sTextureFetch = new LLTextureFetch(LLAppViewer::getTextureCache(), enable_threads && false);
 	LLImage::initClass(LLAppViewer::getImageDecodeThread());
 
+	// Avatar animation
+	S32 animation_threads = gSavedSettings.getS32("AvatarAnimationThreads");
+	if (animation_threads <= 0)
+	{
+		animation_threads = llclamp(gSysCPU.getNumCores(), 1, 4);
+	}
+	if (enable_threads && animation_threads > 1)
+	{
+		LLVOAvatar::sAnimationPool = new LLJobPool("Animation", animation_threads);
+	}
+
 	// *FIX: no error handling here!
 	return true;
 }
@@ -2793,6 +2845,9 @@ bool LLAppViewer::initCache()
 	S64 extra = LLAppViewer::getTextureCache()->initCache(LL_PATH_CACHE, texture_cache_size, read_only);
 	texture_cache_size -= extra;
 
+	// Animations decoded by earlier sessions
+	LLKeyframeDataCache::openCompiledCache(gDirUtilp->getExpandedFilename(LL_PATH_CACHE, "animations.cache"));
+
 	LLSplashScreen::update("Initializing VFS...");
 	
 	// Init the VFS
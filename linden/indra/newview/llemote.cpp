@@ -93,7 +93,7 @@ BOOL LLEmote::onActivate()
 	if (mParam)
 	{
 		mParam->setWeight(0.f, FALSE);
-		mCharacter->updateVisualParams();
+		mCharacter->requestVisualParamUpdate();
 	}
 	
 	return TRUE;
@@ -120,7 +120,7 @@ BOOL LLEmote::onUpdate(F32 time, U8* joint_mask)
 			default_param->setWeight( default_param_weight, FALSE );
 		}
 
-		mCharacter->updateVisualParams();
+		mCharacter->requestVisualParamUpdate();
 	}
 
 	return TRUE;
@@ -143,7 +143,7 @@ void LLEmote::onDeactivate()
 		default_param->setWeight( default_param->getMaxWeight(), FALSE );
 	}
 
-	mCharacter->updateVisualParams();
+	mCharacter->requestVisualParamUpdate();
 }
 
 
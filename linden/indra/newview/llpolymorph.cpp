@@ -39,6 +39,7 @@
 #include "llvoavatar.h"
 #include "llxmltree.h"
 #include "llendianswizzle.h"
+#include "llthread.h"
 
 //#include "../tools/imdebug/imdebug.h"
 
@@ -177,6 +178,8 @@ BOOL LLPolyMorphData::loadBinary(LLFILE *fp, LLPolyMeshSharedData *mesh)
 	mAvgDistortion = mAvgDistortion * (1.f/(F32)mNumIndices);
 	mAvgDistortion.normVec();
 
+	mDeltas.set(mNumIndices, mVertexIndices, mCoords, mNormals, mBinormals, mTexCoords);
+
 	return TRUE;
 }
 
@@ -453,55 +456,8 @@ void LLPolyMorphTarget::apply( ESex avatar_sex )
 	if (delta_weight != 0.f)
 	{
 		llassert(!mMesh->isLOD());
-		LLVector3 *coords = mMesh->getWritableCoords();
-
-		LLVector3 *scaled_normals = mMesh->getScaledNormals();
-		LLVector3 *normals = mMesh->getWritableNormals();
-
-		LLVector3 *scaled_binormals = mMesh->getScaledBinormals();
-		LLVector3 *binormals = mMesh->getWritableBinormals();
-
-		LLVector4 *clothing_weights = mMesh->getWritableClothingWeights();
-		LLVector2 *tex_coords = mMesh->getWritableTexCoords();
-
 		F32 *maskWeightArray = (mVertMask) ? mVertMask->getMorphMaskWeights() : NULL;
-
-		for(U32 vert_index_morph = 0; vert_index_morph < mMorphData->mNumIndices; vert_index_morph++)
-		{
-			S32 vert_index_mesh = mMorphData->mVertexIndices[vert_index_morph];
-
-			F32 maskWeight = 1.f;
-			if (maskWeightArray)
-			{
-				maskWeight = maskWeightArray[vert_index_morph];
-			}
-
-			coords[vert_index_mesh] += mMorphData->mCoords[vert_index_morph] * delta_weight * maskWeight;
-			if (getInfo()->mIsClothingMorph && clothing_weights)
-			{
-				LLVector3 clothing_offset = mMorphData->mCoords[vert_index_morph] * delta_weight * maskWeight;
-				LLVector4* clothing_weight = &clothing_weights[vert_index_mesh];
-				clothing_weight->mV[VX] += clothing_offset.mV[VX];
-				clothing_weight->mV[VY] += clothing_offset.mV[VY];
-				clothing_weight->mV[VZ] += clothing_offset.mV[VZ];
-				clothing_weight->mV[VW] = maskWeight;
-			}
-
-			// calculate new normals based on half angles
-			scaled_normals[vert_index_mesh] += mMorphData->mNormals[vert_index_morph] * delta_weight * maskWeight * NORMAL_SOFTEN_FACTOR;
-			LLVector3 normalized_normal = scaled_normals[vert_index_mesh];
-			normalized_normal.normVec();
-			normals[vert_index_mesh] = normalized_normal;
-
-			// calculate new binormals
-			scaled_binormals[vert_index_mesh] += mMorphData->mBinormals[vert_index_morph] * delta_weight * maskWeight * NORMAL_SOFTEN_FACTOR;
-			LLVector3 tangent = scaled_binormals[vert_index_mesh] % normalized_normal;
-			LLVector3 normalized_binormal = normalized_normal % tangent; 
-			normalized_binormal.normVec();
-			binormals[vert_index_mesh] = normalized_binormal;
-
-			tex_coords[vert_index_mesh] += mMorphData->mTexCoords[vert_index_morph] * delta_weight * maskWeight;
-		}
+		LLPolyMorphBatch::add(mMesh, mMorphData, delta_weight, maskWeightArray, getInfo()->mIsClothingMorph);
 
 		// now apply volume changes
 		for( volume_list_t::iterator iter = mVolumeMorphs.begin(); iter != mVolumeMorphs.end(); iter++ )
@@ -526,6 +482,9 @@ void LLPolyMorphTarget::apply( ESex avatar_sex )
 //-----------------------------------------------------------------------------
 void	LLPolyMorphTarget::applyMask(U8 *maskTextureData, S32 width, S32 height, S32 num_components, BOOL invert)
 {
+	// the mask weights and the mesh have to be current before either changes
+	LLPolyMorphBatch::flush(mMesh);
+
 	LLVector4 *clothing_weights = getInfo()->mIsClothingMorph ? mMesh->getWritableClothingWeights() : NULL;
 
 	if (!mVertMask)
@@ -577,6 +536,97 @@ void	LLPolyMorphTarget::applyMask(U8 *maskTextureData, S32 width, S32 height, S3
 }
 
 
+//-----------------------------------------------------------------------------
+// LLPolyMorphBatch
+//-----------------------------------------------------------------------------
+S32 LLPolyMorphBatch::sDepth = 0;
+LLPolyMorphBatch::pending_list_t LLPolyMorphBatch::sPending;
+LLMorphAccumulator LLPolyMorphBatch::sAccumulator;
+U32 LLPolyMorphBatch::sThreadID = 0;
+
+LLPolyMorphBatch::LLPolyMorphBatch()
+{
+	sDepth++;
+}
+
+LLPolyMorphBatch::~LLPolyMorphBatch()
+{
+	if (--sDepth == 0)
+	{
+		flushAll();
+	}
+}
+
+// static
+void LLPolyMorphBatch::add(LLPolyMesh* mesh, LLPolyMorphData* morph_data, F32 weight,
+						   const F32* mask_weights, BOOL clothing)
+{
+	if (!sThreadID)
+	{
+		sThreadID = LLThread::currentID();
+	}
+	llassert(sThreadID == LLThread::currentID()); // main thread only
+
+	PendingMorph morph;
+	morph.mMesh = mesh;
+	morph.mMorphData = morph_data;
+	morph.mWeight = weight;
+	morph.mMaskWeights = mask_weights;
+	morph.mIsClothingMorph = clothing;
+	sPending.push_back(morph);
+
+	if (sDepth == 0)
+	{
+		flush(mesh);
+	}
+}
+
+// static
+void LLPolyMorphBatch::flush(LLPolyMesh* mesh)
+{
+	pending_list_t::iterator iter = sPending.begin();
+	while (iter != sPending.end() && iter->mMesh != mesh)
+	{
+		++iter;
+	}
+	if (iter == sPending.end())
+	{
+		return;
+	}
+
+	sAccumulator.begin(mesh->getNumVertices(), mesh->getWritableCoords(),
+					   mesh->getWritableNormals(), mesh->getScaledNormals(),
+					   mesh->getWritableBinormals(), mesh->getScaledBinormals(),
+					   mesh->getWritableTexCoords(), mesh->getWritableClothingWeights());
+
+	// apply this mesh's morphs in the order they were queued, and keep the rest
+	pending_list_t::iterator keep = iter;
+	for ( ; iter != sPending.end(); ++iter)
+	{
+		if (iter->mMesh == mesh)
+		{
+			sAccumulator.add(iter->mMorphData->mDeltas, iter->mWeight, iter->mMaskWeights,
+							 NORMAL_SOFTEN_FACTOR, iter->mIsClothingMorph);
+		}
+		else
+		{
+			*keep++ = *iter;
+		}
+	}
+	sPending.erase(keep, sPending.end());
+
+	sAccumulator.finish();
+}
+
+// static
+void LLPolyMorphBatch::flushAll()
+{
+	while (!sPending.empty())
+	{
+		flush(sPending.front().mMesh);
+	}
+}
+
 //-----------------------------------------------------------------------------
 // LLPolyVertexMask()
 //-----------------------------------------------------------------------------
@@ -37,6 +37,7 @@
 #include <vector>
 
 #include "llviewervisualparam.h"
+#include "llmorphdeltas.h"
 
 class LLPolyMeshSharedData;
 class LLVOAvatar;
@@ -66,6 +67,7 @@ public:
 	LLVector3*			mNormals;
 	LLVector3*			mBinormals;
 	LLVector2*			mTexCoords;
+	LLMorphDeltas		mDeltas;			// the same deltas, packed for LLPolyMorphBatch
 
 	F32					mTotalDistortion;	// vertex distortion summed over entire morph
 	F32					mMaxDistortion;		// maximum single vertex distortion in a given morph
@@ -181,4 +183,45 @@ protected:
 
 };
 
+//-----------------------------------------------------------------------------
+// LLPolyMorphBatch
+// While one of these is in scope, morph targets queue their vertex changes
+// instead of applying them.  When the outermost batch ends, everything
+// queued for a mesh is added to it in one pass and each touched normal and
+// binormal is renormalized once, rather than once per morph.
+// The queue is shared, so batches are main thread only; motions running on
+// the animation job pool defer their visual param updates to the main
+// thread through LLCharacter::requestVisualParamUpdate().
+//-----------------------------------------------------------------------------
+class LLPolyMorphBatch
+{
+public:
+	LLPolyMorphBatch();
+	~LLPolyMorphBatch();
+
+	// Queues a weighted morph, or applies it right away outside a batch
+	static void add(LLPolyMesh* mesh, LLPolyMorphData* morph_data, F32 weight,
+					const F32* mask_weights, BOOL clothing);
+
+	// Applies whatever is queued for mesh
+	static void flush(LLPolyMesh* mesh);
+	static void flushAll();
+
+private:
+	struct PendingMorph
+	{
+		LLPolyMesh*			mMesh;
+		LLPolyMorphData*	mMorphData;
+		F32					mWeight;
+		const F32*			mMaskWeights;
+		BOOL				mIsClothingMorph;
+	};
+	typedef std::vector<PendingMorph> pending_list_t;
+
+	static S32					sDepth;
+	static pending_list_t		sPending;
+	static LLMorphAccumulator	sAccumulator;
+	static U32					sThreadID; // the one thread allowed to queue morphs
+};
+
 #endif // LL_LLPOLYMORPH_H
@@ -556,6 +556,12 @@ bool idle_startup()
 				msg->startLogging();
 			}
 
+			std::string capture_file = gSavedSettings.getString("MessageCaptureFile");
+			if (!capture_file.empty())
+			{
+				msg->mPacketRing.startCapture(capture_file);
+			}
+
 			// start the xfer system. by default, choke the downloads
 			// a lot...
 			const S32 VIEWER_MAX_XFER = 3;
@@ -38,6 +38,7 @@
 #include "lldir.h"
 #include "llglheaders.h"
 #include "llimagebmp.h"
+#include "llimagebufferpool.h"
 #include "llimagej2c.h"
 #include "llimagetga.h"
 #include "llpolymorph.h"
@@ -64,6 +65,7 @@ using namespace LLVOAvatarDefines;
 // static
 S32 LLTexLayerSetBuffer::sGLByteCount = 0;
 S32 LLTexLayerSetBuffer::sGLBumpByteCount = 0;
+S32 LLTexLayer::sGLCachedCompositeByteCount = 0;
 
 //-----------------------------------------------------------------------------
 // LLBakedUploadData()
@@ -129,6 +131,8 @@ void LLTexLayerSetBuffer::restoreGLTexture()
 //virtual 
 void LLTexLayerSetBuffer::destroyGLTexture() 
 {
+	mTexLayerSet->deleteCachedComposites();
+
 	if( mBumpTex.notNull() )
 	{
 		mBumpTex = NULL ;
@@ -173,6 +177,7 @@ void LLTexLayerSetBuffer::dumpTotalByteCount()
 {
 	llinfos << "Composite System GL Buffers: " << (LLTexLayerSetBuffer::sGLByteCount/1024) << "KB" << llendl;
 	llinfos << "Composite System GL Bump Buffers: " << (LLTexLayerSetBuffer::sGLBumpByteCount/1024) << "KB" << llendl;
+	llinfos << "Composite System GL Layer Caches: " << (LLTexLayer::sGLCachedCompositeByteCount/1024) << "KB" << llendl;
 }
 
 void LLTexLayerSetBuffer::requestUpdate()
@@ -296,23 +301,23 @@ BOOL LLTexLayerSetBuffer::render()
 			// if we need to upload the data, read it back into a buffer
 			if( upload_now )
 			{
-				baked_bump_data = new U8[ mWidth * mHeight * 4 ];
+				baked_bump_data = LLImageBufferPool::allocate( mWidth * mHeight * 4 );
 				glReadPixels(mOrigin.mX, mOrigin.mY, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, baked_bump_data );
 				stop_glerror();
 			}
 		}
 	}
 
-	// Composite the color data
+	// Composite the color data.  Uploads are always composited in full.
 	LLGLSUIDefault gls_ui;
-	success &= mTexLayerSet->render( mOrigin.mX, mOrigin.mY, mWidth, mHeight );
+	success &= mTexLayerSet->render( mOrigin.mX, mOrigin.mY, mWidth, mHeight, !upload_now && isInitialized() );
 	gGL.flush();
 
 	if( upload_now )
 	{
 		if (!success)
 		{
-			delete [] baked_bump_data;
+			LLImageBufferPool::free( baked_bump_data, mWidth * mHeight * 4 );
 			llinfos << "Failed attempt to bake " << mTexLayerSet->getBodyRegion() << llendl;
 			mUploadPending = FALSE;
 		}
@@ -356,7 +361,7 @@ BOOL LLTexLayerSetBuffer::updateImmediate()
 void LLTexLayerSetBuffer::readBackAndUpload(U8* baked_bump_data)
 {
 	// pointers for storing data to upload
-	U8* baked_color_data = new U8[ mWidth * mHeight * 4 ];
+	U8* baked_color_data = LLImageBufferPool::allocate( mWidth * mHeight * 4 );
 	
 	glReadPixels(mOrigin.mX, mOrigin.mY, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, baked_color_data );
 	stop_glerror();
@@ -535,8 +540,8 @@ void LLTexLayerSetBuffer::readBackAndUpload(U8* baked_bump_data)
 		llinfos << "unable to create baked upload file" << llendl;
 	}
 
-	delete [] baked_color_data;
-	delete [] baked_bump_data;
+	LLImageBufferPool::free( baked_color_data, mWidth * mHeight * 4 );
+	LLImageBufferPool::free( baked_bump_data, mWidth * mHeight * 4 );
 }
 
 
@@ -784,6 +789,19 @@ void LLTexLayerSet::deleteCaches()
 		LLTexLayer* layer = *iter;
 		layer->deleteCaches();
 	}
+	deleteCachedComposites();
+}
+
+void LLTexLayerSet::deleteCachedComposites()
+{
+	for( layer_list_t::iterator iter = mLayerList.begin(); iter != mLayerList.end(); iter++ )
+	{
+		LLTexLayer* layer = *iter;
+		layer->deleteCachedComposite();
+	}
+	mDirtyTracker.clearCached();
+	// Whatever called this may also have lost the composite itself
+	mDirtyTracker.invalidateAll();
 }
 
 // Returns TRUE if at least one packet of data has been received for each of the textures that this layerset depends on.
@@ -800,7 +818,7 @@ BOOL LLTexLayerSet::isLocalTextureDataFinal()
 }
 
 
-BOOL LLTexLayerSet::render( S32 x, S32 y, S32 width, S32 height )
+BOOL LLTexLayerSet::render( S32 x, S32 y, S32 width, S32 height, BOOL incremental )
 {
 	BOOL success = TRUE;
 
@@ -808,18 +826,109 @@ BOOL LLTexLayerSet::render( S32 x, S32 y, S32 width, S32 height )
 	LLGLDepthTest gls_depth(GL_FALSE, GL_FALSE);
 	gGL.setColorMask(true, true);
 
-	// composite color layers
-	for( layer_list_t::iterator iter = mLayerList.begin(); iter != mLayerList.end(); iter++ )
+	// While we're editing our own appearance, keep the composite as it stood
+	// after each color layer, so that a change to one layer can be redone
+	// from the layer below it, over just the region that changed.
+	BOOL cache_layers = mAvatar->isSelf() && gAgent.cameraCustomizeAvatar();
+	if( !cache_layers )
 	{
-		LLTexLayer* layer = *iter;
-		if( layer->getRenderPass() == RP_COLOR )
+		deleteCachedComposites();
+	}
+
+	S32 first_layer = 0;
+	LLRect dirty_rect;
+	incremental = incremental && cache_layers && mDirtyTracker.getUpdate( first_layer, dirty_rect );
+	if( incremental )
+	{
+		// Reading back the alpha for masked morphs needs the whole layer
+		for( S32 i = first_layer; i < (S32)mLayerList.size(); i++ )
 		{
+			if( mLayerList[i]->needsMorphMaskUpdate() )
+			{
+				dirty_rect = mDirtyTracker.getImageRect();
+				break;
+			}
+		}
+
+		// Start from the last composite, and the cached layer under the
+		// first change where it changed
+		LLGLDisable no_alpha(GL_ALPHA_TEST);
+		gGL.flush();
+		gGL.setSceneBlendType(LLRender::BT_REPLACE);
+		gGL.color4f( 1.f, 1.f, 1.f, 1.f );
+		gGL.getTexUnit(0)->bind(mComposite->getTexture());
+		gl_rect_2d_simple_tex( width, height );
+		gGL.flush();
+		gGL.getTexUnit(0)->unbind(LLTexUnit::TT_TEXTURE);
+		if( first_layer > 0 && dirty_rect.notNull() )
+		{
+			LLGLEnable scissor(GL_SCISSOR_TEST);
+			glScissor(x + dirty_rect.mLeft, y + dirty_rect.mBottom, dirty_rect.getWidth(), dirty_rect.getHeight());
+			mLayerList[first_layer - 1]->restoreCachedComposite( width, height );
 			gGL.flush();
-			success &= layer->render( x, y, width, height );
-			gGL.flush();
 		}
+		gGL.setSceneBlendType(LLRender::BT_ALPHA);
+	}
+	else
+	{
+		first_layer = 0;
+		dirty_rect = mDirtyTracker.getImageRect();
+	}
+
+	{
+		LLGLEnable scissor(incremental ? GL_SCISSOR_TEST : 0);
+		if( incremental )
+		{
+			glScissor(x + dirty_rect.mLeft, y + dirty_rect.mBottom, dirty_rect.getWidth(), dirty_rect.getHeight());
+		}
+
+		// composite color layers
+		for( S32 i = first_layer; dirty_rect.notNull() && i < (S32)mLayerList.size(); i++ )
+		{
+			LLTexLayer* layer = mLayerList[i];
+			if( layer->getRenderPass() == RP_COLOR )
+			{
+				gGL.flush();
+				success &= layer->render( x, y, width, height );
+				gGL.flush();
+
+				if( !cache_layers )
+				{
+					continue;
+				}
+				if( !incremental )
+				{
+					layer->cacheComposite( x, y, dirty_rect, width, height );
+					mDirtyTracker.setCached( i, layer->hasCachedComposite() );
+				}
+				else if( mDirtyTracker.isCached( i ) )
+				{
+					layer->cacheComposite( x, y, dirty_rect, width, height );
+				}
+			}
+		}
+
+		success &= renderAlpha( width, height );
 	}
 
+	// A layer that couldn't render (e.g. its texture isn't here yet) will
+	// ask again, and has to be redone in full then
+	if( success )
+	{
+		mDirtyTracker.clearDirty();
+	}
+	else
+	{
+		mDirtyTracker.invalidateAll();
+	}
+
+	return success;
+}
+
+BOOL LLTexLayerSet::renderAlpha( S32 width, S32 height )
+{
+	BOOL success = TRUE;
+
 	// (Optionally) replace alpha with a single component image from a tga file.
 	if( !getInfo()->mStaticAlphaFileName.empty() )
 	{
@@ -903,6 +1012,26 @@ BOOL LLTexLayerSet::renderBump( S32 x, S32 y, S32 width, S32 height )
 
 void LLTexLayerSet::requestUpdate()
 {
+	mDirtyTracker.invalidateAll();
+	if( mUpdatesEnabled )
+	{
+		createComposite();
+		mComposite->requestUpdate(); 
+	}
+}
+
+// Only redo the given color layer, and the ones above it, inside region.
+// Changes to any other kind of layer redo the whole set.
+void LLTexLayerSet::requestUpdate( LLTexLayer* layer, const LLRectf& region )
+{
+	layer_list_t::iterator iter = std::find( mLayerList.begin(), mLayerList.end(), layer );
+	if( iter == mLayerList.end() || layer->getRenderPass() != RP_COLOR )
+	{
+		requestUpdate();
+		return;
+	}
+
+	mDirtyTracker.invalidateLayer( (S32)(iter - mLayerList.begin()), region );
 	if( mUpdatesEnabled )
 	{
 		createComposite();
@@ -937,6 +1066,7 @@ void LLTexLayerSet::createComposite()
 			height /= 2;
 		}
 		mComposite = new LLTexLayerSetBuffer( this, width, height, mHasBump );
+		mDirtyTracker.reset( width, height, mLayerList.size() );
 	}
 }
 
@@ -944,6 +1074,7 @@ void LLTexLayerSet::destroyComposite()
 {
 	if( mComposite )
 	{
+		deleteCachedComposites();
 		delete mComposite;
 		mComposite = NULL;
 	}
@@ -951,6 +1082,11 @@ void LLTexLayerSet::destroyComposite()
 
 void LLTexLayerSet::setUpdatesEnabled( BOOL b )
 {
+	// Changes made while updates were off weren't tracked
+	if( b && !mUpdatesEnabled )
+	{
+		mDirtyTracker.invalidateAll();
+	}
 	mUpdatesEnabled = b; 
 }
 
@@ -1219,6 +1355,7 @@ BOOL LLTexLayerInfo::parseXml(LLXmlTreeNode* node)
 LLTexLayer::LLTexLayer( LLTexLayerSet* layer_set )
 	:
 	mTexLayerSet( layer_set ),
+	mCachedCompositeBytes( 0 ),
 	mMorphMasksValid( FALSE ),
 	mStaticImageInvalid( FALSE ),
 	mInfo( NULL )
@@ -1238,6 +1375,8 @@ LLTexLayer::~LLTexLayer()
 		U8* alpha_data = iter->second;
 		delete [] alpha_data;
 	}
+
+	deleteCachedComposite();
 }
 
 //-----------------------------------------------------------------------------
@@ -1808,6 +1947,119 @@ void LLTexLayer::requestUpdate()
 	mTexLayerSet->requestUpdate();
 }
 
+// The part of the layer set that a change to this layer's color can touch,
+// in unit coordinates.  The whole set unless the layer's alpha comes only
+// from masks that are known to be zero outside some region.
+LLRectf LLTexLayer::getRegion()
+{
+	const LLRectf whole( 0.f, 1.f, 1.f, 0.f );
+
+	if( mParamAlphaList.empty() || mParamAlphaList.front()->getMultiplyBlend() )
+	{
+		return whole;
+	}
+
+	LLVOAvatar* avatar = mTexLayerSet->getAvatar();
+	LLRectf region;
+	for( alpha_list_t::iterator iter = mParamAlphaList.begin(); iter != mParamAlphaList.end(); iter++ )
+	{
+		LLTexLayerParamAlpha* param = *iter;
+		if( param->getMultiplyBlend() )
+		{
+			// Multiplies can only shrink the alpha
+			continue;
+		}
+
+		F32 effective_weight = ( avatar->getSex() & param->getSex() ) ? param->getWeight() : param->getDefaultWeight();
+		LLRectf param_region;
+		if( !param->getMaskRegion( effective_weight, param_region ) )
+		{
+			return whole;
+		}
+		if( param_region.isNull() )
+		{
+			continue;
+		}
+		if( region.isNull() )
+		{
+			region = param_region;
+		}
+		else
+		{
+			region.unionWith( param_region );
+		}
+	}
+	return region;
+}
+
+// Copies rect of the layer set's composite, as it stands now, into the cache.
+void LLTexLayer::cacheComposite( S32 x, S32 y, const LLRect& rect, S32 width, S32 height )
+{
+	if( mCachedComposite.isNull() )
+	{
+		LLGLSUIDefault gls_ui;
+		mCachedComposite = new LLImageGL(FALSE);
+		if( !mCachedComposite->createGLTexture() )
+		{
+			mCachedComposite = NULL;
+			return;
+		}
+
+		gGL.getTexUnit(0)->bindManual(LLTexUnit::TT_TEXTURE, mCachedComposite->getTexName());
+		stop_glerror();
+
+		gGL.getTexUnit(0)->setTextureAddressMode(LLTexUnit::TAM_CLAMP);
+		gGL.getTexUnit(0)->setTextureFilteringOption(LLTexUnit::TFO_POINT);
+
+		LLImageGL::setManualImage(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		stop_glerror();
+
+		mCachedCompositeBytes = width * height * 4;
+		LLImageGL::sGlobalTextureMemoryInBytes += mCachedCompositeBytes;
+		LLTexLayer::sGLCachedCompositeByteCount += mCachedCompositeBytes;
+	}
+	else
+	{
+		gGL.getTexUnit(0)->bindManual(LLTexUnit::TT_TEXTURE, mCachedComposite->getTexName());
+	}
+
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, rect.mLeft, rect.mBottom, x + rect.mLeft, y + rect.mBottom, rect.getWidth(), rect.getHeight());
+	stop_glerror();
+
+	gGL.getTexUnit(0)->unbind(LLTexUnit::TT_TEXTURE);
+}
+
+// Replaces the layer set's composite with the cached copy.  Callers scissor
+// this to the region they're about to redo.
+void LLTexLayer::restoreCachedComposite( S32 width, S32 height )
+{
+	if( mCachedComposite.isNull() )
+	{
+		return;
+	}
+
+	LLGLDisable no_alpha(GL_ALPHA_TEST);
+	gGL.flush();
+	gGL.setSceneBlendType(LLRender::BT_REPLACE);
+	gGL.color4f( 1.f, 1.f, 1.f, 1.f );
+	gGL.getTexUnit(0)->bindManual(LLTexUnit::TT_TEXTURE, mCachedComposite->getTexName());
+	gl_rect_2d_simple_tex( width, height );
+	gGL.flush();
+	gGL.getTexUnit(0)->unbind(LLTexUnit::TT_TEXTURE);
+	gGL.setSceneBlendType(LLRender::BT_ALPHA);
+}
+
+void LLTexLayer::deleteCachedComposite()
+{
+	if( mCachedComposite.notNull() )
+	{
+		mCachedComposite = NULL;
+		LLImageGL::sGlobalTextureMemoryInBytes -= mCachedCompositeBytes;
+		LLTexLayer::sGLCachedCompositeByteCount -= mCachedCompositeBytes;
+		mCachedCompositeBytes = 0;
+	}
+}
+
 void LLTexLayer::addMaskedMorph(LLPolyMorphTarget* morph_target, BOOL invert)
 { 
 	mMaskedMorphs.push_front(LLMaskedMorph(morph_target, invert));
@@ -1908,7 +2160,8 @@ LLTexLayerParamAlpha::LLTexLayerParamAlpha( LLTexLayer* layer )
 	mNeedsCreateTexture( FALSE ),
 	mStaticImageInvalid( FALSE ),
 	mAvgDistortionVec(1.f, 1.f, 1.f),
-	mCachedEffectiveWeight(0.f)
+	mCachedEffectiveWeight(0.f),
+	mHasMaskRegion( FALSE )
 {
 	sInstances.push_front( this );
 }
@@ -1944,6 +2197,48 @@ void LLTexLayerParamAlpha::deleteCaches()
 	mCachedProcessedImageGL = NULL;
 	mStaticImageRaw = NULL;
 	mNeedsCreateTexture = FALSE;
+	mHasMaskRegion = FALSE;
+}
+
+// Where this param's processed mask can be nonzero at the given weight.
+// FALSE if that isn't known, which callers treat as the whole layer.
+BOOL LLTexLayerParamAlpha::getMaskRegion( F32 weight, LLRectf& region )
+{
+	if( getInfo()->mStaticImageFileName.empty() || mStaticImageTGA.isNull() )
+	{
+		return FALSE;
+	}
+
+	// A step at threshold zero lets every pixel through
+	if( getInfo()->mDomain <= 0 && (U8)(0xFF * llclampf( 1.f - weight )) == 0 )
+	{
+		return FALSE;
+	}
+
+	// Otherwise processing never turns a zero pixel into anything else, so
+	// the source image's bounds cover every weight.
+	if( !mHasMaskRegion )
+	{
+		LLPointer<LLImageRaw> raw = new LLImageRaw;
+		if( !mStaticImageTGA->decodeAndProcess( raw, 1.f, 1.f ) )
+		{
+			return FALSE;
+		}
+		mMaskRegion = LLBakeDirtyTracker::calcMaskRegion( raw );
+		mHasMaskRegion = TRUE;
+	}
+	region = mMaskRegion;
+	return TRUE;
+}
+
+LLRectf LLTexLayerParamAlpha::getDirtyRegion( F32 old_weight, F32 new_weight )
+{
+	LLRectf region;
+	if( !getMaskRegion( old_weight, region ) || !getMaskRegion( new_weight, region ) )
+	{
+		return LLRectf( 0.f, 1.f, 1.f, 0.f );
+	}
+	return region;
 }
 
 void LLTexLayerParamAlpha::setWeight(F32 weight, BOOL set_by_user)
@@ -1959,6 +2254,7 @@ void LLTexLayerParamAlpha::setWeight(F32 weight, BOOL set_by_user)
 	U8 new_u8 = F32_to_U8( new_weight, min_weight, max_weight );
 	if( cur_u8 != new_u8)
 	{
+		F32 old_weight = mCurWeight;
 		mCurWeight = new_weight;
 
 		LLVOAvatar* avatar = mTexLayer->getTexLayerSet()->getAvatar();
@@ -1968,7 +2264,7 @@ void LLTexLayerParamAlpha::setWeight(F32 weight, BOOL set_by_user)
 			{
 				set_by_user = FALSE;
 			}
-			avatar->invalidateComposite( mTexLayer->getTexLayerSet(), set_by_user );
+			avatar->invalidateComposite( mTexLayer, getDirtyRegion( old_weight, new_weight ), set_by_user );
 			mTexLayer->invalidateMorphMasks();
 			avatar->updateMeshTextures();
 		}
@@ -2413,7 +2709,7 @@ void LLTexParamColor::setWeight(F32 weight, BOOL set_by_user)
 			else
 			if( mTexLayer )
 			{
-				mAvatar->invalidateComposite( mTexLayer->getTexLayerSet(), set_by_user );
+				mAvatar->invalidateComposite( mTexLayer, mTexLayer->getRegion(), set_by_user );
 			}
 		}
 //		llinfos << "param " << mName << " = " << new_weight << llendl;
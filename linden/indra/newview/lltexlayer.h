@@ -35,6 +35,7 @@
 
 #include <deque>
 #include "llassetstorage.h"
+#include "llbakecompositor.h"
 #include "lldynamictexture.h"
 #include "llrect.h"
 #include "llstring.h"
@@ -263,11 +264,15 @@ public:
 	//   This sets mInfo and calls initialization functions
 	BOOL					setInfo(LLTexLayerSetInfo *info);
 	
-	BOOL					render( S32 x, S32 y, S32 width, S32 height );
+	// If incremental, only redo what changed since the last render, on top
+	// of the composite it left.
+	BOOL					render( S32 x, S32 y, S32 width, S32 height, BOOL incremental = FALSE );
+	BOOL					renderAlpha( S32 width, S32 height );
 	BOOL					renderBump( S32 x, S32 y, S32 width,S32 height );
 	BOOL					isBodyRegion( const std::string& region ) { return mInfo->mBodyRegion == region; }
 	LLTexLayerSetBuffer*	getComposite();
 	void					requestUpdate();
+	void					requestUpdate( LLTexLayer* layer, const LLRectf& region );
 	void					requestUpload();
 	void					cancelUpload();
 	LLVOAvatar*				getAvatar()								{ return mAvatar; }
@@ -279,6 +284,7 @@ public:
 	void					setUpdatesEnabled( BOOL b );
 	BOOL					getUpdatesEnabled()						{ return mUpdatesEnabled; }
 	void					deleteCaches();
+	void					deleteCachedComposites();
 	void					gatherAlphaMasks(U8 *data, S32 width, S32 height);
 	void					applyMorphMask(U8* tex_data, S32 width, S32 height, S32 num_components);
 	const std::string		getBodyRegion() 				{ return mInfo->mBodyRegion; }
@@ -297,6 +303,7 @@ protected:
 	LLVOAvatar*				mAvatar;
 	BOOL					mUpdatesEnabled;
 	BOOL					mHasBump;
+	LLBakeDirtyTracker		mDirtyTracker;		// which color layers changed since the last render, and where
 
 	LLTexLayerSetInfo 		*mInfo;
 };
@@ -342,16 +349,29 @@ public:
 	void					applyMorphMask(U8* tex_data, S32 width, S32 height, S32 num_components);
 
 	void					invalidateMorphMasks();
+	BOOL					needsMorphMaskUpdate()					{ return !mMorphMasksValid && !mMaskedMorphs.empty(); }
 	ERenderPass				getRenderPass() 						{ return mInfo->mRenderPass; }
 	const std::string&			getGlobalColor() 						{ return mInfo->mGlobalColor; }
 	BOOL					findNetColor( LLColor4* color );
 	BOOL					renderImageRaw( U8* in_data, S32 in_width, S32 in_height, S32 in_components, S32 width, S32 height, BOOL is_mask );
 	BOOL					renderAlphaMasks(  S32 x, S32 y, S32 width, S32 height, LLColor4* colorp );
 	BOOL					hasAlphaParams() { return (!mParamAlphaList.empty());}
+	LLRectf					getRegion();
+
+	// The layer set's composite as it stood after this layer, kept while
+	// editing so that changes above this layer can start from here.
+	BOOL					hasCachedComposite()					{ return mCachedComposite.notNull(); }
+	void					cacheComposite( S32 x, S32 y, const LLRect& rect, S32 width, S32 height );
+	void					restoreCachedComposite( S32 width, S32 height );
+	void					deleteCachedComposite();
+
+	static S32				sGLCachedCompositeByteCount;
 
 protected:
 	LLTexLayerSet*			mTexLayerSet;
 	LLPointer<LLImageRaw>	mStaticImageRaw;
+	LLPointer<LLImageGL>	mCachedComposite;
+	S32						mCachedCompositeBytes;
 
 	// Layers can have either mParamColorList, mGlobalColor, or mFixedColor.  They are looked for in that order.
 	typedef std::vector<LLTexParamColor *> color_list_t;
@@ -406,6 +426,8 @@ public:
 	BOOL					render( S32 x, S32 y, S32 width, S32 height );
 	BOOL					getSkip();
 	void					deleteCaches();
+	BOOL					getMaskRegion( F32 weight, LLRectf& region );
+	LLRectf					getDirtyRegion( F32 old_weight, F32 new_weight );
 	LLTexLayer*				getTexLayer()		{ return mTexLayer; }
 	BOOL					getMultiplyBlend()	{ return getInfo()->mMultiplyBlend; }
 
@@ -418,6 +440,8 @@ protected:
 	BOOL					mStaticImageInvalid;
 	LLVector3				mAvgDistortionVec;
 	F32						mCachedEffectiveWeight;
+	LLRectf					mMaskRegion;		// where the static image isn't zero
+	BOOL					mHasMaskRegion;
 
 public:
 	// Global list of instances for gathering statistics
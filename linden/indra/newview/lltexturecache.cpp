@@ -40,9 +40,6 @@
 #include "lllfsthread.h"
 #include "llviewercontrol.h"
 
-// Included to allow LLTextureCache::purgeTextures() to pause watchdog timeout
-#include "llappviewer.h" 
-
 #define USE_LFS_READ 0
 #define USE_LFS_WRITE 0
 
@@ -416,6 +413,7 @@ bool LLTextureCacheRemoteWorker::doRead()
 	{
 		llassert_always(mImageSize == 0);
 		idx = mCache->getHeaderCacheEntry(mID, false, &mImageSize);
+		mCache->recordRead(idx >= 0 && mImageSize > mOffset);
 		if (idx >= 0 && mImageSize > mOffset)
 		{
 			llassert_always(mImageSize > 0);
@@ -726,7 +724,7 @@ bool LLTextureCacheRemoteWorker::doWrite()
 			S32 file_size = mDataSize - data_offset;
 			S32 file_offset = mOffset - TEXTURE_CACHE_ENTRY_SIZE;
 			file_offset = llmax(file_offset, 0);
-			if (file_size > 0 && mCache->appendToTextureEntryList(mID, file_size))
+			if (file_size > 0 && mCache->setTextureBodySize(mID, file_size))
 			{
 				std::string filename = mCache->getTextureFileName(mID);
 				mBytesRead = -1;
@@ -768,7 +766,7 @@ bool LLTextureCacheRemoteWorker::doWrite()
 		S32 file_offset = mOffset - TEXTURE_CACHE_ENTRY_SIZE;
 		file_offset = llmax(file_offset, 0);
 		S32 bytes_written = 0;
-		if (file_size > 0 && mCache->appendToTextureEntryList(mID, file_size))
+		if (file_size > 0 && mCache->setTextureBodySize(mID, file_size))
 		{
 			std::string filename = mCache->getTextureFileName(mID);
 			
@@ -888,13 +886,34 @@ LLTextureCache::LLTextureCache(bool threaded)
 	  mHeaderMutex(NULL),
 	  mListMutex(NULL),
 	  mReadOnly(FALSE),
-	  mTexturesSizeTotal(0),
-	  mDoPurge(FALSE)
+	  mHeaderEntriesInfo(NULL),
+	  mHeaderEntries(NULL),
+	  mClockHand(0),
+	  mDoPurge(FALSE),
+	  mEvictor(NULL),
+	  mEvictSteps(0),
+	  mValidateIdx(-1),
+	  mValidatePos(0),
+	  mReadHits(0),
+	  mReadMisses(0),
+	  mBytesEvicted(0),
+	  mEvictBatches(0),
+	  mEvictTimeTotal(0.f),
+	  mEvictTimeMax(0.f)
 {
 }
 
 LLTextureCache::~LLTextureCache()
 {
+	stopEvictor();
+	closeHeaderCache();
+}
+
+//virtual
+void LLTextureCache::shutdown()
+{
+	stopEvictor();
+	LLWorkerThread::shutdown();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -905,6 +924,18 @@ S32 LLTextureCache::update(U32 max_time_ms)
 	S32 res;
 	res = LLWorkerThread::update(max_time_ms);
 
+	if (mDoPurge || mValidateIdx >= 0)
+	{
+		if (mEvictor)
+		{
+			mEvictor->wake(); // may have been paused with us
+		}
+		else if (!getThreaded())
+		{
+			evictTextures();
+		}
+	}
+
 	mListMutex.lock();
 	handle_list_t priorty_list = mPrioritizeWriteList; // copy list
 	mPrioritizeWriteList.clear();
@@ -958,30 +989,34 @@ std::string LLTextureCache::getTextureFileName(const LLUUID& id)
 	return filename;
 }
 
-bool LLTextureCache::appendToTextureEntryList(const LLUUID& id, S32 bodysize)
+// Called from work thread before the body file is written
+bool LLTextureCache::setTextureBodySize(const LLUUID& id, S32 bodysize)
 {
+	if (!mHeaderEntries)
+	{
+		return false;
+	}
 	bool res = false;
 	bool purge = false;
-	// Append UUID to end of texture entries
 	{
 		LLMutexLock lock(&mHeaderMutex);
-		size_map_t::iterator iter = mTexturesSizeMap.find(id);
-		if (iter == mTexturesSizeMap.end() || iter->second < bodysize)
+		while (mRemovingBodies.find(id) != mRemovingBodies.end())
+		{
+			// the old file must be gone before we write the new one
+			mHeaderMutex.wait();
+		}
+		S32 idx;
+		{
+			LLUUIDHashIndex::ShardLock shard_lock(mHeaderIndex, id);
+			idx = lookupHeaderCacheEntry(id, false);
+		}
+		if (idx >= 0 && mHeaderEntries[idx].mBodySize < bodysize)
 		{
 			llassert_always(bodysize > 0);
-			Entry* entry = new Entry(id, bodysize, time(NULL));
-
-			LLAPRFile::writeEx(mTexturesDirEntriesFileName,
-								 (U8*)entry, -1, 1*sizeof(Entry),
-								 getLocalAPRFilePool());			
-			delete entry;
-			if (iter != mTexturesSizeMap.end())
-			{
-				mTexturesSizeTotal -= iter->second;
-			}
-			mTexturesSizeTotal += bodysize;
-			mTexturesSizeMap[id] = bodysize;
-			if (mTexturesSizeTotal > sCacheMaxTexturesSize)
+			Entry& entry = mHeaderEntries[idx];
+			mHeaderEntriesInfo->mBodySizeTotal += bodysize - entry.mBodySize;
+			entry.mBodySize = bodysize;
+			if (mHeaderEntriesInfo->mBodySizeTotal > sCacheMaxTexturesSize)
 			{
 				purge = true;
 			}
@@ -990,7 +1025,7 @@ bool LLTextureCache::appendToTextureEntryList(const LLUUID& id, S32 bodysize)
 	}
 	if (purge)
 	{
-		mDoPurge = TRUE;
+		startEviction();
 	}
 	return res;
 }
@@ -999,10 +1034,11 @@ bool LLTextureCache::appendToTextureEntryList(const LLUUID& id, S32 bodysize)
 
 //static
 const S32 MAX_REASONABLE_FILE_SIZE = 512*1024*1024; // 512 MB
-F32 LLTextureCache::sHeaderCacheVersion = 1.0f;
+F32 LLTextureCache::sHeaderCacheVersion = 1.1f;
 U32 LLTextureCache::sCacheMaxEntries = MAX_REASONABLE_FILE_SIZE / TEXTURE_CACHE_ENTRY_SIZE;
 S64 LLTextureCache::sCacheMaxTexturesSize = 0; // no limit
 const char* entries_filename = "texture.entries";
+const char* index_filename = "texture.index";
 const char* cache_filename = "texture.cache";
 const char* textures_dirname = "textures";
 
@@ -1010,6 +1046,7 @@ void LLTextureCache::setDirNames(ELLPath location)
 {
 	std::string delem = gDirUtilp->getDirDelimiter();
 	mHeaderEntriesFileName = gDirUtilp->getExpandedFilename(location, entries_filename);
+	mHeaderIndexFileName = gDirUtilp->getExpandedFilename(location, index_filename);
 	mHeaderDataFileName = gDirUtilp->getExpandedFilename(location, cache_filename);
 	mTexturesDirName = gDirUtilp->getExpandedFilename(location, textures_dirname);
 	mTexturesDirEntriesFileName = mTexturesDirName + delem + entries_filename;
@@ -1021,7 +1058,9 @@ void LLTextureCache::purgeCache(ELLPath location)
 	{
 		setDirNames(location);
 	
+		closeHeaderCache();
 		LLAPRFile::remove(mHeaderEntriesFileName, getLocalAPRFilePool());
+		LLAPRFile::remove(mHeaderIndexFileName, getLocalAPRFilePool());
 		LLAPRFile::remove(mHeaderDataFileName, getLocalAPRFilePool());
 	}
 	purgeAllTextures(true);
@@ -1058,90 +1097,113 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL read_only)
 		}
 	}
 	readHeaderCache();
-	purgeTextures(true); // calc mTexturesSize and make some room in the texture cache if we need it
 
-	return max_size; // unused cache space
-}
+	if (!mReadOnly && mHeaderEntries)
+	{
+		// Body sizes used to be logged here; they now live in the header entries
+		LLAPRFile::remove(mTexturesDirEntriesFileName, getLocalAPRFilePool());
 
-struct lru_data
-{
-	lru_data(U32 t, S32 i, const LLUUID& id) { time=t; index=i; uuid=id; }
-	U32 time;
-	S32 index;
-	LLUUID uuid;
-	struct Compare
-	{
-		// lhs < rhs
-		typedef const lru_data* lru_data_ptr;
-		bool operator()(const lru_data_ptr& a, const lru_data_ptr& b) const
-		{
-			if(a->time == b->time)
-				return (a->index < b->index);
-			else
-				return (a->time >= b->time);
+		// Spot check 1/256th of the bodies each session
+		U32 validate_idx = gSavedSettings.getU32("CacheValidateCounter");
+		gSavedSettings.setU32("CacheValidateCounter", (validate_idx + 1) % 256);
+		mValidateIdx = (S32)((validate_idx + 1) % 256);
+		mValidatePos = 0;
+		LL_DEBUGS("TextureCache") << "TEXTURE CACHE: Validating: " << mValidateIdx << LL_ENDL;
+
+		LL_INFOS("TextureCache") << "TEXTURE CACHE: ENTRIES: " << mHeaderEntriesInfo->mEntries
+								 << " CACHE SIZE: " << mHeaderEntriesInfo->mBodySizeTotal / (1024*1024) << " MB" << LL_ENDL;
+
+		if (getThreaded())
+		{
+			mEvictor = new Evictor(this);
+			mEvictor->start();
 		}
-	};				
-};
+		if (mHeaderEntriesInfo->mBodySizeTotal > sCacheMaxTexturesSize)
+		{
+			startEviction(); // the budget shrank
+		}
+	}
+
+	return max_size; // unused cache space
+}
 
-// Called from either the main thread or the worker thread
+// Called from the main thread by initCache()
 void LLTextureCache::readHeaderCache()
 {
 	LLMutexLock lock(&mHeaderMutex);
-	mHeaderEntriesInfo.mVersion = 0.f;
-	mHeaderEntriesInfo.mEntries = 0;
-	if (LLAPRFile::isExist(mHeaderEntriesFileName, getLocalAPRFilePool()))
-	{
-		LLAPRFile::readEx(mHeaderEntriesFileName,
-							(U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
-							getLocalAPRFilePool());
+	closeHeaderCache();
+
+	// Map the whole table up front; pages are only read when touched
+	LLMappedFile::EMode mode = mReadOnly ? LLMappedFile::PRIVATE : LLMappedFile::READ_WRITE;
+	size_t entries_size = sizeof(EntriesInfo) + (size_t)sCacheMaxEntries * sizeof(Entry);
+	size_t index_size = LLUUIDHashIndex::calcMemorySize(sCacheMaxEntries);
+	if (!mHeaderEntriesFile.open(mHeaderEntriesFileName, entries_size, mode)
+		|| !mHeaderIndexFile.open(mHeaderIndexFileName, index_size, mode))
+	{
+		LL_WARNS("TextureCache") << "Unable to map " << mHeaderEntriesFileName
+								 << ", texture headers will not be cached" << LL_ENDL;
+		closeHeaderCache();
+		return;
 	}
-	if (mHeaderEntriesInfo.mVersion != sHeaderCacheVersion)
-	{
-		if (!mReadOnly)
-		{
-			// Info with 0 entries
-			mHeaderEntriesInfo.mVersion = sHeaderCacheVersion;
-
-			LLAPRFile::writeEx(mHeaderEntriesFileName, 
-								 (U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
-								 getLocalAPRFilePool());
-		}
+	mHeaderEntriesInfo = (EntriesInfo*)mHeaderEntriesFile.getData();
+	mHeaderEntries = (Entry*)(mHeaderEntriesFile.getData() + sizeof(EntriesInfo));
+	mHeaderRefBits.assign(sCacheMaxEntries, 0);
+	mClockHand = 0;
+
+	bool index_valid = mHeaderIndex.attach(mHeaderIndexFile.getData(), mHeaderIndexFile.getSize(),
+										   sCacheMaxEntries);
+	if (mHeaderEntriesInfo->mVersion != sHeaderCacheVersion
+		|| mHeaderEntriesInfo->mEntries > sCacheMaxEntries)
+	{
+		// Info with 0 entries
+		mHeaderEntriesInfo->mVersion = sHeaderCacheVersion;
+		mHeaderEntriesInfo->mEntries = 0;
+		mHeaderEntriesInfo->mBodySizeTotal = 0;
+		mHeaderIndex.clear();
+		// Nothing refers to any cached bodies now
+		purgeAllTextures(false);
 	}
-	else
+	else if (!index_valid)
 	{
-		S32 num_entries = mHeaderEntriesInfo.mEntries;
-		if (num_entries)
+		// No index yet, or the last session did not shut down cleanly
+		rebuildHeaderIndex();
+	}
+}
+
+void LLTextureCache::closeHeaderCache()
+{
+	mHeaderIndex.detach(); // marks the saved index as valid
+	mHeaderIndexFile.close();
+	mHeaderEntriesFile.close();
+	mHeaderEntriesInfo = NULL;
+	mHeaderEntries = NULL;
+	mFreeHeaderEntries.clear();
+	mHeaderRefBits.clear();
+}
+
+// call lockHeaders() first!
+void LLTextureCache::rebuildHeaderIndex()
+{
+	LLTimer timer;
+	mHeaderIndex.clear();
+	mHeaderEntriesInfo->mBodySizeTotal = 0;
+	U32 num_entries = mHeaderEntriesInfo->mEntries;
+	for (U32 i=0; i<num_entries; i++)
+	{
+		Entry& entry = mHeaderEntries[i];
+		if (entry.mSize >= 0) // -1 indicates erased entry, skip
 		{
-			Entry* entries = new Entry[num_entries];
+			LLUUIDHashIndex::ShardLock shard_lock(mHeaderIndex, entry.mID);
+			if (!mHeaderIndex.insert(entry.mID, i))
 			{
-				LLAPRFile::readEx(mHeaderEntriesFileName, 
-								(U8*)entries, sizeof(EntriesInfo), num_entries*sizeof(Entry),
-								getLocalAPRFilePool());
+				entry.mSize = -1;
+				entry.mBodySize = 0;
 			}
-			typedef std::set<lru_data*, lru_data::Compare> lru_set_t;
-			lru_set_t lru;
-			for (S32 i=0; i<num_entries; i++)
-			{
-				if (entries[i].mSize >= 0) // -1 indicates erased entry, skip
-				{
-					const LLUUID& id = entries[i].mID;
-					lru.insert(new lru_data(entries[i].mTime, i, id));
-					mHeaderIDMap[id] = i;
-				}
-			}
-			mLRU.clear();
-			S32 lru_entries = sCacheMaxEntries / 10;
-			for (lru_set_t::iterator iter = lru.begin(); iter != lru.end(); ++iter)
-			{
-				lru_data* data = *iter;
-				mLRU[data->index] = data->uuid;
-				if (--lru_entries <= 0)
-					break;
-			}
-			for_each(lru.begin(), lru.end(), DeletePointer());
-			delete[] entries;
+			mHeaderEntriesInfo->mBodySizeTotal += entry.mBodySize;
 		}
 	}
+	LL_INFOS("TextureCache") << "Rebuilt header index: " << mHeaderIndex.getCount() << " entries in "
+							 << timer.getElapsedTimeF32() << " seconds" << LL_ENDL;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1168,150 +1230,287 @@ void LLTextureCache::purgeAllTextures(bool purge_directories)
 			LLFile::rmdir(mTexturesDirName);
 		}
 	}
-	mTexturesSizeMap.clear();
 }
 
-void LLTextureCache::purgeTextures(bool validate)
+// Called from any thread
+void LLTextureCache::startEviction()
 {
-	if (mReadOnly)
+	if (!mDoPurge)
 	{
-		return;
+		mDoPurge = TRUE;
+		if (mEvictor)
+		{
+			mEvictor->wake();
+		}
 	}
+}
 
-	// *FIX:Mani - watchdog off.
-	LLAppViewer::instance()->pauseMainloopTimeout();
-
-	LLMutexLock lock(&mHeaderMutex);
-	
-	S32 filesize = LLAPRFile::size(mTexturesDirEntriesFileName, getLocalAPRFilePool());
-	S32 num_entries = filesize / sizeof(Entry);
-	if (num_entries * (S32)sizeof(Entry) != filesize)
+// call lockHeaders() first!
+// Moves the CLOCK hand on by one entry.  Returns the entry it passed, or -1
+// if that entry was looked up since the hand last came by.
+S32 LLTextureCache::tickClock()
+{
+	U32 num_entries = mHeaderEntriesInfo->mEntries;
+	if (!num_entries)
 	{
-		LL_WARNS("TextureCache") << "Bad cache file: " << mTexturesDirEntriesFileName << " Purging." << LL_ENDL;
-		purgeAllTextures(false);
-		return;
+		return -1;
 	}
-	if (num_entries == 0)
+	if (mClockHand >= num_entries)
 	{
-		return; // nothing to do
+		mClockHand = 0;
 	}
-	
-	Entry* entries = new Entry[num_entries];
-	S32 bytes_read = LLAPRFile::readEx(mTexturesDirEntriesFileName, 
-										 (U8*)entries, 0, num_entries*sizeof(Entry),
-										 getLocalAPRFilePool());	
-	if (bytes_read != filesize)
+	S32 idx = mClockHand++;
+	if (mHeaderRefBits[idx])
+	{
+		mHeaderRefBits[idx] = 0; // second chance
+		return -1;
+	}
+	return idx;
+}
+
+// call lockHeaders() first!
+// Returns the number of bytes freed; the caller removes the file.
+S64 LLTextureCache::evictTextureBody(S32 idx)
+{
+	Entry& entry = mHeaderEntries[idx];
+	S64 bodysize = entry.mBodySize;
+	mHeaderEntriesInfo->mBodySizeTotal -= bodysize;
+	entry.mBodySize = 0;
+	return bodysize;
+}
+
+// call lockHeaders() first!
+void LLTextureCache::queueBodyRemoval(const LLUUID& id, std::vector<LLUUID>& removals)
+{
+	mRemovingBodies.insert(id);
+	removals.push_back(id);
+}
+
+// Removes the files queued by queueBodyRemoval(), without mHeaderMutex held
+void LLTextureCache::removeBodies(const std::vector<LLUUID>& removals)
+{
+	if (removals.empty())
 	{
-		LL_WARNS("TextureCache") << "Bad cache file (2): " << mTexturesDirEntriesFileName << " Purging." << LL_ENDL;
-		purgeAllTextures(false);
 		return;
 	}
-	
-	LL_DEBUGS("TextureCache") << "TEXTURE CACHE: Reading Entries..." << LL_ENDL;
-	
-	std::map<LLUUID, S32> entry_idx_map;
-	S64 total_size = 0;
-	for (S32 idx=0; idx<num_entries; idx++)
+	for (std::vector<LLUUID>::const_iterator iter = removals.begin(); iter != removals.end(); ++iter)
 	{
-		const LLUUID& id = entries[idx].mID;
- 		LL_DEBUGS("TextureCache") << "Entry: " << id << " Size: " << entries[idx].mSize << " Time: " << entries[idx].mTime << LL_ENDL;
-		std::map<LLUUID, S32>::iterator iter = entry_idx_map.find(id);
-		if (iter != entry_idx_map.end())
-		{
-			// Newer entry replacing older entry
-			S32 pidx = iter->second;
-			total_size -= entries[pidx].mSize;
-			entries[pidx].mSize = 0; // flag: skip older entry
-		}
-		entry_idx_map[id] = idx;
-		total_size += entries[idx].mSize;
+		LLFile::remove(getTextureFileName(*iter));
 	}
-
-	U32 validate_idx = 0;
-	if (validate)
+	LLMutexLock lock(&mHeaderMutex);
+	for (std::vector<LLUUID>::const_iterator iter = removals.begin(); iter != removals.end(); ++iter)
 	{
-		validate_idx = gSavedSettings.getU32("CacheValidateCounter");
-		U32 next_idx = (++validate_idx) % 256;
-		gSavedSettings.setU32("CacheValidateCounter", next_idx);
-		LL_DEBUGS("TextureCache") << "TEXTURE CACHE: Validating: " << validate_idx << LL_ENDL;
+		mRemovingBodies.erase(*iter);
 	}
-	
-	S64 min_cache_size = (sCacheMaxTexturesSize * 9) / 10;
-	S32 purge_count = 0;
-	S32 next_idx = 0;
-	for (S32 idx=0; idx<num_entries; idx++)
+	mHeaderMutex.broadcast();
+}
+
+// Does one small batch of eviction (or validation) work.  Returns true if
+// there is more to do.  Called from the evictor thread, or from update()
+// when the cache is not threaded.
+bool LLTextureCache::evictTextures()
+{
+	// Clock steps per batch, bounds the time mHeaderMutex is held
+	const U32 EVICT_BATCH_STEPS = 1024;
+	const U32 EVICT_BATCH_TEXTURES = 32;
+
+	LLTimer timer;
+	std::vector<LLUUID> evicted;
+	bool purging;
 	{
-		if (entries[idx].mSize == 0)
-		{
-			continue;
-		}
-		bool purge_entry = false;
-		std::string filename = getTextureFileName(entries[idx].mID);
-		if (total_size >= min_cache_size)
+		LLMutexLock lock(&mHeaderMutex);
+		if (!mHeaderEntries)
 		{
-			purge_entry = true;
+			mDoPurge = FALSE;
+			mValidateIdx = -1;
+			return false;
 		}
-		else if (validate)
+		purging = mDoPurge;
+		if (purging)
 		{
-			// make sure file exists and is the correct size
-			S32 uuididx = entries[idx].mID.mData[0];
-			if (uuididx == validate_idx)
+			S64 min_cache_size = (sCacheMaxTexturesSize * 9) / 10;
+			U32 steps = 0;
+			while (mHeaderEntriesInfo->mBodySizeTotal > min_cache_size
+				   && steps < EVICT_BATCH_STEPS
+				   && evicted.size() < EVICT_BATCH_TEXTURES)
+			{
+				steps++;
+				S32 idx = tickClock();
+				if (idx >= 0 && mHeaderEntries[idx].mBodySize > 0)
+				{
+					mBytesEvicted += evictTextureBody(idx);
+					queueBodyRemoval(mHeaderEntries[idx].mID, evicted);
+				}
+			}
+			mEvictSteps += steps;
+			if (mHeaderEntriesInfo->mBodySizeTotal <= min_cache_size)
+			{
+				mDoPurge = FALSE;
+				mEvictSteps = 0;
+			}
+			else if (mEvictSteps > 2 * mHeaderEntriesInfo->mEntries + EVICT_BATCH_STEPS)
 			{
- 				LL_DEBUGS("TextureCache") << "Validating: " << filename << "Size: " << entries[idx].mSize << LL_ENDL;
-				S32 bodysize = LLAPRFile::size(filename, getLocalAPRFilePool());
-				if (bodysize != entries[idx].mSize)
+				// Two full turns clear every bit and evict every body, so
+				// the total must have drifted from the entries.
+				S64 total = 0;
+				for (U32 i = 0; i < mHeaderEntriesInfo->mEntries; i++)
 				{
-					LL_WARNS("TextureCache") << "TEXTURE CACHE BODY HAS BAD SIZE: " << bodysize << " != " << entries[idx].mSize
-							<< filename << LL_ENDL;
-					purge_entry = true;
+					total += mHeaderEntries[i].mBodySize;
 				}
+				LL_WARNS("TextureCache") << "Body size total was " << mHeaderEntriesInfo->mBodySizeTotal
+										 << ", entries add up to " << total << LL_ENDL;
+				mHeaderEntriesInfo->mBodySizeTotal = total;
+				mDoPurge = FALSE;
+				mEvictSteps = 0;
 			}
 		}
-		if (purge_entry)
+	}
+
+	if (!purging && mValidateIdx >= 0)
+	{
+		validateTextures(evicted);
+	}
+
+	// A writer claiming one of these bodies again waits in
+	// setTextureBodySize() until its old file is gone
+	removeBodies(evicted);
+
+	if (purging)
+	{
+		F32 elapsed = timer.getElapsedTimeF32() * 1000.f;
+		LLMutexLock lock(&mHeaderMutex);
+		mEvictBatches++;
+		mEvictTimeTotal += elapsed;
+		mEvictTimeMax = llmax(mEvictTimeMax, elapsed);
+	}
+	return mDoPurge || mValidateIdx >= 0;
+}
+
+// Checks the size of one batch of the bodies picked for validation this
+// session, queueing any that do not match for removal.
+void LLTextureCache::validateTextures(std::vector<LLUUID>& evicted)
+{
+	const U32 VALIDATE_BATCH_STEPS = 4096;
+
+	typedef std::vector<std::pair<S32, S32> > check_list_t; // index, body size
+	check_list_t check;
+	{
+		LLMutexLock lock(&mHeaderMutex);
+		U32 num_entries = mHeaderEntriesInfo->mEntries;
+		U32 end = llmin(mValidatePos + VALIDATE_BATCH_STEPS, num_entries);
+		for (U32 i = mValidatePos; i < end; i++)
 		{
-			purge_count++;
-	 		LL_DEBUGS("TextureCache") << "PURGING: " << filename << LL_ENDL;
-			LLAPRFile::remove(filename, getLocalAPRFilePool());
-			total_size -= entries[idx].mSize;
-			entries[idx].mSize = 0;
+			const Entry& entry = mHeaderEntries[i];
+			if (entry.mBodySize > 0 && entry.mID.mData[0] == mValidateIdx)
+			{
+				check.push_back(std::make_pair((S32)i, entry.mBodySize));
+			}
 		}
-		else
+		mValidatePos = end;
+		if (end >= num_entries)
 		{
-			if (next_idx != idx)
+			mValidateIdx = -1;
+		}
+	}
+
+	for (check_list_t::iterator iter = check.begin(); iter != check.end(); ++iter)
+	{
+		S32 idx = iter->first;
+		LLUUID id;
+		{
+			LLMutexLock lock(&mHeaderMutex);
+			id = mHeaderEntries[idx].mID;
+		}
+		std::string filename = getTextureFileName(id);
+		llstat stat_data;
+		S32 bodysize = LLFile::stat(filename, &stat_data) ? 0 : (S32)stat_data.st_size;
+		if (bodysize != iter->second)
+		{
+			LLMutexLock lock(&mHeaderMutex);
+			const Entry& entry = mHeaderEntries[idx];
+			if (entry.mID == id && entry.mBodySize == iter->second)
 			{
-				entries[next_idx] = entries[idx];
+				LL_WARNS("TextureCache") << "TEXTURE CACHE BODY HAS BAD SIZE: " << bodysize << " != " << entry.mBodySize
+										 << filename << LL_ENDL;
+				evictTextureBody(idx);
+				queueBodyRemoval(id, evicted);
 			}
-			++next_idx;
 		}
 	}
-	num_entries = next_idx;
+}
 
-	LL_DEBUGS("TextureCache") << "TEXTURE CACHE: Writing Entries: " << num_entries << LL_ENDL;
-	
-	LLAPRFile::remove(mTexturesDirEntriesFileName, getLocalAPRFilePool());
-	LLAPRFile::writeEx(mTexturesDirEntriesFileName, 
-						 (U8*)&entries[0], 0, num_entries*sizeof(Entry),
-						 getLocalAPRFilePool());
-	
-	mTexturesSizeTotal = 0;
-	mTexturesSizeMap.clear();
-	for (S32 idx=0; idx<num_entries; idx++)
+void LLTextureCache::stopEvictor()
+{
+	if (mEvictor)
 	{
-		mTexturesSizeMap[entries[idx].mID] = entries[idx].mSize;
-		mTexturesSizeTotal += entries[idx].mSize;
+		// ~LLThread() only waits for a thread it has seen running
+		for (S32 timeout = 1000; timeout > 0 && !mEvictor->hasStarted(); --timeout)
+		{
+			ms_sleep(1);
+		}
+		// asks the thread to quit and waits for it
+		delete mEvictor;
+		mEvictor = NULL;
 	}
-	llassert(mTexturesSizeTotal == total_size);
-	
-	delete[] entries;
+}
 
-	// *FIX:Mani - watchdog back on.
-	LLAppViewer::instance()->resumeMainloopTimeout();
-	
-	LL_INFOS("TextureCache") << "TEXTURE CACHE:"
-			<< " PURGED: " << purge_count
-			<< " ENTRIES: " << num_entries
-			<< " CACHE SIZE: " << total_size / 1024*1024 << " MB"
-			<< llendl;
+F32 LLTextureCache::getHitRate()
+{
+	U32 hits = mReadHits;
+	U32 total = hits + mReadMisses;
+	return total ? (F32)hits / (F32)total : 0.f;
+}
+
+S64 LLTextureCache::getBytesEvicted()
+{
+	LLMutexLock lock(&mHeaderMutex);
+	return mBytesEvicted;
+}
+
+F32 LLTextureCache::getEvictTimeAvg()
+{
+	LLMutexLock lock(&mHeaderMutex);
+	return mEvictBatches ? mEvictTimeTotal / (F32)mEvictBatches : 0.f;
+}
+
+F32 LLTextureCache::getEvictTimeMax()
+{
+	LLMutexLock lock(&mHeaderMutex);
+	return mEvictTimeMax;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+LLTextureCache::Evictor::Evictor(LLTextureCache* cache)
+	: LLThread("TextureCacheEvictor"),
+	  mCache(cache),
+	  mStarted(false)
+{
+}
+
+// virtual
+bool LLTextureCache::Evictor::runCondition()
+{
+	// mRunCondition must be locked here
+	return !mCache->isPaused() && (mCache->mDoPurge || mCache->mValidateIdx >= 0);
+}
+
+// virtual
+void LLTextureCache::Evictor::run()
+{
+	mStarted = true;
+	while (1)
+	{
+		checkPause();
+
+		if (isQuitting())
+			break;
+
+		mCache->evictTextures();
+		yield();
+	}
+
+	llinfos << "TEXTURE CACHE EVICTOR EXITING." << llendl;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1341,81 +1540,140 @@ LLTextureCacheWorker* LLTextureCache::getWriter(handle_t handle)
 
 //////////////////////////////////////////////////////////////////////////////
 
-// Called from work thread
-S32 LLTextureCache::getHeaderCacheEntry(const LLUUID& id, bool touch, S32* imagesize)
+// Called with id's index shard locked
+S32 LLTextureCache::lookupHeaderCacheEntry(const LLUUID& id, bool touch, S32* imagesize)
 {
-	bool retry = false;
-	S32 idx = -1;
+	S32 idx = mHeaderIndex.find(id);
+	if (idx < 0)
+	{
+		return -1;
+	}
+	Entry& entry = mHeaderEntries[idx];
+	if (entry.mID != id)
+	{
+		// The entries file was changed behind the index's back
+		mHeaderIndex.erase(id);
+		return -1;
+	}
+	mHeaderRefBits[idx] = 1;
+	if (touch)
+	{
+		llassert_always(imagesize && *imagesize > 0);
+		entry.mSize = *imagesize;
+		entry.mTime = time(NULL);
+	}
+	else if (imagesize)
+	{
+		*imagesize = entry.mSize;
+	}
+	return idx;
+}
 
+// call lockHeaders() first!
+// Bodies of replaced entries are queued on removals for removeBodies().
+S32 LLTextureCache::allocHeaderCacheEntry(std::vector<LLUUID>& removals)
+{
+	while (!mFreeHeaderEntries.empty())
 	{
-		LLMutexLock lock(&mHeaderMutex);
-		id_map_t::iterator iter = mHeaderIDMap.find(id);
-		if (iter != mHeaderIDMap.end())
+		S32 idx = mFreeHeaderEntries.back();
+		mFreeHeaderEntries.pop_back();
+		if (mHeaderEntries[idx].mSize < 0)
 		{
-			idx = iter->second;
+			return idx; // still erased
 		}
-		else if (touch && !mReadOnly)
+	}
+	if (mHeaderEntriesInfo->mEntries < sCacheMaxEntries)
+	{
+		return mHeaderEntriesInfo->mEntries++;
+	}
+
+	// Replace the next entry the clock picks.  One full turn clears every
+	// bit, so only lookups racing the hand can keep it going.
+	S32 idx = -1;
+	for (U32 steps = 0; idx < 0 && steps < 2 * mHeaderEntriesInfo->mEntries; steps++)
+	{
+		idx = tickClock();
+	}
+	if (idx < 0)
+	{
+		idx = mClockHand - 1; // the one just passed
+	}
+	Entry& entry = mHeaderEntries[idx];
+	if (entry.mSize >= 0)
+	{
+		LLUUID oldid = entry.mID;
 		{
-			if (mHeaderEntriesInfo.mEntries < sCacheMaxEntries)
-			{
-				// Add an entry
-				idx = mHeaderEntriesInfo.mEntries++;
-				mHeaderIDMap[id] = idx;
-				// Update Info
-				LLAPRFile::writeEx(mHeaderEntriesFileName, 
-									(U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
-									getLocalAPRFilePool());
-			}
-			else if (!mLRU.empty())
-			{
-				idx = mLRU.begin()->first; // will be erased below
-				const LLUUID& oldid = mLRU.begin()->second;
-				mHeaderIDMap.erase(oldid);
-				mTexturesSizeMap.erase(oldid);
-				mHeaderIDMap[id] = idx;
-			}
-			else
+			LLUUIDHashIndex::ShardLock shard_lock(mHeaderIndex, oldid);
+			if (mHeaderIndex.find(oldid) == idx)
 			{
-				idx = -1;
-				retry = true;
+				mHeaderIndex.erase(oldid);
 			}
+			entry.mSize = -1;
 		}
-		if (idx >= 0)
+		if (entry.mBodySize > 0)
 		{
-			if (touch && !mReadOnly)
-			{
-				// Update the lru entry
-				mLRU.erase(idx);
-				llassert_always(imagesize && *imagesize > 0);
-				Entry* entry = new Entry(id, *imagesize, time(NULL));
-				S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
-				LLAPRFile::writeEx(mHeaderEntriesFileName, 
-									 (U8*)entry, offset, sizeof(Entry),
-									 getLocalAPRFilePool());
-				delete entry;
-			}
-			else if (imagesize)
-			{
-				// Get the image size
-				Entry entry;
-				S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
-
-				LLAPRFile::readEx(mHeaderEntriesFileName, 
-									(U8*)&entry, offset, sizeof(Entry),
-									getLocalAPRFilePool());
-				*imagesize = entry.mSize;
-			}
+			evictTextureBody(idx);
+			queueBodyRemoval(oldid, removals);
 		}
 	}
-	if (retry)
+	return idx;
+}
+
+// Called from work thread
+S32 LLTextureCache::getHeaderCacheEntry(const LLUUID& id, bool touch, S32* imagesize)
+{
+	if (!mHeaderEntries)
+	{
+		return -1;
+	}
+	touch = touch && !mReadOnly;
 	{
-		readHeaderCache(); // updates the lru
-		llassert_always(!mLRU.empty() || mHeaderEntriesInfo.mEntries < sCacheMaxEntries);
-		idx = getHeaderCacheEntry(id, touch, imagesize); // assert above ensures no inf. recursion
+		LLUUIDHashIndex::ShardLock shard_lock(mHeaderIndex, id);
+		S32 idx = lookupHeaderCacheEntry(id, touch, imagesize);
+		if (idx >= 0 || !touch)
+		{
+			return idx;
+		}
 	}
+
+	std::vector<LLUUID> removals;
+	S32 idx = addHeaderCacheEntry(id, imagesize, removals);
+	removeBodies(removals);
 	return idx;
 }
 
+// Called from work thread
+S32 LLTextureCache::addHeaderCacheEntry(const LLUUID& id, S32* imagesize, std::vector<LLUUID>& removals)
+{
+	LLMutexLock lock(&mHeaderMutex);
+	S32 idx;
+	{
+		// Another thread may have added it while we waited for the lock
+		LLUUIDHashIndex::ShardLock shard_lock(mHeaderIndex, id);
+		idx = lookupHeaderCacheEntry(id, true, imagesize);
+		if (idx >= 0)
+		{
+			return idx;
+		}
+	}
+	idx = allocHeaderCacheEntry(removals);
+	if (idx < 0)
+	{
+		return -1;
+	}
+	LLUUIDHashIndex::ShardLock shard_lock(mHeaderIndex, id);
+	if (!mHeaderIndex.insert(id, idx))
+	{
+		LL_WARNS("TextureCache") << "Header index shard full, not caching " << id << LL_ENDL;
+		mFreeHeaderEntries.push_back(idx);
+		return -1;
+	}
+	Entry& entry = mHeaderEntries[idx];
+	entry.mID = id;
+	entry.mBodySize = 0;
+	return lookupHeaderCacheEntry(id, true, imagesize);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 // Calls from texture pipeline thread (i.e. LLTextureFetch)
@@ -1479,14 +1737,6 @@ LLTextureCache::handle_t LLTextureCache::writeToCache(const LLUUID& id, U32 prio
 		delete responder;
 		return LLWorkerThread::nullHandle();
 	}
-	if (mDoPurge)
-	{
-		// NOTE: This may cause an occasional hiccup,
-		//  but it really needs to be done on the control thread
-		//  (i.e. here)		
-		purgeTextures(false);
-		mDoPurge = FALSE;
-	}
 	if (datasize >= TEXTURE_CACHE_ENTRY_SIZE)
 	{
 		LLMutexLock lock(&mWorkersMutex);
@@ -1540,33 +1790,29 @@ void LLTextureCache::addCompleted(Responder* responder, bool success)
 
 // Called from MAIN thread (endWork())
 
-bool LLTextureCache::removeHeaderCacheEntry(const LLUUID& id)
+bool LLTextureCache::removeHeaderCacheEntry(const LLUUID& id, std::vector<LLUUID>& removals)
 {
-	if (mReadOnly)
+	if (mReadOnly || !mHeaderEntries)
 	{
 		return false;
 	}
 	LLMutexLock lock(&mHeaderMutex);
-	id_map_t::iterator iter = mHeaderIDMap.find(id);
-	if (iter != mHeaderIDMap.end())
+	// remove any body file, even one we have no entry for
+	queueBodyRemoval(id, removals);
+	S32 idx;
 	{
-		S32 idx = iter->second;
-		if (idx >= 0)
+		LLUUIDHashIndex::ShardLock shard_lock(mHeaderIndex, id);
+		idx = lookupHeaderCacheEntry(id, false);
+		if (idx < 0)
 		{
-			Entry* entry = new Entry(id, -1, time(NULL));
-			S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
-
-			LLAPRFile::writeEx(mHeaderEntriesFileName,
-								 (U8*)entry, offset, sizeof(Entry),
-								 getLocalAPRFilePool());			
-			delete entry;
-			mLRU[idx] = id;
-			mHeaderIDMap.erase(id);
-			mTexturesSizeMap.erase(id);
-			return true;
+			return false;
 		}
+		mHeaderIndex.erase(id);
+		evictTextureBody(idx);
+		mHeaderEntries[idx] = Entry(id, -1, time(NULL));
 	}
-	return false;
+	mFreeHeaderEntries.push_back(idx);
+	return true;
 }
 
 void LLTextureCache::removeFromCache(const LLUUID& id)
@@ -1574,8 +1820,14 @@ void LLTextureCache::removeFromCache(const LLUUID& id)
 	//llwarns << "Removing texture from cache: " << id << llendl;
 	if (!mReadOnly)
 	{
-		removeHeaderCacheEntry(id);
-		LLAPRFile::remove(getTextureFileName(id), getLocalAPRFilePool());
+		std::vector<LLUUID> removals;
+		removeHeaderCacheEntry(id, removals);
+		if (removals.empty())
+		{
+			// no header cache to coordinate with
+			LLAPRFile::remove(getTextureFileName(id), getLocalAPRFilePool());
+		}
+		removeBodies(removals);
 	}
 }
 
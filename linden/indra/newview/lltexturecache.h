@@ -34,9 +34,11 @@
 #define LL_LLTEXTURECACHE_H
 
 #include "lldir.h"
+#include "llmappedfile.h"
 #include "llstl.h"
 #include "llstring.h"
 #include "lluuid.h"
+#include "lluuidhashindex.h"
 
 #include "llworkerthread.h"
 
@@ -79,6 +81,7 @@ public:
 	LLTextureCache(bool threaded);
 	~LLTextureCache();
 
+	/*virtual*/ void shutdown();
 	/*virtual*/ S32 update(U32 max_time_ms);	
 	
 	void purgeCache(ELLPath location);
@@ -107,9 +110,16 @@ public:
 	S32 getNumReads() { return mReaders.size(); }
 	S32 getNumWrites() { return mWriters.size(); }
 
+	// stats
+	F32 getHitRate(); // fraction of reads found in the cache
+	S64 getBytesEvicted();
+	F32 getEvictTimeAvg(); // ms per eviction batch
+	F32 getEvictTimeMax();
+
 protected:
 	// Accessed by LLTextureCacheWorker
-	bool appendToTextureEntryList(const LLUUID& id, S32 size);
+	bool setTextureBodySize(const LLUUID& id, S32 size);
+	void recordRead(bool hit) { if (hit) mReadHits++; else mReadMisses++; }
 	std::string getLocalFileName(const LLUUID& id);
 	std::string getTextureFileName(const LLUUID& id);
 	void addCompleted(Responder* responder, bool success);
@@ -120,17 +130,47 @@ protected:
 private:
 	void setDirNames(ELLPath location);
 	void readHeaderCache();
+	void closeHeaderCache();
+	void rebuildHeaderIndex();
+	S32 allocHeaderCacheEntry(std::vector<LLUUID>& removals);
+	S32 addHeaderCacheEntry(const LLUUID& id, S32* imagesize, std::vector<LLUUID>& removals);
+	S32 tickClock();
 	void purgeAllTextures(bool purge_directories);
-	void purgeTextures(bool validate);
+	void startEviction();
+	bool evictTextures();
+	void validateTextures(std::vector<LLUUID>& evicted);
+	S64 evictTextureBody(S32 idx);
+	void queueBodyRemoval(const LLUUID& id, std::vector<LLUUID>& removals);
+	void removeBodies(const std::vector<LLUUID>& removals);
+	void stopEvictor();
 	S32 getHeaderCacheEntry(const LLUUID& id, bool touch, S32* imagesize = NULL);
-	bool removeHeaderCacheEntry(const LLUUID& id);
+	S32 lookupHeaderCacheEntry(const LLUUID& id, bool touch, S32* imagesize = NULL);
+	bool removeHeaderCacheEntry(const LLUUID& id, std::vector<LLUUID>& removals);
 	void lockHeaders() { mHeaderMutex.lock(); }
 	void unlockHeaders() { mHeaderMutex.unlock(); }
 	
 private:
+	// Frees space in the body cache a few textures at a time when it goes
+	// over budget, so neither the main thread nor writers wait for it.
+	class Evictor : public LLThread
+	{
+	public:
+		Evictor(LLTextureCache* cache);
+
+		bool hasStarted() const { return mStarted; }
+
+	protected:
+		/*virtual*/ bool runCondition(void);
+		/*virtual*/ void run(void);
+
+	private:
+		LLTextureCache* mCache;
+		volatile bool mStarted;
+	};
+
 	// Internal
 	LLMutex mWorkersMutex;
-	LLMutex mHeaderMutex;
+	LLCondition mHeaderMutex; // signalled when mRemovingBodies shrinks
 	LLMutex mListMutex;
 	
 	typedef std::map<handle_t, LLTextureCacheWorker*> handle_map_t;
@@ -150,32 +190,58 @@ private:
 	{
 		F32 mVersion;
 		U32 mEntries;
+		S64 mBodySizeTotal; // sum of mBodySize
 	};
 	struct Entry
 	{
 		Entry() {}
-		Entry(const LLUUID& id, S32 size, U32 time) : mID(id), mSize(size), mTime(time) {}
+		Entry(const LLUUID& id, S32 size, U32 time) : mID(id), mSize(size), mBodySize(0), mTime(time) {}
 		LLUUID mID; // 128 bits
 		S32 mSize; // total size of image if known (NOT size cached)
+		S32 mBodySize; // bytes cached in the texture's body file
 		U32 mTime; // seconds since 1/1/1970
 	};
 
 	// HEADERS (Include first mip)
+	// The entries file is mapped and indexed by mHeaderIndex, which is
+	// itself mapped from mHeaderIndexFileName, so opening the cache reads
+	// nothing up front.  Hits only lock the UUID's index shard; adding an
+	// entry also takes mHeaderMutex.
 	std::string mHeaderEntriesFileName;
+	std::string mHeaderIndexFileName;
 	std::string mHeaderDataFileName;
-	EntriesInfo mHeaderEntriesInfo;
-	typedef std::map<S32,LLUUID> index_map_t;
-	index_map_t mLRU; // index, id; stored as a map for fast removal
-	typedef std::map<LLUUID,S32> id_map_t;
-	id_map_t mHeaderIDMap;
+	LLMappedFile mHeaderEntriesFile;
+	LLMappedFile mHeaderIndexFile;
+	EntriesInfo* mHeaderEntriesInfo; // in mHeaderEntriesFile
+	Entry* mHeaderEntries; // sCacheMaxEntries, following mHeaderEntriesInfo
+	LLUUIDHashIndex mHeaderIndex;
+	std::vector<S32> mFreeHeaderEntries; // erased entries to reuse first
+	// Entries are replaced, and bodies evicted, in CLOCK order: the hand
+	// skips an entry whose bit was set by a lookup since it last passed.
+	std::vector<U8> mHeaderRefBits;
+	U32 mClockHand;
 
 	// BODIES (TEXTURES minus headers)
+	// Sizes are kept in the header entries; the evictor thread brings the
+	// total back under 90% of sCacheMaxTexturesSize whenever it goes over.
 	std::string mTexturesDirName;
-	std::string mTexturesDirEntriesFileName;
-	typedef std::map<LLUUID,S32> size_map_t;
-	size_map_t mTexturesSizeMap;
-	S64 mTexturesSizeTotal;
+	std::string mTexturesDirEntriesFileName; // no longer used, removed at startup
 	LLAtomic32<BOOL> mDoPurge;
+	Evictor* mEvictor;
+	U32 mEvictSteps; // clock steps since the current purge started
+	S32 mValidateIdx; // entries with this first UUID byte get their body sizes checked; -1 when done
+	U32 mValidatePos;
+	// Evicted bodies whose files are being removed without mHeaderMutex
+	// held.  Writers wait for them before claiming the body again.
+	std::set<LLUUID> mRemovingBodies;
+
+	// Stats
+	LLAtomicU32 mReadHits;
+	LLAtomicU32 mReadMisses;
+	S64 mBytesEvicted; // these are guarded by mHeaderMutex
+	U32 mEvictBatches;
+	F32 mEvictTimeTotal;
+	F32 mEvictTimeMax;
 	
 	// Statics
 	static F32 sHeaderCacheVersion;
@@ -48,6 +48,9 @@
 #include "llviewerimage.h"
 #include "llviewerregion.h"
 
+// Total size of the codestreams finished workers keep for refinement
+const S32 MAX_RETAINED_CODESTREAM_BYTES = 16 * 1024 * 1024;
+
 //////////////////////////////////////////////////////////////////////////////
 //static
 class LLTextureFetchWorker : public LLWorkerClass
@@ -304,6 +307,7 @@ private:
 	S32 mDecodedDiscard;
 	LLFrameTimer mRequestedTimer;
 	LLFrameTimer mFetchTimer;
+	LLTimer mFirstPixelTimer;
 	LLTextureCache::handle_t mCacheReadHandle;
 	LLTextureCache::handle_t mCacheWriteHandle;
 	U8* mBuffer;
@@ -319,6 +323,8 @@ private:
 	BOOL mNeedsAux;
 	BOOL mHaveAllData;
 	BOOL mInLocalCache;
+	BOOL mHaveFirstPixel;
+	S32 mRetainedSize;	// bytes counted against the fetcher's retained codestream cap
 	S32 mRetryAttempt;
 	std::string mURL;
 	S32 mActiveCount;
@@ -414,6 +420,8 @@ LLTextureFetchWorker::LLTextureFetchWorker(LLTextureFetch* fetcher,
 	  mNeedsAux(FALSE),
 	  mHaveAllData(FALSE),
 	  mInLocalCache(FALSE),
+	  mHaveFirstPixel(FALSE),
+	  mRetainedSize(0),
 	  mRetryAttempt(0),
 	  mActiveCount(0),
 	  mWorkMutex(NULL),
@@ -506,7 +514,7 @@ void LLTextureFetchWorker::setDesiredDiscard(S32 discard, S32 size)
 	{
 		mState = INIT;
 		U32 work_priority = mWorkPriority | LLWorkerThread::PRIORITY_HIGH;
-		setPriority(work_priority);
+		setPriority(work_priority, mFetcher->mPriorityBatch);
 	}
 }
 
@@ -519,7 +527,7 @@ void LLTextureFetchWorker::setImagePriority(F32 priority)
 		mImagePriority = priority;
 		calcWorkPriority();
 		U32 work_priority = mWorkPriority | (getPriority() & LLWorkerThread::PRIORITY_HIGHBITS);
-		setPriority(work_priority);
+		setPriority(work_priority, mFetcher->mPriorityBatch);
 	}
 }
 
@@ -539,7 +547,10 @@ void LLTextureFetchWorker::resetFormattedData()
 void LLTextureFetchWorker::startWork(S32 param)
 {
 	llassert(mImageWorker == NULL);
-	llassert(mFormattedImage.isNull());
+	// only a codestream kept for refinement survives endWork()
+	llassert(mFormattedImage.isNull() || mRetainedSize > 0);
+	// we're using it again, so it no longer counts against the cap
+	mFetcher->releaseCodestream(this, false);
 }
 
 #include "llviewerimagelist.h" // debug
@@ -577,7 +588,6 @@ bool LLTextureFetchWorker::doWork(S32 param)
 		mLoadedDiscard = -1;
 		mDecodedDiscard = -1;
 		mRequestedSize = 0;
-		mFileSize = 0;
 		mCachedSize = 0;
 		mLoaded = FALSE;
 		mSentRequest = UNSENT;
@@ -586,7 +596,12 @@ bool LLTextureFetchWorker::doWork(S32 param)
 		delete[] mBuffer;
 		mBuffer = NULL;
 		mBufferSize = 0;
-		mHaveAllData = FALSE;
+		if (mFormattedImage.isNull() || !mFormattedImage->getDataSize())
+		{
+			mFileSize = 0;
+			mHaveAllData = FALSE;
+		}
+		// else we're refining: keep the codestream we have and only load the rest
 		clearPackets(); // TODO: Shouldn't be necessary
 		mCacheReadHandle = LLTextureCache::nullHandle();
 		mCacheWriteHandle = LLTextureCache::nullHandle();
@@ -607,7 +622,16 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				mState = CACHE_POST;
 				return false;
 			}
-			mFileSize = 0;
+			if (mHaveAllData)
+			{
+				// refining from a complete codestream we kept
+				mState = CACHE_POST;
+				return false;
+			}
+			if (!offset)
+			{
+				mFileSize = 0;
+			}
 			mLoaded = FALSE;
 			setPriority(LLWorkerThread::PRIORITY_LOW | mWorkPriority); // Set priority first since Responder may change it
 
@@ -877,7 +901,10 @@ bool LLTextureFetchWorker::doWork(S32 param)
 		U32 image_priority = LLWorkerThread::PRIORITY_NORMAL | mWorkPriority;
 		mDecoded  = FALSE;
 		mState = DECODE_IMAGE_UPDATE;
-		mImageWorker = new LLImageWorker(mFormattedImage, image_priority, discard, new DecodeResponder(mFetcher, mID, this));
+		// Decode no finer than was asked for, even if we have the data for it;
+		// a later refinement decodes from the codestream we keep.
+		mImageWorker = new LLImageWorker(mFormattedImage, image_priority, discard, new DecodeResponder(mFetcher, mID, this),
+										 mDesiredDiscard);
 		// fall though (need to call requestDecodedData() to start work)
 	}
 	
@@ -984,7 +1011,17 @@ void LLTextureFetchWorker::endWork(S32 param, bool aborted)
 		mImageWorker->scheduleDelete();
 		mImageWorker = NULL;
 	}
-	mFormattedImage = NULL;
+	if (aborted || mState != DONE || mDecodedDiscard <= 0 || mFormattedImage.isNull())
+	{
+		mFormattedImage = NULL;
+	}
+	else
+	{
+		// Finer levels can still be wanted, from data we haven't loaded yet
+		// or from data the decode was held back from; keep the codestream
+		// so the refinement only loads and decodes the rest.
+		mFetcher->retainCodestream(this);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1274,6 +1311,20 @@ bool LLTextureFetchWorker::decodeImage()
 		{
 			mDecodedDiscard = mFormattedImage->getDiscardLevel();
 // 			llinfos << mID << " : DECODE FINISHED. DISCARD: " << mDecodedDiscard << llendl;
+			S32 data_discard = mHaveAllData ? 0 : mLoadedDiscard;
+			if (data_discard < 0)
+			{
+				data_discard = mFormattedImage->calcDiscardLevelBytes(mFormattedImage->getDataSize());
+			}
+			S32 decoded_bytes = mFormattedImage->getDecodeDataSize();
+			F64 first_pixel_time = -1.0;
+			if (!mHaveFirstPixel)
+			{
+				first_pixel_time = mFirstPixelTimer.getElapsedTimeF64();
+				mHaveFirstPixel = TRUE;
+			}
+			mFetcher->addDecodeStats(decoded_bytes, mFormattedImage->getDataSize() - decoded_bytes,
+									 mDecodedDiscard > data_discard, first_pixel_time);
 		}
 		else
 		{
@@ -1321,8 +1372,11 @@ LLTextureFetch::LLTextureFetch(LLTextureCache* cache, bool threaded)
 	  mPacketCount(0),
 	  mBadPacketCount(0),
 	  mQueueMutex(getAPRPool()),
-	  mTextureCache(cache)
+	  mDecodeStatsMutex(getAPRPool()),
+	  mTextureCache(cache),
+	  mRetainedBytes(0)
 {
+	memset(&mDecodeStats, 0, sizeof(DecodeStats));
 }
 
 LLTextureFetch::~LLTextureFetch()
@@ -1465,9 +1519,44 @@ void LLTextureFetch::removeRequest(LLTextureFetchWorker* worker, bool cancel)
 	}
 	llassert_always(!(worker->getFlags(LLWorkerClass::WCF_DELETE_REQUESTED))) ;
 
+	releaseCodestream(worker, false);
 	worker->scheduleDelete();	
 }
 
+// call lockQueue() first!
+void LLTextureFetch::retainCodestream(LLTextureFetchWorker* worker)
+{
+	llassert(worker->mRetainedSize == 0);
+	worker->mRetainedSize = llmax(worker->mFormattedImage->getDataSize(), 1);
+	mRetainedBytes += worker->mRetainedSize;
+	mRetainedList.push_back(worker);
+	while (mRetainedBytes > MAX_RETAINED_CODESTREAM_BYTES && !mRetainedList.empty())
+	{
+		releaseCodestream(mRetainedList.front(), true);
+	}
+}
+
+// call lockQueue() first!
+void LLTextureFetch::releaseCodestream(LLTextureFetchWorker* worker, bool drop_data)
+{
+	if (!worker->mRetainedSize)
+	{
+		return;
+	}
+	mRetainedList.remove(worker);
+	mRetainedBytes -= worker->mRetainedSize;
+	worker->mRetainedSize = 0;
+	if (drop_data)
+	{
+		// the worker has no work, so nothing else is using the data
+		worker->lockWorkData();
+		worker->mFormattedImage = NULL;
+		worker->mFileSize = 0;
+		worker->mHaveAllData = FALSE;
+		worker->unlockWorkData();
+	}
+}
+
 // call lockQueue() first!
 LLTextureFetchWorker* LLTextureFetch::getWorker(const LLUUID& id)
 {
@@ -1551,6 +1640,11 @@ bool LLTextureFetch::updateRequestPriority(const LLUUID& id, F32 priority)
 //virtual
 S32 LLTextureFetch::update(U32 max_time_ms)
 {
+	{
+		LLMutexLock lock(&mQueueMutex);
+		submitBatch(mPriorityBatch);
+	}
+
 	S32 res;
 	res = LLWorkerThread::update(max_time_ms);
 	
@@ -1931,8 +2025,11 @@ S32 LLTextureFetch::getFetchState(const LLUUID& id, F32& data_progress_p, F32& r
 void LLTextureFetch::dump()
 {
 	llinfos << "LLTextureFetch REQUESTS:" << llendl;
-	for (request_queue_t::iterator iter = mRequestQueue.begin();
-		 iter != mRequestQueue.end(); ++iter)
+	std::vector<QueuedRequest*> requests;
+	lockData();
+	getQueuedRequests(requests);
+	for (std::vector<QueuedRequest*>::iterator iter = requests.begin();
+		 iter != requests.end(); ++iter)
 	{
 		LLQueuedThread::QueuedRequest* qreq = *iter;
 		LLWorkerThread::WorkRequest* wreq = (LLWorkerThread::WorkRequest*)qreq;
@@ -1942,6 +2039,30 @@ void LLTextureFetch::dump()
 				<< " STATE: " << worker->sStateDescs[worker->mState]
 				<< llendl;
 	}
+	unlockData();
+}
+
+void LLTextureFetch::getDecodeStats(DecodeStats& stats)
+{
+	LLMutexLock lock(&mDecodeStatsMutex);
+	stats = mDecodeStats;
+}
+
+// called from a worker thread when a decode finishes
+void LLTextureFetch::addDecodeStats(S32 decoded_bytes, S32 unused_bytes, bool redundant_avoided, F64 first_pixel_time)
+{
+	LLMutexLock lock(&mDecodeStatsMutex);
+	mDecodeStats.mDecodedBytes += decoded_bytes;
+	mDecodeStats.mUnusedBytes += llmax(unused_bytes, 0);
+	if (redundant_avoided)
+	{
+		mDecodeStats.mRedundantDecodesAvoided++;
+	}
+	if (first_pixel_time >= 0.0)
+	{
+		mDecodeStats.mFirstPixelCount++;
+		mDecodeStats.mFirstPixelTime += first_pixel_time;
+	}
 }
 
 
@@ -33,6 +33,8 @@
 #ifndef LL_LLTEXTUREFETCH_H
 #define LL_LLTEXTUREFETCH_H
 
+#include <list>
+
 #include "lldir.h"
 #include "llimage.h"
 #include "lluuid.h"
@@ -71,6 +73,18 @@ public:
 					  U32& fetch_priority_p, F32& fetch_dtime_p, F32& request_dtime_p);
 	void dump();
 	S32 getNumRequests() { return mRequestMap.size(); }
+
+	struct DecodeStats
+	{
+		U64 mDecodedBytes;				// codestream bytes read by the decoder
+		U64 mUnusedBytes;				// held, but only needed for finer levels
+		U32 mRedundantDecodesAvoided;	// decodes held to the level asked for
+		U32 mFirstPixelCount;
+		F64 mFirstPixelTime;			// request to first decoded level, seconds, total
+
+		F32 getFirstPixelTimeAvg() const { return mFirstPixelCount ? (F32)(mFirstPixelTime / mFirstPixelCount) : 0.f; }
+	};
+	void getDecodeStats(DecodeStats& stats);
 	
 	// Public for access by callbacks
 	void lockQueue() { mQueueMutex.lock(); }
@@ -81,9 +95,15 @@ protected:
 	void addToNetworkQueue(LLTextureFetchWorker* worker);
 	void removeFromNetworkQueue(LLTextureFetchWorker* worker);
 	void removeRequest(LLTextureFetchWorker* worker, bool cancel);
+	// A finished worker may keep its codestream so a later refinement only
+	// loads and decodes the rest.  The oldest are dropped past a byte cap.
+	void retainCodestream(LLTextureFetchWorker* worker);
+	void releaseCodestream(LLTextureFetchWorker* worker, bool drop_data);
 
 private:
 	void sendRequestListToSimulators();
+	// first_pixel_time < 0: not the request's first decode
+	void addDecodeStats(S32 decoded_bytes, S32 unused_bytes, bool redundant_avoided, F64 first_pixel_time);
 
 public:
 	LLUUID mDebugID;
@@ -94,6 +114,8 @@ public:
 	
 private:
 	LLMutex mQueueMutex;
+	LLMutex mDecodeStatsMutex;
+	DecodeStats mDecodeStats;
 
 	LLTextureCache* mTextureCache;
 	
@@ -107,6 +129,15 @@ private:
 	typedef std::map<LLHost,std::set<LLUUID> > cancel_queue_t;
 	cancel_queue_t mCancelQueue;
 
+	// Workers holding a codestream for refinement, oldest first
+	typedef std::list<LLTextureFetchWorker*> retained_list_t;
+	retained_list_t mRetainedList;
+	S32 mRetainedBytes;
+
+	// Priority changes made by the main thread under mQueueMutex,
+	// submitted once per update()
+	LLQueuedThread::RequestBatch mPriorityBatch;
+
 	LLFrameTimer mNetworkTimer;
 };
 
@@ -41,6 +41,7 @@
 #include "lllfsthread.h"
 #include "llui.h"
 #include "llimageworker.h"
+#include "llimagebufferpool.h"
 #include "llrender.h"
 
 #include "llhoverview.h"
@@ -395,13 +396,27 @@ void LLGLTexMemBar::draw()
 	LLGLSUIDefault gls_ui;
 	F32 text_color[] = {1.f, 1.f, 1.f, 0.75f};
 	
+	const LLTextureBudget::Stats& budget_stats = gImageList.getTextureBudget().getStats();
+	
 	std::string text;
-	text = llformat("GL Tot: %d/%d MB Bound: %d/%d MB Discard Bias: %.2f",
-					total_mem,
-					max_total_mem,
-					bound_mem,
-					max_bound_mem,
-					discard_bias);
+	if (LLViewerImage::sUseTextureBudget)
+	{
+		text = llformat("GL Tot: %d/%d MB Bound: %d/%d MB Wanted: %d MB",
+						total_mem,
+						max_total_mem,
+						bound_mem,
+						max_bound_mem,
+						(S32)BYTES_TO_MEGA_BYTES(budget_stats.mWantedBytes));
+	}
+	else
+	{
+		text = llformat("GL Tot: %d/%d MB Bound: %d/%d MB Discard Bias: %.2f",
+						total_mem,
+						max_total_mem,
+						bound_mem,
+						max_bound_mem,
+						discard_bias);
+	}
 
 	LLFontGL::getFontMonospace()->renderUTF8(text, 0, 0, line_height*3,
 									 text_color, LLFontGL::LEFT, LLFontGL::TOP);
@@ -460,15 +475,42 @@ void LLGLTexMemBar::draw()
 
 	//----------------------------------------------------------------------------
 
-	text = llformat("Textures: Count: %d Fetch: %d(%d) Pkts:%d(%d) Cache R/W: %d/%d LFS:%d IW:%d(%d) RAW:%d mRaw:%d mAux:%d CB:%d",
+	LLTextureFetch::DecodeStats decode_stats;
+	LLAppViewer::getTextureFetch()->getDecodeStats(decode_stats);
+
+	text = llformat("Decoded: %dMB Unused: %dMB First Pixel: %.0fms Redundant Avoided: %d",
+					(S32)(decode_stats.mDecodedBytes / (1024*1024)),
+					(S32)(decode_stats.mUnusedBytes / (1024*1024)),
+					decode_stats.getFirstPixelTimeAvg() * 1000.f,
+					decode_stats.mRedundantDecodesAvoided);
+	if (LLViewerImage::sUseTextureBudget)
+	{
+		text += llformat(" Degraded: %d Dropped: %d Prefetched: %d",
+						 budget_stats.mDegraded, budget_stats.mDropped, budget_stats.mPrefetched);
+	}
+
+	LLFontGL::getFontMonospace()->renderUTF8(text, 0, bar_left + bar_width + 20, line_height*3,
+									 text_color, LLFontGL::LEFT, LLFontGL::TOP);
+
+	//----------------------------------------------------------------------------
+
+	LLImageBufferPool::Stats pool_stats;
+	LLImageBufferPool::getStats(pool_stats);
+
+	text = llformat("Textures: Count: %d Fetch: %d(%d) Pkts:%d(%d) Cache R/W: %d/%d Hit:%.0f%% Evict:%dMB(%.1f/%.1fms) LFS:%d IW:%d(%d) RAW:%d mRaw:%d mAux:%d CB:%d Pool:%.0f%% %d/%dMB",
 					gImageList.getNumImages(),
 					LLAppViewer::getTextureFetch()->getNumRequests(), LLAppViewer::getTextureFetch()->getNumDeletes(),
 					LLAppViewer::getTextureFetch()->mPacketCount, LLAppViewer::getTextureFetch()->mBadPacketCount, 
 					LLAppViewer::getTextureCache()->getNumReads(), LLAppViewer::getTextureCache()->getNumWrites(),
+					LLAppViewer::getTextureCache()->getHitRate() * 100.f,
+					(S32)(LLAppViewer::getTextureCache()->getBytesEvicted() / (1024*1024)),
+					LLAppViewer::getTextureCache()->getEvictTimeAvg(), LLAppViewer::getTextureCache()->getEvictTimeMax(),
 					LLLFSThread::sLocal->getPending(),
 					LLImageWorker::sCount, LLImageWorker::getWorkerThread()->getNumDeletes(),
 					LLImageRaw::sRawImageCount, LLViewerImage::sRawCount, LLViewerImage::sAuxCount,
-					gImageList.mCallbackList.size());
+					gImageList.mCallbackList.size(),
+					pool_stats.getReuseRate() * 100.f,
+					(pool_stats.mLiveBytes + pool_stats.mCachedBytes) / (1024*1024), pool_stats.mPeakBytes / (1024*1024));
 
 	LLFontGL::getFontMonospace()->renderUTF8(text, 0, 0, line_height*2,
 									 text_color, LLFontGL::LEFT, LLFontGL::TOP);
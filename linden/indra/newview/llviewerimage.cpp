@@ -82,6 +82,7 @@ S32 LLViewerImage::sMaxBoundTextureMemInMegaBytes = 0;
 S32 LLViewerImage::sMaxTotalTextureMemInMegaBytes = 0;
 S32 LLViewerImage::sMaxDesiredTextureMemInBytes = 0 ;
 BOOL LLViewerImage::sDontLoadVolumeTextures = FALSE;
+BOOL LLViewerImage::sUseTextureBudget = FALSE;
 
 // static
 void LLViewerImage::initClass()
@@ -186,6 +187,13 @@ void LLViewerImage::updateClass(const F32 velocity, const F32 angular_velocity)
 		}
 	}
 	sDesiredDiscardBias = llclamp(sDesiredDiscardBias, sDesiredDiscardBiasMin, sDesiredDiscardBiasMax);
+
+	if (sUseTextureBudget)
+	{
+		// LLViewerImageList fits each texture to the budget instead of
+		// blurring all of them
+		sDesiredDiscardBias = 0.f;
+	}
 }
 
 // static
@@ -245,12 +253,14 @@ void LLViewerImage::init(bool firstinit)
 	mNeedsAux = FALSE;
 	mTexelsPerImage = 64.f*64.f;
 	mMaxVirtualSize = 0.f;
+	mHasStatsPosition = FALSE;
 	mDiscardVirtualSize = 0.f;
 	mRequestedDiscardLevel = -1;
 	mRequestedDownloadPriority = 0.f;
 	mFullyLoaded = FALSE;
 	mDesiredDiscardLevel = MAX_DISCARD_LEVEL + 1;
 	mMinDesiredDiscardLevel = MAX_DISCARD_LEVEL + 1;
+	mBudgetDiscardLevel = -1;
 	mCalculatedDiscardLevel = -1.f;
 
 	mDecodingAux = FALSE;
@@ -465,11 +475,22 @@ void LLViewerImage::addTextureStats(F32 virtual_size) const // = 1.0
 	}
 }
 
+void LLViewerImage::addTextureStats(F32 virtual_size, const LLVector3& position_agent) const
+{
+	if (virtual_size >= mMaxVirtualSize)
+	{
+		mMaxVirtualSize = virtual_size;
+		mStatsPositionAgent = position_agent;
+		mHasStatsPosition = TRUE;
+	}
+}
+
 void LLViewerImage::resetTextureStats(BOOL zero)
 {
 	if (zero)
 	{
 		mMaxVirtualSize = 0.0f;
+		mHasStatsPosition = FALSE;
 	}
 	else
 	{
@@ -561,6 +582,12 @@ void LLViewerImage::processTextureStats()
 		mDesiredDiscardLevel = llmin((S32)mMaxDiscardLevel+1, (S32)discard_level);
 		// Clamp to min desired discard
 		mDesiredDiscardLevel = llmin(mMinDesiredDiscardLevel, mDesiredDiscardLevel);
+		// No finer than the texture budget leaves room for.  One left out
+		// of it altogether still gets its coarsest level.
+		if (sUseTextureBudget && mBudgetDiscardLevel >= 0 && mBoostLevel < LLViewerImage::BOOST_HIGH)
+		{
+			mDesiredDiscardLevel = llmax((S32)mDesiredDiscardLevel, llmin((S32)mBudgetDiscardLevel, (S32)mMaxDiscardLevel));
+		}
 
 		//
 		// At this point we've calculated the quality level that we want,
@@ -602,6 +629,21 @@ void LLViewerImage::processTextureStats()
 			}
 		}
 	}
+
+	// With the texture budget, only textures held finer than it leaves
+	// room for give up memory, and straight down to the budgeted level.
+	// This covers textures that have gone out of view, too.
+	S32 current_discard = getDiscardLevel();
+	if (sUseTextureBudget && mBudgetDiscardLevel >= 0 &&
+		mBoostLevel < LLViewerImage::BOOST_HIGH && getUseDiscard() &&
+		current_discard >= 0 && current_discard < llmin((S32)mBudgetDiscardLevel, (S32)mMaxDiscardLevel))
+	{
+		sBoundTextureMemoryInBytes -= mTextureMemory;
+		sTotalTextureMemoryInBytes -= mTextureMemory;
+		setDiscardLevel(llmin((S32)mBudgetDiscardLevel, (S32)mMaxDiscardLevel));
+		sBoundTextureMemoryInBytes += mTextureMemory;
+		sTotalTextureMemoryInBytes += mTextureMemory;
+	}
 }
 
 //============================================================================
@@ -37,6 +37,7 @@
 #include "lltimer.h"
 #include "llframetimer.h"
 #include "llhost.h"
+#include "v3math.h"
 
 #include <map>
 #include <list>
@@ -193,6 +194,8 @@ public:
 	// New methods for determining image quality/priority
 	// texel_area_ratio is ("scaled" texel area)/(original texel area), approximately.
 	void addTextureStats(F32 virtual_size) const;
+	// As above, also remembering where the largest use is, for prefetch
+	void addTextureStats(F32 virtual_size, const LLVector3& position_agent) const;
 	void resetTextureStats(BOOL zero = FALSE);
 
 	// Process image stats to determine priority/quality requirements.
@@ -214,6 +217,10 @@ public:
 	void setDesiredDiscardLevel(S32 discard) { mDesiredDiscardLevel = discard; }
 	S32  getDesiredDiscardLevel()			 { return mDesiredDiscardLevel; }
 
+	// setBudgetDiscardLevel is only used by LLViewerImageList, -1 for no limit
+	void setBudgetDiscardLevel(S32 discard) { mBudgetDiscardLevel = discard; }
+	S32  getBudgetDiscardLevel() const		{ return mBudgetDiscardLevel; }
+
 	void setMinDiscardLevel(S32 discard) 	{ mMinDesiredDiscardLevel = llmin(mMinDesiredDiscardLevel,(S8)discard); }
 	
 	// Host we think might have this image, used for baked av textures.
@@ -290,6 +297,8 @@ public:
 
 	// Data used for calculating required image priority/quality level/decimation
 	mutable F32 mMaxVirtualSize;	// The largest virtual size of the image, in pixels - how much data to we need?
+	mutable LLVector3 mStatsPositionAgent;	// Where the face with the largest virtual size is
+	mutable BOOL mHasStatsPosition;
 
 	F32 mTexelsPerImage;			// Texels per image.
 	F32 mDiscardVirtualSize;		// Virtual size used to calculate desired discard
@@ -317,6 +326,7 @@ private:
 
 	S8  mDesiredDiscardLevel;			// The discard level we'd LIKE to have - if we have it and there's space
 	S8  mMinDesiredDiscardLevel;		// The minimum discard level we'd like to have
+	S8  mBudgetDiscardLevel;			// The finest level the texture budget leaves room for, -1 if none
 	S8  mNeedsCreateTexture;	
 	S8  mNeedsAux;					// We need to decode the auxiliary channels
 	S8  mDecodingAux;				// Are we decoding high components
@@ -369,6 +379,7 @@ public:
 	static S32 sMaxTotalTextureMemInMegaBytes;
 	static S32 sMaxDesiredTextureMemInBytes ;
 	static BOOL sDontLoadVolumeTextures;
+	static BOOL sUseTextureBudget;
 };
 
 #endif
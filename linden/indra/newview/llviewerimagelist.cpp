@@ -54,6 +54,7 @@
 #include "llagent.h"
 #include "lltexturecache.h"
 #include "lltexturefetch.h"
+#include "llviewercamera.h"
 #include "llviewercontrol.h"
 #include "llviewerimage.h"
 #include "llviewermedia.h"
@@ -518,6 +519,8 @@ void LLViewerImageList::updateImages(F32 max_time)
 	sRawMemStat.addValue((F32)BYTES_TO_MEGA_BYTES(LLImageRaw::sGlobalRawMemory));
 	sFormattedMemStat.addValue((F32)BYTES_TO_MEGA_BYTES(LLImageFormatted::sGlobalFormattedMemory));
 	
+	llpushcallstacks ;
+	updateImagesBudget();
 	llpushcallstacks ;
 	updateImagesDecodePriorities();
 	llpushcallstacks ;
@@ -646,6 +649,97 @@ void LLViewerImageList::updateImagesDecodePriorities()
 	}
 }
 
+// Fits the textures to the resident texture memory, each at the discard
+// level the budget picks for it; processTextureStats() then fetches no
+// finer and evicts down to it.  The camera's velocity since the last solve
+// is used to fetch ahead for textures it is approaching.
+void LLViewerImageList::updateImagesBudget()
+{
+	const F32 BUDGET_INTERVAL = 0.1f;	// seconds
+	const F32 MAX_PREFETCH_SPEED = 100.f;	// m/s, faster is a teleport
+
+	LLViewerImage::sUseTextureBudget = gSavedSettings.getBOOL("TextureResidencyBudget");
+	if (!LLViewerImage::sUseTextureBudget)
+	{
+		if (!mBudgetEntries.empty())
+		{
+			for (uuid_map_t::iterator iter = mUUIDMap.begin(); iter != mUUIDMap.end(); ++iter)
+			{
+				iter->second->setBudgetDiscardLevel(-1);
+			}
+			mBudgetEntries.clear();
+		}
+		return;
+	}
+	F32 elapsed = mBudgetTimer.getElapsedTimeF32();
+	if (elapsed < BUDGET_INTERVAL)
+	{
+		return;
+	}
+	mBudgetTimer.reset();
+
+	LLVector3 camera_origin = LLViewerCamera::getInstance()->getOrigin();
+	LLVector3 camera_velocity = (camera_origin - mBudgetCameraOrigin) / elapsed;
+	mBudgetCameraOrigin = camera_origin;
+	if (camera_velocity.magVec() > MAX_PREFETCH_SPEED)
+	{
+		camera_velocity.clearVec();
+	}
+
+	mBudgetEntries.clear();
+	for (uuid_map_t::iterator iter = mUUIDMap.begin(); iter != mUUIDMap.end(); ++iter)
+	{
+		LLViewerImage* imagep = iter->second;
+		imagep->setBudgetDiscardLevel(-1);
+		if (imagep->mIsMediaTexture || imagep->isDeleted() ||
+			!imagep->mFullWidth || !imagep->mFullHeight)
+		{
+			continue;
+		}
+
+		LLTextureBudget::Entry entry;
+		entry.mWidth = imagep->mFullWidth;
+		entry.mHeight = imagep->mFullHeight;
+		entry.mComponents = imagep->getComponents() ? imagep->getComponents() : 4;
+		if (entry.mWidth > LLViewerImage::MAX_IMAGE_SIZE_DEFAULT || entry.mHeight > LLViewerImage::MAX_IMAGE_SIZE_DEFAULT)
+		{
+			entry.mMinDiscard = 1; // MAX_IMAGE_SIZE_DEFAULT = 1024 and max size ever is 2048
+		}
+		entry.mMaxDiscard = imagep->getMaxDiscardLevel();
+		entry.mPixelArea = imagep->mMaxVirtualSize;
+		entry.mTimeSinceBound = imagep->getTimeSinceBound();
+		entry.mResidentDiscard = imagep->getDiscardLevel() >= 0 ? imagep->getDiscardLevel() : entry.mMaxDiscard + 1;
+		entry.mPinned = imagep->getBoostLevel() >= LLViewerImage::BOOST_HIGH || !imagep->getUseDiscard();
+		if (entry.mPinned)
+		{
+			entry.mWantedDiscard = imagep->getDesiredDiscardLevel();
+		}
+		else
+		{
+			entry.mWantedDiscard = LLTextureBudget::calcDiscardLevel((F32)entry.mWidth * entry.mHeight, entry.mPixelArea);
+		}
+		if (imagep->mHasStatsPosition)
+		{
+			LLVector3 to_image = imagep->mStatsPositionAgent - camera_origin;
+			entry.mDistance = to_image.normVec();
+			entry.mApproachSpeed = camera_velocity * to_image;
+		}
+		entry.mUserData = imagep;
+		mBudgetEntries.push_back(entry);
+	}
+
+	mTextureBudget.solve(mBudgetEntries, MEGA_BYTES_TO_BYTES((S64)mMaxResidentTexMemInMegaBytes));
+
+	for (LLTextureBudget::entry_list_t::iterator iter = mBudgetEntries.begin();
+		 iter != mBudgetEntries.end(); ++iter)
+	{
+		if (!iter->mPinned)
+		{
+			((LLViewerImage*)iter->mUserData)->setBudgetDiscardLevel(iter->mDiscard);
+		}
+	}
+}
+
 /*
  static U8 get_image_type(LLViewerImage* imagep, LLHost target_host)
  {
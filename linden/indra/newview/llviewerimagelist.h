@@ -37,6 +37,7 @@
 //#include "message.h"
 #include "llgl.h"
 #include "llstat.h"
+#include "lltexturebudget.h"
 #include "llviewerimage.h"
 #include "llui.h"
 #include <list>
@@ -135,6 +136,8 @@ public:
 	S32 getNumImages()					{ return mImageList.size(); }
 
 	void updateMaxResidentTexMem(S32 mem);
+
+	const LLTextureBudget& getTextureBudget() const { return mTextureBudget; }
 	
 	void doPreloadImages();
 	void doPrefetchImages();
@@ -144,6 +147,7 @@ public:
 	
 private:
 	void updateImagesDecodePriorities();
+	void updateImagesBudget();
 	F32  updateImagesCreateTextures(F32 max_time);
 	F32  updateImagesFetchTextures(F32 max_time);
 	void updateImagesUpdateStats();
@@ -175,6 +179,11 @@ private:
 	S32	mMaxResidentTexMemInMegaBytes;
 	S32 mMaxTotalTextureMemInMegaBytes;
 	LLFrameTimer mForceDecodeTimer;
+
+	LLTextureBudget mTextureBudget;
+	LLTextureBudget::entry_list_t mBudgetEntries;
+	LLFrameTimer mBudgetTimer;
+	LLVector3 mBudgetCameraOrigin;	// at the last solve, for the camera's velocity
 	
 public:
 	static U32 sTextureBits;
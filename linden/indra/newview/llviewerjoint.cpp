@@ -456,6 +456,26 @@ void LLViewerJoint::updateJointGeometry()
 	}
 }
 
+void LLViewerJoint::stageJointGeometry()
+{
+	for (child_list_t::iterator iter = mChildren.begin();
+		 iter != mChildren.end(); ++iter)
+	{
+		LLViewerJoint* joint = (LLViewerJoint*)(*iter);
+		joint->stageJointGeometry();
+	}
+}
+
+void LLViewerJoint::uploadStagedJointGeometry()
+{
+	for (child_list_t::iterator iter = mChildren.begin();
+		 iter != mChildren.end(); ++iter)
+	{
+		LLViewerJoint* joint = (LLViewerJoint*)(*iter);
+		joint->uploadStagedJointGeometry();
+	}
+}
+
 
 BOOL LLViewerJoint::updateLOD(F32 pixel_area, BOOL activate)
 {
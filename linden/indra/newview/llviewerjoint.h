@@ -130,6 +130,11 @@ public:
 	virtual void updateFaceData(LLFace *face, F32 pixel_area, BOOL damp_wind = FALSE);
 	virtual BOOL updateLOD(F32 pixel_area, BOOL activate);
 	virtual void updateJointGeometry();
+	// Software skinning split in two: stageJointGeometry() skins into the
+	// meshes' own memory and may run off the main thread, then
+	// uploadStagedJointGeometry() copies the result to the vertex buffers.
+	virtual void stageJointGeometry();
+	virtual void uploadStagedJointGeometry();
 	virtual void dump();
 
 	void setVisible( BOOL visible, BOOL recursive );
@@ -168,6 +168,8 @@ LLViewerJointMesh::LLViewerJointMesh()
 	mMeshID = 0;
 	mUpdateXform = FALSE;
 
+	mStagedPass = 0;
+
 	mValid = FALSE;
 }
 
@@ -728,96 +730,113 @@ BOOL LLViewerJointMesh::updateLOD(F32 pixel_area, BOOL activate)
 	return (valid != activate);
 }
 
-// static
-void LLViewerJointMesh::updateGeometryOriginal(LLFace *mFace, LLPolyMesh *mMesh)
+const S32 MAX_SKIN_MATRICES = 32;
+
+//-----------------------------------------------------------------------------
+// getSkinMatrices()
+//-----------------------------------------------------------------------------
+U32 LLViewerJointMesh::getSkinMatrices(LLMatrix4* joint_mats)
 {
+	LLDynamicArray<LLJointRenderData*>& joint_data = mMesh->getReferenceMesh()->mJointRenderData;
+	S32 joint_count = joint_data.count();
+	llassert(joint_count <= MAX_SKIN_MATRICES);
+
+	for (S32 joint_num = 0; joint_num < joint_count; joint_num++)
+	{
+		// a joint without skin data is the parent end of the next one
+		LLSkinJoint* sj = joint_data[joint_num]->mSkinJoint;
+		const LLVector3& skin_offset = sj ? sj->mRootToJointSkinOffset
+			: joint_data[joint_num + 1]->mSkinJoint->mRootToParentJointSkinOffset;
+		LLSkinning::makeJointMatrix(*joint_data[joint_num]->mWorldMatrix, skin_offset, joint_mats[joint_num]);
+	}
+	return (U32)joint_count;
+}
+
+//-----------------------------------------------------------------------------
+// skinGeometry()
+// skins straight into the vertex buffer
+//-----------------------------------------------------------------------------
+void LLViewerJointMesh::skinGeometry(LLSkinning::skin_func_t skin_func)
+{
+	LLMatrix4 joint_mats[MAX_SKIN_MATRICES];
+	getSkinMatrices(joint_mats);
+
 	LLStrider<LLVector3> o_vertices;
 	LLStrider<LLVector3> o_normals;
 
 	//get vertex and normal striders
 	LLVertexBuffer *buffer = mFace->mVertexBuffer;
-	buffer->getVertexStrider(o_vertices,  0);
-	buffer->getNormalStrider(o_normals,   0);
+	buffer->getVertexStrider(o_vertices,  mMesh->mFaceVertexOffset);
+	buffer->getNormalStrider(o_normals,   mMesh->mFaceVertexOffset);
 
-	F32 last_weight = F32_MAX;
-	LLMatrix4 gBlendMat;
-	LLMatrix3 gBlendRotMat;
+	skin_func(joint_mats, mMesh->getWeights(), mMesh->getCoords(), mMesh->getNormals(), mMesh->getNumVertices(),
+			  o_vertices.get(), o_normals.get(), buffer->getStride());
 
-	const F32* weights = mMesh->getWeights();
-	const LLVector3* coords = mMesh->getCoords();
-	const LLVector3* normals = mMesh->getNormals();
-	for (U32 index = 0; index < mMesh->getNumVertices(); index++)
-	{
-		U32 bidx = index + mMesh->mFaceVertexOffset;
-		
-		// blend by first matrix
-		F32 w = weights[index]; 
-		
-		// Maybe we don't have to change gBlendMat.
-		// Profiles of a single-avatar scene on a Mac show this to be a very
-		// common case.  JC
-		if (w == last_weight)
-		{
-			o_vertices[bidx] = coords[index] * gBlendMat;
-			o_normals[bidx] = normals[index] * gBlendRotMat;
-			continue;
-		}
-		
-		last_weight = w;
+	buffer->setBuffer(0);
+}
 
-		S32 joint = llfloor(w);
-		w -= joint;
-		
-		// No lerp required in this case.
-		if (w == 1.0f)
-		{
-			gBlendMat = gJointMatUnaligned[joint+1];
-			o_vertices[bidx] = coords[index] * gBlendMat;
-			gBlendRotMat = gJointRotUnaligned[joint+1];
-			o_normals[bidx] = normals[index] * gBlendRotMat;
-			continue;
-		}
-		
-		// Try to keep all the accesses to the matrix data as close
-		// together as possible.  This function is a hot spot on the
-		// Mac. JC
-		LLMatrix4 &m0 = gJointMatUnaligned[joint+1];
-		LLMatrix4 &m1 = gJointMatUnaligned[joint+0];
-		
-		gBlendMat.mMatrix[VX][VX] = lerp(m1.mMatrix[VX][VX], m0.mMatrix[VX][VX], w);
-		gBlendMat.mMatrix[VX][VY] = lerp(m1.mMatrix[VX][VY], m0.mMatrix[VX][VY], w);
-		gBlendMat.mMatrix[VX][VZ] = lerp(m1.mMatrix[VX][VZ], m0.mMatrix[VX][VZ], w);
+//-----------------------------------------------------------------------------
+// stageJointGeometry()
+// Called from LLVOAvatar::updateQueuedSkinning(), possibly on a job pool
+// thread, so this only touches the mesh and its joints.
+//-----------------------------------------------------------------------------
+void LLViewerJointMesh::stageJointGeometry()
+{
+	if (!(mValid
+		  && mMesh
+		  && mFace
+		  && mMesh->hasWeights()))
+	{
+		return;
+	}
 
-		gBlendMat.mMatrix[VY][VX] = lerp(m1.mMatrix[VY][VX], m0.mMatrix[VY][VX], w);
-		gBlendMat.mMatrix[VY][VY] = lerp(m1.mMatrix[VY][VY], m0.mMatrix[VY][VY], w);
-		gBlendMat.mMatrix[VY][VZ] = lerp(m1.mMatrix[VY][VZ], m0.mMatrix[VY][VZ], w);
+	U32 num_vertices = mMesh->getNumVertices();
+	mStagedCoords.resize(num_vertices);
+	mStagedNormals.resize(num_vertices);
+	if (num_vertices)
+	{
+		LLMatrix4 joint_mats[MAX_SKIN_MATRICES];
+		getSkinMatrices(joint_mats);
+		sSkinFunc(joint_mats, mMesh->getWeights(), mMesh->getCoords(), mMesh->getNormals(), num_vertices,
+				  &mStagedCoords[0], &mStagedNormals[0], sizeof(LLVector3));
+	}
+	mStagedPass = sSkinPass;
+}
 
-		gBlendMat.mMatrix[VZ][VX] = lerp(m1.mMatrix[VZ][VX], m0.mMatrix[VZ][VX], w);
-		gBlendMat.mMatrix[VZ][VY] = lerp(m1.mMatrix[VZ][VY], m0.mMatrix[VZ][VY], w);
-		gBlendMat.mMatrix[VZ][VZ] = lerp(m1.mMatrix[VZ][VZ], m0.mMatrix[VZ][VZ], w);
+//-----------------------------------------------------------------------------
+// uploadStagedJointGeometry()
+//-----------------------------------------------------------------------------
+void LLViewerJointMesh::uploadStagedJointGeometry()
+{
+	if (!(mValid
+		  && mMesh
+		  && mFace
+		  && mMesh->hasWeights()
+		  && mFace->mVertexBuffer.notNull()
+		  && LLViewerShaderMgr::instance()->getVertexShaderLevel(LLViewerShaderMgr::SHADER_AVATAR) == 0))
+	{
+		return;
+	}
 
-		gBlendMat.mMatrix[VW][VX] = lerp(m1.mMatrix[VW][VX], m0.mMatrix[VW][VX], w);
-		gBlendMat.mMatrix[VW][VY] = lerp(m1.mMatrix[VW][VY], m0.mMatrix[VW][VY], w);
-		gBlendMat.mMatrix[VW][VZ] = lerp(m1.mMatrix[VW][VZ], m0.mMatrix[VW][VZ], w);
+	U32 num_vertices = mMesh->getNumVertices();
+	if (mStagedPass != sSkinPass || mStagedCoords.size() != num_vertices)
+	{
+		// not staged this frame, the mesh may have just become visible
+		updateJointGeometry();
+		return;
+	}
 
-		o_vertices[bidx] = coords[index] * gBlendMat;
-		
-		LLMatrix3 &n0 = gJointRotUnaligned[joint+1];
-		LLMatrix3 &n1 = gJointRotUnaligned[joint+0];
-		
-		gBlendRotMat.mMatrix[VX][VX] = lerp(n1.mMatrix[VX][VX], n0.mMatrix[VX][VX], w);
-		gBlendRotMat.mMatrix[VX][VY] = lerp(n1.mMatrix[VX][VY], n0.mMatrix[VX][VY], w);
-		gBlendRotMat.mMatrix[VX][VZ] = lerp(n1.mMatrix[VX][VZ], n0.mMatrix[VX][VZ], w);
+	LLStrider<LLVector3> o_vertices;
+	LLStrider<LLVector3> o_normals;
 
-		gBlendRotMat.mMatrix[VY][VX] = lerp(n1.mMatrix[VY][VX], n0.mMatrix[VY][VX], w);
-		gBlendRotMat.mMatrix[VY][VY] = lerp(n1.mMatrix[VY][VY], n0.mMatrix[VY][VY], w);
-		gBlendRotMat.mMatrix[VY][VZ] = lerp(n1.mMatrix[VY][VZ], n0.mMatrix[VY][VZ], w);
+	LLVertexBuffer *buffer = mFace->mVertexBuffer;
+	buffer->getVertexStrider(o_vertices,  mMesh->mFaceVertexOffset);
+	buffer->getNormalStrider(o_normals,   mMesh->mFaceVertexOffset);
 
-		gBlendRotMat.mMatrix[VZ][VX] = lerp(n1.mMatrix[VZ][VX], n0.mMatrix[VZ][VX], w);
-		gBlendRotMat.mMatrix[VZ][VY] = lerp(n1.mMatrix[VZ][VY], n0.mMatrix[VZ][VY], w);
-		gBlendRotMat.mMatrix[VZ][VZ] = lerp(n1.mMatrix[VZ][VZ], n0.mMatrix[VZ][VZ], w);
-		
-		o_normals[bidx] = normals[index] * gBlendRotMat;
+	for (U32 index = 0; index < num_vertices; index++)
+	{
+		o_vertices[index] = mStagedCoords[index];
+		o_normals[index] = mStagedNormals[index];
 	}
 
 	buffer->setBuffer(0);
@@ -839,7 +858,9 @@ static BOOL sVectorizePerfTest 				= FALSE;
 static U32 sVectorizeProcessor 				= 0;
 
 //static
-void (*LLViewerJointMesh::sUpdateGeometryFunc)(LLFace* face, LLPolyMesh* mesh);
+LLSkinning::skin_func_t LLViewerJointMesh::sSkinFunc = &LLSkinning::skinOriginal;
+//static
+U32 LLViewerJointMesh::sSkinPass = 1;
 
 //static
 void LLViewerJointMesh::updateVectorize()
@@ -849,35 +870,27 @@ void LLViewerJointMesh::updateVectorize()
 	BOOL vectorizeEnable = gSavedSettings.getBOOL("VectorizeEnable");
 	BOOL vectorizeSkin = gSavedSettings.getBOOL("VectorizeSkin");
 
-	std::string vp;
+	LLSkinning::EKernel kernel;
 	switch(sVectorizeProcessor)
 	{
-		case 2: vp = "SSE2"; break;					// *TODO: replace the magic #s
-		case 1: vp = "SSE"; break;
-		default: vp = "COMPILER DEFAULT"; break;
+		case 3: kernel = LLSkinning::KERNEL_AVX2; break;		// *TODO: replace the magic #s
+		case 2: kernel = LLSkinning::KERNEL_SSE2; break;
+		case 1: kernel = LLSkinning::KERNEL_SSE; break;
+		default: kernel = LLSkinning::KERNEL_VECTORIZED; break;
 	}
 	LL_INFOS("AppInit") << "Vectorization         : " << ( vectorizeEnable ? "ENABLED" : "DISABLED" ) << LL_ENDL ;
-	LL_INFOS("AppInit") << "Vector Processor      : " << vp << LL_ENDL ;
+	LL_INFOS("AppInit") << "Vector Processor      : " << LLSkinning::getKernelName(kernel) << LL_ENDL ;
 	LL_INFOS("AppInit") << "Vectorized Skinning   : " << ( vectorizeSkin ? "ENABLED" : "DISABLED" ) << LL_ENDL ;
 	if(vectorizeEnable && vectorizeSkin)
 	{
-		switch(sVectorizeProcessor)
-		{
-			case 2:
-				sUpdateGeometryFunc = &updateGeometrySSE2;
-				break;
-			case 1:
-				sUpdateGeometryFunc = &updateGeometrySSE;
-				break;
-			default:
-				sUpdateGeometryFunc = &updateGeometryVectorized;
-				break;
-		}
+		sSkinFunc = LLSkinning::getKernel(kernel);
 	}
 	else
 	{
-		sUpdateGeometryFunc = &updateGeometryOriginal;
+		sSkinFunc = &LLSkinning::skinOriginal;
 	}
+
+	LLMorphAccumulator::setVectorize(vectorizeEnable);
 }
 
 void LLViewerJointMesh::updateJointGeometry()
@@ -896,9 +909,7 @@ void LLViewerJointMesh::updateJointGeometry()
 	{
 		// Once we've measured performance, just run the specified
 		// code version.
-		if(sUpdateGeometryFunc == updateGeometryOriginal)
-			uploadJointMatrices();
-		sUpdateGeometryFunc(mFace, mMesh);
+		skinGeometry(sSkinFunc);
 	}
 	else
 	{
@@ -908,15 +919,12 @@ void LLViewerJointMesh::updateJointGeometry()
 		
 		if (sUpdateGeometryCallPointer)
 		{
-			if(sUpdateGeometryFunc == updateGeometryOriginal)
-				uploadJointMatrices();
 			// call accelerated version for this processor
-			sUpdateGeometryFunc(mFace, mMesh);
+			skinGeometry(sSkinFunc);
 		}
 		else
 		{
-			uploadJointMatrices();
-			updateGeometryOriginal(mFace, mMesh);
+			skinGeometry(&LLSkinning::skinOriginal);
 		}
 	
 		sUpdateGeometryElapsedTime += ug_timer.getElapsedTimeF64();
@@ -36,6 +36,7 @@
 #include "llviewerjoint.h"
 #include "llviewerimage.h"
 #include "llpolymesh.h"
+#include "llskinning.h"
 #include "v4color.h"
 #include "llapr.h"
 
@@ -86,6 +87,11 @@ protected:
 	LLSkinJoint*				mSkinJoints;
 	S32							mMeshID;
 
+	// skinned by stageJointGeometry() for uploadStagedJointGeometry()
+	std::vector<LLVector3>		mStagedCoords;
+	std::vector<LLVector3>		mStagedNormals;
+	U32							mStagedPass;
+
 public:
 	static BOOL					sPipelineRender;
 	//RN: this is here for testing purposes
@@ -144,6 +150,8 @@ public:
 	/*virtual*/ void updateFaceData(LLFace *face, F32 pixel_area, BOOL damp_wind = FALSE);
 	/*virtual*/ BOOL updateLOD(F32 pixel_area, BOOL activate);
 	/*virtual*/ void updateJointGeometry();
+	/*virtual*/ void stageJointGeometry();
+	/*virtual*/ void uploadStagedJointGeometry();
 	/*virtual*/ void dump();
 
 	void setIsTransparent(BOOL is_transparent) { mIsTransparent = is_transparent; }
@@ -152,21 +160,22 @@ public:
 	
 	static void updateVectorize(); // Update globals when settings variables change
 	
+	// Starts a new round of stageJointGeometry(), making what was staged
+	// before out of date
+	static void nextSkinPass() { ++sSkinPass; }
+
 private:
 	// Avatar vertex skinning is a significant performance issue on computers
-	// with avatar vertex programs turned off (for example, most Macs).  We
-	// therefore have custom versions that use SIMD instructions.
-	//
-	// These functions require compiler options for SSE2, SSE, or neither, and
-	// hence are contained in separate individual .cpp files.  JC
-	static void updateGeometryOriginal(LLFace* face, LLPolyMesh* mesh);
-	// generic vector code, used for Altivec
-	static void updateGeometryVectorized(LLFace* face, LLPolyMesh* mesh);
-	static void updateGeometrySSE(LLFace* face, LLPolyMesh* mesh);
-	static void updateGeometrySSE2(LLFace* face, LLPolyMesh* mesh);
-
-	// Use a fuction pointer to indicate which version we are running.
-	static void (*sUpdateGeometryFunc)(LLFace* face, LLPolyMesh* mesh);
+	// with avatar vertex programs turned off (for example, most Macs).  The
+	// skinning kernels, including SIMD ones for each instruction set, are
+	// in LLSkinning.  JC
+	static LLSkinning::skin_func_t sSkinFunc;
+	static U32 sSkinPass;
+
+	// Fills joint_mats with this mesh's skinning matrices, returns how many
+	U32 getSkinMatrices(LLMatrix4* joint_mats);
+
+	void skinGeometry(LLSkinning::skin_func_t skin_func);
 
 private:
 	// Allocate skin data
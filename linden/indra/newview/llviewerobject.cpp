@@ -54,6 +54,7 @@
 #include "lltree_common.h"
 #include "llxfermanager.h"
 #include "message.h"
+#include "lltemplatemessagereader.h"
 #include "object_flags.h"
 #include "timing.h"
 
@@ -112,6 +113,181 @@ S32			LLViewerObject::sAxisArrowLength(50);
 BOOL		LLViewerObject::sPulseEnabled(FALSE);
 BOOL		LLViewerObject::sUseSharedDrawables(FALSE); // TRUE
 
+//-----------------------------------------------------------------------------
+// LLObjectDataReader
+// Reads the ObjectData variables of one object in a full update.  The
+// variables are resolved to handles once per message template rather than
+// looked up by name for every object (see LLMsgVariableHandle); messages
+// that did not arrive as template messages fall back to the names.
+//
+// The particle system block and the fields read by subclasses (texture
+// entries, volume parameters) still go by name: they are read through
+// helpers shared with other messages.
+//-----------------------------------------------------------------------------
+class LLObjectDataReader
+{
+public:
+	enum EVariable
+	{
+		CRC,
+		PARENT_ID,
+		SOUND,
+		OWNER_ID,
+		GAIN,
+		FLAGS,
+		MATERIAL,
+		CLICK_ACTION,
+		SCALE,
+		OBJECT_DATA,
+		UPDATE_FLAGS,
+		STATE,
+		NAME_VALUE,
+		DATA,
+		TEXT,
+		TEXT_COLOR,
+		MEDIA_URL,
+		EXTRA_PARAMS,
+		JOINT_TYPE,
+		JOINT_PIVOT,
+		JOINT_AXIS_OR_ANCHOR,
+		NUM_VARIABLES
+	};
+
+	LLObjectDataReader(LLMessageSystem* mesgsys, S32 block_num) :
+		mMessageSystem(mesgsys),
+		mBlockNum(block_num),
+		mUseHandles(true)
+	{
+		// a pointer compare per variable once the template has been seen
+		for (S32 i = 0; i < NUM_VARIABLES && mUseHandles; ++i)
+		{
+			mUseHandles = mesgsys->resolveVariableFast(_PREHASH_ObjectData, getName((EVariable)i), sHandles[i]);
+		}
+	}
+
+	S32 getSize(EVariable var)
+	{
+		return mUseHandles ? mMessageSystem->getSizeFast(sHandles[var], mBlockNum)
+						   : mMessageSystem->getSizeFast(_PREHASH_ObjectData, mBlockNum, getName(var));
+	}
+	void getU8(EVariable var, U8& data)
+	{
+		if (mUseHandles)
+		{
+			mMessageSystem->getU8Fast(sHandles[var], data, mBlockNum);
+		}
+		else
+		{
+			mMessageSystem->getU8Fast(_PREHASH_ObjectData, getName(var), data, mBlockNum);
+		}
+	}
+	void getU32(EVariable var, U32& data)
+	{
+		if (mUseHandles)
+		{
+			mMessageSystem->getU32Fast(sHandles[var], data, mBlockNum);
+		}
+		else
+		{
+			mMessageSystem->getU32Fast(_PREHASH_ObjectData, getName(var), data, mBlockNum);
+		}
+	}
+	void getF32(EVariable var, F32& data)
+	{
+		if (mUseHandles)
+		{
+			mMessageSystem->getF32Fast(sHandles[var], data, mBlockNum);
+		}
+		else
+		{
+			mMessageSystem->getF32Fast(_PREHASH_ObjectData, getName(var), data, mBlockNum);
+		}
+	}
+	void getVector3(EVariable var, LLVector3& vec)
+	{
+		if (mUseHandles)
+		{
+			mMessageSystem->getVector3Fast(sHandles[var], vec, mBlockNum);
+		}
+		else
+		{
+			mMessageSystem->getVector3Fast(_PREHASH_ObjectData, getName(var), vec, mBlockNum);
+		}
+	}
+	void getUUID(EVariable var, LLUUID& uuid)
+	{
+		if (mUseHandles)
+		{
+			mMessageSystem->getUUIDFast(sHandles[var], uuid, mBlockNum);
+		}
+		else
+		{
+			mMessageSystem->getUUIDFast(_PREHASH_ObjectData, getName(var), uuid, mBlockNum);
+		}
+	}
+	void getString(EVariable var, std::string& outstr)
+	{
+		if (mUseHandles)
+		{
+			mMessageSystem->getStringFast(sHandles[var], outstr, mBlockNum);
+		}
+		else
+		{
+			mMessageSystem->getStringFast(_PREHASH_ObjectData, getName(var), outstr, mBlockNum);
+		}
+	}
+	void getBinaryData(EVariable var, void* datap, S32 size)
+	{
+		if (mUseHandles)
+		{
+			mMessageSystem->getBinaryDataFast(sHandles[var], datap, size, mBlockNum);
+		}
+		else
+		{
+			mMessageSystem->getBinaryDataFast(_PREHASH_ObjectData, getName(var), datap, size, mBlockNum);
+		}
+	}
+
+private:
+	// looked up on use, the _PREHASH_ names are set up during static init
+	static const char* getName(EVariable var)
+	{
+		switch (var)
+		{
+		case CRC:					return _PREHASH_CRC;
+		case PARENT_ID:				return _PREHASH_ParentID;
+		case SOUND:					return _PREHASH_Sound;
+		case OWNER_ID:				return _PREHASH_OwnerID;
+		case GAIN:					return _PREHASH_Gain;
+		case FLAGS:					return _PREHASH_Flags;
+		case MATERIAL:				return _PREHASH_Material;
+		case CLICK_ACTION:			return _PREHASH_ClickAction;
+		case SCALE:					return _PREHASH_Scale;
+		case OBJECT_DATA:			return _PREHASH_ObjectData;
+		case UPDATE_FLAGS:			return _PREHASH_UpdateFlags;
+		case STATE:					return _PREHASH_State;
+		case NAME_VALUE:			return _PREHASH_NameValue;
+		case DATA:					return _PREHASH_Data;
+		case TEXT:					return _PREHASH_Text;
+		case TEXT_COLOR:			return _PREHASH_TextColor;
+		case MEDIA_URL:				return _PREHASH_MediaURL;
+		case EXTRA_PARAMS:			return _PREHASH_ExtraParams;
+		case JOINT_TYPE:			return _PREHASH_JointType;
+		case JOINT_PIVOT:			return _PREHASH_JointPivot;
+		case JOINT_AXIS_OR_ANCHOR:	return _PREHASH_JointAxisOrAnchor;
+		default:					return NULL;
+		}
+	}
+
+	static LLMsgVariableHandle sHandles[NUM_VARIABLES];
+
+	LLMessageSystem* mMessageSystem;
+	S32 mBlockNum;
+	bool mUseHandles;
+};
+
+LLMsgVariableHandle LLObjectDataReader::sHandles[LLObjectDataReader::NUM_VARIABLES];
+
 // static
 LLViewerObject *LLViewerObject::createObject(const LLUUID &id, const LLPCode pcode, LLViewerRegion *regionp)
 {
@@ -759,18 +935,19 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				F32    gain;
 				U8     sound_flags;
 
-				mesgsys->getU32Fast( _PREHASH_ObjectData, _PREHASH_CRC, crc, block_num);
-				mesgsys->getU32Fast( _PREHASH_ObjectData, _PREHASH_ParentID, parent_id, block_num);
-				mesgsys->getUUIDFast(_PREHASH_ObjectData, _PREHASH_Sound, audio_uuid, block_num );
+				LLObjectDataReader object_data(mesgsys, block_num);
+				object_data.getU32(LLObjectDataReader::CRC, crc);
+				object_data.getU32(LLObjectDataReader::PARENT_ID, parent_id);
+				object_data.getUUID(LLObjectDataReader::SOUND, audio_uuid);
 				// HACK: Owner id only valid if non-null sound id or particle system
-				mesgsys->getUUIDFast(_PREHASH_ObjectData, _PREHASH_OwnerID, owner_id, block_num );
-				mesgsys->getF32Fast( _PREHASH_ObjectData, _PREHASH_Gain, gain, block_num );
-				mesgsys->getU8Fast(  _PREHASH_ObjectData, _PREHASH_Flags, sound_flags, block_num );
-				mesgsys->getU8Fast(  _PREHASH_ObjectData, _PREHASH_Material, material, block_num );
-				mesgsys->getU8Fast(  _PREHASH_ObjectData, _PREHASH_ClickAction, click_action, block_num); 
-				mesgsys->getVector3Fast(_PREHASH_ObjectData, _PREHASH_Scale, new_scale, block_num );
-				length = mesgsys->getSizeFast(_PREHASH_ObjectData, block_num, _PREHASH_ObjectData);
-				mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_ObjectData, data, length, block_num);
+				object_data.getUUID(LLObjectDataReader::OWNER_ID, owner_id);
+				object_data.getF32(LLObjectDataReader::GAIN, gain);
+				object_data.getU8(LLObjectDataReader::FLAGS, sound_flags);
+				object_data.getU8(LLObjectDataReader::MATERIAL, material);
+				object_data.getU8(LLObjectDataReader::CLICK_ACTION, click_action);
+				object_data.getVector3(LLObjectDataReader::SCALE, new_scale);
+				length = object_data.getSize(LLObjectDataReader::OBJECT_DATA);
+				object_data.getBinaryData(LLObjectDataReader::OBJECT_DATA, data, length);
 
 				mTotalCRC = crc;
 
@@ -943,24 +1120,24 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				//
 
 				U32 flags;
-				mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_UpdateFlags, flags, block_num);
+				object_data.getU32(LLObjectDataReader::UPDATE_FLAGS, flags);
 				// clear all but local flags
 				mFlags &= FLAGS_LOCAL;
 				mFlags |= flags;
 
 				U8 state;
-				mesgsys->getU8Fast(_PREHASH_ObjectData, _PREHASH_State, state, block_num );
+				object_data.getU8(LLObjectDataReader::STATE, state);
 				mState = state;
 
 				// ...new objects that should come in selected need to be added to the selected list
 				mCreateSelected = ((flags & FLAGS_CREATE_SELECTED) != 0);
 
 				// Set all name value pairs
-				S32 nv_size = mesgsys->getSizeFast(_PREHASH_ObjectData, block_num, _PREHASH_NameValue);
+				S32 nv_size = object_data.getSize(LLObjectDataReader::NAME_VALUE);
 				if (nv_size > 0)
 				{
 					std::string name_value_list;
-					mesgsys->getStringFast(_PREHASH_ObjectData, _PREHASH_NameValue, name_value_list, block_num);
+					object_data.getString(LLObjectDataReader::NAME_VALUE, name_value_list);
 					setNameValueList(name_value_list);
 				}
 
@@ -971,7 +1148,7 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				}
 
 				// Check for appended generic data
-				S32 data_size = mesgsys->getSizeFast(_PREHASH_ObjectData, block_num, _PREHASH_Data);
+				S32 data_size = object_data.getSize(LLObjectDataReader::DATA);
 				if (data_size <= 0)
 				{
 					mData = NULL;
@@ -980,10 +1157,10 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				{
 					// ...has generic data
 					mData = new U8[data_size];
-					mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, mData, data_size, block_num);
+					object_data.getBinaryData(LLObjectDataReader::DATA, mData, data_size);
 				}
 
-				S32 text_size = mesgsys->getSizeFast(_PREHASH_ObjectData, block_num, _PREHASH_Text);
+				S32 text_size = object_data.getSize(LLObjectDataReader::TEXT);
 				if (text_size > 1)
 				{
 					// Setup object text
@@ -998,10 +1175,10 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 					}
 
 					std::string temp_string;
-					mesgsys->getStringFast(_PREHASH_ObjectData, _PREHASH_Text, temp_string, block_num );
+					object_data.getString(LLObjectDataReader::TEXT, temp_string);
 					
 					LLColor4U coloru;
-					mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_TextColor, coloru.mV, 4, block_num);
+					object_data.getBinaryData(LLObjectDataReader::TEXT_COLOR, coloru.mV, 4);
 
 					// alpha was flipped so that it zero encoded better
 					coloru.mV[3] = 255 - coloru.mV[3];
@@ -1021,7 +1198,7 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				}
 
 				std::string media_url;
-				mesgsys->getStringFast(_PREHASH_ObjectData, _PREHASH_MediaURL, media_url, block_num);
+				object_data.getString(LLObjectDataReader::MEDIA_URL, media_url);
 				//if (!media_url.empty())
 				//{
 				//	llinfos << "WEBONPRIM media_url " << media_url << llendl;
@@ -1064,11 +1241,11 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				}
 
 				// Unpack extra parameters
-				S32 size = mesgsys->getSizeFast(_PREHASH_ObjectData, block_num, _PREHASH_ExtraParams);
+				S32 size = object_data.getSize(LLObjectDataReader::EXTRA_PARAMS);
 				if (size > 0)
 				{
 					U8 *buffer = new U8[size];
-					mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_ExtraParams, buffer, size, block_num);
+					object_data.getBinaryData(LLObjectDataReader::EXTRA_PARAMS, buffer, size);
 					LLDataPackerBinaryBuffer dp(buffer, size);
 
 					U8 num_parameters;
@@ -1097,7 +1274,7 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 				}
 
 				U8 joint_type = 0;
-				mesgsys->getU8Fast(_PREHASH_ObjectData, _PREHASH_JointType, joint_type, block_num);
+				object_data.getU8(LLObjectDataReader::JOINT_TYPE, joint_type);
 				if (joint_type)
 				{
 					// create new joint info 
@@ -1106,8 +1283,8 @@ U32 LLViewerObject::processUpdateMessage(LLMessageSystem *mesgsys,
 						mJointInfo = new LLVOJointInfo;
 					}
 					mJointInfo->mJointType = (EHavokJointType) joint_type;
-					mesgsys->getVector3Fast(_PREHASH_ObjectData, _PREHASH_JointPivot, mJointInfo->mPivot, block_num);
-					mesgsys->getVector3Fast(_PREHASH_ObjectData, _PREHASH_JointAxisOrAnchor, mJointInfo->mAxisOrAnchor, block_num);
+					object_data.getVector3(LLObjectDataReader::JOINT_PIVOT, mJointInfo->mPivot);
+					object_data.getVector3(LLObjectDataReader::JOINT_AXIS_OR_ANCHOR, mJointInfo->mAxisOrAnchor);
 				}
 				else if (mJointInfo)
 				{
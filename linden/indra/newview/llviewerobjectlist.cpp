@@ -35,6 +35,7 @@
 #include "llviewerobjectlist.h"
 
 #include "message.h"
+#include "lltemplatemessagereader.h"
 #include "timing.h"
 #include "llfasttimer.h"
 #include "llrender.h"
@@ -319,6 +320,33 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 	U8 compressed_dpbuffer[2048];
 	LLDataPackerBinaryBuffer compressed_dp(compressed_dpbuffer, 2048);
 	LLDataPacker *cached_dpp = NULL;
+
+	// Resolve the per-object variables once rather than looking them
+	// up by name for every object in the message.  The rest of a full
+	// update is read by LLViewerObject::processUpdateMessage(), which
+	// does the same.
+	static LLMsgVariableHandle id_handle;
+	static LLMsgVariableHandle crc_handle;
+	static LLMsgVariableHandle data_handle;
+	static LLMsgVariableHandle update_flags_handle;
+	static LLMsgVariableHandle full_id_handle;
+	bool use_handles = false;
+	if (cached)
+	{
+		use_handles = mesgsys->resolveVariableFast(_PREHASH_ObjectData, _PREHASH_ID, id_handle)
+			&& mesgsys->resolveVariableFast(_PREHASH_ObjectData, _PREHASH_CRC, crc_handle);
+	}
+	else if (compressed)
+	{
+		use_handles = mesgsys->resolveVariableFast(_PREHASH_ObjectData, _PREHASH_Data, data_handle)
+			&& (update_type == OUT_TERSE_IMPROVED
+				|| mesgsys->resolveVariableFast(_PREHASH_ObjectData, _PREHASH_UpdateFlags, update_flags_handle));
+	}
+	else if (update_type == OUT_FULL)
+	{
+		use_handles = mesgsys->resolveVariableFast(_PREHASH_ObjectData, _PREHASH_ID, id_handle)
+			&& mesgsys->resolveVariableFast(_PREHASH_ObjectData, _PREHASH_FullID, full_id_handle);
+	}
 	
 	for (i = 0; i < num_objects; i++)
 	{
@@ -329,8 +357,16 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 		{
 			U32 id;
 			U32 crc;
-			mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_ID, id, i);
-			mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_CRC, crc, i);
+			if (use_handles)
+			{
+				mesgsys->getU32Fast(id_handle, id, i);
+				mesgsys->getU32Fast(crc_handle, crc, i);
+			}
+			else
+			{
+				mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_ID, id, i);
+				mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_CRC, crc, i);
+			}
 		
 			// Lookup data packer and add this id to cache miss lists if necessary.
 			cached_dpp = regionp->getDP(id, crc);
@@ -357,16 +393,29 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 			U32 flags = 0;
 			if (update_type != OUT_TERSE_IMPROVED)
 			{
-				mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_UpdateFlags, flags, i);
+				if (use_handles)
+				{
+					mesgsys->getU32Fast(update_flags_handle, flags, i);
+				}
+				else
+				{
+					mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_UpdateFlags, flags, i);
+				}
 			}
 			
 			if (flags & FLAGS_ZLIB_COMPRESSED)
 			{
-				compressed_length = mesgsys->getSizeFast(_PREHASH_ObjectData, i, _PREHASH_Data);
-				mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, compbuffer, 0, i);
+				// inflate straight out of the message when we can
+				const U8* compdata = use_handles ? mesgsys->getDataPtrFast(data_handle, i, &compressed_length) : NULL;
+				if (!compdata)
+				{
+					compressed_length = mesgsys->getSizeFast(_PREHASH_ObjectData, i, _PREHASH_Data);
+					mesgsys->getBinaryDataFast(_PREHASH_ObjectData, _PREHASH_Data, compbuffer, 0, i);
+					compdata = compbuffer;
+				}
 				uncompressed_length = 2048;
 				uncompress(compressed_dpbuffer, (unsigned long *)&uncompressed_length,
-						   compbuffer, compressed_length);
+						   compdata, compressed_length);
 				compressed_dp.assignBuffer(compressed_dpbuffer, uncompressed_length);
 			}
 			else
@@ -410,6 +459,11 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 				mNumUnknownUpdates++;
 			}
 		}
+		else if (use_handles)
+		{
+			mesgsys->getUUIDFast(full_id_handle, fullid, i);
+			mesgsys->getU32Fast(id_handle, local_id, i);
+		}
 		else
 		{
 			mesgsys->getUUIDFast(_PREHASH_ObjectData, _PREHASH_FullID, fullid, i);
@@ -709,6 +763,10 @@ void LLViewerObjectList::update(LLAgent &agent, LLWorld &world)
 		}
 	}
 
+	// animate the avatars that idleUpdate() queued for the job pool
+	LLVOAvatar::updateQueuedAnimations();
+	LLVOAvatar::updateQueuedSkinning();
+
 	mNumSizeCulled = 0;
 	mNumVisCulled = 0;
 
@@ -45,6 +45,7 @@
 #include "llviewerobjectlist.h" 
 #include "llviewerimagelist.h" 
 #include "lltexlayer.h"
+#include "llimagebufferpool.h"
 #include "llsurface.h"
 #include "llvlmanager.h"
 #include "llagent.h"
@@ -369,6 +370,7 @@ void output_statistics(void*)
 	llinfos << "Texture working set: " << LLImageGL::sBoundTextureMemoryInBytes << llendl;
 	llinfos << "Raw usage: " << LLImageRaw::sGlobalRawMemory << llendl;
 	llinfos << "Formatted usage: " << LLImageFormatted::sGlobalFormattedMemory << llendl;
+	LLImageBufferPool::dumpStats();
 	llinfos << "Zombie Viewer Objects: " << LLViewerObject::getNumZombieObjects() << llendl;
 	llinfos << "Number of lights: " << gPipeline.getLightCount() << llendl;
 
@@ -662,6 +662,9 @@ LLMap< LLGLenum, F32*> LLVOAvatar::sScratchTexLastBindTime;
 S32 LLVOAvatar::sScratchTexBytes = 0;
 F32 LLVOAvatar::sRenderDistance = 256.f;
 S32	LLVOAvatar::sNumVisibleAvatars = 0;
+LLJobPool* LLVOAvatar::sAnimationPool = NULL;
+std::vector<LLPointer<LLVOAvatar> > LLVOAvatar::sQueuedAnimations;
+std::vector<LLPointer<LLVOAvatar> > LLVOAvatar::sQueuedSkinning;
 S32	LLVOAvatar::sNumLODChangesThisFrame = 0;
 
 const LLUUID LLVOAvatar::sStepSoundOnLand = LLUUID("e8af4a28-aa83-4310-a7c4-c047e15ea0df");
@@ -741,6 +744,8 @@ LLVOAvatar::LLVOAvatar(const LLUUID& id,
 	mTexEyeColor( NULL ),
 	mNeedsSkin(FALSE),
 	mUpdatePeriod(1),
+	mAnimationQueued(FALSE),
+	mSkinStaged(FALSE),
 	mFullyLoadedInitialized(FALSE),
 	mHasBakedHair( FALSE )
 {
@@ -841,6 +846,7 @@ LLVOAvatar::LLVOAvatar(const LLUUID& id,
 	// initialize joint, mesh and shape members
 	//-------------------------------------------------------------------------
 	mRoot.setName( "mRoot" );
+	mFlatSkeleton.setRootJoint(&mRoot);
 
 	for (LLVOAvatarDictionary::mesh_map_t::const_iterator iter = LLVOAvatarDictionary::getInstance()->getMeshes().begin();
 		 iter != LLVOAvatarDictionary::getInstance()->getMeshes().end();
@@ -2516,11 +2522,24 @@ BOOL LLVOAvatar::idleUpdate(LLAgent &agent, LLWorld &world, const F64 &time)
 	// store off last frame's root position to be consistent with camera position
 	LLVector3 root_pos_last = mRoot.getWorldPosition();
 	bool detailed_update = updateCharacter(agent);
+	if (mAnimationQueued)
+	{
+		// finished by updateQueuedAnimations()
+		mQueuedRootPosLast = root_pos_last;
+		return TRUE;
+	}
+
+	finishIdleUpdate(root_pos_last, detailed_update);
+	return TRUE;
+}
+
+void LLVOAvatar::finishIdleUpdate(const LLVector3& root_pos_last, bool detailed_update)
+{
 	bool voice_enabled = gVoiceClient->getVoiceEnabled( mID ) && gVoiceClient->inProximalChannel();
 
 	if (gNoRender)
 	{
-		return TRUE;
+		return;
 	}
 
 	idleUpdateVoiceVisualizer( voice_enabled );
@@ -2533,7 +2552,6 @@ BOOL LLVOAvatar::idleUpdate(LLAgent &agent, LLWorld &world, const F64 &time)
 	idleUpdateNameTag( root_pos_last );
 	idleUpdateRenderCost();
 	idleUpdateTractorBeam();
-	return TRUE;
 }
 
 void LLVOAvatar::idleUpdateVoiceVisualizer(bool voice_enabled)
@@ -2784,6 +2802,7 @@ void LLVOAvatar::idleUpdateAppearanceAnimation()
 			}
 
 			// apply all params
+			LLPolyMorphBatch morph_batch;
 			for (param = getFirstVisualParam();
 				 param;
 				 param = getNextVisualParam())
@@ -3732,10 +3751,33 @@ BOOL LLVOAvatar::updateCharacter(LLAgent &agent)
 
 	// update animations
 	if (mSpecialRenderMode == 1) // Animation Preview
+	{
 		updateMotions(LLCharacter::FORCE_UPDATE);
+	}
+	else if (sAnimationPool && !mIsSelf && !mIsDummy)
+	{
+		// animated together with the other queued avatars, after which
+		// updateQueuedAnimations() finishes the update
+		beginDeferredUpdate(LLCharacter::NORMAL_UPDATE);
+		mAnimationQueued = TRUE;
+		sQueuedAnimations.push_back(this);
+		return TRUE;
+	}
 	else
+	{
 		updateMotions(LLCharacter::NORMAL_UPDATE);
+	}
+
+	finishCharacterUpdate();
+	return TRUE;
+}
 
+//------------------------------------------------------------------------
+// finishCharacterUpdate()
+// the part of updateCharacter() that uses the animated skeleton
+//------------------------------------------------------------------------
+void LLVOAvatar::finishCharacterUpdate()
+{
 	// update head position
 	updateHeadOffset();
 
@@ -3743,6 +3785,7 @@ BOOL LLVOAvatar::updateCharacter(LLAgent &agent)
 	// Find the ground under each foot, these are used for a variety
 	// of things that follow
 	//-------------------------------------------------------------------------
+	LLVector3 normal;
 	LLVector3 ankle_left_pos_agent = mFootLeftp->getWorldPosition();
 	LLVector3 ankle_right_pos_agent = mFootRightp->getWorldPosition();
 
@@ -3835,8 +3878,113 @@ BOOL LLVOAvatar::updateCharacter(LLAgent &agent)
 
 	//mesh vertices need to be reskinned
 	mNeedsSkin = TRUE;
+	mSkinStaged = FALSE;
+	if (sAnimationPool && !mIsSelf && !mIsDummy)
+	{
+		sQueuedSkinning.push_back(this);
+	}
+}
 
-	return TRUE;
+//------------------------------------------------------------------------
+// updateQueuedAnimations()
+//------------------------------------------------------------------------
+// static
+void LLVOAvatar::updateQueuedAnimations()
+{
+	if (sQueuedAnimations.empty())
+	{
+		return;
+	}
+
+	std::vector<LLCharacter*> characters;
+	characters.reserve(sQueuedAnimations.size());
+	for (std::vector<LLPointer<LLVOAvatar> >::iterator iter = sQueuedAnimations.begin();
+		 iter != sQueuedAnimations.end(); ++iter)
+	{
+		LLVOAvatar* avatarp = *iter;
+		if (avatarp->isDead())
+		{
+			avatarp->endDeferredUpdate();
+		}
+		else
+		{
+			characters.push_back(avatarp);
+		}
+	}
+
+	{
+		LLFastTimer t(LLFastTimer::FTM_AVATAR_UPDATE);
+		LLCharacter::runDeferredUpdates(characters, sAnimationPool);
+	}
+
+	for (std::vector<LLPointer<LLVOAvatar> >::iterator iter = sQueuedAnimations.begin();
+		 iter != sQueuedAnimations.end(); ++iter)
+	{
+		LLVOAvatar* avatarp = *iter;
+		avatarp->mAnimationQueued = FALSE;
+		if (!avatarp->isDead())
+		{
+			LLFastTimer t(LLFastTimer::FTM_AVATAR_UPDATE);
+			avatarp->finishCharacterUpdate();
+			avatarp->finishIdleUpdate(avatarp->mQueuedRootPosLast, true);
+		}
+	}
+	sQueuedAnimations.clear();
+}
+
+static void stage_avatar_skinning(S32 index, void* userdata)
+{
+	std::vector<LLViewerJoint*>* meshes = (std::vector<LLViewerJoint*>*)userdata;
+	(*meshes)[index]->stageJointGeometry();
+}
+
+//------------------------------------------------------------------------
+// updateQueuedSkinning()
+//------------------------------------------------------------------------
+// static
+void LLVOAvatar::updateQueuedSkinning()
+{
+	// anything staged before this is out of date
+	LLViewerJointMesh::nextSkinPass();
+
+	if (sQueuedSkinning.empty())
+	{
+		return;
+	}
+
+	if (sAnimationPool
+		&& gSavedSettings.getBOOL("AvatarThreadedSkinning")
+		&& LLViewerShaderMgr::instance()->getVertexShaderLevel(LLViewerShaderMgr::SHADER_AVATAR) <= 0)
+	{
+		LLFastTimer t(LLFastTimer::FTM_AVATAR_UPDATE);
+
+		std::vector<LLVOAvatar*> avatars;
+		std::vector<LLViewerJoint*> meshes;
+		for (std::vector<LLPointer<LLVOAvatar> >::iterator iter = sQueuedSkinning.begin();
+			 iter != sQueuedSkinning.end(); ++iter)
+		{
+			LLVOAvatar* avatarp = *iter;
+			// renderSkinned() rebuilds dirty meshes before skinning them
+			if (!avatarp->isDead()
+				&& avatarp->mIsBuilt
+				&& avatarp->mNeedsSkin
+				&& !avatarp->mDirtyMesh)
+			{
+				avatarp->getMeshesToSkin(meshes);
+				avatars.push_back(avatarp);
+			}
+		}
+
+		// one job per mesh, they don't share any output
+		sAnimationPool->run((S32)meshes.size(), stage_avatar_skinning, (void*)&meshes);
+
+		for (std::vector<LLVOAvatar*>::iterator iter = avatars.begin();
+			 iter != avatars.end(); ++iter)
+		{
+			(*iter)->mSkinStaged = TRUE;
+		}
+	}
+	sQueuedSkinning.clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -4018,6 +4166,28 @@ BOOL LLVOAvatar::needsRenderBeam()
 	return is_touching_or_grabbing || (mState & AGENT_STATE_EDITING && LLSelectMgr::getInstance()->shouldShowSelection());
 }
 
+//-----------------------------------------------------------------------------
+// getMeshesToSkin()
+// the mesh LODs that need software skinning, appended to meshes
+//-----------------------------------------------------------------------------
+void LLVOAvatar::getMeshesToSkin(std::vector<LLViewerJoint*>& meshes)
+{
+	meshes.push_back(mMeshLOD[MESH_ID_LOWER_BODY]);
+	meshes.push_back(mMeshLOD[MESH_ID_UPPER_BODY]);
+
+	if( isWearingWearableType( WT_SKIRT ) )
+	{
+		meshes.push_back(mMeshLOD[MESH_ID_SKIRT]);
+	}
+
+	if (!mIsSelf || gAgent.needsRenderHead() || LLPipeline::sShadowRender)
+	{
+		meshes.push_back(mMeshLOD[MESH_ID_EYELASH]);
+		meshes.push_back(mMeshLOD[MESH_ID_HEAD]);
+		meshes.push_back(mMeshLOD[MESH_ID_HAIR]);
+	}
+}
+
 //-----------------------------------------------------------------------------
 // renderSkinned()
 //-----------------------------------------------------------------------------
@@ -4043,21 +4213,23 @@ U32 LLVOAvatar::renderSkinned(EAvatarRenderPass pass)
 		if (mNeedsSkin)
 		{
 			//generate animated mesh
-			mMeshLOD[MESH_ID_LOWER_BODY]->updateJointGeometry();
-			mMeshLOD[MESH_ID_UPPER_BODY]->updateJointGeometry();
-
-			if( isWearingWearableType( WT_SKIRT ) )
-			{
-				mMeshLOD[MESH_ID_SKIRT]->updateJointGeometry();
-			}
-
-			if (!mIsSelf || gAgent.needsRenderHead() || LLPipeline::sShadowRender)
+			std::vector<LLViewerJoint*> meshes;
+			getMeshesToSkin(meshes);
+			for (std::vector<LLViewerJoint*>::iterator iter = meshes.begin();
+				 iter != meshes.end(); ++iter)
 			{
-				mMeshLOD[MESH_ID_EYELASH]->updateJointGeometry();
-				mMeshLOD[MESH_ID_HEAD]->updateJointGeometry();
-				mMeshLOD[MESH_ID_HAIR]->updateJointGeometry();
+				if (mSkinStaged)
+				{
+					// already skinned by updateQueuedSkinning()
+					(*iter)->uploadStagedJointGeometry();
+				}
+				else
+				{
+					(*iter)->updateJointGeometry();
+				}
 			}
 			mNeedsSkin = FALSE;
+			mSkinStaged = FALSE;
 			
 			LLVertexBuffer* vb = mDrawable->getFace(0)->mVertexBuffer;
 			if (vb)
@@ -5550,7 +5722,11 @@ void LLVOAvatar::updateVisualParams()
 
 	setSex( (getVisualParamWeight( "male" ) > 0.5f) ? SEX_MALE : SEX_FEMALE );
 
-	LLCharacter::updateVisualParams();
+	{
+		// add up all the changed morphs before touching the meshes
+		LLPolyMorphBatch morph_batch;
+		LLCharacter::updateVisualParams();
+	}
 
 	if (mLastSkeletonSerialNum != mSkeletonSerialNum)
 	{
@@ -6363,6 +6539,28 @@ void LLVOAvatar::invalidateComposite( LLTexLayerSet* layerset, BOOL set_by_user
 	}
 }
 
+// Only one layer changed, and only within region (in unit coordinates), so
+// only that much of the composite needs to be redone.
+void LLVOAvatar::invalidateComposite( LLTexLayer* layer, const LLRectf& region, BOOL set_by_user )
+{
+	LLTexLayerSet* layerset = layer->getTexLayerSet();
+	if( !layerset->getUpdatesEnabled() )
+	{
+		return;
+	}
+
+	layerset->requestUpdate( layer, region );
+
+	if( set_by_user )
+	{
+		llassert( mIsSelf );
+
+		ETextureIndex baked_te = getBakedTE( layerset );
+		setTEImage( baked_te, gImageList.getImage(IMG_DEFAULT_AVATAR) );
+		layerset->requestUpload();
+	}
+}
+
 void LLVOAvatar::invalidateAll()
 {
 	for (U32 i = 0; i < mBakedTextureData.size(); i++)
@@ -45,7 +45,9 @@
 #include "llcharacter.h"
 #include "llviewerjointmesh.h"
 #include "llviewerjointattachment.h"
+#include "llrect.h"
 #include "llrendertarget.h"
+#include "llskeleton.h"
 #include "llwearable.h"
 #include "llvoavatardefines.h"
 
@@ -60,11 +62,13 @@ extern const LLUUID ANIM_AGENT_PELVIS_FIX;
 extern const LLUUID ANIM_AGENT_TARGET;
 extern const LLUUID ANIM_AGENT_WALK_ADJUST;
 
+class LLTexLayer;
 class LLTexLayerSet;
 class LLVoiceVisualizer;
 class LLHUDText;
 class LLHUDEffectSpiral;
 class LLTexGlobalColor;
+class LLJobPool;
 
 class LLVOAvatarBoneInfo;
 class LLVOAvatarSkeletonInfo;
@@ -100,6 +104,7 @@ public:
 									 const EObjectUpdateType update_type,
 									 LLDataPacker *dp);
 	/*virtual*/ BOOL idleUpdate(LLAgent &agent, LLWorld &world, const F64 &time);
+	void finishIdleUpdate(const LLVector3& root_pos_last, bool detailed_update);
 	void idleUpdateVoiceVisualizer(bool voice_enabled);
 	void idleUpdateMisc(bool detailed_update);
 	void idleUpdateAppearanceAnimation();
@@ -121,6 +126,7 @@ public:
 	U32 renderRigid();
 	U32 renderSkinned(EAvatarRenderPass pass);
 	U32 renderTransparent(BOOL first_pass);
+	void getMeshesToSkin(std::vector<LLViewerJoint*>& meshes);
 	void renderCollisionVolumes();
 	
 	/*virtual*/ BOOL lineSegmentIntersect(const LLVector3& start, const LLVector3& end,
@@ -245,8 +251,19 @@ public:
 	std::string		getFullname() const;
 
 	BOOL updateCharacter(LLAgent &agent);
+	void finishCharacterUpdate();
 	void updateHeadOffset();
 
+	// Animates the avatars queued by updateCharacter() on sAnimationPool
+	// and finishes their idle updates.  Called once per frame after all
+	// objects have had idleUpdate().
+	static void updateQueuedAnimations();
+
+	// Software skins the avatars finishCharacterUpdate() queued on
+	// sAnimationPool, for renderSkinned() to copy into their vertex buffers.
+	// Called once per frame after updateQueuedAnimations().
+	static void updateQueuedSkinning();
+
 	F32 getPelvisToFoot() const { return mPelvisToFoot; }
 
 public:
@@ -306,6 +323,7 @@ public:
 	LLGLuint		getScratchTexName( LLGLenum format, U32* texture_bytes );
 	BOOL			bindScratchTexture( LLGLenum format );
 	void			invalidateComposite( LLTexLayerSet* layerset, BOOL set_by_user );
+	void			invalidateComposite( LLTexLayer* layer, const LLRectf& region, BOOL set_by_user );
 	void			invalidateAll();
 	void			forceBakeAllTextures(bool slam_for_debug = false);
 	static void		processRebakeAvatarTextures(LLMessageSystem* msg, void**);
@@ -523,6 +541,8 @@ public:
 	static BOOL     sDebugAvatarRotation;
 
 	static S32 sNumVisibleAvatars; // Number of instances of this class
+
+	static LLJobPool* sAnimationPool; // if set, other avatars are animated in parallel on it
 	
 	//--------------------------------------------------------------------
 	// Miscellaneous public variables.
@@ -532,6 +552,7 @@ public:
 	LLFrameTimer	mTimeInAir;
 	LLVector3 mHeadOffset; // current head position
 	LLViewerJoint mRoot; // avatar skeleton
+	LLSkeleton mFlatSkeleton; // mRoot's hierarchy flattened for updates; must follow mRoot
 	BOOL mIsSitting; // sitting state
 
 	//--------------------------------------------------------------------
@@ -637,6 +658,13 @@ private:
 	BOOL				mNeedsSkin;  //if TRUE, avatar has been animated and verts have not been updated
 	S32					mUpdatePeriod;
 
+	BOOL				mAnimationQueued; // waiting for updateQueuedAnimations()
+	LLVector3			mQueuedRootPosLast;
+	static std::vector<LLPointer<LLVOAvatar> > sQueuedAnimations;
+
+	BOOL				mSkinStaged; // meshes skinned by updateQueuedSkinning(), waiting for renderSkinned()
+	static std::vector<LLPointer<LLVOAvatar> > sQueuedSkinning;
+
 	//--------------------------------------------------------------------
 	// Internal functions
 	//--------------------------------------------------------------------
@@ -48,10 +48,24 @@ LLVOCacheEntry::LLVOCacheEntry(U32 local_id, U32 crc, LLDataPackerBinaryBuffer &
 	mDupeCount = 0;
 	mCRCChangeCount = 0;
 	mBuffer = new U8[dp.getBufferSize()];
+	mOwnsBuffer = TRUE;
 	mDP.assignBuffer(mBuffer, dp.getBufferSize());
 	mDP = dp;
 }
 
+LLVOCacheEntry::LLVOCacheEntry(const LLObjectCacheFile::Record& record)
+{
+	mLocalID = record.mID;
+	mCRC = record.mCRC;
+	mHitCount = record.mHitCount;
+	mDupeCount = record.mDupeCount;
+	mCRCChangeCount = record.mCRCChangeCount;
+	// Only ever unpacked from, so the mapping can stay read only
+	mBuffer = (U8*)record.getData();
+	mOwnsBuffer = FALSE;
+	mDP.assignBuffer(mBuffer, record.mSize);
+}
+
 LLVOCacheEntry::LLVOCacheEntry()
 {
 	mLocalID = 0;
@@ -60,51 +74,16 @@ LLVOCacheEntry::LLVOCacheEntry()
 	mDupeCount = 0;
 	mCRCChangeCount = 0;
 	mBuffer = NULL;
+	mOwnsBuffer = FALSE;
 	mDP.assignBuffer(mBuffer, 0);
 }
 
-
-static inline void checkedRead(LLFILE *fp, void *data, size_t nbytes)
-{
-	if (fread(data, 1, nbytes, fp) != nbytes)
-	{
-		llwarns << "Short read" << llendl;
-		memset(data, 0, nbytes);
-	}
-}
-
-LLVOCacheEntry::LLVOCacheEntry(LLFILE *fp)
+LLVOCacheEntry::~LLVOCacheEntry()
 {
-	S32 size;
-	checkedRead(fp, &mLocalID, sizeof(U32));
-	checkedRead(fp, &mCRC, sizeof(U32));
-	checkedRead(fp, &mHitCount, sizeof(S32));
-	checkedRead(fp, &mDupeCount, sizeof(S32));
-	checkedRead(fp, &mCRCChangeCount, sizeof(S32));
-
-	checkedRead(fp, &size, sizeof(S32));
-
-	// Corruption in the cache entries
-	if ((size > 10000) || (size < 1))
+	if (mOwnsBuffer)
 	{
-		// We've got a bogus size, skip reading it.
-		// We won't bother seeking, because the rest of this file
-		// is likely bogus, and will be tossed anyway.
-		llwarns << "Bogus cache entry, size " << size << ", aborting!" << llendl;
-		mLocalID = 0;
-		mCRC = 0;
-		mBuffer = NULL;
-		return;
+		delete [] mBuffer;
 	}
-
-	mBuffer = new U8[size];
-	checkedRead(fp, mBuffer, size);
-	mDP.assignBuffer(mBuffer, size);
-}
-
-LLVOCacheEntry::~LLVOCacheEntry()
-{
-	delete [] mBuffer;
 }
 
 
@@ -118,8 +97,12 @@ void LLVOCacheEntry::assignCRC(U32 crc, LLDataPackerBinaryBuffer &dp)
 		mHitCount = 0;
 		mCRCChangeCount++;
 
-		mDP.freeBuffer();
+		if (mOwnsBuffer)
+		{
+			delete [] mBuffer;
+		}
 		mBuffer = new U8[dp.getBufferSize()];
+		mOwnsBuffer = TRUE;
 		mDP.assignBuffer(mBuffer, dp.getBufferSize());
 		mDP = dp;
 	}
@@ -154,22 +137,293 @@ void LLVOCacheEntry::dump() const
 		<< llendl;
 }
 
-static inline void checkedWrite(LLFILE *fp, const void *data, size_t nbytes)
+void LLVOCacheEntry::writeToLog(LLObjectCacheFile& file) const
+{
+	file.appendLog(mLocalID, mCRC, mBuffer, mDP.getBufferSize());
+}
+
+void LLVOCacheEntry::writeToSnapshot(LLObjectCacheFile& file) const
+{
+	file.addToSnapshot(mLocalID, mCRC, mHitCount, mDupeCount, mCRCChangeCount,
+					   mBuffer, mDP.getBufferSize());
+}
+
+//---------------------------------------------------------------------------
+// LLVOCache
+//---------------------------------------------------------------------------
+
+// Bigger records are corruption, see LLVOCacheEntry's old file reader
+const S32 MAX_OBJECT_CACHE_ENTRY_SIZE = 10000;
+
+LLVOCache::LLVOCache()
+:	mEvictPosition(0),
+	mCount(0)
+{
+	mStart.append(mEnd);
+}
+
+LLVOCache::~LLVOCache()
+{
+	clear();
+}
+
+void LLVOCache::load(const std::string& filename, const std::string& log_filename,
+					 const LLUUID& cache_id, U32 version)
+{
+	clear();
+	mFile.open(filename, log_filename, cache_id, version);
+
+	S32 snapshot_count = mFile.getCount();
+	mSnapshotEntries.resize(snapshot_count, NULL);
+	mSnapshotLive.resize(snapshot_count, 1);
+	mCount = snapshot_count;
+
+	// Replay changes made since the snapshot was written
+	U32 local_id;
+	U32 crc;
+	std::vector<U8> data;
+	while (mFile.readLog(local_id, crc, data))
+	{
+		removeEntry(local_id);
+		if (!data.empty())
+		{
+			LLDataPackerBinaryBuffer dp(&data[0], (S32)data.size());
+			addEntry(new LLVOCacheEntry(local_id, crc, dp));
+		}
+	}
+}
+
+void LLVOCache::save()
+{
+	if (mFile.needsCompaction() && mFile.startSnapshot())
+	{
+		S32 snapshot_count = (S32)mSnapshotLive.size();
+		for (S32 i = mEvictPosition; i < snapshot_count; ++i)
+		{
+			if (!mSnapshotLive[i])
+			{
+				continue;
+			}
+			if (mSnapshotEntries[i])
+			{
+				// carries this visit's hit counts
+				mSnapshotEntries[i]->writeToSnapshot(mFile);
+				continue;
+			}
+			const LLObjectCacheFile::Record* record = mFile.getRecord(i);
+			if (record)
+			{
+				mFile.addToSnapshot(record->mID, record->mCRC, record->mHitCount, record->mDupeCount,
+									record->mCRCChangeCount, record->getData(), record->mSize);
+			}
+		}
+		for (LLVOCacheEntry* entry = mStart.getNext(); entry && (entry != &mEnd); entry = entry->getNext())
+		{
+			entry->writeToSnapshot(mFile);
+		}
+		mFile.finishSnapshot();
+	}
+	clear();
+}
+
+void LLVOCache::clear()
+{
+	// Entries may point into the mapping, so they go first
+	for (std::vector<LLVOCacheEntry*>::iterator iter = mSnapshotEntries.begin();
+		 iter != mSnapshotEntries.end(); ++iter)
+	{
+		delete *iter;
+	}
+	mSnapshotEntries.clear();
+	mSnapshotLive.clear();
+	mEvictPosition = 0;
+
+	mEntries.clear();
+	mEnd.unlink();
+	mEnd.init();
+	mStart.deleteAll();
+	mStart.init();
+	mStart.append(mEnd);
+	mCount = 0;
+
+	mFile.close();
+}
+
+LLVOCacheEntry* LLVOCache::getEntry(U32 local_id)
+{
+	entry_map_t::iterator iter = mEntries.find(local_id);
+	if (iter != mEntries.end())
+	{
+		return iter->second;
+	}
+	S32 position = mFile.find(local_id);
+	if (position < 0 || !mSnapshotLive[position])
+	{
+		return NULL;
+	}
+	return getSnapshotEntry(position);
+}
+
+LLVOCacheEntry* LLVOCache::getSnapshotEntry(S32 position)
+{
+	if (!mSnapshotEntries[position])
+	{
+		const LLObjectCacheFile::Record* record = mFile.getRecord(position);
+		if (!record || record->mSize > MAX_OBJECT_CACHE_ENTRY_SIZE)
+		{
+			llwarns << "Bogus cache entry at " << position << ", dropping it" << llendl;
+			removeSnapshotEntry(position);
+			return NULL;
+		}
+		mSnapshotEntries[position] = new LLVOCacheEntry(*record);
+	}
+	return mSnapshotEntries[position];
+}
+
+void LLVOCache::update(U32 local_id, U32 crc, LLDataPackerBinaryBuffer &dp)
+{
+	LLVOCacheEntry* entry = getEntry(local_id);
+	if (entry)
+	{
+		// we've seen this object before
+		if (entry->getCRC() == crc)
+		{
+			// Record a hit
+			entry->recordDupe();
+			return;
+		}
+		removeEntry(local_id);
+	}
+	else if (mCount > (S32)MAX_OBJECT_CACHE_ENTRIES)
+	{
+		evictOldest();
+	}
+
+	entry = new LLVOCacheEntry(local_id, crc, dp);
+	addEntry(entry);
+	entry->writeToLog(mFile);
+}
+
+void LLVOCache::addEntry(LLVOCacheEntry* entry)
+{
+	mEnd.insert(*entry);
+	mEntries[entry->getLocalID()] = entry;
+	mCount++;
+}
+
+void LLVOCache::removeEntry(U32 local_id)
 {
-	if (fwrite(data, 1, nbytes, fp) != nbytes)
+	entry_map_t::iterator iter = mEntries.find(local_id);
+	if (iter != mEntries.end())
+	{
+		delete iter->second;
+		mEntries.erase(iter);
+		mCount--;
+		return;
+	}
+	S32 position = mFile.find(local_id);
+	if (position >= 0 && mSnapshotLive[position])
 	{
-		llwarns << "Short write" << llendl;
+		removeSnapshotEntry(position);
 	}
 }
 
-void LLVOCacheEntry::writeToFile(LLFILE *fp) const
+void LLVOCache::removeSnapshotEntry(S32 position)
+{
+	delete mSnapshotEntries[position];
+	mSnapshotEntries[position] = NULL;
+	mSnapshotLive[position] = 0;
+	mCount--;
+}
+
+void LLVOCache::evictOldest()
 {
-	checkedWrite(fp, &mLocalID, sizeof(U32));
-	checkedWrite(fp, &mCRC, sizeof(U32));
-	checkedWrite(fp, &mHitCount, sizeof(S32));
-	checkedWrite(fp, &mDupeCount, sizeof(S32));
-	checkedWrite(fp, &mCRCChangeCount, sizeof(S32));
-	S32 size = mDP.getBufferSize();
-	checkedWrite(fp, &size, sizeof(S32));
-	checkedWrite(fp, mBuffer, size);
+	// Everything left in the snapshot is older than what came since
+	S32 snapshot_count = (S32)mSnapshotLive.size();
+	while (mEvictPosition < snapshot_count && !mSnapshotLive[mEvictPosition])
+	{
+		mEvictPosition++;
+	}
+	if (mEvictPosition < snapshot_count)
+	{
+		const LLObjectCacheFile::Record* record = mFile.getRecord(mEvictPosition);
+		if (record)
+		{
+			mFile.appendLog(record->mID, 0, NULL, 0);
+		}
+		removeSnapshotEntry(mEvictPosition);
+		return;
+	}
+
+	LLVOCacheEntry* entry = mStart.getNext();
+	if (entry && entry != &mEnd)
+	{
+		U32 local_id = entry->getLocalID();
+		mFile.appendLog(local_id, 0, NULL, 0);
+		removeEntry(local_id);
+	}
+}
+
+void LLVOCache::dump() const
+{
+	const S32 BINS = 4;
+	S32 hit_bin[BINS];
+	S32 change_bin[BINS];
+
+	S32 i;
+	for (i = 0; i < BINS; ++i)
+	{
+		hit_bin[i] = 0;
+		change_bin[i] = 0;
+	}
+
+	S32 snapshot_count = (S32)mSnapshotLive.size();
+	for (i = mEvictPosition; i < snapshot_count; ++i)
+	{
+		if (!mSnapshotLive[i])
+		{
+			continue;
+		}
+		S32 hits;
+		S32 changes;
+		if (mSnapshotEntries[i])
+		{
+			hits = mSnapshotEntries[i]->getHitCount();
+			changes = mSnapshotEntries[i]->getCRCChangeCount();
+		}
+		else
+		{
+			const LLObjectCacheFile::Record* record = mFile.getRecord(i);
+			if (!record)
+			{
+				continue;
+			}
+			hits = record->mHitCount;
+			changes = record->mCRCChangeCount;
+		}
+		hit_bin[llclamp(hits, 0, BINS-1)]++;
+		change_bin[llclamp(changes, 0, BINS-1)]++;
+	}
+
+	for (entry_map_t::const_iterator iter = mEntries.begin(); iter != mEntries.end(); ++iter)
+	{
+		S32 hits = iter->second->getHitCount();
+		S32 changes = iter->second->getCRCChangeCount();
+
+		hits = llclamp(hits, 0, BINS-1);
+		changes = llclamp(changes, 0, BINS-1);
+
+		hit_bin[hits]++;
+		change_bin[changes]++;
+	}
+
+	llinfos << "Count " << mCount << " (log " << mFile.getLogCount() << ")" << llendl;
+	for (i = 0; i < BINS; i++)
+	{
+		llinfos << "Hits " << i << " " << hit_bin[i] << llendl;
+	}
+	for (i = 0; i < BINS; i++)
+	{
+		llinfos << "Changes " << i << " " << change_bin[i] << llendl;
+	}
 }
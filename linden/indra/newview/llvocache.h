@@ -33,9 +33,15 @@
 #ifndef LL_LLVOCACHE_H
 #define LL_LLVOCACHE_H
 
+#include <map>
+#include <vector>
+
 #include "lluuid.h"
 #include "lldatapacker.h"
 #include "lldlinked.h"
+#include "llobjectcachefile.h"
+
+const U32	MAX_OBJECT_CACHE_ENTRIES = 10000;
 
 
 //---------------------------------------------------------------------------
@@ -46,7 +52,8 @@ class LLVOCacheEntry : public LLDLinked<LLVOCacheEntry>
 {
 public:
 	LLVOCacheEntry(U32 local_id, U32 crc, LLDataPackerBinaryBuffer &dp);
-	LLVOCacheEntry(LLFILE *fp);
+	// Reads the record in place; it must outlive the entry.
+	LLVOCacheEntry(const LLObjectCacheFile::Record& record);
 	LLVOCacheEntry();
 	~LLVOCacheEntry();
 
@@ -56,7 +63,8 @@ public:
 	S32 getCRCChangeCount() const	{ return mCRCChangeCount; }
 
 	void dump() const;
-	void writeToFile(LLFILE *fp) const;
+	void writeToLog(LLObjectCacheFile& file) const;
+	void writeToSnapshot(LLObjectCacheFile& file) const;
 	void assignCRC(U32 crc, LLDataPackerBinaryBuffer &dp);
 	LLDataPackerBinaryBuffer *getDP(U32 crc);
 	void recordHit();
@@ -70,6 +78,51 @@ protected:
 	S32							mCRCChangeCount;
 	LLDataPackerBinaryBuffer	mDP;
 	U8							*mBuffer;
+	BOOL						mOwnsBuffer;	// FALSE when reading a mapped record in place
+};
+
+//---------------------------------------------------------------------------
+// A region's object cache.  Entries saved on an earlier visit are read in
+// place from the mapped snapshot and only become LLVOCacheEntry objects
+// when first used.  Entries added since live in memory, oldest first, and
+// are appended to the file's log as they change, so leaving the region
+// only rewrites the snapshot once the log has grown.
+class LLVOCache
+{
+public:
+	LLVOCache();
+	~LLVOCache();
+
+	void load(const std::string& filename, const std::string& log_filename,
+			  const LLUUID& cache_id, U32 version);
+	// Folds the log into a new snapshot if it is due, then frees everything.
+	void save();
+
+	LLVOCacheEntry* getEntry(U32 local_id);
+	// Adds or replaces local_id's entry, or records a dupe if crc is unchanged.
+	void update(U32 local_id, U32 crc, LLDataPackerBinaryBuffer &dp);
+
+	S32 getCount() const			{ return mCount; }
+	void dump() const;
+
+private:
+	LLVOCacheEntry* getSnapshotEntry(S32 position);
+	void addEntry(LLVOCacheEntry* entry);
+	void removeEntry(U32 local_id);
+	void removeSnapshotEntry(S32 position);
+	void evictOldest();
+	void clear();
+
+	LLObjectCacheFile				mFile;
+	std::vector<LLVOCacheEntry*>	mSnapshotEntries;	// NULL until first used
+	std::vector<U8>					mSnapshotLive;		// 0 once replaced or removed
+	S32								mEvictPosition;		// older snapshot entries are all gone
+
+	typedef std::map<U32, LLVOCacheEntry *>	entry_map_t;
+	entry_map_t						mEntries;			// added since the snapshot
+	LLVOCacheEntry					mStart;
+	LLVOCacheEntry					mEnd;
+	S32								mCount;
 };
 
 #endif
@@ -0,0 +1,259 @@
+/** 
+ * @file llbakecompositor_tut.cpp
+ * @brief LLBakeDirtyTracker and LLBakeCompositor unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "llbakecompositor.h"
+#include "llrand.h"
+
+namespace tut
+{
+	struct bakecompositor_data
+	{
+		// A one component mask, value inside [left, right) x [bottom, top)
+		static LLPointer<LLImageRaw> makeMask(S32 size, S32 left, S32 top, S32 right, S32 bottom, U8 value)
+		{
+			LLPointer<LLImageRaw> mask = new LLImageRaw(size, size, 1);
+			memset(mask->getData(), 0, mask->getDataSize());
+			for (S32 y = bottom; y < top; ++y)
+			{
+				memset(mask->getData() + y * size + left, value, right - left);
+			}
+			return mask;
+		}
+
+		static LLPointer<LLImageRaw> makeImage(S32 size, S32 components)
+		{
+			LLPointer<LLImageRaw> image = new LLImageRaw(size, size, components);
+			U8* data = image->getData();
+			for (S32 i = 0; i < image->getDataSize(); ++i)
+			{
+				data[i] = (U8)ll_rand(256);
+			}
+			return image;
+		}
+
+		static BOOL sameImage(const LLImageRaw* a, const LLImageRaw* b)
+		{
+			return a->getDataSize() == b->getDataSize() &&
+				!memcmp(a->getData(), b->getData(), a->getDataSize());
+		}
+	};
+	typedef test_group<bakecompositor_data> bakecompositor_test;
+	typedef bakecompositor_test::object bakecompositor_object;
+	tut::bakecompositor_test bakecompositor_testcase("bakecompositor");
+
+	template<> template<>
+	void bakecompositor_object::test<1>()
+	{
+		LLBakeDirtyTracker tracker;
+		tracker.reset(128, 128, 4);
+
+		S32 first_layer = -1;
+		LLRect rect;
+		ensure("nothing composited yet", !tracker.getUpdate(first_layer, rect));
+		ensure("dirty", tracker.isDirty());
+
+		tracker.clearDirty();
+		ensure("clean", !tracker.isDirty());
+		ensure("nothing to do", tracker.getUpdate(first_layer, rect));
+		ensure_equals("past the last layer", first_layer, 4);
+		ensure("empty", rect.isNull());
+
+		// no copies held, so a change means starting over
+		tracker.invalidateLayer(2, LLRectf(.25f, .5f, .375f, .125f));
+		ensure("layer dirty", tracker.isLayerDirty(2));
+		ensure("other layer clean", !tracker.isLayerDirty(1));
+		ensure("no copies", !tracker.getUpdate(first_layer, rect));
+
+		// rounded out a pixel each way
+		tracker.setCached(0, TRUE);
+		tracker.setCached(1, TRUE);
+		ensure("from a copy", tracker.getUpdate(first_layer, rect));
+		ensure_equals("layer after the copy", first_layer, 2);
+		ensure_equals("left", rect.mLeft, 31);
+		ensure_equals("top", rect.mTop, 65);
+		ensure_equals("right", rect.mRight, 49);
+		ensure_equals("bottom", rect.mBottom, 15);
+
+		// changes add up, and start below the lowest one
+		tracker.invalidateLayer(3, LLRectf(.75f, 1.f, 1.f, .875f));
+		tracker.invalidateLayer(1, LLRectf(0.f, .125f, .125f, 0.f));
+		ensure("from a lower copy", tracker.getUpdate(first_layer, rect));
+		ensure_equals("layer after the lower copy", first_layer, 1);
+		ensure_equals("union left", rect.mLeft, 0);
+		ensure_equals("union top", rect.mTop, 128);
+		ensure_equals("union right", rect.mRight, 128);
+		ensure_equals("union bottom", rect.mBottom, 0);
+
+		// the nearest copy below the change is used, even if further down
+		tracker.clearDirty();
+		tracker.setCached(1, FALSE);
+		tracker.invalidateLayer(2, LLRectf(.5f, .625f, .625f, .5f));
+		ensure("skips a missing copy", tracker.getUpdate(first_layer, rect));
+		ensure_equals("from the first copy", first_layer, 1);
+
+		// empty regions and bad layers change nothing
+		tracker.clearDirty();
+		tracker.invalidateLayer(1, LLRectf());
+		tracker.invalidateLayer(-1);
+		tracker.invalidateLayer(4);
+		ensure("still clean", !tracker.isDirty());
+
+		// a change to the bottom layer starts over
+		tracker.invalidateLayer(0, LLRectf(.5f, .625f, .625f, .5f));
+		ensure("bottom layer", !tracker.getUpdate(first_layer, rect));
+		tracker.clearDirty();
+		tracker.invalidateAll();
+		ensure("everything", !tracker.getUpdate(first_layer, rect));
+	}
+
+	template<> template<>
+	void bakecompositor_object::test<2>()
+	{
+		LLPointer<LLImageRaw> mask = makeMask(64, 8, 40, 24, 16, 200);
+		LLRectf region = LLBakeDirtyTracker::calcMaskRegion(mask);
+		ensure_approximately_equals("left", region.mLeft, 8.f / 64.f, 16);
+		ensure_approximately_equals("top", region.mTop, 40.f / 64.f, 16);
+		ensure_approximately_equals("right", region.mRight, 24.f / 64.f, 16);
+		ensure_approximately_equals("bottom", region.mBottom, 16.f / 64.f, 16);
+
+		LLPointer<LLImageRaw> empty = makeMask(64, 0, 0, 0, 0, 0);
+		ensure("zero mask", LLBakeDirtyTracker::calcMaskRegion(empty).isNull());
+
+		// a layer shows only where its added masks do; multiplying can
+		// only take alpha away
+		LLBakeCompositor::Layer layer;
+		ensure("unmasked covers everything", LLBakeCompositor::calcLayerRegion(layer).mRight == 1.f);
+
+		LLBakeCompositor::Mask add;
+		add.mImage = mask;
+		LLBakeCompositor::Mask multiply;
+		multiply.mImage = makeMask(64, 0, 64, 64, 0, 128);
+		multiply.mMultiply = TRUE;
+		layer.mMasks.push_back(add);
+		layer.mMasks.push_back(multiply);
+		region = LLBakeCompositor::calcLayerRegion(layer);
+		ensure_approximately_equals("masked left", region.mLeft, 8.f / 64.f, 16);
+		ensure_approximately_equals("masked right", region.mRight, 24.f / 64.f, 16);
+
+		LLBakeCompositor::Mask constant;
+		constant.mValue = 10;
+		layer.mMasks.push_back(constant);
+		ensure("constant mask covers everything", LLBakeCompositor::calcLayerRegion(layer).mLeft == 0.f);
+
+		std::swap(layer.mMasks.front(), layer.mMasks[1]);
+		ensure("multiplied first covers everything", LLBakeCompositor::calcLayerRegion(layer).mRight == 1.f);
+	}
+
+	template<> template<>
+	void bakecompositor_object::test<3>()
+	{
+		// A skin-like base, then tattoo- and clothing-like layers that
+		// only show through their masks
+		const S32 SIZE = 128;
+		LLBakeCompositor compositor(SIZE, SIZE);
+		compositor.setClearAlpha(TRUE);
+
+		LLBakeCompositor::Layer base;
+		base.mImage = makeImage(SIZE, 3);
+		base.mColor = LLColor4U(230, 200, 180, 255);
+		base.mWriteAllChannels = TRUE;
+		compositor.addLayer(base);
+
+		for (S32 i = 0; i < 6; ++i)
+		{
+			LLBakeCompositor::Layer layer;
+			if (i % 2)
+			{
+				layer.mImage = makeImage(SIZE, 4);
+			}
+			layer.mColor = LLColor4U(ll_rand(256), ll_rand(256), ll_rand(256), 128 + ll_rand(128));
+			layer.mColorSpecified = TRUE;
+			S32 left = ll_rand(SIZE / 2);
+			S32 bottom = ll_rand(SIZE / 2);
+			LLBakeCompositor::Mask mask;
+			mask.mImage = makeMask(SIZE, left, bottom + 8 + ll_rand(SIZE / 2), left + 8 + ll_rand(SIZE / 2), bottom, 255);
+			layer.mMasks.push_back(mask);
+			if (i == 3)
+			{
+				LLBakeCompositor::Mask fade;
+				fade.mValue = 100;
+				fade.mMultiply = TRUE;
+				layer.mMasks.push_back(fade);
+			}
+			compositor.addLayer(layer);
+		}
+
+		LLPointer<LLImageRaw> reference = new LLImageRaw;
+		compositor.compositeAll(reference);
+		compositor.setCaching(TRUE);
+		ensure("full composite", sameImage(compositor.update(), reference));
+		ensure_equals("all layers", compositor.getLastLayerCount(), 7);
+		compositor.update();
+		ensure_equals("nothing changed", compositor.getLastLayerCount(), 0);
+
+		// recolor layers, then move their masks, and check every update
+		// against a composite from scratch
+		for (S32 edit = 0; edit < 40; ++edit)
+		{
+			S32 index = 1 + ll_rand(compositor.getLayerCount() - 1);
+			LLBakeCompositor::Layer layer = compositor.getLayer(index);
+			LLRectf region = LLBakeCompositor::calcLayerRegion(layer);
+			if (edit < 20)
+			{
+				layer.mColor.mV[ll_rand(4)] = (U8)ll_rand(256);
+			}
+			else
+			{
+				S32 left = ll_rand(SIZE / 2);
+				S32 bottom = ll_rand(SIZE / 2);
+				layer.mMasks.front().mImage = makeMask(SIZE, left, bottom + 1 + ll_rand(SIZE / 4), left + 1 + ll_rand(SIZE / 4), bottom, 255);
+				region.unionWith(LLBakeCompositor::calcLayerRegion(layer));
+			}
+			compositor.setLayer(index, layer, region);
+
+			compositor.update();
+			compositor.compositeAll(reference);
+			ensure("incremental composite", sameImage(compositor.getComposite(), reference));
+			ensure("redrew less", compositor.getLastPixelCount() < 7 * SIZE * SIZE);
+		}
+
+		// a change to the bottom layer redoes everything
+		compositor.setLayer(0, base);
+		compositor.update();
+		ensure_equals("bottom layer", compositor.getLastLayerCount(), 7);
+		compositor.compositeAll(reference);
+		ensure("after the bottom layer", sameImage(compositor.getComposite(), reference));
+	}
+}
@@ -0,0 +1,346 @@
+/** 
+ * @file test/llcharacter_tut.cpp
+ * @brief LLCharacter parallel animation unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <vector>
+
+#include "llcharacter.h"
+#include "llformat.h"
+#include "llframetimer.h"
+#include "lljobpool.h"
+#include "llmotion.h"
+#include "llstl.h"
+#include "llthread.h"
+#include "lltimer.h"
+#include "v3dmath.h"
+
+namespace tut
+{
+	const S32 NUM_TEST_JOINTS = 20;
+	const LLUUID SWAY_MOTION_ID("d7a2f1c0-5e8b-4b1a-9c3e-2f6a7b8c9d01");
+	const LLUUID ONE_SHOT_MOTION_ID("d7a2f1c0-5e8b-4b1a-9c3e-2f6a7b8c9d02");
+
+	// Rocks every joint of the character back and forth
+	class SwayMotion : public LLMotion
+	{
+	public:
+		SwayMotion(const LLUUID& id) : LLMotion(id), mCharacter(NULL) {}
+
+		static LLMotion* create(const LLUUID& id) { return new SwayMotion(id); }
+
+		/*virtual*/ BOOL getLoop() { return TRUE; }
+		/*virtual*/ F32 getDuration() { return 0.f; }
+		/*virtual*/ F32 getEaseInDuration() { return 0.f; }
+		/*virtual*/ F32 getEaseOutDuration() { return 0.f; }
+		/*virtual*/ LLJoint::JointPriority getPriority() { return LLJoint::MEDIUM_PRIORITY; }
+		/*virtual*/ LLMotionBlendType getBlendType() { return NORMAL_BLEND; }
+		/*virtual*/ F32 getMinPixelArea() { return 0.f; }
+
+		/*virtual*/ LLMotionInitStatus onInitialize(LLCharacter* character)
+		{
+			mCharacter = character;
+			for (S32 i = 0; i < NUM_TEST_JOINTS; ++i)
+			{
+				LLPointer<LLJointState> joint_state = new LLJointState(character->getCharacterJoint(i));
+				joint_state->setUsage(LLJointState::ROT);
+				addJointState(joint_state);
+				mJointStates.push_back(joint_state);
+			}
+			return STATUS_SUCCESS;
+		}
+
+		/*virtual*/ BOOL onActivate() { return TRUE; }
+
+		/*virtual*/ BOOL onUpdate(F32 time, U8* joint_mask)
+		{
+			F32 phase = (F32)(mCharacter->getID().mData[0] % 16);
+			for (S32 i = 0; i < (S32)mJointStates.size(); ++i)
+			{
+				F32 angle = 0.3f * sinf(time * 2.f + phase + (F32)i * 0.5f);
+				mJointStates[i]->setRotation(LLQuaternion(angle, LLVector3(0.2f, 1.f, 0.1f * (F32)(i % 3))));
+			}
+			// as the blink and hand morphs do
+			mCharacter->requestVisualParamUpdate();
+			return TRUE;
+		}
+
+		/*virtual*/ void onDeactivate() {}
+
+	protected:
+		LLCharacter* mCharacter;
+		std::vector<LLPointer<LLJointState> > mJointStates;
+	};
+
+	// Plays for a moment and then asks the character to stop it
+	class OneShotMotion : public SwayMotion
+	{
+	public:
+		OneShotMotion(const LLUUID& id) : SwayMotion(id) {}
+
+		static LLMotion* create(const LLUUID& id) { return new OneShotMotion(id); }
+
+		/*virtual*/ BOOL getLoop() { return FALSE; }
+		/*virtual*/ F32 getDuration() { return 0.02f; }
+		/*virtual*/ LLJoint::JointPriority getPriority() { return LLJoint::HIGH_PRIORITY; }
+	};
+
+	class TestCharacter : public LLCharacter
+	{
+	public:
+		TestCharacter(S32 index) :
+			mRoot("root"),
+			mStopRequests(0),
+			mOffThreadStopRequests(0),
+			mVisualParamUpdates(0),
+			mOffThreadVisualParamUpdates(0)
+		{
+			mID.mData[0] = (U8)index;
+			mRoot.setJointNum(NUM_TEST_JOINTS);
+			// a spine with arms hanging off every fifth joint
+			LLJoint* parent = &mRoot;
+			for (S32 i = 0; i < NUM_TEST_JOINTS; ++i)
+			{
+				LLJoint* joint = &mJoints[i];
+				joint->setName(llformat("joint%d", i));
+				joint->setJointNum(i);
+				joint->setPosition(LLVector3(0.f, 0.f, 0.1f));
+				(i % 5 == 4 ? &mRoot : parent)->addChild(joint);
+				parent = joint;
+			}
+			mRoot.setPosition(LLVector3((F32)index, 0.f, 0.f));
+			registerMotion(SWAY_MOTION_ID, SwayMotion::create);
+			registerMotion(ONE_SHOT_MOTION_ID, OneShotMotion::create);
+		}
+
+		/*virtual*/ const char* getAnimationPrefix() { return "test"; }
+		/*virtual*/ LLJoint* getRootJoint() { return &mRoot; }
+		/*virtual*/ LLVector3 getCharacterPosition() { return mRoot.getPosition(); }
+		/*virtual*/ LLQuaternion getCharacterRotation() { return LLQuaternion::DEFAULT; }
+		/*virtual*/ LLVector3 getCharacterVelocity() { return LLVector3::zero; }
+		/*virtual*/ LLVector3 getCharacterAngularVelocity() { return LLVector3::zero; }
+		/*virtual*/ void getGround(const LLVector3& inPos, LLVector3& outPos, LLVector3& outNorm)
+		{
+			outPos = inPos;
+			outNorm = LLVector3::z_axis;
+		}
+		/*virtual*/ BOOL allocateCharacterJoints(U32 num) { return num <= NUM_TEST_JOINTS; }
+		/*virtual*/ LLJoint* getCharacterJoint(U32 i) { return i < NUM_TEST_JOINTS ? &mJoints[i] : NULL; }
+		/*virtual*/ F32 getTimeDilation() { return 1.f; }
+		/*virtual*/ F32 getPixelArea() const { return 1000.f; }
+		/*virtual*/ LLPolyMesh* getHeadMesh() { return NULL; }
+		/*virtual*/ LLPolyMesh* getUpperBodyMesh() { return NULL; }
+		/*virtual*/ LLVector3d getPosGlobalFromAgent(const LLVector3& position) { return LLVector3d(position); }
+		/*virtual*/ LLVector3 getPosAgentFromGlobal(const LLVector3d& position) { return LLVector3(position); }
+		/*virtual*/ void addDebugText(const std::string& text) {}
+		/*virtual*/ const LLUUID& getID() { return mID; }
+
+		/*virtual*/ void requestStopMotion(LLMotion* motion)
+		{
+			// the viewer tells the simulator from here, which only the main thread may do
+			++mStopRequests;
+			if (LLThread::currentID() != sMainThreadID)
+			{
+				++mOffThreadStopRequests;
+			}
+			LLCharacter::requestStopMotion(motion);
+		}
+
+		/*virtual*/ void updateVisualParams()
+		{
+			// the viewer deforms meshes from here through shared state
+			++mVisualParamUpdates;
+			if (LLThread::currentID() != sMainThreadID)
+			{
+				++mOffThreadVisualParamUpdates;
+			}
+			LLCharacter::updateVisualParams();
+		}
+
+		static U32 sMainThreadID;
+
+		LLJoint mRoot;
+		LLJoint mJoints[NUM_TEST_JOINTS];
+		LLUUID mID;
+		S32 mStopRequests;
+		S32 mOffThreadStopRequests;
+		S32 mVisualParamUpdates;
+		S32 mOffThreadVisualParamUpdates;
+	};
+	U32 TestCharacter::sMainThreadID = 0;
+
+	struct character_data
+	{
+		typedef std::vector<LLCharacter*> character_list_t;
+
+		character_data()
+		{
+			TestCharacter::sMainThreadID = LLThread::currentID();
+		}
+
+		static void makeCrowd(character_list_t& characters, S32 count)
+		{
+			for (S32 i = 0; i < count; ++i)
+			{
+				TestCharacter* character = new TestCharacter(i);
+				character->startMotion(SWAY_MOTION_ID);
+				characters.push_back(character);
+			}
+		}
+
+		static void deleteCrowd(character_list_t& characters)
+		{
+			for_each(characters.begin(), characters.end(), DeletePointer());
+			characters.clear();
+		}
+
+		// what LLCharacter::updateMotions() plus a skeleton update does
+		static void updateSerial(character_list_t& characters)
+		{
+			for (character_list_t::iterator iter = characters.begin();
+				 iter != characters.end(); ++iter)
+			{
+				(*iter)->updateMotions(LLCharacter::NORMAL_UPDATE);
+				(*iter)->getRootJoint()->updateWorldMatrixChildren();
+			}
+		}
+
+		static void updateParallel(character_list_t& characters, LLJobPool* pool)
+		{
+			for (character_list_t::iterator iter = characters.begin();
+				 iter != characters.end(); ++iter)
+			{
+				(*iter)->beginDeferredUpdate(LLCharacter::NORMAL_UPDATE);
+			}
+			LLCharacter::runDeferredUpdates(characters, pool);
+		}
+	};
+	typedef test_group<character_data> character_test;
+	typedef character_test::object character_object;
+	tut::character_test tc("character");
+
+	template<> template<>
+	void character_object::test<1>()
+	{
+		// a crowd animated on the pool poses exactly like one animated in turn
+		const S32 NUM_CHARACTERS = 24;
+		character_list_t serial;
+		character_list_t parallel;
+		makeCrowd(serial, NUM_CHARACTERS);
+		makeCrowd(parallel, NUM_CHARACTERS);
+		LLJobPool pool("Character Test", 4);
+
+		// motions finish loading on their first update, which a deferred
+		// update does a frame early; load them the same way in both crowds
+		for (S32 i = 0; i < NUM_CHARACTERS; ++i)
+		{
+			serial[i]->startMotion(ONE_SHOT_MOTION_ID);
+			parallel[i]->startMotion(ONE_SHOT_MOTION_ID);
+		}
+		updateSerial(serial);
+		updateSerial(parallel);
+
+		for (S32 frame = 0; frame < 60; ++frame)
+		{
+			ms_sleep(1);
+			LLFrameTimer::updateFrameTime();
+			if (frame % 20 == 0)
+			{
+				for (S32 i = 0; i < NUM_CHARACTERS; i += 3)
+				{
+					serial[i]->startMotion(ONE_SHOT_MOTION_ID);
+					parallel[i]->startMotion(ONE_SHOT_MOTION_ID);
+				}
+			}
+			updateSerial(serial);
+			updateParallel(parallel, &pool);
+
+			for (S32 i = 0; i < NUM_CHARACTERS; ++i)
+			{
+				TestCharacter* a = (TestCharacter*)serial[i];
+				TestCharacter* b = (TestCharacter*)parallel[i];
+				for (S32 j = 0; j < NUM_TEST_JOINTS; ++j)
+				{
+					const LLMatrix4& ma = a->mJoints[j].getWorldMatrix();
+					const LLMatrix4& mb = b->mJoints[j].getWorldMatrix();
+					for (S32 k = 0; k < 16; ++k)
+					{
+						ensure_equals("world matrix", mb.mMatrix[k / 4][k % 4], ma.mMatrix[k / 4][k % 4]);
+					}
+				}
+			}
+		}
+
+		for (S32 i = 0; i < NUM_CHARACTERS; ++i)
+		{
+			TestCharacter* a = (TestCharacter*)serial[i];
+			TestCharacter* b = (TestCharacter*)parallel[i];
+			ensure_equals("stop requests", b->mStopRequests, a->mStopRequests);
+			ensure_equals("stop requests on the main thread", b->mOffThreadStopRequests, 0);
+			ensure("visual params updated", b->mVisualParamUpdates > 0);
+			ensure_equals("visual params on the main thread", b->mOffThreadVisualParamUpdates, 0);
+		}
+		ensure("one shots stopped", ((TestCharacter*)serial[0])->mStopRequests > 0);
+
+		deleteCrowd(serial);
+		deleteCrowd(parallel);
+	}
+
+	template<> template<>
+	void character_object::test<2>()
+	{
+		// how animation throughput scales with the size of the pool
+		const S32 NUM_CHARACTERS = 200;
+		const S32 NUM_FRAMES = 50;
+		character_list_t characters;
+		makeCrowd(characters, NUM_CHARACTERS);
+		updateSerial(characters);
+
+		for (S32 num_threads = 1; num_threads <= 4; num_threads *= 2)
+		{
+			LLJobPool pool("Character Benchmark", num_threads);
+			LLTimer timer;
+			for (S32 frame = 0; frame < NUM_FRAMES; ++frame)
+			{
+				LLFrameTimer::updateFrameTime();
+				updateParallel(characters, &pool);
+			}
+			F32 ms = timer.getElapsedTimeF32() * 1000.f;
+			llinfos << "Animated " << NUM_CHARACTERS << " characters on " << num_threads
+					<< " threads: " << (F32)(NUM_CHARACTERS * NUM_FRAMES) / llmax(ms, 0.001f)
+					<< " characters/ms" << llendl;
+		}
+
+		deleteCrowd(characters);
+	}
+}
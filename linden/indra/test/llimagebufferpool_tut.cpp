@@ -0,0 +1,218 @@
+/** 
+ * @file llimagebufferpool_tut.cpp
+ * @brief LLImageBufferPool unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <vector>
+
+#include "llimagebufferpool.h"
+#include "llthread.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	struct imagebufferpool_data
+	{
+		// Decodes a stream of textures of a few sizes, the way an image
+		// decode thread does
+		class DecodeThread : public LLThread
+		{
+		public:
+			DecodeThread(const std::string& name, S32 count, LLAtomicS32& done)
+				: LLThread(name), mCount(count), mDone(done) {}
+
+			/*virtual*/ void run()
+			{
+				const S32 SIZES[] = { 64*64*4, 128*128*3, 256*256*4, 512*512*3, 32*32*4 };
+				for (S32 i = 0; i < mCount; ++i)
+				{
+					S32 size = SIZES[i % LL_ARRAY_SIZE(SIZES)];
+					U8* data = LLImageBufferPool::allocate(size);
+					data[0] = data[size - 1] = (U8)i;
+					LLImageBufferPool::free(data, size);
+				}
+				mDone++;
+			}
+
+		private:
+			S32 mCount;
+			LLAtomicS32& mDone;
+		};
+
+		~imagebufferpool_data()
+		{
+			LLImageBufferPool::cleanupClass();
+		}
+	};
+	typedef test_group<imagebufferpool_data> imagebufferpool_test;
+	typedef imagebufferpool_test::object imagebufferpool_object;
+	tut::imagebufferpool_test imagebufferpool_testcase("imagebufferpool");
+
+	template<> template<>
+	void imagebufferpool_object::test<1>()
+	{
+		// power-of-two images with 1, 2, 3 or 4 components are pooled,
+		// anything else isn't
+		ensure_equals("16x16 RGBA", LLImageBufferPool::getSizeClass(16*16*4), 0);
+		ensure_equals("32x32 RGB", LLImageBufferPool::getSizeClass(32*32*3), 1);
+		ensure_equals("32x32 RGBA", LLImageBufferPool::getSizeClass(32*32*4), 4);
+		ensure_equals("1024x512 luminance alpha", LLImageBufferPool::getSizeClass(1024*512*2), 2 * (20 - 10));
+		ensure_equals("2048x2048 RGB", LLImageBufferPool::getSizeClass(2048*2048*3), 2 * (22 - 10) + 1);
+		ensure_equals("2048x2048 RGBA", LLImageBufferPool::getSizeClass(2048*2048*4),
+					  (S32)LLImageBufferPool::NUM_SIZE_CLASSES - 2);
+		ensure_equals("too small", LLImageBufferPool::getSizeClass(8*8*4), -1);
+		ensure_equals("too big", LLImageBufferPool::getSizeClass(4096*4096*4), -1);
+		ensure_equals("not a power of two", LLImageBufferPool::getSizeClass(100*100*4), -1);
+		ensure_equals("five components", LLImageBufferPool::getSizeClass(64*64*5), -1);
+		ensure_equals("empty", LLImageBufferPool::getSizeClass(0), -1);
+	}
+
+	template<> template<>
+	void imagebufferpool_object::test<2>()
+	{
+		// without the pool, buffers come straight from the heap
+		U8* data = LLImageBufferPool::allocate(64*64*4);
+		ensure("unpooled", data != NULL);
+		LLImageBufferPool::free(data, 64*64*4);
+		LLImageBufferPool::free(NULL, 64*64*4);
+
+		LLImageBufferPool::initClass();
+		LLImageBufferPool::Stats stats;
+		LLImageBufferPool::getStats(stats);
+		ensure_equals("no allocations", stats.mAllocations, (U32)0);
+
+		// a freed buffer comes back for the next image of its size,
+		// including one that was allocated with new
+		data = LLImageBufferPool::allocate(64*64*4);
+		LLImageBufferPool::free(data, 64*64*4);
+		U8* again = LLImageBufferPool::allocate(64*64*4);
+		ensure("reused", again == data);
+		LLImageBufferPool::free(again, 64*64*4);
+
+		U8* outside = new U8[128*128*3];
+		LLImageBufferPool::free(outside, 128*128*3);
+		ensure("adopted", LLImageBufferPool::allocate(128*128*3) == outside);
+		LLImageBufferPool::free(outside, 128*128*3);
+
+		U8* odd = LLImageBufferPool::allocate(100*100*4);
+		LLImageBufferPool::free(odd, 100*100*4);
+
+		LLImageBufferPool::getStats(stats);
+		ensure_equals("allocations", stats.mAllocations, (U32)3);
+		ensure_equals("reused", stats.mReused, (U32)2);
+		ensure_equals("unpooled", stats.mUnpooled, (U32)1);
+		ensure_equals("cached", stats.mCachedBytes, 64*64*4 + 128*128*3);
+		ensure_equals("peak", stats.mPeakBytes, 64*64*4);
+		ensure("reuse rate", stats.getReuseRate() > 0.6f);
+	}
+
+	template<> template<>
+	void imagebufferpool_object::test<3>()
+	{
+		// the caches keep no more than they are allowed, and what they
+		// let go of goes back to the heap
+		const S32 SIZE = 256*256*4;
+		const S32 MAX_CACHED = SIZE * 2;
+		const S32 COUNT = LLImageBufferPool::THREAD_CACHE_DEPTH + 5;
+		LLImageBufferPool::initClass(MAX_CACHED);
+
+		std::vector<U8*> buffers;
+		for (S32 i = 0; i < COUNT; ++i)
+		{
+			buffers.push_back(LLImageBufferPool::allocate(SIZE));
+		}
+		for (S32 i = 0; i < COUNT; ++i)
+		{
+			LLImageBufferPool::free(buffers[i], SIZE);
+		}
+
+		LLImageBufferPool::Stats stats;
+		LLImageBufferPool::getStats(stats);
+		ensure_equals("nothing live", stats.mLiveBytes, 0);
+		ensure_equals("peak", stats.mPeakBytes, SIZE * COUNT);
+		ensure("thread and shared caches are bounded",
+			   stats.mCachedBytes <= llmin((S32)LLImageBufferPool::THREAD_CACHE_BYTES,
+										   (S32)LLImageBufferPool::THREAD_CACHE_DEPTH * SIZE) + MAX_CACHED);
+
+		// everything that was kept is reused before new memory
+		S32 cached = stats.mCachedBytes / SIZE;
+		for (S32 i = 0; i < COUNT; ++i)
+		{
+			buffers[i] = LLImageBufferPool::allocate(SIZE);
+		}
+		LLImageBufferPool::getStats(stats);
+		ensure_equals("reused", stats.mReused, (U32)cached);
+		ensure_equals("cache emptied", stats.mCachedBytes, 0);
+		for (S32 i = 0; i < COUNT; ++i)
+		{
+			LLImageBufferPool::free(buffers[i], SIZE);
+		}
+	}
+
+	template<> template<>
+	void imagebufferpool_object::test<4>()
+	{
+		// decode threads each work out of their own cache
+		const S32 NUM_THREADS = 4;
+		const S32 DECODES = 2000;
+		LLImageBufferPool::initClass();
+
+		LLAtomicS32 done(0);
+		std::vector<DecodeThread*> threads;
+		for (S32 i = 0; i < NUM_THREADS; ++i)
+		{
+			threads.push_back(new DecodeThread(llformat("Decode %d", i), DECODES, done));
+			threads.back()->start();
+		}
+
+		LLTimer timer;
+		while (done < NUM_THREADS && timer.getElapsedTimeF32() < 30.f)
+		{
+			ms_sleep(1);
+		}
+		ensure_equals("threads finished", (S32)done, NUM_THREADS);
+
+		LLImageBufferPool::Stats stats;
+		LLImageBufferPool::getStats(stats);
+		ensure_equals("allocations", stats.mAllocations, (U32)(NUM_THREADS * DECODES));
+		ensure_equals("nothing live", stats.mLiveBytes, 0);
+		// each thread only needs new memory the first time it sees a size
+		ensure("reused", stats.mReused >= (U32)(NUM_THREADS * (DECODES - 5)));
+		ensure("peak", stats.mPeakBytes <= NUM_THREADS * (64*64*4 + 128*128*3 + 256*256*4 + 512*512*3 + 32*32*4));
+
+		for (S32 i = 0; i < NUM_THREADS; ++i)
+		{
+			delete threads[i];
+		}
+	}
+}
@@ -0,0 +1,125 @@
+/** 
+ * @file lljobpool_tut.cpp
+ * @brief LLJobPool unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "lljobpool.h"
+#include "llthread.h"
+
+#include <vector>
+
+namespace tut
+{
+	struct jobpool_data
+	{
+		struct Batch
+		{
+			std::vector<LLAtomic32<S32> > mRuns;
+			LLAtomic32<S32> mOffMain;
+			U32 mMainID;
+
+			Batch(S32 count) : mRuns(count), mOffMain(0), mMainID(LLThread::currentID())
+			{
+				for (S32 i = 0; i < count; ++i)
+				{
+					mRuns[i] = 0;
+				}
+			}
+		};
+
+		static void countJob(S32 index, void* userdata)
+		{
+			Batch* batch = (Batch*)userdata;
+			batch->mRuns[index]++;
+			if (LLThread::currentID() != batch->mMainID)
+			{
+				batch->mOffMain++;
+			}
+			// enough work that the other threads get a share
+			volatile F32 x = 1.f;
+			for (S32 i = 0; i < 2000; ++i)
+			{
+				x = x * 0.999f + 0.001f;
+			}
+		}
+
+		static void sumJob(S32 index, void* userdata)
+		{
+			LLAtomic32<S32>* sum = (LLAtomic32<S32>*)userdata;
+			*sum += index + 1;
+		}
+	};
+	typedef test_group<jobpool_data> jobpool_test;
+	typedef jobpool_test::object jobpool_object;
+	tut::jobpool_test tjp("jobpool");
+
+	template<> template<>
+	void jobpool_object::test<1>()
+	{
+		// every job runs exactly once, whatever the pool and batch size
+		for (S32 threads = 1; threads <= 4; threads *= 2)
+		{
+			LLJobPool pool("jobpool test", threads);
+			ensure_equals("threads", pool.getNumThreads(), threads);
+			S32 off_main = 0;
+			for (S32 count = 0; count < 40; ++count)
+			{
+				Batch batch(count);
+				pool.run(count, countJob, &batch);
+				for (S32 i = 0; i < count; ++i)
+				{
+					ensure_equals("ran once", (S32)batch.mRuns[i], 1);
+				}
+				off_main += batch.mOffMain;
+			}
+			if (threads == 1)
+			{
+				ensure_equals("single thread pool runs inline", off_main, 0);
+			}
+		}
+	}
+
+	template<> template<>
+	void jobpool_object::test<2>()
+	{
+		// many small batches back to back, as one per frame would be
+		LLJobPool pool("jobpool frames", 4);
+		for (S32 frame = 0; frame < 2000; ++frame)
+		{
+			S32 count = frame % 7;
+			LLAtomic32<S32> sum(0);
+			pool.run(count, sumJob, &sum);
+			ensure_equals("all jobs done before run() returns", (S32)sum, count * (count + 1) / 2);
+		}
+	}
+}
@@ -32,21 +32,97 @@
  * $/LicenseInfo$
  */
 
-#ifdef THIS_DOESNT_LINK
-// THIS DOESN'T LINK!
-
 #include <tut/tut.hpp>
 #include "lltut.h"
 #include "linden_common.h"
 #include "m4math.h"
 #include "v3math.h"
 #include "lljoint.h"
+#include "llskeleton.h"
+#include "lltimer.h"
+
+#include <vector>
 
 
 namespace tut
 {
 	struct lljoint_data
 	{
+		typedef std::vector<LLJoint*> joint_list_t;
+
+		// Roughly the shape of an avatar: a spine, four limbs and an
+		// assortment of mesh and attachment joints hanging off every bone.
+		static void makeSkeleton(LLJoint* root, joint_list_t& joints)
+		{
+			joints.push_back(root);
+			std::vector<LLJoint*> bones;
+			LLJoint* spine = root;
+			for (S32 i = 0; i < 6; ++i)
+			{
+				spine = addJoint(spine, LLVector3(0.f, 0.f, 0.15f), joints);
+				bones.push_back(spine);
+			}
+			for (S32 limb = 0; limb < 4; ++limb)
+			{
+				LLJoint* bone = bones[limb < 2 ? 4 : 0];
+				F32 side = (limb % 2) ? -1.f : 1.f;
+				for (S32 i = 0; i < 4; ++i)
+				{
+					bone = addJoint(bone, LLVector3(0.05f, side * 0.2f, -0.1f), joints);
+					bones.push_back(bone);
+				}
+			}
+			for (S32 i = 0; i < (S32)bones.size(); ++i)
+			{
+				for (S32 j = 0; j < 3; ++j)
+				{
+					addJoint(bones[i], LLVector3(0.01f * j, 0.f, 0.02f), joints);
+				}
+			}
+		}
+
+		static LLJoint* addJoint(LLJoint* parent, const LLVector3& pos, joint_list_t& joints)
+		{
+			LLJoint* joint = new LLJoint(llformat("joint%d", (S32)joints.size()), parent);
+			joint->setPosition(pos);
+			joint->setScale(LLVector3(1.f, 1.f + 0.01f * (joints.size() % 3), 1.f));
+			joints.push_back(joint);
+			return joint;
+		}
+
+		static void deleteSkeleton(joint_list_t& joints)
+		{
+			// children first
+			for (S32 i = (S32)joints.size() - 1; i > 0; --i)
+			{
+				delete joints[i];
+			}
+			joints.clear();
+		}
+
+		static void pose(joint_list_t& joints, S32 frame)
+		{
+			for (S32 i = 0; i < (S32)joints.size(); ++i)
+			{
+				F32 angle = 0.4f * sinf(0.1f * (F32)frame + (F32)i);
+				joints[i]->setRotation(LLQuaternion(angle, LLVector3(0.3f, 1.f, 0.2f * (F32)(i % 4))));
+			}
+		}
+
+		static bool sameMatrix(const LLMatrix4& a, const LLMatrix4& b)
+		{
+			for (S32 i = 0; i < 4; ++i)
+			{
+				for (S32 j = 0; j < 4; ++j)
+				{
+					if (fabs(a.mMatrix[i][j] - b.mMatrix[i][j]) > 0.0001f)
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
 	};
 	typedef test_group<lljoint_data> lljoint_test;
 	typedef lljoint_test::object lljoint_object;
@@ -149,7 +225,7 @@ namespace tut
 	{
 		LLJoint lljoint("LLJoint");
 		LLMatrix4 mat;
-		mat.identity();
+		mat.setIdentity();
 		lljoint.setWorldMatrix(mat);//giving warning setWorldMatrix not correctly implemented;
 		LLMatrix4 mat4 = lljoint.getWorldMatrix();
 		ensure("setWorldMatrix()/getWorldMatrix failed ", (mat4 == mat));
@@ -227,8 +303,116 @@ namespace tut
 		ensure("2. addChild failed to remove prior parent", llparent1.findJoint("child2") == NULL);
 	}
 
+	template<> template<>
+	void lljoint_object::test<15>()
+	{
+		// a flattened skeleton poses exactly like the recursive update
+		LLJoint tree_root("root"), flat_root("root");
+		joint_list_t tree_joints, flat_joints;
+		makeSkeleton(&tree_root, tree_joints);
+		makeSkeleton(&flat_root, flat_joints);
+		LLSkeleton skeleton;
+		skeleton.setRootJoint(&flat_root);
+		tree_root.setPosition(LLVector3(10.f, 20.f, 30.f));
+		flat_root.setPosition(LLVector3(10.f, 20.f, 30.f));
+
+		for (S32 frame = 0; frame < 20; ++frame)
+		{
+			pose(tree_joints, frame);
+			pose(flat_joints, frame);
+			if (frame == 5)
+			{
+				// hierarchy changes rebuild the skeleton
+				addJoint(tree_joints[3], LLVector3(0.f, 0.1f, 0.f), tree_joints);
+				addJoint(flat_joints[3], LLVector3(0.f, 0.1f, 0.f), flat_joints);
+			}
+			if (frame == 10)
+			{
+				// frozen subtrees are skipped
+				tree_joints[7]->mUpdateXform = FALSE;
+				flat_joints[7]->mUpdateXform = FALSE;
+			}
+			if (frame % 3 == 0)
+			{
+				// getting one joint's matrix early updates just its chain
+				ensure("chain", sameMatrix(flat_joints[12]->getWorldMatrix(), tree_joints[12]->getWorldMatrix()));
+			}
+
+			tree_root.updateWorldMatrixChildren();
+			flat_root.updateWorldMatrixChildren();
+			ensure_equals("all joints flattened", skeleton.getNumJoints(), (S32)flat_joints.size());
+			for (S32 i = 0; i < (S32)tree_joints.size(); ++i)
+			{
+				ensure("world matrix", sameMatrix(flat_joints[i]->getWorldMatrix(), tree_joints[i]->getWorldMatrix()));
+				ensure("world position", dist_vec(flat_joints[i]->getLastWorldPosition(), tree_joints[i]->getLastWorldPosition()) < 0.0001f);
+			}
+		}
+
+		deleteSkeleton(tree_joints);
+		deleteSkeleton(flat_joints);
+		ensure_equals("joints removed", skeleton.getNumJoints(), 1);
+	}
+
+	template<> template<>
+	void lljoint_object::test<16>()
+	{
+		// world matrix updates for a crowd of 100 avatars
+		const S32 NUM_AVATARS = 100;
+		const S32 NUM_FRAMES = 50;
+		std::vector<LLJoint*> roots;
+		std::vector<joint_list_t> joints(NUM_AVATARS);
+		std::vector<LLSkeleton*> skeletons;
+		for (S32 a = 0; a < NUM_AVATARS; ++a)
+		{
+			LLJoint* root = new LLJoint("root");
+			makeSkeleton(root, joints[a]);
+			roots.push_back(root);
+		}
+
+		F32 tree_time = 0.f;
+		F32 flat_time = 0.f;
+		for (S32 pass = 0; pass < 2; ++pass)
+		{
+			if (pass == 1)
+			{
+				for (S32 a = 0; a < NUM_AVATARS; ++a)
+				{
+					LLSkeleton* skeleton = new LLSkeleton;
+					skeleton->setRootJoint(roots[a]);
+					skeletons.push_back(skeleton);
+				}
+			}
+			LLTimer timer;
+			F32 elapsed = 0.f;
+			for (S32 frame = 0; frame < NUM_FRAMES; ++frame)
+			{
+				for (S32 a = 0; a < NUM_AVATARS; ++a)
+				{
+					pose(joints[a], frame);
+				}
+				timer.reset();
+				for (S32 a = 0; a < NUM_AVATARS; ++a)
+				{
+					roots[a]->updateWorldMatrixChildren();
+				}
+				elapsed += timer.getElapsedTimeF32();
+			}
+			(pass == 0 ? tree_time : flat_time) = elapsed;
+		}
+
+		llinfos << "Skeleton update, " << NUM_AVATARS << " avatars of " << joints[0].size()
+				<< " joints, " << NUM_FRAMES << " frames: flat " << flat_time * 1000.f
+				<< " ms, recursive " << tree_time * 1000.f << " ms" << llendl;
+
+		for (S32 a = 0; a < NUM_AVATARS; ++a)
+		{
+			delete skeletons[a];
+			deleteSkeleton(joints[a]);
+			delete roots[a];
+		}
+	}
 
-	//*
+	/*
 		Test cases for the following not added. They perform operations 
 		on underlying LLXformMatrix	and LLVector3 elements which have
 		been unit tested separately. 
@@ -243,6 +427,5 @@ namespace tut
         6) void setConstraintSilhouette(LLDynamicArray<LLVector3>& silhouette);
         7) void clampRotation(LLQuaternion old_rot, LLQuaternion new_rot);
 
-	//*
+	*/
 }
-#endif // THIS_DOESNT_LINK
@@ -0,0 +1,435 @@
+/** 
+ * @file llkeyframecachefile_tut.cpp
+ * @brief LLKeyframeCacheFile unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <vector>
+
+#include "llcharacter.h"
+#include "lldatapacker.h"
+#include "llfile.h"
+#include "llformat.h"
+#include "llkeyframecachefile.h"
+#include "llkeyframemotion.h"
+#include "lltimer.h"
+
+#define TEST_FILE_NAME		"keyframecachefile_test.cache"
+
+namespace tut
+{
+	const S32 NUM_TEST_JOINTS = 25;
+
+	// Just a skeleton to resolve joint names against
+	class TestCharacter : public LLCharacter
+	{
+	public:
+		TestCharacter() : mRoot("root")
+		{
+			for (S32 i = 0; i < NUM_TEST_JOINTS; ++i)
+			{
+				mJoints[i].setName(llformat("joint%d", i));
+				mRoot.addChild(&mJoints[i]);
+			}
+		}
+
+		/*virtual*/ const char* getAnimationPrefix() { return "test"; }
+		/*virtual*/ LLJoint* getRootJoint() { return &mRoot; }
+		/*virtual*/ LLVector3 getCharacterPosition() { return LLVector3::zero; }
+		/*virtual*/ LLQuaternion getCharacterRotation() { return LLQuaternion::DEFAULT; }
+		/*virtual*/ LLVector3 getCharacterVelocity() { return LLVector3::zero; }
+		/*virtual*/ LLVector3 getCharacterAngularVelocity() { return LLVector3::zero; }
+		/*virtual*/ void getGround(const LLVector3& inPos, LLVector3& outPos, LLVector3& outNorm)
+		{
+			outPos = inPos;
+			outNorm = LLVector3::z_axis;
+		}
+		/*virtual*/ BOOL allocateCharacterJoints(U32 num) { return FALSE; }
+		/*virtual*/ LLJoint* getCharacterJoint(U32 i) { return NULL; }
+		/*virtual*/ F32 getTimeDilation() { return 1.f; }
+		/*virtual*/ F32 getPixelArea() const { return 1000.f; }
+		/*virtual*/ LLPolyMesh* getHeadMesh() { return NULL; }
+		/*virtual*/ LLPolyMesh* getUpperBodyMesh() { return NULL; }
+		/*virtual*/ LLVector3d getPosGlobalFromAgent(const LLVector3& position) { return LLVector3d(position); }
+		/*virtual*/ LLVector3 getPosAgentFromGlobal(const LLVector3d& position) { return LLVector3(position); }
+		/*virtual*/ void addDebugText(const std::string& text) {}
+		/*virtual*/ const LLUUID& getID() { return mID; }
+
+	private:
+		LLJoint mRoot;
+		LLJoint mJoints[NUM_TEST_JOINTS];
+		LLUUID mID;
+	};
+
+	// Decodes assets the way the viewer does, without fetching them
+	class TestKeyframeMotion : public LLKeyframeMotion
+	{
+	public:
+		TestKeyframeMotion(const LLUUID& id, LLCharacter* character) : LLKeyframeMotion(id)
+		{
+			mCharacter = character;
+		}
+
+		// What deserialize() resolves for an IK constraint
+		static void addConstraint(JointMotionList* list)
+		{
+			JointConstraintSharedData* constraint = new JointConstraintSharedData;
+			constraint->mChainLength = 2;
+			constraint->mSourceConstraintVolume = 3;
+			constraint->mSourceConstraintOffset.setVec(0.1f, 0.2f, 0.3f);
+			constraint->mConstraintTargetType = CONSTRAINT_TARGET_TYPE_GROUND;
+			constraint->mTargetConstraintDir.setVec(0.f, 0.f, -1.f);
+			constraint->mUseTargetOffset = TRUE;
+			constraint->mEaseOutStopTime = 1.5f;
+			constraint->mJointStateIndices = new S32[3];
+			for (S32 i = 0; i < 3; ++i)
+			{
+				constraint->mJointStateIndices[i] = 4 - i;
+			}
+			list->mConstraints.push_back(constraint);
+		}
+
+		static bool sameConstraints(const JointMotionList* a, const JointMotionList* b)
+		{
+			if (a->mConstraints.size() != b->mConstraints.size())
+			{
+				return false;
+			}
+			JointMotionList::constraint_list_t::const_iterator a_iter = a->mConstraints.begin();
+			JointMotionList::constraint_list_t::const_iterator b_iter = b->mConstraints.begin();
+			for ( ; a_iter != a->mConstraints.end(); ++a_iter, ++b_iter)
+			{
+				const JointConstraintSharedData* ca = *a_iter;
+				const JointConstraintSharedData* cb = *b_iter;
+				if (ca->mChainLength != cb->mChainLength
+					|| ca->mSourceConstraintVolume != cb->mSourceConstraintVolume
+					|| ca->mSourceConstraintOffset != cb->mSourceConstraintOffset
+					|| ca->mTargetConstraintDir != cb->mTargetConstraintDir
+					|| ca->mConstraintTargetType != cb->mConstraintTargetType
+					|| ca->mUseTargetOffset != cb->mUseTargetOffset
+					|| ca->mEaseOutStopTime != cb->mEaseOutStopTime)
+				{
+					return false;
+				}
+				for (S32 i = 0; i <= ca->mChainLength; ++i)
+				{
+					if (ca->mJointStateIndices[i] != cb->mJointStateIndices[i])
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+	};
+
+	struct keyframecachefile_data
+	{
+		~keyframecachefile_data()
+		{
+			LLKeyframeDataCache::closeCompiledCache(false);
+			LLFile::remove(TEST_FILE_NAME);
+		}
+
+		static LLUUID makeID(S32 i)
+		{
+			LLUUID id;
+			id.mData[0] = (U8)(i + 1);
+			id.mData[15] = (U8)(i >> 8);
+			return id;
+		}
+
+		// An animation asset as the upload preview writes it: a rotation key
+		// for every joint each 1/30s, and pelvis positions.
+		static void makeAsset(std::vector<U8>& asset, S32 num_joints, F32 duration, S32 seed)
+		{
+			S32 num_keys = (S32)(duration * 30.f) + 1;
+			asset.resize(128 + num_joints * (32 + num_keys * 8) + num_keys * 8);
+			LLDataPackerBinaryBuffer dp(&asset[0], (S32)asset.size());
+			dp.packU16(KEYFRAME_MOTION_VERSION, "version");
+			dp.packU16(KEYFRAME_MOTION_SUBVERSION, "sub_version");
+			dp.packS32(LLJoint::MEDIUM_PRIORITY, "base_priority");
+			dp.packF32(duration, "duration");
+			dp.packString(seed % 2 ? "" : "express_smile", "emote_name");
+			dp.packF32(0.5f, "loop_in_point");
+			dp.packF32(duration, "loop_out_point");
+			dp.packS32(seed % 2, "loop");
+			dp.packF32(0.2f, "ease_in_duration");
+			dp.packF32(0.3f, "ease_out_duration");
+			dp.packU32(LLHandMotion::HAND_POSE_RELAXED, "hand_pose");
+			dp.packU32(num_joints, "num_joints");
+			for (S32 j = 0; j < num_joints; ++j)
+			{
+				dp.packString(llformat("joint%d", j), "joint_name");
+				dp.packS32(LLJoint::USE_MOTION_PRIORITY, "joint_priority");
+				dp.packS32(num_keys, "num_rot_keys");
+				for (S32 k = 0; k < num_keys; ++k)
+				{
+					dp.packU16((U16)(k * 65535 / (num_keys - 1)), "time");
+					dp.packU16((U16)((k * 997 + j * 131 + seed * 17) & 0xffff), "rot_angle_x");
+					dp.packU16((U16)((k * 577 + j * 71) & 0xffff), "rot_angle_y");
+					dp.packU16((U16)((k * 313 + seed) & 0xffff), "rot_angle_z");
+				}
+				S32 num_pos_keys = j ? 0 : num_keys;
+				dp.packS32(num_pos_keys, "num_pos_keys");
+				for (S32 k = 0; k < num_pos_keys; ++k)
+				{
+					dp.packU16((U16)(k * 65535 / (num_keys - 1)), "time");
+					dp.packU16((U16)(32768 + k * 40), "pos_x");
+					dp.packU16((U16)(32768 - k * 20), "pos_y");
+					dp.packU16((U16)(32768 + seed), "pos_z");
+				}
+			}
+			dp.packS32(0, "num_constraints");
+			asset.resize(dp.getCurrentSize());
+		}
+
+		// Decodes an asset into LLKeyframeDataCache, as loading from the VFS does
+		static LLKeyframeMotion::JointMotionList* decode(const LLUUID& id, std::vector<U8>& asset, LLCharacter* character)
+		{
+			TestKeyframeMotion motion(id, character);
+			LLDataPackerBinaryBuffer dp(&asset[0], (S32)asset.size());
+			if (!motion.deserialize(dp))
+			{
+				return NULL;
+			}
+			return LLKeyframeDataCache::getKeyframeData(id);
+		}
+
+		static bool sameLists(const LLKeyframeMotion::JointMotionList* a, const LLKeyframeMotion::JointMotionList* b)
+		{
+			if (a->mDuration != b->mDuration
+				|| a->mLoop != b->mLoop
+				|| a->mLoopInPoint != b->mLoopInPoint
+				|| a->mLoopOutPoint != b->mLoopOutPoint
+				|| a->mEaseInDuration != b->mEaseInDuration
+				|| a->mEaseOutDuration != b->mEaseOutDuration
+				|| a->mBasePriority != b->mBasePriority
+				|| a->mMaxPriority != b->mMaxPriority
+				|| a->mHandPose != b->mHandPose
+				|| a->mEmoteName != b->mEmoteName
+				|| a->mPelvisBBox.getMin() != b->mPelvisBBox.getMin()
+				|| a->mPelvisBBox.getMax() != b->mPelvisBBox.getMax()
+				|| a->getNumJointMotions() != b->getNumJointMotions())
+			{
+				return false;
+			}
+			for (U32 i = 0; i < a->getNumJointMotions(); ++i)
+			{
+				LLKeyframeMotion::JointMotion* ja = a->getJointMotion(i);
+				LLKeyframeMotion::JointMotion* jb = b->getJointMotion(i);
+				if (ja->mJointName != jb->mJointName
+					|| ja->mUsage != jb->mUsage
+					|| ja->mPriority != jb->mPriority
+					|| ja->mRotationCurve.mNumKeys != jb->mRotationCurve.mNumKeys
+					|| ja->mPositionCurve.mNumKeys != jb->mPositionCurve.mNumKeys
+					|| ja->mScaleCurve.mNumKeys != jb->mScaleCurve.mNumKeys)
+				{
+					return false;
+				}
+				for (F32 time = -0.1f; time < a->mDuration + 0.1f; time += 0.0137f)
+				{
+					if (ja->mRotationCurve.getValue(time, a->mDuration) != jb->mRotationCurve.getValue(time, b->mDuration)
+						|| ja->mPositionCurve.getValue(time, a->mDuration) != jb->mPositionCurve.getValue(time, b->mDuration))
+					{
+						return false;
+					}
+				}
+			}
+			return TestKeyframeMotion::sameConstraints(a, b);
+		}
+
+		// Heap used by a decoded list's keys
+		static size_t keyBytes(const LLKeyframeMotion::JointMotionList* list)
+		{
+			size_t bytes = 0;
+			for (U32 i = 0; i < list->getNumJointMotions(); ++i)
+			{
+				const LLKeyframeMotion::JointMotion* joint_motion = list->getJointMotion(i);
+				bytes += joint_motion->mRotationCurve.mKeyTimeData.capacity() * sizeof(F32);
+				bytes += joint_motion->mRotationCurve.mKeyRotationsData.capacity() * sizeof(LLQuaternion);
+				bytes += joint_motion->mPositionCurve.mKeyTimeData.capacity() * sizeof(F32);
+				bytes += joint_motion->mPositionCurve.mKeyPositionsData.capacity() * sizeof(LLVector3);
+			}
+			return bytes;
+		}
+
+		TestCharacter mCharacter;
+	};
+	typedef test_group<keyframecachefile_data> keyframecachefile_test;
+	typedef keyframecachefile_test::object keyframecachefile_object;
+	tut::keyframecachefile_test tkfc("keyframecachefile");
+
+	template<> template<>
+	void keyframecachefile_object::test<1>()
+	{
+		// animations come back from the file as they were decoded
+		const S32 NUM_ANIMATIONS = 3;
+		std::vector<U8> assets[NUM_ANIMATIONS];
+		LLKeyframeMotion::JointMotionList* decoded[NUM_ANIMATIONS];
+		for (S32 i = 0; i < NUM_ANIMATIONS; ++i)
+		{
+			makeAsset(assets[i], 5 + i, 1.f + (F32)i, i);
+			decoded[i] = decode(makeID(i), assets[i], &mCharacter);
+			ensure("decoded", decoded[i] != NULL);
+		}
+		TestKeyframeMotion::addConstraint(decoded[1]);
+
+		LLKeyframeCacheFile file;
+		ensure("no file yet", !file.open(TEST_FILE_NAME));
+		ensure("start", file.startFile(TEST_FILE_NAME));
+		for (S32 i = 0; i < NUM_ANIMATIONS; ++i)
+		{
+			file.addToFile(makeID(i), decoded[i]);
+		}
+		ensure("finish", file.finishFile());
+
+		ensure("open", file.open(TEST_FILE_NAME));
+		ensure_equals("count", file.getCount(), NUM_ANIMATIONS);
+		for (S32 i = 0; i < NUM_ANIMATIONS; ++i)
+		{
+			LLKeyframeMotion::JointMotionList* loaded = file.load(makeID(i));
+			ensure("loaded", loaded != NULL);
+			ensure("keys are mapped", loaded->getJointMotion(0)->mRotationCurve.mKeyRotationsData.empty());
+			ensure("same as decoded", sameLists(decoded[i], loaded));
+			delete loaded;
+		}
+		ensure("missing", file.load(makeID(NUM_ANIMATIONS)) == NULL);
+		file.close();
+		LLKeyframeDataCache::clear();
+	}
+
+	template<> template<>
+	void keyframecachefile_object::test<2>()
+	{
+		// other versions and damaged entries are ignored
+		std::vector<U8> asset;
+		makeAsset(asset, 4, 1.f, 0);
+		LLKeyframeCacheFile file;
+		file.startFile(TEST_FILE_NAME);
+		file.addToFile(makeID(0), decode(makeID(0), asset, &mCharacter));
+		file.finishFile();
+		LLKeyframeDataCache::clear();
+
+		LLFILE* fp = LLFile::fopen(TEST_FILE_NAME, "r+b");		/* Flawfinder: ignore */
+		ensure("reopen", fp != NULL);
+		U32 words[4];
+		ensure("read header", fread(words, sizeof(U32), 4, fp) == 4);
+		U32 version = words[1];
+		words[1] = version + 1;
+		fseek(fp, 0, SEEK_SET);
+		fwrite(words, sizeof(U32), 4, fp);
+		fflush(fp);
+		ensure("other version", !file.open(TEST_FILE_NAME));
+
+		// an index entry claiming more than the file holds
+		words[1] = version;
+		fseek(fp, 0, SEEK_SET);
+		fwrite(words, sizeof(U32), 4, fp);
+		U32 size = 0xffff;
+		fseek(fp, words[3] + sizeof(LLUUID) + sizeof(U32), SEEK_SET);
+		fwrite(&size, sizeof(U32), 1, fp);
+		fclose(fp);
+		ensure("open", file.open(TEST_FILE_NAME));
+		ensure("damaged entry", file.load(makeID(0)) == NULL);
+	}
+
+	template<> template<>
+	void keyframecachefile_object::test<3>()
+	{
+		// LLKeyframeDataCache saves what it holds and finds it next session
+		std::vector<U8> asset;
+		makeAsset(asset, 6, 2.f, 1);
+		ensure("no file yet", !LLKeyframeDataCache::openCompiledCache(TEST_FILE_NAME));
+		LLKeyframeMotion::JointMotionList* decoded = decode(makeID(7), asset, &mCharacter);
+		ensure("decoded", decoded != NULL);
+		LLKeyframeDataCache::closeCompiledCache(true);
+		ensure("cleared", LLKeyframeDataCache::getKeyframeData(makeID(7)) == NULL);
+
+		ensure("next session", LLKeyframeDataCache::openCompiledCache(TEST_FILE_NAME));
+		LLKeyframeMotion::JointMotionList* loaded = LLKeyframeDataCache::getKeyframeData(makeID(7));
+		ensure("found", loaded != NULL);
+		ensure("cached", LLKeyframeDataCache::getKeyframeData(makeID(7)) == loaded);
+		ensure("not decoded", loaded->getJointMotion(0)->mRotationCurve.mKeyRotationsData.empty());
+
+		// saving again keeps it, though it points into the file being replaced
+		LLKeyframeDataCache::closeCompiledCache(true);
+		ensure("third session", LLKeyframeDataCache::openCompiledCache(TEST_FILE_NAME));
+		ensure("still there", LLKeyframeDataCache::getKeyframeData(makeID(7)) != NULL);
+		LLKeyframeDataCache::closeCompiledCache(false);
+	}
+
+	template<> template<>
+	void keyframecachefile_object::test<4>()
+	{
+		// startup with 60 animations of 25 joints and 3 seconds, decoded
+		// from assets versus loaded from the file
+		const S32 NUM_ANIMATIONS = 60;
+		std::vector<std::vector<U8> > assets(NUM_ANIMATIONS);
+		for (S32 i = 0; i < NUM_ANIMATIONS; ++i)
+		{
+			makeAsset(assets[i], NUM_TEST_JOINTS, 3.f, i);
+		}
+
+		LLTimer timer;
+		size_t heap_bytes = 0;
+		for (S32 i = 0; i < NUM_ANIMATIONS; ++i)
+		{
+			LLKeyframeMotion::JointMotionList* decoded = decode(makeID(i), assets[i], &mCharacter);
+			ensure("decoded", decoded != NULL);
+			heap_bytes += keyBytes(decoded);
+		}
+		F32 decode_time = timer.getElapsedTimeF32();
+		ensure("no file yet", !LLKeyframeDataCache::openCompiledCache(TEST_FILE_NAME));
+		LLKeyframeDataCache::closeCompiledCache(true);
+
+		timer.reset();
+		ensure("reopen", LLKeyframeDataCache::openCompiledCache(TEST_FILE_NAME));
+		size_t loaded_heap_bytes = 0;
+		for (S32 i = 0; i < NUM_ANIMATIONS; ++i)
+		{
+			LLKeyframeMotion::JointMotionList* loaded = LLKeyframeDataCache::getKeyframeData(makeID(i));
+			ensure("loaded", loaded != NULL);
+			loaded_heap_bytes += keyBytes(loaded);
+		}
+		F32 load_time = timer.getElapsedTimeF32();
+		ensure_equals("no keys on the heap", loaded_heap_bytes, (size_t)0);
+
+		llstat file_stat;
+		LLFile::stat(TEST_FILE_NAME, &file_stat);
+		llinfos << "Keyframe cache, " << NUM_ANIMATIONS << " animations: mapped " << load_time * 1000.f
+				<< " ms (decoded " << decode_time * 1000.f << " ms); keys "
+				<< (S32)file_stat.st_size / 1024 << " KB shared in the file (decoded "
+				<< (S32)(heap_bytes / 1024) << " KB on the heap)" << llendl;
+		LLKeyframeDataCache::closeCompiledCache(false);
+	}
+}
@@ -0,0 +1,230 @@
+/** 
+ * @file llkeyframemotion_tut.cpp
+ * @brief LLKeyframeMotion curve unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <map>
+
+#include "llkeyframemotion.h"
+#include "lltimer.h"
+
+namespace tut
+{
+	struct keyframemotion_data
+	{
+		typedef std::map<F32, LLQuaternion> rot_map_t;
+
+		// How curves were sampled when their keys lived in a std::map
+		static LLQuaternion mapValue(const rot_map_t& keys, F32 time)
+		{
+			if (keys.empty())
+			{
+				return LLQuaternion::DEFAULT;
+			}
+			rot_map_t::const_iterator right = keys.lower_bound(time);
+			if (right == keys.end())
+			{
+				--right;
+				return right->second;
+			}
+			if (right == keys.begin() || right->first == time)
+			{
+				return right->second;
+			}
+			rot_map_t::const_iterator left = right;
+			--left;
+			F32 u = (time - left->first) / (right->first - left->first);
+			return nlerp(u, left->second, right->second);
+		}
+
+		static bool same(const LLQuaternion& a, const LLQuaternion& b)
+		{
+			for (S32 i = 0; i < 4; ++i)
+			{
+				if (fabs(a.mQ[i] - b.mQ[i]) > 0.00001f)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static LLQuaternion makeRotation(S32 i)
+		{
+			LLQuaternion rot;
+			rot.setQuat((F32)i * 0.37f, LLVector3(0.3f, 1.f, (F32)(i % 5) * 0.1f));
+			return rot;
+		}
+
+		// Keys every 1/30s, like animations exported from the upload preview
+		static void makeCurve(LLKeyframeMotion::RotationCurve& curve, rot_map_t& keys, F32 duration)
+		{
+			S32 num_keys = (S32)(duration * 30.f);
+			for (S32 i = 0; i <= num_keys; ++i)
+			{
+				F32 time = duration * (F32)i / (F32)num_keys;
+				LLKeyframeMotion::RotationKey key(time, makeRotation(i));
+				curve.addKey(key);
+				keys[time] = key.mRotation;
+			}
+			curve.sortKeys();
+		}
+	};
+	typedef test_group<keyframemotion_data> keyframemotion_test;
+	typedef keyframemotion_test::object keyframemotion_object;
+	tut::keyframemotion_test tkfm("keyframemotion");
+
+	template<> template<>
+	void keyframemotion_object::test<1>()
+	{
+		// keys added out of order, and twice at one time, sort like the old map
+		LLKeyframeMotion::RotationCurve curve;
+		rot_map_t keys;
+		static const F32 times[] = { 0.5f, 0.f, 1.f, 0.25f, 0.5f, 0.75f };
+		for (S32 i = 0; i < (S32)(sizeof(times) / sizeof(times[0])); ++i)
+		{
+			LLKeyframeMotion::RotationKey key(times[i], makeRotation(i));
+			curve.addKey(key);
+			keys[times[i]] = key.mRotation;
+		}
+		curve.sortKeys();
+		ensure_equals("duplicate dropped", curve.mNumKeys, 5);
+		ensure("later key wins", same(curve.mKeyRotations[2], makeRotation(4)));
+
+		S32 cursor = 0;
+		for (F32 time = -0.1f; time < 1.2f; time += 0.01f)
+		{
+			ensure("matches map", same(curve.getValue(time, 1.f, cursor), mapValue(keys, time)));
+		}
+		for (S32 i = 0; i < 5; ++i)
+		{
+			ensure("on a key", same(curve.getValue(times[i], 1.f, cursor), mapValue(keys, times[i])));
+		}
+
+		LLKeyframeMotion::RotationCurve empty;
+		ensure("empty curve", same(empty.getValue(0.5f, 1.f, cursor), LLQuaternion::DEFAULT));
+	}
+
+	template<> template<>
+	void keyframemotion_object::test<2>()
+	{
+		// the playhead survives looping, seeking back and random access
+		LLKeyframeMotion::RotationCurve curve;
+		rot_map_t keys;
+		const F32 duration = 4.f;
+		makeCurve(curve, keys, duration);
+
+		S32 cursor = 0;
+		for (S32 frame = 0; frame < 1000; ++frame)
+		{
+			F32 time = fmodf((F32)frame * 0.0213f, duration);
+			ensure("looping", same(curve.getValue(time, duration, cursor), mapValue(keys, time)));
+		}
+		for (F32 time = duration; time >= 0.f; time -= 0.05f)
+		{
+			ensure("backwards", same(curve.getValue(time, duration, cursor), mapValue(keys, time)));
+		}
+		for (S32 i = 0; i < 500; ++i)
+		{
+			F32 time = (F32)((i * 7919) % 1000) * duration / 1000.f;
+			ensure("random", same(curve.getValue(time, duration, cursor), mapValue(keys, time)));
+		}
+	}
+
+	template<> template<>
+	void keyframemotion_object::test<3>()
+	{
+		// sampling a crowd: 60 avatars playing a 20 joint, 5 second animation
+		const S32 NUM_AVATARS = 60;
+		const S32 NUM_JOINTS = 20;
+		const S32 NUM_FRAMES = 300;
+		const F32 duration = 5.f;
+
+		LLKeyframeMotion::JointMotionList motion_list;
+		motion_list.mDuration = duration;
+		std::vector<rot_map_t> joint_keys(NUM_JOINTS);
+		for (S32 j = 0; j < NUM_JOINTS; ++j)
+		{
+			LLKeyframeMotion::JointMotion* joint_motion = new LLKeyframeMotion::JointMotion;
+			makeCurve(joint_motion->mRotationCurve, joint_keys[j], duration);
+			joint_motion->mUsage = LLJointState::ROT;
+			motion_list.mJointMotionArray.push_back(joint_motion);
+		}
+
+		std::vector<LLPointer<LLJointState> > joint_states;
+		for (S32 i = 0; i < NUM_AVATARS * NUM_JOINTS; ++i)
+		{
+			LLPointer<LLJointState> joint_state = new LLJointState;
+			joint_state->setUsage(LLJointState::ROT);
+			joint_states.push_back(joint_state);
+		}
+		std::vector<LLKeyframeMotion::JointCursor> cursors(NUM_AVATARS * NUM_JOINTS);
+
+		LLTimer timer;
+		F32 checksum = 0.f;
+		for (S32 frame = 0; frame < NUM_FRAMES; ++frame)
+		{
+			for (S32 a = 0; a < NUM_AVATARS; ++a)
+			{
+				// avatars start the animation at different times
+				F32 time = fmodf((F32)frame / 30.f + (F32)a * 0.13f, duration);
+				for (S32 j = 0; j < NUM_JOINTS; ++j)
+				{
+					checksum += mapValue(joint_keys[j], time).mQ[VW];
+				}
+			}
+		}
+		F32 map_time = timer.getElapsedTimeF32();
+
+		timer.reset();
+		F32 curve_checksum = 0.f;
+		for (S32 frame = 0; frame < NUM_FRAMES; ++frame)
+		{
+			for (S32 a = 0; a < NUM_AVATARS; ++a)
+			{
+				F32 time = fmodf((F32)frame / 30.f + (F32)a * 0.13f, duration);
+				motion_list.update(time, &joint_states[a * NUM_JOINTS], &cursors[a * NUM_JOINTS]);
+				for (S32 j = 0; j < NUM_JOINTS; ++j)
+				{
+					curve_checksum += joint_states[a * NUM_JOINTS + j]->getRotation().mQ[VW];
+				}
+			}
+		}
+		F32 curve_time = timer.getElapsedTimeF32();
+		ensure("same samples", fabs(checksum - curve_checksum) < 0.1f);
+
+		S32 samples = NUM_FRAMES * NUM_AVATARS * NUM_JOINTS;
+		llinfos << "Keyframe sampling, " << samples << " joint samples: "
+				<< curve_time * 1000.f << " ms (std::map " << map_time * 1000.f << " ms)" << llendl;
+	}
+}
@@ -0,0 +1,363 @@
+/** 
+ * @file llmorphdeltas_tut.cpp
+ * @brief LLMorphDeltas and LLMorphAccumulator unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <vector>
+
+#include "llmorphdeltas.h"
+#include "lltimer.h"
+#include "v2math.h"
+#include "v3math.h"
+#include "v4math.h"
+
+namespace tut
+{
+	struct morphdeltas_data
+	{
+		struct Mesh
+		{
+			Mesh(U32 num_vertices) :
+				mCoords(num_vertices), mNormals(num_vertices), mScaledNormals(num_vertices),
+				mBinormals(num_vertices), mScaledBinormals(num_vertices),
+				mTexCoords(num_vertices), mClothingWeights(num_vertices)
+			{
+				for (U32 i = 0; i < num_vertices; ++i)
+				{
+					mCoords[i] = randVec();
+					mScaledNormals[i] = randVec();
+					mNormals[i] = mScaledNormals[i];
+					mNormals[i].normVec();
+					mScaledBinormals[i] = randVec();
+					mBinormals[i] = mScaledBinormals[i];
+					mBinormals[i].normVec();
+					mTexCoords[i].setVec(randF32(), randF32());
+				}
+			}
+
+			void begin(LLMorphAccumulator& accumulator)
+			{
+				accumulator.begin(mCoords.size(), &mCoords[0], &mNormals[0], &mScaledNormals[0],
+								  &mBinormals[0], &mScaledBinormals[0], &mTexCoords[0], &mClothingWeights[0]);
+			}
+
+			std::vector<LLVector3> mCoords;
+			std::vector<LLVector3> mNormals;
+			std::vector<LLVector3> mScaledNormals;
+			std::vector<LLVector3> mBinormals;
+			std::vector<LLVector3> mScaledBinormals;
+			std::vector<LLVector2> mTexCoords;
+			std::vector<LLVector4> mClothingWeights;
+		};
+
+		struct Morph
+		{
+			Morph(U32 mesh_vertices, U32 num_vertices)
+			{
+				// every third or so vertex, in order, like the morphs in the .llm files
+				U32 stride = llmax(mesh_vertices / num_vertices, (U32)1);
+				U32 index = randU32() % stride;
+				for (U32 i = 0; i < num_vertices && index < mesh_vertices; ++i)
+				{
+					mIndices.push_back(index);
+					mCoords.push_back(randVec() * 0.01f);
+					mNormals.push_back(randVec() * 0.1f);
+					mBinormals.push_back(randVec() * 0.1f);
+					mTexCoords.push_back(LLVector2(randF32(), randF32()) * 0.01f);
+					mMaskWeights.push_back(randF32());
+					index += 1 + randU32() % stride;
+				}
+				mDeltas.set(mIndices.size(), &mIndices[0], &mCoords[0], &mNormals[0],
+							&mBinormals[0], &mTexCoords[0]);
+			}
+
+			std::vector<U32> mIndices;
+			std::vector<LLVector3> mCoords;
+			std::vector<LLVector3> mNormals;
+			std::vector<LLVector3> mBinormals;
+			std::vector<LLVector2> mTexCoords;
+			std::vector<F32> mMaskWeights;
+			LLMorphDeltas mDeltas;
+		};
+
+		// One morph at a time, renormalizing as it goes, the way
+		// LLPolyMorphTarget::apply() used to.
+		static void applyOneMorph(Mesh& mesh, const Morph& morph, F32 delta_weight,
+								  const F32* mask_weights, F32 soften, BOOL clothing)
+		{
+			for (U32 v = 0; v < morph.mIndices.size(); ++v)
+			{
+				U32 index = morph.mIndices[v];
+				F32 mask_weight = mask_weights ? mask_weights[v] : 1.f;
+
+				mesh.mCoords[index] += morph.mCoords[v] * delta_weight * mask_weight;
+				if (clothing)
+				{
+					LLVector3 clothing_offset = morph.mCoords[v] * delta_weight * mask_weight;
+					LLVector4* clothing_weight = &mesh.mClothingWeights[index];
+					clothing_weight->mV[VX] += clothing_offset.mV[VX];
+					clothing_weight->mV[VY] += clothing_offset.mV[VY];
+					clothing_weight->mV[VZ] += clothing_offset.mV[VZ];
+					clothing_weight->mV[VW] = mask_weight;
+				}
+
+				mesh.mScaledNormals[index] += morph.mNormals[v] * delta_weight * mask_weight * soften;
+				LLVector3 normalized_normal = mesh.mScaledNormals[index];
+				normalized_normal.normVec();
+				mesh.mNormals[index] = normalized_normal;
+
+				mesh.mScaledBinormals[index] += morph.mBinormals[v] * delta_weight * mask_weight * soften;
+				LLVector3 tangent = mesh.mScaledBinormals[index] % normalized_normal;
+				LLVector3 normalized_binormal = normalized_normal % tangent;
+				normalized_binormal.normVec();
+				mesh.mBinormals[index] = normalized_binormal;
+
+				mesh.mTexCoords[index] += morph.mTexCoords[v] * delta_weight * mask_weight;
+			}
+		}
+
+		static void ensureClose(const std::string& msg, F32 actual, F32 expected)
+		{
+			ensure(msg, fabs(actual - expected) <= 1.e-6f);
+		}
+
+		static void ensureMeshesEqual(const std::string& msg, const Mesh& a, const Mesh& b)
+		{
+			for (U32 i = 0; i < a.mCoords.size(); ++i)
+			{
+				for (U32 c = 0; c < 3; ++c)
+				{
+					ensureClose(msg + " coord", a.mCoords[i].mV[c], b.mCoords[i].mV[c]);
+					ensureClose(msg + " normal", a.mNormals[i].mV[c], b.mNormals[i].mV[c]);
+					ensureClose(msg + " scaled normal", a.mScaledNormals[i].mV[c], b.mScaledNormals[i].mV[c]);
+					ensureClose(msg + " binormal", a.mBinormals[i].mV[c], b.mBinormals[i].mV[c]);
+					ensureClose(msg + " scaled binormal", a.mScaledBinormals[i].mV[c], b.mScaledBinormals[i].mV[c]);
+				}
+				for (U32 c = 0; c < 4; ++c)
+				{
+					ensureClose(msg + " clothing weight", a.mClothingWeights[i].mV[c], b.mClothingWeights[i].mV[c]);
+				}
+				ensureClose(msg + " u", a.mTexCoords[i].mV[VX], b.mTexCoords[i].mV[VX]);
+				ensureClose(msg + " v", a.mTexCoords[i].mV[VY], b.mTexCoords[i].mV[VY]);
+			}
+		}
+
+		// deterministic, so a failure can be reproduced
+		static U32 randU32()
+		{
+			static U32 seed = 12345;
+			seed = seed * 1664525 + 1013904223;
+			return seed >> 8;
+		}
+		static F32 randF32() { return (F32)(randU32() & 0xffff) / 65535.f; }
+		static LLVector3 randVec() { return LLVector3(randF32() - 0.5f, randF32() - 0.5f, randF32() - 0.5f); }
+
+		~morphdeltas_data()
+		{
+			LLMorphAccumulator::setVectorize(TRUE);
+		}
+	};
+	typedef test_group<morphdeltas_data> morphdeltas_test;
+	typedef morphdeltas_test::object morphdeltas_object;
+	tut::morphdeltas_test morphdeltas_testcase("morphdeltas");
+
+	template<> template<>
+	void morphdeltas_object::test<1>()
+	{
+		// a morph packs into groups of four and pads the last one
+		Morph morph(100, 7);
+		ensure_equals("vertices", morph.mDeltas.getNumVertices(), (U32)morph.mIndices.size());
+
+		LLMorphDeltas empty;
+		empty.set(0, NULL, NULL, NULL, NULL, NULL);
+		ensure_equals("empty", empty.getNumVertices(), (U32)0);
+
+		Mesh mesh(10);
+		Mesh before = mesh;
+		LLMorphAccumulator accumulator;
+		mesh.begin(accumulator);
+		accumulator.add(empty, 1.f, NULL, 0.65f, FALSE);
+		accumulator.finish();
+		ensureMeshesEqual("empty morph", mesh, before);
+	}
+
+	template<> template<>
+	void morphdeltas_object::test<2>()
+	{
+		// batched morphs, scalar and vectorized, give the same mesh as
+		// applying them one at a time
+		const U32 NUM_VERTICES = 500;
+		const F32 SOFTEN = 0.65f;
+		std::vector<Morph*> morphs;
+		for (U32 i = 0; i < 12; ++i)
+		{
+			morphs.push_back(new Morph(NUM_VERTICES, 30 + i * 37));
+		}
+
+		Mesh reference(NUM_VERTICES);
+		Mesh scalar = reference;
+		Mesh vectorized = reference;
+
+		for (U32 i = 0; i < morphs.size(); ++i)
+		{
+			const F32* mask_weights = (i % 3 == 1) ? &morphs[i]->mMaskWeights[0] : NULL;
+			applyOneMorph(reference, *morphs[i], 0.25f * i - 1.f, mask_weights, SOFTEN, i % 4 == 0);
+		}
+
+		for (S32 pass = 0; pass < 2; ++pass)
+		{
+			LLMorphAccumulator::setVectorize(pass == 1);
+			Mesh& mesh = (pass == 1) ? vectorized : scalar;
+			LLMorphAccumulator accumulator;
+			mesh.begin(accumulator);
+			for (U32 i = 0; i < morphs.size(); ++i)
+			{
+				const F32* mask_weights = (i % 3 == 1) ? &morphs[i]->mMaskWeights[0] : NULL;
+				accumulator.add(morphs[i]->mDeltas, 0.25f * i - 1.f, mask_weights, SOFTEN, i % 4 == 0);
+			}
+			accumulator.finish();
+		}
+
+		ensureMeshesEqual("scalar", scalar, reference);
+		ensureMeshesEqual("vectorized", vectorized, reference);
+
+		for (U32 i = 0; i < morphs.size(); ++i)
+		{
+			delete morphs[i];
+		}
+	}
+
+	template<> template<>
+	void morphdeltas_object::test<3>()
+	{
+		// an accumulator can be reused across meshes of different sizes
+		Morph small_morph(20, 10);
+		Morph large_morph(300, 100);
+		Mesh small_mesh(20);
+		Mesh large_mesh(300);
+		Mesh small_reference = small_mesh;
+		Mesh large_reference = large_mesh;
+		applyOneMorph(small_reference, small_morph, 0.5f, NULL, 0.65f, FALSE);
+		applyOneMorph(large_reference, large_morph, 0.5f, NULL, 0.65f, FALSE);
+
+		LLMorphAccumulator accumulator;
+		small_mesh.begin(accumulator);
+		accumulator.add(small_morph.mDeltas, 0.5f, NULL, 0.65f, FALSE);
+		accumulator.finish();
+		large_mesh.begin(accumulator);
+		accumulator.add(large_morph.mDeltas, 0.5f, NULL, 0.65f, FALSE);
+		accumulator.finish();
+
+		ensureMeshesEqual("small", small_mesh, small_reference);
+		ensureMeshesEqual("large", large_mesh, large_reference);
+	}
+
+	template<> template<>
+	void morphdeltas_object::test<4>()
+	{
+		// A full appearance change on meshes roughly the size of the base
+		// avatar's (head, upper and lower body, hair, skirt, eyelashes),
+		// each with the number of morphs avatar_lad.xml gives it.
+		const U32 NUM_MESHES = 6;
+		const U32 MESH_VERTICES[NUM_MESHES] = { 1600, 2200, 1800, 1000, 900, 150 };
+		const U32 MESH_MORPHS[NUM_MESHES] = { 70, 45, 30, 35, 20, 10 };
+		const S32 NUM_CHANGES = 20;
+		const F32 SOFTEN = 0.65f;
+
+		std::vector<Mesh*> meshes;
+		std::vector<std::vector<Morph*> > morphs(NUM_MESHES);
+		for (U32 m = 0; m < NUM_MESHES; ++m)
+		{
+			meshes.push_back(new Mesh(MESH_VERTICES[m]));
+			for (U32 i = 0; i < MESH_MORPHS[m]; ++i)
+			{
+				morphs[m].push_back(new Morph(MESH_VERTICES[m], MESH_VERTICES[m] / (2 + i % 8)));
+			}
+		}
+
+		F32 one_at_a_time = 0.f;
+		F32 batched[2] = { 0.f, 0.f };
+		LLTimer timer;
+		for (S32 change = 0; change < NUM_CHANGES; ++change)
+		{
+			F32 weight = (change % 2) ? -0.5f : 0.5f;
+
+			timer.reset();
+			for (U32 m = 0; m < NUM_MESHES; ++m)
+			{
+				for (U32 i = 0; i < morphs[m].size(); ++i)
+				{
+					applyOneMorph(*meshes[m], *morphs[m][i], weight, NULL, SOFTEN, FALSE);
+				}
+			}
+			one_at_a_time += timer.getElapsedTimeF32();
+
+			for (S32 pass = 0; pass < 2; ++pass)
+			{
+				LLMorphAccumulator::setVectorize(pass == 1);
+				LLMorphAccumulator accumulator;
+				timer.reset();
+				for (U32 m = 0; m < NUM_MESHES; ++m)
+				{
+					meshes[m]->begin(accumulator);
+					for (U32 i = 0; i < morphs[m].size(); ++i)
+					{
+						accumulator.add(morphs[m][i]->mDeltas, weight, NULL, SOFTEN, FALSE);
+					}
+					accumulator.finish();
+				}
+				batched[pass] += timer.getElapsedTimeF32();
+			}
+		}
+
+		U32 num_morphs = 0;
+		for (U32 m = 0; m < NUM_MESHES; ++m)
+		{
+			num_morphs += morphs[m].size();
+		}
+		llinfos << "Appearance change, " << num_morphs << " morphs on " << NUM_MESHES
+				<< " meshes, " << NUM_CHANGES << " changes: one at a time "
+				<< one_at_a_time * 1000.f << " ms, batched " << batched[0] * 1000.f
+				<< " ms, batched and vectorized " << batched[1] * 1000.f << " ms"
+				<< (LLMorphAccumulator::getVectorize() ? "" : " (not available)") << llendl;
+
+		for (U32 m = 0; m < NUM_MESHES; ++m)
+		{
+			for (U32 i = 0; i < morphs[m].size(); ++i)
+			{
+				delete morphs[m][i];
+			}
+			delete meshes[m];
+		}
+	}
+}
@@ -0,0 +1,329 @@
+/** 
+ * @file llobjectcachefile_tut.cpp
+ * @brief LLObjectCacheFile unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <map>
+
+#include "llobjectcachefile.h"
+#include "lltimer.h"
+
+#define TEST_FILE_NAME		"objectcachefile_test.slc"
+#define TEST_LOG_NAME		"objectcachefile_test.sll"
+#define TEST_LEGACY_NAME	"objectcachefile_test.old"
+
+namespace tut
+{
+	struct objectcachefile_data
+	{
+		objectcachefile_data()
+		{
+			mCacheID.generate();
+		}
+		~objectcachefile_data()
+		{
+			LLFile::remove(TEST_FILE_NAME);
+			LLFile::remove(TEST_LOG_NAME);
+			LLFile::remove(TEST_LEGACY_NAME);
+		}
+
+		// Update data of roughly the size the simulator sends
+		static void makeData(U32 id, U32 crc, std::vector<U8>& data)
+		{
+			data.resize(150 + (id * 37 + crc) % 350);
+			for (size_t i = 0; i < data.size(); ++i)
+			{
+				data[i] = (U8)(id + crc + i);
+			}
+		}
+
+		static bool checkData(U32 id, U32 crc, const U8* data, S32 size)
+		{
+			std::vector<U8> expected;
+			makeData(id, crc, expected);
+			return size == (S32)expected.size() && !memcmp(data, &expected[0], size);
+		}
+
+		// Object local ids are sparse and arrive in no particular order
+		static U32 makeID(S32 i)
+		{
+			return (U32)i * 2654435761U;
+		}
+
+		void writeSnapshot(S32 count, U32 crc)
+		{
+			LLObjectCacheFile file;
+			file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1);
+			ensure("start", file.startSnapshot());
+			std::vector<U8> data;
+			for (S32 i = 0; i < count; ++i)
+			{
+				U32 id = makeID(i);
+				makeData(id, crc, data);
+				file.addToSnapshot(id, crc, i, 0, 0, &data[0], (S32)data.size());
+			}
+			ensure("finish", file.finishSnapshot());
+		}
+
+		LLUUID mCacheID;
+	};
+	typedef test_group<objectcachefile_data> objectcachefile_test;
+	typedef objectcachefile_test::object objectcachefile_object;
+	tut::objectcachefile_test tocf("objectcachefile");
+
+	template<> template<>
+	void objectcachefile_object::test<1>()
+	{
+		// a snapshot reads back in place, oldest first, found by id
+		const S32 count = 1000;
+		writeSnapshot(count, 7);
+
+		LLObjectCacheFile file;
+		ensure("open", file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1));
+		ensure_equals("count", file.getCount(), count);
+		ensure("no log", !file.needsCompaction());
+		for (S32 i = 0; i < count; ++i)
+		{
+			U32 id = makeID(i);
+			S32 position = file.find(id);
+			ensure_equals("position", position, i);
+			const LLObjectCacheFile::Record* record = file.getRecord(position);
+			ensure("record", record != NULL);
+			ensure_equals("id", record->mID, id);
+			ensure_equals("hits", record->mHitCount, i);
+			ensure("data", checkData(id, 7, record->getData(), record->mSize));
+		}
+		ensure_equals("missing", file.find(makeID(count)), -1);
+		file.close();
+
+		LLUUID other_id;
+		other_id.generate();
+		ensure("other region", !file.open(TEST_FILE_NAME, TEST_LOG_NAME, other_id, 1));
+		ensure("other version", !file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 2));
+		ensure_equals("nothing mapped", file.getCount(), 0);
+	}
+
+	template<> template<>
+	void objectcachefile_object::test<2>()
+	{
+		// the log replays in order, survives a torn tail and keeps appending
+		std::vector<U8> data;
+		{
+			LLObjectCacheFile file;
+			ensure("no snapshot", !file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1));
+			for (U32 id = 1; id <= 10; ++id)
+			{
+				makeData(id, 3, data);
+				file.appendLog(id, 3, &data[0], (S32)data.size());
+			}
+			file.appendLog(4, 0, NULL, 0);
+			ensure("compact without a snapshot", file.needsCompaction());
+		}
+		{
+			// as if we crashed halfway through a record
+			LLFILE* fp = LLFile::fopen(TEST_LOG_NAME, "ab");
+			ensure("log reopened", fp != NULL);
+			U8 junk[9] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+			ensure("junk written", fwrite(junk, 1, sizeof(junk), fp) == sizeof(junk));
+			fclose(fp);
+		}
+		{
+			LLObjectCacheFile file;
+			file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1);
+			U32 id;
+			U32 crc;
+			for (U32 i = 1; i <= 10; ++i)
+			{
+				ensure("read", file.readLog(id, crc, data));
+				ensure_equals("id", id, i);
+				ensure("data", checkData(id, crc, &data[0], (S32)data.size()));
+			}
+			ensure("removal", file.readLog(id, crc, data));
+			ensure_equals("removed id", id, 4U);
+			ensure("removal is empty", data.empty());
+			ensure("torn record dropped", !file.readLog(id, crc, data));
+			ensure_equals("log count", file.getLogCount(), 11);
+
+			makeData(11, 5, data);
+			file.appendLog(11, 5, &data[0], (S32)data.size());
+		}
+		{
+			LLObjectCacheFile file;
+			file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1);
+			U32 id = 0;
+			U32 crc;
+			S32 read = 0;
+			while (file.readLog(id, crc, data))
+			{
+				++read;
+			}
+			ensure_equals("appended after good records", read, 12);
+			ensure_equals("last id", id, 11U);
+		}
+		{
+			LLUUID other_id;
+			other_id.generate();
+			LLObjectCacheFile file;
+			file.open(TEST_FILE_NAME, TEST_LOG_NAME, other_id, 1);
+			U32 id;
+			U32 crc;
+			ensure("other region's log ignored", !file.readLog(id, crc, data));
+		}
+	}
+
+	template<> template<>
+	void objectcachefile_object::test<3>()
+	{
+		// compaction replaces the snapshot and retires the log
+		const S32 count = 100;
+		writeSnapshot(count, 1);
+		std::vector<U8> data;
+		{
+			LLObjectCacheFile file;
+			file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1);
+			makeData(makeID(0), 2, data);
+			file.appendLog(makeID(0), 2, &data[0], (S32)data.size());
+			ensure("small log waits", !file.needsCompaction());
+		}
+		LLFile::rename(TEST_LOG_NAME, TEST_LEGACY_NAME);
+		{
+			LLObjectCacheFile file;
+			file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1);
+			ensure("start", file.startSnapshot());
+			// newest last, with record 0 replaced
+			for (S32 i = 1; i < count; ++i)
+			{
+				const LLObjectCacheFile::Record* record = file.getRecord(i);
+				file.addToSnapshot(record->mID, record->mCRC, record->mHitCount, record->mDupeCount,
+								   record->mCRCChangeCount, record->getData(), record->mSize);
+			}
+			file.addToSnapshot(makeID(0), 2, 0, 0, 1, &data[0], (S32)data.size());
+			ensure("finish", file.finishSnapshot());
+		}
+		// the old snapshot's log must not apply to the new one
+		LLFile::rename(TEST_LEGACY_NAME, TEST_LOG_NAME);
+		LLObjectCacheFile file;
+		ensure("open", file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1));
+		U32 id;
+		U32 crc;
+		ensure("stale log ignored", !file.readLog(id, crc, data));
+		ensure_equals("count", file.getCount(), count);
+		S32 position = file.find(makeID(0));
+		ensure_equals("replaced record is newest", position, count - 1);
+		const LLObjectCacheFile::Record* record = file.getRecord(position);
+		ensure_equals("crc", record->mCRC, 2U);
+		ensure("data", checkData(record->mID, 2, record->getData(), record->mSize));
+		ensure_equals("moved down", file.find(makeID(1)), 0);
+	}
+
+	template<> template<>
+	void objectcachefile_object::test<4>()
+	{
+		// region cache load time against the old read-everything format
+		static const S32 counts[] = { 1000, 5000, 10000, 15000 };
+		for (S32 c = 0; c < (S32)(sizeof(counts) / sizeof(counts[0])); ++c)
+		{
+			const S32 count = counts[c];
+			writeSnapshot(count, 9);
+
+			// what LLViewerRegion used to write
+			LLFILE* fp = LLFile::fopen(TEST_LEGACY_NAME, "wb");
+			ensure("legacy create", fp != NULL);
+			U32 header[2] = { 0, 14 };
+			ensure("legacy header write",
+				fwrite(header, sizeof(U32), 2, fp) == 2
+				&& fwrite(&mCacheID.mData, 1, UUID_BYTES, fp) == UUID_BYTES
+				&& fwrite(&count, sizeof(S32), 1, fp) == 1);
+			std::vector<U8> data;
+			for (S32 i = 0; i < count; ++i)
+			{
+				U32 id = makeID(i);
+				makeData(id, 9, data);
+				S32 fields[6] = { (S32)id, 9, 0, 0, 0, (S32)data.size() };
+				ensure("legacy record write",
+					fwrite(fields, sizeof(S32), 6, fp) == 6
+					&& fwrite(&data[0], 1, data.size(), fp) == data.size());
+			}
+			fclose(fp);
+
+			LLTimer timer;
+			fp = LLFile::fopen(TEST_LEGACY_NAME, "rb");
+			ensure("legacy open", fp != NULL);
+			LLUUID cache_id;
+			S32 legacy_count = 0;
+			ensure("legacy header read",
+				fread(header, sizeof(U32), 2, fp) == 2
+				&& fread(&cache_id.mData, 1, UUID_BYTES, fp) == UUID_BYTES
+				&& fread(&legacy_count, sizeof(S32), 1, fp) == 1);
+			ensure_equals("legacy count", legacy_count, count);
+			std::map<U32, U8*> legacy_map;
+			for (S32 i = 0; i < legacy_count; ++i)
+			{
+				S32 fields[6];
+				ensure("legacy record read", fread(fields, sizeof(S32), 6, fp) == 6);
+				U8* buffer = new U8[fields[5]];
+				legacy_map[(U32)fields[0]] = buffer;
+				ensure("legacy data read", fread(buffer, 1, fields[5], fp) == (size_t)fields[5]);
+			}
+			fclose(fp);
+			F32 legacy_load = timer.getElapsedTimeF32();
+
+			timer.reset();
+			LLObjectCacheFile file;
+			ensure("open", file.open(TEST_FILE_NAME, TEST_LOG_NAME, mCacheID, 1));
+			F32 open_time = timer.getElapsedTimeF32();
+
+			// a visit typically touches every cached object once
+			timer.reset();
+			U32 sum = 0;
+			for (S32 i = 0; i < count; ++i)
+			{
+				const LLObjectCacheFile::Record* record = file.getRecord(file.find(makeID(i)));
+				sum += record ? record->getData()[0] : 0;
+			}
+			F32 lookup_time = timer.getElapsedTimeF32();
+
+			U32 legacy_sum = 0;
+			for (std::map<U32, U8*>::iterator iter = legacy_map.begin(); iter != legacy_map.end(); ++iter)
+			{
+				legacy_sum += iter->second[0];
+				delete[] iter->second;
+			}
+			ensure_equals("same data", sum, legacy_sum);
+
+			llinfos << "Object cache, " << count << " objects: open " << open_time * 1000.f
+					<< " ms, lookups " << lookup_time * 1000.f << " ms (old format load "
+					<< legacy_load * 1000.f << " ms)" << llendl;
+		}
+	}
+}
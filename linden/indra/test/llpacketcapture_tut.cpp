@@ -0,0 +1,152 @@
+/** 
+ * @file llpacketcapture_tut.cpp
+ * @brief LLPacketCapture and LLPacketRing replay unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "llpacketcapture.h"
+#include "llpacketring.h"
+
+#define TEST_FILE_NAME	"packetcapture_test.dat"
+
+namespace tut
+{
+	struct packetcapture_data
+	{
+		~packetcapture_data()
+		{
+			LLFile::remove(TEST_FILE_NAME);
+		}
+	};
+	typedef test_group<packetcapture_data> packetcapture_test;
+	typedef packetcapture_test::object packetcapture_object;
+	tut::packetcapture_test tpc("packetcapture");
+
+	template<> template<>
+	void packetcapture_object::test<1>()
+	{
+		// records round trip with sender and payload intact
+		LLHost host_a("127.0.0.1", 13000);
+		LLHost host_b("10.1.2.3", 12035);
+		char small[3] = { 0x40, 0x00, 0x01 };
+		char large[NET_BUFFER_SIZE];
+		for (S32 i = 0; i < NET_BUFFER_SIZE; ++i)
+		{
+			large[i] = (char)(i * 7);
+		}
+
+		LLPacketCapture writer;
+		ensure("open for write", writer.openForWrite(TEST_FILE_NAME));
+		ensure("write small", writer.writePacket(host_a, small, sizeof(small)));
+		ensure("write large", writer.writePacket(host_b, large, NET_BUFFER_SIZE));
+		ensure("reject empty", !writer.writePacket(host_a, small, 0));
+		ensure_equals("written count", writer.getPacketCount(), 2);
+		writer.close();
+
+		LLPacketCapture reader;
+		ensure("open for read", reader.openForRead(TEST_FILE_NAME));
+		char buffer[NET_BUFFER_SIZE];
+		LLHost sender;
+		ensure_equals("small size", reader.readPacket(sender, buffer), (S32)sizeof(small));
+		ensure("small sender", sender == host_a);
+		ensure("small data", !memcmp(buffer, small, sizeof(small)));
+		ensure_equals("large size", reader.readPacket(sender, buffer), NET_BUFFER_SIZE);
+		ensure("large sender", sender == host_b);
+		ensure("large data", !memcmp(buffer, large, NET_BUFFER_SIZE));
+		ensure_equals("end of file", reader.readPacket(sender, buffer), 0);
+	}
+
+	template<> template<>
+	void packetcapture_object::test<2>()
+	{
+		// files without the magic and truncated records are rejected
+		LLFILE* fp = LLFile::fopen(TEST_FILE_NAME, "wb");
+		fputs("not a capture", fp);
+		fclose(fp);
+		LLPacketCapture reader;
+		ensure("bad magic", !reader.openForRead(TEST_FILE_NAME));
+
+		LLPacketCapture writer;
+		char data[16] = { 0 };
+		writer.openForWrite(TEST_FILE_NAME);
+		writer.writePacket(LLHost("127.0.0.1", 13000), data, sizeof(data));
+		writer.close();
+
+		// chop the last byte off the payload
+		fp = LLFile::fopen(TEST_FILE_NAME, "rb");
+		char contents[64];
+		size_t length = fread(contents, 1, sizeof(contents), fp);
+		fclose(fp);
+		fp = LLFile::fopen(TEST_FILE_NAME, "wb");
+		fwrite(contents, 1, length - 1, fp);
+		fclose(fp);
+
+		ensure("open truncated", reader.openForRead(TEST_FILE_NAME));
+		LLHost sender;
+		ensure_equals("truncated record", reader.readPacket(sender, contents), -1);
+	}
+
+	template<> template<>
+	void packetcapture_object::test<3>()
+	{
+		// in replay mode the ring hands out injected packets in order,
+		// never touches the socket, and records them if capturing
+		LLPacketRing ring;
+		ring.setReplayMode(TRUE);
+		ensure("capture", ring.startCapture(TEST_FILE_NAME));
+
+		LLHost host("127.0.0.1", 13000);
+		char first[4] = { 1, 2, 3, 4 };
+		char second[2] = { 5, 6 };
+		ring.injectPacket(host, first, sizeof(first));
+		ring.injectPacket(host, second, sizeof(second));
+		ensure_equals("queued", ring.getReplayQueueSize(), 2);
+
+		char buffer[NET_BUFFER_SIZE];
+		ensure_equals("first size", ring.receivePacket(-1, buffer), (S32)sizeof(first));
+		ensure("first data", !memcmp(buffer, first, sizeof(first)));
+		ensure("first sender", ring.getLastSender() == host);
+		ensure_equals("second size", ring.receivePacket(-1, buffer), (S32)sizeof(second));
+		ensure_equals("drained", ring.receivePacket(-1, buffer), 0);
+
+		ensure("send swallowed", ring.sendPacket(-1, first, sizeof(first), host));
+		ensure_equals("send counted", ring.getAndResetActualOutBits(), (S32)sizeof(first) * 8);
+		ring.stopCapture();
+
+		LLPacketCapture reader;
+		ensure("open capture", reader.openForRead(TEST_FILE_NAME));
+		LLHost sender;
+		ensure_equals("captured first", reader.readPacket(sender, buffer), (S32)sizeof(first));
+		ensure_equals("captured second", reader.readPacket(sender, buffer), (S32)sizeof(second));
+		ensure_equals("captured end", reader.readPacket(sender, buffer), 0);
+	}
+}
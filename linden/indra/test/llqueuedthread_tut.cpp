@@ -0,0 +1,426 @@
+/** 
+ * @file llqueuedthread_tut.cpp
+ * @brief LLQueuedThread unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "llqueuedthread.h"
+#include "llrand.h"
+#include "lltimer.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace tut
+{
+	struct queuedthread_data
+	{
+		// Records the order requests complete in; optionally asks to be
+		// run again a few times first, like a texture fetch waiting on data.
+		class TestRequest : public LLQueuedThread::QueuedRequest
+		{
+		public:
+			TestRequest(LLQueuedThread::handle_t handle, U32 priority, S32 retries,
+						std::vector<LLQueuedThread::handle_t>* order, LLAtomic32<S32>* done)
+			:	LLQueuedThread::QueuedRequest(handle, priority, LLQueuedThread::FLAG_AUTO_COMPLETE),
+				mRetries(retries),
+				mOrder(order),
+				mDone(done)
+			{
+			}
+
+			/*virtual*/ bool processRequest()
+			{
+				if (mRetries-- > 0)
+				{
+					return false;
+				}
+				if (mOrder)
+				{
+					mOrder->push_back(getHashKey());
+				}
+				(*mDone)++;
+				return true;
+			}
+
+		private:
+			S32 mRetries;
+			std::vector<LLQueuedThread::handle_t>* mOrder;
+			LLAtomic32<S32>* mDone;
+		};
+
+		class TestThread : public LLQueuedThread
+		{
+		public:
+			TestThread(bool threaded) : LLQueuedThread("queuedthread test", threaded) {}
+
+			handle_t add(U32 priority, S32 retries, std::vector<handle_t>* order, LLAtomic32<S32>* done)
+			{
+				handle_t handle = generateHandle();
+				addRequest(new TestRequest(handle, priority, retries, order, done));
+				return handle;
+			}
+			handle_t newHandle() { return generateHandle(); }
+		};
+
+		// Never finishes until told to, so the queue stays full while
+		// priorities are being changed.
+		class SpinRequest : public LLQueuedThread::QueuedRequest
+		{
+		public:
+			SpinRequest(LLQueuedThread::handle_t handle, U32 priority, LLAtomic32<S32>* stop)
+			:	LLQueuedThread::QueuedRequest(handle, priority, LLQueuedThread::FLAG_AUTO_COMPLETE),
+				mStop(stop)
+			{
+			}
+			/*virtual*/ bool processRequest()
+			{
+				spin();
+				return *mStop != 0;
+			}
+			static void spin()
+			{
+				volatile S32 x = 0;
+				for (S32 i = 0; i < 200; ++i)
+				{
+					x += i;
+				}
+			}
+		private:
+			LLAtomic32<S32>* mStop;
+		};
+
+		class SpinThread : public LLQueuedThread
+		{
+		public:
+			SpinThread() : LLQueuedThread("queuedthread spin", true) {}
+			handle_t add(U32 priority, LLAtomic32<S32>* stop)
+			{
+				handle_t handle = generateHandle();
+				addRequest(new SpinRequest(handle, priority, stop));
+				return handle;
+			}
+		};
+
+		// The queue as it was before the inbox: a std::set under a mutex,
+		// reprioritized by erase and reinsert.  Kept here as the baseline
+		// for the contention benchmark.
+		struct SetRequest
+		{
+			U32 mPriority;
+			U32 mHandle;
+		};
+		struct set_request_less
+		{
+			bool operator()(const SetRequest* lhs, const SetRequest* rhs) const
+			{
+				if (lhs->mPriority == rhs->mPriority)
+					return lhs->mHandle < rhs->mHandle;
+				else
+					return lhs->mPriority > rhs->mPriority;
+			}
+		};
+		class SetQueueThread : public LLThread
+		{
+		public:
+			SetQueueThread() : LLThread("queuedthread set baseline"), mMutex(NULL) {}
+
+			void add(SetRequest* req)
+			{
+				LLMutexLock lock(&mMutex);
+				mQueue.insert(req);
+				mHash[req->mHandle] = req;
+			}
+			void setPriority(U32 handle, U32 priority)
+			{
+				LLMutexLock lock(&mMutex);
+				std::map<U32, SetRequest*>::iterator iter = mHash.find(handle);
+				if (iter != mHash.end())
+				{
+					SetRequest* req = iter->second;
+					if (mQueue.erase(req))
+					{
+						req->mPriority = priority;
+						mQueue.insert(req);
+					}
+					else
+					{
+						req->mPriority = priority;
+					}
+				}
+			}
+			/*virtual*/ void run()
+			{
+				while (!isQuitting())
+				{
+					SetRequest* req = NULL;
+					mMutex.lock();
+					if (!mQueue.empty())
+					{
+						req = *mQueue.begin();
+						mQueue.erase(mQueue.begin());
+					}
+					mMutex.unlock();
+					if (req)
+					{
+						SpinRequest::spin();
+						add(req);
+					}
+				}
+			}
+
+		private:
+			LLMutex mMutex;
+			std::set<SetRequest*, set_request_less> mQueue;
+			std::map<U32, SetRequest*> mHash;
+		};
+
+		static U32 scramble(U32 i)
+		{
+			return (i * 7919) % 1000;
+		}
+	};
+	typedef test_group<queuedthread_data> queuedthread_test;
+	typedef queuedthread_test::object queuedthread_object;
+	tut::queuedthread_test tqt("queuedthread");
+
+	template<> template<>
+	void queuedthread_object::test<1>()
+	{
+		// reprioritized requests are processed in their new order
+		TestThread thread(false);
+		std::vector<LLQueuedThread::handle_t> order;
+		LLAtomic32<S32> done(0);
+		std::vector<LLQueuedThread::handle_t> handles;
+		for (S32 i = 0; i < 100; ++i)
+		{
+			handles.push_back(thread.add(LLQueuedThread::PRIORITY_NORMAL + i, 0, &order, &done));
+		}
+		for (S32 i = 0; i < 100; i += 2)
+		{
+			thread.setPriority(handles[i], LLQueuedThread::PRIORITY_HIGH + i);
+		}
+		ensure_equals("pending", thread.getPending(), 100);
+
+		thread.update(0);
+		ensure_equals("all processed", (S32)order.size(), 100);
+		for (S32 i = 0; i < 50; ++i)
+		{
+			ensure_equals("raised first", order[i], handles[98 - 2 * i]);
+			ensure_equals("then the rest", order[50 + i], handles[99 - 2 * i]);
+		}
+		ensure_equals("none pending", thread.getPending(), 0);
+	}
+
+	template<> template<>
+	void queuedthread_object::test<2>()
+	{
+		// a batch queues its requests and applies its priority changes
+		TestThread thread(false);
+		std::vector<LLQueuedThread::handle_t> order;
+		LLAtomic32<S32> done(0);
+		std::map<LLQueuedThread::handle_t, U32> keys;
+		LLQueuedThread::RequestBatch batch;
+		for (U32 i = 0; i < 1000; ++i)
+		{
+			LLQueuedThread::handle_t handle = thread.newHandle();
+			batch.addRequest(new TestRequest(handle, LLQueuedThread::PRIORITY_LOW, 0, &order, &done));
+			batch.setPriority(handle, LLQueuedThread::PRIORITY_LOW + scramble(i));
+			keys[handle] = scramble(i);
+		}
+		ensure("submitted", thread.submitBatch(batch));
+		ensure("batch emptied", batch.empty());
+		ensure_equals("pending", thread.getPending(), 1000);
+
+		thread.update(0);
+		ensure_equals("all processed", (S32)order.size(), 1000);
+		for (S32 i = 1; i < 1000; ++i)
+		{
+			ensure("descending priority", keys[order[i - 1]] > keys[order[i]]);
+		}
+	}
+
+	template<> template<>
+	void queuedthread_object::test<3>()
+	{
+		// aborted requests are dropped when they reach the front, and a
+		// lowered request keeps its new priority when it is queued again
+		TestThread thread(false);
+		std::vector<LLQueuedThread::handle_t> order;
+		LLAtomic32<S32> done(0);
+		LLQueuedThread::handle_t aborted = thread.add(LLQueuedThread::PRIORITY_HIGH, 0, &order, &done);
+		LLQueuedThread::handle_t retried = thread.add(LLQueuedThread::PRIORITY_NORMAL, 1, &order, &done);
+		LLQueuedThread::handle_t normal = thread.add(LLQueuedThread::PRIORITY_NORMAL, 0, &order, &done);
+		thread.abortRequest(aborted, true);
+		thread.setPriority(retried, LLQueuedThread::PRIORITY_NORMAL - 1);
+
+		thread.update(0);
+		ensure_equals("two processed", (S32)order.size(), 2);
+		ensure_equals("normal first", order[0], normal);
+		ensure_equals("retried last", order[1], retried);
+		ensure_equals("aborted removed", thread.getRequestStatus(aborted), LLQueuedThread::STATUS_EXPIRED);
+	}
+
+	template<> template<>
+	void queuedthread_object::test<4>()
+	{
+		// a worker thread keeps up with requests and priority changes
+		// arriving while it runs
+		TestThread thread(true);
+		LLAtomic32<S32> done(0);
+		const S32 COUNT = 5000;
+		std::vector<LLQueuedThread::handle_t> handles;
+		for (S32 i = 0; i < COUNT; ++i)
+		{
+			handles.push_back(thread.add(LLQueuedThread::PRIORITY_NORMAL + i % 1000, i % 3, NULL, &done));
+			thread.setPriority(handles[ll_rand(handles.size())], LLQueuedThread::PRIORITY_NORMAL + ll_rand(100000));
+		}
+
+		LLTimer timer;
+		while (done < COUNT && timer.getElapsedTimeF32() < 30.f)
+		{
+			thread.update(0);
+			ms_sleep(1);
+		}
+		ensure_equals("all processed", (S32)done, COUNT);
+		ensure_equals("none pending", thread.getPending(), 0);
+	}
+
+	template<> template<>
+	void queuedthread_object::test<5>()
+	{
+		// contention benchmark: the main thread reprioritizes every request
+		// each frame while a worker keeps processing them
+		const S32 REQUESTS = 4000;
+		const S32 FRAMES = 25;
+		std::vector<U32> priorities(REQUESTS * FRAMES);
+		for (S32 i = 0; i < REQUESTS * FRAMES; ++i)
+		{
+			priorities[i] = LLQueuedThread::PRIORITY_NORMAL + ll_rand(100000);
+		}
+
+		F64 set_time;
+		{
+			std::vector<SetRequest> requests(REQUESTS);
+			SetQueueThread thread;
+			for (S32 i = 0; i < REQUESTS; ++i)
+			{
+				requests[i].mHandle = i + 1;
+				requests[i].mPriority = priorities[i];
+				thread.add(&requests[i]);
+			}
+			thread.start();
+
+			LLTimer timer;
+			for (S32 frame = 0; frame < FRAMES; ++frame)
+			{
+				for (S32 i = 0; i < REQUESTS; ++i)
+				{
+					thread.setPriority(i + 1, priorities[frame * REQUESTS + i]);
+				}
+			}
+			set_time = timer.getElapsedTimeF64();
+			thread.shutdown();
+		}
+
+		F64 single_time, batch_time;
+		{
+			LLAtomic32<S32> stop(0);
+			SpinThread thread;
+			std::vector<LLQueuedThread::handle_t> handles;
+			for (S32 i = 0; i < REQUESTS; ++i)
+			{
+				handles.push_back(thread.add(priorities[i], &stop));
+			}
+
+			LLTimer timer;
+			for (S32 frame = 0; frame < FRAMES; ++frame)
+			{
+				for (S32 i = 0; i < REQUESTS; ++i)
+				{
+					thread.setPriority(handles[i], priorities[frame * REQUESTS + i]);
+				}
+			}
+			single_time = timer.getElapsedTimeF64();
+
+			timer.reset();
+			LLQueuedThread::RequestBatch batch;
+			for (S32 frame = 0; frame < FRAMES; ++frame)
+			{
+				for (S32 i = 0; i < REQUESTS; ++i)
+				{
+					batch.setPriority(handles[i], priorities[frame * REQUESTS + i]);
+				}
+				thread.submitBatch(batch);
+			}
+			batch_time = timer.getElapsedTimeF64();
+
+			stop = 1;
+			LLTimer drain_timer;
+			while (thread.getPending() && drain_timer.getElapsedTimeF32() < 30.f)
+			{
+				thread.update(0);
+				ms_sleep(1);
+			}
+			ensure_equals("drained", thread.getPending(), 0);
+		}
+
+		llinfos << "Reprioritizing " << REQUESTS << " requests x " << FRAMES << " frames: "
+				<< set_time * 1000.0 << " ms set, "
+				<< single_time * 1000.0 << " ms inbox, "
+				<< batch_time * 1000.0 << " ms batched" << llendl;
+	}
+
+	template<> template<>
+	void queuedthread_object::test<6>()
+	{
+		// priority changes apply in the order they were made, whether
+		// made directly or through a batch
+		TestThread thread(false);
+		std::vector<LLQueuedThread::handle_t> order;
+		LLAtomic32<S32> done(0);
+		LLQueuedThread::handle_t first = thread.add(LLQueuedThread::PRIORITY_NORMAL, 0, &order, &done);
+		LLQueuedThread::handle_t second = thread.add(LLQueuedThread::PRIORITY_NORMAL + 1, 0, &order, &done);
+		thread.setPriority(first, LLQueuedThread::PRIORITY_HIGH);
+		LLQueuedThread::RequestBatch batch;
+		batch.setPriority(first, LLQueuedThread::PRIORITY_LOW);
+		thread.submitBatch(batch);
+		LLQueuedThread::RequestBatch unsubmitted;
+		unsubmitted.setPriority(second, LLQueuedThread::PRIORITY_LOW);
+
+		thread.update(0);
+		ensure_equals("both processed", (S32)order.size(), 2);
+		ensure_equals("later batch wins", order[0], second);
+		ensure_equals("lowered last", order[1], first);
+	}
+}
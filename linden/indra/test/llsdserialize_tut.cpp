@@ -42,6 +42,7 @@
 #include "llsdserialize.h"
 #include "lltut.h"
 #include "llformat.h"
+#include "lltimer.h"
 
 // These tests take too long to run on Windows. JC
 // Yeah, who cares if windows works or not, right? Phoenix
@@ -1234,12 +1235,125 @@ namespace tut
 			1);
 	}
 
-/*
+	LLSD makeInventoryPayload(S32 count)
+	{
+		// shaped like a FetchInventoryDescendents response
+		LLSD items = LLSD::emptyArray();
+		for(S32 i = 0; i < count; ++i)
+		{
+			LLUUID id;
+			id.generate();
+			LLSD item;
+			item["item_id"] = id;
+			item["parent_id"] = LLUUID::null;
+			item["asset_id"] = id;
+			item["name"] = llformat("Object %d", i);
+			item["desc"] = "(No Description)";
+			item["type"] = 6;
+			item["inv_type"] = 6;
+			item["flags"] = 0;
+			item["created_at"] = 1234567890 + i;
+			item["sale_info"]["sale_price"] = 10;
+			item["sale_info"]["sale_type"] = "not";
+			item["permissions"]["owner_mask"] = (S32)0x7fffffff;
+			item["permissions"]["next_owner_mask"] = (S32)0x82000;
+			item["permissions"]["is_owner_group"] = false;
+			items.append(item);
+		}
+		LLSD folder;
+		folder["folder_id"] = LLUUID::null;
+		folder["version"] = 42;
+		folder["items"] = items;
+		LLSD body;
+		body["folders"].append(folder);
+		return body;
+	}
+
 	template<> template<> 
 	void TestLLSDBinaryParsingObject::test<11>()
 	{
+		// parsed values are plain copy on write LLSD, and their arena
+		// blocks go away with them
+		LLSD input = makeInventoryPayload(200);
+		std::stringstream stream;
+		LLSDSerialize::toBinary(input, stream);
+
+		S32 blocks = LLSDArena::getBlockCount();
+		LLSD output;
+		{
+			LLPointer<LLSDBinaryParser> parser = new LLSDBinaryParser;
+			parser->parse(stream, output, LLSDSerialize::SIZE_UNLIMITED);
+		}
+		ensure_equals("parsed payload", output, input);
+		ensure("blocks outlive the parser",
+			LLSDArena::getBlockCount() > blocks);
+
+		LLSD copy = output;
+		LLSD& item = copy["folders"][0]["items"][3];
+		item["name"] = "renamed";
+		item["type"] = 7;
+		item["sale_info"]["sale_price"] = 11;
+		item.erase("desc");
+		copy["folders"][0]["items"].append(5);
+		ensure_equals("original untouched", output, input);
+		ensure_equals("copy renamed", copy["folders"][0]["items"][3]["name"].asString(), "renamed");
+		ensure_equals("copy type", copy["folders"][0]["items"][3]["type"].asInteger(), 7);
+
+		LLSD kept = output["folders"][0]["items"][10]["name"];
+		output.clear();
+		ensure_equals("value outlives its document", kept.asString(), "Object 10");
+		copy.clear();
+		kept.clear();
+		ensure_equals("blocks released", LLSDArena::getBlockCount(), blocks);
+	}
+
+	template<> template<> 
+	void TestLLSDBinaryParsingObject::test<12>()
+	{
+		// benchmark against the notation parser, which still allocates
+		// each value on its own
+		const S32 ITEMS = 5000;
+		const S32 PASSES = 4;
+		LLSD input = makeInventoryPayload(ITEMS);
+		std::string binary;
+		std::string notation;
+		{
+			std::stringstream stream;
+			LLSDSerialize::toBinary(input, stream);
+			binary = stream.str();
+			std::stringstream stream2;
+			LLSDSerialize::toNotation(input, stream2);
+			notation = stream2.str();
+		}
+
+		F64 times[2] = { 0.0, 0.0 };
+		U32 allocs[2] = { 0, 0 };
+		for(S32 pass = 0; pass < PASSES; ++pass)
+		{
+			for(S32 format = 0; format < 2; ++format)
+			{
+				std::istringstream stream(format ? notation : binary);
+				LLSD output;
+				U32 before = LLSD::allocationCount();
+				LLTimer timer;
+				if(format)
+				{
+					LLSDSerialize::fromNotation(output, stream, notation.size());
+				}
+				else
+				{
+					LLSDSerialize::fromBinary(output, stream, binary.size());
+				}
+				times[format] += timer.getElapsedTimeF64();
+				allocs[format] = LLSD::allocationCount() - before;
+				ensure_equals("benchmark payload", output, input);
+			}
+		}
+		llinfos << "LLSD parse of " << ITEMS << " inventory items: binary "
+				<< times[0] * 1000.0 / PASSES << " ms, notation "
+				<< times[1] * 1000.0 / PASSES << " ms, " << allocs[0]
+				<< " values" << llendl;
 	}
-*/
 
    /**
 	 * @class TestLLSDCrossCompatible
@@ -1321,6 +1435,38 @@ namespace tut
 				count3);
 			ensure_equals((msg + " (binaryandxml)").c_str(), actual_value_xml, input);
 		}
+		/**
+		 * @brief Reader which only counts inventory items as they arrive.
+		 */
+		class ItemCounter : public LLSDReader
+		{
+		public:
+			ItemCounter() : mItems(0), mFirstItem(0.0), mPeakValues(0) {}
+
+			virtual void beginMap(S32 size) {}
+			virtual void key(const std::string& key)
+			{
+				if("item_id" == key)
+				{
+					if(0 == mItems++)
+					{
+						mFirstItem = mTimer.getElapsedTimeF64();
+					}
+				}
+			}
+			virtual void endMap() {}
+			virtual void beginArray(S32 size) {}
+			virtual void endArray() {}
+			virtual void value(const LLSD& value)
+			{
+				mPeakValues = llmax(mPeakValues, LLSD::outstandingCount());
+			}
+
+			LLTimer mTimer;
+			S32 mItems;
+			F64 mFirstItem;
+			U32 mPeakValues;
+		};
 	};
 
 	typedef tut::test_group<TestLLSDCrossCompatible> TestLLSDCompatibleGroup;
@@ -1439,6 +1585,179 @@ namespace tut
 		ensureBinaryAndNotation("map", test);
 		ensureBinaryAndXML("map", test);
 	}
+	template<> template<> 
+	void TestLLSDCompatibleObject::test<9>()
+	{
+		// reader events rebuild the same tree from every parser
+		LLSD test = makeInventoryPayload(20);
+		test["empty_map"] = LLSD::emptyMap();
+		test["empty_array"] = LLSD::emptyArray();
+		test["nested"][0][0]["undef"] = LLSD();
+		test["nested"][1] = "last";
+
+		std::stringstream xml;
+		S32 count = LLSDSerialize::toXML(test, xml);
+		LLSDTreeReader xml_reader;
+		ensure_equals("xml reader count", LLSDSerialize::fromXML(xml_reader, xml), count);
+		ensure_equals("xml reader", xml_reader.getResult(), test);
+
+		std::stringstream binary;
+		LLSDSerialize::toBinary(test, binary);
+		LLSDTreeReader binary_reader;
+		ensure_equals(
+			"binary reader count",
+			LLSDSerialize::fromBinary(binary_reader, binary, LLSDSerialize::SIZE_UNLIMITED),
+			count);
+		ensure_equals("binary reader", binary_reader.getResult(), test);
+
+		// notation parses a tree and replays it
+		std::stringstream notation;
+		LLSDSerialize::toNotation(test, notation);
+		LLSDTreeReader notation_reader;
+		LLPointer<LLSDNotationParser> parser = new LLSDNotationParser;
+		ensure_equals(
+			"notation reader count",
+			parser->parse(notation, notation_reader, LLSDSerialize::SIZE_UNLIMITED),
+			count);
+		ensure_equals("notation reader", notation_reader.getResult(), test);
+	}
+
+	template<> template<> 
+	void TestLLSDCompatibleObject::test<10>()
+	{
+		// the streaming writer matches the xml formatter byte for byte
+		LLSD test = makeInventoryPayload(3);
+		test["empty_map"] = LLSD::emptyMap();
+		test["empty_array"] = LLSD::emptyArray();
+		test["escaped <&>"] = "a < b & c";
+		test["real"] = 3.14159265358979;
+
+		std::stringstream plain;
+		LLSDSerialize::toXML(test, plain);
+		std::ostringstream plain_writer;
+		{
+			LLSDXMLWriter writer(plain_writer);
+			writer.replay(test);
+		}
+		ensure_equals("plain writer", plain_writer.str(), plain.str());
+
+		std::stringstream pretty;
+		LLSDSerialize::toPrettyXML(test, pretty);
+		std::ostringstream pretty_writer;
+		{
+			LLSDXMLWriter writer(pretty_writer, LLSDFormatter::OPTIONS_PRETTY);
+			writer.replay(test);
+		}
+		ensure_equals("pretty writer", pretty_writer.str(), pretty.str());
+
+		// binary straight to xml without building the tree
+		std::stringstream binary;
+		LLSDSerialize::toBinary(test, binary);
+		std::ostringstream transcoded;
+		{
+			LLSDXMLWriter writer(transcoded);
+			LLSDSerialize::fromBinary(writer, binary, LLSDSerialize::SIZE_UNLIMITED);
+		}
+		ensure_equals("transcoded", transcoded.str(), plain.str());
+
+		std::ostringstream scalar;
+		{
+			LLSDXMLWriter writer(scalar);
+			writer.value(LLSD(42));
+		}
+		ensure_equals("scalar writer", scalar.str(), std::string("<llsd><integer>42</integer></llsd>\n"));
+	}
+
+	template<> template<> 
+	void TestLLSDCompatibleObject::test<11>()
+	{
+		// benchmark streaming against building the tree on a large
+		// inventory fetch
+		const S32 ITEMS = 50000;
+		LLSD input = makeInventoryPayload(ITEMS);
+		std::string xml;
+		std::string binary;
+		{
+			std::stringstream stream;
+			LLSDSerialize::toXML(input, stream);
+			xml = stream.str();
+			std::stringstream stream2;
+			LLSDSerialize::toBinary(input, stream2);
+			binary = stream2.str();
+		}
+		input.clear();
+		U32 baseline = LLSD::outstandingCount();
+
+		for(S32 format = 0; format < 2; ++format)
+		{
+			const char* name = format ? "binary" : "xml";
+			const std::string& data = format ? binary : xml;
+
+			F64 tree_time;
+			U32 tree_peak;
+			{
+				std::istringstream stream(data);
+				LLSD output;
+				LLTimer timer;
+				if(format)
+				{
+					LLSDSerialize::fromBinary(output, stream, data.size());
+				}
+				else
+				{
+					LLSDSerialize::fromXML(output, stream);
+				}
+				tree_time = timer.getElapsedTimeF64();
+				tree_peak = LLSD::outstandingCount() - baseline;
+				ensure_equals("tree items", output["folders"][0]["items"].size(), ITEMS);
+			}
+
+			std::istringstream stream(data);
+			ItemCounter counter;
+			if(format)
+			{
+				LLSDSerialize::fromBinary(counter, stream, data.size());
+			}
+			else
+			{
+				LLSDSerialize::fromXML(counter, stream);
+			}
+			F64 stream_time = counter.mTimer.getElapsedTimeF64();
+			ensure_equals("streamed items", counter.mItems, ITEMS);
+			ensure("streaming holds fewer values", counter.mPeakValues - baseline < tree_peak);
+
+			llinfos << "LLSD " << name << " parse of " << ITEMS
+					<< " inventory items: tree " << tree_time * 1000.0
+					<< " ms, " << tree_peak << " live values; reader "
+					<< stream_time * 1000.0 << " ms, first item after "
+					<< counter.mFirstItem * 1000.0 << " ms, "
+					<< counter.mPeakValues - baseline << " live values" << llendl;
+		}
+
+		// and the same payload written back out
+		LLSD output;
+		{
+			std::istringstream stream(binary);
+			LLSDSerialize::fromBinary(output, stream, binary.size());
+		}
+		std::ostringstream formatted;
+		LLTimer format_timer;
+		LLSDSerialize::toXML(output, formatted);
+		F64 format_time = format_timer.getElapsedTimeF64();
+
+		std::istringstream stream(binary);
+		std::ostringstream written;
+		LLTimer write_timer;
+		{
+			LLSDXMLWriter writer(written);
+			LLSDSerialize::fromBinary(writer, stream, binary.size());
+		}
+		F64 write_time = write_timer.getElapsedTimeF64();
+		ensure("written xml", written.str() == formatted.str());
+		llinfos << "LLSD xml write of " << ITEMS << " inventory items: formatter "
+				<< format_time * 1000.0 << " ms from a parsed tree, writer "
+				<< write_time * 1000.0 << " ms straight from binary" << llendl;
+	}
 }
 
 #endif
@@ -0,0 +1,286 @@
+/** 
+ * @file llskinning_tut.cpp
+ * @brief LLSkinning unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <vector>
+
+#include "llskinning.h"
+#include "lljobpool.h"
+#include "llquaternion.h"
+#include "llsys.h"
+#include "lltimer.h"
+#include "m4math.h"
+#include "v3math.h"
+#include "v4math.h"
+
+namespace tut
+{
+	struct skinning_data
+	{
+		enum { NUM_JOINTS = 20 };
+
+		struct Mesh
+		{
+			// vertices sorted by joint, in runs sharing a weight, like the
+			// avatar meshes
+			Mesh(U32 num_vertices) :
+				mWeights(num_vertices), mCoords(num_vertices), mNormals(num_vertices),
+				mOutCoords(num_vertices), mOutNormals(num_vertices)
+			{
+				U32 index = 0;
+				while (index < num_vertices)
+				{
+					S32 joint = (index * (NUM_JOINTS - 1)) / num_vertices;
+					F32 weight = joint + (randU32() % 4) * 0.25f;
+					U32 run = 1 + randU32() % 8;
+					for ( ; run && index < num_vertices; --run, ++index)
+					{
+						mWeights[index] = weight;
+						mCoords[index] = randVec();
+						mNormals[index] = randVec();
+						mNormals[index].normVec();
+					}
+				}
+			}
+
+			void skin(LLSkinning::skin_func_t skin_func, const LLMatrix4* joint_mats)
+			{
+				skin_func(joint_mats, &mWeights[0], &mCoords[0], &mNormals[0], mCoords.size(),
+						  &mOutCoords[0], &mOutNormals[0], sizeof(LLVector3));
+			}
+
+			std::vector<F32> mWeights;
+			std::vector<LLVector3> mCoords;
+			std::vector<LLVector3> mNormals;
+			std::vector<LLVector3> mOutCoords;
+			std::vector<LLVector3> mOutNormals;
+		};
+
+		struct Job
+		{
+			std::vector<Mesh*>* mMeshes;
+			LLSkinning::skin_func_t mSkinFunc;
+			const LLMatrix4* mJointMats;
+		};
+
+		skinning_data()
+		{
+			for (S32 i = 0; i < NUM_JOINTS; ++i)
+			{
+				LLQuaternion rot(randF32() * F_PI, randVec());
+				LLVector3 skin_offset = randVec();
+				LLMatrix4 world(rot, LLVector4(randVec() * 2.f, 1.f));
+				LLSkinning::makeJointMatrix(world, skin_offset, mJointMats[i]);
+			}
+		}
+
+		static void skinJob(S32 index, void* userdata)
+		{
+			Job* job = (Job*)userdata;
+			(*job->mMeshes)[index]->skin(job->mSkinFunc, job->mJointMats);
+		}
+
+		static void ensureClose(const std::string& msg, const LLVector3& actual, const LLVector3& expected)
+		{
+			for (S32 c = 0; c < 3; ++c)
+			{
+				ensure(msg, fabs(actual.mV[c] - expected.mV[c]) <= 1.e-5f);
+			}
+		}
+
+		// deterministic, so a failure can be reproduced
+		static U32 randU32()
+		{
+			static U32 seed = 12345;
+			seed = seed * 1664525 + 1013904223;
+			return seed >> 8;
+		}
+		static F32 randF32() { return (F32)(randU32() & 0xffff) / 65535.f; }
+		static LLVector3 randVec() { return LLVector3(randF32() - 0.5f, randF32() - 0.5f, randF32() - 0.5f); }
+
+		LLMatrix4 mJointMats[NUM_JOINTS];
+	};
+	typedef test_group<skinning_data> skinning_test;
+	typedef skinning_test::object skinning_object;
+	tut::skinning_test skinning_testcase("skinning");
+
+	template<> template<>
+	void skinning_object::test<1>()
+	{
+		// every kernel gives the same vertices as the plain C++ one,
+		// including the odd one out at the end
+		Mesh reference(1001);
+		reference.skin(&LLSkinning::skinOriginal, mJointMats);
+
+		// the blended matrix of a vertex with a whole weight is its joint's
+		const LLMatrix4& mat = mJointMats[(S32)reference.mWeights[0]];
+		if (reference.mWeights[0] == llfloor(reference.mWeights[0]))
+		{
+			ensureClose("unblended", reference.mOutCoords[0], reference.mCoords[0] * mat);
+		}
+
+		for (S32 kernel = LLSkinning::KERNEL_VECTORIZED; kernel < LLSkinning::KERNEL_COUNT; ++kernel)
+		{
+			Mesh mesh = reference;
+			mesh.mOutCoords.assign(mesh.mOutCoords.size(), LLVector3::zero);
+			mesh.mOutNormals.assign(mesh.mOutNormals.size(), LLVector3::zero);
+			mesh.skin(LLSkinning::getKernel((LLSkinning::EKernel)kernel), mJointMats);
+
+			std::string name = LLSkinning::getKernelName((LLSkinning::EKernel)kernel);
+			for (U32 i = 0; i < mesh.mCoords.size(); ++i)
+			{
+				ensureClose(name + " coord", mesh.mOutCoords[i], reference.mOutCoords[i]);
+				ensureClose(name + " normal", mesh.mOutNormals[i], reference.mOutNormals[i]);
+			}
+		}
+	}
+
+	template<> template<>
+	void skinning_object::test<2>()
+	{
+		// strided output lands in an interleaved buffer without touching
+		// the rest of each vertex
+		const U32 NUM_VERTICES = 37;
+		const U32 STRIDE = 8 * sizeof(F32);
+		const F32 UNTOUCHED = -7.f;
+		Mesh mesh(NUM_VERTICES);
+		mesh.skin(&LLSkinning::skinOriginal, mJointMats);
+
+		for (S32 kernel = LLSkinning::KERNEL_ORIGINAL; kernel < LLSkinning::KERNEL_COUNT; ++kernel)
+		{
+			std::vector<F32> buffer(NUM_VERTICES * 8, UNTOUCHED);
+			LLSkinning::getKernel((LLSkinning::EKernel)kernel)(mJointMats, &mesh.mWeights[0], &mesh.mCoords[0],
+															   &mesh.mNormals[0], NUM_VERTICES,
+															   (LLVector3*)&buffer[0], (LLVector3*)&buffer[4], STRIDE);
+
+			std::string name = LLSkinning::getKernelName((LLSkinning::EKernel)kernel);
+			for (U32 i = 0; i < NUM_VERTICES; ++i)
+			{
+				const F32* vertex = &buffer[i * 8];
+				ensureClose(name + " coord", LLVector3(vertex), mesh.mOutCoords[i]);
+				ensureClose(name + " normal", LLVector3(vertex + 4), mesh.mOutNormals[i]);
+				ensure(name + " coord padding", vertex[3] == UNTOUCHED);
+				ensure(name + " normal padding", vertex[7] == UNTOUCHED);
+			}
+		}
+	}
+
+	template<> template<>
+	void skinning_object::test<3>()
+	{
+		// the chosen kernel matches what the processor has
+		LLCPUInfo cpu;
+		LLSkinning::EKernel best = LLSkinning::getBestKernel(cpu);
+		if (cpu.hasAVX2())
+		{
+			ensure_equals("AVX2", best, LLSkinning::KERNEL_AVX2);
+		}
+		else if (cpu.hasSSE2())
+		{
+			ensure_equals("SSE2", best, LLSkinning::KERNEL_SSE2);
+		}
+		else if (cpu.hasSSE())
+		{
+			ensure_equals("SSE", best, LLSkinning::KERNEL_SSE);
+		}
+		ensure("out of range", LLSkinning::getKernel(LLSkinning::KERNEL_COUNT) == &LLSkinning::skinOriginal);
+		ensure_equals("name", std::string(LLSkinning::getKernelName(LLSkinning::KERNEL_AVX2)), std::string("AVX2"));
+	}
+
+	template<> template<>
+	void skinning_object::test<4>()
+	{
+		// Skinning throughput for a crowd of base avatars (lower and
+		// upper body, head, hair, skirt and eyelashes at their highest
+		// LODs), on one thread and spread over a job pool, one mesh per
+		// job the way LLVOAvatar::updateQueuedSkinning() does it.
+		const U32 NUM_MESHES = 6;
+		const U32 MESH_VERTICES[NUM_MESHES] = { 2200, 1800, 1600, 1000, 900, 150 };
+		const S32 NUM_AVATARS = 20;
+		const S32 NUM_FRAMES = 10;
+		const S32 NUM_THREADS = 4;
+
+		std::vector<Mesh*> meshes;
+		U32 num_vertices = 0;
+		for (S32 avatar = 0; avatar < NUM_AVATARS; ++avatar)
+		{
+			for (U32 m = 0; m < NUM_MESHES; ++m)
+			{
+				meshes.push_back(new Mesh(MESH_VERTICES[m]));
+				num_vertices += MESH_VERTICES[m];
+			}
+		}
+
+		LLJobPool pool("Skinning test", NUM_THREADS);
+		LLTimer timer;
+		for (S32 kernel = LLSkinning::KERNEL_ORIGINAL; kernel < LLSkinning::KERNEL_COUNT; ++kernel)
+		{
+			Job job;
+			job.mMeshes = &meshes;
+			job.mSkinFunc = LLSkinning::getKernel((LLSkinning::EKernel)kernel);
+			job.mJointMats = mJointMats;
+
+			timer.reset();
+			for (S32 frame = 0; frame < NUM_FRAMES; ++frame)
+			{
+				for (U32 i = 0; i < meshes.size(); ++i)
+				{
+					skinJob(i, &job);
+				}
+			}
+			F64 serial = timer.getElapsedTimeF64();
+			std::vector<LLVector3> serial_coords = meshes.back()->mOutCoords;
+
+			timer.reset();
+			for (S32 frame = 0; frame < NUM_FRAMES; ++frame)
+			{
+				pool.run((S32)meshes.size(), skinJob, &job);
+			}
+			F64 pooled = timer.getElapsedTimeF64();
+
+			ensure("pooled", meshes.back()->mOutCoords == serial_coords);
+
+			F64 skinned = (F64)num_vertices * NUM_FRAMES;
+			llinfos << "Skinning " << LLSkinning::getKernelName((LLSkinning::EKernel)kernel) << ": "
+					<< (S32)(skinned / llmax(serial, 1.e-6) / 1000000.0) << "M vertices/sec on one thread, "
+					<< (S32)(skinned / llmax(pooled, 1.e-6) / 1000000.0) << "M vertices/sec on "
+					<< pool.getNumThreads() << " threads" << llendl;
+		}
+
+		for (U32 i = 0; i < meshes.size(); ++i)
+		{
+			delete meshes[i];
+		}
+	}
+}
@@ -124,7 +124,7 @@ namespace tut
 
 	};
 	
-	typedef test_group<LLTemplateMessageBuilderTestData>	LLTemplateMessageBuilderTestGroup;
+	typedef test_group<LLTemplateMessageBuilderTestData, 60>	LLTemplateMessageBuilderTestGroup;
 	typedef LLTemplateMessageBuilderTestGroup::object		LLTemplateMessageBuilderTestObject;
 	LLTemplateMessageBuilderTestGroup templateMessageBuilderTestGroup("LLTemplateMessageBuilder");
 	
@@ -972,5 +972,302 @@ namespace tut
 		ensure_equals("Ensure unchanged buffer ", strlen(outBuffer), 0);
 		delete reader;
 	}
-}
 
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<46>()
+		// read fixed data past end of message -> zero filled
+	{
+		// build message with single block
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		messageTemplate.addBlock(defaultBlock(MVT_U32, 4, MBT_SINGLE));
+		U32 outValue, outValue2 = 0xdddddddd, inValue = 0xbbbbbbbb;
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		builder->addU32(_PREHASH_Test0, inValue);
+		const U32 bufferSize = 1024;
+		U8 buffer[bufferSize];
+		memset(buffer, 0xaa, bufferSize);
+		memset(buffer, 0, LL_PACKET_ID_SIZE);
+		U32 builtSize = builder->buildMessage(buffer, bufferSize, 0);
+		delete builder;
+
+		// add fixed block to reader template
+		messageTemplate.addBlock(createBlock(_PREHASH_Test1, MVT_U32, 4, 
+											 MBT_SINGLE));
+
+		// read message value and default value
+		numberMap[1] = &messageTemplate;
+		LLTemplateMessageReader* reader = 
+			new LLTemplateMessageReader(numberMap);
+		reader->validateMessage(buffer, builtSize, LLHost());
+		reader->readMessage(buffer, LLHost());
+		reader->getU32(_PREHASH_Test0, _PREHASH_Test0, outValue);
+		reader->getU32(_PREHASH_Test1, _PREHASH_Test0, outValue2);
+		ensure_equals("Ensure present value ", outValue, inValue);
+		ensure_equals("Ensure zero value ", outValue2, (U32)0);
+		delete reader;
+	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<47>()
+		// reader reused for consecutive messages
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		messageTemplate.addBlock(createBlock(_PREHASH_Test0, MVT_U32, 4));
+		numberMap[1] = &messageTemplate;
+		LLTemplateMessageReader* reader = 
+			new LLTemplateMessageReader(numberMap);
+
+		U8 buffer[MAX_BUFFER_SIZE];
+		for (U32 repeats = 3; repeats > 0; --repeats)
+		{
+			LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+			for (U32 i = 0; i < repeats; ++i)
+			{
+				if (i)
+				{
+					builder->nextBlock(_PREHASH_Test0);
+				}
+				builder->addU32(_PREHASH_Test0, repeats * 10 + i);
+			}
+			memset(buffer, 0, LL_PACKET_ID_SIZE);
+			U32 builtSize = builder->buildMessage(buffer, MAX_BUFFER_SIZE, 0);
+			delete builder;
+
+			reader->clearMessage();
+			reader->validateMessage(buffer, builtSize, LLHost());
+			reader->readMessage(buffer, LLHost());
+			ensure_equals("Ensure block count", 
+						  reader->getNumberOfBlocks(_PREHASH_Test0), (S32)repeats);
+			for (U32 i = 0; i < repeats; ++i)
+			{
+				U32 outValue;
+				reader->getU32(_PREHASH_Test0, _PREHASH_Test0, outValue, i);
+				ensure_equals("Ensure repeated value", outValue, repeats * 10 + i);
+			}
+		}
+		delete reader;
+	}
+
+	struct DecodeRateData
+	{
+		LLTemplateMessageReader* mReader;
+		U32 mSum;
+	};
+
+	static void decodeRateHandler(LLMessageSystem*, void** user_data)
+	{
+		DecodeRateData* data = (DecodeRateData*)user_data;
+		U32 value;
+		S32 count = data->mReader->getNumberOfBlocks(_PREHASH_Test0);
+		for (S32 i = 0; i < count; ++i)
+		{
+			data->mReader->getU32(_PREHASH_Test0, _PREHASH_Test0, value, i);
+			data->mSum += value;
+		}
+	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<48>()
+		// decode rate when replaying a stream of packets
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		messageTemplate.addBlock(createBlock(_PREHASH_Test0, MVT_U32, 4));
+		DecodeRateData data;
+		data.mSum = 0;
+		messageTemplate.setHandlerFunc(decodeRateHandler, (void**)&data);
+		numberMap[1] = &messageTemplate;
+
+		const S32 STREAM_LENGTH = 16;
+		const S32 BLOCKS_PER_PACKET = 32;
+		U8 stream[STREAM_LENGTH][MAX_BUFFER_SIZE];
+		U32 sizes[STREAM_LENGTH];
+		for (S32 packet = 0; packet < STREAM_LENGTH; ++packet)
+		{
+			LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+			for (S32 i = 0; i < BLOCKS_PER_PACKET; ++i)
+			{
+				if (i)
+				{
+					builder->nextBlock(_PREHASH_Test0);
+				}
+				builder->addU32(_PREHASH_Test0, 1);
+			}
+			memset(stream[packet], 0, LL_PACKET_ID_SIZE);
+			sizes[packet] = builder->buildMessage(stream[packet], MAX_BUFFER_SIZE, 0);
+			delete builder;
+		}
+
+		LLTemplateMessageReader* reader = 
+			new LLTemplateMessageReader(numberMap);
+		data.mReader = reader;
+
+		const S32 PASSES = 1000;
+		LLTimer timer;
+		for (S32 pass = 0; pass < PASSES; ++pass)
+		{
+			for (S32 packet = 0; packet < STREAM_LENGTH; ++packet)
+			{
+				reader->clearMessage();
+				reader->validateMessage(stream[packet], sizes[packet], LLHost());
+				reader->readMessage(stream[packet], LLHost());
+			}
+		}
+		F64 elapsed = timer.getElapsedTimeF64();
+
+		delete reader;
+
+		ensure_equals("Ensure every block decoded", data.mSum, 
+					  (U32)(PASSES * STREAM_LENGTH * BLOCKS_PER_PACKET));
+		if (elapsed > 0.0)
+		{
+			llinfos << "Template decode: "
+					<< (PASSES * STREAM_LENGTH) / elapsed << " messages/sec"
+					<< llendl;
+		}
+	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<49>()
+		// variable handles read the same data as the named getters
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		LLMessageBlock* block = createBlock(_PREHASH_Test0, MVT_U32, 4);
+		block->addVariable(_PREHASH_Test1, MVT_VARIABLE, 1);
+		messageTemplate.addBlock(block);
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		builder->addU32(_PREHASH_Test0, 7);
+		builder->addBinaryData(_PREHASH_Test1, "abc", 3);
+		builder->nextBlock(_PREHASH_Test0);
+		builder->addU32(_PREHASH_Test0, 8);
+		builder->addBinaryData(_PREHASH_Test1, "de", 2);
+		LLTemplateMessageReader* reader = setReader(messageTemplate, builder);
+
+		LLMsgVariableHandle value_handle;
+		LLMsgVariableHandle data_handle;
+		LLMsgVariableHandle missing_handle;
+		ensure("Ensure value resolves", reader->resolveVariable(
+				   _PREHASH_Test0, _PREHASH_Test0, value_handle));
+		ensure("Ensure data resolves", reader->resolveVariable(
+				   _PREHASH_Test0, _PREHASH_Test1, data_handle));
+		ensure("Ensure missing block fails", !reader->resolveVariable(
+				   _PREHASH_Test1, _PREHASH_Test0, missing_handle));
+
+		U32 outValue;
+		reader->getU32(value_handle, outValue, 1);
+		ensure_equals("Ensure handle value", outValue, (U32)8);
+
+		S32 size = 0;
+		const U8* data = reader->getDataPtr(data_handle, 0, &size);
+		ensure_equals("Ensure data size", size, 3);
+		ensure_equals("Ensure data", memcmp(data, "abc", 3), 0);
+		data = reader->getDataPtr(data_handle, 1, &size);
+		ensure_equals("Ensure second data size", size, 2);
+		ensure_equals("Ensure second data", memcmp(data, "de", 2), 0);
+		ensure("Ensure missing repeat", 
+			   reader->getDataPtr(data_handle, 2) == NULL);
+		delete reader;
+	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<50>()
+		// decode rate of named getters against variable handles
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		LLMessageBlock* block = createBlock(_PREHASH_Test0, MVT_U32, 4);
+		block->addVariable(_PREHASH_Test1, MVT_U32, 4);
+		messageTemplate.addBlock(block);
+
+		const S32 BLOCKS_PER_PACKET = 64;
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		for (S32 i = 0; i < BLOCKS_PER_PACKET; ++i)
+		{
+			if (i)
+			{
+				builder->nextBlock(_PREHASH_Test0);
+			}
+			builder->addU32(_PREHASH_Test0, i);
+			builder->addU32(_PREHASH_Test1, 1);
+		}
+		LLTemplateMessageReader* reader = setReader(messageTemplate, builder);
+
+		const S32 PASSES = 10000;
+		U32 named_sum = 0;
+		U32 value;
+		LLTimer timer;
+		for (S32 pass = 0; pass < PASSES; ++pass)
+		{
+			for (S32 i = 0; i < BLOCKS_PER_PACKET; ++i)
+			{
+				reader->getU32(_PREHASH_Test0, _PREHASH_Test0, value, i);
+				named_sum += value;
+				reader->getU32(_PREHASH_Test0, _PREHASH_Test1, value, i);
+				named_sum += value;
+			}
+		}
+		F64 named_time = timer.getElapsedTimeF64();
+
+		U32 handle_sum = 0;
+		LLMsgVariableHandle handle0;
+		LLMsgVariableHandle handle1;
+		timer.reset();
+		for (S32 pass = 0; pass < PASSES; ++pass)
+		{
+			reader->resolveVariable(_PREHASH_Test0, _PREHASH_Test0, handle0);
+			reader->resolveVariable(_PREHASH_Test0, _PREHASH_Test1, handle1);
+			for (S32 i = 0; i < BLOCKS_PER_PACKET; ++i)
+			{
+				reader->getU32(handle0, value, i);
+				handle_sum += value;
+				reader->getU32(handle1, value, i);
+				handle_sum += value;
+			}
+		}
+		F64 handle_time = timer.getElapsedTimeF64();
+		delete reader;
+
+		ensure_equals("Ensure same values", handle_sum, named_sum);
+		llinfos << "Template getters: named " << named_time 
+				<< "s, handles " << handle_time << "s for "
+				<< PASSES * BLOCKS_PER_PACKET * 2 << " reads" << llendl;
+	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<51>()
+		// sizes, strings and binary data read through variable handles
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		LLMessageBlock* block = createBlock(_PREHASH_Test0, MVT_VARIABLE, 1);
+		block->addVariable(_PREHASH_Test1, MVT_FIXED, 4);
+		messageTemplate.addBlock(block);
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+		builder->addString(_PREHASH_Test0, "hello");
+		builder->addBinaryData(_PREHASH_Test1, "wxyz", 4);
+		builder->nextBlock(_PREHASH_Test0);
+		builder->addString(_PREHASH_Test0, "");
+		builder->addBinaryData(_PREHASH_Test1, "abcd", 4);
+		LLTemplateMessageReader* reader = setReader(messageTemplate, builder);
+
+		LLMsgVariableHandle string_handle;
+		LLMsgVariableHandle fixed_handle;
+		ensure("Ensure string resolves", reader->resolveVariable(
+				   _PREHASH_Test0, _PREHASH_Test0, string_handle));
+		ensure("Ensure fixed resolves", reader->resolveVariable(
+				   _PREHASH_Test0, _PREHASH_Test1, fixed_handle));
+
+		ensure_equals("Ensure string size", reader->getSize(string_handle, 0),
+					  reader->getSize(_PREHASH_Test0, 0, _PREHASH_Test0));
+		ensure_equals("Ensure missing repeat size", reader->getSize(string_handle, 2),
+					  LL_BLOCK_NOT_IN_MESSAGE);
+
+		std::string outString;
+		reader->getString(string_handle, outString, 0);
+		ensure_equals("Ensure string", outString, std::string("hello"));
+		reader->getString(string_handle, outString, 1);
+		ensure_equals("Ensure empty string", outString, std::string(""));
+
+		char outData[4];
+		reader->getBinaryData(fixed_handle, outData, 4, 1);
+		ensure_equals("Ensure binary data", memcmp(outData, "abcd", 4), 0);
+		delete reader;
+	}
+}
@@ -0,0 +1,224 @@
+/** 
+ * @file lltexturebudget_tut.cpp
+ * @brief LLTextureBudget unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "lltexturebudget.h"
+
+namespace tut
+{
+	struct texturebudget_data
+	{
+		// A visible RGBA texture that wants full resolution
+		static LLTextureBudget::Entry makeEntry(S32 size, F32 pixel_area, F32 distance)
+		{
+			LLTextureBudget::Entry entry;
+			entry.mWidth = size;
+			entry.mHeight = size;
+			entry.mComponents = 4;
+			entry.mMaxDiscard = 5;
+			entry.mWantedDiscard = 0;
+			entry.mPixelArea = pixel_area;
+			entry.mDistance = distance;
+			return entry;
+		}
+
+		LLTextureBudget mBudget;
+	};
+	typedef test_group<texturebudget_data> texturebudget_test;
+	typedef texturebudget_test::object texturebudget_object;
+	tut::texturebudget_test texturebudget_testcase("texturebudget");
+
+	template<> template<>
+	void texturebudget_object::test<1>()
+	{
+		// a mip chain adds a third, and every level is a quarter of the last
+		ensure_equals("256 RGBA", LLTextureBudget::calcBytes(256, 256, 4, 0), (S64)256*256*4*4/3);
+		ensure_equals("256 RGBA discard 2", LLTextureBudget::calcBytes(256, 256, 4, 2), (S64)64*64*4*4/3);
+		ensure_equals("thin", LLTextureBudget::calcBytes(512, 2, 3, 3), (S64)64*1*3*4/3);
+		ensure_equals("empty", LLTextureBudget::calcBytes(0, 256, 4, 0), (S64)0);
+
+		ensure_equals("one texel per pixel", LLTextureBudget::calcDiscardLevel(512.f*512.f, 512.f*512.f), 0);
+		ensure_equals("quarter the pixels", LLTextureBudget::calcDiscardLevel(512.f*512.f, 256.f*256.f), 0);
+		ensure_equals("sixteenth of the pixels", LLTextureBudget::calcDiscardLevel(512.f*512.f, 128.f*128.f), 1);
+		ensure_equals("tiny", LLTextureBudget::calcDiscardLevel(512.f*512.f, 8.f*8.f), 5);
+		ensure_equals("magnified", LLTextureBudget::calcDiscardLevel(64.f*64.f, 512.f*512.f), 0);
+
+		// halving the distance quadruples the area, up to a limit
+		ensure_approximately_equals("still", LLTextureBudget::predictPixelArea(100.f, 20.f, 0.f, 1.f), 100.f, 8);
+		ensure_approximately_equals("receding", LLTextureBudget::predictPixelArea(100.f, 20.f, -10.f, 1.f), 100.f, 8);
+		ensure_approximately_equals("approaching", LLTextureBudget::predictPixelArea(100.f, 20.f, 10.f, 1.f), 400.f, 8);
+		ensure_approximately_equals("capped", LLTextureBudget::predictPixelArea(100.f, 20.f, 100.f, 1.f),
+						100.f * (F32)LLTextureBudget::MAX_AREA_GROWTH, 8);
+
+		// off screen, recently bound textures are worth a little
+		ensure_approximately_equals("on screen", mBudget.calcUtility(5000.f, 0.f), 5000.f, 8);
+		ensure("recent", mBudget.calcUtility(0.f, 0.f) > mBudget.calcUtility(0.f, 1.f));
+		ensure("less than on screen", mBudget.calcUtility(0.f, 0.f) < 5000.f);
+		ensure_approximately_equals("forgotten", mBudget.calcUtility(0.f, 600.f), 0.f, 8);
+	}
+
+	template<> template<>
+	void texturebudget_object::test<2>()
+	{
+		// with room for everything, everything visible gets what it wants
+		LLTextureBudget::entry_list_t entries;
+		entries.push_back(makeEntry(512, 500.f*500.f, 5.f));
+		entries.push_back(makeEntry(256, 50.f*50.f, 30.f));
+		entries.back().mWantedDiscard = 2;
+		entries.push_back(makeEntry(256, 0.f, 100.f));
+		entries.back().mTimeSinceBound = 600.f;
+		entries.push_back(makeEntry(1024, 0.f, 0.f));
+		entries.back().mPinned = TRUE;
+		entries.back().mWantedDiscard = 1;
+
+		S64 used = mBudget.solve(entries, 64 * 1024 * 1024);
+		const LLTextureBudget::Stats& stats = mBudget.getStats();
+		ensure_equals("near", entries[0].mDiscard, 0);
+		ensure_equals("far", entries[1].mDiscard, 2);
+		ensure_equals("idle", entries[2].mDiscard, 6);
+		ensure_equals("pinned", entries[3].mDiscard, 1);
+		ensure_equals("used", used,
+					  LLTextureBudget::calcBytes(512, 512, 4, 0) +
+					  LLTextureBudget::calcBytes(256, 256, 4, 2) +
+					  LLTextureBudget::calcBytes(1024, 1024, 4, 1));
+		ensure_equals("all wanted", used, stats.mWantedBytes);
+		ensure_equals("at wanted", stats.mAtWanted, (U32)3);
+		ensure_equals("not visible", stats.mIdle, (U32)1);
+		ensure_equals("nothing degraded", stats.mDegraded, (U32)0);
+	}
+
+	template<> template<>
+	void texturebudget_object::test<3>()
+	{
+		// short on memory, the big texture in front keeps its detail and
+		// the small distant ones give way, rather than all blurring alike
+		LLTextureBudget::entry_list_t entries;
+		entries.push_back(makeEntry(512, 500.f*500.f, 5.f));
+		for (S32 i = 0; i < 8; ++i)
+		{
+			entries.push_back(makeEntry(512, 40.f*40.f, 40.f));
+		}
+		S64 budget = LLTextureBudget::calcBytes(512, 512, 4, 0) + 8 * LLTextureBudget::calcBytes(512, 512, 4, 2);
+		S64 used = mBudget.solve(entries, budget);
+		ensure("within budget", used <= budget);
+		ensure_equals("near keeps full resolution", entries[0].mDiscard, 0);
+		for (S32 i = 1; i < 9; ++i)
+		{
+			ensure("far are degraded", entries[i].mDiscard > 0 && entries[i].mDiscard <= 5);
+		}
+		ensure_equals("degraded", mBudget.getStats().mDegraded, (U32)8);
+
+		// the budget is spent, not left on the table: not one more level fits
+		for (S32 i = 0; i < 9; ++i)
+		{
+			S32 discard = entries[i].mDiscard;
+			if (discard > 0)
+			{
+				S64 more = LLTextureBudget::calcBytes(512, 512, 4, discard - 1) - LLTextureBudget::calcBytes(512, 512, 4, discard);
+				ensure("no upgrade fits", used + more > budget);
+			}
+		}
+
+		// with almost nothing, the least useful go away entirely
+		budget = 3 * LLTextureBudget::calcBytes(512, 512, 4, 5);
+		used = mBudget.solve(entries, budget);
+		ensure("within tiny budget", used <= budget);
+		ensure_equals("near at the coarsest level", entries[0].mDiscard, 5);
+		ensure_equals("dropped", mBudget.getStats().mDropped, (U32)6);
+	}
+
+	template<> template<>
+	void texturebudget_object::test<4>()
+	{
+		// the camera is flying at one of two identical textures: that one
+		// is fetched ahead of need, if there's room
+		LLTextureBudget::entry_list_t entries;
+		entries.push_back(makeEntry(512, 64.f*64.f, 40.f));
+		entries.back().mWantedDiscard = LLTextureBudget::calcDiscardLevel(512.f*512.f, 64.f*64.f);
+		entries.back().mApproachSpeed = 20.f;
+		entries.push_back(entries.back());
+		entries.back().mApproachSpeed = -20.f;
+
+		mBudget.setLookahead(1.f);
+		mBudget.solve(entries, 64 * 1024 * 1024);
+		ensure("prefetched", entries[0].mDiscard < entries[0].mWantedDiscard);
+		ensure_equals("receding as wanted", entries[1].mDiscard, entries[1].mWantedDiscard);
+		ensure_equals("prefetch count", mBudget.getStats().mPrefetched, (U32)1);
+
+		// exactly enough for both: the approaching one still gets ahead
+		S64 budget = LLTextureBudget::calcBytes(512, 512, 4, entries[0].mWantedDiscard - 1) +
+			LLTextureBudget::calcBytes(512, 512, 4, entries[1].mWantedDiscard);
+		mBudget.solve(entries, budget);
+		ensure_equals("approaching fits", entries[0].mDiscard, entries[0].mWantedDiscard - 1);
+		ensure_equals("receding fits", entries[1].mDiscard, entries[1].mWantedDiscard);
+
+		// only just enough for what's needed now: that comes first
+		budget = LLTextureBudget::calcBytes(512, 512, 4, entries[0].mWantedDiscard) +
+			LLTextureBudget::calcBytes(512, 512, 4, entries[1].mWantedDiscard);
+		mBudget.solve(entries, budget);
+		ensure_equals("approaching as wanted", entries[0].mDiscard, entries[0].mWantedDiscard);
+		ensure_equals("receding not starved", entries[1].mDiscard, entries[1].mWantedDiscard);
+		ensure_equals("no prefetch", mBudget.getStats().mPrefetched, (U32)0);
+
+		mBudget.setLookahead(0.f);
+		mBudget.solve(entries, 64 * 1024 * 1024);
+		ensure_equals("no lookahead", entries[0].mDiscard, entries[0].mWantedDiscard);
+	}
+
+	template<> template<>
+	void texturebudget_object::test<5>()
+	{
+		// totals and budgets past 2GB don't wrap
+		const S64 GIGABYTE = 1024 * 1024 * 1024;
+		ensure_equals("huge texture", LLTextureBudget::calcBytes(16384, 16384, 4, 0),
+					  (S64)16384 * 16384 * 4 * 4 / 3);
+
+		LLTextureBudget::entry_list_t entries;
+		for (S32 i = 0; i < 200; ++i)
+		{
+			entries.push_back(makeEntry(2048, 1000.f*1000.f, 5.f));
+		}
+		S64 one = LLTextureBudget::calcBytes(2048, 2048, 4, 0);
+		S64 used = mBudget.solve(entries, 8 * GIGABYTE);
+		ensure_equals("all fit", used, 200 * one);
+		ensure("past 2GB", used > 2 * GIGABYTE);
+		ensure_equals("wanted", mBudget.getStats().mWantedBytes, 200 * one);
+		ensure_equals("all at wanted", mBudget.getStats().mAtWanted, (U32)200);
+
+		used = mBudget.solve(entries, 3 * GIGABYTE);
+		ensure("within budget", used <= 3 * GIGABYTE);
+		ensure("budget spent", used > 2 * GIGABYTE);
+		ensure_equals("budget", mBudget.getStats().mBudgetBytes, 3 * GIGABYTE);
+	}
+}
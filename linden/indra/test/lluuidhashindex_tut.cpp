@@ -0,0 +1,280 @@
+/** 
+ * @file lluuidhashindex_tut.cpp
+ * @brief LLUUIDHashIndex unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <map>
+
+#include "llmappedfile.h"
+#include "lltimer.h"
+#include "lluuidhashindex.h"
+
+#define TEST_FILE_NAME	"uuidhashindex_test.dat"
+
+namespace tut
+{
+	struct uuidhashindex_data
+	{
+		~uuidhashindex_data()
+		{
+			LLFile::remove(TEST_FILE_NAME);
+		}
+
+		// UUIDs in the same shard that all hash to the same home slot
+		static LLUUID makeCollidingID(U32 n)
+		{
+			LLUUID id;
+			id.mData[0] = 5;
+			id.mData[15] = (U8)n;
+			id.mData[14] = (U8)(n >> 8);
+			return id;
+		}
+	};
+	typedef test_group<uuidhashindex_data> uuidhashindex_test;
+	typedef uuidhashindex_test::object uuidhashindex_object;
+	tut::uuidhashindex_test tuhi("uuidhashindex");
+
+	template<> template<>
+	void uuidhashindex_object::test<1>()
+	{
+		// insert, replace, find and erase within one probe run
+		const U32 capacity = 1000;
+		std::vector<U8> memory(LLUUIDHashIndex::calcMemorySize(capacity));
+		LLUUIDHashIndex index;
+		ensure("zeroed memory is not a saved index", !index.attach(&memory[0], memory.size(), capacity));
+		ensure_equals("empty", index.getCount(), 0U);
+
+		const S32 count = 20;
+		for (S32 i = 0; i < count; ++i)
+		{
+			LLUUID id = makeCollidingID(i);
+			LLUUIDHashIndex::ShardLock lock(index, id);
+			ensure("insert", index.insert(id, i * 3));
+		}
+		ensure_equals("count", index.getCount(), (U32)count);
+		{
+			LLUUID id = makeCollidingID(4);
+			LLUUIDHashIndex::ShardLock lock(index, id);
+			ensure("replace", index.insert(id, 1234));
+			ensure_equals("replaced", index.find(id), 1234);
+		}
+		ensure_equals("replace keeps count", index.getCount(), (U32)count);
+
+		// erase from the front and middle of the run, everything after must stay reachable
+		for (S32 i = 0; i < count; i += 3)
+		{
+			LLUUID id = makeCollidingID(i);
+			LLUUIDHashIndex::ShardLock lock(index, id);
+			ensure("erase", index.erase(id));
+			ensure("erase twice", !index.erase(id));
+		}
+		for (S32 i = 0; i < count; ++i)
+		{
+			LLUUID id = makeCollidingID(i);
+			LLUUIDHashIndex::ShardLock lock(index, id);
+			S32 expected = (i % 3 == 0) ? -1 : (i == 4 ? 1234 : i * 3);
+			ensure_equals("find after erase", index.find(id), expected);
+		}
+		LLUUID other;
+		other.generate();
+		LLUUIDHashIndex::ShardLock lock(index, other);
+		ensure_equals("missing", index.find(other), -1);
+	}
+
+	template<> template<>
+	void uuidhashindex_object::test<2>()
+	{
+		// a full shard refuses new ids but still accepts updates
+		const U32 capacity = 10;
+		std::vector<U8> memory(LLUUIDHashIndex::calcMemorySize(capacity));
+		LLUUIDHashIndex index;
+		index.attach(&memory[0], memory.size(), capacity);
+		S32 inserted = 0;
+		while (1)
+		{
+			LLUUID id = makeCollidingID(inserted);
+			LLUUIDHashIndex::ShardLock lock(index, id);
+			if (!index.insert(id, inserted))
+			{
+				break;
+			}
+			++inserted;
+			ensure("shard never fills", inserted < 1000);
+		}
+		ensure("some inserted", inserted > 0);
+		LLUUID id = makeCollidingID(0);
+		LLUUIDHashIndex::ShardLock lock(index, id);
+		ensure("update in full shard", index.insert(id, 77));
+		ensure_equals("updated", index.find(id), 77);
+	}
+
+	template<> template<>
+	void uuidhashindex_object::test<3>()
+	{
+		// an index saved in a mapped file is reused only after a clean detach
+		const U32 capacity = 5000;
+		const size_t size = LLUUIDHashIndex::calcMemorySize(capacity);
+		std::vector<LLUUID> ids(capacity);
+		{
+			LLMappedFile file;
+			ensure("map", file.open(TEST_FILE_NAME, size, LLMappedFile::READ_WRITE));
+			LLUUIDHashIndex index;
+			ensure("new file", !index.attach(file.getData(), file.getSize(), capacity));
+			for (U32 i = 0; i < capacity; ++i)
+			{
+				ids[i].generate();
+				LLUUIDHashIndex::ShardLock lock(index, ids[i]);
+				ensure("insert", index.insert(ids[i], i));
+			}
+			index.detach();
+		}
+		{
+			LLMappedFile file;
+			ensure("remap", file.open(TEST_FILE_NAME, size, LLMappedFile::READ_WRITE));
+			ensure_equals("file size", file.getFileSize(), size);
+			LLUUIDHashIndex index;
+			ensure("clean index reused", index.attach(file.getData(), file.getSize(), capacity));
+			ensure_equals("count", index.getCount(), capacity);
+			for (U32 i = 0; i < capacity; ++i)
+			{
+				LLUUIDHashIndex::ShardLock lock(index, ids[i]);
+				ensure_equals("find", index.find(ids[i]), (S32)i);
+			}
+			// no detach(), as if we crashed
+		}
+		{
+			LLMappedFile file;
+			file.open(TEST_FILE_NAME, size, LLMappedFile::READ_WRITE);
+			LLUUIDHashIndex index;
+			ensure("dirty index rejected", !index.attach(file.getData(), file.getSize(), capacity));
+			ensure_equals("dirty index cleared", index.getCount(), 0U);
+			index.detach();
+		}
+		{
+			LLMappedFile file;
+			file.open(TEST_FILE_NAME, size, LLMappedFile::READ_WRITE);
+			LLUUIDHashIndex index;
+			ensure("capacity change rejected", !index.attach(file.getData(), file.getSize(), capacity / 2));
+		}
+	}
+
+	template<> template<>
+	void uuidhashindex_object::test<4>()
+	{
+		// open time and lookup throughput against the std::map the texture cache used
+		const U32 capacity = 500000;
+		const size_t size = LLUUIDHashIndex::calcMemorySize(capacity);
+		std::vector<LLUUID> ids(capacity);
+		for (U32 i = 0; i < capacity; ++i)
+		{
+			ids[i].generate();
+		}
+		{
+			LLMappedFile file;
+			file.open(TEST_FILE_NAME, size, LLMappedFile::READ_WRITE);
+			LLUUIDHashIndex index;
+			index.attach(file.getData(), file.getSize(), capacity);
+			for (U32 i = 0; i < capacity; ++i)
+			{
+				LLUUIDHashIndex::ShardLock lock(index, ids[i]);
+				ensure("insert", index.insert(ids[i], i));
+			}
+			index.detach();
+		}
+
+		LLTimer timer;
+		std::map<LLUUID, S32> id_map;
+		for (U32 i = 0; i < capacity; ++i)
+		{
+			id_map[ids[i]] = i;
+		}
+		F32 map_open = timer.getElapsedTimeF32();
+
+		timer.reset();
+		LLMappedFile file;
+		ensure("map", file.open(TEST_FILE_NAME, size, LLMappedFile::READ_WRITE));
+		LLUUIDHashIndex index;
+		ensure("attach", index.attach(file.getData(), file.getSize(), capacity));
+		F32 index_open = timer.getElapsedTimeF32();
+
+		LLMutex map_mutex(NULL);
+		S32 found = 0;
+		timer.reset();
+		for (U32 i = 0; i < capacity; ++i)
+		{
+			LLMutexLock lock(&map_mutex);
+			found += id_map.find(ids[(i * 7919) % capacity]) != id_map.end();
+		}
+		F32 map_lookup = timer.getElapsedTimeF32();
+
+		timer.reset();
+		for (U32 i = 0; i < capacity; ++i)
+		{
+			const LLUUID& id = ids[(i * 7919) % capacity];
+			LLUUIDHashIndex::ShardLock lock(index, id);
+			found += index.find(id) >= 0;
+		}
+		F32 index_lookup = timer.getElapsedTimeF32();
+		ensure_equals("all found", found, (S32)capacity * 2);
+		index.detach();
+
+		llinfos << "UUID index, " << capacity << " entries: open " << index_open * 1000.f
+				<< " ms (std::map build " << map_open * 1000.f << " ms), "
+				<< capacity / llmax(index_lookup, 0.0001f) << " lookups/s (std::map "
+				<< capacity / llmax(map_lookup, 0.0001f) << " lookups/s)" << llendl;
+	}
+
+	template<> template<>
+	void uuidhashindex_object::test<5>()
+	{
+		// a rejected header's counts mean nothing, so leftover slots must not survive
+		const U32 capacity = 100;
+		std::vector<U8> memory(LLUUIDHashIndex::calcMemorySize(capacity), 0xff);
+		LLUUIDHashIndex index;
+		ensure("garbage is not a saved index", !index.attach(&memory[0], memory.size(), capacity));
+		ensure_equals("empty", index.getCount(), 0U);
+		LLUUID id = makeCollidingID(1);
+		{
+			LLUUIDHashIndex::ShardLock lock(index, id);
+			ensure_equals("garbage slots cleared", index.find(id), -1);
+			ensure("insert", index.insert(id, 42));
+		}
+		index.detach();
+
+		// a header that matches but wasn't detached cleanly, with zeroed counts
+		memset(&memory[0] + sizeof(U32) * 4, 0, sizeof(U32) * (1 + LLUUIDHashIndex::NUM_SHARDS));
+		ensure("dirty index rejected", !index.attach(&memory[0], memory.size(), capacity));
+		LLUUIDHashIndex::ShardLock lock(index, id);
+		ensure_equals("stale entry cleared", index.find(id), -1);
+	}
+}
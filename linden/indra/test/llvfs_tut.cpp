@@ -0,0 +1,591 @@
+/** 
+ * @file llvfs_tut.cpp
+ * @brief LLVFS unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include <vector>
+#if !LL_WINDOWS
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "llrand.h"
+#include "llthread.h"
+#include "lltimer.h"
+#include "llvfs.h"
+
+#define TEST_INDEX_NAME		"vfs_test.index"
+#define TEST_DATA_NAME		"vfs_test.data"
+
+namespace tut
+{
+	struct vfs_data
+	{
+		vfs_data()
+		{
+			remove();
+		}
+		~vfs_data()
+		{
+			remove();
+		}
+
+		static void remove()
+		{
+			LLFile::remove(TEST_INDEX_NAME);
+			LLFile::remove(TEST_INDEX_NAME ".jnl");
+			LLFile::remove(TEST_INDEX_NAME ".tmp");
+			LLFile::remove(TEST_DATA_NAME);
+		}
+
+		// Contents that say which file and offset they came from
+		static U8 makeByte(const LLUUID& id, S32 offset)
+		{
+			return (U8)(id.mData[offset % UUID_BYTES] + offset * 7);
+		}
+
+		static void makeData(const LLUUID& id, S32 size, std::vector<U8>& data)
+		{
+			data.resize(size);
+			for (S32 i = 0; i < size; ++i)
+			{
+				data[i] = makeByte(id, i);
+			}
+		}
+
+		static bool checkData(const LLUUID& id, const U8* data, S32 offset, S32 size)
+		{
+			for (S32 i = 0; i < size; ++i)
+			{
+				if (data[i] != makeByte(id, offset + i))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static void storeFile(LLVFS& vfs, const LLUUID& id, S32 size)
+		{
+			std::vector<U8> data;
+			makeData(id, size, data);
+			vfs.setMaxSize(id, LLAssetType::AT_TEXTURE, size);
+			vfs.storeData(id, LLAssetType::AT_TEXTURE, &data[0], 0, size);
+		}
+
+		// Every file that survived has the contents it was written with
+		static bool checkFiles(LLVFS& vfs, const std::vector<LLUUID>& ids)
+		{
+			std::vector<U8> buffer;
+			for (size_t i = 0; i < ids.size(); ++i)
+			{
+				S32 size = vfs.getSize(ids[i], LLAssetType::AT_TEXTURE);
+				if (size <= 0)
+				{
+					continue;
+				}
+				buffer.resize(size);
+				if (vfs.getData(ids[i], LLAssetType::AT_TEXTURE, &buffer[0], 0, size) != size
+					|| !checkData(ids[i], &buffer[0], 0, size))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Reads random pieces of random files until told to stop, or until
+		// it has done its share of a fixed amount of work.
+		class ReadThread : public LLThread
+		{
+		public:
+			ReadThread(LLVFS* vfs, const std::vector<LLUUID>* ids, S32 file_size, S32 reads, LLMutex* serialize, bool verify)
+			:	LLThread("vfs test reader"),
+				mVFS(vfs),
+				mIDs(ids),
+				mFileSize(file_size),
+				mReads(reads),
+				mSerialize(serialize),
+				mVerify(verify),
+				mErrors(0),
+				mStop(false),
+				mDone(false)
+			{
+			}
+
+			/*virtual*/ void run()
+			{
+				std::vector<U8> buffer(mFileSize);
+				for (S32 i = 0; (mReads <= 0 || i < mReads) && !mStop; ++i)
+				{
+					const LLUUID& id = (*mIDs)[ll_rand(mIDs->size())];
+					S32 offset = ll_rand(mFileSize / 2);
+					S32 length = mFileSize - offset;
+					if (mSerialize)
+					{
+						mSerialize->lock();
+					}
+					S32 bytes = mVFS->getData(id, LLAssetType::AT_TEXTURE, &buffer[0], offset, length);
+					if (mSerialize)
+					{
+						mSerialize->unlock();
+					}
+					if (bytes != length
+						|| (mVerify && !checkData(id, &buffer[0], offset, bytes))
+						|| buffer[bytes - 1] != makeByte(id, offset + bytes - 1))
+					{
+						mErrors++;
+					}
+				}
+				mDone = true;
+			}
+
+			LLVFS* mVFS;
+			const std::vector<LLUUID>* mIDs;
+			S32 mFileSize;
+			S32 mReads;
+			LLMutex* mSerialize;
+			bool mVerify;		// check every byte, not just the last
+			S32 mErrors;
+			volatile bool mStop;
+			volatile bool mDone;
+		};
+
+		static void runReaders(std::vector<ReadThread*>& threads)
+		{
+			for (size_t i = 0; i < threads.size(); ++i)
+			{
+				threads[i]->start();
+			}
+			for (size_t i = 0; i < threads.size(); ++i)
+			{
+				while (!threads[i]->mDone)
+				{
+					ms_sleep(1);
+				}
+			}
+		}
+
+		static S32 deleteReaders(std::vector<ReadThread*>& threads)
+		{
+			S32 errors = 0;
+			for (size_t i = 0; i < threads.size(); ++i)
+			{
+				// a thread that hasn't been scheduled yet also reads as stopped
+				while (!threads[i]->mDone || !threads[i]->isStopped())
+				{
+					ms_sleep(1);
+				}
+				errors += threads[i]->mErrors;
+				delete threads[i];
+			}
+			threads.clear();
+			return errors;
+		}
+	};
+	typedef test_group<vfs_data> vfs_test;
+	typedef vfs_test::object vfs_object;
+	tut::vfs_test tvfs("vfs");
+
+	template<> template<>
+	void vfs_object::test<1>()
+	{
+		// data survives growing, which moves the file, and reopening
+		LLUUID first, second;
+		first.generate();
+		second.generate();
+		{
+			LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 1024 * 1024, FALSE);
+			ensure("valid", vfs.isValid());
+
+			storeFile(vfs, first, 3000);
+			storeFile(vfs, second, 5000);
+			std::vector<U8> buffer(20000);
+			ensure_equals("read", vfs.getData(first, LLAssetType::AT_TEXTURE, &buffer[0], 0, 20000), 3000);
+			ensure("contents", checkData(first, &buffer[0], 0, 3000));
+			ensure_equals("partial read", vfs.getData(second, LLAssetType::AT_TEXTURE, &buffer[0], 1000, 500), 500);
+			ensure("partial contents", checkData(second, &buffer[0], 1000, 500));
+
+			// second sits right after first, so first has to move to grow
+			ensure("grow", vfs.setMaxSize(first, LLAssetType::AT_TEXTURE, 12000));
+			std::vector<U8> data;
+			makeData(first, 12000, data);
+			ensure_equals("append", vfs.storeData(first, LLAssetType::AT_TEXTURE, &data[3000], -1, 9000), 9000);
+			ensure_equals("size", vfs.getSize(first, LLAssetType::AT_TEXTURE), 12000);
+
+			vfs.removeFile(second, LLAssetType::AT_TEXTURE);
+			ensure("removed", !vfs.getExists(second, LLAssetType::AT_TEXTURE));
+		}
+
+		LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 1024 * 1024, FALSE);
+		ensure("valid again", vfs.isValid());
+		std::vector<U8> buffer(12000);
+		ensure_equals("read again", vfs.getData(first, LLAssetType::AT_TEXTURE, &buffer[0], 0, 12000), 12000);
+		ensure("contents again", checkData(first, &buffer[0], 0, 12000));
+		ensure("still removed", !vfs.getExists(second, LLAssetType::AT_TEXTURE));
+	}
+
+	template<> template<>
+	void vfs_object::test<2>()
+	{
+		// readers never see a file half moved, or space reused under them,
+		// while another thread grows, removes and replaces files
+		const S32 FILES = 16;
+		const S32 FILE_SIZE = 16 * 1024;
+		LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 4 * 1024 * 1024, FALSE);
+		ensure("valid", vfs.isValid());
+
+		std::vector<LLUUID> ids(FILES);
+		for (S32 i = 0; i < FILES; ++i)
+		{
+			ids[i].generate();
+			storeFile(vfs, ids[i], FILE_SIZE);
+		}
+
+		std::vector<ReadThread*> threads;
+		for (S32 i = 0; i < 4; ++i)
+		{
+			threads.push_back(new ReadThread(&vfs, &ids, FILE_SIZE, 0, NULL, true));
+			threads.back()->start();
+		}
+
+		std::vector<U8> data;
+		for (S32 round = 0; round < 200; ++round)
+		{
+			// grow a file the readers use, moving it past the others
+			const LLUUID& id = ids[ll_rand(FILES)];
+			vfs.setMaxSize(id, LLAssetType::AT_TEXTURE, FILE_SIZE + 1024 * (1 + round % 8));
+
+			// churn files the readers don't use through the free space
+			LLUUID scratch;
+			scratch.generate();
+			storeFile(vfs, scratch, 1024 * (1 + ll_rand(32)));
+			vfs.removeFile(scratch, LLAssetType::AT_TEXTURE);
+		}
+
+		for (size_t i = 0; i < threads.size(); ++i)
+		{
+			threads[i]->mStop = true;
+		}
+		ensure_equals("no bad reads", deleteReaders(threads), 0);
+	}
+
+	template<> template<>
+	void vfs_object::test<3>()
+	{
+		// benchmark: reads from several threads, one at a time through a
+		// lock as they used to be, against running concurrently
+		const S32 FILES = 256;
+		const S32 FILE_SIZE = 32 * 1024;
+		const S32 THREADS = 4;
+		const S32 READS = 4000;
+		LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 16 * 1024 * 1024, FALSE);
+		ensure("valid", vfs.isValid());
+
+		std::vector<LLUUID> ids(FILES);
+		for (S32 i = 0; i < FILES; ++i)
+		{
+			ids[i].generate();
+			storeFile(vfs, ids[i], FILE_SIZE);
+		}
+
+		LLMutex serialize(NULL);
+		F64 times[2];
+		S32 errors = 0;
+		for (S32 pass = 0; pass < 2; ++pass)
+		{
+			std::vector<ReadThread*> threads;
+			for (S32 i = 0; i < THREADS; ++i)
+			{
+				threads.push_back(new ReadThread(&vfs, &ids, FILE_SIZE, READS, pass ? NULL : &serialize, false));
+			}
+			LLTimer timer;
+			runReaders(threads);
+			times[pass] = timer.getElapsedTimeF64();
+			errors += deleteReaders(threads);
+		}
+		ensure_equals("no bad reads", errors, 0);
+
+		llinfos << "VFS reads, " << THREADS << " threads x " << READS << ": "
+				<< times[0] * 1000.0 << " ms serialized, "
+				<< times[1] * 1000.0 << " ms concurrent" << llendl;
+	}
+
+#if !LL_WINDOWS
+	template<> template<>
+	void vfs_object::test<4>()
+	{
+		// a process killed at any point leaves an index that loads, matches
+		// what it loads into, and only names intact files
+		const S32 FILES = 64;
+		const S32 ROUNDS = 12;
+		std::vector<LLUUID> ids(FILES);
+		for (S32 i = 0; i < FILES; ++i)
+		{
+			ids[i].generate();
+		}
+
+		for (S32 round = 0; round < ROUNDS; ++round)
+		{
+			pid_t pid = fork();
+			ensure("fork", pid >= 0);
+			if (pid == 0)
+			{
+				// small enough that new files evict old ones
+				LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 512 * 1024, FALSE);
+				std::vector<U8> data;
+				for (S32 op = 0; op < 100000; ++op)
+				{
+					const LLUUID& id = ids[ll_rand(FILES)];
+					S32 size = vfs.getSize(id, LLAssetType::AT_TEXTURE);
+					switch (ll_rand(4))
+					{
+					case 0:
+						vfs.removeFile(id, LLAssetType::AT_TEXTURE);
+						break;
+					case 1:
+						if (size > 0)
+						{
+							// give back the slack, so the tail is reused
+							vfs.setMaxSize(id, LLAssetType::AT_TEXTURE, size);
+						}
+						break;
+					default:
+						if (size <= 0)
+						{
+							vfs.removeFile(id, LLAssetType::AT_TEXTURE);
+							storeFile(vfs, id, 1024 * (1 + ll_rand(16)));
+						}
+						else
+						{
+							// append, moving the file when it can't grow in place
+							S32 new_size = size + 1024 * (1 + ll_rand(8));
+							makeData(id, new_size, data);
+							if (vfs.setMaxSize(id, LLAssetType::AT_TEXTURE, new_size))
+							{
+								vfs.storeData(id, LLAssetType::AT_TEXTURE, &data[size], size, new_size - size);
+							}
+						}
+						break;
+					}
+				}
+				_exit(0);
+			}
+
+			ms_sleep(10 + ll_rand(100));
+			kill(pid, SIGKILL);
+			int status = 0;
+			waitpid(pid, &status, 0);
+
+			LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 512 * 1024, FALSE);
+			ensure("valid after kill", vfs.isValid());
+			ensure("audit after kill", vfs.audit());
+			ensure("contents after kill", checkFiles(vfs, ids));
+		}
+	}
+
+	template<> template<>
+	void vfs_object::test<5>()
+	{
+		// a torn journal entry and a half written snapshot are both ignored
+		const S32 FILES = 40;
+		std::vector<LLUUID> ids(FILES + 1);
+		for (S32 i = 0; i <= FILES; ++i)
+		{
+			ids[i].generate();
+		}
+		LLUUID renamed;
+		renamed.generate();
+
+		pid_t pid = fork();
+		ensure("fork", pid >= 0);
+		if (pid == 0)
+		{
+			LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 1024 * 1024, FALSE);
+			for (S32 i = 0; i < FILES; ++i)
+			{
+				storeFile(vfs, ids[i], 4096);
+			}
+			vfs.renameFile(ids[1], LLAssetType::AT_TEXTURE, renamed, LLAssetType::AT_SOUND);
+			vfs.removeFile(ids[0], LLAssetType::AT_TEXTURE);
+			// reusing the space writes out everything before it
+			storeFile(vfs, ids[FILES], 4096);
+			_exit(0);
+		}
+		int status = 0;
+		waitpid(pid, &status, 0);
+		ensure("child exited", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+		LLFILE* fp = LLFile::fopen(TEST_INDEX_NAME ".jnl", "ab");
+		ensure("journal", fp != NULL);
+		U8 junk[20];
+		memset(junk, 0x5a, sizeof(junk));
+		fwrite(junk, sizeof(junk), 1, fp);
+		fclose(fp);
+
+		fp = LLFile::fopen(TEST_INDEX_NAME ".tmp", "wb");
+		ensure("snapshot", fp != NULL);
+		fwrite(junk, sizeof(junk), 1, fp);
+		fclose(fp);
+
+		{
+			LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 1024 * 1024, FALSE);
+			ensure("valid", vfs.isValid());
+			ensure("audit", vfs.audit());
+			ensure("removed", !vfs.getExists(ids[0], LLAssetType::AT_TEXTURE));
+			ensure("renamed away", !vfs.getExists(ids[1], LLAssetType::AT_TEXTURE));
+			ensure_equals("renamed", vfs.getSize(renamed, LLAssetType::AT_SOUND), 4096);
+			for (S32 i = 2; i < FILES; ++i)
+			{
+				ensure_equals("kept", vfs.getSize(ids[i], LLAssetType::AT_TEXTURE), 4096);
+			}
+			ensure("contents", checkFiles(vfs, ids));
+		}
+
+		// and a clean shutdown leaves nothing to replay
+		LLTimer timer;
+		LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 1024 * 1024, FALSE);
+		F64 open_time = timer.getElapsedTimeF64();
+		ensure("valid again", vfs.isValid());
+		ensure("audit again", vfs.audit());
+		ensure("contents again", checkFiles(vfs, ids));
+		llinfos << "VFS reopened with " << FILES << " files in " << open_time * 1000.0 << " ms" << llendl;
+	}
+#endif
+
+	template<> template<>
+	void vfs_object::test<6>()
+	{
+		// compaction packs files down into the holes left by removals,
+		// leaving one free block, but leaves open files where they are
+		const S32 FILES = 64;
+		LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 1024 * 1024, FALSE);
+		ensure("valid", vfs.isValid());
+
+		std::vector<LLUUID> ids(FILES);
+		for (S32 i = 0; i < FILES; ++i)
+		{
+			ids[i].generate();
+			storeFile(vfs, ids[i], 1024 * (1 + i % 7));
+		}
+		for (S32 i = 1; i < FILES; i += 2)
+		{
+			vfs.removeFile(ids[i], LLAssetType::AT_TEXTURE);
+		}
+		ensure("fragmented", vfs.getFragmentation() > 0.f);
+
+		// the last file left
+		const LLUUID& last = ids[FILES - 2];
+		vfs.incLock(last, LLAssetType::AT_TEXTURE, VFSLOCK_OPEN);
+		while (vfs.compact(16 * 1024) > 0)
+		{
+		}
+		ensure("open file not moved", vfs.getFragmentation() > 0.f);
+		ensure("contents while open", checkFiles(vfs, ids));
+
+		vfs.decLock(last, LLAssetType::AT_TEXTURE, VFSLOCK_OPEN);
+		while (vfs.compact(16 * 1024) > 0)
+		{
+		}
+		ensure_equals("one free block", vfs.getFragmentation(), 0.f);
+		ensure("audit", vfs.audit());
+		ensure("contents", checkFiles(vfs, ids));
+		vfs.dumpStatistics();
+
+		// benchmark: allocation latency once the free space has splintered
+		const S32 ALLOCS = 20000;
+		std::vector<LLUUID> churn(256);
+		for (size_t i = 0; i < churn.size(); ++i)
+		{
+			churn[i].generate();
+		}
+		LLTimer timer;
+		for (S32 i = 0; i < ALLOCS; ++i)
+		{
+			const LLUUID& id = churn[ll_rand(churn.size())];
+			vfs.removeFile(id, LLAssetType::AT_TEXTURE);
+			vfs.setMaxSize(id, LLAssetType::AT_TEXTURE, 1024 * (1 + ll_rand(8)));
+		}
+		F64 churn_time = timer.getElapsedTimeF64();
+		llinfos << "VFS allocations: " << ALLOCS << " in " << churn_time * 1000.0 << " ms, "
+				<< vfs.getFragmentation() * 100.f << "% fragmented" << llendl;
+		ensure("contents after churn", checkFiles(vfs, ids));
+	}
+
+	template<> template<>
+	void vfs_object::test<7>()
+	{
+		// compaction copies files without holding the data lock, so readers
+		// running alongside it must still see every byte where they expect it
+		const S32 FILES = 32;
+		const S32 FILE_SIZE = 8 * 1024;
+		LLVFS vfs(TEST_INDEX_NAME, TEST_DATA_NAME, FALSE, 2 * 1024 * 1024, FALSE);
+		ensure("valid", vfs.isValid());
+
+		std::vector<LLUUID> ids(FILES);
+		std::vector<LLUUID> holes(FILES);
+		for (S32 i = 0; i < FILES; ++i)
+		{
+			holes[i].generate();
+			storeFile(vfs, holes[i], 1024 * (1 + i % 5));
+			ids[i].generate();
+			storeFile(vfs, ids[i], FILE_SIZE);
+		}
+		for (S32 i = 0; i < FILES; ++i)
+		{
+			vfs.removeFile(holes[i], LLAssetType::AT_TEXTURE);
+		}
+		ensure("fragmented", vfs.getFragmentation() > 0.f);
+
+		std::vector<ReadThread*> threads;
+		for (S32 i = 0; i < 4; ++i)
+		{
+			threads.push_back(new ReadThread(&vfs, &ids, FILE_SIZE, 0, NULL, true));
+			threads.back()->start();
+		}
+
+		while (vfs.compact(4 * 1024) > 0)
+		{
+		}
+
+		for (size_t i = 0; i < threads.size(); ++i)
+		{
+			threads[i]->mStop = true;
+		}
+		ensure_equals("no bad reads", deleteReaders(threads), 0);
+		ensure_equals("one free block", vfs.getFragmentation(), 0.f);
+		ensure("audit", vfs.audit());
+		ensure("contents", checkFiles(vfs, ids));
+	}
+}
@@ -0,0 +1,108 @@
+/** 
+ * @file llvfsextentmap_tut.cpp
+ * @brief LLVFSExtentMap unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "llvfsextentmap.h"
+
+namespace tut
+{
+	struct vfsextentmap_data
+	{
+		LLVFSExtentMap mMap;
+	};
+	typedef test_group<vfsextentmap_data> vfsextentmap_test;
+	typedef vfsextentmap_test::object vfsextentmap_object;
+	tut::vfsextentmap_test tvfsextentmap("vfsextentmap");
+
+	template<> template<>
+	void vfsextentmap_object::test<1>()
+	{
+		// freed neighbours merge into one extent from either side
+		mMap.addFree(1000, 100);
+		mMap.addFree(1200, 100);
+		ensure_equals("apart", mMap.getExtentCount(), 2);
+		mMap.addFree(1100, 100);
+		ensure_equals("merged", mMap.getExtentCount(), 1);
+		ensure_equals("merged length", mMap.getFreeAt(1000), 300);
+		mMap.addFree(900, 100);
+		mMap.addFree(1300, 50);
+		ensure_equals("still one", mMap.getExtentCount(), 1);
+		ensure_equals("grown", mMap.getFreeAt(900), 450);
+		ensure_equals("total", mMap.getTotalFree(), (U32)450);
+		ensure_equals("no fragmentation", mMap.getFragmentation(), 0.f);
+	}
+
+	template<> template<>
+	void vfsextentmap_object::test<2>()
+	{
+		// using space from the middle of an extent leaves both ends free
+		mMap.addFree(0, 1000);
+		mMap.useFree(400, 200);
+		ensure_equals("split", mMap.getExtentCount(), 2);
+		ensure_equals("front", mMap.getFreeAt(0), 400);
+		ensure_equals("back", mMap.getFreeAt(600), 400);
+		ensure_equals("total", mMap.getTotalFree(), (U32)800);
+		ensure_equals("largest", mMap.getLargestExtent(), 400);
+		ensure_equals("fragmentation", mMap.getFragmentation(), 0.5f);
+
+		mMap.useFree(0, 400);
+		mMap.useFree(600, 400);
+		ensure_equals("all used", mMap.getExtentCount(), 0);
+		ensure_equals("nothing free", mMap.getTotalFree(), (U32)0);
+	}
+
+	template<> template<>
+	void vfsextentmap_object::test<3>()
+	{
+		// best fit takes the smallest extent that's big enough, lowest
+		// first; first fit takes the lowest one before the limit
+		mMap.addFree(5000, 300);
+		mMap.addFree(1000, 500);
+		mMap.addFree(3000, 300);
+		mMap.addFree(8000, 2000);
+
+		U32 location = 0;
+		ensure("best fit", mMap.findBestFit(250, location));
+		ensure_equals("smallest, lowest", location, (U32)3000);
+		ensure("best fit larger", mMap.findBestFit(400, location));
+		ensure_equals("next size up", location, (U32)1000);
+		ensure("too large", !mMap.findBestFit(3000, location));
+
+		ensure("first fit", mMap.findFirstFit(250, 10000, location));
+		ensure_equals("lowest", location, (U32)1000);
+		ensure("first fit limited", mMap.findFirstFit(1000, 10000, location));
+		ensure_equals("only the last", location, (U32)8000);
+		ensure("first fit before limit", !mMap.findFirstFit(1000, 8000, location));
+	}
+}
@@ -0,0 +1,259 @@
+/** 
+ * @file llworkerthread_tut.cpp
+ * @brief LLWorkerThread unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "llsys.h"
+#include "lltimer.h"
+#include "llworkerthread.h"
+
+#include <vector>
+
+namespace tut
+{
+	struct workerthread_data
+	{
+		// Stands in for an image decode: a few passes of an inverse 5/3
+		// wavelet lift over a tile, one pass per doWork() call.
+		class DecodeWorker : public LLWorkerClass
+		{
+		public:
+			enum { TILE = 128, PASSES = 8 };
+
+			DecodeWorker(LLWorkerThread* thread, S32 seed, LLAtomic32<S32>* overlaps)
+			:	LLWorkerClass(thread, "decode test"),
+				mCoeffs(TILE * TILE),
+				mPasses(0),
+				mInWork(0),
+				mOverlaps(overlaps)
+			{
+				for (S32 i = 0; i < TILE * TILE; ++i)
+				{
+					mCoeffs[i] = ((i + seed) * 2654435761U) >> 20;
+				}
+			}
+
+			void decode(U32 priority)	{ addWork(0, priority); }
+			void abort()				{ abortWork(false); }
+			bool isDone()				{ return checkWork(); }
+
+			U32 getChecksum() const
+			{
+				U32 sum = 0;
+				for (S32 i = 0; i < TILE * TILE; ++i)
+				{
+					sum = sum * 31 + (U32)mCoeffs[i];
+				}
+				return sum;
+			}
+
+			/*virtual*/ bool doWork(S32 param)
+			{
+				// a worker's requests must never run on two threads at once
+				if (mInWork++ != 0)
+				{
+					(*mOverlaps)++;
+				}
+				for (S32 y = 0; y < TILE; ++y)
+				{
+					lift(&mCoeffs[y * TILE], 1);
+				}
+				// as a real decode does between steps; must not stall the
+				// request when nothing else is queued
+				yield();
+				for (S32 x = 0; x < TILE; ++x)
+				{
+					lift(&mCoeffs[x], TILE);
+				}
+				mInWork--;
+				return ++mPasses >= PASSES;
+			}
+
+		private:
+			/*virtual*/ void startWork(S32 param) { mPasses = 0; }
+			/*virtual*/ void endWork(S32 param, bool aborted) {}
+
+			static void lift(S32* x, S32 stride)
+			{
+				for (S32 i = 0; i < TILE; i += 2)
+				{
+					S32 left = x[(i > 0 ? i - 1 : 1) * stride];
+					S32 right = x[(i + 1) * stride];
+					x[i * stride] -= (left + right + 2) >> 2;
+				}
+				for (S32 i = 1; i < TILE; i += 2)
+				{
+					S32 left = x[(i - 1) * stride];
+					S32 right = x[(i + 1 < TILE ? i + 1 : i - 1) * stride];
+					x[i * stride] += (left + right) >> 1;
+				}
+			}
+
+			std::vector<S32> mCoeffs;
+			S32 mPasses;
+			LLAtomic32<S32> mInWork;
+			LLAtomic32<S32>* mOverlaps;
+		};
+
+		// Decodes count tiles and waits for them all; returns the seconds
+		// taken, or a negative value if the workers did not finish.
+		static F64 decodeAll(LLWorkerThread& thread, S32 count, S32 abort_every,
+							 U32& checksum, S32& aborted, LLAtomic32<S32>& overlaps)
+		{
+			LLTimer timer;
+			std::vector<DecodeWorker*> workers;
+			for (S32 i = 0; i < count; ++i)
+			{
+				DecodeWorker* worker = new DecodeWorker(&thread, i, &overlaps);
+				worker->decode(LLWorkerThread::PRIORITY_NORMAL + i);
+				workers.push_back(worker);
+			}
+			if (abort_every)
+			{
+				for (S32 i = 0; i < count; i += abort_every)
+				{
+					workers[i]->abort();
+				}
+			}
+
+			checksum = 0;
+			aborted = 0;
+			S32 remaining = count;
+			while (remaining && timer.getElapsedTimeF32() < 60.f)
+			{
+				thread.update(0);
+				for (S32 i = 0; i < count; ++i)
+				{
+					DecodeWorker* worker = workers[i];
+					if (worker && worker->isDone())
+					{
+						if (worker->getFlags(LLWorkerClass::WCF_WORK_ABORTED))
+						{
+							++aborted;
+						}
+						else
+						{
+							checksum += worker->getChecksum() * (i + 1);
+						}
+						worker->scheduleDelete();
+						workers[i] = NULL;
+						--remaining;
+					}
+				}
+				if (remaining && thread.getThreaded())
+				{
+					ms_sleep(1);
+				}
+			}
+			F64 elapsed = timer.getElapsedTimeF64();
+
+			while (thread.getNumDeletes() && timer.getElapsedTimeF32() < 60.f)
+			{
+				thread.update(0);
+			}
+			return remaining ? -1.0 : elapsed;
+		}
+	};
+	typedef test_group<workerthread_data> workerthread_test;
+	typedef workerthread_test::object workerthread_object;
+	tut::workerthread_test twt("workerthread");
+
+	template<> template<>
+	void workerthread_object::test<1>()
+	{
+		// a pool produces the same results as the main thread would, and
+		// never runs one worker on two threads at once
+		const S32 COUNT = 64;
+		LLAtomic32<S32> overlaps(0);
+		U32 expected, checksum;
+		S32 aborted;
+		{
+			LLWorkerThread thread("workerthread main", false, 4);
+			ensure_equals("unthreaded", thread.getNumThreads(), 0);
+			ensure("main thread finished", decodeAll(thread, COUNT, 0, expected, aborted, overlaps) >= 0.0);
+		}
+		{
+			LLWorkerThread thread("workerthread pool", true, 4);
+			ensure_equals("threads", thread.getNumThreads(), 4);
+			ensure("pool finished", decodeAll(thread, COUNT, 0, checksum, aborted, overlaps) >= 0.0);
+			ensure_equals("nothing pending", thread.getPending(), 0);
+		}
+		ensure_equals("same results", checksum, expected);
+		ensure_equals("no aborts", aborted, 0);
+		ensure_equals("no overlapping work", (S32)overlaps, 0);
+	}
+
+	template<> template<>
+	void workerthread_object::test<2>()
+	{
+		// aborting work while the pool is running it
+		const S32 COUNT = 200;
+		LLAtomic32<S32> overlaps(0);
+		U32 checksum;
+		S32 aborted;
+		LLWorkerThread thread("workerthread abort", true, 3);
+		ensure("all workers done", decodeAll(thread, COUNT, 3, checksum, aborted, overlaps) >= 0.0);
+		ensure("no more aborts than requested", aborted <= (COUNT + 2) / 3);
+		ensure_equals("no overlapping work", (S32)overlaps, 0);
+		ensure_equals("nothing pending", thread.getPending(), 0);
+	}
+
+	template<> template<>
+	void workerthread_object::test<3>()
+	{
+		// stress: decode throughput as threads are added, up to one per core
+		const S32 COUNT = 512;
+		S32 max_threads = llclamp(gSysCPU.getNumCores(), 1, 8);
+		LLAtomic32<S32> overlaps(0);
+		U32 expected = 0;
+		F64 base_time = 0.0;
+		for (S32 threads = 1; threads <= max_threads; threads *= 2)
+		{
+			LLWorkerThread thread("workerthread stress", true, threads);
+			U32 checksum;
+			S32 aborted;
+			F64 elapsed = decodeAll(thread, COUNT, 0, checksum, aborted, overlaps);
+			ensure("stress finished", elapsed >= 0.0);
+			if (threads == 1)
+			{
+				expected = checksum;
+				base_time = elapsed;
+			}
+			ensure_equals("same results", checksum, expected);
+			llinfos << "Decoded " << COUNT << " tiles on " << threads << " threads: "
+					<< elapsed * 1000.0 << " ms ("
+					<< (elapsed > 0.0 ? base_time / elapsed : 0.0) << "x)" << llendl;
+		}
+		ensure_equals("no overlapping work", (S32)overlaps, 0);
+	}
+}
@@ -0,0 +1,340 @@
+/** 
+ * @file llzerocode_tut.cpp
+ * @brief LLZeroCode unit tests
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "lltut.h"
+
+#include "llrand.h"
+#include "llsys.h"
+#include "lltimer.h"
+#include "llzerocode.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace tut
+{
+	struct zerocode_data
+	{
+		// tests pick the scanners, so put back whatever was chosen
+		zerocode_data() : mUseSSE2(LLZeroCode::getUseSSE2()) {}
+		~zerocode_data() { LLZeroCode::setUseSSE2(mUseSSE2); }
+
+		// fills buffer with roughly zero_percent zero bytes and,
+		// sometimes, one long zero run to exercise the 255 wrap
+		static void fillPacket(std::vector<U8>& buffer, S32 zero_percent)
+		{
+			S32 size = (S32)buffer.size();
+			for (S32 i = 0; i < size; ++i)
+			{
+				buffer[i] = (ll_rand(100) < zero_percent) ? 0 : (U8)ll_rand(256);
+			}
+			if (size > 600 && ll_rand(4) == 0)
+			{
+				S32 start = ll_rand(size - 600);
+				S32 length = ll_rand(600);
+				memset(&buffer[start], 0, length);
+			}
+		}
+
+		// encodes in with every scanner available and checks the result
+		// against expected, byte for byte
+		static void checkEncode(const char* name, const std::vector<U8>& in, const std::vector<U8>& expected)
+		{
+			LLCPUInfo cpu;
+			S32 size = (S32)in.size();
+			for (S32 sse2 = 0; sse2 < (cpu.hasSSE2() ? 2 : 1); ++sse2)
+			{
+				LLZeroCode::setUseSSE2(sse2 != 0);
+				std::vector<U8> out(2 * size + 1);
+				S32 out_size = LLZeroCode::encode(size ? &in[0] : NULL, size, &out[0]);
+				ensure_equals(name, out_size, (S32)expected.size());
+				ensure(name, std::equal(expected.begin(), expected.end(), out.begin()));
+				ensure_equals(name, LLZeroCode::encodedSize(size ? &in[0] : NULL, size), out_size);
+				out_size = LLZeroCode::encodeScalar(size ? &in[0] : NULL, size, &out[0]);
+				ensure_equals(name, out_size, (S32)expected.size());
+				ensure(name, std::equal(expected.begin(), expected.end(), out.begin()));
+			}
+		}
+
+		// expands in into out_size bytes with every scanner available;
+		// expected_size is -1 for overflow, else expected holds the data
+		static void checkExpand(const char* name, const std::vector<U8>& in, S32 out_size,
+								S32 expected_size, const std::vector<U8>& expected)
+		{
+			LLCPUInfo cpu;
+			for (S32 sse2 = 0; sse2 < (cpu.hasSSE2() ? 2 : 1); ++sse2)
+			{
+				LLZeroCode::setUseSSE2(sse2 != 0);
+				for (S32 bulk = 0; bulk < 2; ++bulk)
+				{
+					std::vector<U8> out(out_size + 1, 0xff);
+					S32 size = bulk
+						? LLZeroCode::expand(&in[0], (S32)in.size(), &out[0], out_size)
+						: LLZeroCode::expandScalar(&in[0], (S32)in.size(), &out[0], out_size);
+					ensure_equals(name, size, expected_size);
+					if (expected_size >= 0)
+					{
+						ensure(name, std::equal(expected.begin(), expected.end(), out.begin()));
+					}
+				}
+			}
+		}
+
+		static std::vector<U8> bytes(const U8* data, S32 size)
+		{
+			return std::vector<U8>(data, data + size);
+		}
+
+		bool mUseSSE2;
+	};
+	typedef test_group<zerocode_data> zerocode_test;
+	typedef zerocode_test::object zerocode_object;
+	tut::zerocode_test zerocode("zerocode");
+
+	template<> template<>
+	void zerocode_object::test<1>()
+		// run lengths around the 255 wrap
+	{
+		const S32 runs[] = { 1, 2, 254, 255, 256, 509, 510, 511 };
+		for (S32 r = 0; r < (S32)(sizeof(runs) / sizeof(runs[0])); ++r)
+		{
+			std::vector<U8> packet(runs[r] + 2, 0);
+			packet[0] = 7;
+			packet[runs[r] + 1] = 9;
+			std::vector<U8> encoded(2 * packet.size());
+			S32 encoded_size = LLZeroCode::encode(&packet[0], (S32)packet.size(), &encoded[0]);
+			ensure_equals("encoded size", encoded_size, 2 + 2 * ((runs[r] + 254) / 255));
+			ensure_equals("size only", LLZeroCode::encodedSize(&packet[0], (S32)packet.size()), encoded_size);
+
+			std::vector<U8> expanded(packet.size());
+			S32 expanded_size = LLZeroCode::expand(&encoded[0], encoded_size, &expanded[0], (S32)expanded.size());
+			ensure_equals("expanded size", expanded_size, (S32)packet.size());
+			ensure("round trip", expanded == packet);
+		}
+	}
+
+	template<> template<>
+	void zerocode_object::test<2>()
+		// bulk and byte at a time versions agree on random packets
+	{
+		LLCPUInfo cpu;
+		for (S32 sse2 = 0; sse2 < (cpu.hasSSE2() ? 2 : 1); ++sse2)
+		{
+			LLZeroCode::setUseSSE2(sse2 != 0);
+			for (S32 i = 0; i < 20000; ++i)
+			{
+				std::vector<U8> packet(ll_rand(1300));
+				fillPacket(packet, ll_rand(100));
+				S32 size = (S32)packet.size();
+
+				std::vector<U8> bulk(2 * size + 1);
+				std::vector<U8> scalar(2 * size + 1);
+				S32 bulk_size = LLZeroCode::encode(size ? &packet[0] : NULL, size, &bulk[0]);
+				S32 scalar_size = LLZeroCode::encodeScalar(size ? &packet[0] : NULL, size, &scalar[0]);
+				ensure_equals("encoded size", bulk_size, scalar_size);
+				ensure("encoded data", !memcmp(&bulk[0], &scalar[0], bulk_size));
+
+				std::vector<U8> expanded(size + 1);
+				S32 expanded_size = LLZeroCode::expand(&bulk[0], bulk_size, &expanded[0], size + 1);
+				ensure_equals("expanded size", expanded_size, size);
+				ensure("expanded data", !memcmp(&expanded[0], size ? &packet[0] : NULL, size));
+			}
+		}
+	}
+
+	template<> template<>
+	void zerocode_object::test<3>()
+		// bulk and byte at a time expansion agree on arbitrary input
+	{
+		LLCPUInfo cpu;
+		for (S32 sse2 = 0; sse2 < (cpu.hasSSE2() ? 2 : 1); ++sse2)
+		{
+			LLZeroCode::setUseSSE2(sse2 != 0);
+			for (S32 i = 0; i < 20000; ++i)
+			{
+				std::vector<U8> packet(1 + ll_rand(1300));
+				fillPacket(packet, ll_rand(100));
+				S32 out_size = 1 + ll_rand(4096);
+
+				std::vector<U8> bulk(out_size);
+				std::vector<U8> scalar(out_size);
+				S32 bulk_size = LLZeroCode::expand(&packet[0], (S32)packet.size(), &bulk[0], out_size);
+				S32 scalar_size = LLZeroCode::expandScalar(&packet[0], (S32)packet.size(), &scalar[0], out_size);
+				ensure_equals("expanded size", bulk_size, scalar_size);
+				if (bulk_size > 0)
+				{
+					ensure("expanded data", !memcmp(&bulk[0], &scalar[0], bulk_size));
+				}
+			}
+		}
+	}
+
+	template<> template<>
+	void zerocode_object::test<4>()
+		// throughput on object update like packets, with the scanners
+		// the processor gets
+	{
+		LLCPUInfo cpu;
+		LLZeroCode::initClass(cpu);
+		ensure_equals("SSE2 chosen when present", LLZeroCode::getUseSSE2(), cpu.hasSSE2());
+
+		const S32 PACKETS = 256;
+		const S32 PASSES = 200;
+		std::vector<std::vector<U8> > packets(PACKETS);
+		std::vector<std::vector<U8> > encoded(PACKETS);
+		std::vector<S32> encoded_sizes(PACKETS);
+		S64 total = 0;
+		for (S32 i = 0; i < PACKETS; ++i)
+		{
+			packets[i].resize(1000 + ll_rand(200));
+			fillPacket(packets[i], 40);
+			encoded[i].resize(2 * packets[i].size());
+			total += packets[i].size();
+		}
+
+		std::vector<U8> out(4096);
+		F64 times[2][2];
+		for (S32 bulk = 0; bulk < 2; ++bulk)
+		{
+			LLTimer timer;
+			for (S32 pass = 0; pass < PASSES; ++pass)
+			{
+				for (S32 i = 0; i < PACKETS; ++i)
+				{
+					S32 size = (S32)packets[i].size();
+					encoded_sizes[i] = bulk
+						? LLZeroCode::encode(&packets[i][0], size, &encoded[i][0])
+						: LLZeroCode::encodeScalar(&packets[i][0], size, &encoded[i][0]);
+				}
+			}
+			times[bulk][0] = timer.getElapsedTimeF64();
+
+			timer.reset();
+			for (S32 pass = 0; pass < PASSES; ++pass)
+			{
+				for (S32 i = 0; i < PACKETS; ++i)
+				{
+					S32 size = bulk
+						? LLZeroCode::expand(&encoded[i][0], encoded_sizes[i], &out[0], (S32)out.size())
+						: LLZeroCode::expandScalar(&encoded[i][0], encoded_sizes[i], &out[0], (S32)out.size());
+					ensure_equals("expanded size", size, (S32)packets[i].size());
+				}
+			}
+			times[bulk][1] = timer.getElapsedTimeF64();
+		}
+
+		F64 megabytes = (F64)(total * PASSES) / (1024.0 * 1024.0);
+		llinfos << "Zero code MB/s (" << (LLZeroCode::getUseSSE2() ? "SSE2" : "byte") << " scan): encode " 
+				<< megabytes / llmax(times[0][0], 0.0001) << " scalar, "
+				<< megabytes / llmax(times[1][0], 0.0001) << " bulk; expand "
+				<< megabytes / llmax(times[0][1], 0.0001) << " scalar, "
+				<< megabytes / llmax(times[1][1], 0.0001) << " bulk" << llendl;
+	}
+
+	template<> template<>
+	void zerocode_object::test<5>()
+		// encodings worked out by hand from the loop message.cpp used
+		// before the bulk versions
+	{
+		checkEncode("empty", std::vector<U8>(), std::vector<U8>());
+
+		const U8 literal[] = { 1, 2, 3 };
+		checkEncode("no zeroes", bytes(literal, 3), bytes(literal, 3));
+
+		const U8 one_zero[] = { 0 };
+		const U8 one_zero_encoded[] = { 0, 1 };
+		checkEncode("one zero", bytes(one_zero, 1), bytes(one_zero_encoded, 2));
+
+		const U8 inner[] = { 5, 0, 0, 0, 6 };
+		const U8 inner_encoded[] = { 5, 0, 3, 6 };
+		checkEncode("inner run", bytes(inner, 5), bytes(inner_encoded, 4));
+
+		const U8 ends[] = { 0, 0, 7, 0 };
+		const U8 ends_encoded[] = { 0, 2, 7, 0, 1 };
+		checkEncode("runs at both ends", bytes(ends, 4), bytes(ends_encoded, 5));
+
+		// a run of 255 fills one count; the next zero starts a new run
+		const U8 full_encoded[] = { 0, 255 };
+		checkEncode("255 zeroes", std::vector<U8>(255, 0), bytes(full_encoded, 2));
+		const U8 wrap_encoded[] = { 0, 255, 0, 1 };
+		checkEncode("256 zeroes", std::vector<U8>(256, 0), bytes(wrap_encoded, 4));
+		const U8 two_full_encoded[] = { 0, 255, 0, 255 };
+		checkEncode("510 zeroes", std::vector<U8>(510, 0), bytes(two_full_encoded, 4));
+
+		std::vector<U8> long_run(302, 0);
+		long_run.front() = 9;
+		long_run.back() = 9;
+		const U8 long_run_encoded[] = { 9, 0, 255, 0, 45, 9 };
+		checkEncode("300 zeroes between", long_run, bytes(long_run_encoded, 6));
+	}
+
+	template<> template<>
+	void zerocode_object::test<6>()
+		// expansions worked out by hand from the loop message.cpp used
+		// before the bulk versions, including truncated and oversized
+		// input.  It turned down a count running past the end with -2
+		// and every other overflow with -1; these return -1 for all.
+	{
+		const U8 inner_encoded[] = { 5, 0, 3, 6 };
+		const U8 inner[] = { 5, 0, 0, 0, 6 };
+		checkExpand("inner run", bytes(inner_encoded, 4), 5, 5, bytes(inner, 5));
+		checkExpand("inner run, one short", bytes(inner_encoded, 4), 4, -1, std::vector<U8>());
+
+		const U8 wrap_encoded[] = { 0, 255, 0, 1 };
+		checkExpand("256 zeroes", bytes(wrap_encoded, 4), 257, 256, std::vector<U8>(256, 0));
+		checkExpand("256 zeroes, no spare", bytes(wrap_encoded, 4), 256, -1, std::vector<U8>());
+
+		const U8 literal[] = { 1, 2, 3 };
+		checkExpand("literal", bytes(literal, 3), 3, 3, bytes(literal, 3));
+		checkExpand("literal overflow", bytes(literal, 3), 2, -1, std::vector<U8>());
+
+		// a run needs a byte to spare past its end, as it always did
+		const U8 big_count[] = { 0, 200 };
+		checkExpand("count fits", bytes(big_count, 2), 201, 200, std::vector<U8>(200, 0));
+		checkExpand("count overflow", bytes(big_count, 2), 200, -1, std::vector<U8>());
+
+		// 0 0 adds 256 more zeroes, and needs room for all of them
+		// beyond the byte just written
+		const U8 double_zero[] = { 0, 0, 5 };
+		checkExpand("0 0 count", bytes(double_zero, 3), 300, 261, std::vector<U8>(261, 0));
+		const U8 double_zero_one[] = { 0, 0, 1 };
+		checkExpand("0 0 with room", bytes(double_zero_one, 3), 258, 257, std::vector<U8>(257, 0));
+		checkExpand("0 0 without room", bytes(double_zero_one, 3), 257, -1, std::vector<U8>());
+
+		// cut off before the count: the zero stands alone
+		const U8 truncated[] = { 7, 0 };
+		checkExpand("truncated run", bytes(truncated, 2), 16, 2, bytes(truncated, 2));
+		const U8 truncated_double[] = { 0, 0 };
+		checkExpand("truncated 0 0", bytes(truncated_double, 2), 300, 257, std::vector<U8>(257, 0));
+	}
+}
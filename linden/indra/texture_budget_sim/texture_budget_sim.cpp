@@ -0,0 +1,503 @@
+/** 
+ * @file texture_budget_sim.cpp
+ * @brief Flies a camera through a textured scene and compares texture memory policies.
+ *
+ * $LicenseInfo:firstyear=2009&license=viewergpl$
+ * 
+ * Copyright (c) 2009, Linden Research, Inc.
+ * 
+ * Second Life Viewer Source Code
+ * The source code in this file ("Source Code") is provided by Linden Lab
+ * to you under the terms of the GNU General Public License, version 2.0
+ * ("GPL"), unless you have obtained a separate licensing agreement
+ * ("Other License"), formally executed by you and Linden Lab.  Terms of
+ * the GPL can be found in doc/GPL-license.txt in this distribution, or
+ * online at http://secondlifegrid.net/programs/open_source/licensing/gplv2
+ * 
+ * There are special exceptions to the terms and conditions of the GPL as
+ * it is applied to this Source Code. View the full text of the exception
+ * in the file doc/FLOSS-exception.txt in this software distribution, or
+ * online at
+ * http://secondlifegrid.net/programs/open_source/licensing/flossexception
+ * 
+ * By copying, modifying or distributing this software, you acknowledge
+ * that you have read and understood your obligations described above,
+ * and agree to abide by those obligations.
+ * 
+ * ALL LINDEN LAB SOURCE CODE IS PROVIDED "AS IS." LINDEN LAB MAKES NO
+ * WARRANTIES, EXPRESS, IMPLIED OR OTHERWISE, REGARDING ITS ACCURACY,
+ * COMPLETENESS OR PERFORMANCE.
+ * $/LicenseInfo$
+ */
+
+// Flies a camera along a weaving path through a field of textured
+// objects, with a fixed texture memory budget and fetch bandwidth, and
+// runs the same flight under two policies:
+//  - bias: the viewer's old scheme, which raises a discard bias for every
+//    texture while memory is over budget and evicts a level at a time
+//  - budget: LLTextureBudget, solved ten times a second, with targeted
+//    eviction and prefetch along the camera's motion
+// Reported:
+//  - resident texture memory, mean and peak, and how often it was over
+//  - blur: discard levels short of what the view needs, averaged over
+//    the visible pixels
+//  - prefetch: how often a texture was already sharp enough at the
+//    moment the view first needed it finer
+//  - fetched: texture data fetched and decoded over the flight
+
+#include "linden_common.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "apr_getopt.h"
+#include "apr_pools.h"
+
+#include "llapr.h"
+#include "llerrorcontrol.h"
+#include "llimage.h"
+#include "llmath.h"
+#include "llrand.h"
+#include "lltexturebudget.h"
+
+static const F32 FRAME_TIME = 1.f / 30.f;
+static const F32 SOLVE_INTERVAL = 0.1f;			// as LLViewerImageList
+static const F32 SCREEN_WIDTH = 1024.f;
+static const F32 SCREEN_HEIGHT = 768.f;
+static const F32 HALF_FOV = 0.5f;				// radians, vertically and horizontally
+static const F32 MIN_VISIBLE_AREA = 10.f;		// as LLViewerImage
+
+// the old LLViewerImage tuning
+static const F32 BIAS_DELTA = .05f;
+static const F32 BIAS_INTERVAL = .5f;
+static const F32 BIAS_MAX = 1.5f;
+static const F32 BIAS_SCALE = 1.1f;
+static const F32 LOWER_BOUND_SCALE = .85f;
+static const F32 MIDDLE_BOUND_SCALE = .925f;
+static const F32 BOUND_LIFETIME = 10.f;			// as LLImageGL::getBoundRecently()
+
+struct LLSimObject
+{
+	F32 mX;
+	F32 mY;
+	F32 mRadius;
+	S32 mSize;				// texture width and height
+	S32 mComponents;
+};
+
+struct LLSimTexture
+{
+	LLSimTexture() : mDiscard(MAX_DISCARD_LEVEL + 1), mTarget(MAX_DISCARD_LEVEL + 1),
+					 mNeeded(MAX_DISCARD_LEVEL + 1), mLastNeeded(MAX_DISCARD_LEVEL + 1),
+					 mLastVisible(-1000.f) {}
+
+	S32 mDiscard;			// resident level, MAX_DISCARD_LEVEL + 1 if none
+	S32 mTarget;			// what the policy wants fetched
+	S32 mNeeded;			// what the view needs this frame
+	S32 mLastNeeded;		// and when it was last visible
+	F32 mLastVisible;
+};
+
+struct LLSimResults
+{
+	LLSimResults() : mMeanBytes(0.0), mPeakBytes(0), mOverFrames(0), mFrames(0),
+					 mBlur(0.0), mNeedEvents(0), mPrefetchHits(0), mFetchedBytes(0.0) {}
+
+	F64 mMeanBytes;
+	S64 mPeakBytes;
+	U32 mOverFrames;
+	U32 mFrames;
+	F64 mBlur;
+	U32 mNeedEvents;
+	U32 mPrefetchHits;
+	F64 mFetchedBytes;
+};
+
+enum EPolicy
+{
+	POLICY_BIAS,
+	POLICY_BUDGET
+};
+
+static S64 texture_bytes(const LLSimObject& object, S32 discard)
+{
+	if (discard > MAX_DISCARD_LEVEL)
+	{
+		return 0;
+	}
+	return LLTextureBudget::calcBytes(object.mSize, object.mSize, object.mComponents, discard);
+}
+
+static void camera_at(F32 time, F32 speed, F32& x, F32& y, F32& vx, F32& vy)
+{
+	// weave from side to side so that not everything ahead gets closer
+	const F32 AMPLITUDE = 40.f;
+	const F32 PERIOD = 12.f;
+	F32 w = F_TWO_PI / PERIOD;
+	x = speed * time;
+	y = AMPLITUDE * sinf(w * time);
+	vx = speed;
+	vy = AMPLITUDE * w * cosf(w * time);
+}
+
+static void solve_budget(const std::vector<LLSimObject>& objects, std::vector<LLSimTexture>& textures,
+						 const std::vector<F32>& areas, const std::vector<F32>& distances, const std::vector<F32>& approach,
+						 F32 time, S64 budget_bytes, LLTextureBudget& budget,
+						 LLTextureBudget::entry_list_t& entries, S64& resident_bytes)
+{
+	S32 count = (S32)objects.size();
+	for (S32 i = 0; i < count; ++i)
+	{
+		const LLSimObject& object = objects[i];
+		LLTextureBudget::Entry& entry = entries[i];
+		entry.mWidth = object.mSize;
+		entry.mHeight = object.mSize;
+		entry.mComponents = object.mComponents;
+		entry.mWantedDiscard = textures[i].mLastNeeded;
+		entry.mPixelArea = areas[i];
+		entry.mDistance = distances[i];
+		entry.mApproachSpeed = approach[i];
+		entry.mTimeSinceBound = time - textures[i].mLastVisible;
+		entry.mResidentDiscard = textures[i].mDiscard;
+	}
+	budget.solve(entries, budget_bytes);
+	for (S32 i = 0; i < count; ++i)
+	{
+		// evict straight down to the chosen level
+		LLSimTexture& texture = textures[i];
+		texture.mTarget = entries[i].mDiscard;
+		if (texture.mDiscard < texture.mTarget)
+		{
+			resident_bytes -= texture_bytes(objects[i], texture.mDiscard);
+			texture.mDiscard = texture.mTarget;
+			resident_bytes += texture_bytes(objects[i], texture.mDiscard);
+		}
+	}
+}
+
+static void run_flight(const std::vector<LLSimObject>& objects, EPolicy policy,
+					   S64 budget_bytes, S32 bandwidth, F32 seconds, F32 speed,
+					   LLSimResults& results)
+{
+	S32 count = (S32)objects.size();
+	std::vector<LLSimTexture> textures(count);
+	std::vector<F32> areas(count);
+	std::vector<F32> distances(count);
+	std::vector<F32> approach(count);
+	std::vector<std::pair<F32, S32> > fetch_order;
+
+	LLTextureBudget budget;
+	LLTextureBudget::entry_list_t entries(count);
+	F32 bias = 0.f;
+	F32 next_evaluation = 0.f;
+	S64 resident_bytes = 0;
+	F32 focal = (SCREEN_HEIGHT * 0.5f) / tanf(HALF_FOV);
+
+	for (F32 time = 0.f; time < seconds; time += FRAME_TIME)
+	{
+		F32 cx, cy, vx, vy;
+		camera_at(time, speed, cx, cy, vx, vy);
+		F32 vlen = sqrtf(vx * vx + vy * vy);
+		F32 fx = vx / vlen;
+		F32 fy = vy / vlen;
+
+		// what's on screen
+		for (S32 i = 0; i < count; ++i)
+		{
+			const LLSimObject& object = objects[i];
+			F32 dx = object.mX - cx;
+			F32 dy = object.mY - cy;
+			F32 distance = llmax(sqrtf(dx * dx + dy * dy), 0.1f);
+			F32 ahead = (dx * fx + dy * fy) / distance;
+			F32 area = 0.f;
+			if (ahead > cosf(HALF_FOV))
+			{
+				F32 radius = object.mRadius / distance * focal;
+				area = llmin(F_PI * radius * radius, SCREEN_WIDTH * SCREEN_HEIGHT);
+			}
+			areas[i] = area > MIN_VISIBLE_AREA ? area : 0.f;
+			distances[i] = distance;
+			approach[i] = (dx * vx + dy * vy) / distance;
+
+			LLSimTexture& texture = textures[i];
+			S32 needed = MAX_DISCARD_LEVEL + 1;
+			if (areas[i] > 0.f)
+			{
+				texture.mLastVisible = time;
+				needed = llmin(LLTextureBudget::calcDiscardLevel((F32)object.mSize * object.mSize, areas[i]),
+							   MAX_DISCARD_LEVEL);
+				if (needed < texture.mNeeded)
+				{
+					results.mNeedEvents++;
+					if (texture.mDiscard <= needed)
+					{
+						results.mPrefetchHits++;
+					}
+				}
+				texture.mLastNeeded = needed;
+			}
+			texture.mNeeded = needed;
+		}
+
+		// what the policy wants
+		if (policy == POLICY_BIAS)
+		{
+			if (time >= next_evaluation)
+			{
+				next_evaluation = time + BIAS_INTERVAL;
+				if (resident_bytes >= budget_bytes)
+				{
+					bias += BIAS_DELTA;
+				}
+				else if (bias > 0.f && resident_bytes < budget_bytes * LOWER_BOUND_SCALE)
+				{
+					bias -= BIAS_DELTA;
+				}
+				bias = llclamp(bias, 0.f, BIAS_MAX);
+			}
+			for (S32 i = 0; i < count; ++i)
+			{
+				const LLSimObject& object = objects[i];
+				LLSimTexture& texture = textures[i];
+				if (areas[i] <= 0.f)
+				{
+					texture.mTarget = MAX_DISCARD_LEVEL + 1;
+				}
+				else
+				{
+					F32 discard = (F32)(log((F32)object.mSize * object.mSize / areas[i]) / log(4.0)) - .5f;
+					discard = floorf((discard + bias) * BIAS_SCALE);
+					texture.mTarget = llclamp((S32)discard, 0, MAX_DISCARD_LEVEL);
+				}
+				if (bias > 0.f && texture.mDiscard <= MAX_DISCARD_LEVEL &&
+					resident_bytes > budget_bytes * MIDDLE_BOUND_SCALE &&
+					(texture.mTarget > texture.mDiscard || time - texture.mLastVisible > BOUND_LIFETIME))
+				{
+					// one level at a time, and only the ones that can go
+					resident_bytes -= texture_bytes(object, texture.mDiscard);
+					texture.mDiscard++;
+					resident_bytes += texture_bytes(object, texture.mDiscard);
+				}
+			}
+		}
+		else
+		{
+			if (time >= next_evaluation)
+			{
+				next_evaluation = time + SOLVE_INTERVAL;
+				solve_budget(objects, textures, areas, distances, approach, time, budget_bytes,
+							 budget, entries, resident_bytes);
+			}
+			for (S32 i = 0; i < count; ++i)
+			{
+				// seen since the last solve: as the viewer, fetch what the
+				// view needs until the next one takes it into account
+				if (areas[i] > 0.f && entries[i].mUtility <= 0.f)
+				{
+					textures[i].mTarget = textures[i].mNeeded;
+				}
+			}
+		}
+
+		// fetch and decode, biggest on screen first, a level at a time
+		fetch_order.clear();
+		for (S32 i = 0; i < count; ++i)
+		{
+			const LLSimTexture& texture = textures[i];
+			S32 target = llmin(texture.mTarget, MAX_DISCARD_LEVEL);
+			if (texture.mDiscard > target && (areas[i] > 0.f || texture.mTarget <= MAX_DISCARD_LEVEL))
+			{
+				fetch_order.push_back(std::make_pair(areas[i], i));
+			}
+		}
+		std::sort(fetch_order.begin(), fetch_order.end(), std::greater<std::pair<F32, S32> >());
+		S64 fetch_bytes = (S64)(bandwidth * FRAME_TIME);
+		for (std::vector<std::pair<F32, S32> >::iterator iter = fetch_order.begin();
+			 iter != fetch_order.end() && fetch_bytes > 0; ++iter)
+		{
+			const LLSimObject& object = objects[iter->second];
+			LLSimTexture& texture = textures[iter->second];
+			S32 finer = llmin(texture.mDiscard - 1, MAX_DISCARD_LEVEL);
+			S64 bytes = texture_bytes(object, finer) - texture_bytes(object, texture.mDiscard);
+			fetch_bytes -= bytes;
+			resident_bytes += bytes;
+			results.mFetchedBytes += bytes;
+			texture.mDiscard = finer;
+		}
+
+		// how it looks
+		F64 area_total = 0.0;
+		F64 blur_total = 0.0;
+		for (S32 i = 0; i < count; ++i)
+		{
+			if (areas[i] > 0.f)
+			{
+				area_total += areas[i];
+				blur_total += areas[i] * llmax(0, textures[i].mDiscard - textures[i].mNeeded);
+			}
+		}
+		results.mFrames++;
+		results.mMeanBytes += resident_bytes;
+		results.mPeakBytes = llmax(results.mPeakBytes, resident_bytes);
+		if (resident_bytes > budget_bytes)
+		{
+			results.mOverFrames++;
+		}
+		if (area_total > 0.0)
+		{
+			results.mBlur += blur_total / area_total;
+		}
+	}
+	if (results.mFrames)
+	{
+		results.mMeanBytes /= results.mFrames;
+		results.mBlur /= results.mFrames;
+	}
+}
+
+static void report(std::ostream& s, const char* name, const LLSimResults& results)
+{
+	s << llformat("%8s%10.1f%10.1f%8.1f%8.2f%11.1f%11.1f",
+				  name,
+				  results.mMeanBytes / (1024.0 * 1024.0),
+				  results.mPeakBytes / (1024.0 * 1024.0),
+				  results.mFrames ? 100.f * results.mOverFrames / results.mFrames : 0.f,
+				  results.mBlur,
+				  results.mNeedEvents ? 100.f * results.mPrefetchHits / results.mNeedEvents : 0.f,
+				  results.mFetchedBytes / (1024.0 * 1024.0))
+	  << std::endl;
+}
+
+static const apr_getopt_option_t SIM_CL_OPTIONS[] =
+{
+	{"help", 'h', 0, "Print the help message."},
+	{"budget", 'b', 1, "Texture memory budget in MB (default: 64)."},
+	{"objects", 'o', 1, "Textured objects in the scene (default: 2000)."},
+	{"speed", 's', 1, "Camera speed in m/s (default: 20)."},
+	{"time", 't', 1, "Length of the flight in seconds (default: 60)."},
+	{"bandwidth", 'w', 1, "Fetch and decode rate in MB/s (default: 16)."},
+	{0, 0, 0, 0}
+};
+
+void stream_usage(std::ostream& s, const char* app)
+{
+	s << "Usage: " << app << " [OPTIONS]" << std::endl
+	  << std::endl;
+
+	s << "Flies a camera through a field of textured objects under a texture" << std::endl
+	  << "memory budget, once with the discard bias scheme and once with the" << std::endl
+	  << "texture budget solver, and reports memory use, blur and prefetch." << std::endl << std::endl;
+
+	s << "Options: " << std::endl;
+	const apr_getopt_option_t* option = &SIM_CL_OPTIONS[0];
+	while(option->name)
+	{
+		s << "  ";
+		s << "  -" << (char)option->optch << ", --" << option->name
+		  << std::endl;
+		s << "\t" << option->description << std::endl << std::endl;
+		++option;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	LLError::initForApplication(".");
+	LLError::setDefaultLevel(LLError::LEVEL_WARN);
+
+	ll_init_apr();
+
+	apr_pool_t* pool = NULL;
+	if(APR_SUCCESS != apr_pool_create(&pool, NULL))
+	{
+		std::cerr << "Unable to initialize pool" << std::endl;
+		return 1;
+	}
+	apr_getopt_t* os = NULL;
+	if(APR_SUCCESS != apr_getopt_init(&os, pool, argc, argv))
+	{
+		std::cerr << "Unable to parse options" << std::endl;
+		return 1;
+	}
+
+	S32 budget_mb = 64;
+	S32 object_count = 2000;
+	F32 speed = 20.f;
+	F32 seconds = 60.f;
+	S32 bandwidth_mb = 16;
+
+	apr_status_t apr_err;
+	const char* opt_arg = NULL;
+	int opt_id = 0;
+	while(true)
+	{
+		apr_err = apr_getopt_long(os, SIM_CL_OPTIONS, &opt_id, &opt_arg);
+		if(APR_STATUS_IS_EOF(apr_err)) break;
+		if(apr_err)
+		{
+			char buf[255];		/* Flawfinder: ignore */
+			std::cerr << "Error parsing options: "
+					  << apr_strerror(apr_err, buf, 255) << std::endl;
+			return 1;
+		}
+		switch (opt_id)
+		{
+		case 'h':
+			stream_usage(std::cout, argv[0]);
+			return 0;
+		case 'b':
+			budget_mb = llmax(1, atoi(opt_arg));
+			break;
+		case 'o':
+			object_count = llmax(1, atoi(opt_arg));
+			break;
+		case 's':
+			speed = llmax(0.1f, (F32)atof(opt_arg));
+			break;
+		case 't':
+			seconds = llmax(1.f, (F32)atof(opt_arg));
+			break;
+		case 'w':
+			bandwidth_mb = llmax(1, atoi(opt_arg));
+			break;
+		default:
+			stream_usage(std::cerr, argv[0]);
+			return 1;
+		}
+	}
+
+	// the same scene for both runs
+	const S32 SIZES[] = { 128, 256, 512, 512, 1024 };
+	F32 length = speed * seconds + 200.f;
+	std::vector<LLSimObject> objects(object_count);
+	for (S32 i = 0; i < object_count; ++i)
+	{
+		LLSimObject& object = objects[i];
+		object.mX = ll_frand(length) - 50.f;
+		object.mY = ll_frand(200.f) - 100.f;
+		object.mRadius = 0.5f + ll_frand(4.5f);
+		object.mSize = SIZES[ll_rand(LL_ARRAY_SIZE(SIZES))];
+		object.mComponents = ll_rand(4) ? 3 : 4;
+	}
+
+	std::cout << object_count << " objects, " << budget_mb << "MB budget, "
+			  << bandwidth_mb << "MB/s fetch, " << speed << "m/s for " << seconds << "s"
+			  << std::endl << std::endl;
+	std::cout << llformat("%8s%10s%10s%8s%8s%11s%11s",
+						  "Policy", "Mean MB", "Peak MB", "Over %", "Blur", "Prefetch %", "Fetched MB") << std::endl;
+
+	LLSimResults bias_results;
+	run_flight(objects, POLICY_BIAS, (S64)budget_mb * 1024 * 1024, bandwidth_mb * 1024 * 1024,
+			   seconds, speed, bias_results);
+	report(std::cout, "bias", bias_results);
+
+	LLSimResults budget_results;
+	run_flight(objects, POLICY_BUDGET, (S64)budget_mb * 1024 * 1024, bandwidth_mb * 1024 * 1024,
+			   seconds, speed, budget_results);
+	report(std::cout, "budget", budget_results);
+
+	ll_cleanup_apr();
+	return 0;
+}